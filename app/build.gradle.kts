@@ -198,7 +198,9 @@ dependencies {
     implementation(libs.androidx.hilt.work)
 
     // Compression (Wine/Box64 binaries and NSIS extraction)
-    implementation(libs.zstd.jni) // Zstandard with JNI (includes Android ARM64 libs)
+    // Zstandard; the AAR carries the Android builds of libzstd-jni, the jar only
+    // glibc ones. archive_extract resolves its ZSTD_* symbols at runtime
+    implementation(libs.zstd.jni) { artifact { type = "aar" } }
     implementation(libs.commons.compress) // Apache Commons Compress for tar/zip
     implementation(libs.xz) // XZ-Java for .txz decompression
     implementation(libs.sevenz.jbinding) // 7-Zip-JBinding-4Android for NSIS extraction
@@ -0,0 +1,160 @@
+package com.steamdeck.mobile.core.winlator
+
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import com.github.luben.zstd.ZstdOutputStream
+import org.apache.commons.compress.archivers.tar.TarArchiveEntry
+import org.apache.commons.compress.archivers.tar.TarArchiveOutputStream
+import org.junit.After
+import org.junit.Assume.assumeTrue
+import org.junit.Before
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.io.FileOutputStream
+import kotlin.random.Random
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+import kotlin.test.assertNull
+
+/**
+ * Native archive extractor tests (libarchive_extract.so)
+ *
+ * The inputs are built on the device: a tar written with Commons Compress
+ * and compressed by zstd-jni without a content size, so the streaming
+ * decoder (extract_stream) is used rather than the parallel one.
+ */
+@RunWith(AndroidJUnit4::class)
+class NativeArchiveTest {
+
+    companion object {
+        // More than the 1MB output buffer of extract_stream()
+        private const val TAIL_SIZE = 3 * 1024 * 1024 + 12345
+    }
+
+    private lateinit var workDir: File
+
+    @Before
+    fun setUp() {
+        assumeTrue(NativeArchive.isZstdAvailable)
+        val context = InstrumentationRegistry.getInstrumentation().targetContext
+        workDir = File(context.cacheDir, "native-archive-test").apply {
+            deleteRecursively()
+            mkdirs()
+        }
+    }
+
+    @After
+    fun tearDown() {
+        if (::workDir.isInitialized) workDir.deleteRecursively()
+    }
+
+    /**
+     * Compressible but not trivially so, the decoder then produces far
+     * more output per call than it consumes input.
+     */
+    private fun content(size: Int, seed: Int): ByteArray {
+        val random = Random(seed)
+        val words = List(256) { ByteArray(6) { ('a' + random.nextInt(10)).code.toByte() } }
+        val out = ByteArrayOutputStream(size + 7)
+        while (out.size() < size) {
+            out.write(words[random.nextInt(words.size)])
+            out.write(' '.code)
+        }
+        return out.toByteArray().copyOf(size)
+    }
+
+    private fun tar(vararg files: Pair<String, ByteArray>): ByteArray {
+        val out = ByteArrayOutputStream()
+        TarArchiveOutputStream(out).use { tar ->
+            for ((name, data) in files) {
+                val entry = TarArchiveEntry(name)
+                entry.size = data.size.toLong()
+                tar.putArchiveEntry(entry)
+                tar.write(data)
+                tar.closeArchiveEntry()
+            }
+            tar.finish()
+        }
+        return out.toByteArray()
+    }
+
+    private fun link(tar: TarArchiveOutputStream, name: String, type: Byte, target: String) {
+        val entry = TarArchiveEntry(name, type)
+        entry.linkName = target
+        tar.putArchiveEntry(entry)
+        tar.closeArchiveEntry()
+    }
+
+    private fun zstdFrame(data: ByteArray, checksum: Boolean): ByteArray {
+        val out = ByteArrayOutputStream()
+        ZstdOutputStream(out).use { zstd ->
+            zstd.setChecksum(checksum)
+            zstd.write(data)
+        }
+        return out.toByteArray()
+    }
+
+    private fun extract(archive: ByteArray): File {
+        val file = File(workDir, "archive.tar.zst")
+        FileOutputStream(file).use { it.write(archive) }
+        val target = File(workDir, "out").apply { mkdirs() }
+        assertNull(NativeArchive.extractZstd(file.path, target.path, null, NativeArchive.newProgressBuffer()))
+        return target
+    }
+
+    @Test
+    fun streamedFrameEndingInLargeFileIsComplete() {
+        val head = content(1000, 1)
+        val tail = content(TAIL_SIZE, 2)
+        for (checksum in listOf(false, true)) {
+            val target = extract(zstdFrame(tar("head.txt" to head, "tail.txt" to tail), checksum))
+            assertContentEquals(head, File(target, "head.txt").readBytes())
+            assertContentEquals(tail, File(target, "tail.txt").readBytes())
+            target.deleteRecursively()
+        }
+    }
+
+    @Test
+    fun lastOfSeveralStreamedFramesLargerThanOutputBufferIsComplete() {
+        val head = content(200_000, 3)
+        val tail = content(TAIL_SIZE, 4)
+        val archive = tar("head.txt" to head, "tail.txt" to tail)
+
+        // Split inside the first file, the last frame carries the big tail
+        val split = 100_000
+        val frames = zstdFrame(archive.copyOfRange(0, split), false) +
+            zstdFrame(archive.copyOfRange(split, archive.size), false)
+
+        val target = extract(frames)
+        assertContentEquals(head, File(target, "head.txt").readBytes())
+        assertContentEquals(tail, File(target, "tail.txt").readBytes())
+    }
+
+    @Test
+    fun hardLinkThroughPlantedSymlinkIsSkipped() {
+        val outside = File(workDir, "outside").apply { mkdirs() }
+        val victim = File(outside, "file").apply { writeText("original") }
+        val real = "ok".toByteArray()
+
+        val out = ByteArrayOutputStream()
+        TarArchiveOutputStream(out).use { tar ->
+            link(tar, "evil", TarArchiveEntry.LF_SYMLINK, outside.path)
+            link(tar, "h", TarArchiveEntry.LF_LINK, "evil/file")
+            for ((name, data) in listOf("h" to "PWNED".toByteArray(), "dir/real" to real)) {
+                val entry = TarArchiveEntry(name)
+                entry.size = data.size.toLong()
+                tar.putArchiveEntry(entry)
+                tar.write(data)
+                tar.closeArchiveEntry()
+            }
+            link(tar, "good", TarArchiveEntry.LF_LINK, "dir/real")
+            tar.finish()
+        }
+
+        val target = extract(zstdFrame(out.toByteArray(), false))
+        assertEquals("original", victim.readText())
+        assertContentEquals(real, File(target, "good").readBytes())
+    }
+}
@@ -0,0 +1,54 @@
+/**
+ * archive_extract.h
+ *
+ * Native extraction of the container image archives (tar.zst, tar.xz)
+ *
+ * Progress is shared with Java through a direct ByteBuffer of
+ * ARCHIVE_PROGRESS_SLOTS native-endian longs, written by the extracting
+ * thread with relaxed atomic stores and polled by the UI:
+ * - DONE/TOTAL: compressed bytes consumed and the input size (zstd), or
+ *   tar bytes consumed and 0 (tar read from a pipe)
+ * - ENTRIES: entries extracted
+ * - CANCEL: set to non-zero by Java to stop the extraction
+ */
+
+#ifndef ARCHIVE_EXTRACT_H
+#define ARCHIVE_EXTRACT_H
+
+#include <stdint.h>
+
+#include "tar_extract.h"
+
+#define ARCHIVE_PROGRESS_DONE 0
+#define ARCHIVE_PROGRESS_TOTAL 1
+#define ARCHIVE_PROGRESS_ENTRIES 2
+#define ARCHIVE_PROGRESS_CANCEL 3
+#define ARCHIVE_PROGRESS_SLOTS 4
+
+static inline void archive_progress_set(int64_t* progress, int slot, int64_t value) {
+    if (progress) __atomic_store_n(&progress[slot], value, __ATOMIC_RELAXED);
+}
+
+static inline int archive_progress_cancelled(int64_t* progress) {
+    return progress && __atomic_load_n(&progress[ARCHIVE_PROGRESS_CANCEL], __ATOMIC_RELAXED);
+}
+
+/**
+ * Whether zstd could be resolved, from the libzstd-jni library Java loaded
+ */
+int zstd_extract_available(void);
+
+/**
+ * Decompress the tar.zst at path into tar. Archives of several
+ * independent frames (the zstd seekable format, pzstd, concatenated
+ * streams) are decoded on all cores; a single frame is streamed.
+ * Returns 0, -ECANCELED or another -errno.
+ */
+int zstd_extract_file(const char* path, tar_extract* tar, int64_t* progress);
+
+/**
+ * Feed tar with a plain tar stream read from fd until end of file
+ */
+int tar_extract_fd(int fd, tar_extract* tar, int64_t* progress);
+
+#endif
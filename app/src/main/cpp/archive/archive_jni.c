@@ -0,0 +1,240 @@
+/**
+ * archive_jni.c
+ *
+ * JNI bindings for NativeArchive.kt
+ *
+ * Maps Java native methods to C functions:
+ * - nativeIsZstdAvailable() → zstd_extract_available()
+ * - nativeExtractZstd() → zstd_extract_file()
+ * - nativeExtractTarFd() → tar_extract_fd()
+ * - NativeArchive.EntryFilter.accept() ← tar_extract filter, per entry
+ *
+ * Data marshalling:
+ * - Entry paths are passed to the filter as byte[], tar names need not
+ *   be valid (modified) UTF-8
+ * - Progress is a direct ByteBuffer, see archive_extract.h
+ * - Failures are returned as a message, null on success
+ */
+
+#include <jni.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#include "archive_extract.h"
+
+#define TAG "archive_jni"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+
+typedef struct java_filter {
+    JNIEnv* env;
+    jobject filter;
+    jmethodID accept;
+} java_filter;
+
+int tar_extract_fd(int fd, tar_extract* tar, int64_t* progress) {
+    uint8_t* buffer = malloc(READ_BUFFER_SIZE);
+    uint64_t total = 0;
+    int status = 0;
+
+    if (!buffer) return -ENOMEM;
+
+    for (;;) {
+        ssize_t n = read(fd, buffer, READ_BUFFER_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            status = -errno;
+            break;
+        }
+        if (n == 0) break;
+
+        if (archive_progress_cancelled(progress)) {
+            status = -ECANCELED;
+            break;
+        }
+        if ((status = tar_extract_feed(tar, buffer, (size_t) n)) < 0) break;
+
+        total += (uint64_t) n;
+        archive_progress_set(progress, ARCHIVE_PROGRESS_DONE, (int64_t) total);
+        archive_progress_set(progress, ARCHIVE_PROGRESS_ENTRIES, (int64_t) tar_extract_entries(tar));
+    }
+
+    free(buffer);
+    return status;
+}
+
+static int filter_to_java(const char* path, void* data) {
+    java_filter* jf = data;
+    JNIEnv* env = jf->env;
+    size_t len = strlen(path);
+    jbyteArray bytes = (*env)->NewByteArray(env, (jsize) len);
+    jint action;
+
+    if (!bytes) {
+        (*env)->ExceptionClear(env);
+        return TAR_ENTRY_SKIP;
+    }
+    (*env)->SetByteArrayRegion(env, bytes, 0, (jsize) len, (const jbyte*) path);
+
+    action = (*env)->CallIntMethod(env, jf->filter, jf->accept, bytes);
+    (*env)->DeleteLocalRef(env, bytes);
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+        return TAR_ENTRY_SKIP;
+    }
+    return action;
+}
+
+/**
+ * Set up the extractor for target_dir and the progress slots. Returns
+ * NULL with *error set on failure.
+ */
+static tar_extract* begin_extract(JNIEnv* env, jstring target_dir, jobject filter,
+                                  jobject progress_buffer, java_filter* jf,
+                                  int64_t** progress, jstring* error) {
+    const char* root;
+    tar_extract* tar;
+    char message[256];
+
+    *progress = NULL;
+    if (progress_buffer &&
+        (*env)->GetDirectBufferCapacity(env, progress_buffer) >= ARCHIVE_PROGRESS_SLOTS * 8)
+        *progress = (*env)->GetDirectBufferAddress(env, progress_buffer);
+
+    jf->env = env;
+    jf->filter = filter;
+    if (filter) {
+        jclass cls = (*env)->GetObjectClass(env, filter);
+        jf->accept = (*env)->GetMethodID(env, cls, "accept", "([B)I");
+        (*env)->DeleteLocalRef(env, cls);
+        if (!jf->accept) {
+            (*env)->ExceptionClear(env);
+            *error = (*env)->NewStringUTF(env, "Entry filter has no accept([B)I");
+            return NULL;
+        }
+    }
+
+    root = (*env)->GetStringUTFChars(env, target_dir, NULL);
+    tar = tar_extract_create(root, filter ? filter_to_java : NULL, jf);
+    if (!tar) {
+        snprintf(message, sizeof(message), "Can not open %s: %s", root, strerror(errno));
+        *error = (*env)->NewStringUTF(env, message);
+    }
+    (*env)->ReleaseStringUTFChars(env, target_dir, root);
+    return tar;
+}
+
+static jstring end_extract(JNIEnv* env, tar_extract* tar, int status, int64_t* progress) {
+    char message[256];
+
+    if (status == 0) status = tar_extract_finish(tar);
+    archive_progress_set(progress, ARCHIVE_PROGRESS_ENTRIES, (int64_t) tar_extract_entries(tar));
+    LOGI("Extracted %llu entries, %llu bytes: %s",
+         (unsigned long long) tar_extract_entries(tar),
+         (unsigned long long) tar_extract_bytes(tar),
+         status == 0 ? "ok" : strerror(-status));
+    tar_extract_destroy(tar);
+
+    if (status == 0) return NULL;
+    if (status == -EPIPE) return (*env)->NewStringUTF(env, "Archive is truncated");
+    if (status == -EBADMSG) return (*env)->NewStringUTF(env, "Archive is corrupt");
+    snprintf(message, sizeof(message), "Extraction failed: %s", strerror(-status));
+    return (*env)->NewStringUTF(env, message);
+}
+
+/**
+ * JNI: Whether the zstd decoder could be resolved
+ *
+ * Java signature:
+ * private external fun nativeIsZstdAvailable(): Boolean
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_steamdeck_mobile_core_winlator_NativeArchive_nativeIsZstdAvailable(
+    JNIEnv* env,
+    jobject thiz
+) {
+    return zstd_extract_available() ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * JNI: Extract a tar.zst archive
+ *
+ * Java signature:
+ * private external fun nativeExtractZstd(
+ *     archivePath: String,
+ *     targetDir: String,
+ *     filter: EntryFilter?,
+ *     progress: ByteBuffer
+ * ): String?
+ *
+ * @return null on success, otherwise the error message
+ */
+JNIEXPORT jstring JNICALL
+Java_com_steamdeck_mobile_core_winlator_NativeArchive_nativeExtractZstd(
+    JNIEnv* env,
+    jobject thiz,
+    jstring archive_path,
+    jstring target_dir,
+    jobject filter,
+    jobject progress_buffer
+) {
+    java_filter jf = { 0 };
+    jstring error = NULL;
+    int64_t* progress;
+    const char* path;
+    int status;
+
+    tar_extract* tar = begin_extract(env, target_dir, filter, progress_buffer, &jf, &progress, &error);
+    if (!tar) return error;
+
+    path = (*env)->GetStringUTFChars(env, archive_path, NULL);
+    status = zstd_extract_file(path, tar, progress);
+    (*env)->ReleaseStringUTFChars(env, archive_path, path);
+
+    if (status == -ENOSYS) {
+        tar_extract_destroy(tar);
+        return (*env)->NewStringUTF(env, "Zstandard decoder is not available");
+    }
+    return end_extract(env, tar, status, progress);
+}
+
+/**
+ * JNI: Extract a plain tar stream read from fd until end of file
+ *
+ * Java signature:
+ * private external fun nativeExtractTarFd(
+ *     fd: Int,
+ *     targetDir: String,
+ *     filter: EntryFilter?,
+ *     progress: ByteBuffer
+ * ): String?
+ *
+ * The fd stays owned by the caller.
+ *
+ * @return null on success, otherwise the error message
+ */
+JNIEXPORT jstring JNICALL
+Java_com_steamdeck_mobile_core_winlator_NativeArchive_nativeExtractTarFd(
+    JNIEnv* env,
+    jobject thiz,
+    jint fd,
+    jstring target_dir,
+    jobject filter,
+    jobject progress_buffer
+) {
+    java_filter jf = { 0 };
+    jstring error = NULL;
+    int64_t* progress;
+
+    tar_extract* tar = begin_extract(env, target_dir, filter, progress_buffer, &jf, &progress, &error);
+    if (!tar) return error;
+
+    return end_extract(env, tar, tar_extract_fd(fd, tar, progress), progress);
+}
@@ -0,0 +1,646 @@
+/**
+ * tar_extract.c
+ *
+ * Streaming tar extractor, see tar_extract.h
+ *
+ * Architecture:
+ * - A state machine over 512 byte blocks: header, entry body, padding
+ * - File bodies go through a 1MB write buffer (large writes are passed
+ *   straight through) into a file preallocated to the entry size
+ * - Every path is resolved below root_fd: leading '/' and "." components
+ *   are dropped, entries with ".." or with a parent that is not a real
+ *   directory (a symlink planted by the archive) are skipped
+ *
+ * Error handling:
+ * - Disk and malformed archive errors are returned as -errno and stop the
+ *   extraction; links that can not be created are logged and skipped
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <android/log.h>
+
+#include "tar_extract.h"
+
+#define TAG "tar_extract"
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, TAG, __VA_ARGS__)
+
+#define TAR_BLOCK 512
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+// GNU long names and pax headers are buffered whole
+#define MAX_META_SIZE (1024 * 1024)
+
+enum {
+    STATE_HEADER,
+    STATE_BODY,
+    STATE_PADDING,
+    STATE_END
+};
+
+enum {
+    BODY_SKIP,
+    BODY_FILE,
+    BODY_META
+};
+
+struct tar_extract {
+    int root_fd;
+    tar_filter_fn filter;
+    void* filter_data;
+
+    int state;
+    uint8_t header[TAR_BLOCK];
+    size_t header_fill;
+    int zero_blocks;
+
+    // Current entry body
+    int body;
+    uint64_t remaining;
+    uint64_t padding;
+
+    // GNU 'L'/'K' and pax 'x' bodies, applied to the next header
+    char meta_type;
+    char* meta;
+    size_t meta_len;
+    char* long_name;
+    char* long_link;
+    uint64_t pax_size;
+    int has_pax_size;
+
+    // Regular file being written
+    int fd;
+    uint8_t* buffer;
+    size_t buffer_fill;
+
+    // Last parent directory known to exist as a real directory
+    char* parent;
+
+    uint64_t entries;
+    uint64_t bytes;
+};
+
+tar_extract* tar_extract_create(const char* root, tar_filter_fn filter, void* filter_data) {
+    tar_extract* tar = calloc(1, sizeof(*tar));
+    if (!tar) return NULL;
+
+    tar->buffer = malloc(WRITE_BUFFER_SIZE);
+    if (!tar->buffer) {
+        free(tar);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (mkdir(root, 0755) < 0 && errno != EEXIST) goto fail;
+    tar->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (tar->root_fd < 0) goto fail;
+
+    tar->filter = filter;
+    tar->filter_data = filter_data;
+    tar->fd = -1;
+    return tar;
+
+fail: {
+        int error = errno;
+        free(tar->buffer);
+        free(tar);
+        errno = error;
+        return NULL;
+    }
+}
+
+static void clear_meta(tar_extract* tar) {
+    free(tar->long_name);
+    free(tar->long_link);
+    tar->long_name = NULL;
+    tar->long_link = NULL;
+    tar->has_pax_size = 0;
+}
+
+void tar_extract_destroy(tar_extract* tar) {
+    if (!tar) return;
+    if (tar->fd >= 0) close(tar->fd);
+    close(tar->root_fd);
+    clear_meta(tar);
+    free(tar->meta);
+    free(tar->parent);
+    free(tar->buffer);
+    free(tar);
+}
+
+uint64_t tar_extract_entries(const tar_extract* tar) {
+    return tar->entries;
+}
+
+uint64_t tar_extract_bytes(const tar_extract* tar) {
+    return tar->bytes;
+}
+
+static int write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int flush_buffer(tar_extract* tar) {
+    int status = write_all(tar->fd, tar->buffer, tar->buffer_fill);
+    tar->buffer_fill = 0;
+    return status;
+}
+
+static int write_file_data(tar_extract* tar, const uint8_t* data, size_t size) {
+    int status;
+
+    if (tar->buffer_fill == 0 && size >= WRITE_BUFFER_SIZE) {
+        tar->bytes += size;
+        return write_all(tar->fd, data, size);
+    }
+
+    while (size > 0) {
+        size_t n = WRITE_BUFFER_SIZE - tar->buffer_fill;
+        if (n > size) n = size;
+        memcpy(tar->buffer + tar->buffer_fill, data, n);
+        tar->buffer_fill += n;
+        tar->bytes += n;
+        data += n;
+        size -= n;
+
+        if (tar->buffer_fill == WRITE_BUFFER_SIZE && (status = flush_buffer(tar)) < 0)
+            return status;
+    }
+    return 0;
+}
+
+static uint64_t parse_number(const uint8_t* field, size_t size) {
+    uint64_t value = 0;
+    size_t i;
+
+    // GNU base-256 for values that do not fit the octal digits
+    if (field[0] & 0x80) {
+        value = field[0] & 0x3f;
+        for (i = 1; i < size; i++)
+            value = (value << 8) | field[i];
+        return value;
+    }
+
+    for (i = 0; i < size && (field[i] == ' ' || field[i] == '\0'); i++);
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+        value = (value << 3) | (field[i] - '0');
+    return value;
+}
+
+static int checksum_valid(const uint8_t* header) {
+    uint64_t expected = parse_number(header + 148, 8);
+    uint64_t sum = 0;
+    int64_t signed_sum = 0;
+    int i;
+
+    for (i = 0; i < TAR_BLOCK; i++) {
+        uint8_t c = (i >= 148 && i < 156) ? ' ' : header[i];
+        sum += c;
+        signed_sum += (int8_t) c;
+    }
+    return sum == expected || (uint64_t) signed_sum == expected;
+}
+
+/**
+ * Copy path into a newly allocated relative path without "." components
+ * and leading slashes. Returns NULL for paths with "..", and "" for the
+ * root itself.
+ */
+static char* sanitize_path(const char* path) {
+    size_t len = strlen(path);
+    char* out = malloc(len + 1);
+    size_t out_len = 0;
+    const char* p = path;
+
+    if (!out) return NULL;
+
+    while (*p) {
+        const char* start;
+        size_t n;
+
+        while (*p == '/') p++;
+        start = p;
+        while (*p && *p != '/') p++;
+        n = p - start;
+
+        if (n == 0 || (n == 1 && start[0] == '.')) continue;
+        if (n == 2 && start[0] == '.' && start[1] == '.') {
+            free(out);
+            return NULL;
+        }
+
+        if (out_len) out[out_len++] = '/';
+        memcpy(out + out_len, start, n);
+        out_len += n;
+    }
+    out[out_len] = '\0';
+    return out;
+}
+
+/**
+ * Create the missing parents of path. Fails with -ENOTDIR if one of them
+ * exists as anything but a directory, so nothing is ever written through
+ * a symlink the archive created.
+ */
+static int make_parents(tar_extract* tar, char* path) {
+    char* slash = strrchr(path, '/');
+    char* p;
+    struct stat st;
+
+    if (!slash) return 0;
+
+    *slash = '\0';
+    if (tar->parent && strcmp(tar->parent, path) == 0) {
+        *slash = '/';
+        return 0;
+    }
+
+    for (p = path;; p++) {
+        if (*p != '/' && *p != '\0') continue;
+
+        char c = *p;
+        *p = '\0';
+        if (mkdirat(tar->root_fd, path, 0755) < 0) {
+            if (errno != EEXIST ||
+                fstatat(tar->root_fd, path, &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+                !S_ISDIR(st.st_mode)) {
+                *p = c;
+                *slash = '/';
+                return -ENOTDIR;
+            }
+        }
+        *p = c;
+        if (c == '\0') break;
+    }
+
+    free(tar->parent);
+    tar->parent = strdup(path);
+    *slash = '/';
+    return 0;
+}
+
+static int open_file(tar_extract* tar, const char* path, mode_t mode, uint64_t size) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC;
+    int fd = openat(tar->root_fd, path, flags, mode);
+
+    // A symlink, directory or busy executable in the way is replaced
+    if (fd < 0 && errno != ENOENT && errno != ENOSPC && errno != EDQUOT) {
+        (void) unlinkat(tar->root_fd, path, 0);
+        fd = openat(tar->root_fd, path, flags, mode);
+    }
+    if (fd < 0) return -errno;
+
+    // Existing files keep their mode through O_CREAT
+    (void) fchmod(fd, mode);
+
+    // Not fatal, the writes allocate anyway
+    if (size > 0) (void) fallocate(fd, 0, 0, (off_t) size);
+
+    tar->fd = fd;
+    tar->buffer_fill = 0;
+    return 0;
+}
+
+static void make_directory(tar_extract* tar, const char* path, mode_t mode) {
+    struct stat st;
+
+    if (mkdirat(tar->root_fd, path, mode) == 0) return;
+
+    if (errno == EEXIST && fstatat(tar->root_fd, path, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        !S_ISDIR(st.st_mode)) {
+        (void) unlinkat(tar->root_fd, path, 0);
+        if (mkdirat(tar->root_fd, path, mode) == 0) return;
+    }
+    if (errno != EEXIST) LOGW("Can not create directory %s: %s", path, strerror(errno));
+}
+
+static void make_symlink(tar_extract* tar, const char* path, const char* target) {
+    if (symlinkat(target, tar->root_fd, path) == 0) return;
+
+    if (errno == EEXIST) {
+        (void) unlinkat(tar->root_fd, path, 0);
+        if (symlinkat(target, tar->root_fd, path) == 0) return;
+    }
+    LOGW("Can not create symlink %s -> %s: %s", path, target, strerror(errno));
+}
+
+/**
+ * Whether every parent of path is a real directory, the same walk as
+ * make_parents() without creating anything. linkat() resolves the
+ * source through symlinks the archive planted, this keeps it inside.
+ */
+static int parents_are_directories(tar_extract* tar, char* path) {
+    struct stat st;
+    char* p;
+
+    for (p = path; *p; p++) {
+        if (*p != '/') continue;
+
+        *p = '\0';
+        int ok = fstatat(tar->root_fd, path, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        *p = '/';
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+static void make_hardlink(tar_extract* tar, const char* path, const char* target) {
+    char* source = sanitize_path(target);
+
+    if (!source || !*source || !parents_are_directories(tar, source)) {
+        LOGW("Skipping hard link %s to %s", path, target);
+        free(source);
+        return;
+    }
+
+    if (linkat(tar->root_fd, source, tar->root_fd, path, 0) < 0) {
+        if (errno == EEXIST) {
+            (void) unlinkat(tar->root_fd, path, 0);
+            if (linkat(tar->root_fd, source, tar->root_fd, path, 0) == 0) goto done;
+        }
+        LOGW("Can not create hard link %s -> %s: %s", path, source, strerror(errno));
+    }
+done:
+    free(source);
+}
+
+static char* header_string(const uint8_t* field, size_t size) {
+    size_t len = strnlen((const char*) field, size);
+    char* s = malloc(len + 1);
+
+    if (s) {
+        memcpy(s, field, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+static char* header_path(const uint8_t* header) {
+    char* name = header_string(header, 100);
+    char* path;
+
+    // ustar splits long paths into prefix and name
+    if (!name || memcmp(header + 257, "ustar", 5) != 0 || header[345] == '\0')
+        return name;
+
+    char* prefix = header_string(header + 345, 155);
+    if (!prefix) {
+        free(name);
+        return NULL;
+    }
+    path = malloc(strlen(prefix) + strlen(name) + 2);
+    if (path) {
+        strcpy(path, prefix);
+        strcat(path, "/");
+        strcat(path, name);
+    }
+    free(prefix);
+    free(name);
+    return path;
+}
+
+static void start_body(tar_extract* tar, int body, uint64_t size) {
+    tar->body = body;
+    tar->remaining = size;
+    tar->padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+    tar->state = STATE_BODY;
+}
+
+/**
+ * Act on a complete header block and set up its body
+ */
+static int process_header(tar_extract* tar) {
+    const uint8_t* header = tar->header;
+    char type = (char) header[156];
+    uint64_t size;
+    mode_t mode;
+    char* name = NULL;
+    char* path = NULL;
+    char* link = NULL;
+    int action;
+    int status = 0;
+    int i;
+
+    for (i = 0; i < TAR_BLOCK && header[i] == 0; i++);
+    if (i == TAR_BLOCK) {
+        if (++tar->zero_blocks == 2) tar->state = STATE_END;
+        return 0;
+    }
+    tar->zero_blocks = 0;
+
+    if (!checksum_valid(header)) return -EINVAL;
+
+    size = tar->has_pax_size ? tar->pax_size : parse_number(header + 124, 12);
+    mode = (mode_t) parse_number(header + 100, 8) & 0777;
+
+    switch (type) {
+        case 'L':
+        case 'K':
+        case 'x':
+            // These stay pending for the header that follows
+            if (size > MAX_META_SIZE) return -EINVAL;
+            free(tar->meta);
+            tar->meta = malloc(size + 1);
+            if (!tar->meta) return -ENOMEM;
+            tar->meta_type = type;
+            tar->meta_len = 0;
+            start_body(tar, BODY_META, size);
+            return 0;
+        case 'g':
+            start_body(tar, BODY_SKIP, size);
+            return 0;
+    }
+
+    name = tar->long_name ? strdup(tar->long_name) : header_path(header);
+    if (!name) {
+        status = -ENOMEM;
+        goto out;
+    }
+    path = sanitize_path(name);
+
+    // Links, devices, fifos and directories have no body whatever size says
+    start_body(tar, BODY_SKIP, (type >= '1' && type <= '6') ? 0 : size);
+
+    if (!path) {
+        LOGW("Skipping entry outside of the target: %s", name);
+        goto out;
+    }
+    if (!*path) goto out;
+
+    action = tar->filter ? tar->filter(path, tar->filter_data) : TAR_ENTRY_EXTRACT;
+    if (action == TAR_ENTRY_SKIP) goto out;
+
+    if (make_parents(tar, path) < 0) {
+        LOGW("Skipping entry below a non-directory: %s", path);
+        goto out;
+    }
+
+    switch (type) {
+        case '0':
+        case '\0':
+        case '7':
+            if (action == TAR_ENTRY_EXECUTABLE) mode = 0755;
+            status = open_file(tar, path, mode | 0600, size);
+            if (status < 0) break;
+            tar->body = BODY_FILE;
+            tar->entries++;
+            break;
+        case '5':
+            make_directory(tar, path, mode | 0700);
+            tar->entries++;
+            break;
+        case '1':
+        case '2':
+            link = tar->long_link ? strdup(tar->long_link) : header_string(header + 157, 100);
+            if (!link) {
+                status = -ENOMEM;
+                break;
+            }
+            if (type == '2') make_symlink(tar, path, link);
+            else make_hardlink(tar, path, link);
+            tar->entries++;
+            break;
+    }
+
+out:
+    clear_meta(tar);
+    free(name);
+    free(path);
+    free(link);
+    return status;
+}
+
+static char* pax_value(const char* value, size_t len) {
+    char* s = malloc(len + 1);
+
+    if (s) {
+        memcpy(s, value, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+/**
+ * Pick path, linkpath and size out of pax records "<len> <key>=<value>\n"
+ */
+static void apply_pax(tar_extract* tar) {
+    const char* p = tar->meta;
+    const char* end = tar->meta + tar->meta_len;
+
+    while (p < end) {
+        char* key;
+        size_t len = strtoul(p, &key, 10);
+        const char* record_end = p + len;
+        const char* eq;
+
+        if (len == 0 || record_end > end || *key != ' ') break;
+        key++;
+        eq = memchr(key, '=', record_end - key);
+        if (!eq || eq + 1 >= record_end) break;
+
+        // The value runs up to the record's trailing newline
+        size_t value_len = record_end - (eq + 1) - 1;
+        size_t key_len = eq - key;
+
+        if (key_len == 4 && memcmp(key, "path", 4) == 0) {
+            free(tar->long_name);
+            tar->long_name = pax_value(eq + 1, value_len);
+        } else if (key_len == 8 && memcmp(key, "linkpath", 8) == 0) {
+            free(tar->long_link);
+            tar->long_link = pax_value(eq + 1, value_len);
+        } else if (key_len == 4 && memcmp(key, "size", 4) == 0) {
+            tar->pax_size = strtoull(eq + 1, NULL, 10);
+            tar->has_pax_size = 1;
+        }
+        p = record_end;
+    }
+}
+
+static int end_body(tar_extract* tar) {
+    int status = 0;
+
+    if (tar->body == BODY_FILE) {
+        status = flush_buffer(tar);
+        if (close(tar->fd) < 0 && status == 0) status = -errno;
+        tar->fd = -1;
+    } else if (tar->body == BODY_META) {
+        tar->meta[tar->meta_len] = '\0';
+        if (tar->meta_type == 'x') {
+            apply_pax(tar);
+        } else {
+            // NUL terminated inside the body
+            char** target = tar->meta_type == 'L' ? &tar->long_name : &tar->long_link;
+            free(*target);
+            *target = strdup(tar->meta);
+        }
+        free(tar->meta);
+        tar->meta = NULL;
+    }
+
+    tar->body = BODY_SKIP;
+    tar->state = tar->padding ? STATE_PADDING : STATE_HEADER;
+    return status;
+}
+
+int tar_extract_feed(tar_extract* tar, const uint8_t* data, size_t size) {
+    int status;
+
+    while (size > 0) {
+        size_t n;
+
+        switch (tar->state) {
+            case STATE_HEADER:
+                n = TAR_BLOCK - tar->header_fill;
+                if (n > size) n = size;
+                memcpy(tar->header + tar->header_fill, data, n);
+                tar->header_fill += n;
+                if (tar->header_fill == TAR_BLOCK) {
+                    tar->header_fill = 0;
+                    if ((status = process_header(tar)) < 0) return status;
+                    if (tar->state == STATE_BODY && tar->remaining == 0 &&
+                        (status = end_body(tar)) < 0)
+                        return status;
+                }
+                break;
+            case STATE_BODY:
+                n = tar->remaining < size ? (size_t) tar->remaining : size;
+                if (tar->body == BODY_FILE) {
+                    if ((status = write_file_data(tar, data, n)) < 0) return status;
+                } else if (tar->body == BODY_META) {
+                    memcpy(tar->meta + tar->meta_len, data, n);
+                    tar->meta_len += n;
+                }
+                tar->remaining -= n;
+                if (tar->remaining == 0 && (status = end_body(tar)) < 0) return status;
+                break;
+            case STATE_PADDING:
+                n = tar->padding < size ? (size_t) tar->padding : size;
+                tar->padding -= n;
+                if (tar->padding == 0) tar->state = STATE_HEADER;
+                break;
+            default:
+                return 0;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int tar_extract_finish(tar_extract* tar) {
+    if (tar->state == STATE_BODY || tar->state == STATE_PADDING || tar->header_fill)
+        return -EPIPE;
+    return 0;
+}
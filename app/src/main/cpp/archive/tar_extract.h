@@ -0,0 +1,56 @@
+/**
+ * tar_extract.h
+ *
+ * Streaming tar extractor shared by the archive_extract decoders
+ *
+ * The archive is pushed in arbitrary slices with tar_extract_feed(), the
+ * way it comes out of a decompressor, so no decoded copy of the tar ever
+ * touches the disk.  Understands ustar, GNU long names/links and the pax
+ * path, linkpath and size records; regular files, directories, symlinks
+ * and hard links are extracted, everything else is skipped.
+ */
+
+#ifndef TAR_EXTRACT_H
+#define TAR_EXTRACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What a filter decides for an entry
+#define TAR_ENTRY_SKIP 0
+#define TAR_ENTRY_EXTRACT 1
+#define TAR_ENTRY_EXECUTABLE 2   // extract and force mode 0755 on files
+
+/**
+ * Called once per entry with its sanitized relative path, returns one of
+ * TAR_ENTRY_*
+ */
+typedef int (*tar_filter_fn)(const char* path, void* data);
+
+typedef struct tar_extract tar_extract;
+
+/**
+ * Create an extractor writing below root (created if missing). filter
+ * may be NULL to extract everything. Returns NULL with errno set.
+ */
+tar_extract* tar_extract_create(const char* root, tar_filter_fn filter, void* filter_data);
+void tar_extract_destroy(tar_extract* tar);
+
+/**
+ * Consume the next size bytes of the archive. Returns 0, or -errno on an
+ * error writing the tree or a malformed archive. Data after the end of
+ * archive marker is ignored.
+ */
+int tar_extract_feed(tar_extract* tar, const uint8_t* data, size_t size);
+
+/**
+ * Flush the entry being written. Returns -EPIPE if the archive ended in
+ * the middle of an entry.
+ */
+int tar_extract_finish(tar_extract* tar);
+
+// Extracted entries and file bytes written so far
+uint64_t tar_extract_entries(const tar_extract* tar);
+uint64_t tar_extract_bytes(const tar_extract* tar);
+
+#endif
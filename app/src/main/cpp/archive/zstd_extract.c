@@ -0,0 +1,398 @@
+/**
+ * zstd_extract.c
+ *
+ * tar.zst decoding for archive_extract
+ *
+ * Architecture:
+ * - zstd itself comes from libzstd-jni, which the app already ships and
+ *   Java loads first; its public ZSTD_* entry points are resolved with
+ *   dlsym() so no second copy of the library is built
+ * - The input is mmap()ed and split into frames up front. With several
+ *   frames of known size, worker threads decode them into memory while
+ *   the calling thread writes them to the tar extractor in order, at most
+ *   a window of frames ahead
+ * - Otherwise the whole input is streamed through one decoder
+ *
+ * Error handling:
+ * - Returns -errno; a corrupt frame is -EBADMSG
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <android/log.h>
+
+#include "archive_extract.h"
+#include "native_trace.h"
+
+#define TAG "zstd_extract"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#define ZSTD_LIBRARY "libzstd-jni"
+#define ZSTD_CONTENTSIZE_UNKNOWN (0ULL - 1)
+#define ZSTD_CONTENTSIZE_ERROR (0ULL - 2)
+#define ZSTD_MAGIC_SKIPPABLE_START 0x184D2A50u
+#define ZSTD_MAGIC_SKIPPABLE_MASK 0xFFFFFFF0u
+
+#define STREAM_OUT_SIZE (1024 * 1024)
+#define MAX_WORKERS 8
+// Decoded frames held at once when decoding in parallel
+#define PARALLEL_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// Same layout as ZSTD_inBuffer/ZSTD_outBuffer
+typedef struct {
+    const void* src;
+    size_t size;
+    size_t pos;
+} zstd_in_buffer;
+
+typedef struct {
+    void* dst;
+    size_t size;
+    size_t pos;
+} zstd_out_buffer;
+
+static struct {
+    void* (*createDCtx)(void);
+    size_t (*freeDCtx)(void* dctx);
+    size_t (*decompressDCtx)(void* dctx, void* dst, size_t dst_size, const void* src, size_t src_size);
+    size_t (*decompressStream)(void* dctx, zstd_out_buffer* out, zstd_in_buffer* in);
+    unsigned (*isError)(size_t code);
+    const char* (*getErrorName)(size_t code);
+    size_t (*findFrameCompressedSize)(const void* src, size_t src_size);
+    unsigned long long (*getFrameContentSize)(const void* src, size_t src_size);
+} zstd;
+
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+static int zstd_loaded;
+
+static int find_zstd_library(struct dl_phdr_info* info, size_t size, void* data) {
+    const char** path = data;
+    (void) size;
+
+    if (info->dlpi_name && strstr(info->dlpi_name, ZSTD_LIBRARY)) {
+        *path = info->dlpi_name;
+        return 1;
+    }
+    return 0;
+}
+
+static void load_zstd(void) {
+    const char* path = NULL;
+    void* handle;
+
+    dl_iterate_phdr(find_zstd_library, &path);
+    if (!path) {
+        LOGE("%s is not loaded", ZSTD_LIBRARY);
+        return;
+    }
+
+    handle = dlopen(path, RTLD_NOW | RTLD_NOLOAD);
+    if (!handle) {
+        LOGE("dlopen %s: %s", path, dlerror());
+        return;
+    }
+
+    zstd.createDCtx = dlsym(handle, "ZSTD_createDCtx");
+    zstd.freeDCtx = dlsym(handle, "ZSTD_freeDCtx");
+    zstd.decompressDCtx = dlsym(handle, "ZSTD_decompressDCtx");
+    zstd.decompressStream = dlsym(handle, "ZSTD_decompressStream");
+    zstd.isError = dlsym(handle, "ZSTD_isError");
+    zstd.getErrorName = dlsym(handle, "ZSTD_getErrorName");
+    zstd.findFrameCompressedSize = dlsym(handle, "ZSTD_findFrameCompressedSize");
+    zstd.getFrameContentSize = dlsym(handle, "ZSTD_getFrameContentSize");
+
+    zstd_loaded = zstd.createDCtx && zstd.freeDCtx && zstd.decompressDCtx &&
+                  zstd.decompressStream && zstd.isError && zstd.getErrorName &&
+                  zstd.findFrameCompressedSize && zstd.getFrameContentSize;
+    if (!zstd_loaded) LOGE("%s does not export the zstd API", path);
+}
+
+int zstd_extract_available(void) {
+    pthread_once(&zstd_once, load_zstd);
+    return zstd_loaded;
+}
+
+/*
+ * Parallel decoding
+ */
+
+enum {
+    FRAME_PENDING,
+    FRAME_DECODING,
+    FRAME_READY,
+    FRAME_FAILED
+};
+
+typedef struct frame {
+    size_t offset;
+    size_t size;
+    size_t content_size;
+    uint8_t* data;
+    int state;
+} frame;
+
+typedef struct parallel {
+    const uint8_t* input;
+    frame* frames;
+    int num_frames;
+    int window;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int next_decode;
+    int next_write;
+    int abort;
+} parallel;
+
+static void* decode_worker(void* arg) {
+    parallel* par = arg;
+    void* dctx = zstd.createDCtx();
+
+    pthread_mutex_lock(&par->lock);
+    for (;;) {
+        while (!par->abort && par->next_decode < par->num_frames &&
+               par->next_decode >= par->next_write + par->window)
+            pthread_cond_wait(&par->work, &par->lock);
+        if (par->abort || par->next_decode >= par->num_frames) break;
+
+        frame* f = &par->frames[par->next_decode++];
+        f->state = FRAME_DECODING;
+        pthread_mutex_unlock(&par->lock);
+
+        int ok = 0;
+        f->data = dctx ? malloc(f->content_size ? f->content_size : 1) : NULL;
+        if (f->data) {
+            NATIVE_TRACE_SCOPE("zstd_decode_frame");
+            size_t n = zstd.decompressDCtx(dctx, f->data, f->content_size,
+                                           par->input + f->offset, f->size);
+            ok = !zstd.isError(n) && n == f->content_size;
+            if (!ok && zstd.isError(n)) LOGE("Frame at %zu: %s", f->offset, zstd.getErrorName(n));
+        }
+
+        pthread_mutex_lock(&par->lock);
+        f->state = ok ? FRAME_READY : FRAME_FAILED;
+        pthread_cond_broadcast(&par->done);
+    }
+    pthread_mutex_unlock(&par->lock);
+
+    if (dctx) zstd.freeDCtx(dctx);
+    return NULL;
+}
+
+static int online_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > MAX_WORKERS ? MAX_WORKERS : (int) n);
+}
+
+static int extract_parallel(parallel* par, size_t max_content, tar_extract* tar, int64_t* progress) {
+    pthread_t threads[MAX_WORKERS];
+    int num_threads = online_cpus();
+    int started = 0;
+    int status = 0;
+    int i;
+
+    par->window = (int) (PARALLEL_MEMORY_BUDGET / (max_content ? max_content : 1));
+    if (par->window > num_threads + 2) par->window = num_threads + 2;
+    if (par->window < 2) par->window = 2;
+
+    pthread_mutex_init(&par->lock, NULL);
+    pthread_cond_init(&par->work, NULL);
+    pthread_cond_init(&par->done, NULL);
+
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, decode_worker, par) != 0) break;
+        started++;
+    }
+    LOGI("Decoding %d frames on %d threads, %d in flight", par->num_frames, started, par->window);
+
+    for (i = 0; i < par->num_frames && started > 0; i++) {
+        frame* f = &par->frames[i];
+
+        pthread_mutex_lock(&par->lock);
+        while (f->state == FRAME_PENDING || f->state == FRAME_DECODING)
+            pthread_cond_wait(&par->done, &par->lock);
+        pthread_mutex_unlock(&par->lock);
+
+        if (f->state == FRAME_FAILED) status = -EBADMSG;
+        else if (archive_progress_cancelled(progress)) status = -ECANCELED;
+        else status = tar_extract_feed(tar, f->data, f->content_size);
+
+        free(f->data);
+        f->data = NULL;
+
+        pthread_mutex_lock(&par->lock);
+        par->next_write = i + 1;
+        if (status < 0) par->abort = 1;
+        pthread_cond_broadcast(&par->work);
+        pthread_mutex_unlock(&par->lock);
+
+        if (status < 0) break;
+        archive_progress_set(progress, ARCHIVE_PROGRESS_DONE, (int64_t) (f->offset + f->size));
+        archive_progress_set(progress, ARCHIVE_PROGRESS_ENTRIES, (int64_t) tar_extract_entries(tar));
+    }
+    if (started == 0) status = -EAGAIN;
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // Frames decoded past an error
+    for (i = 0; i < par->num_frames; i++)
+        free(par->frames[i].data);
+
+    pthread_cond_destroy(&par->done);
+    pthread_cond_destroy(&par->work);
+    pthread_mutex_destroy(&par->lock);
+    return status;
+}
+
+/*
+ * Streaming
+ */
+
+static int extract_stream(const uint8_t* input, size_t size, tar_extract* tar, int64_t* progress) {
+    void* dctx = zstd.createDCtx();
+    uint8_t* out = malloc(STREAM_OUT_SIZE);
+    zstd_in_buffer in = { input, size, 0 };
+    int status = 0;
+    // A full output buffer may leave decoded data inside zstd, even with all input consumed
+    int pending = 0;
+
+    if (!dctx || !out) {
+        status = -ENOMEM;
+        goto done;
+    }
+
+    while (in.pos < in.size || pending) {
+        zstd_out_buffer ob = { out, STREAM_OUT_SIZE, 0 };
+        size_t ret = zstd.decompressStream(dctx, &ob, &in);
+
+        if (zstd.isError(ret)) {
+            LOGE("At %zu: %s", in.pos, zstd.getErrorName(ret));
+            status = -EBADMSG;
+            break;
+        }
+        if (archive_progress_cancelled(progress)) {
+            status = -ECANCELED;
+            break;
+        }
+        if (ob.pos && (status = tar_extract_feed(tar, out, ob.pos)) < 0) break;
+        pending = ret != 0 && ob.pos == ob.size;
+
+        archive_progress_set(progress, ARCHIVE_PROGRESS_DONE, (int64_t) in.pos);
+        archive_progress_set(progress, ARCHIVE_PROGRESS_ENTRIES, (int64_t) tar_extract_entries(tar));
+    }
+
+done:
+    free(out);
+    if (dctx) zstd.freeDCtx(dctx);
+    return status;
+}
+
+/**
+ * Split input into its data frames. Returns the number of frames, 0 if
+ * they can not all be decoded independently into memory, or -errno.
+ */
+static int scan_frames(const uint8_t* input, size_t size, frame** frames_out, size_t* max_content) {
+    frame* frames = NULL;
+    int num_frames = 0;
+    int capacity = 0;
+    size_t offset = 0;
+
+    *max_content = 0;
+    while (offset < size) {
+        size_t frame_size = zstd.findFrameCompressedSize(input + offset, size - offset);
+        if (zstd.isError(frame_size)) {
+            free(frames);
+            return -EBADMSG;
+        }
+
+        uint32_t magic;
+        memcpy(&magic, input + offset, sizeof(magic));
+        if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) != ZSTD_MAGIC_SKIPPABLE_START) {
+            unsigned long long content = zstd.getFrameContentSize(input + offset, size - offset);
+
+            if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR ||
+                content > PARALLEL_MEMORY_BUDGET / 2) {
+                free(frames);
+                return 0;
+            }
+            if (num_frames == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                frame* grown = realloc(frames, capacity * sizeof(*frames));
+                if (!grown) {
+                    free(frames);
+                    return -ENOMEM;
+                }
+                frames = grown;
+            }
+            frames[num_frames++] = (frame) { offset, frame_size, (size_t) content, NULL, FRAME_PENDING };
+            if (content > *max_content) *max_content = (size_t) content;
+        }
+        offset += frame_size;
+    }
+
+    *frames_out = frames;
+    return num_frames;
+}
+
+int zstd_extract_file(const char* path, tar_extract* tar, int64_t* progress) {
+    NATIVE_TRACE_SCOPE("zstd_extract_file");
+    struct stat st;
+    uint8_t* input;
+    frame* frames = NULL;
+    size_t max_content;
+    int num_frames;
+    int status;
+    int fd;
+
+    if (!zstd_extract_available()) return -ENOSYS;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -errno;
+    if (fstat(fd, &st) < 0) {
+        status = -errno;
+        close(fd);
+        return status;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return -EBADMSG;
+    }
+
+    input = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (input == MAP_FAILED) return -errno;
+    (void) madvise(input, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+    archive_progress_set(progress, ARCHIVE_PROGRESS_TOTAL, (int64_t) st.st_size);
+
+    num_frames = scan_frames(input, (size_t) st.st_size, &frames, &max_content);
+    if (num_frames < 0) {
+        status = num_frames;
+    } else if (num_frames >= 2) {
+        parallel par = { .input = input, .frames = frames, .num_frames = num_frames };
+        status = extract_parallel(&par, max_content, tar, progress);
+        // No thread could be started, nothing was written yet
+        if (status == -EAGAIN)
+            status = extract_stream(input, (size_t) st.st_size, tar, progress);
+    } else {
+        status = extract_stream(input, (size_t) st.st_size, tar, progress);
+    }
+
+    // Trailing skippable frames are never reported by the decoders
+    if (status == 0) archive_progress_set(progress, ARCHIVE_PROGRESS_DONE, (int64_t) st.st_size);
+
+    free(frames);
+    munmap(input, (size_t) st.st_size);
+    return status;
+}
@@ -0,0 +1,55 @@
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/system_properties.h>
+
+#include "native_trace.h"
+
+int nativeTraceState;
+
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+static bool (*atraceIsEnabled)(void);
+static void (*atraceBeginSection)(const char *name);
+static void (*atraceEndSection)(void);
+// API 29, NULL before
+static void (*atraceSetCounter)(const char *name, int64_t value);
+
+static void initOnceFunc(void) {
+    char value[PROP_VALUE_MAX] = "";
+    int state = -1;
+
+    __system_property_get(NATIVE_TRACE_PROPERTY, value);
+    if (atoi(value) > 0) {
+        // proot is not linked with libandroid, so it is always looked up
+        void *handle = dlopen("libandroid.so", RTLD_NOW);
+        if (handle) {
+            atraceIsEnabled = (bool (*)(void))dlsym(handle, "ATrace_isEnabled");
+            atraceBeginSection = (void (*)(const char *))dlsym(handle, "ATrace_beginSection");
+            atraceEndSection = (void (*)(void))dlsym(handle, "ATrace_endSection");
+            atraceSetCounter = (void (*)(const char *, int64_t))dlsym(handle, "ATrace_setCounter");
+            if (atraceIsEnabled && atraceBeginSection && atraceEndSection) state = 1;
+        }
+    }
+    __atomic_store_n(&nativeTraceState, state, __ATOMIC_RELEASE);
+}
+
+void NativeTrace_init(void) {
+    pthread_once(&initOnce, initOnceFunc);
+}
+
+bool NativeTrace_recording(void) {
+    return atraceIsEnabled();
+}
+
+bool NativeTrace_begin(const char *name) {
+    atraceBeginSection(name);
+    return true;
+}
+
+void NativeTrace_end(bool *begun) {
+    if (*begun) atraceEndSection();
+}
+
+void NativeTrace_counter(const char *name, int64_t value) {
+    if (atraceSetCounter) atraceSetCounter(name, value);
+}
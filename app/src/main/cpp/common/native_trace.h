@@ -0,0 +1,59 @@
+#ifndef NATIVE_TRACE_H
+#define NATIVE_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Perfetto/systrace slices and counters for the native libraries, written
+ * through ATrace from libandroid.
+ *
+ * Trace points do nothing unless the debug.steamdeck.trace property is 1
+ * when the library first traces:
+ *
+ *   adb shell setprop debug.steamdeck.trace 1
+ *
+ * and then only while a trace is being recorded.  A disabled trace point
+ * costs a load and a branch.  Every library (and proot) compiles its own
+ * copy of native_trace.c, the state is hidden so the copies do not clash.
+ */
+
+#define NATIVE_TRACE_PROPERTY "debug.steamdeck.trace"
+
+#define NATIVE_TRACE_HIDDEN __attribute__((visibility("hidden")))
+
+/* 0 until the property was read, then 1 if enabled and -1 if not */
+extern int nativeTraceState NATIVE_TRACE_HIDDEN;
+
+void NativeTrace_init(void) NATIVE_TRACE_HIDDEN;
+bool NativeTrace_recording(void) NATIVE_TRACE_HIDDEN;
+bool NativeTrace_begin(const char *name) NATIVE_TRACE_HIDDEN;
+void NativeTrace_end(bool *begun) NATIVE_TRACE_HIDDEN;
+void NativeTrace_counter(const char *name, int64_t value) NATIVE_TRACE_HIDDEN;
+
+static inline bool NativeTrace_isEnabled(void) {
+    int state = __atomic_load_n(&nativeTraceState, __ATOMIC_ACQUIRE);
+    if (__builtin_expect(state == 0, 0)) {
+        NativeTrace_init();
+        state = __atomic_load_n(&nativeTraceState, __ATOMIC_ACQUIRE);
+    }
+    return state > 0 && NativeTrace_recording();
+}
+
+#define NATIVE_TRACE_CONCAT_(a, b) a##b
+#define NATIVE_TRACE_CONCAT(a, b) NATIVE_TRACE_CONCAT_(a, b)
+
+/* Traces the rest of the enclosing block as a slice called name, ended on
+ * every way out of the block; the slice is only ended if it was begun, so
+ * a trace starting or stopping in between can not unbalance the thread. */
+#define NATIVE_TRACE_SCOPE(name) \
+    bool NATIVE_TRACE_CONCAT(nativeTraceScope, __LINE__) \
+        __attribute__((cleanup(NativeTrace_end), unused)) = \
+        NativeTrace_isEnabled() && NativeTrace_begin(name)
+
+#define NATIVE_TRACE_COUNTER(name, value) \
+    do { \
+        if (NativeTrace_isEnabled()) NativeTrace_counter(name, value); \
+    } while (0)
+
+#endif
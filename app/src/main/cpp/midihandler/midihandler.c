@@ -1,65 +1,468 @@
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <fluidsynth.h>
 #include <jni.h>
 #include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
 #include <android/log.h>
 #include <malloc.h>
 
 #define FLUIDSYNTH_SAMPLE_RATE 44100
 #define FLUIDSYNTH_LATENCY 40
 #define LATENCY_MILLIS_TO_BUFFER_SIZE(ms) (FLUIDSYNTH_SAMPLE_RATE * ms / 1000.0)
+#define EVENT_QUEUE_SIZE 1024
+#define MIXER_EVENT_DELAY 10
+#define MAX_CACHED_SOUNDFONTS 4
+#define EVENT_SIZE 8
+#define MIN_POLYPHONY 32
+#define LOAD_SMOOTHING 0.1f
+#define BUDGET_REDUCE_PERIODS 16
+#define BUDGET_RESTORE_PERIODS 64
 
 #define println(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__)
 
+/*
+ * A queued event as passed in by queueEvents: a 32-bit microsecond timestamp
+ * of CLOCK_MONOTONIC (System.nanoTime() / 1000) followed by the status and
+ * data bytes of a channel message.
+ */
+typedef struct MIDIEvent {
+    uint32_t time;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+} MIDIEvent;
+
+/*
+ * Events go through a single-producer/single-consumer queue and are applied by
+ * the render callback at the frame they fall on, delayed by eventDelay (one
+ * period of the output) so a batch always arrives before its events are due.
+ */
 typedef struct MIDIHandler {
     fluid_settings_t* settings;
     fluid_synth_t* synth;
     fluid_audio_driver_t* driver;
     int soundfontId;
+    fluid_sfont_t* soundfont;
+    int sampleRate;
+    uint32_t eventDelay;
+    bool mixed;
+    atomic_bool ready;
+    bool affinityApplied;
+
+    // CPU budget, only touched by the render thread once enabled
+    atomic_bool cpuBudget;
+    float targetLoad;
+    float averageLoad;
+    int maxPolyphony;
+    int polyphony;
+    bool reducedQuality;
+    int periodsSinceChange;
+
+    MIDIEvent events[EVENT_QUEUE_SIZE];
+    atomic_uint eventHead;
+    atomic_uint eventTail;
 } MIDIHandler;
 
+// Mixer entry points exported by libwinlator (winlator/alsa_client.c)
+typedef void (*MixerRenderFunc)(void* data, float* out, int numFrames);
+typedef int32_t (*AudioMixerAddSource)(MixerRenderFunc render, void* data);
+typedef void (*AudioMixerRemoveSource)(MixerRenderFunc render, void* data);
+
+static AudioMixerAddSource audioMixerAddSource = NULL;
+static AudioMixerRemoveSource audioMixerRemoveSource = NULL;
+
+// applied to synths created afterwards, see setSynthThreads
+static int synthCpuCores = 4;
+static int synthAffinityMask = 0;
+
+typedef int (*RenderFunc)(fluid_synth_t* synth, int offset, int len, void* target);
+
+typedef struct DriverBuffers {
+    int nfx;
+    float** fx;
+    int nout;
+    float** out;
+} DriverBuffers;
+
 static void setAudioLatency(fluid_settings_t* settings, int ms) {
     double periodSize = LATENCY_MILLIS_TO_BUFFER_SIZE(ms);
     fluid_settings_setnum(settings, "audio.period-size", periodSize);
     fluid_settings_setint(settings, "audio.periods", 2);
 }
 
-static MIDIHandler* MIDIHandler_allocate() {
+static uint32_t currentTimeMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+}
+
+static int64_t currentTimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void setThreadAffinity(int mask) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int i = 0; i < 32; i++) {
+        if (mask & (1 << i)) CPU_SET(i, &cpuSet);
+    }
+    sched_setaffinity(0, sizeof(cpuSet), &cpuSet);
+}
+
+// Worker threads inherit the affinity of the thread creating the synth, so it
+// is narrowed to the configured cores only for the duration of new_fluid_synth.
+static fluid_synth_t* createSynth(fluid_settings_t* settings) {
+    cpu_set_t previous;
+    bool restore = synthAffinityMask != 0 && sched_getaffinity(0, sizeof(previous), &previous) == 0;
+    if (restore) setThreadAffinity(synthAffinityMask);
+    fluid_synth_t* synth = new_fluid_synth(settings);
+    if (restore) sched_setaffinity(0, sizeof(previous), &previous);
+    return synth;
+}
+
+/*
+ * Keeps the render time under targetLoad of the period: linear interpolation
+ * is the first step down, then polyphony shrinks by a quarter at a time. Once
+ * the load stays under half the target it is given back in the reverse order.
+ */
+static void updateCPUBudget(MIDIHandler* midiHandler, int64_t renderNanos, int len) {
+    if (!atomic_load_explicit(&midiHandler->cpuBudget, memory_order_relaxed) || len <= 0) return;
+
+    float load = renderNanos / (len * 1e9f / midiHandler->sampleRate);
+    midiHandler->averageLoad += (load - midiHandler->averageLoad) * LOAD_SMOOTHING;
+    midiHandler->periodsSinceChange++;
+
+    if (midiHandler->averageLoad > midiHandler->targetLoad) {
+        if (midiHandler->periodsSinceChange < BUDGET_REDUCE_PERIODS) return;
+        if (!midiHandler->reducedQuality) {
+            fluid_synth_set_interp_method(midiHandler->synth, -1, FLUID_INTERP_LINEAR);
+            midiHandler->reducedQuality = true;
+        }
+        else if (midiHandler->polyphony > MIN_POLYPHONY) {
+            midiHandler->polyphony = midiHandler->polyphony * 3 / 4;
+            if (midiHandler->polyphony < MIN_POLYPHONY) midiHandler->polyphony = MIN_POLYPHONY;
+            fluid_synth_set_polyphony(midiHandler->synth, midiHandler->polyphony);
+        }
+        midiHandler->periodsSinceChange = 0;
+    }
+    else if (midiHandler->averageLoad < midiHandler->targetLoad * 0.5f) {
+        if (midiHandler->periodsSinceChange < BUDGET_RESTORE_PERIODS) return;
+        if (midiHandler->polyphony < midiHandler->maxPolyphony) {
+            midiHandler->polyphony += midiHandler->polyphony / 8;
+            if (midiHandler->polyphony > midiHandler->maxPolyphony) midiHandler->polyphony = midiHandler->maxPolyphony;
+            fluid_synth_set_polyphony(midiHandler->synth, midiHandler->polyphony);
+        }
+        else if (midiHandler->reducedQuality) {
+            fluid_synth_set_interp_method(midiHandler->synth, -1, FLUID_INTERP_DEFAULT);
+            midiHandler->reducedQuality = false;
+        }
+        midiHandler->periodsSinceChange = 0;
+    }
+}
+
+static void applyEvent(fluid_synth_t* synth, const MIDIEvent* event) {
+    int channel = event->status & 0x0f;
+    switch (event->status & 0xf0) {
+        case 0x80:
+            fluid_synth_noteoff(synth, channel, event->data1);
+            break;
+        case 0x90:
+            fluid_synth_noteon(synth, channel, event->data1, event->data2);
+            break;
+        case 0xa0:
+            fluid_synth_key_pressure(synth, channel, event->data1, event->data2);
+            break;
+        case 0xb0:
+            fluid_synth_cc(synth, channel, event->data1, event->data2);
+            break;
+        case 0xc0:
+            fluid_synth_program_change(synth, channel, event->data1);
+            break;
+        case 0xd0:
+            fluid_synth_channel_pressure(synth, channel, event->data1);
+            break;
+        case 0xe0:
+            fluid_synth_pitch_bend(synth, channel, event->data1 | (event->data2 << 7));
+            break;
+    }
+}
+
+static int renderDriverFrames(fluid_synth_t* synth, int offset, int len, void* target) {
+    DriverBuffers* buffers = target;
+    int nout = buffers->nout;
+    int nfx = buffers->nfx;
+    float* outBuffers[nout];
+    for (int i = 0; i < nout; i++) outBuffers[i] = buffers->out[i] + offset;
+
+    // the driver has no effects buffers, so reverb and chorus are mixed into the dry output
+    if (nfx == 0) {
+        float* fxBuffers[4] = {outBuffers[0], outBuffers[nout > 1 ? 1 : 0], outBuffers[0], outBuffers[nout > 1 ? 1 : 0]};
+        return fluid_synth_process(synth, len, 4, fxBuffers, nout, outBuffers);
+    }
+
+    float* fxBuffers[nfx];
+    for (int i = 0; i < nfx; i++) fxBuffers[i] = buffers->fx[i] + offset;
+    return fluid_synth_process(synth, len, nfx, fxBuffers, nout, outBuffers);
+}
+
+static int renderMixerFrames(fluid_synth_t* synth, int offset, int len, void* target) {
+    float* out = target;
+    return fluid_synth_write_float(synth, len, out, offset * 2, 2, out, offset * 2 + 1, 2);
+}
+
+// Renders up to each due event, applies it and continues, so an event lands on its
+// own frame (rounded to the synth's 64-frame block) instead of the callback start.
+static int renderWithEvents(MIDIHandler* midiHandler, int len, RenderFunc render, void* target) {
+    uint32_t blockStart = currentTimeMicros() - midiHandler->eventDelay;
+    uint32_t tail = atomic_load_explicit(&midiHandler->eventTail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&midiHandler->eventHead, memory_order_acquire);
+    int done = 0;
+
+    while (tail != head) {
+        const MIDIEvent* event = &midiHandler->events[tail & (EVENT_QUEUE_SIZE - 1)];
+        int32_t delta = (int32_t)(event->time - blockStart);
+        int frame = delta > 0 ? (int)((int64_t)delta * midiHandler->sampleRate / 1000000) : 0;
+        if (frame >= len) break;
+
+        if (frame > done) {
+            render(midiHandler->synth, done, frame - done, target);
+            done = frame;
+        }
+        applyEvent(midiHandler->synth, event);
+        tail++;
+    }
+    atomic_store_explicit(&midiHandler->eventTail, tail, memory_order_release);
+
+    return done < len ? render(midiHandler->synth, done, len - done, target) : FLUID_OK;
+}
+
+static int MIDIHandler_render(void* data, int len, int nfx, float* fx[], int nout, float* out[]) {
+    MIDIHandler* midiHandler = data;
+    DriverBuffers buffers = {nfx, fx, nout, out};
+
+    // the driver thread belongs to this handler, unlike the shared mixer thread
+    if (!midiHandler->affinityApplied) {
+        if (synthAffinityMask != 0) setThreadAffinity(synthAffinityMask);
+        midiHandler->affinityApplied = true;
+    }
+
+    int64_t startTime = currentTimeNanos();
+    int result = renderWithEvents(midiHandler, len, renderDriverFrames, &buffers);
+    updateCPUBudget(midiHandler, currentTimeNanos() - startTime, len);
+    return result;
+}
+
+static void MIDIHandler_renderMixed(void* data, float* out, int numFrames) {
+    MIDIHandler* midiHandler = data;
+    if (!atomic_load_explicit(&midiHandler->ready, memory_order_acquire)) {
+        memset(out, 0, numFrames * 2 * sizeof(float));
+        return;
+    }
+    int64_t startTime = currentTimeNanos();
+    renderWithEvents(midiHandler, numFrames, renderMixerFrames, out);
+    updateCPUBudget(midiHandler, currentTimeNanos() - startTime, numFrames);
+}
+
+static void MIDIHandler_queueEvents(MIDIHandler* midiHandler, const uint8_t* data, int count) {
+    if (!midiHandler) return;
+    uint32_t head = atomic_load_explicit(&midiHandler->eventHead, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&midiHandler->eventTail, memory_order_acquire);
+
+    for (int i = 0; i < count; i++, data += EVENT_SIZE) {
+        MIDIEvent event;
+        event.time = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+        event.status = data[4];
+        event.data1 = data[5];
+        event.data2 = data[6];
+
+        if (head - tail == EVENT_QUEUE_SIZE) {
+            tail = atomic_load_explicit(&midiHandler->eventTail, memory_order_acquire);
+            // never drop a note-off: with the queue still full the event is applied right away
+            if (head - tail == EVENT_QUEUE_SIZE) {
+                applyEvent(midiHandler->synth, &event);
+                continue;
+            }
+        }
+
+        midiHandler->events[head & (EVENT_QUEUE_SIZE - 1)] = event;
+        head++;
+    }
+    atomic_store_explicit(&midiHandler->eventHead, head, memory_order_release);
+}
+
+static fluid_settings_t* createSettings() {
     fluid_settings_t* settings = new_fluid_settings();
     if (!settings) return NULL;
-    fluid_settings_setint(settings, "synth.cpu-cores", 4);
+    fluid_settings_setint(settings, "synth.cpu-cores", synthCpuCores);
     fluid_settings_setnum(settings, "synth.gain", 0.6f);
     fluid_settings_setstr(settings, "audio.oboe.performance-mode", "LowLatency");
     fluid_settings_setstr(settings, "audio.oboe.sharing-mode", "Exclusive");
     fluid_settings_setnum(settings, "synth.sample-rate", FLUIDSYNTH_SAMPLE_RATE);
 
     setAudioLatency(settings, FLUIDSYNTH_LATENCY);
+    return settings;
+}
 
-    fluid_synth_t* synth = new_fluid_synth(settings);
+static MIDIHandler* createMIDIHandler(fluid_settings_t* settings) {
+    MIDIHandler* midiHandler = calloc(1, sizeof(MIDIHandler));
+    if (!midiHandler) return NULL;
+    midiHandler->settings = settings;
+    midiHandler->soundfontId = -1;
+    midiHandler->sampleRate = FLUIDSYNTH_SAMPLE_RATE;
+    midiHandler->eventDelay = FLUIDSYNTH_LATENCY * 1000;
+    atomic_init(&midiHandler->eventHead, 0);
+    atomic_init(&midiHandler->eventTail, 0);
+    atomic_init(&midiHandler->ready, false);
+    atomic_init(&midiHandler->cpuBudget, false);
+    return midiHandler;
+}
+
+static MIDIHandler* MIDIHandler_allocate() {
+    fluid_settings_t* settings = createSettings();
+    if (!settings) return NULL;
+
+    fluid_synth_t* synth = createSynth(settings);
     if (!synth) {
         delete_fluid_settings(settings);
         return NULL;
     }
 
-    fluid_audio_driver_t* driver = new_fluid_audio_driver(settings, synth);
-    if (!driver) {
+    MIDIHandler* midiHandler = createMIDIHandler(settings);
+    if (!midiHandler) {
         delete_fluid_synth(synth);
         delete_fluid_settings(settings);
         return NULL;
     }
-
-    MIDIHandler* midiHandler = calloc(1, sizeof(MIDIHandler));
-    midiHandler->settings = settings;
     midiHandler->synth = synth;
-    midiHandler->driver = driver;
-    midiHandler->soundfontId = -1;
+
+    midiHandler->driver = new_fluid_audio_driver2(settings, MIDIHandler_render, midiHandler);
+    if (!midiHandler->driver) {
+        delete_fluid_synth(synth);
+        delete_fluid_settings(settings);
+        free(midiHandler);
+        return NULL;
+    }
     return midiHandler;
 }
 
+static bool loadAudioMixer() {
+    if (audioMixerAddSource && audioMixerRemoveSource) return true;
+    // the audio latency test links the mixer into its executable instead
+    void* handle = dlopen("libwinlator.so", RTLD_NOW | RTLD_NOLOAD);
+    if (!handle) handle = RTLD_DEFAULT;
+    audioMixerAddSource = (AudioMixerAddSource)dlsym(handle, "AudioMixer_addSource");
+    audioMixerRemoveSource = (AudioMixerRemoveSource)dlsym(handle, "AudioMixer_removeSource");
+    return audioMixerAddSource && audioMixerRemoveSource;
+}
+
+// Renders the synth from the shared mixer callback at the device rate instead of
+// opening its own Oboe stream, falling back to the driver when there is no mixer.
+static MIDIHandler* MIDIHandler_allocateMixed() {
+    if (!loadAudioMixer()) return MIDIHandler_allocate();
+
+    fluid_settings_t* settings = createSettings();
+    if (!settings) return NULL;
+
+    MIDIHandler* midiHandler = createMIDIHandler(settings);
+    if (!midiHandler) {
+        delete_fluid_settings(settings);
+        return NULL;
+    }
+
+    int sampleRate = audioMixerAddSource(MIDIHandler_renderMixed, midiHandler);
+    if (sampleRate <= 0) {
+        delete_fluid_settings(settings);
+        free(midiHandler);
+        return MIDIHandler_allocate();
+    }
+    midiHandler->mixed = true;
+    midiHandler->sampleRate = sampleRate;
+    // the mixer runs a couple of bursts ahead instead of two 40 ms periods
+    midiHandler->eventDelay = MIXER_EVENT_DELAY * 1000;
+    fluid_settings_setnum(settings, "synth.sample-rate", sampleRate);
+
+    midiHandler->synth = createSynth(settings);
+    if (!midiHandler->synth) {
+        audioMixerRemoveSource(MIDIHandler_renderMixed, midiHandler);
+        delete_fluid_settings(settings);
+        free(midiHandler);
+        return NULL;
+    }
+    atomic_store_explicit(&midiHandler->ready, true, memory_order_release);
+    return midiHandler;
+}
+
+/*
+ * Parsed soundfonts are kept for the lifetime of the process, owned by a synth
+ * that never renders, and added to each handler's synth with
+ * fluid_synth_add_sfont. Re-creating a handler then only links the already
+ * loaded presets and samples instead of reading and parsing the SF2 again.
+ */
+typedef struct SoundFontCache {
+    fluid_settings_t* settings;
+    fluid_synth_t* synth;
+    int numSoundFonts;
+    char* paths[MAX_CACHED_SOUNDFONTS];
+    fluid_sfont_t* soundfonts[MAX_CACHED_SOUNDFONTS];
+} SoundFontCache;
+
+static SoundFontCache soundfontCache;
+static pthread_mutex_t soundfontCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static fluid_sfont_t* getCachedSoundFont(const char* path) {
+    fluid_sfont_t* soundfont = NULL;
+    pthread_mutex_lock(&soundfontCacheLock);
+    for (int i = 0; i < soundfontCache.numSoundFonts; i++) {
+        if (strcmp(soundfontCache.paths[i], path) == 0) {
+            soundfont = soundfontCache.soundfonts[i];
+            break;
+        }
+    }
+
+    if (!soundfont && soundfontCache.numSoundFonts < MAX_CACHED_SOUNDFONTS) {
+        if (!soundfontCache.synth) {
+            soundfontCache.settings = new_fluid_settings();
+            if (soundfontCache.settings) {
+                fluid_settings_setint(soundfontCache.settings, "synth.polyphony", 1);
+                soundfontCache.synth = new_fluid_synth(soundfontCache.settings);
+            }
+        }
+
+        int id = soundfontCache.synth ? fluid_synth_sfload(soundfontCache.synth, path, 0) : FLUID_FAILED;
+        if (id != FLUID_FAILED) {
+            soundfont = fluid_synth_get_sfont_by_id(soundfontCache.synth, id);
+            soundfontCache.paths[soundfontCache.numSoundFonts] = strdup(path);
+            soundfontCache.soundfonts[soundfontCache.numSoundFonts++] = soundfont;
+        }
+    }
+    pthread_mutex_unlock(&soundfontCacheLock);
+    return soundfont;
+}
+
+static void unloadSoundFont(MIDIHandler* midiHandler) {
+    if (midiHandler->soundfont) {
+        fluid_synth_remove_sfont(midiHandler->synth, midiHandler->soundfont);
+    }
+    else if (midiHandler->soundfontId != -1) {
+        fluid_synth_sfunload(midiHandler->synth, midiHandler->soundfontId, 1);
+    }
+    midiHandler->soundfont = NULL;
+    midiHandler->soundfontId = -1;
+}
+
 static void MIDIHandler_destroy(MIDIHandler* midiHandler) {
     if (!midiHandler) return;
-    if (midiHandler->soundfontId != -1) fluid_synth_sfunload(midiHandler->synth, midiHandler->soundfontId, 1);
-    delete_fluid_audio_driver(midiHandler->driver);
+    if (midiHandler->mixed) audioMixerRemoveSource(MIDIHandler_renderMixed, midiHandler);
+    else delete_fluid_audio_driver(midiHandler->driver);
+    // a cached soundfont must leave the synth's list, or deleting the synth would free it
+    unloadSoundFont(midiHandler);
     delete_fluid_synth(midiHandler->synth);
     delete_fluid_settings(midiHandler->settings);
     free(midiHandler);
@@ -97,8 +500,17 @@ static void MIDIHandler_pitchBend(MIDIHandler* midiHandler, int channel, int val
 
 static void MIDIHandler_loadSoundFont(MIDIHandler* midiHandler, const char* path) {
     if (!midiHandler) return;
-    midiHandler->soundfontId = -1;
-    int id = fluid_synth_sfload(midiHandler->synth, path, 0);
+    unloadSoundFont(midiHandler);
+
+    int id = FLUID_FAILED;
+    fluid_sfont_t* soundfont = getCachedSoundFont(path);
+    if (soundfont) {
+        id = fluid_synth_add_sfont(midiHandler->synth, soundfont);
+        if (id != FLUID_FAILED) midiHandler->soundfont = soundfont;
+    }
+    // a font the cache cannot hold is still loaded, just privately
+    if (id == FLUID_FAILED) id = fluid_synth_sfload(midiHandler->synth, path, 0);
+
     if (id != FLUID_FAILED) {
         midiHandler->soundfontId = id;
         for (int i = 0; i < 16; i++) {
@@ -114,6 +526,41 @@ Java_com_winlator_winhandler_MIDIHandler_nativeAllocate(JNIEnv *env, jobject obj
     return (jlong)midiHandler;
 }
 
+JNIEXPORT jlong JNICALL
+Java_com_winlator_winhandler_MIDIHandler_nativeAllocateMixed(JNIEnv *env, jobject obj) {
+    MIDIHandler* midiHandler = MIDIHandler_allocateMixed();
+    return (jlong)midiHandler;
+}
+
+JNIEXPORT void JNICALL
+Java_com_winlator_winhandler_MIDIHandler_setSynthThreads(JNIEnv *env, jclass obj, jint cpuCores,
+                                                         jint affinityMask) {
+    synthCpuCores = cpuCores > 0 ? cpuCores : 1;
+    synthAffinityMask = affinityMask;
+}
+
+JNIEXPORT void JNICALL
+Java_com_winlator_winhandler_MIDIHandler_setCPUBudget(JNIEnv *env, jobject obj, jlong nativePtr,
+                                                      jboolean enabled, jfloat targetLoad) {
+    MIDIHandler* midiHandler = (MIDIHandler*)nativePtr;
+    if (!midiHandler) return;
+
+    // stop further adjustments before undoing the ones already made
+    atomic_store(&midiHandler->cpuBudget, false);
+    if (midiHandler->polyphony != midiHandler->maxPolyphony) {
+        fluid_synth_set_polyphony(midiHandler->synth, midiHandler->maxPolyphony);
+    }
+    if (midiHandler->reducedQuality) fluid_synth_set_interp_method(midiHandler->synth, -1, FLUID_INTERP_DEFAULT);
+
+    midiHandler->maxPolyphony = fluid_synth_get_polyphony(midiHandler->synth);
+    midiHandler->polyphony = midiHandler->maxPolyphony;
+    midiHandler->reducedQuality = false;
+    midiHandler->averageLoad = 0.0f;
+    midiHandler->periodsSinceChange = 0;
+    midiHandler->targetLoad = targetLoad > 0.0f ? targetLoad : 0.5f;
+    atomic_store(&midiHandler->cpuBudget, enabled);
+}
+
 JNIEXPORT void JNICALL
 Java_com_winlator_winhandler_MIDIHandler_destroy(JNIEnv *env, jobject obj,
                                                  jlong nativePtr) {
@@ -136,7 +583,9 @@ JNIEXPORT void JNICALL
 Java_com_winlator_winhandler_MIDIHandler_loadSoundFont(JNIEnv *env, jobject obj, jlong nativePtr,
                                                        jstring soundfontPath) {
     const char* path = (*env)->GetStringUTFChars(env, soundfontPath, NULL);
+    if (!path) return;
     MIDIHandler_loadSoundFont((MIDIHandler*)nativePtr, path);
+    (*env)->ReleaseStringUTFChars(env, soundfontPath, path);
 }
 
 JNIEXPORT void JNICALL
@@ -161,4 +610,13 @@ JNIEXPORT void JNICALL
 Java_com_winlator_winhandler_MIDIHandler_keyPressure(JNIEnv *env, jobject obj, jlong nativePtr,
                                                      jint channel, jint key, jint value) {
     MIDIHandler_keyPressure((MIDIHandler*)nativePtr, channel, key, value);
-}
\ No newline at end of file
+}
+JNIEXPORT void JNICALL
+Java_com_winlator_winhandler_MIDIHandler_queueEvents(JNIEnv *env, jobject obj, jlong nativePtr,
+                                                     jobject events, jint count) {
+    const uint8_t* data = (*env)->GetDirectBufferAddress(env, events);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, events);
+    if (!data || count <= 0) return;
+    if ((jlong)count * EVENT_SIZE > capacity) count = capacity / EVENT_SIZE;
+    MIDIHandler_queueEvents((MIDIHandler*)nativePtr, data, count);
+}
@@ -0,0 +1,428 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>      /* open(2), AT_FDCWD, */
+#include <limits.h>     /* PATH_MAX, */
+#include <stdint.h>     /* uint64_t, */
+#include <stdio.h>      /* printf(3), */
+#include <stdlib.h>     /* getenv(3), atol(3), */
+#include <string.h>     /* strcmp(3), */
+#include <time.h>       /* clock_gettime(2), */
+#include <unistd.h>     /* syscall(2), fork(2), */
+#include <linux/futex.h> /* FUTEX_*, */
+#include <sys/socket.h> /* socket(2), */
+#include <sys/stat.h>   /* struct stat, */
+#include <sys/syscall.h> /* SYS_*, */
+#include <sys/un.h>     /* struct sockaddr_un, */
+#include <sys/wait.h>   /* waitpid(2), */
+
+/*
+ * Syscall cost benchmark, meant to be run inside the guest rootfs both
+ * natively and under PRoot: every syscall class PRoot handles in its own
+ * way is looped for a fixed time and its mean cost per call is printed.
+ * Syscalls are issued through syscall(2) so that libc caches and
+ * wrappers don't hide any of them.  Given the table of a native run, the
+ * overhead PRoot adds to each call is printed as well.
+ *
+ * read (pread64) and futex aren't in the seccomp filter, they measure
+ * what a syscall costs when the tracer isn't involved at all.
+ */
+
+/* 32-bit ABIs only have the 64-bit variant.  */
+#ifndef SYS_newfstatat
+#define SYS_newfstatat SYS_fstatat64
+#endif
+
+#define BENCH_DEFAULT_MILLIS 500
+#define BENCH_MAX_BASELINE 32
+
+struct bench {
+	const char *name;
+	void (*run)(long count);
+};
+
+struct baseline {
+	char name[32];
+	double ns;
+};
+
+static char self_path[PATH_MAX];
+static char file_path[PATH_MAX];
+static char link_path[PATH_MAX];
+static char socket_path[PATH_MAX];
+static int file_fd = -1;
+static int socket_fd = -1;
+static struct sockaddr_un socket_addr;
+static int futex_word;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_stat(long count)
+{
+	struct stat statbuf;
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_newfstatat, AT_FDCWD, file_path, &statbuf, 0);
+}
+
+/* close(2) isn't traced, it only adds what a native call costs.  */
+static void bench_openat(long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++) {
+		int fd = syscall(SYS_openat, AT_FDCWD, file_path, O_RDONLY | O_CLOEXEC);
+		if (fd >= 0)
+			syscall(SYS_close, fd);
+	}
+}
+
+static void bench_readlink(long count)
+{
+	char buffer[PATH_MAX];
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_readlinkat, AT_FDCWD, link_path, buffer, sizeof(buffer));
+}
+
+static void bench_getcwd(long count)
+{
+	char buffer[PATH_MAX];
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_getcwd, buffer, sizeof(buffer));
+}
+
+/* One child execs itself @count times, see exec_chain().  */
+static void bench_execve(long count)
+{
+	char count_string[32];
+	pid_t pid;
+
+	snprintf(count_string, sizeof(count_string), "%ld", count);
+	pid = fork();
+	if (pid == 0) {
+		execl(self_path, self_path, "--exec-chain", count_string, (char *) NULL);
+		_exit(127);
+	}
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+}
+
+/* The child's exit and its reaping are part of every call.  */
+static void bench_fork(long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++) {
+		pid_t pid = fork();
+		if (pid == 0)
+			_exit(0);
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+	}
+}
+
+/* A datagram socket can be connected again and again, each call has its
+ * sockaddr_un translated.  */
+static void bench_connect(long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_connect, socket_fd, &socket_addr, sizeof(socket_addr));
+}
+
+static void bench_brk(long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_brk, 0);
+}
+
+static void bench_read(long count)
+{
+	char buffer[64];
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_pread64, file_fd, buffer, sizeof(buffer), 0);
+}
+
+static void bench_futex(long count)
+{
+	long i;
+
+	for (i = 0; i < count; i++)
+		syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static const struct bench benches[] = {
+	{ "stat",		bench_stat },
+	{ "openat+close",	bench_openat },
+	{ "readlink",		bench_readlink },
+	{ "getcwd",		bench_getcwd },
+	{ "execve",		bench_execve },
+	{ "fork+wait",		bench_fork },
+	{ "connect",		bench_connect },
+	{ "brk",		bench_brk },
+	{ "read",		bench_read },
+	{ "futex",		bench_futex },
+};
+
+/* Exec'ed by bench_execve(): execs itself until @count drops to 1.  */
+static int exec_chain(const char *path, long count)
+{
+	char count_string[32];
+
+	if (count <= 1)
+		return 0;
+
+	snprintf(count_string, sizeof(count_string), "%ld", count - 1);
+	execl(path, path, "--exec-chain", count_string, (char *) NULL);
+	return 127;
+}
+
+static int setup(void)
+{
+	const char *tmpdir = getenv("TMPDIR");
+	char dir[PATH_MAX - 16];
+	ssize_t length;
+	int server_fd;
+
+	length = readlink("/proc/self/exe", self_path, sizeof(self_path) - 1);
+	if (length < 0) {
+		perror("readlink /proc/self/exe");
+		return -1;
+	}
+	self_path[length] = '\0';
+
+	snprintf(dir, sizeof(dir), "%s/proot-bench-XXXXXX", tmpdir != NULL ? tmpdir : "/tmp");
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return -1;
+	}
+	snprintf(file_path, sizeof(file_path), "%s/file", dir);
+	snprintf(link_path, sizeof(link_path), "%s/link", dir);
+	snprintf(socket_path, sizeof(socket_path), "%s/socket", dir);
+
+	file_fd = open(file_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (file_fd < 0 || write(file_fd, dir, strlen(dir)) < 0 || symlink(file_path, link_path) < 0) {
+		perror("creating the bench files");
+		return -1;
+	}
+
+	if (strlen(socket_path) >= sizeof(socket_addr.sun_path)) {
+		fprintf(stderr, "%s is too long for a sockaddr_un\n", socket_path);
+		return -1;
+	}
+	socket_addr.sun_family = AF_UNIX;
+	strcpy(socket_addr.sun_path, socket_path);
+
+	server_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (server_fd < 0 || bind(server_fd, (struct sockaddr *) &socket_addr, sizeof(socket_addr)) < 0) {
+		perror("binding the bench socket");
+		return -1;
+	}
+	socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (socket_fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void cleanup(void)
+{
+	char *slash;
+
+	unlink(socket_path);
+	unlink(link_path);
+	unlink(file_path);
+	slash = strrchr(file_path, '/');
+	if (slash != NULL) {
+		*slash = '\0';
+		rmdir(file_path);
+	}
+}
+
+static int load_baseline(const char *path, struct baseline *baseline)
+{
+	char line[256];
+	int count = 0;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while (count < BENCH_MAX_BASELINE && fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%31s %lf", baseline[count].name, &baseline[count].ns) == 2)
+			count++;
+	}
+
+	fclose(file);
+	return count;
+}
+
+static const struct baseline *find_baseline(const struct baseline *baseline, int count, const char *name)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (strcmp(baseline[i].name, name) == 0)
+			return &baseline[i];
+	}
+	return NULL;
+}
+
+/* Tracer of this process as seen by the kernel, 0 when running natively.  */
+static long tracer_pid(void)
+{
+	char line[256];
+	long pid = 0;
+	FILE *file;
+
+	file = fopen("/proc/self/status", "r");
+	if (file == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "TracerPid: %ld", &pid) == 1)
+			break;
+	}
+
+	fclose(file);
+	return pid;
+}
+
+/* Runs @bench in batches that double until @millis have elapsed, and
+ * returns the mean cost of one call.  */
+static double run_bench(const struct bench *bench, long millis, long *calls)
+{
+	uint64_t target_ns = (uint64_t) millis * 1000000ULL;
+	uint64_t total_ns = 0;
+	long batch = 1;
+
+	bench->run(1);
+
+	*calls = 0;
+	while (total_ns < target_ns) {
+		uint64_t start = now_ns();
+		uint64_t elapsed;
+
+		bench->run(batch);
+		elapsed = now_ns() - start;
+
+		total_ns += elapsed;
+		*calls += batch;
+		if (elapsed < target_ns / 10)
+			batch *= 2;
+	}
+
+	return (double) total_ns / *calls;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-t millis] [-b native_table] [filter]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+	struct baseline baseline[BENCH_MAX_BASELINE];
+	int nb_baseline = 0;
+	const char *filter = NULL;
+	long millis = BENCH_DEFAULT_MILLIS;
+	size_t i;
+	int opt;
+
+	if (argc == 3 && strcmp(argv[1], "--exec-chain") == 0)
+		return exec_chain(argv[0], atol(argv[2]));
+
+	while ((opt = getopt(argc, argv, "t:b:h")) != -1) {
+		switch (opt) {
+		case 't':
+			millis = atol(optarg);
+			break;
+		case 'b':
+			nb_baseline = load_baseline(optarg, baseline);
+			if (nb_baseline < 0)
+				return 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind < argc)
+		filter = argv[optind];
+	if (millis <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (setup() < 0) {
+		cleanup();
+		return 1;
+	}
+
+	printf("# proot_syscall_bench, tracer pid %ld, %ld ms per syscall\n", tracer_pid(), millis);
+	if (nb_baseline > 0)
+		printf("# %-14s %12s %12s %12s %8s\n", "syscall", "ns/call", "calls", "+ns/call", "ratio");
+	else
+		printf("# %-14s %12s %12s\n", "syscall", "ns/call", "calls");
+
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		const struct baseline *native;
+		double ns;
+		long calls;
+
+		if (filter != NULL && strstr(benches[i].name, filter) == NULL)
+			continue;
+
+		ns = run_bench(&benches[i], millis, &calls);
+		native = find_baseline(baseline, nb_baseline, benches[i].name);
+		if (native != NULL && native->ns > 0)
+			printf("  %-14s %12.1f %12ld %12.1f %7.1fx\n", benches[i].name, ns, calls,
+			       ns - native->ns, ns / native->ns);
+		else
+			printf("  %-14s %12.1f %12ld\n", benches[i].name, ns, calls);
+		fflush(stdout);
+	}
+
+	cleanup();
+	return 0;
+}
@@ -41,8 +41,16 @@ typedef enum {
 	INFO,
 } Severity;
 
+/* Verbose notices above this level are compiled out, along with the
+ * evaluation of their arguments.  */
+#ifndef VERBOSE_MAX_LEVEL
+#define VERBOSE_MAX_LEVEL 9
+#endif
+
 #define VERBOSE(tracee, level, message, args...) do {			\
-		if (tracee == NULL || tracee->verbose >= (level))	\
+		if ((level) <= VERBOSE_MAX_LEVEL				\
+		    && __builtin_expect((tracee == NULL ? global_verbose_level	\
+					 : tracee->verbose) >= (level), 0))	\
 			note(tracee, INFO, INTERNAL, (message), ## args); \
 	} while (0)
 
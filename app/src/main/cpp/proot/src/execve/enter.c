@@ -31,6 +31,7 @@
 #include <stdlib.h>     /* getenv(3), */
 #include <stdio.h>      /* fwrite(3), */
 #include <assert.h>     /* assert(3), */
+#include <stdint.h>     /* uint64_t, */
 
 #include "execve/execve.h"
 #include "execve/elf.h"
@@ -153,15 +154,13 @@ int translate_and_check_exec(Tracee *tracee, char host_path[PATH_MAX], const cha
 }
 
 /**
- * Add @program_header (type PT_INTERP) to @load_info->interp.  This
+ * Set @load_info->interp to the ELF interpreter @user_path.  This
  * function returns -errno if an error occured, otherwise it returns
  * 0.
  */
-static int add_interp(Tracee *tracee, int fd, LoadInfo *load_info,
-		const ProgramHeader *program_header)
+static int set_interp(Tracee *tracee, LoadInfo *load_info, const char *user_path)
 {
 	char host_path[PATH_MAX];
-	char *user_path;
 	int status;
 
 	/* Only one PT_INTERP segment is allowed.  */
@@ -172,6 +171,32 @@ static int add_interp(Tracee *tracee, int fd, LoadInfo *load_info,
 	if (load_info->interp == NULL)
 		return -ENOMEM;
 
+	status = translate_and_check_exec(tracee, host_path, user_path);
+	if (status < 0)
+		return status;
+
+	load_info->interp->host_path = talloc_strdup(load_info->interp, host_path);
+	if (load_info->interp->host_path == NULL)
+		return -ENOMEM;
+
+	load_info->interp->user_path = talloc_strdup(load_info->interp, user_path);
+	if (load_info->interp->user_path == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Add @program_header (type PT_INTERP) to @load_info->interp.  This
+ * function returns -errno if an error occured, otherwise it returns
+ * 0.
+ */
+static int add_interp(Tracee *tracee, int fd, LoadInfo *load_info,
+		const ProgramHeader *program_header)
+{
+	char *user_path;
+	int status;
+
 	user_path = talloc_size(tracee->ctx, P(filesz) + 1);
 	if (user_path == NULL)
 		return -ENOMEM;
@@ -186,19 +211,7 @@ static int add_interp(Tracee *tracee, int fd, LoadInfo *load_info,
 
 	user_path[P(filesz)] = '\0';
 
-	status = translate_and_check_exec(tracee, host_path, user_path);
-	if (status < 0)
-		return status;
-
-	load_info->interp->host_path = talloc_strdup(load_info->interp, host_path);
-	if (load_info->interp->host_path == NULL)
-		return -ENOMEM;
-
-	load_info->interp->user_path = talloc_strdup(load_info->interp, user_path);
-	if (load_info->interp->user_path == NULL)
-		return -ENOMEM;
-
-	return 0;
+	return set_interp(tracee, load_info, user_path);
 }
 
 #undef P
@@ -246,6 +259,114 @@ static int add_load_info(const ElfHeader *elf_header,
 	return 0;
 }
 
+/* Number of ELF files whose load info is cached, and the limits of
+ * what an entry can hold.  */
+#define LOAD_INFO_CACHE_SIZE		64
+#define LOAD_INFO_CACHE_MAX_MAPPINGS	16
+#define LOAD_INFO_CACHE_MAX_INTERP	256
+
+/* What extract_load_info() found in an ELF file, before the
+ * interpreter is translated and load addresses are computed.  */
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+
+	ElfHeader elf_header;
+	bool needs_executable_stack;
+	size_t nb_mappings;
+	Mapping mappings[LOAD_INFO_CACHE_MAX_MAPPINGS];
+	char interp_user_path[LOAD_INFO_CACHE_MAX_INTERP];
+} LoadInfoCacheEntry;
+
+static LoadInfoCacheEntry load_info_cache[LOAD_INFO_CACHE_SIZE];
+
+/**
+ * Return the entry of the load info cache where the file described by
+ * @statf goes.
+ */
+static LoadInfoCacheEntry *get_load_info_cache_entry(const struct stat *statf)
+{
+	uint64_t hash = (uint64_t) statf->st_ino * 0x9e3779b97f4a7c15ULL ^ statf->st_dev;
+
+	return &load_info_cache[(hash >> 32) % LOAD_INFO_CACHE_SIZE];
+}
+
+/**
+ * Check the cached @entry still describes the file @statf.
+ */
+static bool is_load_info_cache_hit(const LoadInfoCacheEntry *entry, const struct stat *statf)
+{
+	return entry->nb_mappings != 0
+		&& entry->ino  == statf->st_ino
+		&& entry->dev  == statf->st_dev
+		&& entry->size == statf->st_size
+		&& entry->mtime.tv_sec  == statf->st_mtim.tv_sec
+		&& entry->mtime.tv_nsec == statf->st_mtim.tv_nsec
+		&& entry->ctime.tv_sec  == statf->st_ctim.tv_sec
+		&& entry->ctime.tv_nsec == statf->st_ctim.tv_nsec;
+}
+
+/**
+ * Fill @load_info from the cached @entry.  This function returns
+ * -errno if an error occured, otherwise it returns 0.
+ */
+static int load_info_from_cache(Tracee *tracee, LoadInfo *load_info,
+				const LoadInfoCacheEntry *entry)
+{
+	load_info->elf_header = entry->elf_header;
+	load_info->needs_executable_stack = entry->needs_executable_stack;
+
+	load_info->mappings = talloc_memdup(load_info, entry->mappings,
+					entry->nb_mappings * sizeof(Mapping));
+	if (load_info->mappings == NULL)
+		return -ENOMEM;
+	talloc_set_name_const(load_info->mappings, "Mapping");
+
+	if (entry->interp_user_path[0] == '\0')
+		return 0;
+
+	/* The interpreter path is translated each time since
+	 * bindings depend on the tracee.  */
+	return set_interp(tracee, load_info, entry->interp_user_path);
+}
+
+/**
+ * Remember the freshly extracted @load_info of the file @statf, if it
+ * fits in the cache.
+ */
+static void load_info_to_cache(const LoadInfo *load_info, const struct stat *statf)
+{
+	LoadInfoCacheEntry *entry = get_load_info_cache_entry(statf);
+	size_t nb_mappings;
+
+	nb_mappings = talloc_array_length(load_info->mappings);
+	if (nb_mappings == 0 || nb_mappings > LOAD_INFO_CACHE_MAX_MAPPINGS)
+		return;
+
+	if (load_info->interp != NULL
+	    && strlen(load_info->interp->user_path) >= LOAD_INFO_CACHE_MAX_INTERP)
+		return;
+
+	entry->dev   = statf->st_dev;
+	entry->ino   = statf->st_ino;
+	entry->size  = statf->st_size;
+	entry->mtime = statf->st_mtim;
+	entry->ctime = statf->st_ctim;
+
+	entry->elf_header = load_info->elf_header;
+	entry->needs_executable_stack = load_info->needs_executable_stack;
+	entry->nb_mappings = nb_mappings;
+	memcpy(entry->mappings, load_info->mappings, nb_mappings * sizeof(Mapping));
+
+	if (load_info->interp != NULL)
+		strcpy(entry->interp_user_path, load_info->interp->user_path);
+	else
+		entry->interp_user_path[0] = '\0';
+}
+
 /**
  * Extract the load info from @load->host_path.  This function returns
  * -errno if an error occured, otherwise it returns 0.
@@ -253,12 +374,24 @@ static int add_load_info(const ElfHeader *elf_header,
 static int extract_load_info(Tracee *tracee, LoadInfo *load_info)
 {
 	struct add_load_info_data data;
+	LoadInfoCacheEntry *entry;
+	struct stat statf;
+	bool cacheable;
 	int fd = -1;
 	int status;
 
 	assert(load_info != NULL);
 	assert(load_info->host_path != NULL);
 
+	/* Launchers exec the same few files over and over, don't
+	 * parse them again as long as they are unchanged.  */
+	cacheable = (stat(load_info->host_path, &statf) == 0);
+	if (cacheable) {
+		entry = get_load_info_cache_entry(&statf);
+		if (is_load_info_cache_hit(entry, &statf))
+			return load_info_from_cache(tracee, load_info, entry);
+	}
+
 	fd = open_elf(load_info->host_path, &load_info->elf_header);
 	if (fd < 0)
 		return fd;
@@ -279,6 +412,8 @@ static int extract_load_info(Tracee *tracee, LoadInfo *load_info)
 	data.fd        = fd;
 
 	status = iterate_program_headers(tracee, fd, &load_info->elf_header, add_load_info, &data);
+	if (status >= 0 && cacheable)
+		load_info_to_cache(load_info, &statf);
 end:
 	if (fd >= 0)
 		close(fd);
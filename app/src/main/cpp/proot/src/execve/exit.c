@@ -137,29 +137,63 @@ static int bind_proc_pid_auxv(const Tracee *ptracee)
 	return 0;
 }
 
+/**
+ * Check if @next can be mapped by the same mmap(2) as @previous: both
+ * are of the same kind and protection, and @next continues @previous
+ * in memory and, for file mappings, in the file too with no tail to
+ * clear in between.
+ */
+static bool can_merge_mappings(const Mapping *previous, const Mapping *next)
+{
+	if (previous->addr + previous->length != next->addr
+	    || previous->prot != next->prot
+	    || (previous->flags & MAP_ANONYMOUS) != (next->flags & MAP_ANONYMOUS))
+		return false;
+
+	if ((next->flags & MAP_ANONYMOUS) != 0)
+		return true;
+
+	return previous->clear_length == 0
+		&& previous->offset + previous->length == next->offset;
+}
+
 /**
  * Convert @mappings into load @script statements at the given @cursor
- * position.  This function returns the new cursor position.
+ * position, one per run of mappings that can be merged.  This
+ * function returns the new cursor position.
  */
 static void *transcript_mappings(void *cursor, const Mapping *mappings)
 {
 	size_t nb_mappings;
 	size_t i;
+	size_t j;
 
 	nb_mappings = talloc_array_length(mappings);
-	for (i = 0; i < nb_mappings; i++) {
+	for (i = 0; i < nb_mappings; i = j) {
 		LoadStatement *statement = cursor;
+		word_t length = mappings[i].length;
+
+		for (j = i + 1; j < nb_mappings && can_merge_mappings(&mappings[j - 1], &mappings[j]); j++)
+			length += mappings[j].length;
 
-		if ((mappings[i].flags & MAP_ANONYMOUS) != 0)
+		/* Anonymous mappings have neither offset nor tail to
+		 * clear, their statement is shorter.  */
+		if ((mappings[i].flags & MAP_ANONYMOUS) != 0) {
 			statement->action = LOAD_ACTION_MMAP_ANON;
-		else
-			statement->action = LOAD_ACTION_MMAP_FILE;
+			statement->mmap_anon.addr   = mappings[i].addr;
+			statement->mmap_anon.length = length;
+			statement->mmap_anon.prot   = mappings[i].prot;
+
+			cursor += LOAD_STATEMENT_SIZE(*statement, mmap_anon);
+			continue;
+		}
 
+		statement->action = LOAD_ACTION_MMAP_FILE;
 		statement->mmap.addr   = mappings[i].addr;
-		statement->mmap.length = mappings[i].length;
+		statement->mmap.length = length;
 		statement->mmap.prot   = mappings[i].prot;
 		statement->mmap.offset = mappings[i].offset;
-		statement->mmap.clear_length = mappings[i].clear_length;
+		statement->mmap.clear_length = mappings[j - 1].clear_length;
 
 		cursor += LOAD_STATEMENT_SIZE(*statement, mmap);
 	}
@@ -179,6 +213,7 @@ static int transfer_load_script(Tracee *tracee)
 
 	word_t entry_point;
 
+	size_t script_max_size;
 	size_t script_size;
 	size_t strings_size;
 	size_t string1_size;
@@ -225,8 +260,9 @@ static int transfer_load_script(Tracee *tracee)
 	string1_address = stack_pointer - strings_size;
 	string2_address = stack_pointer - strings_size + string1_size;
 
-	/* Compute the size of the load script.  */
-	script_size =
+	/* Compute the size of the load script before mappings are
+	 * merged, see transcript_mappings().  */
+	script_max_size =
 		LOAD_STATEMENT_SIZE(*statement, open)
 		+ (LOAD_STATEMENT_SIZE(*statement, mmap)
 			* talloc_array_length(tracee->load_info->mappings))
@@ -239,8 +275,7 @@ static int transfer_load_script(Tracee *tracee)
 
 	/* Allocate enough room for both the load script and the
 	 * strings area.  */
-	buffer_size = script_size + strings_size;
-	buffer = talloc_zero_size(tracee->ctx, buffer_size);
+	buffer = talloc_zero_size(tracee->ctx, script_max_size + strings_size);
 	if (buffer == NULL)
 		return -ENOMEM;
 
@@ -303,7 +338,9 @@ static int transfer_load_script(Tracee *tracee)
 	cursor += LOAD_STATEMENT_SIZE(*statement, start);
 
 	/* Sanity check.  */
-	assert((uintptr_t) cursor - (uintptr_t) buffer == script_size);
+	script_size = (uintptr_t) cursor - (uintptr_t) buffer;
+	assert(script_size <= script_max_size);
+	buffer_size = script_size + strings_size;
 
 	/* Convert the load script to the expected format.  */
 	if (is_32on64_mode(tracee)) {
@@ -157,12 +157,12 @@ void _start(void *cursor)
 			break;
 
 		case LOAD_ACTION_MMAP_ANON:
-			status = SYSCALL(MMAP, 6, stmt->mmap.addr, stmt->mmap.length,
-					stmt->mmap.prot, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
-			if (unlikely(status != stmt->mmap.addr))
+			status = SYSCALL(MMAP, 6, stmt->mmap_anon.addr, stmt->mmap_anon.length,
+					stmt->mmap_anon.prot, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+			if (unlikely(status != stmt->mmap_anon.addr))
 				FATAL();
 
-			cursor += LOAD_STATEMENT_SIZE(*stmt, mmap);
+			cursor += LOAD_STATEMENT_SIZE(*stmt, mmap_anon);
 			break;
 
 		case LOAD_ACTION_MAKE_STACK_EXEC:
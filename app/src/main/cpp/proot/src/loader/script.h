@@ -42,6 +42,12 @@ struct load_statement {
 			word_t clear_length;
 		} mmap;
 
+		struct {
+			word_t addr;
+			word_t length;
+			word_t prot;
+		} mmap_anon;
+
 		struct {
 			word_t start;
 		} make_stack_exec;
@@ -60,6 +66,8 @@ struct load_statement {
 
 typedef struct load_statement LoadStatement;
 
+/* Every statement is an even number of words, this keeps the stack
+ * pointer the script is put below 16-byte aligned on AArch64.  */
 #define LOAD_STATEMENT_SIZE(statement, type) \
 	(sizeof((statement).action) + sizeof((statement).type))
 
@@ -33,6 +33,7 @@
 #include "path/binding.h"
 #include "path/path.h"
 #include "path/canon.h"
+#include "path/glue.h"
 #include "cli/note.h"
 
 #include "compat.h"
@@ -95,6 +96,140 @@
 
 extern char *root_path;
 
+/* Node of a prefix tree of bindings: one per path component, where
+ * @binding is the first binding -- in the list order -- that is
+ * exactly at this location.  */
+typedef struct binding_node {
+	struct binding_node *children;
+	struct binding_node *next;
+	const char *component;
+	size_t length;
+	const Binding *binding;
+} BindingNode;
+
+/* Trees of another generation are obsolete, 0 is never used.  */
+static unsigned int bindings_generation = 1;
+
+/**
+ * Note that a list of bindings changed: the prefix trees and the
+ * cached canonicalizations built from it are obsolete.
+ */
+static void bindings_changed(void)
+{
+	bindings_generation++;
+	if (bindings_generation == 0)
+		bindings_generation = 1;
+
+	invalidate_canon_cache();
+}
+
+/**
+ * Return the child of @node for the path component @component, which
+ * is @length bytes long.  A new child is allocated in @context if
+ * @context is not NULL, otherwise NULL is returned if there's none.
+ */
+static BindingNode *get_binding_node(TALLOC_CTX *context, BindingNode *node,
+				const char *component, size_t length)
+{
+	BindingNode *child;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->length == length && memcmp(child->component, component, length) == 0)
+			return child;
+	}
+
+	if (context == NULL)
+		return NULL;
+
+	child = talloc_zero(context, BindingNode);
+	if (child == NULL)
+		return NULL;
+
+	child->component = component;
+	child->length = length;
+	child->next = node->children;
+	node->children = child;
+
+	return child;
+}
+
+/**
+ * Build the prefix tree of the @tracee's list of bindings for the
+ * given @side, its root is allocated in @context.  This function returns NULL if an error
+ * occurred.
+ */
+static BindingNode *build_binding_tree(const Tracee *tracee, TALLOC_CTX *context, Side side)
+{
+	const Binding *binding;
+	BindingNode *root;
+
+	root = talloc_zero(context, BindingNode);
+	if (root == NULL)
+		return NULL;
+
+	CIRCLEQ_FOREACH_(tracee, binding, side) {
+		const Path *ref = (side == GUEST ? &binding->guest : &binding->host);
+		const char *cursor = ref->path;
+		const char *end = ref->path + ref->length;
+		BindingNode *node = root;
+
+		/* compare_paths2() can't match an empty path.  */
+		if (ref->length == 0)
+			continue;
+
+		/* Ignore one trailing '/', as compare_paths2() does.  */
+		if (end[-1] == '/')
+			end--;
+
+		while (cursor < end) {
+			const char *start;
+
+			/* Skip the path separator.  */
+			cursor++;
+			start = cursor;
+			while (cursor < end && *cursor != '/')
+				cursor++;
+
+			node = get_binding_node(root, node, start, cursor - start);
+			if (node == NULL)
+				return NULL;
+		}
+
+		/* Earlier bindings take precedence, as in the list.  */
+		if (node->binding == NULL)
+			node->binding = binding;
+	}
+
+	return root;
+}
+
+/**
+ * Return the prefix tree of the @tracee's bindings for the given
+ * @side, rebuilding the trees if the lists of bindings changed since
+ * they were built.  This function returns NULL if an error occurred.
+ */
+static BindingNode *get_binding_tree(const Tracee *tracee, Side side)
+{
+	FileSystemNameSpace *fs = tracee->fs;
+
+	if (fs->binding_trees.generation != bindings_generation) {
+		TALLOC_FREE(fs->binding_trees.guest);
+		TALLOC_FREE(fs->binding_trees.host);
+
+		fs->binding_trees.guest = build_binding_tree(tracee, fs, GUEST);
+		fs->binding_trees.host  = build_binding_tree(tracee, fs, HOST);
+		if (fs->binding_trees.guest == NULL || fs->binding_trees.host == NULL) {
+			TALLOC_FREE(fs->binding_trees.guest);
+			TALLOC_FREE(fs->binding_trees.host);
+			return NULL;
+		}
+
+		fs->binding_trees.generation = bindings_generation;
+	}
+
+	return (side == GUEST ? fs->binding_trees.guest : fs->binding_trees.host);
+}
+
 /**
  * Print all bindings (verbose purpose).
  */
@@ -121,11 +256,54 @@ static void print_bindings(const Tracee *tracee)
 Binding *get_binding(const Tracee *tracee, Side side, const char path[PATH_MAX])
 {
 	Binding *binding;
+	const BindingNode *node;
+	const Binding *deepest;
+	const char *cursor;
 	size_t path_length = strlen(path);
 
 	/* Sanity checks.  */
 	assert(path != NULL && path[0] == '/');
 
+	/* Avoid false positive when a prefix of the rootfs is used as
+	 * an asymmetric binding, ex.:
+	 *
+	 *     proot -m /usr:/location /usr/local/slackware
+	 */
+	if (   side == HOST
+	    && compare_paths(root_path, "/") != PATHS_ARE_EQUAL
+	    && belongs_to_guestfs(path))
+		return NULL;
+
+	/* Bindings are sorted so that the deepest one comes first
+	 * among those containing @path, see insort_binding(): that's
+	 * the deepest node of the prefix tree along @path.  */
+	node = get_binding_tree(tracee, side);
+	if (node != NULL) {
+		deepest = node->binding;
+		cursor = path;
+		while (*cursor == '/') {
+			const char *start;
+
+			/* Skip the path separator, a trailing one is
+			 * ignored, an empty component matches nothing.  */
+			cursor++;
+			start = cursor;
+			while (*cursor != '\0' && *cursor != '/')
+				cursor++;
+			if (cursor == start)
+				break;
+
+			node = get_binding_node(NULL, (BindingNode *) node, start, cursor - start);
+			if (node == NULL)
+				break;
+
+			if (node->binding != NULL)
+				deepest = node->binding;
+		}
+
+		return (Binding *) deepest;
+	}
+
 	CIRCLEQ_FOREACH_(tracee, binding, side) {
 		Comparison comparison;
 		const Path *ref;
@@ -149,16 +327,6 @@ Binding *get_binding(const Tracee *tracee, Side side, const char path[PATH_MAX])
 		    && comparison != PATH1_IS_PREFIX)
 			continue;
 
-		/* Avoid false positive when a prefix of the rootfs is
-		 * used as an asymmetric binding, ex.:
-		 *
-		 *     proot -m /usr:/location /usr/local/slackware
-		 */
-		if (   side == HOST
-		    && compare_paths(root_path, "/") != PATHS_ARE_EQUAL
-		    && belongs_to_guestfs(path))
-				continue;
-
 		return binding;
 	}
 
@@ -242,6 +410,8 @@ int substitute_binding(const Tracee *tracee, Side side, char path[PATH_MAX])
  */
 void remove_binding_from_all_lists(const Tracee *tracee, Binding *binding)
 {
+       bindings_changed();
+
        if (IS_LINKED(binding, link.pending))
 	       CIRCLEQ_REMOVE_(tracee, binding, pending);
 
@@ -266,6 +436,8 @@ static void insort_binding(const Tracee *tracee, Side side, Binding *binding)
 	Binding *previous = NULL;
 	Binding *next = CIRCLEQ_FIRST(HEAD(tracee, side));
 
+	bindings_changed();
+
 	/* Find where it should be added in the list.  */
 	CIRCLEQ_FOREACH_(tracee, iterator, side) {
 		Comparison comparison;
@@ -411,6 +583,9 @@ static int remove_bindings(Bindings *bindings)
 
 	bzero(bindings, sizeof(Bindings));
 
+	/* Another list may be allocated at the same address.  */
+	bindings_changed();
+
 	return 0;
 }
 
@@ -687,6 +862,9 @@ int initialize_bindings(Tracee *tracee)
 
 	TALLOC_FREE(tracee->fs->bindings.pending);
 
+	/* The glue is now in the hands of the tracee.  */
+	free_glue_entries(tracee);
+
 	if (tracee->verbose > 0)
 		print_bindings(tracee);
 
@@ -29,6 +29,9 @@
 #include <string.h>    /* string(3), */
 #include <assert.h>    /* assert(3), */
 #include <stdio.h>     /* sscanf(3), */
+#include <stdint.h>    /* uint*_t, */
+#include <time.h>      /* clock_gettime(2), */
+#include <stdlib.h>    /* getenv(3), */
 
 #include "path/canon.h"
 #include "path/path.h"
@@ -117,6 +120,227 @@ static inline Finality next_component(char component[NAME_MAX], const char **cur
 	return NOT_FINAL;
 }
 
+/* Number of entries in the canonicalization cache, a power of 2.  */
+#define CANON_CACHE_SIZE 1024
+
+/* Longest guest and host paths the canonicalization cache keeps.  */
+#define CANON_CACHE_PATH_MAX 256
+
+/* Lifetime of a cached entry in milliseconds: it bounds how long a
+ * change made outside of the tracees -- hence not seen by PRoot -- may
+ * go unnoticed.  */
+#define CANON_CACHE_TTL 1000
+
+/* Outcome of substitute_binding() then lstat(2) for @guest_path, as
+ * seen through the bindings @bindings.  Tracees sharing the same
+ * bindings -- that is, the same root and the same binding list --
+ * share the entries.  */
+typedef struct {
+	const void *bindings;
+	unsigned int generation;
+	uint64_t expiry;
+
+	/* Result of substitute_binding() when it fails, 0 otherwise.  */
+	int binding_status;
+
+	/* st_mode reported by lstat(2), 0 when it failed.  */
+	mode_t mode;
+
+	char guest_path[CANON_CACHE_PATH_MAX];
+	char host_path[CANON_CACHE_PATH_MAX];
+} CanonCacheEntry;
+
+static CanonCacheEntry canon_cache[CANON_CACHE_SIZE];
+
+/* Entries of another generation are stale, 0 is never used.  */
+static unsigned int canon_cache_generation = 1;
+
+/* Guest prefixes that nothing but the tracees modifies, like the
+ * system directories of the rootfs, as listed in PROOT_STATIC_PATHS
+ * (separated by ':').  Their entries never expire, they are only
+ * dropped by invalidate_canon_cache().  */
+#define CANON_CACHE_MAX_STATIC_PATHS 16
+
+static struct {
+	bool initialized;
+	size_t nb_prefixes;
+	char *paths;
+	const char *prefixes[CANON_CACHE_MAX_STATIC_PATHS];
+	size_t lengths[CANON_CACHE_MAX_STATIC_PATHS];
+} static_paths;
+
+/**
+ * Parse PROOT_STATIC_PATHS, once.
+ */
+static void init_static_paths(void)
+{
+	const char *value;
+	char *cursor;
+	char *prefix;
+
+	static_paths.initialized = true;
+
+	value = getenv("PROOT_STATIC_PATHS");
+	if (value == NULL)
+		return;
+
+	/* Kept for the whole life of PRoot.  */
+	static_paths.paths = strdup(value);
+	if (static_paths.paths == NULL)
+		return;
+
+	for (prefix = strtok_r(static_paths.paths, ":", &cursor);
+	     prefix != NULL && static_paths.nb_prefixes < CANON_CACHE_MAX_STATIC_PATHS;
+	     prefix = strtok_r(NULL, ":", &cursor)) {
+		size_t length = strlen(prefix);
+
+		/* Only absolute guest paths, without trailing '/'.  */
+		while (length > 1 && prefix[length - 1] == '/')
+			prefix[--length] = '\0';
+		if (prefix[0] != '/' || length < 2)
+			continue;
+
+		static_paths.prefixes[static_paths.nb_prefixes] = prefix;
+		static_paths.lengths[static_paths.nb_prefixes] = length;
+		static_paths.nb_prefixes++;
+	}
+}
+
+/**
+ * Check whether @guest_path is under one of PROOT_STATIC_PATHS.
+ */
+static bool is_static_path(const char guest_path[PATH_MAX])
+{
+	size_t i;
+
+	if (!static_paths.initialized)
+		init_static_paths();
+
+	for (i = 0; i < static_paths.nb_prefixes; i++) {
+		size_t length = static_paths.lengths[i];
+
+		if (strncmp(guest_path, static_paths.prefixes[i], length) == 0
+		    && (guest_path[length] == '/' || guest_path[length] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Drop all the entries of the canonicalization cache.  This has to be
+ * called each time a tracee modifies the file-system name-space and
+ * each time a list of bindings changes.
+ */
+void invalidate_canon_cache(void)
+{
+	canon_cache_generation++;
+	if (canon_cache_generation == 0)
+		canon_cache_generation = 1;
+}
+
+/**
+ * Return the current time in milliseconds, as used for the expiry of
+ * cached entries.
+ */
+static inline uint64_t canon_cache_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Record in @stamp that a lookup made now holds until the next
+ * invalidation of the canonicalization cache, or until it expires.
+ */
+void stamp_canon_cache(CanonCacheStamp *stamp)
+{
+	stamp->generation = canon_cache_generation;
+	stamp->expiry = canon_cache_now() + CANON_CACHE_TTL;
+}
+
+/**
+ * Check whether a lookup stamped with @stamp still holds.
+ */
+bool is_canon_cache_stamp_valid(const CanonCacheStamp *stamp)
+{
+	return stamp->generation == canon_cache_generation
+		&& stamp->expiry > canon_cache_now();
+}
+
+/**
+ * Return the entry of the canonicalization cache where the outcome
+ * for @guest_path is kept, or NULL if it can't be cached.
+ */
+static inline CanonCacheEntry *get_canon_cache_entry(const Tracee *tracee, const char guest_path[PATH_MAX])
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const char *cursor;
+
+	/* Don't cache while a binding is being initialized since the
+	 * glue may be built, see build_glue().  */
+	if (tracee->glue_type != 0 || tracee->fs->bindings.guest == NULL)
+		return NULL;
+
+	/* Entries in "/proc" come and go with the processes.  */
+	if (strncmp(guest_path, "/proc", 5) == 0
+	    && (guest_path[5] == '/' || guest_path[5] == '\0'))
+		return NULL;
+
+	/* FNV-1a over the path, then the list of bindings.  */
+	for (cursor = guest_path; *cursor != '\0'; cursor++) {
+		hash ^= (uint8_t) *cursor;
+		hash *= 1099511628211ULL;
+	}
+	if (cursor - guest_path >= CANON_CACHE_PATH_MAX)
+		return NULL;
+
+	hash ^= (uintptr_t) tracee->fs->bindings.guest;
+	hash *= 1099511628211ULL;
+
+	return &canon_cache[(hash ^ (hash >> 32)) & (CANON_CACHE_SIZE - 1)];
+}
+
+/**
+ * Check whether @entry holds a valid outcome for @guest_path.
+ */
+static inline bool is_canon_cache_hit(const Tracee *tracee, const CanonCacheEntry *entry,
+				const char guest_path[PATH_MAX])
+{
+	return entry->generation == canon_cache_generation
+		&& entry->bindings == tracee->fs->bindings.guest
+		&& strcmp(entry->guest_path, guest_path) == 0
+		&& entry->expiry > canon_cache_now();
+}
+
+/**
+ * Record in @entry the outcome of substitute_binding() -- that is
+ * @binding_status and @host_path -- then of lstat(2) -- that is
+ * @mode -- for @guest_path.
+ */
+static inline void set_canon_cache_entry(const Tracee *tracee, CanonCacheEntry *entry,
+					const char guest_path[PATH_MAX], const char host_path[PATH_MAX],
+					int binding_status, mode_t mode)
+{
+	if (binding_status == 0 && strlen(host_path) >= CANON_CACHE_PATH_MAX) {
+		entry->generation = 0;
+		return;
+	}
+
+	entry->bindings = tracee->fs->bindings.guest;
+	entry->generation = canon_cache_generation;
+	entry->expiry = (is_static_path(guest_path)
+			? UINT64_MAX
+			: canon_cache_now() + CANON_CACHE_TTL);
+	entry->binding_status = binding_status;
+	entry->mode = mode;
+	strcpy(entry->guest_path, guest_path);
+	if (binding_status == 0)
+		strcpy(entry->host_path, host_path);
+}
+
 /**
  * Resolve bindings (if any) in @guest_path and copy the translated
  * path into @host_path.  Also, this function checks that a non-final
@@ -126,16 +350,44 @@ static inline Finality next_component(char component[NAME_MAX], const char **cur
  */
 static inline int substitute_binding_stat(Tracee *tracee, Finality finality, const char guest_path[PATH_MAX], char host_path[PATH_MAX])
 {
+	CanonCacheEntry *entry;
 	struct stat statl;
 	int status;
 
+	/* Wine keeps coming back to the same few prefixes, so the
+	 * outcome of the lookup is cached per path.  */
+	entry = get_canon_cache_entry(tracee, guest_path);
+	if (entry != NULL && is_canon_cache_hit(tracee, entry, guest_path)) {
+		if (entry->binding_status < 0)
+			return entry->binding_status;
+
+		strcpy(host_path, entry->host_path);
+		statl.st_mode = entry->mode;
+		status = (entry->mode == 0 ? -1 : 0);
+		goto check;
+	}
+
 	strcpy(host_path, guest_path);
 	status = substitute_binding(tracee, GUEST, host_path);
-	if (status < 0)
+	if (status < 0) {
+		if (entry != NULL)
+			set_canon_cache_entry(tracee, entry, guest_path, NULL, status, 0);
 		return status;
+	}
+
+	/* Components glued for a previous binding are known
+	 * already.  */
+	statl.st_mode = (tracee->glue_type != 0 ? get_glue_type(tracee, host_path) : 0);
+	if (statl.st_mode != 0)
+		status = 0;
+	else {
+		status = lstat(host_path, &statl);
+		if (status < 0)
+			statl.st_mode = 0;
+	}
 
-	statl.st_mode = 0;
-	status = lstat(host_path, &statl);
+	if (entry != NULL)
+		set_canon_cache_entry(tracee, entry, guest_path, host_path, 0, statl.st_mode);
 
 	/* Build the glue between the hostfs and the guestfs during
 	 * the initialization of a binding.  */
@@ -145,6 +397,7 @@ static inline int substitute_binding_stat(Tracee *tracee, Finality finality, con
 			status = -1;
 	}
 
+check:
 	/* Return an error if a non-final component isn't a directory
 	 * nor a symlink.  The error depends on why the component
 	 * could not be accessed (ENOENT, EACCES, ...), otherwise the
@@ -24,11 +24,23 @@
 #define CANON_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
 
 #include "tracee/tracee.h"
 
 extern int canonicalize(Tracee *tracee, const char *user_path, bool deref_final,
 			char guest_path[PATH_MAX], unsigned int nb_recursion);
+extern void invalidate_canon_cache(void);
+
+/* Validity of a path lookup cached outside of canonicalize(), see
+ * stamp_canon_cache().  */
+typedef struct {
+	unsigned int generation;
+	uint64_t expiry;
+} CanonCacheStamp;
+
+extern void stamp_canon_cache(CanonCacheStamp *stamp);
+extern bool is_canon_cache_stamp_valid(const CanonCacheStamp *stamp);
 
 #endif /* CANON_H */
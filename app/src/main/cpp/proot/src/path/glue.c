@@ -37,6 +37,67 @@
 
 #include "compat.h"
 
+struct glue_entry {
+	struct glue_entry *next;
+	mode_t type;
+	char *path;
+};
+
+/**
+ * Remember that @host_path was glued with the given @type, so
+ * get_glue_type() can report it without a lstat(2).  Entries are
+ * released once the bindings are initialized, the tracee may change
+ * the glue afterward.
+ */
+static void add_glue_entry(Tracee *tracee, const char *host_path, mode_t type)
+{
+	struct glue_entry *entry;
+
+	entry = talloc_zero(tracee, struct glue_entry);
+	if (entry == NULL)
+		return; /* Not fatal, lstat(2) will be used.  */
+
+	entry->path = talloc_strdup(entry, host_path);
+	if (entry->path == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	entry->type = type;
+	entry->next = tracee->glue_entries;
+	tracee->glue_entries = entry;
+}
+
+/**
+ * Return the type of @host_path if it was glued by build_glue()
+ * during the initialization of the bindings of @tracee, otherwise 0.
+ */
+mode_t get_glue_type(const Tracee *tracee, const char host_path[PATH_MAX])
+{
+	const struct glue_entry *entry;
+
+	for (entry = tracee->glue_entries; entry != NULL; entry = entry->next) {
+		if (strcmp(entry->path, host_path) == 0)
+			return entry->type;
+	}
+
+	return 0;
+}
+
+/**
+ * Forget the glue entries of @tracee.
+ */
+void free_glue_entries(Tracee *tracee)
+{
+	struct glue_entry *entry;
+
+	while (tracee->glue_entries != NULL) {
+		entry = tracee->glue_entries;
+		tracee->glue_entries = entry->next;
+		talloc_free(entry);
+	}
+}
+
 /**
  * Remove @path if it is empty only.
  *
@@ -157,6 +218,11 @@ mode_t build_glue(Tracee *tracee, const char *guest_path, char host_path[PATH_MA
 	if (status >= 0 && !belongs_to_gluefs)
 		set_placeholder_destructor(host_path);
 
+	/* Subsequent bindings that go through this component get
+	 * its type from memory, they don't stat it again.  */
+	if (status >= 0)
+		add_glue_entry(tracee, host_path, type);
+
 	/* Nothing else to do if the path already exists or if it is
 	 * the final component since it will be pointed to by the
 	 * binding being initialized (from the example,
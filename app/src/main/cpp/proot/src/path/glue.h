@@ -30,5 +30,7 @@
 
 extern mode_t build_glue(Tracee *tracee, const char *guest_path, char host_path[PATH_MAX],
 			Finality finality);
+extern mode_t get_glue_type(const Tracee *tracee, const char host_path[PATH_MAX]);
+extern void free_glue_entries(Tracee *tracee);
 
 #endif /* GLUE_H */
@@ -238,6 +238,11 @@ void chop_finality(char *path)
 /**
  * Put in @path the result of readlink(/proc/@pid/fd/@fd).  This
  * function returns -errno if an error occured, otherwise 0.
+ *
+ * Note: the result is not cached.  Under seccomp, close(2), dup2(2),
+ * close_range(2) and close-on-exec happen without any stop, so a
+ * cached descriptor could silently refer to another directory, and
+ * tracing them would cost a stop each, far more than this readlink.
  */
 int readlink_proc_pid_fd(pid_t pid, int fd, char path[PATH_MAX])
 {
@@ -315,6 +320,10 @@ int translate_path(Tracee *tracee, char result[PATH_MAX], int dir_fd,
 	join_paths(guest_path, result, user_path);
 	strcpy(result, "/");
 
+	/* Wine and box64 look "/proc/self/exe" up very often.  */
+	if (deref_final && get_proc_link_cache(tracee, result, guest_path))
+		return 0;
+
 	/* Canonicalize regarding the new root. */
 	status = canonicalize(tracee, guest_path, deref_final, result, 0);
 	if (status < 0)
@@ -327,6 +336,9 @@ int translate_path(Tracee *tracee, char result[PATH_MAX], int dir_fd,
 	if (status < 0)
 		return status;
 
+	if (deref_final)
+		set_proc_link_cache(tracee, guest_path, result);
+
 	return 0;
 }
 
@@ -25,11 +25,16 @@
 #include <stdlib.h>  /* atoi(3), strtol(3), */
 #include <errno.h>   /* E*, */
 #include <assert.h>  /* assert(3), */
+#include <fcntl.h>   /* open(2), */
+#include <unistd.h>  /* read(2), write(2), close(2), */
+#include <stdint.h>  /* uint64_t, */
+#include <talloc.h>  /* talloc_*, */
 
 #include "path/proc.h"
 #include "tracee/tracee.h"
 #include "path/path.h"
 #include "path/binding.h"
+#include "path/temp.h"
 
 extern char *root_path;
 
@@ -85,7 +90,8 @@ Action readlink_proc(const Tracee *tracee, char result[PATH_MAX],
 	comparison = compare_paths(proc_path, base);
 	switch (comparison) {
 	case PATHS_ARE_EQUAL:
-		known_tracee = get_tracee(tracee, pid, false);
+		/* Most of the time it's about "/proc/self".  */
+		known_tracee = (pid == tracee->pid ? tracee : get_tracee(tracee, pid, false));
 		if (known_tracee == NULL)
 			return DEFAULT;
 
@@ -189,3 +195,352 @@ ssize_t readlink_proc2(const Tracee *tracee, char result[PATH_MAX], const char r
 	action = readlink_proc(tracee, result, base, component, PATH1_IS_PREFIX);
 	return (action == CANONICALIZE ? strlen(result) : 0);
 }
+
+/* Links of "/proc/self" whose translation is cached.  */
+typedef enum {
+	PROC_LINK_EXE,
+	PROC_LINK_CWD,
+	PROC_LINK_ROOT,
+	PROC_LINK_NONE,
+} ProcLink;
+
+struct proc_cache {
+	/* Translations of "/proc/self/{exe,cwd,root}", each valid as
+	 * long as the string it was computed from is unchanged.  */
+	struct {
+		const void *bindings;
+		char *source;
+		char *host_path;
+	} links[PROC_LINK_NONE];
+
+	/* Detranslated copy of "/proc/@maps_pid/maps", and the hash of
+	 * the content it was rewritten from.  */
+	const char *maps;
+	uint64_t maps_hash;
+	pid_t maps_pid;
+};
+
+/**
+ * Return the cache of @tracee, allocated on first use, or NULL if
+ * there's not enough memory.
+ */
+static struct proc_cache *get_proc_cache(Tracee *tracee)
+{
+	if (tracee->proc_cache == NULL) {
+		tracee->proc_cache = talloc_zero(tracee, struct proc_cache);
+		if (tracee->proc_cache != NULL)
+			talloc_set_name_const(tracee->proc_cache, "$proc_cache");
+	}
+
+	return tracee->proc_cache;
+}
+
+/**
+ * Return the link of "/proc/self" named by @guest_path, with respect
+ * to @tracee, and its current target in @source; or PROC_LINK_NONE.
+ */
+static ProcLink get_proc_link(const Tracee *tracee, const char guest_path[PATH_MAX],
+			const char **source)
+{
+	const char *cursor;
+	char *end_ptr;
+	long pid;
+
+	if (strncmp(guest_path, "/proc/", strlen("/proc/")) != 0)
+		return PROC_LINK_NONE;
+	cursor = guest_path + strlen("/proc/");
+
+	if (strncmp(cursor, "self/", strlen("self/")) == 0)
+		cursor += strlen("self");
+	else {
+		pid = strtol(cursor, &end_ptr, 10);
+		if (end_ptr == cursor || pid != tracee->pid || *end_ptr != '/')
+			return PROC_LINK_NONE;
+		cursor = end_ptr;
+	}
+
+	if (strcmp(cursor, "/exe") == 0 && tracee->exe != NULL) {
+		*source = tracee->exe;
+		return PROC_LINK_EXE;
+	}
+	if (strcmp(cursor, "/cwd") == 0 && tracee->fs->cwd != NULL) {
+		*source = tracee->fs->cwd;
+		return PROC_LINK_CWD;
+	}
+	if (strcmp(cursor, "/root") == 0) {
+		*source = root_path;
+		return PROC_LINK_ROOT;
+	}
+
+	return PROC_LINK_NONE;
+}
+
+/**
+ * Copy in @host_path the cached translation of the dereferenced
+ * @guest_path with respect to @tracee.  This function returns 1 on a
+ * hit, 0 otherwise.
+ */
+int get_proc_link_cache(const Tracee *tracee, char host_path[PATH_MAX],
+			const char guest_path[PATH_MAX])
+{
+	const struct proc_cache *cache = tracee->proc_cache;
+	const char *source;
+	ProcLink link;
+
+	if (cache == NULL)
+		return 0;
+
+	link = get_proc_link(tracee, guest_path, &source);
+	if (link == PROC_LINK_NONE)
+		return 0;
+
+	/* Invalidated by execve(2), chdir(2), and by a
+	 * sub-reconfiguration.  */
+	if (   cache->links[link].host_path == NULL
+	    || cache->links[link].bindings != tracee->fs->bindings.guest
+	    || strcmp(cache->links[link].source, source) != 0)
+		return 0;
+
+	strcpy(host_path, cache->links[link].host_path);
+	return 1;
+}
+
+/**
+ * Remember @host_path is the translation of the dereferenced
+ * @guest_path with respect to @tracee, if @guest_path is a link of
+ * "/proc/self" worth caching.
+ */
+void set_proc_link_cache(Tracee *tracee, const char guest_path[PATH_MAX],
+			const char host_path[PATH_MAX])
+{
+	struct proc_cache *cache;
+	const char *source;
+	ProcLink link;
+
+	link = get_proc_link(tracee, guest_path, &source);
+	if (link == PROC_LINK_NONE)
+		return;
+
+	cache = get_proc_cache(tracee);
+	if (cache == NULL)
+		return;
+
+	TALLOC_FREE(cache->links[link].source);
+	TALLOC_FREE(cache->links[link].host_path);
+
+	cache->links[link].source = talloc_strdup(cache, source);
+	cache->links[link].host_path = talloc_strdup(cache, host_path);
+	if (cache->links[link].source == NULL || cache->links[link].host_path == NULL) {
+		TALLOC_FREE(cache->links[link].source);
+		TALLOC_FREE(cache->links[link].host_path);
+		return;
+	}
+
+	cache->links[link].bindings = tracee->fs->bindings.guest;
+}
+
+/**
+ * Read the whole content of the file at @path in a buffer attached to
+ * @context.  This function returns NULL on error, otherwise the
+ * buffer and its size in @size.
+ */
+static char *read_proc_file(TALLOC_CTX *context, const char *path, size_t *size)
+{
+	size_t capacity = 16 * 1024;
+	char *buffer;
+	ssize_t status;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	*size = 0;
+	buffer = talloc_size(context, capacity);
+	while (buffer != NULL) {
+		if (*size == capacity) {
+			capacity *= 2;
+			buffer = talloc_realloc_size(context, buffer, capacity);
+			if (buffer == NULL)
+				break;
+		}
+
+		status = read(fd, buffer + *size, capacity - *size);
+		if (status < 0 && errno == EINTR)
+			continue;
+		if (status < 0)
+			TALLOC_FREE(buffer);
+		if (status <= 0)
+			break;
+
+		*size += status;
+	}
+
+	close(fd);
+	return buffer;
+}
+
+/**
+ * Write the lines of the "maps" file @content, @size bytes long, to
+ * @fd with their pathnames detranslated with respect to @tracee.
+ * This function returns -errno on error, otherwise 0.
+ */
+static int write_detranslated_maps(Tracee *tracee, int fd, const char *content, size_t size)
+{
+	const size_t capacity = size + PATH_MAX + 1;
+	const char *end = content + size;
+	char raw_path[PATH_MAX] = "";
+	char path[PATH_MAX] = "";
+	const char *line;
+	const char *eol;
+	char *output;
+	size_t length;
+	int status;
+
+	output = talloc_size(tracee->ctx, capacity);
+	if (output == NULL)
+		return -ENOMEM;
+	length = 0;
+
+	for (line = content; line < end; line = eol + 1) {
+		const char *pathname = line;
+		size_t path_length;
+		int field;
+
+		eol = memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+
+		/* Flush what might not fit in the buffer.  */
+		if (length + (eol - line) + PATH_MAX + 1 > capacity) {
+			if (write(fd, output, length) != (ssize_t) length)
+				return -errno;
+			length = 0;
+		}
+
+		/* The pathname follows the five fields "address perms
+		 * offset dev inode", see proc(5).  */
+		for (field = 0; field < 5 && pathname < eol; field++) {
+			while (pathname < eol && *pathname != ' ')
+				pathname++;
+			while (pathname < eol && *pathname == ' ')
+				pathname++;
+		}
+
+		path_length = eol - pathname;
+		if (field < 5 || pathname == eol || *pathname != '/' || path_length >= PATH_MAX) {
+			memcpy(output + length, line, eol - line);
+			length += eol - line;
+		}
+		else {
+			/* Consecutive lines map the same file most of
+			 * the time, @path is still its detranslation.  */
+			if (   strlen(raw_path) != path_length
+			    || memcmp(raw_path, pathname, path_length) != 0) {
+				memcpy(raw_path, pathname, path_length);
+				raw_path[path_length] = '\0';
+
+				strcpy(path, raw_path);
+				status = detranslate_path(tracee, path, NULL);
+				if (status <= 0)
+					strcpy(path, raw_path);
+			}
+
+			memcpy(output + length, line, pathname - line);
+			length += pathname - line;
+			memcpy(output + length, path, strlen(path));
+			length += strlen(path);
+		}
+
+		if (eol < end)
+			output[length++] = '\n';
+	}
+
+	if (write(fd, output, length) != (ssize_t) length)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * Substitute @host_path with a copy of it where pathnames are
+ * detranslated, if @host_path is "/proc/<PID>/maps" and <PID> a
+ * process monitored by PRoot.  The copy is rewritten only when the
+ * mappings changed since the previous call for the same <PID>.  This
+ * function returns -errno on error, 1 if @host_path was substituted,
+ * 0 otherwise.
+ */
+int substitute_proc_maps(Tracee *tracee, char host_path[PATH_MAX])
+{
+	struct proc_cache *cache;
+	const char *content;
+	const char *maps;
+	const char *cursor;
+	char *end_ptr;
+	uint64_t hash;
+	size_t size;
+	size_t i;
+	long pid;
+	int status;
+	int fd;
+
+	if (strncmp(host_path, "/proc/", strlen("/proc/")) != 0)
+		return 0;
+	cursor = host_path + strlen("/proc/");
+
+	pid = strtol(cursor, &end_ptr, 10);
+	if (end_ptr == cursor || strcmp(end_ptr, "/maps") != 0)
+		return 0;
+
+	if (pid != tracee->pid && get_tracee(tracee, pid, false) == NULL)
+		return 0;
+
+	cache = get_proc_cache(tracee);
+	if (cache == NULL)
+		return -ENOMEM;
+
+	content = read_proc_file(tracee->ctx, host_path, &size);
+	if (content == NULL)
+		return 0; /* Let the kernel report the error.  */
+
+	/* FNV-1a over the raw mappings.  */
+	hash = 14695981039346656037ULL;
+	for (i = 0; i < size; i++) {
+		hash ^= (uint8_t) content[i];
+		hash *= 1099511628211ULL;
+	}
+
+	if (cache->maps != NULL && cache->maps_pid == pid && cache->maps_hash == hash) {
+		strcpy(host_path, cache->maps);
+		return 1;
+	}
+
+	/* A new file each time: the previous copy may still be read
+	 * through a descriptor opened earlier.  */
+	maps = create_temp_file(cache, "proot-maps");
+	if (maps == NULL)
+		return -ENOMEM;
+
+	fd = open(maps, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	if (fd < 0) {
+		talloc_free((void *) maps);
+		return -errno;
+	}
+
+	status = write_detranslated_maps(tracee, fd, content, size);
+	close(fd);
+	if (status < 0) {
+		talloc_free((void *) maps);
+		return status;
+	}
+
+	if (cache->maps != NULL)
+		talloc_free((void *) cache->maps);
+
+	cache->maps = maps;
+	cache->maps_hash = hash;
+	cache->maps_pid = pid;
+
+	strcpy(host_path, maps);
+	return 1;
+}
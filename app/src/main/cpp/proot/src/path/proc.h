@@ -41,4 +41,10 @@ extern Action readlink_proc(const Tracee *tracee, char result[PATH_MAX], const c
 
 extern ssize_t readlink_proc2(const Tracee *tracee, char result[PATH_MAX], const char path[PATH_MAX]);
 
+extern int get_proc_link_cache(const Tracee *tracee, char host_path[PATH_MAX],
+			const char guest_path[PATH_MAX]);
+extern void set_proc_link_cache(Tracee *tracee, const char guest_path[PATH_MAX],
+			const char host_path[PATH_MAX]);
+extern int substitute_proc_maps(Tracee *tracee, char host_path[PATH_MAX]);
+
 #endif /* PROC_H */
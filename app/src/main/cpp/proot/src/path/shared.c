@@ -0,0 +1,129 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+
+#include <sys/types.h>   /* off_t, */
+#include <sys/stat.h>    /* struct stat, fchmod(2), */
+#include <sys/sendfile.h> /* sendfile(2), */
+#include <sys/xattr.h>   /* lgetxattr(2), */
+#include <fcntl.h>       /* open(2), */
+#include <unistd.h>      /* close(2), unlink(2), */
+#include <stdlib.h>      /* mkstemp(3), */
+#include <stdio.h>       /* rename(2), */
+#include <string.h>      /* strlen(3), */
+#include <limits.h>      /* PATH_MAX, */
+#include <errno.h>       /* E*, */
+#include <stdbool.h>     /* bool, */
+
+#include "path/shared.h"
+
+/* Set by ContentStore.kt on the inode of every stored file.  */
+#define STORE_XATTR "user.winlator.store"
+
+/**
+ * Files of the container content store (ContentStore.kt) are hard
+ * linked into several containers and carry STORE_XATTR.  They keep
+ * their original mode, Wine would report cleared write bits to Windows
+ * as FILE_ATTRIBUTE_READONLY, so the xattr is the only marker; it is
+ * only looked up for files with several links.
+ *
+ * Every syscall that changes the inode goes through unshare_file()
+ * first (see translate_path2_modify() and unshare_fd() in enter.c),
+ * the ones on a descriptor included.  ftruncate(2) and write(2) need
+ * a descriptor opened for writing, which was unshared by open(2).
+ */
+static bool is_shared(const char *host_path, const struct stat *statl)
+{
+	return S_ISREG(statl->st_mode)
+		&& statl->st_nlink > 1
+		&& lgetxattr(host_path, STORE_XATTR, NULL, 0) >= 0;
+}
+
+/**
+ * Replace the store link at @host_path with a private, writable copy
+ * of the file, so a tracee writing to it leaves the other containers
+ * untouched (copy-on-write).  The copy keeps the times of the file and
+ * is renamed over it, @host_path always exists.  This function returns
+ * 0 if @host_path is not shared, 1 if it was unshared, -errno
+ * otherwise.
+ */
+int unshare_file(const char *host_path)
+{
+	char temp_path[PATH_MAX];
+	struct timespec times[2];
+	struct stat statl;
+	off_t offset = 0;
+	int status = 0;
+	int src_fd;
+	int dst_fd;
+
+	if (lstat(host_path, &statl) < 0 || !is_shared(host_path, &statl))
+		return 0;
+
+	if (strlen(host_path) + sizeof(".cow-XXXXXX") > PATH_MAX)
+		return -ENAMETOOLONG;
+	strcpy(temp_path, host_path);
+	strcat(temp_path, ".cow-XXXXXX");
+
+	src_fd = open(host_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (src_fd < 0)
+		return -errno;
+
+	dst_fd = mkstemp(temp_path);
+	if (dst_fd < 0) {
+		status = -errno;
+		close(src_fd);
+		return status;
+	}
+
+	while (offset < statl.st_size) {
+		ssize_t count = sendfile(dst_fd, src_fd, &offset, statl.st_size - offset);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0) {
+			status = count < 0 ? -errno : -EIO;
+			break;
+		}
+	}
+
+	if (status == 0 && fchmod(dst_fd, statl.st_mode & 07777) < 0)
+		status = -errno;
+
+	times[0] = statl.st_atim;
+	times[1] = statl.st_mtim;
+	if (status == 0)
+		(void) futimens(dst_fd, times);
+
+	close(src_fd);
+	if (close(dst_fd) < 0 && status == 0)
+		status = -errno;
+
+	if (status == 0 && rename(temp_path, host_path) < 0)
+		status = -errno;
+
+	if (status < 0) {
+		(void) unlink(temp_path);
+		return status;
+	}
+
+	return 1;
+}
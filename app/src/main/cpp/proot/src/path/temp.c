@@ -6,6 +6,11 @@
 #include <string.h>     /* strcmp(3), */
 #include <stdlib.h>     /* free(3), getenv(3), */
 #include <stdio.h>      /* P_tmpdir, */
+#include <fcntl.h>      /* open(2), */
+#include <signal.h>     /* kill(2), */
+#include <sys/file.h>   /* flock(2), */
+#include <sys/resource.h> /* setpriority(2), */
+#include <sys/wait.h>   /* waitpid(2), */
 #include <talloc.h>     /* talloc(3), */
 
 #include "cli/note.h"
@@ -246,14 +251,146 @@ end:
 	return result;
 }
 
+/* Temporary directories are renamed with this prefix before they are
+ * removed in the background, see remove_temp_directory().  */
+#define TRASH_PREFIX "proot-trash-"
+
+/**
+ * Remove @trash -- a directory lying in temp_directory -- from a
+ * detached, low priority process, so that the caller doesn't wait for
+ * it, nor is it killed with the session of the caller.  The remover
+ * holds a lock on @trash, a tree another remover already works on is
+ * left alone.  This function returns -1 if no process could be
+ * started, otherwise 0.
+ */
+static int remove_in_background(const char *trash)
+{
+	pid_t pid;
+	int fd;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (pid > 0) {
+		/* The intermediate child exits right away.  */
+		(void) waitpid(pid, NULL, 0);
+		return 0;
+	}
+
+	(void) setsid();
+	if (fork() != 0)
+		_exit(0);
+
+	/* Nobody reads the notes of the remover.  */
+	fd = open("/dev/null", O_RDWR);
+	if (fd >= 0) {
+		(void) dup2(fd, STDIN_FILENO);
+		(void) dup2(fd, STDOUT_FILENO);
+		(void) dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			(void) close(fd);
+	}
+
+	fd = open(trash, O_RDONLY | O_DIRECTORY);
+	if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) < 0)
+		_exit(0);
+
+	(void) setpriority(PRIO_PROCESS, 0, 19);
+	(void) remove_temp_directory2(trash);
+	_exit(0);
+}
+
+/**
+ * Move @path -- a directory lying in temp_directory -- out of the way
+ * and remove it in the background.  It is removed synchronously if it
+ * can't be moved or no remover can be started.  This function returns
+ * -1 on error, otherwise 0.
+ */
+static int dispose_temp_directory(const char *path)
+{
+	const char *temp_directory = get_temp_directory();
+	const char *name;
+	char *trash;
+	int status;
+
+	name = strrchr(path, '/');
+	name = (name != NULL ? name + 1 : path);
+
+	/* Already in the trash, see sweep_temp_directory().  */
+	if (strncmp(name, TRASH_PREFIX, strlen(TRASH_PREFIX)) == 0)
+		return remove_in_background(path) == 0 ? 0 : remove_temp_directory2(path);
+
+	trash = talloc_asprintf(NULL, "%s/" TRASH_PREFIX "%s", temp_directory, name);
+	if (trash == NULL || rename(path, trash) < 0) {
+		TALLOC_FREE(trash);
+		return remove_temp_directory2(path);
+	}
+
+	status = remove_in_background(trash);
+	if (status < 0)
+		status = remove_temp_directory2(trash);
+
+	TALLOC_FREE(trash);
+	return status;
+}
+
 /**
- * Like remove_temp_directory2() but always return 0.
+ * Remove the temporary trees left in temp_directory by previous
+ * sessions: the trash nobody is removing anymore, and the @prefix-ed
+ * directories the PRoot process of which is gone.
+ */
+static void sweep_temp_directory(const char *prefix)
+{
+	const char *temp_directory = get_temp_directory();
+	const size_t length_prefix = strlen(prefix);
+	DIR *dir;
+
+	dir = opendir(temp_directory);
+	if (dir == NULL)
+		return;
+
+	while (1) {
+		struct dirent *entry;
+		char *path;
+		int pid;
+
+		entry = readdir(dir);
+		if (entry == NULL)
+			break;
+
+		if (strncmp(entry->d_name, TRASH_PREFIX, strlen(TRASH_PREFIX)) != 0) {
+			/* Format: "@prefix-$PID-XXXXXX", see create_temp_name(). */
+			if (   strncmp(entry->d_name, prefix, length_prefix) != 0
+			    || sscanf(entry->d_name + length_prefix, "-%d-", &pid) != 1
+			    || pid == getpid()
+			    || kill(pid, 0) == 0
+			    || errno != ESRCH)
+				continue;
+		}
+
+		if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+			continue;
+
+		path = talloc_asprintf(NULL, "%s/%s", temp_directory, entry->d_name);
+		if (path == NULL)
+			break;
+
+		(void) dispose_temp_directory(path);
+		TALLOC_FREE(path);
+	}
+
+	(void) closedir(dir);
+}
+
+/**
+ * Like dispose_temp_directory() but always return 0.
  *
  * Note: this is a talloc destructor.
  */
 static int remove_temp_directory(char *path)
 {
-	(void) remove_temp_directory2(path);
+	(void) dispose_temp_directory(path);
 	return 0;
 }
 
@@ -305,8 +442,14 @@ char *create_temp_name(TALLOC_CTX *context, const char *prefix)
  */
 const char *create_temp_directory(TALLOC_CTX *context, const char *prefix)
 {
+	static bool swept = false;
 	char *name;
 
+	if (!swept) {
+		sweep_temp_directory(prefix);
+		swept = true;
+	}
+
 	name = create_temp_name(context, prefix);
 	if (name == NULL)
 		return NULL;
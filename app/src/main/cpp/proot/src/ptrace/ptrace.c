@@ -109,6 +109,22 @@ void detach_from_ptracer(Tracee *ptracee)
 	PTRACER.nb_ptracees--;
 }
 
+/**
+ * Store the word @value at @address in the @ptracer's memory, with a
+ * single process_vm_writev(2) when possible: unlike poke_word(), the
+ * 32 MSB don't have to be read back for a 32-bit ptracer.  This
+ * function returns -errno if an error occured, otherwise 0.
+ */
+static int relay_word(Tracee *ptracer, word_t address, word_t value)
+{
+	uint32_t value32 = value;
+
+	if (is_32on64_mode(ptracer))
+		return write_data(ptracer, address, &value32, sizeof(value32));
+
+	return write_data(ptracer, address, &value, sizeof(value));
+}
+
 /**
  * Emulate the ptrace syscall made by @tracee.  This function returns
  * -errno if an error occured (unsupported request), otherwise 0.
@@ -259,11 +275,7 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (status < 0)
 			return -errno;
 
-		poke_word(ptracer, data, result);
-		if (errno != 0)
-			return -errno;
-
-		return 0;  /* Don't restart the ptracee.  */
+		return relay_word(ptracer, data, result);  /* Don't restart the ptracee.  */
 	}
 
 	case PTRACE_PEEKUSER:
@@ -277,11 +289,7 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (errno != 0)
 			return -errno;
 
-		poke_word(ptracer, data, result);
-		if (errno != 0)
-			return -errno;
-
-		return 0;  /* Don't restart the ptracee.  */
+		return relay_word(ptracer, data, result);  /* Don't restart the ptracee.  */
 
 	case PTRACE_POKEUSER:
 		if (is_32on64_mode(ptracer)) {
@@ -293,13 +301,22 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (status < 0)
 			return -errno;
 
+		invalidate_fetched_regs(ptracee);
+
 		return 0;  /* Don't restart the ptracee.  */
 
 	case PTRACE_POKETEXT:
 	case PTRACE_POKEDATA:
 		if (is_32on64_mode(ptracer)) {
+			uint32_t data32 = data;
 			word_t tmp;
 
+			/* Writable data is patched with a single
+			 * process_vm_writev(2), text is handled below.  */
+			if (request == PTRACE_POKEDATA
+			    && write_data(ptracee, address, &data32, sizeof(data32)) == 0)
+				return 0;  /* Don't restart the ptracee.  */
+
 			errno = 0;
 			tmp = (word_t) ptrace(PTRACE_PEEKDATA, ptracee->pid, address, NULL);
 			if (errno != 0)
@@ -395,6 +412,8 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (status < 0)
 			return -errno;
 
+		invalidate_fetched_regs(ptracee);
+
 		return 0;  /* Don't restart the ptracee.  */
 	}
 
@@ -533,6 +552,8 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (status < 0)
 			return status;
 
+		invalidate_fetched_regs(ptracee);
+
 		return 0;  /* Don't restart the ptracee.  */
 	}
 
@@ -551,6 +572,8 @@ int translate_ptrace_exit(Tracee *tracee)
 		if (status < 0)
 			return -errno;
 
+		invalidate_fetched_regs(ptracee);
+
 		return 0;  /* Don't restart the ptracee.  */
 
 	default:
@@ -25,6 +25,9 @@
 #include <assert.h>     /* assert(3), */
 #include <stdbool.h>    /* bool, true, false, */
 #include <signal.h>     /* SIG*, */
+#include <stdio.h>      /* snprintf(3), fopen(3), */
+#include <string.h>     /* strncmp(3), */
+#include <stdlib.h>     /* strtoull(3), */
 #include <talloc.h>     /* talloc*, */
 
 #include "ptrace/wait.h"
@@ -226,6 +229,38 @@ int translate_wait_exit(Tracee *ptracer)
 	return status;
 }
 
+/**
+ * Check whether a SIGKILL is pending for the process @pid, that is,
+ * whether it is about to die whatever its ptracer does.
+ */
+static bool is_being_killed(pid_t pid)
+{
+	const unsigned long long mask = 1ULL << (SIGKILL - 1);
+	char path[64]; /* 64 > sizeof("/proc//status") + sizeof(#ULONG_MAX) */
+	char line[128];
+	bool killed = false;
+	FILE *file;
+	int status;
+
+	status = snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	if (status < 0 || (size_t) status >= sizeof(path))
+		return false;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+
+	/* Both the thread and the process pending sets matter.  */
+	while (!killed && fgets(line, sizeof(line), file) != NULL) {
+		if (   strncmp(line, "SigPnd:", strlen("SigPnd:")) == 0
+		    || strncmp(line, "ShdPnd:", strlen("ShdPnd:")) == 0)
+			killed = (strtoull(line + strlen("SigPnd:"), NULL, 16) & mask) != 0;
+	}
+
+	fclose(file);
+	return killed;
+}
+
 /**
  * For the given @ptracee, pass its current @event to its ptracer if
  * this latter is waiting for it, otherwise put the @ptracee in the
@@ -276,9 +311,24 @@ bool handle_ptracee_event(Tracee *ptracee, int event)
 		CASE_FILTER_EVENT(VFORK);
 		CASE_FILTER_EVENT(VFORKDONE);
 		CASE_FILTER_EVENT(CLONE);
-		CASE_FILTER_EVENT(EXIT);
 		CASE_FILTER_EVENT(EXEC);
 
+		case SIGTRAP | PTRACE_EVENT_EXIT << 8:
+			if ((PTRACEE.options & PTRACE_O_TRACEEXIT) == 0)
+				return false;
+
+			/* A killed ptracee can't be held back by its
+			 * ptracer, so only its death is reported.
+			 * Otherwise tearing down a tree stalls on each
+			 * ptracer, typically a debugger that is dying
+			 * too.  */
+			if (is_being_killed(ptracee->pid))
+				return false;
+
+			PTRACEE.tracing_started = true;
+			handled_by_proot_first = true;
+			break;
+
 			/* Never reached.  */
 			assert(0);
 
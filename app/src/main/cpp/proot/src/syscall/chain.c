@@ -83,6 +83,14 @@ static int register_chained_syscall_internal(Tracee *tracee, Sysnum sysnum,
  * caller is free to force the last result of this syscall chain in
  * @tracee->chain.final_result.  This function returns -errno if an
  * error occurred, otherwise 0.
+ *
+ * Each chained syscall costs a full sysenter/sysexit round trip, so
+ * work that PRoot can do itself shouldn't be chained: execve(2) is
+ * completed by the loader script and sockaddr_un are rewritten in
+ * place at the sysenter stage (see translate_socketcall_enter()).
+ * The only remaining users are the ptrace emulation, which has to let
+ * the kernel reap a zombie, and the fallback for kernels that can't
+ * change the syscall number (see restart_current_syscall_as_chained).
  */
 int register_chained_syscall(Tracee *tracee, Sysnum sysnum,
 			word_t sysarg_1, word_t sysarg_2, word_t sysarg_3,
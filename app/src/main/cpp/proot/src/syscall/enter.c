@@ -43,6 +43,9 @@
 #include "tracee/abi.h"
 #include "path/path.h"
 #include "path/canon.h"
+#include "path/shared.h"
+#include "path/proc.h"
+#include "cli/note.h"
 #include "arch.h"
 
 /**
@@ -85,6 +88,112 @@ static int translate_sysarg(Tracee *tracee, Reg reg, Type type)
 	return translate_path2(tracee, AT_FDCWD, old_path, reg, type);
 }
 
+/**
+ * Like translate_path2(), for syscalls that open the file read-only:
+ * "/proc/<PID>/maps" is substituted with a copy where pathnames are
+ * detranslated, see substitute_proc_maps().
+ */
+static int translate_path2_open(Tracee *tracee, int dir_fd, char path[PATH_MAX], Reg reg, Type type)
+{
+	char new_path[PATH_MAX];
+	int status;
+
+	if (path[0] == '\0')
+		return 0;
+
+	status = translate_path(tracee, new_path, dir_fd, path, type != SYMLINK);
+	if (status < 0)
+		return status;
+
+	/* The raw mappings are still better than nothing.  */
+	if (substitute_proc_maps(tracee, new_path) < 0)
+		VERBOSE(tracee, 1, "can't detranslate %s", new_path);
+
+	return set_sysarg_path(tracee, new_path, reg);
+}
+
+/**
+ * Like translate_path2(), for syscalls that may modify the file: a
+ * file of the container content store is unshared first, see
+ * unshare_file().
+ */
+static int translate_path2_modify(Tracee *tracee, int dir_fd, char path[PATH_MAX], Reg reg, Type type)
+{
+	char new_path[PATH_MAX];
+	int status;
+
+	if (path[0] == '\0')
+		return 0;
+
+	status = translate_path(tracee, new_path, dir_fd, path, type != SYMLINK);
+	if (status < 0)
+		return status;
+
+	/* Stored files keep their write bits, so the syscall has to
+	 * be refused here or it would modify every container.  */
+	status = unshare_file(new_path);
+	if (status < 0) {
+		VERBOSE(tracee, 1, "can't unshare %s", new_path);
+		return status;
+	}
+
+	return set_sysarg_path(tracee, new_path, reg);
+}
+
+/**
+ * A helper, see the comment of the function above.
+ */
+static int translate_sysarg_modify(Tracee *tracee, Reg reg, Type type)
+{
+	char old_path[PATH_MAX];
+	int status;
+
+	status = get_sysarg_path(tracee, old_path, reg);
+	if (status < 0)
+		return status;
+
+	return translate_path2_modify(tracee, AT_FDCWD, old_path, reg, type);
+}
+
+/**
+ * For syscalls that change the inode referred by @fd: a file of the
+ * container content store is unshared first, see unshare_file().  The
+ * descriptor still refers to the shared inode then, so the caller has
+ * to redirect the syscall to the private copy at @host_path.  This
+ * function returns -errno if an error occured, 1 if the syscall has to
+ * be redirected, otherwise 0.
+ */
+static int unshare_fd(Tracee *tracee, int fd, char host_path[PATH_MAX])
+{
+	int status;
+
+	/* Let the kernel report a wrong descriptor.  */
+	status = readlink_proc_pid_fd(tracee->pid, fd, host_path);
+	if (status < 0 || host_path[0] != '/')
+		return 0;
+
+	status = unshare_file(host_path);
+	if (status < 0) {
+		VERBOSE(tracee, 1, "can't unshare %s", host_path);
+		return status;
+	}
+	if (status == 0)
+		return 0;
+
+	/* The redirected syscall moves its arguments around, they
+	 * are restored at the sysexit stage.  */
+	tracee->restart_how = PTRACE_SYSCALL;
+	return 1;
+}
+
+/**
+ * Whether open(2) @flags may change the content of the file.
+ */
+static bool open_modifies(int flags)
+{
+	return (flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC) != 0;
+}
+
 /**
  * Translate the input arguments of the current @tracee's syscall in the
  * @tracee->pid process area. This function sets @tracee->status to
@@ -97,6 +206,7 @@ int translate_syscall_enter(Tracee *tracee)
 	int dirfd;
 	int olddirfd;
 	int newdirfd;
+	Type type;
 
 	int status = 0;
 
@@ -128,10 +238,40 @@ int translate_syscall_enter(Tracee *tracee)
 		status = 0;
 		break;
 
-	case PR_getcwd:
+	case PR_getcwd: {
+		size_t new_size;
+		size_t size;
+
+		/* Fully emulated from the cached cwd, so the result is
+		 * set right now and no sysexit stop is needed.  */
 		set_sysnum(tracee, PR_void);
+
+		size = (size_t) peek_reg(tracee, CURRENT, SYSARG_2);
+		if (size == 0) {
+			status = -EINVAL;
+			break;
+		}
+
+		/* Ensure cwd still exists.  */
+		status = translate_path(tracee, path, AT_FDCWD, ".", false);
+		if (status < 0)
+			break;
+
+		new_size = strlen(tracee->fs->cwd) + 1;
+		if (size < new_size) {
+			status = -ERANGE;
+			break;
+		}
+
+		/* Overwrite the path.  */
+		status = write_data(tracee, peek_reg(tracee, CURRENT, SYSARG_1), tracee->fs->cwd, new_size);
+		if (status < 0)
+			break;
+
+		poke_reg(tracee, SYSARG_RESULT, new_size);
 		status = 0;
 		break;
+	}
 
 	case PR_fchdir:
 	case PR_chdir: {
@@ -191,12 +331,15 @@ int translate_syscall_enter(Tracee *tracee)
 			status = -ENOMEM;
 			break;
 		}
-		TALLOC_FREE(tracee->fs->cwd);
+		/* The previous string may still be shared with
+		 * processes forked from this one.  */
+		(void) talloc_unlink(tracee->fs, tracee->fs->cwd);
 
 		tracee->fs->cwd = tmp;
 		talloc_set_name_const(tracee->fs->cwd, "$cwd");
 
 		set_sysnum(tracee, PR_void);
+		poke_reg(tracee, SYSARG_RESULT, 0);
 		status = 0;
 		break;
 	}
@@ -268,40 +411,120 @@ int translate_syscall_enter(Tracee *tracee)
 #undef PEEK_WORD
 #undef POKE_WORD
 
-	case PR_access:
 	case PR_chmod:
 	case PR_chown:
 	case PR_chown32:
+	case PR_removexattr:
+	case PR_setxattr:
+	case PR_truncate:
+	case PR_truncate64:
+	case PR_utime:
+	case PR_utimes:
+		status = translate_sysarg_modify(tracee, SYSARG_1, REGULAR);
+		break;
+
+	case PR_access:
 	case PR_getxattr:
 	case PR_listxattr:
 	case PR_mknod:
-	case PR_removexattr:
-	case PR_setxattr:
 	case PR_stat:
 	case PR_stat64:
 	case PR_statfs:
 	case PR_statfs64:
-	case PR_truncate:
-	case PR_truncate64:
-	case PR_utime:
-	case PR_utimes:
 		status = translate_sysarg(tracee, SYSARG_1, REGULAR);
 		break;
 
+	case PR_fchmod:
+		status = unshare_fd(tracee, peek_reg(tracee, CURRENT, SYSARG_1), path);
+		if (status <= 0)
+			break;
+
+		/* fchmod(fd, mode) -> fchmodat(AT_FDCWD, path, mode)  */
+		set_sysnum(tracee, PR_fchmodat);
+		poke_reg(tracee, SYSARG_3, peek_reg(tracee, CURRENT, SYSARG_2));
+		poke_reg(tracee, SYSARG_1, AT_FDCWD);
+		status = set_sysarg_path(tracee, path, SYSARG_2);
+		break;
+
+	case PR_fchown:
+	case PR_fchown32:
+		status = unshare_fd(tracee, peek_reg(tracee, CURRENT, SYSARG_1), path);
+		if (status <= 0)
+			break;
+
+		/* fchown(fd, uid, gid) -> fchownat(AT_FDCWD, path, uid, gid, 0)  */
+		set_sysnum(tracee, PR_fchownat);
+		poke_reg(tracee, SYSARG_5, 0);
+		poke_reg(tracee, SYSARG_4, peek_reg(tracee, CURRENT, SYSARG_3));
+		poke_reg(tracee, SYSARG_3, peek_reg(tracee, CURRENT, SYSARG_2));
+		poke_reg(tracee, SYSARG_1, AT_FDCWD);
+		status = set_sysarg_path(tracee, path, SYSARG_2);
+		break;
+
+	case PR_fremovexattr:
+	case PR_fsetxattr:
+		status = unshare_fd(tracee, peek_reg(tracee, CURRENT, SYSARG_1), path);
+		if (status <= 0)
+			break;
+
+		/* The path variants take the same other arguments.  */
+		set_sysnum(tracee, syscall_number == PR_fsetxattr ? PR_setxattr : PR_removexattr);
+		status = set_sysarg_path(tracee, path, SYSARG_1);
+		break;
+
 	case PR_open:
 		flags = peek_reg(tracee, CURRENT, SYSARG_2);
 
-		if (   ((flags & O_NOFOLLOW) != 0)
-		    || ((flags & O_EXCL) != 0 && (flags & O_CREAT) != 0))
-			status = translate_sysarg(tracee, SYSARG_1, SYMLINK);
-		else
-			status = translate_sysarg(tracee, SYSARG_1, REGULAR);
+		type = (   ((flags & O_NOFOLLOW) != 0)
+		        || ((flags & O_EXCL) != 0 && (flags & O_CREAT) != 0))
+			? SYMLINK : REGULAR;
+
+		if (open_modifies(flags))
+			status = translate_sysarg_modify(tracee, SYSARG_1, type);
+		else {
+			status = get_sysarg_path(tracee, path, SYSARG_1);
+			if (status < 0)
+				break;
+
+			status = translate_path2_open(tracee, AT_FDCWD, path, SYSARG_1, type);
+		}
 		break;
 
 	case PR_fchownat:
+	case PR_utimensat:
+		dirfd = peek_reg(tracee, CURRENT, SYSARG_1);
+
+		status = get_sysarg_path(tracee, path, SYSARG_2);
+		if (status < 0)
+			break;
+
+		flags = syscall_number == PR_fchownat
+			? peek_reg(tracee, CURRENT, SYSARG_5)
+			: peek_reg(tracee, CURRENT, SYSARG_4);
+
+		/* futimens(2) is utimensat(fd, NULL, ...), the same
+		 * goes for an empty path with AT_EMPTY_PATH.  */
+		if (path[0] == '\0') {
+			if (dirfd == AT_FDCWD)
+				break;
+
+			status = unshare_fd(tracee, dirfd, path);
+			if (status <= 0)
+				break;
+
+			poke_reg(tracee, SYSARG_1, AT_FDCWD);
+			status = set_sysarg_path(tracee, path, SYSARG_2);
+			break;
+		}
+
+		if ((flags & AT_SYMLINK_NOFOLLOW) != 0)
+			status = translate_path2_modify(tracee, dirfd, path, SYSARG_2, SYMLINK);
+		else
+			status = translate_path2_modify(tracee, dirfd, path, SYSARG_2, REGULAR);
+		break;
+
 	case PR_fstatat64:
 	case PR_newfstatat:
-	case PR_utimensat:
 	case PR_name_to_handle_at:
 		dirfd = peek_reg(tracee, CURRENT, SYSARG_1);
 
@@ -309,8 +532,7 @@ int translate_syscall_enter(Tracee *tracee)
 		if (status < 0)
 			break;
 
-		flags = (  syscall_number == PR_fchownat
-			|| syscall_number == PR_name_to_handle_at)
+		flags = syscall_number == PR_name_to_handle_at
 			? peek_reg(tracee, CURRENT, SYSARG_5)
 			: peek_reg(tracee, CURRENT, SYSARG_4);
 
@@ -321,9 +543,27 @@ int translate_syscall_enter(Tracee *tracee)
 		break;
 
 	case PR_fchmodat:
+		dirfd = peek_reg(tracee, CURRENT, SYSARG_1);
+
+		status = get_sysarg_path(tracee, path, SYSARG_2);
+		if (status < 0)
+			break;
+
+		status = translate_path2_modify(tracee, dirfd, path, SYSARG_2, REGULAR);
+		break;
+
+	case PR_futimesat:
+		dirfd = peek_reg(tracee, CURRENT, SYSARG_1);
+
+		status = get_sysarg_path(tracee, path, SYSARG_2);
+		if (status < 0)
+			break;
+
+		status = translate_path2_modify(tracee, dirfd, path, SYSARG_2, REGULAR);
+		break;
+
 	case PR_faccessat:
 	case PR_faccessat2:
-	case PR_futimesat:
 	case PR_mknodat:
 		dirfd = peek_reg(tracee, CURRENT, SYSARG_1);
 
@@ -343,13 +583,16 @@ int translate_syscall_enter(Tracee *tracee)
 			status = translate_sysarg(tracee, SYSARG_2, REGULAR);
 		break;
 
-	case PR_readlink:
 	case PR_lchown:
 	case PR_lchown32:
-	case PR_lgetxattr:
-	case PR_llistxattr:
 	case PR_lremovexattr:
 	case PR_lsetxattr:
+		status = translate_sysarg_modify(tracee, SYSARG_1, SYMLINK);
+		break;
+
+	case PR_readlink:
+	case PR_lgetxattr:
+	case PR_llistxattr:
 	case PR_lstat:
 	case PR_lstat64:
 	case PR_unlink:
@@ -389,11 +632,14 @@ int translate_syscall_enter(Tracee *tracee)
 		if (status < 0)
 			break;
 
-		if (   ((flags & O_NOFOLLOW) != 0)
+		type = (   ((flags & O_NOFOLLOW) != 0)
 			|| ((flags & O_EXCL) != 0 && (flags & O_CREAT) != 0))
-			status = translate_path2(tracee, dirfd, path, SYSARG_2, SYMLINK);
+			? SYMLINK : REGULAR;
+
+		if (open_modifies(flags))
+			status = translate_path2_modify(tracee, dirfd, path, SYSARG_2, type);
 		else
-			status = translate_path2(tracee, dirfd, path, SYSARG_2, REGULAR);
+			status = translate_path2_open(tracee, dirfd, path, SYSARG_2, type);
 		break;
 
 	case PR_readlinkat:
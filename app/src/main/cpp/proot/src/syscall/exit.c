@@ -39,6 +39,7 @@
 #include "tracee/abi.h"
 #include "tracee/seccomp.h"
 #include "path/path.h"
+#include "path/canon.h"
 #include "ptrace/ptrace.h"
 #include "ptrace/wait.h"
 #include "arch.h"
@@ -75,46 +76,35 @@ void translate_syscall_exit(Tracee *tracee)
 	 */
 	syscall_number = get_sysnum(tracee, ORIGINAL);
 	syscall_result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
-	switch (syscall_number) {
-	case PR_brk:
-		translate_brk_exit(tracee);
-		return;
-
-	case PR_getcwd: {
-		char path[PATH_MAX];
-		size_t new_size;
-		size_t size;
-		word_t output;
-
-		size = (size_t) peek_reg(tracee, ORIGINAL, SYSARG_2);
-		if (size == 0) {
-			status = -EINVAL;
-			break;
-		}
-
-		/* Ensure cwd still exists.  */
-		status = translate_path(tracee, path, AT_FDCWD, ".", false);
-		if (status < 0)
-			break;
-
-		new_size = strlen(tracee->fs->cwd) + 1;
-		if (size < new_size) {
-			status = -ERANGE;
-			break;
-		}
 
-		/* Overwrite the path.  */
-		output = peek_reg(tracee, ORIGINAL, SYSARG_1);
-		status = write_data(tracee, output, tracee->fs->cwd, new_size);
-		if (status < 0)
-			break;
+	/* Paths may have appeared or vanished, so the cached
+	 * canonicalizations can't be trusted anymore.  */
+	switch (syscall_number) {
+	case PR_rename:
+	case PR_renameat:
+	case PR_renameat2:
+	case PR_unlink:
+	case PR_unlinkat:
+	case PR_rmdir:
+	case PR_mkdir:
+	case PR_mkdirat:
+	case PR_symlink:
+	case PR_symlinkat:
+	case PR_link:
+	case PR_linkat:
+		if ((int) syscall_result >= 0)
+			invalidate_canon_cache();
+		break;
 
-		/* The value of "status" is used to update the returned value
-		 * in translate_syscall_exit().  */
-		status = new_size;
+	default:
 		break;
 	}
 
+	switch (syscall_number) {
+	case PR_brk:
+		translate_brk_exit(tracee);
+		return;
+
 	case PR_accept:
 	case PR_accept4:
 		/* Nothing special to do if no sockaddr was specified.  */
@@ -165,10 +155,11 @@ void translate_syscall_exit(Tracee *tracee)
 
 	case PR_fchdir:
 	case PR_chdir:
-		/* These syscalls are fully emulated, see enter.c for details
+	case PR_getcwd:
+		/* These syscalls are fully emulated and their result
+		 * is set at the sysenter stage, see enter.c for details
 		 * (like errors).  */
-		status = 0;
-		break;
+		return;
 
 	case PR_rename:
 	case PR_renameat: {
@@ -240,7 +231,7 @@ void translate_syscall_exit(Tracee *tracee)
 			break;
 		}
 
-		TALLOC_FREE(tracee->fs->cwd);
+		(void) talloc_unlink(tracee->fs, tracee->fs->cwd);
 		tracee->fs->cwd = tmp;
 
 		status = 0;
@@ -25,6 +25,7 @@
 #include <string.h>     /* strerror(3), */
 #include <unistd.h>     /* sysconf(3), */
 #include <sys/param.h>  /* MIN(), MAX(), */
+#include <sys/ptrace.h> /* PTRACE_SYSCALL, */
 
 #include "tracee/tracee.h"
 #include "tracee/reg.h"
@@ -40,6 +41,30 @@
  * mapping is discarded in order to emulate an empty heap.  */
 static word_t heap_offset = 0;
 
+/* Size of the memory mapping reserved for the heap when it is
+ * created, so it can grow without any actual syscall.  Untouched
+ * pages of this mapping cost nothing thanks to MAP_NORESERVE.  */
+#define HEAP_RESERVE_SIZE	(256 * 1024 * 1024)
+#define HEAP_RESERVE_SIZE_32	(32 * 1024 * 1024)
+
+/**
+ * Return @address rounded up to the next page boundary.
+ */
+static inline word_t page_align(word_t address)
+{
+	return (address + heap_offset - 1) & ~(heap_offset - 1);
+}
+
+/**
+ * Make @tracee stop at the sysexit stage, even though its brk(2)
+ * isn't flagged FILTER_SYSEXIT.  The real syscall it was replaced
+ * with has to be translated back then.
+ */
+static inline void request_sysexit(Tracee *tracee)
+{
+	tracee->restart_how = PTRACE_SYSCALL;
+}
+
 /**
  * Put @tracee's heap to a reliable location.  By default the Linux
  * kernel puts it near loader's BSS, but this default location is not
@@ -48,11 +73,18 @@ static word_t heap_offset = 0;
  * grow anymore and some programs like Bash will abort.  This issue
  * can be reproduced when using a Ubuntu 12.04 x86_64 rootfs on RHEL 5
  * x86_64.
+ *
+ * The heap mapping is reserved larger than needed, so most calls are
+ * answered right at the sysenter stage: the heap just grows within
+ * the reserved mapping.  Only its creation, shrinking (the released
+ * pages have to be zeroed again) and growing beyond the reservation
+ * need the sysexit stage.
  */
 void translate_brk_enter(Tracee *tracee)
 {
 	word_t new_brk_address;
-	size_t old_heap_size;
+	word_t release_start;
+	word_t release_end;
 	size_t new_heap_size;
 
 	if (tracee->heap->disabled)
@@ -71,6 +103,7 @@ void translate_brk_enter(Tracee *tracee)
 		Sysnum sysnum;
 		Mapping *mappings;
 		Mapping *bss;
+		size_t reserve;
 
 		/* From PRoot's point-of-view this is the first time this
 		 * tracee calls brk(2), although an address was specified.
@@ -85,6 +118,7 @@ void translate_brk_enter(Tracee *tracee)
 			if (tracee->verbose > 0)
 				note(tracee, WARNING, INTERNAL,
 					"process %d is doing suspicious brk()",	tracee->pid);
+			request_sysexit(tracee);
 			return;
 		}
 
@@ -103,6 +137,9 @@ void translate_brk_enter(Tracee *tracee)
 		bss = &mappings[talloc_array_length(mappings) - 1];
 		new_brk_address = bss->addr + bss->length;
 
+		reserve = IS_CLASS32(tracee->load_info->elf_header)
+			? HEAP_RESERVE_SIZE_32 : HEAP_RESERVE_SIZE;
+
 #ifdef ARCH_ARM64
 		sysnum = tracee->is_aarch32 ? PR_mmap2 : PR_mmap;
 #else
@@ -111,33 +148,59 @@ void translate_brk_enter(Tracee *tracee)
 
 		set_sysnum(tracee, sysnum);
 		poke_reg(tracee, SYSARG_1 /* address */, new_brk_address);
-		poke_reg(tracee, SYSARG_2 /* length  */, heap_offset);
+		poke_reg(tracee, SYSARG_2 /* length  */, heap_offset + reserve);
 		poke_reg(tracee, SYSARG_3 /* prot    */, PROT_READ | PROT_WRITE);
-		poke_reg(tracee, SYSARG_4 /* flags   */, MAP_PRIVATE | MAP_ANONYMOUS);
+		poke_reg(tracee, SYSARG_4 /* flags   */, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
 		poke_reg(tracee, SYSARG_5 /* fd      */, -1);
 		poke_reg(tracee, SYSARG_6 /* offset  */, 0);
 
+		request_sysexit(tracee);
 		return;
 	}
 
 	/* The size of the heap can't be negative.  */
 	if (new_brk_address < tracee->heap->base) {
 		set_sysnum(tracee, PR_void);
+		poke_reg(tracee, SYSARG_RESULT, tracee->heap->base + tracee->heap->size);
 		return;
 	}
 
 	new_heap_size = new_brk_address - tracee->heap->base;
-	old_heap_size = tracee->heap->size;
 
-	/* Actually resizing.  */
-	set_sysnum(tracee, PR_mremap);
-	poke_reg(tracee, SYSARG_1 /* old_address */, tracee->heap->base - heap_offset);
-	poke_reg(tracee, SYSARG_2 /* old_size    */, old_heap_size + heap_offset);
-	poke_reg(tracee, SYSARG_3 /* new_size    */, new_heap_size + heap_offset);
-	poke_reg(tracee, SYSARG_4 /* flags       */, 0);
-	poke_reg(tracee, SYSARG_5 /* new_address */, 0);
+	/* Actually resizing beyond the reserved mapping.  */
+	if (new_heap_size > tracee->heap->reserved) {
+		set_sysnum(tracee, PR_mremap);
+		poke_reg(tracee, SYSARG_1 /* old_address */, tracee->heap->base - heap_offset);
+		poke_reg(tracee, SYSARG_2 /* old_size    */, tracee->heap->reserved + heap_offset);
+		poke_reg(tracee, SYSARG_3 /* new_size    */, new_heap_size + heap_offset);
+		poke_reg(tracee, SYSARG_4 /* flags       */, 0);
+		poke_reg(tracee, SYSARG_5 /* new_address */, 0);
+
+		request_sysexit(tracee);
+		return;
+	}
 
-	return;
+	/* The kernel discards the pages above the new break, so they
+	 * are zero-filled once the heap grows again -- malloc(3)
+	 * relies on it.  */
+	release_start = page_align(tracee->heap->base + new_heap_size);
+	release_end   = page_align(tracee->heap->base + tracee->heap->size);
+	if (release_start < release_end) {
+		set_sysnum(tracee, PR_madvise);
+		poke_reg(tracee, SYSARG_1 /* address */, release_start);
+		poke_reg(tracee, SYSARG_2 /* length  */, release_end - release_start);
+		poke_reg(tracee, SYSARG_3 /* advice  */, MADV_DONTNEED);
+
+		request_sysexit(tracee);
+		return;
+	}
+
+	/* Within the reserved mapping, nothing to do but
+	 * moving the break.  */
+	tracee->heap->size = new_heap_size;
+
+	set_sysnum(tracee, PR_void);
+	poke_reg(tracee, SYSARG_RESULT, tracee->heap->base + tracee->heap->size);
 }
 
 /**
@@ -175,6 +238,7 @@ void translate_brk_exit(Tracee *tracee)
 
 		tracee->heap->base = result + heap_offset;
 		tracee->heap->size = 0;
+		tracee->heap->reserved = peek_reg(tracee, MODIFIED, SYSARG_2) - heap_offset;
 
 		poke_reg(tracee, SYSARG_RESULT, tracee->heap->base + tracee->heap->size);
 		break;
@@ -190,6 +254,15 @@ void translate_brk_exit(Tracee *tracee)
 		}
 
 		tracee->heap->size = peek_reg(tracee, MODIFIED, SYSARG_3) - heap_offset;
+		tracee->heap->reserved = tracee->heap->size;
+
+		poke_reg(tracee, SYSARG_RESULT, tracee->heap->base + tracee->heap->size);
+		break;
+
+	case PR_madvise:
+		/* On error, brk(2) returns the previous value.  */
+		if (tracee_errno == 0)
+			tracee->heap->size = peek_reg(tracee, ORIGINAL, SYSARG_1) - tracee->heap->base;
 
 		poke_reg(tracee, SYSARG_RESULT, tracee->heap->base + tracee->heap->size);
 		break;
@@ -0,0 +1,219 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdio.h>      /* fprintf(3), fopen(3), */
+#include <stdlib.h>     /* getenv(3), qsort(3), */
+#include <string.h>     /* memset(3), */
+#include <time.h>       /* clock_gettime(2), */
+#include <signal.h>     /* sig_atomic_t, */
+#include <inttypes.h>   /* PRI*, */
+
+#include "syscall/profile.h"
+
+/* Tracer time per stop is bucketed by powers of 2 microseconds: the
+ * first bucket is below 1us, the last one is 2^14us (16ms) or more.  */
+#define PROFILE_NB_BUCKETS 16
+
+typedef struct {
+	uint64_t enter_stops;
+	uint64_t exit_stops;
+	uint64_t tracer_ns;
+	uint64_t bytes;
+	uint64_t buckets[PROFILE_NB_BUCKETS];
+} ProfileEntry;
+
+bool profile_enabled = false;
+
+static ProfileEntry profile[PR_NB_SYSNUM];
+
+/* Bytes copied from/to tracees since the beginning of the current
+ * stop, see profile_count_bytes().  */
+static uint64_t pending_bytes = 0;
+
+/* Where the report is written, stderr if NULL.  */
+static const char *report_path = NULL;
+
+static volatile sig_atomic_t report_requested = 0;
+
+/**
+ * Enable the profiling of the syscall stops if PROOT_PROFILE is
+ * defined.  If its value is an absolute path, reports are appended
+ * to this file, otherwise they are printed on stderr.
+ */
+void init_profile(void)
+{
+	const char *value = getenv("PROOT_PROFILE");
+
+	if (value == NULL)
+		return;
+
+	profile_enabled = true;
+	if (value[0] == '/')
+		report_path = value;
+}
+
+/**
+ * Return the current time in nanoseconds.
+ */
+static uint64_t profile_clock(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Start measuring the handling of a syscall stop, see
+ * profile_syscall_stop().
+ */
+uint64_t profile_syscall_start(void)
+{
+	pending_bytes = 0;
+	return profile_clock();
+}
+
+/**
+ * Account for a stop of the syscall @sysnum, at its enter stage if
+ * @is_enter_stage is true, that was handled by the tracer since
+ * @start, as returned by profile_syscall_start().
+ */
+void profile_syscall_stop(Sysnum sysnum, bool is_enter_stage, uint64_t start)
+{
+	ProfileEntry *entry;
+	uint64_t elapsed;
+	uint64_t us;
+	int bucket;
+
+	if (sysnum >= PR_NB_SYSNUM)
+		sysnum = PR_void;
+
+	entry = &profile[sysnum];
+	elapsed = profile_clock() - start;
+
+	if (is_enter_stage)
+		entry->enter_stops++;
+	else
+		entry->exit_stops++;
+
+	entry->tracer_ns += elapsed;
+	entry->bytes += pending_bytes;
+	pending_bytes = 0;
+
+	for (bucket = 0, us = elapsed / 1000; us != 0 && bucket < PROFILE_NB_BUCKETS - 1; us >>= 1)
+		bucket++;
+	entry->buckets[bucket]++;
+}
+
+/**
+ * Account for @size bytes copied from/to a tracee's memory.
+ */
+void profile_count_bytes(word_t size)
+{
+	if (profile_enabled)
+		pending_bytes += size;
+}
+
+/**
+ * Ask for a report at the next call to print_profile_report().  This
+ * function is async-signal-safe.
+ */
+void request_profile_report(void)
+{
+	report_requested = 1;
+}
+
+/**
+ * Helper for print_profile_report(): sort by decreasing tracer time.
+ */
+static int compare_profile_entries(const void *a, const void *b)
+{
+	const ProfileEntry *entry_a = &profile[*(const Sysnum *) a];
+	const ProfileEntry *entry_b = &profile[*(const Sysnum *) b];
+
+	if (entry_a->tracer_ns != entry_b->tracer_ns)
+		return (entry_a->tracer_ns < entry_b->tracer_ns ? 1 : -1);
+
+	return 0;
+}
+
+/**
+ * Write the report of the syscall stops, unless @only_if_requested
+ * is true and no report was requested by request_profile_report().
+ */
+void print_profile_report(bool only_if_requested)
+{
+	Sysnum sysnums[PR_NB_SYSNUM];
+	uint64_t total_stops = 0;
+	uint64_t total_ns = 0;
+	size_t nb_sysnums = 0;
+	FILE *file = stderr;
+	size_t i;
+	int j;
+
+	if (!profile_enabled || (only_if_requested && !report_requested))
+		return;
+	report_requested = 0;
+
+	for (i = 0; i < PR_NB_SYSNUM; i++) {
+		const ProfileEntry *entry = &profile[i];
+
+		if (entry->enter_stops + entry->exit_stops == 0)
+			continue;
+
+		sysnums[nb_sysnums++] = i;
+		total_stops += entry->enter_stops + entry->exit_stops;
+		total_ns += entry->tracer_ns;
+	}
+
+	qsort(sysnums, nb_sysnums, sizeof(Sysnum), compare_profile_entries);
+
+	if (report_path != NULL) {
+		file = fopen(report_path, "a");
+		if (file == NULL)
+			file = stderr;
+	}
+
+	fprintf(file, "proot profile: %" PRIu64 " stops, %" PRIu64 " ms in the tracer\n",
+		total_stops, total_ns / 1000000);
+	fprintf(file, "%-20s %10s %10s %10s %8s %12s  tracer time per stop (<1us, <2us, <4us, ...)\n",
+		"syscall", "enter", "exit", "total ms", "avg us", "bytes");
+
+	for (i = 0; i < nb_sysnums; i++) {
+		const ProfileEntry *entry = &profile[sysnums[i]];
+		uint64_t stops = entry->enter_stops + entry->exit_stops;
+
+		fprintf(file, "%-20s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %12" PRIu64 " ",
+			stringify_sysnum(sysnums[i]), entry->enter_stops, entry->exit_stops,
+			entry->tracer_ns / 1000000, entry->tracer_ns / 1000 / stops, entry->bytes);
+
+		for (j = 0; j < PROFILE_NB_BUCKETS; j++)
+			fprintf(file, " %" PRIu64, entry->buckets[j]);
+
+		fprintf(file, "\n");
+	}
+
+	if (file != stderr)
+		fclose(file);
+	else
+		fflush(file);
+}
@@ -0,0 +1,42 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "syscall/sysnum.h"
+#include "arch.h"
+
+/* Set when PROOT_PROFILE is defined, see init_profile().  */
+extern bool profile_enabled;
+
+extern void init_profile(void);
+extern uint64_t profile_syscall_start(void);
+extern void profile_syscall_stop(Sysnum sysnum, bool is_enter_stage, uint64_t start);
+extern void profile_count_bytes(word_t size);
+extern void request_profile_report(void);
+extern void print_profile_report(bool only_if_requested);
+
+#endif /* PROFILE_H */
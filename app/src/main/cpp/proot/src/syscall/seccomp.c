@@ -32,14 +32,17 @@
 #include <talloc.h>        /* talloc_*, */
 #include <errno.h>         /* E*, */
 #include <string.h>        /* memcpy(3), */
+#include <stdlib.h>        /* qsort(3), */
 #include <stddef.h>        /* offsetof(3), */
 #include <stdint.h>        /* uint*_t, UINT*_MAX, */
 #include <assert.h>        /* assert(3), */
+#include <sys/resource.h>  /* RLIMIT_STACK, */
 
 #include "syscall/seccomp.h"
 #include "tracee/tracee.h"
 #include "syscall/syscall.h"
 #include "syscall/sysnum.h"
+#include "path/binding.h"
 #include "cli/note.h"
 
 #include "compat.h"
@@ -47,6 +50,8 @@
 
 #define DEBUG_FILTER(...) /* fprintf(stderr, __VA_ARGS__) */
 
+extern char *root_path;
+
 /**
  * Allocate an empty @program->filter.  This function returns -errno
  * if an error occurred, otherwise 0.
@@ -117,13 +122,68 @@ static int add_trace_syscall(struct sock_fprog *program, word_t syscall, int fla
 	return 0;
 }
 
+/**
+ * Append to @program->filter the statements required to notify PRoot
+ * about the given @syscall made by a tracee, with the given @flag,
+ * unless its argument @sysarg has the value @value -- or has not this
+ * value if @allow_if_equal is false -- that is, unless PRoot would
+ * have nothing to do with it.  This function returns -errno if an
+ * error occurred, otherwise 0.
+ */
+static int add_trace_syscall_unless(struct sock_fprog *program, word_t syscall, int flag,
+				unsigned int sysarg, uint64_t value, bool allow_if_equal)
+{
+	/* The 64-bit argument is compared as two 32-bit words, the
+	 * low one first (little-endian).  */
+	const size_t low_offset  = offsetof(struct seccomp_data, args[sysarg]);
+	const size_t high_offset = low_offset + sizeof(uint32_t);
+	int status;
+
+	/* Sanity check.  */
+	if (syscall > UINT32_MAX)
+		return -ERANGE;
+
+	#define LENGTH_TRACE_SYSCALL_UNLESS 7
+	struct sock_filter statements[LENGTH_TRACE_SYSCALL_UNLESS] = {
+		/* Compare the accumulator with the expected syscall:
+		 * skip this whole block if not equal.  */
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, syscall, 0, LENGTH_TRACE_SYSCALL_UNLESS - 1),
+
+		/* Compare the low word of the argument: go to the
+		 * statement deciding the "not equal" case if it
+		 * differs.  */
+		BPF_STMT(BPF_LD + BPF_W + BPF_ABS, low_offset),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (uint32_t) value, 0, allow_if_equal ? 2 : 3),
+
+		/* Then the high word, the outcome is final.  */
+		BPF_STMT(BPF_LD + BPF_W + BPF_ABS, high_offset),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (uint32_t) (value >> 32),
+			allow_if_equal ? 1 : 0, allow_if_equal ? 0 : 1),
+
+		/* Notify the tracer.  */
+		BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_TRACE + flag),
+
+		/* Nothing to do for PRoot.  */
+		BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+	};
+
+	DEBUG_FILTER("FILTER:     trace if syscall == %ld unless arg%u %s %lld\n",
+		syscall, sysarg, allow_if_equal ? "==" : "!=", (long long) value);
+
+	status = add_statements(program, LENGTH_TRACE_SYSCALL_UNLESS, statements);
+	if (status < 0)
+		return status;
+
+	return 0;
+}
+
 /**
  * Append to @program->filter the statements that allow anything (if
- * unfiltered).  Note that @nb_traced_syscalls is used to make a
- * sanity check.  This function returns -errno if an error occurred,
+ * unfiltered).  Note that @section_length is used to make a sanity
+ * check.  This function returns -errno if an error occurred,
  * otherwise 0.
  */
-static int end_arch_section(struct sock_fprog *program, size_t nb_traced_syscalls)
+static int end_arch_section(struct sock_fprog *program, size_t section_length)
 {
 	int status;
 
@@ -139,8 +199,7 @@ static int end_arch_section(struct sock_fprog *program, size_t nb_traced_syscall
 		return status;
 
 	/* Sanity check, see start_arch_section().  */
-	if (   talloc_array_length(program->filter) - program->len
-	    != LENGTH_END_SECTION + nb_traced_syscalls * LENGTH_TRACE_SYSCALL)
+	if (talloc_array_length(program->filter) - program->len != section_length)
 		return -ERANGE;
 
 	return 0;
@@ -148,16 +207,14 @@ static int end_arch_section(struct sock_fprog *program, size_t nb_traced_syscall
 
 /**
  * Append to @program->filter the statements that check the current
- * @architecture.  Note that @nb_traced_syscalls is used to make a
- * sanity check.  This function returns -errno if an error occurred,
- * otherwise 0.
+ * @architecture, the statements of this section -- up to its end --
+ * are @section_length long.  This function returns -errno if an error
+ * occurred, otherwise 0.
  */
-static int start_arch_section(struct sock_fprog *program, uint32_t arch, size_t nb_traced_syscalls)
+static int start_arch_section(struct sock_fprog *program, uint32_t arch, size_t section_length)
 {
 	const size_t arch_offset    = offsetof(struct seccomp_data, arch);
 	const size_t syscall_offset = offsetof(struct seccomp_data, nr);
-	const size_t section_length = LENGTH_END_SECTION +
-					nb_traced_syscalls * LENGTH_TRACE_SYSCALL;
 	int status;
 
 	/* Sanity checks.  */
@@ -187,7 +244,7 @@ static int start_arch_section(struct sock_fprog *program, uint32_t arch, size_t
 	};
 
 	DEBUG_FILTER("FILTER: if arch == %ld, up to %zdth statement\n",
-		arch, nb_traced_syscalls);
+		arch, section_length);
 
 	status = add_statements(program, LENGTH_START_SECTION, statements);
 	if (status < 0)
@@ -233,17 +290,237 @@ static void free_program_filter(struct sock_fprog *program)
 	program->len = 0;
 }
 
+/* Syscalls PRoot has nothing to do with, neither on enter nor on
+ * exit, when their argument @sysarg is equal to @value -- or is not
+ * equal to @value if @allow_if_equal is false.  */
+typedef struct {
+	Sysnum value;
+	unsigned int sysarg;
+	uint64_t arg_value;
+	bool allow_if_equal;
+} FilteredSysarg;
+
+static const FilteredSysarg proot_sysargs[] = {
+	/* No sockaddr to detranslate.  */
+	{ PR_accept,	1, 0,		 true },
+	{ PR_accept4,	1, 0,		 true },
+
+	/* Only the stack limit is emulated, see rlimit.c.  */
+	{ PR_setrlimit,	0, RLIMIT_STACK, false },
+	{ PR_prlimit64,	1, RLIMIT_STACK, false },
+
+	{ PR_void,	0, 0,		 false },
+};
+
+/**
+ * Return the fast path for @sysnum from proot_sysargs[], or NULL if
+ * it has to be traced unconditionally.
+ */
+static const FilteredSysarg *get_filtered_sysarg(Sysnum sysnum)
+{
+	size_t i;
+
+	for (i = 0; proot_sysargs[i].value != PR_void; i++) {
+		if (proot_sysargs[i].value == sysnum)
+			return &proot_sysargs[i];
+	}
+
+	return NULL;
+}
+
+/* A filtered syscall resolved for one architecture.  */
+typedef struct {
+	word_t syscall;
+	int flags;
+	const FilteredSysarg *sysarg;
+	size_t order;
+} SyscallRule;
+
+/* Rules tested one after another at the leaves of the decision
+ * tree, see add_decision_tree().  */
+#define MAX_LEAF_RULES 3
+#define LENGTH_LEAF_END 1
+
+static int compare_rules(const void *a, const void *b)
+{
+	const SyscallRule *rule_a = a;
+	const SyscallRule *rule_b = b;
+
+	if (rule_a->syscall != rule_b->syscall)
+		return rule_a->syscall < rule_b->syscall ? -1 : 1;
+
+	/* Keep the first of the duplicates, as the linear filter
+	 * would have matched it first.  */
+	return rule_a->order < rule_b->order ? -1 : (rule_a->order > rule_b->order);
+}
+
+static size_t rule_length(const SyscallRule *rule)
+{
+	return rule->sysarg != NULL ? LENGTH_TRACE_SYSCALL_UNLESS : LENGTH_TRACE_SYSCALL;
+}
+
+/**
+ * Return the number of statements add_decision_tree() appends for the
+ * given @rules (@nb_rules items).
+ */
+static size_t decision_tree_length(const SyscallRule *rules, size_t nb_rules)
+{
+	size_t length;
+	size_t half;
+	size_t i;
+
+	if (nb_rules <= MAX_LEAF_RULES) {
+		length = LENGTH_LEAF_END;
+		for (i = 0; i < nb_rules; i++)
+			length += rule_length(&rules[i]);
+		return length;
+	}
+
+	half   = nb_rules / 2;
+	length = decision_tree_length(&rules[half], nb_rules - half);
+
+	return (length <= UINT8_MAX ? 1 : 2) + length + decision_tree_length(rules, half);
+}
+
+/**
+ * Append to @program->filter a binary search over the syscall number
+ * in the accumulator for the given @rules (@nb_rules items, sorted by
+ * syscall number), so that an untraced syscall goes through a few
+ * comparisons instead of one per filtered syscall.  Every path of
+ * the tree ends with a return statement.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+static int add_decision_tree(struct sock_fprog *program, const SyscallRule *rules, size_t nb_rules)
+{
+	size_t right_length;
+	size_t half;
+	size_t i;
+	int status;
+
+	if (nb_rules <= MAX_LEAF_RULES) {
+		struct sock_filter statements[LENGTH_LEAF_END] = {
+			BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+		};
+
+		for (i = 0; i < nb_rules; i++) {
+			if (rules[i].sysarg != NULL)
+				status = add_trace_syscall_unless(program, rules[i].syscall, rules[i].flags,
+								rules[i].sysarg->sysarg, rules[i].sysarg->arg_value,
+								rules[i].sysarg->allow_if_equal);
+			else
+				status = add_trace_syscall(program, rules[i].syscall, rules[i].flags);
+			if (status < 0)
+				return status;
+		}
+
+		DEBUG_FILTER("FILTER:     allow\n");
+
+		return add_statements(program, LENGTH_LEAF_END, statements);
+	}
+
+	/* The upper half comes first, the lower half is reached by
+	 * jumping over it.  */
+	half = nb_rules / 2;
+	right_length = decision_tree_length(&rules[half], nb_rules - half);
+
+	DEBUG_FILTER("FILTER:   if syscall >= %ld\n", rules[half].syscall);
+
+	if (right_length <= UINT8_MAX) {
+		struct sock_filter statements[1] = {
+			BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, rules[half].syscall, 0, right_length)
+		};
+		status = add_statements(program, 1, statements);
+	}
+	else {
+		/* Conditional jumps are limited to 255 statements.  */
+		struct sock_filter statements[2] = {
+			BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, rules[half].syscall, 1, 0),
+			BPF_STMT(BPF_JMP + BPF_JA + BPF_K, right_length)
+		};
+		status = add_statements(program, 2, statements);
+	}
+	if (status < 0)
+		return status;
+
+	status = add_decision_tree(program, &rules[half], nb_rules - half);
+	if (status < 0)
+		return status;
+
+	return add_decision_tree(program, rules, half);
+}
+
+/**
+ * Resolve the @sysnums for the ABIs of @arch into @rules, sorted by
+ * syscall number and without duplicates, the caller frees them.
+ * This function returns the number of rules, or -errno if an error
+ * occurred.
+ */
+static ssize_t get_syscall_rules(const SeccompArch *arch, const FilteredSysnum *sysnums,
+				SyscallRule **rules)
+{
+	size_t nb_rules = 0;
+	size_t i, j, k;
+	word_t syscall;
+
+	for (k = 0; sysnums[k].value != PR_void; k++)
+		;
+
+	*rules = talloc_array(NULL, SyscallRule, arch->nb_abis * k);
+	if (*rules == NULL)
+		return -ENOMEM;
+
+	for (j = 0; j < arch->nb_abis; j++) {
+		for (k = 0; sysnums[k].value != PR_void; k++) {
+			/* Get the architecture specific syscall number.  */
+			syscall = detranslate_sysnum(arch->abis[j], sysnums[k].value);
+			if (syscall == SYSCALL_AVOIDER)
+				continue;
+
+			/* Sanity check.  */
+			if (syscall > UINT32_MAX) {
+				TALLOC_FREE(*rules);
+				return -ERANGE;
+			}
+
+			(*rules)[nb_rules].syscall = syscall;
+			(*rules)[nb_rules].flags   = sysnums[k].flags;
+			(*rules)[nb_rules].sysarg  = get_filtered_sysarg(sysnums[k].value);
+			(*rules)[nb_rules].order   = nb_rules;
+			nb_rules++;
+		}
+	}
+
+	qsort(*rules, nb_rules, sizeof(SyscallRule), compare_rules);
+
+	for (i = 0, j = 0; i < nb_rules; i++) {
+		if (j > 0 && (*rules)[j - 1].syscall == (*rules)[i].syscall)
+			continue;
+		(*rules)[j++] = (*rules)[i];
+	}
+
+	return j;
+}
+
 /**
  * Convert the given @sysnums into BPF filters according to the
  * following pseudo-code, then enabled them for the given @tracee and
  * all of its future children:
  *
  *     for each handled architectures
- *         for each filtered syscall
- *             trace
+ *         binary search of the filtered syscalls
+ *             trace, unless its arguments tell there's nothing to do
  *         allow
  *     kill
  *
+ * The host architecture comes first, so its tracees never reach the
+ * sections of the other architectures.
+ *
+ * Note: filtered syscalls are always SECCOMP_RET_TRACE.  With
+ * SECCOMP_RET_USER_NOTIF the syscall arguments can't be rewritten,
+ * so PRoot would have to perform each path syscall on the tracee's
+ * behalf -- including its cwd, fds and credentials -- and its
+ * listener would have to run beside the single-threaded event loop.
+ *
  * This function returns -errno if an error occurred, otherwise 0.
  */
 static int set_seccomp_filters(const FilteredSysnum *sysnums)
@@ -252,8 +529,8 @@ static int set_seccomp_filters(const FilteredSysnum *sysnums)
 	size_t nb_archs = sizeof(seccomp_archs) / sizeof(SeccompArch);
 
 	struct sock_fprog program = { .len = 0, .filter = NULL };
-	size_t nb_traced_syscalls;
-	size_t i, j, k;
+	size_t section_length;
+	size_t i;
 	int status;
 
 	status = new_program_filter(&program);
@@ -262,40 +539,30 @@ static int set_seccomp_filters(const FilteredSysnum *sysnums)
 
 	/* For each handled architectures */
 	for (i = 0; i < nb_archs; i++) {
-		word_t syscall;
+		SyscallRule *rules;
+		ssize_t nb_rules;
 
-		nb_traced_syscalls = 0;
-
-		/* Pre-compute the number of traced syscalls for this architecture.  */
-		for (j = 0; j < seccomp_archs[i].nb_abis; j++) {
-			for (k = 0; sysnums[k].value != PR_void; k++) {
-				syscall = detranslate_sysnum(seccomp_archs[i].abis[j], sysnums[k].value);
-				if (syscall != SYSCALL_AVOIDER)
-					nb_traced_syscalls++;
-			}
+		nb_rules = get_syscall_rules(&seccomp_archs[i], sysnums, &rules);
+		if (nb_rules < 0) {
+			status = nb_rules;
+			goto end;
 		}
 
+		section_length = decision_tree_length(rules, nb_rules) + LENGTH_END_SECTION;
+
 		/* Filter: if handled architecture */
-		status = start_arch_section(&program, seccomp_archs[i].value, nb_traced_syscalls);
+		status = start_arch_section(&program, seccomp_archs[i].value, section_length);
 		if (status < 0)
 			goto end;
 
-		for (j = 0; j < seccomp_archs[i].nb_abis; j++) {
-			for (k = 0; sysnums[k].value != PR_void; k++) {
-				/* Get the architecture specific syscall number.  */
-				syscall = detranslate_sysnum(seccomp_archs[i].abis[j], sysnums[k].value);
-				if (syscall == SYSCALL_AVOIDER)
-					continue;
-
-				/* Filter: trace if handled syscall */
-				status = add_trace_syscall(&program, syscall, sysnums[k].flags);
-				if (status < 0)
-					goto end;
-			}
-		}
+		/* Filter: trace if handled syscall */
+		status = add_decision_tree(&program, rules, nb_rules);
+		TALLOC_FREE(rules);
+		if (status < 0)
+			goto end;
 
 		/* Filter: allow untraced syscalls for this architecture */
-		status = end_arch_section(&program, nb_traced_syscalls);
+		status = end_arch_section(&program, section_length);
 		if (status < 0)
 			goto end;
 	}
@@ -329,8 +596,8 @@ static FilteredSysnum proot_sysnums[] = {
 	{ PR_accept4,		FILTER_SYSEXIT },
 	{ PR_access,		0 },
 	{ PR_bind,		0 },
-	{ PR_brk,		FILTER_SYSEXIT },
-	{ PR_chdir,		FILTER_SYSEXIT },
+	{ PR_brk,		0 },
+	{ PR_chdir,		0 },
 	{ PR_chmod,		0 },
 	{ PR_chown,		0 },
 	{ PR_chown32,		0 },
@@ -338,12 +605,17 @@ static FilteredSysnum proot_sysnums[] = {
 	{ PR_execve,		FILTER_SYSEXIT },
 	{ PR_faccessat,		0 },
 	{ PR_faccessat2,	0 },
-	{ PR_fchdir,		FILTER_SYSEXIT },
+	{ PR_fchdir,		0 },
+	{ PR_fchmod,		0 },
 	{ PR_fchmodat,		0 },
+	{ PR_fchown,		0 },
+	{ PR_fchown32,		0 },
 	{ PR_fchownat,		0 },
+	{ PR_fremovexattr,	0 },
+	{ PR_fsetxattr,		0 },
 	{ PR_fstatat64,		0 },
 	{ PR_futimesat,		0 },
-	{ PR_getcwd,		FILTER_SYSEXIT },
+	{ PR_getcwd,		0 },
 	{ PR_getpeername,	FILTER_SYSEXIT },
 	{ PR_getsockname,	FILTER_SYSEXIT },
 	{ PR_getxattr,		0 },
@@ -351,16 +623,16 @@ static FilteredSysnum proot_sysnums[] = {
 	{ PR_lchown,		0 },
 	{ PR_lchown32,		0 },
 	{ PR_lgetxattr,		0 },
-	{ PR_link,		0 },
-	{ PR_linkat,		0 },
+	{ PR_link,		FILTER_SYSEXIT },
+	{ PR_linkat,		FILTER_SYSEXIT },
 	{ PR_listxattr,		0 },
 	{ PR_llistxattr,	0 },
 	{ PR_lremovexattr,	0 },
 	{ PR_lsetxattr,		0 },
 	{ PR_lstat,		0 },
 	{ PR_lstat64,		0 },
-	{ PR_mkdir,		0 },
-	{ PR_mkdirat,		0 },
+	{ PR_mkdir,		FILTER_SYSEXIT },
+	{ PR_mkdirat,		FILTER_SYSEXIT },
 	{ PR_mknod,		0 },
 	{ PR_mknodat,		0 },
 	{ PR_name_to_handle_at,	0 },
@@ -376,20 +648,19 @@ static FilteredSysnum proot_sysnums[] = {
 	{ PR_rename,		FILTER_SYSEXIT },
 	{ PR_renameat,		FILTER_SYSEXIT },
 	{ PR_renameat2,		FILTER_SYSEXIT },
-	{ PR_rmdir,		0 },
+	{ PR_rmdir,		FILTER_SYSEXIT },
 	{ PR_setrlimit,		FILTER_SYSEXIT },
 	{ PR_setxattr,		0 },
 	{ PR_stat,		0 },
 	{ PR_stat64,		0 },
 	{ PR_statfs,		FILTER_SYSEXIT },
 	{ PR_statfs64,		FILTER_SYSEXIT },
-	{ PR_symlink,		0 },
-	{ PR_symlinkat,		0 },
+	{ PR_symlink,		FILTER_SYSEXIT },
+	{ PR_symlinkat,		FILTER_SYSEXIT },
 	{ PR_truncate,		0 },
 	{ PR_truncate64,	0 },
-	{ PR_uname,		FILTER_SYSEXIT },
-	{ PR_unlink,		0 },
-	{ PR_unlinkat,		0 },
+	{ PR_unlink,		FILTER_SYSEXIT },
+	{ PR_unlinkat,		FILTER_SYSEXIT },
 	{ PR_utime,		FILTER_SYSEXIT },
 	{ PR_utimensat,		0 },
 	{ PR_utimes,		0 },
@@ -445,6 +716,57 @@ static int merge_filtered_sysnums(TALLOC_CTX *context, FilteredSysnum **sysnums,
 	return 0;
 }
 
+/**
+ * Check whether guest paths and host paths are the same for @tracee,
+ * that is, whether its rootfs is "/" and all its bindings are
+ * symmetric.
+ */
+static bool is_identity_translation(const Tracee *tracee)
+{
+	const Binding *binding;
+
+	if (root_path == NULL || strcmp(root_path, "/") != 0)
+		return false;
+
+	if (tracee->fs->bindings.guest == NULL)
+		return false;
+
+	CIRCLEQ_FOREACH(binding, tracee->fs->bindings.guest, link.guest) {
+		if (binding->need_substitution)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Remove the FILTER_SYSEXIT flag from the @sysnums the exit stage of
+ * which has nothing to do for the configuration of @tracee.
+ */
+static void trim_filtered_sysexits(const Tracee *tracee, FilteredSysnum *sysnums)
+{
+	size_t i;
+
+	/* Socket addresses are detranslated on exit, that's useless
+	 * when no path is translated.  */
+	if (!is_identity_translation(tracee))
+		return;
+
+	for (i = 0; sysnums[i].value != PR_void; i++) {
+		switch (sysnums[i].value) {
+		case PR_accept:
+		case PR_accept4:
+		case PR_getsockname:
+		case PR_getpeername:
+			sysnums[i].flags &= ~FILTER_SYSEXIT;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
 /**
  * Tell the kernel to trace only syscalls handled by PRoot.
  * This filter will be enabled for the given @tracee and
@@ -463,6 +785,8 @@ int enable_syscall_filtering(const Tracee *tracee)
 	if (status < 0)
 		return status;
 
+	trim_filtered_sysexits(tracee, filtered_sysnums);
+
 	status = set_seccomp_filters(filtered_sysnums);
 	if (status < 0)
 		return status;
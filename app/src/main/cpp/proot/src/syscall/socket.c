@@ -35,6 +35,7 @@
 #include "path/binding.h"
 #include "path/temp.h"
 #include "path/path.h"
+#include "path/canon.h"
 #include "arch.h"
 
 #include "compat.h"
@@ -45,6 +46,46 @@ static const off_t offsetof_path = offsetof(struct sockaddr_un, sun_path);
 extern struct sockaddr_un sockaddr_un__;
 static const size_t sizeof_path  = sizeof(sockaddr_un__.sun_path);
 
+/* Number of entries in the cache of translated socket paths, a power
+ * of 2.  */
+#define SOCKET_CACHE_SIZE 64
+
+/* Translation of an absolute @user_path that fits in sun_path, as
+ * seen through @bindings.  The X11, PulseAudio and virgl sockets are
+ * connected to again and again.  */
+typedef struct {
+	const void *bindings;
+	CanonCacheStamp stamp;
+	char user_path[sizeof(sockaddr_un__.sun_path) + 1];
+	char host_path[sizeof(sockaddr_un__.sun_path) + 1];
+} SocketCacheEntry;
+
+static SocketCacheEntry socket_cache[SOCKET_CACHE_SIZE];
+
+/**
+ * Return the entry of the socket cache where the translation of
+ * @user_path is kept, or NULL if it can't be cached.
+ */
+static SocketCacheEntry *get_socket_cache_entry(const Tracee *tracee, const char *user_path)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const char *cursor;
+
+	/* Relative paths depend on the cwd, and the glue may be built
+	 * while a binding is initialized.  */
+	if (user_path[0] != '/' || tracee->glue_type != 0 || tracee->fs->bindings.guest == NULL)
+		return NULL;
+
+	for (cursor = user_path; *cursor != '\0'; cursor++) {
+		hash ^= (uint8_t) *cursor;
+		hash *= 1099511628211ULL;
+	}
+	hash ^= (uintptr_t) tracee->fs->bindings.guest;
+	hash *= 1099511628211ULL;
+
+	return &socket_cache[(hash ^ (hash >> 32)) & (SOCKET_CACHE_SIZE - 1)];
+}
+
 /**
  * Copy in @sockaddr the struct sockaddr_un stored in the @tracee
  * memory at the given @address.  Also, its pathname is copied to the
@@ -94,6 +135,7 @@ static int read_sockaddr_un(Tracee *tracee, struct sockaddr_un *sockaddr, word_t
 int translate_socketcall_enter(Tracee *tracee, word_t *address, int size)
 {
 	struct sockaddr_un sockaddr;
+	SocketCacheEntry *entry;
 	char user_path[PATH_MAX];
 	char host_path[PATH_MAX];
 	int status;
@@ -105,10 +147,28 @@ int translate_socketcall_enter(Tracee *tracee, word_t *address, int size)
 	if (status <= 0)
 		return status;
 
+	entry = get_socket_cache_entry(tracee, user_path);
+	if (entry != NULL
+	    && entry->bindings == tracee->fs->bindings.guest
+	    && strcmp(entry->user_path, user_path) == 0
+	    && is_canon_cache_stamp_valid(&entry->stamp)) {
+		strcpy(host_path, entry->host_path);
+		goto translated;
+	}
+
 	status = translate_path(tracee, host_path, AT_FDCWD, user_path, true);
 	if (status < 0)
 		return status;
 
+	/* Only translations that don't need a shorter binding can be
+	 * reused as they are.  */
+	if (entry != NULL && strlen(host_path) <= sizeof_path) {
+		entry->bindings = tracee->fs->bindings.guest;
+		stamp_canon_cache(&entry->stamp);
+		strcpy(entry->user_path, user_path);
+		strcpy(entry->host_path, host_path);
+	}
+
 	/* Be careful: sun_path doesn't have to be null-terminated.  */
 	if (strlen(host_path) > sizeof_path) {
 		char *shorter_host_path;
@@ -144,6 +204,7 @@ int translate_socketcall_enter(Tracee *tracee, word_t *address, int size)
 		/* Let's use this shorter path now.  */
 		strcpy(host_path, shorter_host_path);
 	}
+translated:
 	strncpy(sockaddr.sun_path, host_path, sizeof_path);
 
 	/* Push the updated sockaddr to a newly allocated space.  */
@@ -30,6 +30,7 @@
 #include "tracee/tracee.h"
 #include "tracee/reg.h"
 #include "tracee/mem.h"
+#include "syscall/profile.h"
 #include "cli/note.h"
 
 /**
@@ -102,8 +103,12 @@ int set_sysarg_path(Tracee *tracee, const char path[PATH_MAX], Reg reg)
 void translate_syscall(Tracee *tracee)
 {
 	const bool is_enter_stage = IS_IN_SYSENTER(tracee);
+	uint64_t profile_start = 0;
 	int status;
 
+	if (profile_enabled)
+		profile_start = profile_syscall_start();
+
 	assert(tracee->exe != NULL);
 
 	status = fetch_regs(tracee);
@@ -230,4 +235,7 @@ void translate_syscall(Tracee *tracee)
 		print_current_regs(tracee, 5, "sysenter end" );
 	else
 		print_current_regs(tracee, 4, "sysexit end");
+
+	if (profile_enabled)
+		profile_syscall_stop(get_sysnum(tracee, ORIGINAL), is_enter_stage, profile_start);
 }
@@ -44,11 +44,14 @@
 #include "path/binding.h"
 #include "syscall/syscall.h"
 #include "syscall/seccomp.h"
+#include "syscall/profile.h"
+#include "tracee/talloc_report.h"
 #include "ptrace/wait.h"
 #include "execve/elf.h"
 
 #include "attribute.h"
 #include "compat.h"
+#include "native_trace.h"
 
 static bool seccomp_after_ptrace_enter = false;
 
@@ -101,7 +104,7 @@ int launch_process(Tracee *tracee, char *const argv[])
 
 	default: /* parent */
 		/* We know the pid of the first tracee now.  */
-		tracee->pid = pid;
+		set_tracee_pid(tracee, pid);
 		return 0;
 	}
 
@@ -188,11 +191,17 @@ static void print_talloc_chunk(const void *ptr, int depth, int max_depth UNUSED,
 	fprintf(stderr, "\n");
 }
 
-/* Print on stderr the complete talloc hierarchy.  */
+/* Print on stderr the complete talloc hierarchy, or ask for a
+ * structured report on SIGUSR1 when PROOT_TALLOC_REPORT is defined,
+ * see print_talloc_report().  */
 static void print_talloc_hierarchy(int signum, siginfo_t *siginfo UNUSED, void *ucontext UNUSED)
 {
 	switch (signum) {
 	case SIGUSR1:
+		if (talloc_report_enabled) {
+			request_talloc_report();
+			break;
+		}
 		talloc_report_depth_cb(NULL, 0, 100, print_talloc_chunk, NULL);
 		break;
 
@@ -205,6 +214,12 @@ static void print_talloc_hierarchy(int signum, siginfo_t *siginfo UNUSED, void *
 	}
 }
 
+/* Ask for a report of the syscall stops, see print_profile_report().  */
+static void request_profile(int signum UNUSED, siginfo_t *siginfo UNUSED, void *ucontext UNUSED)
+{
+	request_profile_report();
+}
+
 static int last_exit_status = -1;
 
 /**
@@ -222,6 +237,9 @@ int event_loop()
 	if (status != 0)
 		note(NULL, WARNING, INTERNAL, "atexit() failed");
 
+	init_profile();
+	init_talloc_report();
+
 	/* All signals are blocked when the signal handler is called.
 	 * SIGINFO is used to know which process has signaled us and
 	 * RESTART is used to restart waitpid(2) seamlessly.  */
@@ -248,10 +266,18 @@ int event_loop()
 		case SIGUSR1:
 		case SIGUSR2:
 			/* Print on stderr the complete talloc
-			 * hierarchy, useful for debug purpose.  */
+			 * hierarchy, useful for debug purpose, see
+			 * PROOT_TALLOC_REPORT.  */
 			signal_action.sa_sigaction = print_talloc_hierarchy;
 			break;
 
+		case SIGPROF:
+			/* Print the syscall stop profile once the
+			 * current waitpid(2) returns, see
+			 * PROOT_PROFILE.  */
+			signal_action.sa_sigaction = request_profile;
+			break;
+
 		case SIGCHLD:
 		case SIGCONT:
 		case SIGSTOP:
@@ -274,6 +300,14 @@ int event_loop()
 			note(NULL, WARNING, SYSTEM, "sigaction(%d)", signum);
 	}
 
+	/* All tracees are handled by this thread only.  Auto-attached
+	 * children are traced by the thread that traced their parent,
+	 * and moving one to another tracer thread means a
+	 * PTRACE_DETACH/PTRACE_SEIZE dance during which it may run
+	 * untranslated.  Besides, the whole tracer state -- talloc
+	 * hierarchies shared between tracees, bindings, the
+	 * canonicalization cache, ptracer emulation -- assumes a
+	 * single thread.  */
 	while (1) {
 		int tracee_status;
 		Tracee *tracee;
@@ -293,6 +327,11 @@ int event_loop()
 			break;
 		}
 
+		/* The report can't be printed from the signal
+		 * handler, stdio isn't async-signal-safe.  */
+		print_profile_report(true);
+		print_talloc_report(true);
+
 		/* Get information about this tracee. */
 		tracee = get_tracee(NULL, pid, true);
 		assert(tracee != NULL);
@@ -309,6 +348,9 @@ int event_loop()
 		(void) restart_tracee(tracee, signal);
 	}
 
+	print_profile_report(false);
+	print_talloc_report(false);
+
 	return last_exit_status;
 }
 
@@ -324,6 +366,7 @@ int handle_tracee_event(Tracee *tracee, int tracee_status)
 	long status;
 	int signal;
 	bool sysexit_necessary;
+	NATIVE_TRACE_SCOPE("handle_tracee_event");
 
 	if (!seccomp_after_ptrace_enter_checked) {
 		seccomp_after_ptrace_enter = getenv("PROOT_ASSUME_NEW_SECCOMP") != NULL;
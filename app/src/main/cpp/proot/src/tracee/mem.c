@@ -37,6 +37,7 @@
 #include "tracee/mem.h"
 #include "tracee/abi.h"
 #include "syscall/heap.h"
+#include "syscall/profile.h"
 #include "arch.h"            /* word_t, NO_MISALIGNED_ACCESS */
 #include "cli/note.h"
 
@@ -74,12 +75,52 @@ static inline void store_word(void *address, word_t value)
 #endif
 }
 
+/* Set once the kernel refuses process_vm_readv/writev altogether
+ * (not built in, or filtered by a seccomp policy), so the word by
+ * word ptrace(2) path is used from then on without trying again.  */
+static bool process_vm_unavailable = false;
+
+/**
+ * Note whether the failed process_vm_readv/writev -- with errno set
+ * -- means the call itself is not usable.
+ */
+static void check_process_vm_failure(void)
+{
+	if (errno == ENOSYS || errno == EPERM)
+		process_vm_unavailable = true;
+}
+
+/**
+ * Copy @size bytes from @src_tracee within the memory space of the
+ * @tracee process to @dest_tracer with a single process_vm_readv(2).
+ * This function returns the number of bytes copied, or -1 with errno
+ * set, a short count means the rest of the range is not readable.
+ */
+static ssize_t process_vm_read(const Tracee *tracee, void *dest_tracer, word_t src_tracee, word_t size)
+{
+	struct iovec local;
+	struct iovec remote;
+	ssize_t status;
+
+	local.iov_base  = dest_tracer;
+	local.iov_len   = size;
+	remote.iov_base = (void *) src_tracee;
+	remote.iov_len  = size;
+
+	status = process_vm_readv(tracee->pid, &local, 1, &remote, 1, 0);
+	if (status < 0)
+		check_process_vm_failure();
+
+	return status;
+}
+
 /**
  * Copy @size bytes from the buffer @src_tracer to the address
- * @dest_tracee within the memory space of the @tracee process. It
- * returns -errno if an error occured, otherwise 0.
+ * @dest_tracee within the memory space of the @tracee process, one
+ * word at a time with ptrace(2). It returns -errno if an error
+ * occured, otherwise 0.
  */
-int write_data(Tracee *tracee, word_t dest_tracee, const void *src_tracer, word_t size)
+static int write_data_ptrace(Tracee *tracee, word_t dest_tracee, const void *src_tracer, word_t size)
 {
 	word_t *src  = (word_t *)src_tracer;
 	word_t *dest = (word_t *)dest_tracee;
@@ -137,6 +178,45 @@ int write_data(Tracee *tracee, word_t dest_tracee, const void *src_tracer, word_
 	return 0;
 }
 
+/**
+ * Copy @size bytes from the buffer @src_tracer to the address
+ * @dest_tracee within the memory space of the @tracee process. It
+ * returns -errno if an error occured, otherwise 0.
+ */
+int write_data(Tracee *tracee, word_t dest_tracee, const void *src_tracer, word_t size)
+{
+	struct iovec local;
+	struct iovec remote;
+	ssize_t status;
+
+	if (size == 0)
+		return 0;
+
+	profile_count_bytes(size);
+
+	if (!process_vm_unavailable) {
+		local.iov_base  = (void *) src_tracer;
+		local.iov_len   = size;
+		remote.iov_base = (void *) dest_tracee;
+		remote.iov_len  = size;
+
+		status = process_vm_writev(tracee->pid, &local, 1, &remote, 1, 0);
+		if (status == (ssize_t) size)
+			return 0;
+		if (status < 0)
+			check_process_vm_failure();
+
+		/* Unlike ptrace(2), process_vm_writev(2) does not write
+		 * to read-only mappings, so finish the remaining bytes
+		 * -- if any -- the slow way.  */
+		if (status > 0)
+			return write_data_ptrace(tracee, dest_tracee + status,
+						(const uint8_t *) src_tracer + status, size - status);
+	}
+
+	return write_data_ptrace(tracee, dest_tracee, src_tracer, size);
+}
+
 /**
  * Gather the @src_tracer_count buffers pointed to by @src_tracer to
  * the address @dest_tracee within the memory space of the @tracee
@@ -145,10 +225,29 @@ int write_data(Tracee *tracee, word_t dest_tracee, const void *src_tracer, word_
  */
 int writev_data(Tracee *tracee, word_t dest_tracee, const struct iovec *src_tracer, int src_tracer_count)
 {
+	struct iovec remote;
+	ssize_t written;
 	size_t size;
 	int status;
 	int i;
 
+	for (i = 0, size = 0; i < src_tracer_count; i++)
+		size += src_tracer[i].iov_len;
+
+	/* Scatter all the buffers in a single system call.  */
+	if (!process_vm_unavailable && src_tracer_count <= IOV_MAX) {
+		remote.iov_base = (void *) dest_tracee;
+		remote.iov_len  = size;
+
+		written = process_vm_writev(tracee->pid, src_tracer, src_tracer_count, &remote, 1, 0);
+		if (written == (ssize_t) size) {
+			profile_count_bytes(size);
+			return 0;
+		}
+		if (written < 0)
+			check_process_vm_failure();
+	}
+
 	for (i = 0, size = 0; i < src_tracer_count; i++) {
 		status = write_data(tracee, dest_tracee + size,
 				src_tracer[i].iov_base, src_tracer[i].iov_len);
@@ -163,10 +262,11 @@ int writev_data(Tracee *tracee, word_t dest_tracee, const struct iovec *src_trac
 
 /**
  * Copy @size bytes to the buffer @dest_tracer from the address
- * @src_tracee within the memory space of the @tracee process. It
- * returns -errno if an error occured, otherwise 0.
+ * @src_tracee within the memory space of the @tracee process, one
+ * word at a time with ptrace(2). It returns -errno if an error
+ * occured, otherwise 0.
  */
-int read_data(const Tracee *tracee, void *dest_tracer, word_t src_tracee, word_t size)
+static int read_data_ptrace(const Tracee *tracee, void *dest_tracer, word_t src_tracee, word_t size)
 {
 	word_t *src  = (word_t *)src_tracee;
 	word_t *dest = (word_t *)dest_tracer;
@@ -215,14 +315,42 @@ int read_data(const Tracee *tracee, void *dest_tracer, word_t src_tracee, word_t
 	return 0;
 }
 
+/**
+ * Copy @size bytes to the buffer @dest_tracer from the address
+ * @src_tracee within the memory space of the @tracee process. It
+ * returns -errno if an error occured, otherwise 0.
+ */
+int read_data(const Tracee *tracee, void *dest_tracer, word_t src_tracee, word_t size)
+{
+	ssize_t status;
+
+	if (size == 0)
+		return 0;
+
+	profile_count_bytes(size);
+
+	if (!process_vm_unavailable) {
+		status = process_vm_read(tracee, dest_tracer, src_tracee, size);
+		if (status == (ssize_t) size)
+			return 0;
+
+		/* Let ptrace(2) tell whether the rest is readable.  */
+		if (status > 0)
+			return read_data_ptrace(tracee, (uint8_t *) dest_tracer + status,
+						src_tracee + status, size - status);
+	}
+
+	return read_data_ptrace(tracee, dest_tracer, src_tracee, size);
+}
+
 /**
  * Copy to @dest_tracer at most @max_size bytes from the string
  * pointed to by @src_tracee within the memory space of the @tracee
- * process. This function returns -errno on error, otherwise
- * it returns the number in bytes of the string, including the
- * end-of-string terminator.
+ * process, one word at a time with ptrace(2). This function returns
+ * -errno on error, otherwise it returns the number in bytes of the
+ * string, including the end-of-string terminator.
  */
-int read_string(const Tracee *tracee, char *dest_tracer, word_t src_tracee, word_t max_size)
+static int read_string_ptrace(const Tracee *tracee, char *dest_tracer, word_t src_tracee, word_t max_size)
 {
 	word_t *src  = (word_t *)src_tracee;
 	word_t *dest = (word_t *)dest_tracer;
@@ -274,6 +402,57 @@ int read_string(const Tracee *tracee, char *dest_tracer, word_t src_tracee, word
 	return i * sizeof(word_t) + j + 1;
 }
 
+/**
+ * Copy to @dest_tracer at most @max_size bytes from the string
+ * pointed to by @src_tracee within the memory space of the @tracee
+ * process. This function returns -errno on error, otherwise
+ * it returns the number in bytes of the string, including the
+ * end-of-string terminator.
+ */
+int read_string(const Tracee *tracee, char *dest_tracer, word_t src_tracee, word_t max_size)
+{
+	static word_t page_size = 0;
+	word_t offset = 0;
+	word_t length;
+	ssize_t status;
+	char *end;
+	int result;
+
+	if (page_size == 0) {
+		page_size = sysconf(_SC_PAGE_SIZE);
+		if ((int) page_size <= 0)
+			page_size = 0x1000;
+	}
+
+	/* Read up to the end of each page only: the string may end
+	 * right before an unmapped page, that has to be left alone.  */
+	while (!process_vm_unavailable && offset < max_size) {
+		length = page_size - ((src_tracee + offset) % page_size);
+		if (length > max_size - offset)
+			length = max_size - offset;
+
+		status = process_vm_read(tracee, dest_tracer + offset, src_tracee + offset, length);
+		if (status != (ssize_t) length)
+			break;
+
+		end = memchr(dest_tracer + offset, '\0', length);
+		if (end != NULL)
+			return end - dest_tracer + 1;
+
+		offset += length;
+	}
+
+	if (offset == max_size)
+		return max_size + 1;
+
+	/* The kernel refused this page, see what ptrace(2) gets.  */
+	result = read_string_ptrace(tracee, dest_tracer + offset, src_tracee + offset, max_size - offset);
+	if (result < 0)
+		return result;
+
+	return offset + result;
+}
+
 /**
  * Return the value of the word at the given @address in the @tracee's
  * memory space.  The caller must test errno to check if an error
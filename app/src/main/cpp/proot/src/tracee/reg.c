@@ -156,7 +156,7 @@ void poke_reg(Tracee *tracee, Reg reg, word_t value)
  */
 void print_current_regs(Tracee *tracee, int verbose_level, const char *message)
 {
-	if (tracee->verbose < verbose_level)
+	if (verbose_level > VERBOSE_MAX_LEVEL || tracee->verbose < verbose_level)
 		return;
 
 	note(tracee, INFO, INTERNAL,
@@ -207,9 +207,21 @@ int fetch_regs(Tracee *tracee)
 	if (status < 0)
 		return status;
 
+	memcpy(&tracee->_regs[FETCHED], &tracee->_regs[CURRENT], sizeof(tracee->_regs[CURRENT]));
+
 	return 0;
 }
 
+/**
+ * Forget the values of @tracee's registers as known by the kernel,
+ * since they were changed behind PRoot's back (ptrace emulation).
+ * This ensures the next push_regs() writes them back.
+ */
+void invalidate_fetched_regs(Tracee *tracee)
+{
+	memset(&tracee->_regs[FETCHED], 0xFF, sizeof(tracee->_regs[FETCHED]));
+}
+
 int push_specific_regs(Tracee *tracee, bool including_sysnum)
 {
 	int status;
@@ -256,7 +268,12 @@ int push_specific_regs(Tracee *tracee, bool including_sysnum)
 			}
 		}
 
-		/* Update other registers.  */
+		/* Update other registers, unless the process already
+		 * has these values -- for instance when what was
+		 * restored is what the kernel left.  */
+		if (memcmp(&tracee->_regs[CURRENT], &tracee->_regs[FETCHED], sizeof(tracee->_regs[CURRENT])) == 0)
+			return 0;
+
 		regs.iov_base = &tracee->_regs[CURRENT];
 		regs.iov_len  = sizeof(tracee->_regs[CURRENT]);
 
@@ -274,10 +291,15 @@ int push_specific_regs(Tracee *tracee, bool including_sysnum)
 			}
 		}
 
+		if (memcmp(&tracee->_regs[CURRENT], &tracee->_regs[FETCHED], sizeof(tracee->_regs[CURRENT])) == 0)
+			return 0;
+
 		status = ptrace(PTRACE_SETREGS, tracee->pid, NULL, &tracee->_regs[CURRENT]);
 #endif
 		if (status < 0)
 			return status;
+
+		memcpy(&tracee->_regs[FETCHED], &tracee->_regs[CURRENT], sizeof(tracee->_regs[CURRENT]));
 	}
 
 	return 0;
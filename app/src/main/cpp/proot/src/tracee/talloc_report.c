@@ -0,0 +1,408 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdio.h>      /* fprintf(3), fopen(3), */
+#include <stdlib.h>     /* getenv(3), malloc(3), qsort(3), */
+#include <string.h>     /* strcmp(3), strchr(3), strdup(3), */
+#include <signal.h>     /* sig_atomic_t, */
+#include <inttypes.h>   /* PRI*, */
+#include <talloc.h>     /* talloc_*, */
+
+#include "tracee/talloc_report.h"
+#include "tracee/tracee.h"
+#include "attribute.h"
+
+/* How many names the growth section of a report lists.  */
+#define TALLOC_REPORT_GROWTH_TOP 16
+
+/* Chunks are accounted per name.  talloc() and talloc_zero() name
+ * chunks after their type, the size based allocators after their
+ * source location, and the string ones after their content: all of
+ * those are accounted under a single "<strings>" name.  */
+typedef enum {
+	KIND_TYPE,
+	KIND_SITE,
+	KIND_STRING,
+} ChunkKind;
+
+typedef struct {
+	char *name;
+	ChunkKind kind;
+	size_t bytes;
+	size_t blocks;
+	/* Figures of the previous report, for the growth section.  */
+	size_t previous_bytes;
+	size_t previous_blocks;
+} ReportEntry;
+
+typedef struct {
+	pid_t pid;
+	size_t bytes;
+	size_t blocks;
+} TraceeEntry;
+
+bool talloc_report_enabled = false;
+
+/* The report tables are allocated with malloc(3), not talloc, so
+ * they don't appear in the reports themselves.  */
+static ReportEntry *entries = NULL;
+static size_t nb_entries = 0;
+static size_t max_entries = 0;
+
+/* Open addressing index of entries[] by name, each slot holds an
+ * index + 1, or 0 when empty.  */
+static size_t *index_slots = NULL;
+static size_t nb_index_slots = 0;
+
+static TraceeEntry *tracee_entries = NULL;
+static size_t nb_tracee_entries = 0;
+static size_t max_tracee_entries = 0;
+
+/* Number of reports written so far.  */
+static unsigned int nb_reports = 0;
+
+/* Where the report is written, stderr if NULL.  */
+static const char *report_path = NULL;
+
+static volatile sig_atomic_t report_requested = 0;
+
+/**
+ * Enable the structured talloc reports if PROOT_TALLOC_REPORT is
+ * defined.  If its value is an absolute path, reports are appended
+ * to this file, otherwise they are printed on stderr.
+ */
+void init_talloc_report(void)
+{
+	const char *value = getenv("PROOT_TALLOC_REPORT");
+
+	if (value == NULL)
+		return;
+
+	talloc_report_enabled = true;
+	if (value[0] == '/')
+		report_path = value;
+}
+
+/**
+ * Ask for a report at the next call to print_talloc_report().  This
+ * function is async-signal-safe.
+ */
+void request_talloc_report(void)
+{
+	report_requested = 1;
+}
+
+/**
+ * Return the FNV-1a hash of @name.
+ */
+static size_t hash_name(const char *name)
+{
+	size_t hash = 2166136261u;
+
+	for (; *name != '\0'; name++)
+		hash = (hash ^ (unsigned char) *name) * 16777619u;
+
+	return hash;
+}
+
+/**
+ * Rebuild index_slots[] with twice as many slots.  This function
+ * returns false if there's not enough memory.
+ */
+static bool grow_index(void)
+{
+	size_t nb_slots = nb_index_slots != 0 ? 2 * nb_index_slots : 256;
+	size_t *slots;
+	size_t i;
+
+	slots = calloc(nb_slots, sizeof(size_t));
+	if (slots == NULL)
+		return false;
+
+	for (i = 0; i < nb_entries; i++) {
+		size_t slot = hash_name(entries[i].name) & (nb_slots - 1);
+
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (nb_slots - 1);
+		slots[slot] = i + 1;
+	}
+
+	free(index_slots);
+	index_slots = slots;
+	nb_index_slots = nb_slots;
+	return true;
+}
+
+/**
+ * Return the entry named @name, creating it with the given @kind if
+ * needed.  This function returns NULL if there's not enough memory.
+ */
+static ReportEntry *get_entry(const char *name, ChunkKind kind)
+{
+	ReportEntry *entry;
+	size_t slot;
+
+	/* Keep the index at most half full.  */
+	if (2 * (nb_entries + 1) > nb_index_slots && !grow_index())
+		return NULL;
+
+	slot = hash_name(name) & (nb_index_slots - 1);
+	while (index_slots[slot] != 0) {
+		entry = &entries[index_slots[slot] - 1];
+		if (strcmp(entry->name, name) == 0)
+			return entry;
+		slot = (slot + 1) & (nb_index_slots - 1);
+	}
+
+	if (nb_entries == max_entries) {
+		size_t max = max_entries != 0 ? 2 * max_entries : 128;
+
+		entry = realloc(entries, max * sizeof(ReportEntry));
+		if (entry == NULL)
+			return NULL;
+		entries = entry;
+		max_entries = max;
+	}
+
+	entry = &entries[nb_entries];
+	memset(entry, 0, sizeof(ReportEntry));
+	entry->name = strdup(name);
+	if (entry->name == NULL)
+		return NULL;
+	entry->kind = kind;
+
+	index_slots[slot] = ++nb_entries;
+	return entry;
+}
+
+/**
+ * Append the figures of @tracee to tracee_entries[].
+ */
+static void add_tracee_entry(const Tracee *tracee)
+{
+	TraceeEntry *entry;
+
+	if (nb_tracee_entries == max_tracee_entries) {
+		size_t max = max_tracee_entries != 0 ? 2 * max_tracee_entries : 16;
+
+		entry = realloc(tracee_entries, max * sizeof(TraceeEntry));
+		if (entry == NULL)
+			return;
+		tracee_entries = entry;
+		max_tracee_entries = max;
+	}
+
+	entry = &tracee_entries[nb_tracee_entries++];
+	entry->pid = tracee->pid;
+	entry->bytes = talloc_total_size(tracee);
+	entry->blocks = talloc_total_blocks(tracee);
+}
+
+/**
+ * Helper for print_talloc_report(): account for the chunk @ptr.
+ * References are skipped, their chunk is accounted under its
+ * parent.
+ */
+static void account_chunk(const void *ptr, int depth, int max_depth UNUSED,
+			int is_ref, void *data UNUSED)
+{
+	ReportEntry *entry;
+	const char *name;
+	ChunkKind kind;
+
+	if (depth == 0 || is_ref)
+		return;
+
+	name = talloc_get_name(ptr);
+	if (name == ptr) {
+		name = "<strings>";
+		kind = KIND_STRING;
+	}
+	else if (strchr(name, ':') != NULL)
+		kind = KIND_SITE;
+	else
+		kind = KIND_TYPE;
+
+	entry = get_entry(name, kind);
+	if (entry == NULL)
+		return;
+
+	entry->bytes += talloc_get_size(ptr);
+	entry->blocks++;
+
+	if (strcmp(name, "Tracee") == 0)
+		add_tracee_entry(ptr);
+}
+
+/**
+ * Helper for print_talloc_report(): sort by decreasing size.
+ */
+static int compare_entries_by_size(const void *a, const void *b)
+{
+	const ReportEntry *entry_a = &entries[*(const size_t *) a];
+	const ReportEntry *entry_b = &entries[*(const size_t *) b];
+
+	if (entry_a->bytes != entry_b->bytes)
+		return (entry_a->bytes < entry_b->bytes ? 1 : -1);
+
+	return strcmp(entry_a->name, entry_b->name);
+}
+
+/**
+ * Return how many bytes @entry grew since the previous report.
+ */
+static int64_t entry_growth(const ReportEntry *entry)
+{
+	return (int64_t) entry->bytes - (int64_t) entry->previous_bytes;
+}
+
+/**
+ * Helper for print_talloc_report(): sort by decreasing growth.
+ */
+static int compare_entries_by_growth(const void *a, const void *b)
+{
+	const ReportEntry *entry_a = &entries[*(const size_t *) a];
+	const ReportEntry *entry_b = &entries[*(const size_t *) b];
+
+	if (entry_growth(entry_a) != entry_growth(entry_b))
+		return (entry_growth(entry_a) < entry_growth(entry_b) ? 1 : -1);
+
+	return strcmp(entry_a->name, entry_b->name);
+}
+
+/**
+ * Helper for print_talloc_report(): sort by decreasing size.
+ */
+static int compare_tracee_entries(const void *a, const void *b)
+{
+	const TraceeEntry *entry_a = a;
+	const TraceeEntry *entry_b = b;
+
+	if (entry_a->bytes != entry_b->bytes)
+		return (entry_a->bytes < entry_b->bytes ? 1 : -1);
+
+	return entry_a->pid - entry_b->pid;
+}
+
+static const char *const kind_names[] = {
+	[KIND_TYPE]   = "type",
+	[KIND_SITE]   = "site",
+	[KIND_STRING] = "string",
+};
+
+/**
+ * Write a report of the memory allocated with talloc, per talloc
+ * name, per tracee, and the names that grew most since the previous
+ * report, unless @only_if_requested is true and no report was
+ * requested by request_talloc_report().
+ */
+void print_talloc_report(bool only_if_requested)
+{
+	size_t total_bytes = 0;
+	size_t total_blocks = 0;
+	size_t *order = NULL;
+	size_t nb_grown = 0;
+	FILE *file = stderr;
+	size_t i;
+
+	if (!talloc_report_enabled || (only_if_requested && !report_requested))
+		return;
+	report_requested = 0;
+
+	for (i = 0; i < nb_entries; i++) {
+		entries[i].previous_bytes = entries[i].bytes;
+		entries[i].previous_blocks = entries[i].blocks;
+		entries[i].bytes = 0;
+		entries[i].blocks = 0;
+	}
+	nb_tracee_entries = 0;
+
+	/* The null context is tracked since talloc_enable_leak_report()
+	 * is called at startup, so this walks every live chunk.  */
+	talloc_report_depth_cb(NULL, 0, -1, account_chunk, NULL);
+
+	if (nb_entries != 0) {
+		order = malloc(nb_entries * sizeof(size_t));
+		if (order == NULL)
+			return;
+	}
+
+	for (i = 0; i < nb_entries; i++) {
+		order[i] = i;
+		total_bytes += entries[i].bytes;
+		total_blocks += entries[i].blocks;
+	}
+	nb_reports++;
+
+	if (report_path != NULL) {
+		file = fopen(report_path, "a");
+		if (file == NULL)
+			file = stderr;
+	}
+
+	fprintf(file, "proot talloc report %u: %zu bytes in %zu blocks, %zu tracees\n",
+		nb_reports, total_bytes, total_blocks, nb_tracee_entries);
+
+	qsort(order, nb_entries, sizeof(size_t), compare_entries_by_size);
+
+	fprintf(file, "%-32s %-6s %12s %10s\n", "name", "kind", "bytes", "blocks");
+	for (i = 0; i < nb_entries && entries[order[i]].blocks != 0; i++) {
+		const ReportEntry *entry = &entries[order[i]];
+
+		fprintf(file, "%-32s %-6s %12zu %10zu\n",
+			entry->name, kind_names[entry->kind], entry->bytes, entry->blocks);
+	}
+
+	qsort(tracee_entries, nb_tracee_entries, sizeof(TraceeEntry), compare_tracee_entries);
+
+	fprintf(file, "%-32s %-6s %12s %10s\n", "tracee", "", "bytes", "blocks");
+	for (i = 0; i < nb_tracee_entries; i++)
+		fprintf(file, "pid %-28d %-6s %12zu %10zu\n", tracee_entries[i].pid, "",
+			tracee_entries[i].bytes, tracee_entries[i].blocks);
+
+	qsort(order, nb_entries, sizeof(size_t), compare_entries_by_growth);
+
+	if (nb_reports == 1)
+		fprintf(file, "%-32s %-6s %12s %10s\n", "growth since start", "kind", "bytes", "blocks");
+	else
+		fprintf(file, "growth since report %-12u %-6s %12s %10s\n", nb_reports - 1,
+			"kind", "bytes", "blocks");
+
+	for (i = 0; i < nb_entries && nb_grown < TALLOC_REPORT_GROWTH_TOP; i++) {
+		const ReportEntry *entry = &entries[order[i]];
+
+		if (entry_growth(entry) <= 0)
+			break;
+
+		fprintf(file, "%-32s %-6s %+12" PRId64 " %+10" PRId64 "\n",
+			entry->name, kind_names[entry->kind], entry_growth(entry),
+			(int64_t) entry->blocks - (int64_t) entry->previous_blocks);
+		nb_grown++;
+	}
+
+	free(order);
+
+	if (file != stderr)
+		fclose(file);
+	else
+		fflush(file);
+}
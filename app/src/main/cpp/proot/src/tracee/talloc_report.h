@@ -0,0 +1,35 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef TALLOC_REPORT_H
+#define TALLOC_REPORT_H
+
+#include <stdbool.h>
+
+/* Set when PROOT_TALLOC_REPORT is defined, see init_talloc_report().  */
+extern bool talloc_report_enabled;
+
+extern void init_talloc_report(void);
+extern void request_talloc_report(void);
+extern void print_talloc_report(bool only_if_requested);
+
+#endif /* TALLOC_REPORT_H */
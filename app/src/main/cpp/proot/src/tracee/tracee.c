@@ -24,7 +24,7 @@
 #include <sys/types.h>  /* pid_t, size_t, */
 #include <stdlib.h>     /* NULL, */
 #include <assert.h>     /* assert(3), */
-#include <string.h>     /* bzero(3), */
+#include <string.h>     /* bzero(3), memcpy(3), */
 #include <stdbool.h>    /* bool, true, false, */
 #include <sys/queue.h>  /* LIST_*,  */
 #include <talloc.h>     /* talloc_*, */
@@ -47,6 +47,40 @@
 
 static Tracees tracees;
 
+/* Index of the tracees by pid, so the event loop doesn't walk the
+ * whole list on each stop.  */
+#define TRACEES_BY_PID_SIZE 256
+static Tracees tracees_by_pid[TRACEES_BY_PID_SIZE];
+
+/* Bounds of the pool each tracee allocates its temporary memory
+ * from, see reset_memory_collector().  */
+#define SCRATCH_POOL_MIN_SIZE (16 * 1024)
+#define SCRATCH_POOL_MAX_SIZE (256 * 1024)
+
+/* Largest memory collector seen so far, new pools are sized after
+ * it.  */
+static size_t scratch_peak;
+
+/**
+ * Return the size of a pool with enough room for @usage bytes of
+ * temporary memory: twice as much, to account for the talloc headers,
+ * rounded up to a power of two.
+ */
+static size_t scratch_pool_size(size_t usage)
+{
+	size_t size = SCRATCH_POOL_MIN_SIZE;
+
+	while (size < 2 * usage && size < SCRATCH_POOL_MAX_SIZE)
+		size *= 2;
+
+	return size;
+}
+
+static inline Tracees *tracees_by_pid_bucket(pid_t pid)
+{
+	return &tracees_by_pid[(unsigned int) pid % TRACEES_BY_PID_SIZE];
+}
+
 
 /**
  * Remove @zombie from its parent's list of zombies.  Note: this is a
@@ -88,6 +122,7 @@ static int remove_tracee(Tracee *tracee)
 	int event;
 
 	LIST_REMOVE(tracee, link);
+	LIST_REMOVE(tracee, pid_link);
 
 	/* Clean objects that are linked to this tracee's life
 	 * span.  */
@@ -203,6 +238,38 @@ no_mem:
 	return NULL;
 }
 
+/**
+ * Flush then allocate a new memory collector for @tracee.  Once all
+ * the temporary allocations are freed, the scratch pool is reused
+ * from its beginning by talloc.  The pool is re-allocated bigger if
+ * the collector outgrew it, so the next stops don't fall back to
+ * malloc(3) for the overflow.
+ */
+static void reset_memory_collector(Tracee *tracee)
+{
+	size_t usage;
+
+	if (tracee->scratch != NULL && tracee->ctx != NULL) {
+		usage = talloc_total_size(tracee->ctx);
+		if (usage > scratch_peak)
+			scratch_peak = usage;
+
+		TALLOC_FREE(tracee->ctx);
+
+		/* Objects reparented out of the old pool keep its
+		 * memory until they are freed, this is handled by
+		 * talloc.  */
+		if (scratch_pool_size(usage) > tracee->scratch_size) {
+			TALLOC_FREE(tracee->scratch);
+			tracee->scratch_size = scratch_pool_size(usage);
+			tracee->scratch = talloc_pool(tracee, tracee->scratch_size);
+		}
+	}
+
+	TALLOC_FREE(tracee->ctx);
+	tracee->ctx = talloc_new(tracee->scratch != NULL ? tracee->scratch : tracee);
+}
+
 /**
  * Allocate a new entry for the tracee @pid, then set its destructor
  * and add it to the list of tracees.  This function returns NULL if
@@ -222,9 +289,15 @@ static Tracee *new_tracee(pid_t pid)
 	tracee->pid = pid;
 
 	LIST_INSERT_HEAD(&tracees, tracee, link);
+	LIST_INSERT_HEAD(tracees_by_pid_bucket(pid), tracee, pid_link);
 
 	tracee->life_context = talloc_new(tracee);
 
+	/* Not fatal, temporary allocations are then regular chunks.  */
+	tracee->scratch_size = scratch_pool_size(scratch_peak);
+	tracee->scratch = talloc_pool(tracee, tracee->scratch_size);
+	reset_memory_collector(tracee);
+
 	return tracee;
 }
 
@@ -323,11 +396,9 @@ Tracee *get_tracee(const Tracee *current_tracee, pid_t pid, bool create)
 	if (current_tracee != NULL && current_tracee->pid == pid)
 		return (Tracee *)current_tracee;
 
-	LIST_FOREACH(tracee, &tracees, link) {
+	LIST_FOREACH(tracee, tracees_by_pid_bucket(pid), pid_link) {
 		if (tracee->pid == pid) {
-			/* Flush then allocate a new memory collector.  */
-			TALLOC_FREE(tracee->ctx);
-			tracee->ctx = talloc_new(tracee);
+			reset_memory_collector(tracee);
 
 			return tracee;
 		}
@@ -336,6 +407,17 @@ Tracee *get_tracee(const Tracee *current_tracee, pid_t pid, bool create)
 	return (create ? new_tracee(pid) : NULL);
 }
 
+/**
+ * Change the pid of @tracee, an entry returned by get_tracee(), to
+ * @pid.
+ */
+void set_tracee_pid(Tracee *tracee, pid_t pid)
+{
+	LIST_REMOVE(tracee, pid_link);
+	tracee->pid = pid;
+	LIST_INSERT_HEAD(tracees_by_pid_bucket(pid), tracee, pid_link);
+}
+
 /**
  * Mark tracee as terminated and optionally take action.
  */
@@ -441,12 +523,16 @@ int new_child(Tracee *parent, word_t clone_flags)
 	 *
 	 * -- clone(2) man-page
 	 */
-	TALLOC_FREE(child->heap);
-	child->heap = ((clone_flags & CLONE_VM) != 0)
-		? talloc_reference(child, parent->heap)
-		: talloc_memdup(child, parent->heap, sizeof(Heap));
-	if (child->heap == NULL)
-		return -ENOMEM;
+	if ((clone_flags & CLONE_VM) != 0) {
+		TALLOC_FREE(child->heap);
+		child->heap = talloc_reference(child, parent->heap);
+		if (child->heap == NULL)
+			return -ENOMEM;
+	}
+	else {
+		/* Reuse the heap allocated with the child.  */
+		memcpy(child->heap, parent->heap, sizeof(Heap));
+	}
 
 	child->load_info = talloc_reference(child, parent->load_info);
 
@@ -509,21 +595,19 @@ int new_child(Tracee *parent, word_t clone_flags)
 	 *
 	 * -- clone(2) man-page
 	 */
-	TALLOC_FREE(child->fs);
 	if ((clone_flags & CLONE_FS) != 0) {
 		/* File-system name-space is shared.  */
+		TALLOC_FREE(child->fs);
 		child->fs = talloc_reference(child, parent->fs);
 	}
 	else {
-		/* File-system name-space is copied.  */
-		child->fs = talloc_zero(child, FileSystemNameSpace);
-		if (child->fs == NULL)
-			return -ENOMEM;
-
-		child->fs->cwd = talloc_strdup(child->fs, parent->fs->cwd);
+		/* File-system name-space is copied, into the empty
+		 * one allocated with the child.  The working
+		 * directory is unshared only once one of them calls
+		 * chdir(2), see translate_syscall_enter().  */
+		child->fs->cwd = talloc_reference(child->fs, parent->fs->cwd);
 		if (child->fs->cwd == NULL)
 			return -ENOMEM;
-		talloc_set_name_const(child->fs->cwd, "$cwd");
 
 		/* Bindings are shared across file-system name-spaces since a
 		 * "mount --bind" made by a process affects all other processes
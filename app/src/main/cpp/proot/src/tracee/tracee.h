@@ -39,12 +39,16 @@ typedef enum {
 	ORIGINAL = 1,
 	MODIFIED = 2,
 	ORIGINAL_SECCOMP_REWRITE = 3,
+	FETCHED  = 4,	/* As known by the kernel, see push_specific_regs().  */
 	NB_REG_VERSION
 } RegVersion;
 
 struct bindings;
+struct binding_node;
 struct load_info;
 struct chained_syscalls;
+struct glue_entry;
+struct proc_cache;
 
 /* Information related to a file-system name-space.  */
 typedef struct {
@@ -59,6 +63,14 @@ typedef struct {
 		struct bindings *host;
 	} bindings;
 
+	/* Prefix trees of the two lists above, built on demand by
+	 * get_binding() and rebuilt once a list of bindings changed.  */
+	struct {
+		struct binding_node *guest;
+		struct binding_node *host;
+		unsigned int generation;
+	} binding_trees;
+
 	/* Current working directory, à la /proc/self/pwd.  */
 	char *cwd;
 } FileSystemNameSpace;
@@ -67,6 +79,7 @@ typedef struct {
 typedef struct {
 	word_t base;
 	size_t size;
+	size_t reserved;
 	bool disabled;
 } Heap;
 
@@ -79,6 +92,10 @@ typedef struct tracee {
 	/* Link for the list of all tracees.  */
 	LIST_ENTRY(tracee) link;
 
+	/* Link for the bucket of tracees sharing the same pid hash,
+	 * see get_tracee().  */
+	LIST_ENTRY(tracee) pid_link;
+
 	/* Process identifier. */
 	pid_t pid;
 
@@ -167,6 +184,12 @@ typedef struct tracee {
 	 * allocations.  */
 	TALLOC_CTX *ctx;
 
+	/* Pool @ctx is allocated from, if any, so these temporary
+	 * allocations don't go through malloc(3)/free(3) on each
+	 * stop.  */
+	TALLOC_CTX *scratch;
+	size_t scratch_size;
+
 	/* Context used to collect all dynamic memory allocations that
 	 * should be released once this tracee is freed.  */
 	TALLOC_CTX *life_context;
@@ -179,6 +202,15 @@ typedef struct tracee {
 	 * defined in bind_path() then used in build_glue().  */
 	mode_t glue_type;
 
+	/* Components of the glue built so far, their type is served
+	 * from here instead of lstat(2) while the bindings are
+	 * initialized, see build_glue().  */
+	struct glue_entry *glue_entries;
+
+	/* Translations of "/proc/self" links and detranslated copy of
+	 * "/proc/<PID>/maps", see path/proc.c.  */
+	struct proc_cache *proc_cache;
+
 	/* During a sub-reconfiguration, the new setup is relatively
 	 * to @tracee's file-system name-space.  Also, @paths holds
 	 * its $PATH environment variable in order to emulate the
@@ -271,5 +303,6 @@ extern void kill_all_tracees();
 
 typedef LIST_HEAD(tracees, tracee) Tracees;
 extern Tracees *get_tracees_list_head();
+extern void set_tracee_pid(Tracee *tracee, pid_t pid);
 
 #endif /* TRACEE_H */
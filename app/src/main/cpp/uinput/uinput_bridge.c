@@ -4,9 +4,12 @@
  * Native uinput bridge for creating virtual Xbox 360 controller on Android
  *
  * Architecture:
- * - Creates virtual input device via Linux /dev/uinput
+ * - Creates virtual input devices via Linux /dev/uinput (one fd per device)
+ * - Up to MAX_CONTROLLERS pads, addressed by the handle returned on creation
  * - Emulates Xbox 360 controller (VID: 0x045e, PID: 0x028e)
  * - Sends button events (EV_KEY) and axis events (EV_ABS)
+ * - Accepts FF_RUMBLE effects (EV_FF), serviced by uinput_ff.c
+ * - Optional motion sensor companion device, fed by uinput_motion.c
  * - No root required (works with Android 8+ targetSdk 28)
  *
  * Performance:
@@ -24,63 +27,134 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <dlfcn.h>
 #include <android/log.h>
 
+#include "native_trace.h"
+
 #define TAG "uinput_bridge"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
 
-// Global file descriptor for /dev/uinput
-static int uinput_fd = -1;
+#define MAX_CONTROLLERS 4
+#define MAX_FF_EFFECTS 16
+
+// Button and axis order used by uinput_send_state()
+static const int button_codes[] = {
+    BTN_A, BTN_B, BTN_X, BTN_Y,
+    BTN_TL, BTN_TR,
+    BTN_SELECT, BTN_START, BTN_MODE,
+    BTN_THUMBL, BTN_THUMBR
+};
+
+static const int axis_codes[] = {
+    ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y
+};
+
+#define NUM_BUTTONS (sizeof(button_codes) / sizeof(button_codes[0]))
+#define NUM_AXES (sizeof(axis_codes) / sizeof(axis_codes[0]))
+
+// One virtual pad; buttons/axes are the last state reported to the kernel,
+// diffed against by uinput_send_state(). lock serializes the Java callers
+// against the evdev passthrough thread (uinput_passthrough.c)
+typedef struct uinput_device {
+    int fd;
+    int buttons;
+    int axes[NUM_AXES];
+    pthread_mutex_t lock;
+} uinput_device;
+
+static uinput_device devices[MAX_CONTROLLERS] = {
+    [0 ... MAX_CONTROLLERS - 1] = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER}
+};
+
+extern void uinput_passthrough_stop(int controller_id);
+extern void uinput_motion_stop(int controller_id);
+extern int uinput_ff_start(int controller_id, int fd);
+extern void uinput_ff_stop(int controller_id);
+
+// Input-to-photon statistics live in libwinlator (latency_stats.c)
+#define LATENCY_STAGE_INPUT 0
+static void (*latency_mark)(int) = NULL;
+
+// Opened by uinput_init() to check access, used by the next created controller
+static int pending_fd = -1;
+
+static uinput_device* get_device(int controller_id) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS || devices[controller_id].fd < 0) {
+        LOGE("Invalid controller id %d", controller_id);
+        return NULL;
+    }
+    return &devices[controller_id];
+}
 
 /**
- * Initialize uinput device
- * Opens /dev/uinput with O_WRONLY | O_NONBLOCK
- *
- * @return 0 on success, -1 on failure
+ * @return Bit index of button_code in the uinput_send_state() bitmask, -1 if not mapped
  */
-int uinput_init() {
-    if (uinput_fd >= 0) {
-        LOGI("uinput already initialized (fd=%d)", uinput_fd);
-        return 0;
+int uinput_button_index(int button_code) {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        if (button_codes[i] == button_code) return i;
     }
+    return -1;
+}
 
-    uinput_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (uinput_fd < 0) {
+/**
+ * @return Index of axis_code in the uinput_send_state() axes array, -1 if not mapped
+ */
+int uinput_axis_index(int axis_code) {
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (axis_codes[i] == axis_code) return i;
+    }
+    return -1;
+}
+
+static void mark_input_latency() {
+    // Looked up until libwinlator is loaded, then cached
+    if (!latency_mark) {
+        void* handle = dlopen("libwinlator.so", RTLD_NOW | RTLD_NOLOAD);
+        if (!handle) return;
+        latency_mark = (void (*)(int))dlsym(handle, "LatencyStats_mark");
+        if (!latency_mark) return;
+    }
+    latency_mark(LATENCY_STAGE_INPUT);
+}
+
+static int open_uinput() {
+    // Read access is needed for the force-feedback requests (uinput_ff.c)
+    int fd = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
         LOGE("Failed to open /dev/uinput: %s (errno=%d)", strerror(errno), errno);
         LOGE("Possible causes:");
         LOGE("  1. SELinux policy denial (requires targetSdk <= 28)");
         LOGE("  2. /dev/uinput does not exist");
         LOGE("  3. Permission denied (check ls -l /dev/uinput)");
-        return -1;
     }
-
-    LOGI("uinput initialized successfully (fd=%d)", uinput_fd);
-    return 0;
+    return fd;
 }
 
 /**
- * Create virtual Xbox 360 controller
- *
- * Xbox 360 controller capabilities:
- * - Buttons: A, B, X, Y, LB, RB, Back, Start, Xbox, LS, RS (11 buttons)
- * - Axes: Left stick (X, Y), Right stick (RX, RY), Triggers (Z, RZ), D-pad (HAT0X, HAT0Y)
- * - Vendor ID: 0x045e (Microsoft)
- * - Product ID: 0x028e (Xbox 360 Controller)
+ * Initialize uinput device
+ * Opens /dev/uinput with O_RDWR | O_NONBLOCK
  *
- * @param name Device name (e.g., "Steam Deck Mobile Controller")
- * @param vendor_id Vendor ID (0x045e for Xbox)
- * @param product_id Product ID (0x028e for Xbox 360)
  * @return 0 on success, -1 on failure
  */
-int uinput_create_xbox360_controller(const char* name, int vendor_id, int product_id) {
-    if (uinput_fd < 0) {
-        LOGE("uinput not initialized (call uinput_init first)");
-        return -1;
+int uinput_init() {
+    if (pending_fd >= 0) {
+        LOGI("uinput already initialized (fd=%d)", pending_fd);
+        return 0;
     }
 
+    pending_fd = open_uinput();
+    if (pending_fd < 0) return -1;
+
+    LOGI("uinput initialized successfully (fd=%d)", pending_fd);
+    return 0;
+}
+
+static int setup_xbox360_controller(int fd, const char* name, int vendor_id, int product_id) {
     // Enable EV_KEY (buttons) event type
-    if (ioctl(uinput_fd, UI_SET_EVBIT, EV_KEY) < 0) {
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) {
         LOGE("Failed to enable EV_KEY: %s", strerror(errno));
         return -1;
     }
@@ -91,22 +165,21 @@ int uinput_create_xbox360_controller(const char* name, int vendor_id, int produc
     // BTN_SELECT=0x13a (314, Back), BTN_START=0x13b (315, Start)
     // BTN_MODE=0x13c (316, Xbox button)
     // BTN_THUMBL=0x13d (317, LS), BTN_THUMBR=0x13e (318, RS)
-    int button_codes[] = {
-        BTN_A, BTN_B, BTN_X, BTN_Y,
-        BTN_TL, BTN_TR,
-        BTN_SELECT, BTN_START, BTN_MODE,
-        BTN_THUMBL, BTN_THUMBR
-    };
-
-    for (int i = 0; i < sizeof(button_codes) / sizeof(button_codes[0]); i++) {
-        if (ioctl(uinput_fd, UI_SET_KEYBIT, button_codes[i]) < 0) {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        if (ioctl(fd, UI_SET_KEYBIT, button_codes[i]) < 0) {
             LOGE("Failed to enable button %d: %s", button_codes[i], strerror(errno));
             return -1;
         }
     }
 
+    // Enable EV_FF with rumble (strong/weak motor), like xpad
+    if (ioctl(fd, UI_SET_EVBIT, EV_FF) < 0 || ioctl(fd, UI_SET_FFBIT, FF_RUMBLE) < 0) {
+        LOGE("Failed to enable FF_RUMBLE: %s", strerror(errno));
+        return -1;
+    }
+
     // Enable EV_ABS (absolute axes) event type
-    if (ioctl(uinput_fd, UI_SET_EVBIT, EV_ABS) < 0) {
+    if (ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0) {
         LOGE("Failed to enable EV_ABS: %s", strerror(errno));
         return -1;
     }
@@ -125,28 +198,28 @@ int uinput_create_xbox360_controller(const char* name, int vendor_id, int produc
     abs_setup.absinfo.fuzz = 16;
     abs_setup.absinfo.flat = 128;
     abs_setup.absinfo.value = 0;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_X: %s", strerror(errno));
         return -1;
     }
 
     // Left stick Y
     abs_setup.code = ABS_Y;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_Y: %s", strerror(errno));
         return -1;
     }
 
     // Right stick X
     abs_setup.code = ABS_RX;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_RX: %s", strerror(errno));
         return -1;
     }
 
     // Right stick Y
     abs_setup.code = ABS_RY;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_RY: %s", strerror(errno));
         return -1;
     }
@@ -157,14 +230,14 @@ int uinput_create_xbox360_controller(const char* name, int vendor_id, int produc
     abs_setup.absinfo.maximum = 255;
     abs_setup.absinfo.fuzz = 0;
     abs_setup.absinfo.flat = 0;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_Z: %s", strerror(errno));
         return -1;
     }
 
     // Right trigger (RZ)
     abs_setup.code = ABS_RZ;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_RZ: %s", strerror(errno));
         return -1;
     }
@@ -175,14 +248,14 @@ int uinput_create_xbox360_controller(const char* name, int vendor_id, int produc
     abs_setup.absinfo.maximum = 1;
     abs_setup.absinfo.fuzz = 0;
     abs_setup.absinfo.flat = 0;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_HAT0X: %s", strerror(errno));
         return -1;
     }
 
     // D-pad Y (HAT0Y)
     abs_setup.code = ABS_HAT0Y;
-    if (ioctl(uinput_fd, UI_ABS_SETUP, &abs_setup) < 0) {
+    if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
         LOGE("Failed to setup ABS_HAT0Y: %s", strerror(errno));
         return -1;
     }
@@ -195,37 +268,93 @@ int uinput_create_xbox360_controller(const char* name, int vendor_id, int produc
     usetup.id.vendor = vendor_id;
     usetup.id.product = product_id;
     usetup.id.version = 1;
+    usetup.ff_effects_max = MAX_FF_EFFECTS;
 
     strncpy(usetup.name, name, UINPUT_MAX_NAME_SIZE - 1);
     usetup.name[UINPUT_MAX_NAME_SIZE - 1] = '\0';
 
-    if (ioctl(uinput_fd, UI_DEV_SETUP, &usetup) < 0) {
+    if (ioctl(fd, UI_DEV_SETUP, &usetup) < 0) {
         LOGE("Failed to setup device: %s", strerror(errno));
         return -1;
     }
 
     // Create the device
-    if (ioctl(uinput_fd, UI_DEV_CREATE) < 0) {
+    if (ioctl(fd, UI_DEV_CREATE) < 0) {
         LOGE("Failed to create device: %s", strerror(errno));
         return -1;
     }
 
-    LOGI("Xbox 360 controller created: %s (VID=0x%04x, PID=0x%04x)", name, vendor_id, product_id);
     return 0;
 }
 
+/**
+ * Create virtual Xbox 360 controller
+ *
+ * Xbox 360 controller capabilities:
+ * - Buttons: A, B, X, Y, LB, RB, Back, Start, Xbox, LS, RS (11 buttons)
+ * - Axes: Left stick (X, Y), Right stick (RX, RY), Triggers (Z, RZ), D-pad (HAT0X, HAT0Y)
+ * - Vendor ID: 0x045e (Microsoft)
+ * - Product ID: 0x028e (Xbox 360 Controller)
+ *
+ * @param name Device name (e.g., "Steam Deck Mobile Controller")
+ * @param vendor_id Vendor ID (0x045e for Xbox)
+ * @param product_id Product ID (0x028e for Xbox 360)
+ * @return Controller id (0 to MAX_CONTROLLERS - 1) on success, -1 on failure
+ */
+int uinput_create_xbox360_controller(const char* name, int vendor_id, int product_id) {
+    int controller_id = -1;
+    for (int i = 0; i < MAX_CONTROLLERS; i++) {
+        if (devices[i].fd < 0) {
+            controller_id = i;
+            break;
+        }
+    }
+    if (controller_id < 0) {
+        LOGE("No free controller slot (max %d)", MAX_CONTROLLERS);
+        return -1;
+    }
+
+    // Each uinput fd carries exactly one device
+    int fd = pending_fd;
+    pending_fd = -1;
+    if (fd < 0) fd = open_uinput();
+    if (fd < 0) return -1;
+
+    if (setup_xbox360_controller(fd, name, vendor_id, product_id) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Games block in EVIOCSFF until uploads are answered, so the reader must always run
+    if (uinput_ff_start(controller_id, fd) < 0) {
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+        return -1;
+    }
+
+    uinput_device* device = &devices[controller_id];
+    device->fd = fd;
+
+    // A new device starts released and centered
+    device->buttons = 0;
+    memset(device->axes, 0, sizeof(device->axes));
+
+    LOGI("Xbox 360 controller %d created: %s (VID=0x%04x, PID=0x%04x)", controller_id, name, vendor_id, product_id);
+    return controller_id;
+}
+
 /**
  * Send button event
  *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
  * @param button_code Xbox button code (e.g., BTN_A=0x130)
  * @param pressed 1 for press, 0 for release
  * @return 0 on success, -1 on failure
  */
-int uinput_send_button_event(int button_code, int pressed) {
-    if (uinput_fd < 0) {
-        LOGE("uinput not initialized");
-        return -1;
-    }
+int uinput_send_button_event(int controller_id, int button_code, int pressed) {
+    NATIVE_TRACE_SCOPE("uinput_send_button_event");
+    uinput_device* device = get_device(controller_id);
+    if (!device) return -1;
 
     struct input_event ev[2];
     memset(ev, 0, sizeof(ev));
@@ -240,26 +369,38 @@ int uinput_send_button_event(int button_code, int pressed) {
     ev[1].code = SYN_REPORT;
     ev[1].value = 0;
 
-    if (write(uinput_fd, ev, sizeof(ev)) < 0) {
+    pthread_mutex_lock(&device->lock);
+    if (write(device->fd, ev, sizeof(ev)) < 0) {
+        pthread_mutex_unlock(&device->lock);
         LOGE("Failed to send button event (code=%d, pressed=%d): %s", button_code, pressed, strerror(errno));
         return -1;
     }
 
+    // Keep the snapshot in sync for uinput_send_state()
+    int index = uinput_button_index(button_code);
+    if (index >= 0) {
+        if (pressed) device->buttons |= 1 << index;
+        else device->buttons &= ~(1 << index);
+    }
+    pthread_mutex_unlock(&device->lock);
+
+    mark_input_latency();
+
     return 0;
 }
 
 /**
  * Send axis event
  *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
  * @param axis_code evdev axis code (e.g., ABS_X=0x00)
  * @param value Axis value (-32768 to 32767 for sticks, 0-255 for triggers)
  * @return 0 on success, -1 on failure
  */
-int uinput_send_axis_event(int axis_code, int value) {
-    if (uinput_fd < 0) {
-        LOGE("uinput not initialized");
-        return -1;
-    }
+int uinput_send_axis_event(int controller_id, int axis_code, int value) {
+    NATIVE_TRACE_SCOPE("uinput_send_axis_event");
+    uinput_device* device = get_device(controller_id);
+    if (!device) return -1;
 
     struct input_event ev[2];
     memset(ev, 0, sizeof(ev));
@@ -274,29 +415,122 @@ int uinput_send_axis_event(int axis_code, int value) {
     ev[1].code = SYN_REPORT;
     ev[1].value = 0;
 
-    if (write(uinput_fd, ev, sizeof(ev)) < 0) {
+    pthread_mutex_lock(&device->lock);
+    if (write(device->fd, ev, sizeof(ev)) < 0) {
+        pthread_mutex_unlock(&device->lock);
         LOGE("Failed to send axis event (code=%d, value=%d): %s", axis_code, value, strerror(errno));
         return -1;
     }
 
+    // Keep the snapshot in sync for uinput_send_state()
+    int index = uinput_axis_index(axis_code);
+    if (index >= 0) device->axes[index] = value;
+    pthread_mutex_unlock(&device->lock);
+
+    mark_input_latency();
+
     return 0;
 }
 
 /**
- * Destroy virtual controller and cleanup
+ * Send complete gamepad state
+ *
+ * Diffs the snapshot against the last reported state and writes every changed
+ * EV_KEY/EV_ABS followed by a single SYN_REPORT in one write().
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ * @param buttons Bitmask of pressed buttons (bit N = button_codes[N])
+ * @param axes evdev axis values in axis_codes order (ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y)
+ * @return Number of changed inputs (0 if nothing changed), -1 on failure
  */
-void uinput_destroy() {
-    if (uinput_fd < 0) {
-        LOGI("uinput not initialized (nothing to destroy)");
-        return;
+int uinput_send_state(int controller_id, int buttons, const int* axes) {
+    NATIVE_TRACE_SCOPE("uinput_send_state");
+    uinput_device* device = get_device(controller_id);
+    if (!device) return -1;
+
+    struct input_event ev[NUM_BUTTONS + NUM_AXES + 1];
+    int count = 0;
+    memset(ev, 0, sizeof(ev));
+
+    pthread_mutex_lock(&device->lock);
+    int changed_buttons = buttons ^ device->buttons;
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        if (changed_buttons & (1 << i)) {
+            ev[count].type = EV_KEY;
+            ev[count].code = button_codes[i];
+            ev[count].value = (buttons >> i) & 1;
+            count++;
+        }
+    }
+
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (axes[i] != device->axes[i]) {
+            ev[count].type = EV_ABS;
+            ev[count].code = axis_codes[i];
+            ev[count].value = axes[i];
+            count++;
+        }
     }
 
-    if (ioctl(uinput_fd, UI_DEV_DESTROY) < 0) {
-        LOGE("Failed to destroy device: %s", strerror(errno));
+    if (count == 0) {
+        pthread_mutex_unlock(&device->lock);
+        return 0;
     }
 
-    close(uinput_fd);
-    uinput_fd = -1;
+    // Synchronization event
+    ev[count].type = EV_SYN;
+    ev[count].code = SYN_REPORT;
+    ev[count].value = 0;
+
+    if (write(device->fd, ev, (count + 1) * sizeof(struct input_event)) < 0) {
+        pthread_mutex_unlock(&device->lock);
+        LOGE("Failed to send state (%d changes): %s", count, strerror(errno));
+        return -1;
+    }
+
+    device->buttons = buttons;
+    memcpy(device->axes, axes, sizeof(device->axes));
+    pthread_mutex_unlock(&device->lock);
+
+    mark_input_latency();
+    return count;
+}
+
+/**
+ * Destroy one virtual controller
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ */
+void uinput_destroy_controller(int controller_id) {
+    uinput_device* device = get_device(controller_id);
+    if (!device) return;
+
+    uinput_passthrough_stop(controller_id);
+    uinput_motion_stop(controller_id);
+    uinput_ff_stop(controller_id);
+
+    if (ioctl(device->fd, UI_DEV_DESTROY) < 0) {
+        LOGE("Failed to destroy device %d: %s", controller_id, strerror(errno));
+    }
+
+    close(device->fd);
+    device->fd = -1;
+
+    LOGI("uinput controller %d destroyed", controller_id);
+}
+
+/**
+ * Destroy all virtual controllers and cleanup
+ */
+void uinput_destroy() {
+    for (int i = 0; i < MAX_CONTROLLERS; i++) {
+        if (devices[i].fd >= 0) uinput_destroy_controller(i);
+    }
+
+    if (pending_fd >= 0) {
+        close(pending_fd);
+        pending_fd = -1;
+    }
 
     LOGI("uinput destroyed and closed");
 }
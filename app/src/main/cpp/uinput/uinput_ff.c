@@ -0,0 +1,285 @@
+/**
+ * uinput_ff.c
+ *
+ * Force feedback (FF_RUMBLE) service for the virtual Xbox 360 controllers
+ *
+ * Architecture:
+ * - One reader thread per virtual controller polls its uinput fd
+ * - Answers UI_FF_UPLOAD/UI_FF_ERASE requests (games block in EVIOCSFF until answered)
+ * - Tracks EV_FF play/stop and effect durations, mixes all playing effects
+ *   (max per motor, like xpad)
+ * - Delivers motor changes to uinput_rumble_callback, coalesced to at most one
+ *   update per RUMBLE_INTERVAL_MS so vibrator calls do not flood the binder
+ *
+ * Error handling:
+ * - Unsupported effect types are rejected with -EINVAL to the game
+ * - Logs errors via __android_log_print
+ */
+
+#include <linux/uinput.h>
+#include <linux/input.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <android/log.h>
+
+#define TAG "uinput_ff"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#define MAX_CONTROLLERS 4
+#define MAX_FF_EFFECTS 16
+#define RUMBLE_INTERVAL_MS 16
+#define EVENT_BATCH 16
+
+/**
+ * Motor update callback
+ *
+ * @param controller_id Controller the effect was played on
+ * @param strong Strong (low frequency) motor, 0 to 65535
+ * @param weak Weak (high frequency) motor, 0 to 65535
+ * @param duration_ms Time until the mix changes on its own, -1 until the next update
+ */
+typedef void (*uinput_rumble_callback)(int controller_id, int strong, int weak, int duration_ms);
+
+typedef struct ff_effect_slot {
+    int uploaded;
+    int strong;
+    int weak;
+    int length;
+    int playing;
+    long long end_ms;
+} ff_effect_slot;
+
+typedef struct ff_service {
+    pthread_t thread;
+    int active;
+    int controller_id;
+    int fd;
+    int wake_fd[2];
+    ff_effect_slot effects[MAX_FF_EFFECTS];
+} ff_service;
+
+static ff_service services[MAX_CONTROLLERS];
+static uinput_rumble_callback rumble_callback = NULL;
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void handle_upload(ff_service* service, int request_id) {
+    struct uinput_ff_upload upload;
+    memset(&upload, 0, sizeof(upload));
+    upload.request_id = request_id;
+
+    if (ioctl(service->fd, UI_BEGIN_FF_UPLOAD, &upload) < 0) {
+        LOGE("UI_BEGIN_FF_UPLOAD failed: %s", strerror(errno));
+        return;
+    }
+
+    int id = upload.effect.id;
+    if (upload.effect.type == FF_RUMBLE && id >= 0 && id < MAX_FF_EFFECTS) {
+        ff_effect_slot* slot = &service->effects[id];
+        slot->uploaded = 1;
+        slot->strong = upload.effect.u.rumble.strong_magnitude;
+        slot->weak = upload.effect.u.rumble.weak_magnitude;
+        slot->length = upload.effect.replay.length;
+        upload.retval = 0;
+    }
+    else upload.retval = -EINVAL;
+
+    if (ioctl(service->fd, UI_END_FF_UPLOAD, &upload) < 0) {
+        LOGE("UI_END_FF_UPLOAD failed: %s", strerror(errno));
+    }
+}
+
+static void handle_erase(ff_service* service, int request_id) {
+    struct uinput_ff_erase erase;
+    memset(&erase, 0, sizeof(erase));
+    erase.request_id = request_id;
+
+    if (ioctl(service->fd, UI_BEGIN_FF_ERASE, &erase) < 0) {
+        LOGE("UI_BEGIN_FF_ERASE failed: %s", strerror(errno));
+        return;
+    }
+
+    if (erase.effect_id < MAX_FF_EFFECTS) {
+        memset(&service->effects[erase.effect_id], 0, sizeof(ff_effect_slot));
+    }
+    erase.retval = 0;
+
+    if (ioctl(service->fd, UI_END_FF_ERASE, &erase) < 0) {
+        LOGE("UI_END_FF_ERASE failed: %s", strerror(errno));
+    }
+}
+
+static void handle_play(ff_service* service, int id, int count, long long now) {
+    if (id < 0 || id >= MAX_FF_EFFECTS || !service->effects[id].uploaded) return;
+
+    ff_effect_slot* slot = &service->effects[id];
+    slot->playing = count > 0;
+    slot->end_ms = slot->playing && slot->length > 0 ? now + slot->length : 0;
+}
+
+/**
+ * Expire finished effects and mix the rest
+ *
+ * @return Time until the next effect ends, -1 if nothing ends on its own
+ */
+static int mix_effects(ff_service* service, long long now, int* strong, int* weak) {
+    long long next_end = 0;
+    *strong = 0;
+    *weak = 0;
+
+    for (int i = 0; i < MAX_FF_EFFECTS; i++) {
+        ff_effect_slot* slot = &service->effects[i];
+        if (!slot->playing) continue;
+
+        if (slot->end_ms && slot->end_ms <= now) {
+            slot->playing = 0;
+            continue;
+        }
+
+        if (slot->strong > *strong) *strong = slot->strong;
+        if (slot->weak > *weak) *weak = slot->weak;
+        if (slot->end_ms && (!next_end || slot->end_ms < next_end)) next_end = slot->end_ms;
+    }
+
+    return next_end ? (int)(next_end - now) : -1;
+}
+
+static void* ff_thread(void* arg) {
+    ff_service* service = arg;
+    struct input_event events[EVENT_BATCH];
+    struct pollfd fds[2] = {
+        {.fd = service->fd, .events = POLLIN},
+        {.fd = service->wake_fd[0], .events = POLLIN}
+    };
+
+    int sent_strong = 0;
+    int sent_weak = 0;
+    long long sent_ms = 0;
+    int pending = 0;
+    int timeout = -1;
+
+    while (1) {
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) continue;
+            LOGE("poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents) break;
+
+        long long now = now_ms();
+        if (fds[0].revents & POLLIN) {
+            ssize_t size = read(service->fd, events, sizeof(events));
+            int count = size > 0 ? size / sizeof(struct input_event) : 0;
+            for (int i = 0; i < count; i++) {
+                struct input_event* ev = &events[i];
+                if (ev->type == EV_UINPUT) {
+                    if (ev->code == UI_FF_UPLOAD) handle_upload(service, ev->value);
+                    else if (ev->code == UI_FF_ERASE) handle_erase(service, ev->value);
+                }
+                else if (ev->type == EV_FF && ev->code < MAX_FF_EFFECTS) {
+                    handle_play(service, ev->code, ev->value, now);
+                }
+            }
+        }
+
+        int strong, weak;
+        int remaining = mix_effects(service, now, &strong, &weak);
+        if (strong != sent_strong || weak != sent_weak) pending = 1;
+
+        // Coalesce: at most one callback per RUMBLE_INTERVAL_MS, the latest mix wins
+        int wait = -1;
+        if (pending) {
+            long long elapsed = now - sent_ms;
+            if (elapsed >= RUMBLE_INTERVAL_MS) {
+                if (rumble_callback) rumble_callback(service->controller_id, strong, weak, remaining);
+                sent_strong = strong;
+                sent_weak = weak;
+                sent_ms = now;
+                pending = 0;
+            }
+            else wait = (int)(RUMBLE_INTERVAL_MS - elapsed);
+        }
+
+        timeout = remaining;
+        if (wait >= 0 && (timeout < 0 || wait < timeout)) timeout = wait;
+    }
+
+    if ((sent_strong || sent_weak) && rumble_callback) {
+        rumble_callback(service->controller_id, 0, 0, -1);
+    }
+    return NULL;
+}
+
+/**
+ * Set the motor update callback (NULL to drop rumble)
+ * Called from the per-controller reader threads.
+ */
+void uinput_set_rumble_callback(uinput_rumble_callback callback) {
+    rumble_callback = callback;
+}
+
+/**
+ * Start the force-feedback reader for a created controller
+ *
+ * @param controller_id Slot of the controller in uinput_bridge.c
+ * @param fd The controller's uinput fd (opened O_RDWR | O_NONBLOCK)
+ * @return 0 on success, -1 on failure
+ */
+int uinput_ff_start(int controller_id, int fd) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) return -1;
+
+    ff_service* service = &services[controller_id];
+    if (service->active) return 0;
+
+    if (pipe2(service->wake_fd, O_CLOEXEC) < 0) {
+        LOGE("Failed to create wake pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(service->effects, 0, sizeof(service->effects));
+    service->controller_id = controller_id;
+    service->fd = fd;
+
+    if (pthread_create(&service->thread, NULL, ff_thread, service) != 0) {
+        LOGE("Failed to start force-feedback thread");
+        close(service->wake_fd[0]);
+        close(service->wake_fd[1]);
+        return -1;
+    }
+
+    service->active = 1;
+    return 0;
+}
+
+/**
+ * Stop the force-feedback reader (no-op if not running)
+ * Must run before the controller's fd is closed.
+ *
+ * @param controller_id Slot of the controller in uinput_bridge.c
+ */
+void uinput_ff_stop(int controller_id) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) return;
+
+    ff_service* service = &services[controller_id];
+    if (!service->active) return;
+
+    char wake = 1;
+    write(service->wake_fd[1], &wake, 1);
+    pthread_join(service->thread, NULL);
+
+    close(service->wake_fd[0]);
+    close(service->wake_fd[1]);
+    service->active = 0;
+}
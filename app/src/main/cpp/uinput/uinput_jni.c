@@ -8,7 +8,15 @@
  * - nativeCreateVirtualController() → uinput_create_xbox360_controller()
  * - nativeSendButtonEvent() → uinput_send_button_event()
  * - nativeSendAxisEvent() → uinput_send_axis_event()
+ * - nativeSendState() → uinput_send_state()
+ * - nativeStartPassthrough() → uinput_passthrough_start()
+ * - nativeStopPassthrough() → uinput_passthrough_stop()
+ * - nativeStartMotion() → uinput_motion_start()
+ * - nativeSetMotionRotation() → uinput_motion_set_rotation()
+ * - nativeStopMotion() → uinput_motion_stop()
+ * - nativeDestroyController() → uinput_destroy_controller()
  * - nativeDestroy() → uinput_destroy()
+ * - uinput_ff.c rumble callback → NativeUInputBridge.onRumble()
  *
  * Data marshalling:
  * - jstring → const char* (UTF-8)
@@ -19,6 +27,7 @@
 
 #include <jni.h>
 #include <string.h>
+#include <pthread.h>
 #include <android/log.h>
 
 #define TAG "uinput_jni"
@@ -28,9 +37,47 @@
 // External functions from uinput_bridge.c
 extern int uinput_init();
 extern int uinput_create_xbox360_controller(const char* name, int vendor_id, int product_id);
-extern int uinput_send_button_event(int button_code, int pressed);
-extern int uinput_send_axis_event(int axis_code, int value);
+extern int uinput_send_button_event(int controller_id, int button_code, int pressed);
+extern int uinput_send_axis_event(int controller_id, int axis_code, int value);
+extern int uinput_send_state(int controller_id, int buttons, const int* axes);
+extern int uinput_passthrough_start(int controller_id, int vendor_id, int product_id, int grab);
+extern void uinput_passthrough_stop(int controller_id);
+extern int uinput_motion_start(int controller_id, const char* name, int vendor_id, int product_id,
+                               const char* package_name, int rate_hz);
+extern void uinput_motion_set_rotation(int controller_id, int rotation);
+extern void uinput_motion_stop(int controller_id);
+extern void uinput_destroy_controller(int controller_id);
 extern void uinput_destroy();
+extern void uinput_set_rumble_callback(void (*callback)(int controller_id, int strong, int weak, int duration_ms));
+
+static JavaVM* java_vm = NULL;
+static jobject bridge_ref = NULL;
+static jmethodID on_rumble_method = NULL;
+static pthread_key_t detach_key;
+static pthread_once_t detach_once = PTHREAD_ONCE_INIT;
+
+// The force-feedback threads attach once and detach when they exit
+static void detach_thread(void* env) {
+    (*java_vm)->DetachCurrentThread(java_vm);
+}
+
+static void create_detach_key() {
+    pthread_key_create(&detach_key, detach_thread);
+}
+
+static void rumble_to_java(int controller_id, int strong, int weak, int duration_ms) {
+    JNIEnv* env;
+    if ((*java_vm)->GetEnv(java_vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) {
+        if ((*java_vm)->AttachCurrentThread(java_vm, &env, NULL) != JNI_OK) return;
+        pthread_setspecific(detach_key, env);
+    }
+
+    (*env)->CallVoidMethod(env, bridge_ref, on_rumble_method, controller_id, strong, weak, duration_ms);
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+    }
+}
 
 /**
  * JNI: Initialize uinput
@@ -53,6 +100,15 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeInit(
         return JNI_FALSE;
     }
 
+    if (!bridge_ref) {
+        pthread_once(&detach_once, create_detach_key);
+        (*env)->GetJavaVM(env, &java_vm);
+        bridge_ref = (*env)->NewGlobalRef(env, thiz);
+        jclass cls = (*env)->GetObjectClass(env, thiz);
+        on_rumble_method = (*env)->GetMethodID(env, cls, "onRumble", "(IIII)V");
+        uinput_set_rumble_callback(rumble_to_java);
+    }
+
     return JNI_TRUE;
 }
 
@@ -69,7 +125,7 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeInit(
  * @param name Controller name (e.g., "Steam Deck Mobile Controller")
  * @param vendor_id Vendor ID (0x045e for Xbox)
  * @param product_id Product ID (0x028e for Xbox 360)
- * @return Controller ID (0) on success, -1 on failure
+ * @return Controller ID (0 to 3) on success, -1 on failure
  */
 JNIEXPORT jint JNICALL
 Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeCreateVirtualController(
@@ -97,16 +153,16 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeCreateVirtualContr
         return -1;
     }
 
-    // Return 0 as controller ID (single controller for now)
-    return 0;
+    return result;
 }
 
 /**
  * JNI: Send button event
  *
  * Java signature:
- * private external fun nativeSendButtonEvent(button: Int, pressed: Boolean): Boolean
+ * private external fun nativeSendButtonEvent(controllerId: Int, button: Int, pressed: Boolean): Boolean
  *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
  * @param button Xbox button code (e.g., BTN_A=0x130)
  * @param pressed JNI_TRUE for press, JNI_FALSE for release
  * @return JNI_TRUE on success, JNI_FALSE on failure
@@ -115,11 +171,12 @@ JNIEXPORT jboolean JNICALL
 Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendButtonEvent(
     JNIEnv* env,
     jobject thiz,
+    jint controller_id,
     jint button,
     jboolean pressed
 ) {
     int pressed_int = pressed ? 1 : 0;
-    int result = uinput_send_button_event(button, pressed_int);
+    int result = uinput_send_button_event(controller_id, button, pressed_int);
 
     if (result < 0) {
         LOGE("uinput_send_button_event failed (button=%d, pressed=%d)", button, pressed_int);
@@ -133,7 +190,7 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendButtonEvent(
  * JNI: Send axis event
  *
  * Java signature:
- * private external fun nativeSendAxisEvent(axis: Int, value: Float): Boolean
+ * private external fun nativeSendAxisEvent(controllerId: Int, axis: Int, value: Float): Boolean
  *
  * Data conversion:
  * - Android value: -1.0 to 1.0 (float)
@@ -141,6 +198,7 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendButtonEvent(
  *
  * Formula: evdev_value = (android_value + 1.0) * 32767.5 - 32768
  *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
  * @param axis evdev axis code (e.g., ABS_X=0x00)
  * @param value Android axis value (-1.0 to 1.0)
  * @return JNI_TRUE on success, JNI_FALSE on failure
@@ -149,6 +207,7 @@ JNIEXPORT jboolean JNICALL
 Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendAxisEvent(
     JNIEnv* env,
     jobject thiz,
+    jint controller_id,
     jint axis,
     jfloat value
 ) {
@@ -159,7 +218,7 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendAxisEvent(
     if (evdev_value < -32768) evdev_value = -32768;
     if (evdev_value > 32767) evdev_value = 32767;
 
-    int result = uinput_send_axis_event(axis, evdev_value);
+    int result = uinput_send_axis_event(controller_id, axis, evdev_value);
 
     if (result < 0) {
         LOGE("uinput_send_axis_event failed (axis=%d, value=%f, evdev=%d)", axis, value, evdev_value);
@@ -170,7 +229,229 @@ Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendAxisEvent(
 }
 
 /**
- * JNI: Destroy virtual controller
+ * JNI: Send complete gamepad state
+ *
+ * Java signature:
+ * private external fun nativeSendState(controllerId: Int, buttons: Int, axes: FloatArray): Boolean
+ *
+ * Data conversion (axes in ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y order):
+ * - Sticks: -1.0 to 1.0 → -32768 to 32767
+ * - Triggers (ABS_Z, ABS_RZ): 0.0 to 1.0 → 0 to 255
+ * - D-pad: -1.0 to 1.0 → -1, 0, 1
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ * @param buttons Bitmask of pressed buttons (bit 0 = BTN_A ... bit 10 = BTN_THUMBR)
+ * @param axes Android axis values, 8 entries
+ * @return JNI_TRUE on success (including no change), JNI_FALSE on failure
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSendState(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id,
+    jint buttons,
+    jfloatArray axes
+) {
+    jfloat values[8];
+    int evdev_values[8];
+
+    if ((*env)->GetArrayLength(env, axes) < 8) {
+        LOGE("nativeSendState needs 8 axis values");
+        return JNI_FALSE;
+    }
+    (*env)->GetFloatArrayRegion(env, axes, 0, 8, values);
+
+    for (int i = 0; i < 8; i++) {
+        int evdev_value;
+        if (i == 2 || i == 5) {
+            // Triggers
+            evdev_value = (int)(values[i] * 255.0f + 0.5f);
+            if (evdev_value < 0) evdev_value = 0;
+            if (evdev_value > 255) evdev_value = 255;
+        }
+        else if (i >= 6) {
+            // D-pad
+            evdev_value = values[i] > 0.5f ? 1 : (values[i] < -0.5f ? -1 : 0);
+        }
+        else {
+            evdev_value = (int)((values[i] + 1.0f) * 32767.5f - 32768.0f);
+            if (evdev_value < -32768) evdev_value = -32768;
+            if (evdev_value > 32767) evdev_value = 32767;
+        }
+        evdev_values[i] = evdev_value;
+    }
+
+    if (uinput_send_state(controller_id, buttons, evdev_values) < 0) {
+        LOGE("uinput_send_state failed (buttons=0x%x)", buttons);
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
+
+/**
+ * JNI: Forward a physical gamepad's evdev node to a virtual controller on a native thread
+ *
+ * Java signature:
+ * private external fun nativeStartPassthrough(
+ *     controllerId: Int,
+ *     vendorId: Int,
+ *     productId: Int,
+ *     grab: Boolean
+ * ): Boolean
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ * @param vendor_id Physical device vendor ID
+ * @param product_id Physical device product ID
+ * @param grab JNI_TRUE to take the evdev node exclusively
+ * @return JNI_TRUE if the node was found and the thread started, JNI_FALSE otherwise
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeStartPassthrough(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id,
+    jint vendor_id,
+    jint product_id,
+    jboolean grab
+) {
+    LOGI("nativeStartPassthrough called: id=%d, vendor=0x%04x, product=0x%04x",
+         controller_id, vendor_id, product_id);
+
+    if (uinput_passthrough_start(controller_id, vendor_id, product_id, grab ? 1 : 0) < 0) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
+
+/**
+ * JNI: Stop evdev passthrough
+ *
+ * Java signature:
+ * private external fun nativeStopPassthrough(controllerId: Int)
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ */
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeStopPassthrough(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id
+) {
+    uinput_passthrough_stop(controller_id);
+}
+
+/**
+ * JNI: Create the motion sensor device of a virtual controller, fed from the phone's sensors on a native thread
+ *
+ * Java signature:
+ * private external fun nativeStartMotion(
+ *     controllerId: Int,
+ *     name: String,
+ *     vendorId: Int,
+ *     productId: Int,
+ *     packageName: String,
+ *     rateHz: Int
+ * ): Boolean
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ * @param name Controller name, the device is called "<name> Motion Sensors"
+ * @param vendor_id Controller vendor ID
+ * @param product_id Controller product ID
+ * @param package_name Context.getPackageName(), for ASensorManager_getInstanceForPackage()
+ * @param rate_hz Sensor sample rate
+ * @return JNI_TRUE if the device was created and the thread started, JNI_FALSE otherwise
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeStartMotion(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id,
+    jstring name,
+    jint vendor_id,
+    jint product_id,
+    jstring package_name,
+    jint rate_hz
+) {
+    const char* name_str = (*env)->GetStringUTFChars(env, name, NULL);
+    if (name_str == NULL) {
+        LOGE("Failed to convert jstring to const char*");
+        return JNI_FALSE;
+    }
+    const char* package_str = (*env)->GetStringUTFChars(env, package_name, NULL);
+    if (package_str == NULL) {
+        (*env)->ReleaseStringUTFChars(env, name, name_str);
+        LOGE("Failed to convert jstring to const char*");
+        return JNI_FALSE;
+    }
+
+    LOGI("nativeStartMotion called: id=%d, name=%s, rate=%d Hz", controller_id, name_str, rate_hz);
+
+    int result = uinput_motion_start(controller_id, name_str, vendor_id, product_id, package_str, rate_hz);
+
+    (*env)->ReleaseStringUTFChars(env, package_name, package_str);
+    (*env)->ReleaseStringUTFChars(env, name, name_str);
+
+    return result < 0 ? JNI_FALSE : JNI_TRUE;
+}
+
+/**
+ * JNI: Report the display rotation the motion axes are mapped to
+ *
+ * Java signature:
+ * private external fun nativeSetMotionRotation(controllerId: Int, rotation: Int)
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ * @param rotation Display.getRotation() (Surface.ROTATION_0 ~ ROTATION_270)
+ */
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeSetMotionRotation(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id,
+    jint rotation
+) {
+    uinput_motion_set_rotation(controller_id, rotation);
+}
+
+/**
+ * JNI: Stop the motion sensor device
+ *
+ * Java signature:
+ * private external fun nativeStopMotion(controllerId: Int)
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ */
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeStopMotion(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id
+) {
+    uinput_motion_stop(controller_id);
+}
+
+/**
+ * JNI: Destroy one virtual controller
+ *
+ * Java signature:
+ * private external fun nativeDestroyController(controllerId: Int)
+ *
+ * @param controller_id Controller ID from nativeCreateVirtualController()
+ */
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_input_NativeUInputBridge_nativeDestroyController(
+    JNIEnv* env,
+    jobject thiz,
+    jint controller_id
+) {
+    LOGI("nativeDestroyController called: id=%d", controller_id);
+    uinput_destroy_controller(controller_id);
+}
+
+/**
+ * JNI: Destroy all virtual controllers
  *
  * Java signature:
  * private external fun nativeDestroy()
@@ -0,0 +1,416 @@
+/**
+ * uinput_motion.c
+ *
+ * Motion sensor companion device for a virtual controller
+ *
+ * Architecture:
+ * - One extra uinput device per virtual controller, flagged with
+ *   INPUT_PROP_ACCELEROMETER and laid out like the motion node of the
+ *   kernel's hid-playstation driver: ABS_X/Y/Z acceleration, ABS_RX/RY/RZ
+ *   angular velocity, EV_MSC MSC_TIMESTAMP
+ * - A native thread per device reads the phone's accelerometer and gyroscope
+ *   through an ASensorEventQueue attached to its own ALooper
+ * - Every gyroscope sample becomes one frame carrying the latest acceleration,
+ *   all frames of a queue drain go out in a single write()
+ * - Java only starts/stops the device and reports the display rotation,
+ *   sensor samples never cross JNI
+ *
+ * Error handling:
+ * - Returns -1 when the phone has no usable sensor or uinput fails
+ *   (caller keeps gyro emulation on the sticks)
+ * - Logs errors via __android_log_print
+ */
+
+#include <linux/uinput.h>
+#include <linux/input.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <android/looper.h>
+#include <android/sensor.h>
+#include <android/log.h>
+
+#include "native_trace.h"
+
+#define TAG "uinput_motion"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#define MAX_CONTROLLERS 4
+#define SENSOR_BATCH 32
+
+// Same units and ranges as hid-playstation, what SDL and Steam Input expect
+#define ACCEL_RES_PER_G 8192
+#define ACCEL_RANGE (4 * ACCEL_RES_PER_G)
+#define GYRO_RES_PER_DEG_S 1024
+#define GYRO_RANGE (2048 * GYRO_RES_PER_DEG_S)
+
+// ABS_X/Y/Z, ABS_RX/RY/RZ, MSC_TIMESTAMP and SYN_REPORT
+#define NUM_MOTION_AXES 6
+#define FRAME_EVENTS (NUM_MOTION_AXES + 2)
+
+#define MIN_RATE_HZ 50
+#define MAX_RATE_HZ 1000
+
+// Same niceness as the evdev passthrough threads
+#define MOTION_NICE -8
+
+#define LOOPER_ID_SENSORS 1
+#define LOOPER_ID_WAKE 2
+
+static const int motion_axis_codes[NUM_MOTION_AXES] = {
+    ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ
+};
+
+typedef struct motion {
+    pthread_t thread;
+    int active;
+    int controller_id;
+    int fd;
+    int wake_fd[2];
+    int period_us;
+    // Surface.ROTATION_* of the display, written by Java, read by the thread
+    volatile int rotation;
+    ASensorManager* manager;
+    const ASensor* accel_sensor;
+    const ASensor* gyro_sensor;
+    // Latest acceleration in hid-playstation units, and the last frame reported
+    int accel[3];
+    int gyro[3];
+    int reported[NUM_MOTION_AXES];
+    int64_t base_timestamp;
+} motion;
+
+static motion motions[MAX_CONTROLLERS];
+
+static int setup_motion_device(int fd, const char* name, int vendor_id, int product_id) {
+    if (ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_ACCELEROMETER) < 0) {
+        LOGE("Failed to set INPUT_PROP_ACCELEROMETER: %s", strerror(errno));
+        return -1;
+    }
+
+    if (ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0) {
+        LOGE("Failed to enable EV_ABS: %s", strerror(errno));
+        return -1;
+    }
+
+    // Sample timestamps in microseconds, lets consumers integrate the gyro exactly
+    if (ioctl(fd, UI_SET_EVBIT, EV_MSC) < 0 || ioctl(fd, UI_SET_MSCBIT, MSC_TIMESTAMP) < 0) {
+        LOGE("Failed to enable MSC_TIMESTAMP: %s", strerror(errno));
+        return -1;
+    }
+
+    struct uinput_abs_setup abs_setup;
+    memset(&abs_setup, 0, sizeof(abs_setup));
+    for (int i = 0; i < NUM_MOTION_AXES; i++) {
+        int range = i < 3 ? ACCEL_RANGE : GYRO_RANGE;
+        abs_setup.code = motion_axis_codes[i];
+        abs_setup.absinfo.minimum = -range;
+        abs_setup.absinfo.maximum = range;
+        abs_setup.absinfo.resolution = i < 3 ? ACCEL_RES_PER_G : GYRO_RES_PER_DEG_S;
+        if (ioctl(fd, UI_ABS_SETUP, &abs_setup) < 0) {
+            LOGE("Failed to setup motion axis %d: %s", motion_axis_codes[i], strerror(errno));
+            return -1;
+        }
+    }
+
+    struct uinput_setup usetup;
+    memset(&usetup, 0, sizeof(usetup));
+
+    // Same ids as the pad so consumers can pair the two nodes
+    usetup.id.bustype = BUS_USB;
+    usetup.id.vendor = vendor_id;
+    usetup.id.product = product_id;
+    usetup.id.version = 1;
+
+    snprintf(usetup.name, UINPUT_MAX_NAME_SIZE, "%s Motion Sensors", name);
+
+    if (ioctl(fd, UI_DEV_SETUP, &usetup) < 0) {
+        LOGE("Failed to setup motion device: %s", strerror(errno));
+        return -1;
+    }
+
+    if (ioctl(fd, UI_DEV_CREATE) < 0) {
+        LOGE("Failed to create motion device: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int scale_motion(float value, float resolution, int range) {
+    long scaled = lroundf(value * resolution);
+    if (scaled < -range) return -range;
+    if (scaled > range) return range;
+    return (int)scaled;
+}
+
+/**
+ * Map a sensor vector from the phone's natural orientation to the display,
+ * so X points right and Y up on screen however the phone is held
+ */
+static void to_display(int rotation, const ASensorVector* v, float* x, float* y, float* z) {
+    switch (rotation & 3) {
+        case 1: *x = -v->y; *y = v->x; break;
+        case 2: *x = -v->x; *y = -v->y; break;
+        case 3: *x = v->y; *y = -v->x; break;
+        default: *x = v->x; *y = v->y; break;
+    }
+    *z = v->z;
+}
+
+static void handle_sensor(motion* m, const ASensorEvent* event) {
+    float x, y, z;
+    to_display(m->rotation, &event->vector, &x, &y, &z);
+
+    if (event->type == ASENSOR_TYPE_ACCELEROMETER) {
+        // m/s^2 to g
+        const float res = ACCEL_RES_PER_G / ASENSOR_STANDARD_GRAVITY;
+        m->accel[0] = scale_motion(x, res, ACCEL_RANGE);
+        m->accel[1] = scale_motion(y, res, ACCEL_RANGE);
+        m->accel[2] = scale_motion(z, res, ACCEL_RANGE);
+    }
+    else {
+        // rad/s to deg/s
+        const float res = GYRO_RES_PER_DEG_S * (float)(180.0 / M_PI);
+        m->gyro[0] = scale_motion(x, res, GYRO_RANGE);
+        m->gyro[1] = scale_motion(y, res, GYRO_RANGE);
+        m->gyro[2] = scale_motion(z, res, GYRO_RANGE);
+    }
+}
+
+/**
+ * Append one frame (changed axes, MSC_TIMESTAMP, SYN_REPORT) to ev
+ *
+ * @return Number of events appended
+ */
+static int build_frame(motion* m, struct input_event* ev, int64_t timestamp) {
+    int values[NUM_MOTION_AXES] = {
+        m->accel[0], m->accel[1], m->accel[2], m->gyro[0], m->gyro[1], m->gyro[2]
+    };
+    int count = 0;
+
+    for (int i = 0; i < NUM_MOTION_AXES; i++) {
+        if (values[i] == m->reported[i]) continue;
+        ev[count].type = EV_ABS;
+        ev[count].code = motion_axis_codes[i];
+        ev[count].value = values[i];
+        m->reported[i] = values[i];
+        count++;
+    }
+
+    // Wraps like the hardware counters of real controllers
+    ev[count].type = EV_MSC;
+    ev[count].code = MSC_TIMESTAMP;
+    ev[count].value = (int)(uint32_t)((timestamp - m->base_timestamp) / 1000);
+    count++;
+
+    ev[count].type = EV_SYN;
+    ev[count].code = SYN_REPORT;
+    ev[count].value = 0;
+    return count + 1;
+}
+
+/**
+ * Turn everything queued since the last wakeup into frames, one write() per batch
+ */
+static void drain_sensors(motion* m, ASensorEventQueue* queue) {
+    NATIVE_TRACE_SCOPE("uinput_motion_drain");
+    ASensorEvent events[SENSOR_BATCH];
+    struct input_event frames[SENSOR_BATCH * FRAME_EVENTS];
+    ssize_t n;
+
+    while ((n = ASensorEventQueue_getEvents(queue, events, SENSOR_BATCH)) > 0) {
+        int count = 0;
+        memset(frames, 0, sizeof(frames));
+
+        for (ssize_t i = 0; i < n; i++) {
+            const ASensorEvent* event = &events[i];
+            if (event->type != ASENSOR_TYPE_ACCELEROMETER && event->type != ASENSOR_TYPE_GYROSCOPE) continue;
+
+            handle_sensor(m, event);
+
+            // The gyro paces the frames, acceleration rides along with the next one
+            if (event->type == ASENSOR_TYPE_ACCELEROMETER && m->gyro_sensor) continue;
+
+            if (!m->base_timestamp) m->base_timestamp = event->timestamp;
+            count += build_frame(m, &frames[count], event->timestamp);
+        }
+
+        if (count && write(m->fd, frames, count * sizeof(struct input_event)) < 0) {
+            LOGE("Failed to send %d motion events: %s", count, strerror(errno));
+        }
+    }
+}
+
+static void enable_sensor(ASensorEventQueue* queue, const ASensor* sensor, int period_us) {
+    if (!sensor) return;
+
+    // Never faster than the sensor can go, no batching so samples arrive as they happen
+    int min_delay = ASensor_getMinDelay(sensor);
+    if (period_us < min_delay) period_us = min_delay;
+
+    if (ASensorEventQueue_registerSensor(queue, sensor, period_us, 0) < 0) {
+        LOGE("Failed to enable %s", ASensor_getName(sensor));
+    }
+}
+
+static void* motion_thread(void* arg) {
+    motion* m = arg;
+
+    // Applies to the calling thread on Linux; failure just leaves the default priority
+    setpriority(PRIO_PROCESS, 0, MOTION_NICE);
+
+    ALooper* looper = ALooper_prepare(0);
+    ALooper_addFd(looper, m->wake_fd[0], LOOPER_ID_WAKE, ALOOPER_EVENT_INPUT, NULL, NULL);
+
+    ASensorEventQueue* queue = ASensorManager_createEventQueue(m->manager, looper, LOOPER_ID_SENSORS, NULL, NULL);
+    if (!queue) {
+        LOGE("Failed to create sensor event queue");
+        ALooper_removeFd(looper, m->wake_fd[0]);
+        return NULL;
+    }
+
+    enable_sensor(queue, m->accel_sensor, m->period_us);
+    enable_sensor(queue, m->gyro_sensor, m->period_us);
+
+    while (1) {
+        int id = ALooper_pollOnce(-1, NULL, NULL, NULL);
+        if (id == LOOPER_ID_WAKE || id == ALOOPER_POLL_ERROR) break;
+        if (id == LOOPER_ID_SENSORS) drain_sensors(m, queue);
+    }
+
+    if (m->accel_sensor) ASensorEventQueue_disableSensor(queue, m->accel_sensor);
+    if (m->gyro_sensor) ASensorEventQueue_disableSensor(queue, m->gyro_sensor);
+    ASensorManager_destroyEventQueue(m->manager, queue);
+    ALooper_removeFd(looper, m->wake_fd[0]);
+
+    return NULL;
+}
+
+/**
+ * Create the motion device of a virtual controller and start feeding it from the phone's sensors
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ * @param name Name of the controller, the device is called "<name> Motion Sensors"
+ * @param vendor_id Vendor ID of the controller
+ * @param product_id Product ID of the controller
+ * @param package_name Calling app package, needed by ASensorManager_getInstanceForPackage()
+ * @param rate_hz Sample rate (clamped to MIN_RATE_HZ ~ MAX_RATE_HZ and the sensors' limits)
+ * @return 0 on success, -1 on failure
+ */
+int uinput_motion_start(int controller_id, const char* name, int vendor_id, int product_id,
+                        const char* package_name, int rate_hz) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) {
+        LOGE("Invalid controller id %d", controller_id);
+        return -1;
+    }
+
+    motion* m = &motions[controller_id];
+    if (m->active) {
+        LOGI("Motion already active for controller %d", controller_id);
+        return 0;
+    }
+
+    m->manager = ASensorManager_getInstanceForPackage(package_name);
+    if (!m->manager) {
+        LOGE("No sensor manager");
+        return -1;
+    }
+
+    m->accel_sensor = ASensorManager_getDefaultSensor(m->manager, ASENSOR_TYPE_ACCELEROMETER);
+    m->gyro_sensor = ASensorManager_getDefaultSensor(m->manager, ASENSOR_TYPE_GYROSCOPE);
+    if (!m->accel_sensor && !m->gyro_sensor) {
+        LOGE("No accelerometer or gyroscope");
+        return -1;
+    }
+
+    if (rate_hz < MIN_RATE_HZ) rate_hz = MIN_RATE_HZ;
+    if (rate_hz > MAX_RATE_HZ) rate_hz = MAX_RATE_HZ;
+    m->period_us = 1000000 / rate_hz;
+
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("Failed to open /dev/uinput: %s", strerror(errno));
+        return -1;
+    }
+
+    if (setup_motion_device(fd, name, vendor_id, product_id) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (pipe2(m->wake_fd, O_CLOEXEC) < 0) {
+        LOGE("Failed to create wake pipe: %s", strerror(errno));
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+        return -1;
+    }
+
+    // A new device starts at rest
+    m->controller_id = controller_id;
+    m->fd = fd;
+    m->base_timestamp = 0;
+    memset(m->accel, 0, sizeof(m->accel));
+    memset(m->gyro, 0, sizeof(m->gyro));
+    memset(m->reported, 0, sizeof(m->reported));
+
+    if (pthread_create(&m->thread, NULL, motion_thread, m) != 0) {
+        LOGE("Failed to start motion thread");
+        close(m->wake_fd[0]);
+        close(m->wake_fd[1]);
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+        return -1;
+    }
+
+    m->active = 1;
+    LOGI("Motion started for controller %d: accel=%s gyro=%s, %d Hz", controller_id,
+         m->accel_sensor ? ASensor_getName(m->accel_sensor) : "none",
+         m->gyro_sensor ? ASensor_getName(m->gyro_sensor) : "none", rate_hz);
+    return 0;
+}
+
+/**
+ * Report the display rotation, sensor axes are remapped to it from the next sample on
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ * @param rotation Surface.ROTATION_0 ~ ROTATION_270 (0 ~ 3)
+ */
+void uinput_motion_set_rotation(int controller_id, int rotation) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) return;
+    motions[controller_id].rotation = rotation;
+}
+
+/**
+ * Stop the motion thread and destroy the motion device of a virtual controller (no-op if not running)
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ */
+void uinput_motion_stop(int controller_id) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) return;
+
+    motion* m = &motions[controller_id];
+    if (!m->active) return;
+
+    char wake = 1;
+    write(m->wake_fd[1], &wake, 1);
+    pthread_join(m->thread, NULL);
+
+    close(m->wake_fd[0]);
+    close(m->wake_fd[1]);
+
+    if (ioctl(m->fd, UI_DEV_DESTROY) < 0) {
+        LOGE("Failed to destroy motion device %d: %s", controller_id, strerror(errno));
+    }
+    close(m->fd);
+    m->fd = -1;
+    m->active = 0;
+
+    LOGI("Motion stopped for controller %d", controller_id);
+}
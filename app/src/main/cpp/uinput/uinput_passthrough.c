@@ -0,0 +1,344 @@
+/**
+ * uinput_passthrough.c
+ *
+ * evdev passthrough for physical gamepads
+ *
+ * Architecture:
+ * - One native thread per virtual controller reads the physical pad's
+ *   /dev/input/eventN node directly (where SELinux/permissions allow it)
+ * - Button/axis codes are mapped and rescaled to the Xbox 360 layout
+ * - Every SYN_REPORT becomes one merged uinput_send_state() write
+ * - Java (UI thread, GC) is not involved once the thread is running
+ *
+ * Error handling:
+ * - Returns -1 when no accessible node is found (caller keeps the
+ *   InputDevice → JNI path)
+ * - Logs errors via __android_log_print
+ */
+
+#include <linux/input.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <android/log.h>
+
+#define TAG "uinput_passthrough"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#define MAX_CONTROLLERS 4
+#define NUM_AXES 8
+#define EVENT_BATCH 64
+
+// Same niceness as Android's THREAD_PRIORITY_URGENT_DISPLAY
+#define PASSTHROUGH_NICE -8
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) (((x) - 1) / BITS_PER_LONG + 1)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
+extern int uinput_button_index(int button_code);
+extern int uinput_axis_index(int axis_code);
+extern int uinput_send_state(int controller_id, int buttons, const int* axes);
+
+typedef struct passthrough {
+    pthread_t thread;
+    int active;
+    int controller_id;
+    int source_fd;
+    int wake_fd[2];
+    int buttons;
+    int dpad;
+    int axes[NUM_AXES];
+    struct input_absinfo absinfo[ABS_CNT];
+} passthrough;
+
+static passthrough passthroughs[MAX_CONTROLLERS];
+
+// Analog triggers on some drivers (hid-generic, hid-steam) use the gas/brake codes
+static int target_axis(int code) {
+    switch (code) {
+        case ABS_BRAKE: return ABS_Z;
+        case ABS_GAS: return ABS_RZ;
+        default: return code;
+    }
+}
+
+/**
+ * Rescale a source axis value to the range uinput_bridge.c sets up:
+ * sticks -32768 to 32767, triggers 0 to 255, D-pad -1 to 1
+ */
+static int scale_axis(const struct input_absinfo* info, int index, int value) {
+    int range = info->maximum - info->minimum;
+    if (range <= 0) return 0;
+
+    long long offset = (long long)value - info->minimum;
+    if (offset < 0) offset = 0;
+    if (offset > range) offset = range;
+
+    if (index == 2 || index == 5) {
+        // Triggers
+        return (int)(offset * 255 / range);
+    }
+    else if (index >= 6) {
+        // D-pad
+        int center = info->minimum + range / 2;
+        return value > center ? 1 : (value < center ? -1 : 0);
+    }
+    else return (int)(offset * 65535 / range) - 32768;
+}
+
+static void apply_dpad(passthrough* pt) {
+    pt->axes[6] = ((pt->dpad >> 3) & 1) - ((pt->dpad >> 2) & 1);
+    pt->axes[7] = ((pt->dpad >> 1) & 1) - (pt->dpad & 1);
+}
+
+static void handle_key(passthrough* pt, int code, int value) {
+    int bit = -1;
+    switch (code) {
+        case BTN_DPAD_UP: bit = 0; break;
+        case BTN_DPAD_DOWN: bit = 1; break;
+        case BTN_DPAD_LEFT: bit = 2; break;
+        case BTN_DPAD_RIGHT: bit = 3; break;
+    }
+
+    if (bit >= 0) {
+        if (value) pt->dpad |= 1 << bit;
+        else pt->dpad &= ~(1 << bit);
+        apply_dpad(pt);
+        return;
+    }
+
+    int index = uinput_button_index(code);
+    if (index < 0) return;
+    if (value) pt->buttons |= 1 << index;
+    else pt->buttons &= ~(1 << index);
+}
+
+static void handle_abs(passthrough* pt, int code, int value) {
+    if (code >= ABS_CNT) return;
+    int index = uinput_axis_index(target_axis(code));
+    if (index >= 0) pt->axes[index] = scale_axis(&pt->absinfo[code], index, value);
+}
+
+/**
+ * (Re)read the full device state, used on start and after SYN_DROPPED
+ */
+static void sync_state(passthrough* pt) {
+    unsigned long keys[NBITS(KEY_CNT)];
+    unsigned long abs_bits[NBITS(ABS_CNT)];
+    memset(keys, 0, sizeof(keys));
+    memset(abs_bits, 0, sizeof(abs_bits));
+
+    pt->buttons = 0;
+    pt->dpad = 0;
+    memset(pt->axes, 0, sizeof(pt->axes));
+
+    ioctl(pt->source_fd, EVIOCGKEY(sizeof(keys)), keys);
+    for (int code = BTN_GAMEPAD; code <= BTN_THUMBR; code++) {
+        if (TEST_BIT(code, keys)) handle_key(pt, code, 1);
+    }
+    for (int code = BTN_DPAD_UP; code <= BTN_DPAD_RIGHT; code++) {
+        if (TEST_BIT(code, keys)) handle_key(pt, code, 1);
+    }
+
+    ioctl(pt->source_fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+    for (int code = 0; code < ABS_CNT; code++) {
+        if (!TEST_BIT(code, abs_bits)) continue;
+        if (ioctl(pt->source_fd, EVIOCGABS(code), &pt->absinfo[code]) < 0) continue;
+        handle_abs(pt, code, pt->absinfo[code].value);
+    }
+}
+
+static void* passthrough_thread(void* arg) {
+    passthrough* pt = arg;
+    struct input_event events[EVENT_BATCH];
+    struct pollfd fds[2] = {
+        {.fd = pt->source_fd, .events = POLLIN},
+        {.fd = pt->wake_fd[0], .events = POLLIN}
+    };
+    int dropped = 0;
+
+    // Applies to the calling thread on Linux; failure just leaves the default priority
+    setpriority(PRIO_PROCESS, 0, PASSTHROUGH_NICE);
+
+    sync_state(pt);
+    uinput_send_state(pt->controller_id, pt->buttons, pt->axes);
+
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOGE("poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents) break;
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            LOGI("Controller %d source disconnected", pt->controller_id);
+            break;
+        }
+
+        ssize_t size = read(pt->source_fd, events, sizeof(events));
+        if (size < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            LOGE("read failed: %s", strerror(errno));
+            break;
+        }
+
+        int count = size / sizeof(struct input_event);
+        for (int i = 0; i < count; i++) {
+            struct input_event* ev = &events[i];
+            if (ev->type == EV_SYN) {
+                if (ev->code == SYN_DROPPED) {
+                    dropped = 1;
+                }
+                else if (ev->code == SYN_REPORT) {
+                    if (dropped) {
+                        sync_state(pt);
+                        dropped = 0;
+                    }
+                    uinput_send_state(pt->controller_id, pt->buttons, pt->axes);
+                }
+            }
+            else if (dropped) {
+                // Discard until the next SYN_REPORT, then resync
+                continue;
+            }
+            else if (ev->type == EV_KEY) {
+                handle_key(pt, ev->code, ev->value);
+            }
+            else if (ev->type == EV_ABS) {
+                handle_abs(pt, ev->code, ev->value);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Find the evdev node of a physical gamepad
+ *
+ * Virtual devices created through uinput have no phys path and are skipped,
+ * so our own Xbox 360 pads never match even with identical VID/PID.
+ *
+ * @return Opened fd (O_RDONLY | O_NONBLOCK) on success, -1 if not found or not accessible
+ */
+static int open_evdev(int vendor_id, int product_id) {
+    DIR* dir = opendir("/dev/input");
+    if (!dir) {
+        LOGE("Failed to open /dev/input: %s", strerror(errno));
+        return -1;
+    }
+
+    int result = -1;
+    struct dirent* entry;
+    while (result < 0 && (entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "event", 5) != 0) continue;
+
+        char path[64];
+        snprintf(path, sizeof(path), "/dev/input/%s", entry->d_name);
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) continue;
+
+        struct input_id id;
+        char phys[64] = {0};
+        unsigned long keys[NBITS(KEY_CNT)];
+        memset(keys, 0, sizeof(keys));
+
+        if (ioctl(fd, EVIOCGID, &id) == 0 && id.vendor == vendor_id && id.product == product_id &&
+            ioctl(fd, EVIOCGPHYS(sizeof(phys) - 1), phys) > 0 && phys[0] != '\0' &&
+            ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0 && TEST_BIT(BTN_GAMEPAD, keys)) {
+            LOGI("Found gamepad %04x:%04x at %s", vendor_id, product_id, path);
+            result = fd;
+        }
+        else close(fd);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+/**
+ * Start forwarding a physical gamepad to a virtual controller
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ * @param vendor_id Physical device vendor ID (InputDevice.getVendorId())
+ * @param product_id Physical device product ID (InputDevice.getProductId())
+ * @param grab 1 to take the node exclusively (Android stops seeing its events)
+ * @return 0 on success, -1 on failure
+ */
+int uinput_passthrough_start(int controller_id, int vendor_id, int product_id, int grab) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) {
+        LOGE("Invalid controller id %d", controller_id);
+        return -1;
+    }
+
+    passthrough* pt = &passthroughs[controller_id];
+    if (pt->active) {
+        LOGI("Passthrough already active for controller %d", controller_id);
+        return 0;
+    }
+
+    int fd = open_evdev(vendor_id, product_id);
+    if (fd < 0) {
+        LOGE("No accessible evdev node for %04x:%04x", vendor_id, product_id);
+        return -1;
+    }
+
+    if (grab && ioctl(fd, EVIOCGRAB, 1) < 0) {
+        LOGE("Failed to grab evdev node: %s", strerror(errno));
+    }
+
+    if (pipe2(pt->wake_fd, O_CLOEXEC) < 0) {
+        LOGE("Failed to create wake pipe: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    memset(pt->absinfo, 0, sizeof(pt->absinfo));
+    pt->controller_id = controller_id;
+    pt->source_fd = fd;
+
+    if (pthread_create(&pt->thread, NULL, passthrough_thread, pt) != 0) {
+        LOGE("Failed to start passthrough thread");
+        close(pt->wake_fd[0]);
+        close(pt->wake_fd[1]);
+        close(fd);
+        return -1;
+    }
+
+    pt->active = 1;
+    LOGI("Passthrough started: %04x:%04x → controller %d", vendor_id, product_id, controller_id);
+    return 0;
+}
+
+/**
+ * Stop the passthrough thread of a virtual controller (no-op if not running)
+ *
+ * @param controller_id Handle returned by uinput_create_xbox360_controller()
+ */
+void uinput_passthrough_stop(int controller_id) {
+    if (controller_id < 0 || controller_id >= MAX_CONTROLLERS) return;
+
+    passthrough* pt = &passthroughs[controller_id];
+    if (!pt->active) return;
+
+    char wake = 1;
+    write(pt->wake_fd[1], &wake, 1);
+    pthread_join(pt->thread, NULL);
+
+    close(pt->wake_fd[0]);
+    close(pt->wake_fd[1]);
+    close(pt->source_fd);
+    pt->active = 0;
+
+    LOGI("Passthrough stopped for controller %d", controller_id);
+}
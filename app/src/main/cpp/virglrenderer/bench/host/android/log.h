@@ -0,0 +1,20 @@
+#ifndef VREND_BENCH_ANDROID_LOG_H
+#define VREND_BENCH_ANDROID_LOG_H
+
+/* the part of the NDK log API the renderer uses, printed to stderr */
+
+enum {
+   ANDROID_LOG_UNKNOWN,
+   ANDROID_LOG_DEFAULT,
+   ANDROID_LOG_VERBOSE,
+   ANDROID_LOG_DEBUG,
+   ANDROID_LOG_INFO,
+   ANDROID_LOG_WARN,
+   ANDROID_LOG_ERROR,
+   ANDROID_LOG_FATAL,
+};
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+   __attribute__((format(printf, 3, 4)));
+
+#endif
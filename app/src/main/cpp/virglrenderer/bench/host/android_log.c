@@ -0,0 +1,18 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <android/log.h>
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+   va_list va;
+   int ret;
+
+   (void)prio;
+   fprintf(stderr, "%s: ", tag);
+   va_start(va, fmt);
+   ret = vfprintf(stderr, fmt, va);
+   va_end(va);
+   fputc('\n', stderr);
+   return ret;
+}
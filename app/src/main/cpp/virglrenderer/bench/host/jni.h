@@ -0,0 +1,6 @@
+#ifndef VREND_BENCH_JNI_H
+#define VREND_BENCH_JNI_H
+
+/* vrend_util.h includes jni.h but uses nothing from it */
+
+#endif
@@ -0,0 +1,589 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "pipe/p_defines.h"
+#include "pipe/p_format.h"
+#include "virgl_protocol.h"
+#include "virgl_server_protocol.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#endif
+
+/*
+ * Transport benchmark: a synthetic client speaking virgl_server_protocol.h
+ * to a running server, by default the one of the guest at /tmp/.virgl/V0.
+ * Transfers of several sizes, transfer batches, submit streams of state
+ * only and of clear commands, over the socket and over the shared memory
+ * ring, and the bare round trip.  Every transfer is followed by a busy wait
+ * on its resource so it is timed until the server finished it; submits are
+ * streamed and waited for every BENCH_SUBMIT_WINDOW messages.  Server CPU
+ * time is read from /proc for the pid behind the socket, so it includes
+ * whatever else the server process does meanwhile.
+ */
+
+#define BENCH_DEFAULT_SOCKET "/tmp/.virgl/V0"
+#define BENCH_DEFAULT_MILLIS 1000
+#define BENCH_SUBMIT_WINDOW 64
+#define BENCH_BATCH_RECORDS 32
+#define BENCH_STATE_CMDS 16
+#define BENCH_CLEAR_SIZE 256
+#define BENCH_RING_SIZE (1024 * 1024)
+
+#define BENCH_SURFACE_HANDLE 1
+
+struct bench_client {
+   int fd;
+   pid_t server_pid;
+   uint32_t next_handle;
+   /* shared memory ring, NULL unless it was negotiated */
+   struct virgl_server_ring_header *ring;
+   uint32_t *ring_data;
+   uint32_t ring_size_dw;
+   size_t ring_map_size;
+};
+
+struct bench_resource {
+   uint32_t handle;
+   uint32_t size;
+   void *shm;
+};
+
+struct bench_result {
+   uint64_t messages;
+   uint64_t bytes;
+   uint64_t ns;
+   uint64_t server_ns;
+};
+
+static uint64_t now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* user + system time of the server process, 0 if it can't be read */
+static uint64_t server_cpu_ns(pid_t pid)
+{
+   unsigned long utime, stime;
+   char path[64], buf[1024], *p;
+   ssize_t len;
+   int fd;
+
+   snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return 0;
+   len = read(fd, buf, sizeof(buf) - 1);
+   close(fd);
+   if (len <= 0)
+      return 0;
+   buf[len] = '\0';
+
+   /* the fields after the parenthesized command name, utime is the 14th */
+   p = strrchr(buf, ')');
+   if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                    &utime, &stime) != 2)
+      return 0;
+   return (uint64_t)(utime + stime) * (1000000000ull / sysconf(_SC_CLK_TCK));
+}
+
+static bool bench_write(struct bench_client *client, const void *data, size_t size)
+{
+   const char *ptr = data;
+
+   while (size) {
+      ssize_t ret = send(client->fd, ptr, size, MSG_NOSIGNAL);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return false;
+      ptr += ret;
+      size -= ret;
+   }
+   return true;
+}
+
+static bool bench_read(struct bench_client *client, void *data, size_t size)
+{
+   char *ptr = data;
+
+   while (size) {
+      ssize_t ret = recv(client->fd, ptr, size, 0);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return false;
+      ptr += ret;
+      size -= ret;
+   }
+   return true;
+}
+
+static bool bench_send_cmd(struct bench_client *client, uint32_t cmd, const uint32_t *args, uint32_t ndw)
+{
+   uint32_t header[2] = { ndw, cmd };
+
+   return bench_write(client, header, sizeof(header)) &&
+          (!ndw || bench_write(client, args, ndw * 4));
+}
+
+/* the server passes fds with a single byte of payload */
+static int bench_recv_fd(struct bench_client *client)
+{
+   char buf[CMSG_SPACE(sizeof(int))], c;
+   struct iovec iov = { &c, 1 };
+   struct msghdr msg = { 0 };
+   struct cmsghdr *cmsg;
+   int fd;
+
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = buf;
+   msg.msg_controllen = sizeof(buf);
+   if (recvmsg(client->fd, &msg, 0) != 1)
+      return -1;
+
+   cmsg = CMSG_FIRSTHDR(&msg);
+   if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      return -1;
+   memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+   return fd;
+}
+
+static bool bench_connect(struct bench_client *client, const char *path)
+{
+   struct sockaddr_un addr = { .sun_family = AF_UNIX };
+   struct ucred cred;
+   socklen_t cred_len = sizeof(cred);
+
+   memset(client, 0, sizeof(*client));
+   client->next_handle = BENCH_SURFACE_HANDLE + 1;
+   client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (client->fd < 0)
+      return false;
+
+   strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+   if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      fprintf(stderr, "connect %s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   if (getsockopt(client->fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0)
+      client->server_pid = cred.pid;
+
+   return bench_send_cmd(client, VCMD_CREATE_RENDERER, NULL, 0);
+}
+
+/* a busy wait is answered once every earlier message was handled */
+static bool bench_busy_wait(struct bench_client *client, uint32_t handle, uint32_t flags)
+{
+   uint32_t args[2] = { handle, flags };
+   uint32_t reply[3];
+
+   return bench_send_cmd(client, VCMD_RESOURCE_BUSY_WAIT, args, 2) &&
+          bench_read(client, reply, sizeof(reply)) && reply[1] == VCMD_RESOURCE_BUSY_WAIT;
+}
+
+static bool bench_resource_create(struct bench_client *client, struct bench_resource *res,
+                                  uint32_t target, uint32_t format, uint32_t bind,
+                                  uint32_t width, uint32_t height, uint32_t size)
+{
+   uint32_t args[11] = { 0 };
+   int fd;
+
+   res->handle = client->next_handle++;
+   res->size = size;
+   args[0] = res->handle;
+   args[1] = target;
+   args[2] = format;
+   args[3] = bind;
+   args[4] = width;
+   args[5] = height;
+   args[6] = 1;
+   args[7] = 1;
+   args[10] = size;
+   if (!bench_send_cmd(client, VCMD_RESOURCE_CREATE, args, 11))
+      return false;
+
+   fd = bench_recv_fd(client);
+   if (fd < 0)
+      return false;
+   res->shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (res->shm == MAP_FAILED)
+      return false;
+
+   memset(res->shm, 0x5a, size);
+   return true;
+}
+
+static void bench_resource_destroy(struct bench_client *client, struct bench_resource *res)
+{
+   bench_send_cmd(client, VCMD_RESOURCE_DESTROY, &res->handle, 1);
+   munmap(res->shm, res->size);
+}
+
+static bool bench_ring_create(struct bench_client *client)
+{
+   uint32_t size = BENCH_RING_SIZE;
+   uint32_t reply[3];
+   void *ptr;
+   int fd;
+
+   if (!bench_send_cmd(client, VCMD_RING_CREATE, &size, 1) ||
+       !bench_read(client, reply, sizeof(reply)) || reply[2] != 0)
+      return false;
+
+   fd = bench_recv_fd(client);
+   if (fd < 0)
+      return false;
+
+   /* the header says how large the server made the data area */
+   ptr = mmap(NULL, VIRGL_SERVER_RING_DATA_OFFSET, PROT_READ, MAP_SHARED, fd, 0);
+   if (ptr == MAP_FAILED) {
+      close(fd);
+      return false;
+   }
+   size = ((struct virgl_server_ring_header *)ptr)->size;
+   munmap(ptr, VIRGL_SERVER_RING_DATA_OFFSET);
+
+   client->ring_map_size = VIRGL_SERVER_RING_DATA_OFFSET + size;
+   ptr = mmap(NULL, client->ring_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (ptr == MAP_FAILED)
+      return false;
+
+   client->ring = ptr;
+   client->ring_data = (uint32_t *)((char *)ptr + VIRGL_SERVER_RING_DATA_OFFSET);
+   client->ring_size_dw = size / 4;
+   return true;
+}
+
+/* publishes one entry, waiting for the server to make room if needed */
+static bool bench_ring_submit(struct bench_client *client, const uint32_t *cmds, uint32_t ndw)
+{
+   struct virgl_server_ring_header *ring = client->ring;
+   uint32_t head = ring->head;
+   uint32_t i;
+
+   if (ndw + 1 > client->ring_size_dw)
+      return false;
+
+   while (client->ring_size_dw - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) < ndw + 1) {
+      if (__atomic_exchange_n(&ring->server_idle, 0, __ATOMIC_SEQ_CST) &&
+          !bench_send_cmd(client, VCMD_RING_KICK, NULL, 0))
+         return false;
+      sched_yield();
+   }
+
+   client->ring_data[head & (client->ring_size_dw - 1)] = ndw;
+   for (i = 0; i < ndw; i++)
+      client->ring_data[(head + 1 + i) & (client->ring_size_dw - 1)] = cmds[i];
+   __atomic_store_n(&ring->head, head + 1 + ndw, __ATOMIC_SEQ_CST);
+
+   if (__atomic_exchange_n(&ring->server_idle, 0, __ATOMIC_SEQ_CST))
+      return bench_send_cmd(client, VCMD_RING_KICK, NULL, 0);
+   return true;
+}
+
+struct bench_case;
+typedef bool (*bench_step)(struct bench_client *client, const struct bench_case *bc,
+                           struct bench_resource *res, struct bench_result *result);
+
+struct bench_case {
+   const char *name;
+   bench_step step;
+   /* resource size for transfers, 0 for the submit cases */
+   uint32_t size;
+   bool ring;
+};
+
+static void bench_fill_transfer(uint32_t *args, const struct bench_resource *res,
+                                uint32_t offset, uint32_t size)
+{
+   memset(args, 0, VCMD_TRANSFER_ARGS * 4);
+   args[0] = res->handle;
+   args[2] = offset;
+   args[5] = size;
+   args[6] = 1;
+   args[7] = 1;
+   args[9] = offset;
+}
+
+static bool step_transfer(struct bench_client *client, uint32_t cmd,
+                          struct bench_resource *res, struct bench_result *result)
+{
+   uint32_t args[VCMD_TRANSFER_ARGS];
+
+   bench_fill_transfer(args, res, 0, res->size);
+   if (!bench_send_cmd(client, cmd, args, VCMD_TRANSFER_ARGS) ||
+       !bench_busy_wait(client, res->handle, VCMD_BUSY_WAIT_FLAG_WAIT))
+      return false;
+
+   result->messages++;
+   result->bytes += res->size;
+   return true;
+}
+
+static bool step_put(struct bench_client *client, const struct bench_case *bc,
+                     struct bench_resource *res, struct bench_result *result)
+{
+   return step_transfer(client, VCMD_TRANSFER_PUT, res, result);
+}
+
+static bool step_get(struct bench_client *client, const struct bench_case *bc,
+                     struct bench_resource *res, struct bench_result *result)
+{
+   return step_transfer(client, VCMD_TRANSFER_GET, res, result);
+}
+
+/* the resource uploaded in BENCH_BATCH_RECORDS slices with one message */
+static bool step_put_batch(struct bench_client *client, const struct bench_case *bc,
+                           struct bench_resource *res, struct bench_result *result)
+{
+   uint32_t records[BENCH_BATCH_RECORDS * VCMD_TRANSFER_BATCH_RECORD];
+   uint32_t slice = res->size / BENCH_BATCH_RECORDS;
+   int i;
+
+   for (i = 0; i < BENCH_BATCH_RECORDS; i++) {
+      uint32_t *record = records + i * VCMD_TRANSFER_BATCH_RECORD;
+      record[0] = VCMD_TRANSFER_PUT;
+      bench_fill_transfer(record + 1, res, i * slice, slice);
+   }
+
+   if (!bench_send_cmd(client, VCMD_TRANSFER_BATCH, records, ARRAY_SIZE(records)) ||
+       !bench_busy_wait(client, res->handle, VCMD_BUSY_WAIT_FLAG_WAIT))
+      return false;
+
+   result->messages++;
+   result->bytes += slice * BENCH_BATCH_RECORDS;
+   return true;
+}
+
+static bool step_ping(struct bench_client *client, const struct bench_case *bc,
+                      struct bench_resource *res, struct bench_result *result)
+{
+   if (!bench_busy_wait(client, res->handle, 0))
+      return false;
+
+   result->messages++;
+   return true;
+}
+
+/* BENCH_SUBMIT_WINDOW submits of cmds, then a busy wait for all of them */
+static bool bench_submit_window(struct bench_client *client, const struct bench_case *bc,
+                                struct bench_resource *res, const uint32_t *cmds, uint32_t ndw,
+                                struct bench_result *result)
+{
+   int i;
+
+   for (i = 0; i < BENCH_SUBMIT_WINDOW; i++) {
+      bool ok = bc->ring ? bench_ring_submit(client, cmds, ndw) :
+                           bench_send_cmd(client, VCMD_SUBMIT_CMD, cmds, ndw);
+      if (!ok)
+         return false;
+   }
+   if (!bench_busy_wait(client, res->handle, 0))
+      return false;
+
+   result->messages += BENCH_SUBMIT_WINDOW;
+   result->bytes += (uint64_t)BENCH_SUBMIT_WINDOW * ndw * 4;
+   return true;
+}
+
+/* decoded but leave the GPU idle, the decoder has no real no-op */
+static bool step_submit_state(struct bench_client *client, const struct bench_case *bc,
+                              struct bench_resource *res, struct bench_result *result)
+{
+   uint32_t cmds[BENCH_STATE_CMDS * 2];
+   int i;
+
+   for (i = 0; i < BENCH_STATE_CMDS; i++) {
+      cmds[i * 2] = VIRGL_CMD0(VIRGL_CCMD_SET_STENCIL_REF, 0, VIRGL_SET_STENCIL_REF_SIZE);
+      cmds[i * 2 + 1] = i;
+   }
+   return bench_submit_window(client, bc, res, cmds, ARRAY_SIZE(cmds), result);
+}
+
+static bool step_submit_clear(struct bench_client *client, const struct bench_case *bc,
+                              struct bench_resource *res, struct bench_result *result)
+{
+   uint32_t cmds[1 + VIRGL_OBJ_CLEAR_SIZE] = { 0 };
+   float color[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+
+   cmds[0] = VIRGL_CMD0(VIRGL_CCMD_CLEAR, 0, VIRGL_OBJ_CLEAR_SIZE);
+   cmds[VIRGL_OBJ_CLEAR_BUFFERS] = PIPE_CLEAR_COLOR0;
+   memcpy(&cmds[VIRGL_OBJ_CLEAR_COLOR_0], color, sizeof(color));
+   return bench_submit_window(client, bc, res, cmds, ARRAY_SIZE(cmds), result);
+}
+
+/* binds a render target for the clears */
+static bool bench_setup_framebuffer(struct bench_client *client, struct bench_resource *res)
+{
+   uint32_t cmds[1 + VIRGL_OBJ_SURFACE_SIZE + 1 + VIRGL_SET_FRAMEBUFFER_STATE_SIZE(1)];
+   uint32_t *p = cmds;
+
+   *p++ = VIRGL_CMD0(VIRGL_CCMD_CREATE_OBJECT, VIRGL_OBJECT_SURFACE, VIRGL_OBJ_SURFACE_SIZE);
+   *p++ = BENCH_SURFACE_HANDLE;
+   *p++ = res->handle;
+   *p++ = PIPE_FORMAT_B8G8R8A8_UNORM;
+   *p++ = 0;
+   *p++ = 0;
+   *p++ = VIRGL_CMD0(VIRGL_CCMD_SET_FRAMEBUFFER_STATE, 0, VIRGL_SET_FRAMEBUFFER_STATE_SIZE(1));
+   *p++ = 1;
+   *p++ = 0;
+   *p++ = BENCH_SURFACE_HANDLE;
+   return bench_send_cmd(client, VCMD_SUBMIT_CMD, cmds, ARRAY_SIZE(cmds)) &&
+          bench_busy_wait(client, res->handle, VCMD_BUSY_WAIT_FLAG_WAIT);
+}
+
+static const struct bench_case bench_cases[] = {
+   { "ping", step_ping, 0, false },
+   { "put", step_put, 4096, false },
+   { "put", step_put, 64 * 1024, false },
+   { "put", step_put, 1024 * 1024, false },
+   { "put", step_put, 8 * 1024 * 1024, false },
+   { "get", step_get, 4096, false },
+   { "get", step_get, 64 * 1024, false },
+   { "get", step_get, 1024 * 1024, false },
+   { "get", step_get, 8 * 1024 * 1024, false },
+   { "put_batch", step_put_batch, 64 * 1024, false },
+   { "put_batch", step_put_batch, 1024 * 1024, false },
+   { "submit_state", step_submit_state, 0, false },
+   { "submit_clear", step_submit_clear, 0, false },
+   { "ring_state", step_submit_state, 0, true },
+   { "ring_clear", step_submit_clear, 0, true },
+};
+
+static bool bench_run(struct bench_client *client, const struct bench_case *bc,
+                      struct bench_resource *target, uint64_t millis,
+                      struct bench_result *result)
+{
+   struct bench_resource buffer, *res = target;
+   uint64_t start, server_start, deadline;
+   bool ok = true;
+
+   memset(result, 0, sizeof(*result));
+   if (bc->size) {
+      if (!bench_resource_create(client, &buffer, PIPE_BUFFER, PIPE_FORMAT_R8_UNORM,
+                                 PIPE_BIND_VERTEX_BUFFER, bc->size, 1, bc->size))
+         return false;
+      res = &buffer;
+   }
+
+   /* one warm up step outside of the measurement */
+   if (!bc->step(client, bc, res, result))
+      ok = false;
+   memset(result, 0, sizeof(*result));
+
+   server_start = server_cpu_ns(client->server_pid);
+   start = now_ns();
+   deadline = start + millis * 1000000ull;
+   while (ok && now_ns() < deadline)
+      ok = bc->step(client, bc, res, result);
+   result->ns = now_ns() - start;
+   result->server_ns = server_cpu_ns(client->server_pid) - server_start;
+
+   if (bc->size)
+      bench_resource_destroy(client, &buffer);
+   return ok;
+}
+
+static void usage(const char *prog)
+{
+   fprintf(stderr, "usage: %s [-s socket] [-t millis] [filter]\n"
+           "  socket defaults to " BENCH_DEFAULT_SOCKET "\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+   const char *socket_path = BENCH_DEFAULT_SOCKET;
+   const char *filter = NULL;
+   uint64_t millis = BENCH_DEFAULT_MILLIS;
+   struct bench_client client;
+   struct bench_resource target;
+   bool have_ring;
+   int i;
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+         socket_path = argv[++i];
+      } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+         millis = strtoull(argv[++i], NULL, 10);
+      } else if (argv[i][0] == '-' || filter) {
+         usage(argv[0]);
+         return 1;
+      } else {
+         filter = argv[i];
+      }
+   }
+   if (!millis) {
+      usage(argv[0]);
+      return 1;
+   }
+
+   if (!bench_connect(&client, socket_path))
+      return 1;
+
+   /* the render target of the clears is also what pings and submits wait on */
+   if (!bench_resource_create(&client, &target, PIPE_TEXTURE_2D, PIPE_FORMAT_B8G8R8A8_UNORM,
+                              PIPE_BIND_RENDER_TARGET | PIPE_BIND_SAMPLER_VIEW,
+                              BENCH_CLEAR_SIZE, BENCH_CLEAR_SIZE,
+                              BENCH_CLEAR_SIZE * BENCH_CLEAR_SIZE * 4) ||
+       !bench_setup_framebuffer(&client, &target)) {
+      fprintf(stderr, "renderer setup failed\n");
+      return 1;
+   }
+   have_ring = bench_ring_create(&client);
+
+   printf("%-14s %10s %10s %10s %12s %12s\n",
+          "case", "size", "msgs", "MB/s", "us/msg", "server us");
+
+   for (i = 0; i < (int)ARRAY_SIZE(bench_cases); i++) {
+      const struct bench_case *bc = &bench_cases[i];
+      struct bench_result result;
+      char size[16] = "-";
+
+      if (filter && !strstr(bc->name, filter))
+         continue;
+      if (bc->size)
+         snprintf(size, sizeof(size), "%uK", bc->size / 1024);
+      if (bc->ring && !have_ring) {
+         printf("%-14s %10s no ring\n", bc->name, size);
+         continue;
+      }
+
+      if (!bench_run(&client, bc, &target, millis, &result) || !result.messages) {
+         printf("%-14s %10s failed, the server dropped the connection\n", bc->name, size);
+         return 1;
+      }
+
+      printf("%-14s %10s %10" PRIu64 " %10.1f %12.2f", bc->name, size, result.messages,
+             result.bytes / 1e6 / (result.ns / 1e9), result.ns / 1000.0 / result.messages);
+      if (client.server_pid && result.server_ns)
+         printf(" %12.2f\n", result.server_ns / 1000.0 / result.messages);
+      else
+         printf(" %12s\n", "-");
+      fflush(stdout);
+   }
+
+   bench_resource_destroy(&client, &target);
+   close(client.fd);
+   return 0;
+}
@@ -0,0 +1,388 @@
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "os/os_misc.h"
+#include "pipe/p_defines.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_memory.h"
+
+#include "vrend_shader.h"
+#include "vrend_shader_cache.h"
+
+/*
+ * Translation benchmark: every shader of the corpus is parsed from TGSI
+ * text once and then run through vrend_convert_shader() for each of the
+ * shader keys below that applies to its stage, reporting the mean time
+ * and allocations of one translation.  The shader cache is stubbed out so
+ * every iteration really translates.
+ */
+
+#define BENCH_MAX_TOKENS (64 * 1024)
+#define BENCH_MAX_SHADERS 256
+#define BENCH_DEFAULT_ITERATIONS 200
+
+#define STAGE_BIT(processor) (1u << (processor))
+#define ALL_STAGES (~0u)
+
+struct bench_shader {
+   char *name;
+   struct tgsi_token *tokens;
+   unsigned processor;
+};
+
+struct bench_key {
+   const char *name;
+   unsigned stages;
+   void (*setup)(struct vrend_shader_key *key);
+};
+
+static uint64_t alloc_count;
+static uint64_t alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+   alloc_count++;
+   alloc_bytes += size;
+   return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+   alloc_count++;
+   alloc_bytes += nmemb * size;
+   return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+   alloc_count++;
+   alloc_bytes += size;
+   return __real_realloc(ptr, size);
+}
+
+/* the translator consults the shader cache first, always miss */
+uint64_t vrend_shader_cache_hash(UNUSED const struct vrend_shader_cfg *cfg,
+                                 UNUSED const struct tgsi_token *tokens,
+                                 UNUSED uint32_t req_local_mem,
+                                 UNUSED const struct vrend_shader_key *key,
+                                 UNUSED const struct pipe_stream_output_info *so_info)
+{
+   return 0;
+}
+
+bool vrend_shader_cache_lookup(UNUSED uint64_t hash, UNUSED struct vrend_shader_info *sinfo,
+                               UNUSED struct vrend_strarray *shader)
+{
+   return false;
+}
+
+void vrend_shader_cache_store(UNUSED uint64_t hash, UNUSED const struct vrend_shader_info *sinfo,
+                              UNUSED const struct vrend_strarray *shader)
+{
+}
+
+static void key_default(UNUSED struct vrend_shader_key *key)
+{
+}
+
+static void key_clip_planes(struct vrend_shader_key *key)
+{
+   key->clip_plane_enable = 0x3f;
+}
+
+static void key_gs_present(struct vrend_shader_key *key)
+{
+   key->gs_present = true;
+}
+
+static void key_alpha_test(struct vrend_shader_key *key)
+{
+   key->add_alpha_test = true;
+   key->alpha_test = PIPE_FUNC_GEQUAL;
+   key->alpha_ref_val = 0.5f;
+}
+
+static void key_two_side_flat(struct vrend_shader_key *key)
+{
+   key->color_two_side = true;
+   key->flatshade = true;
+}
+
+static void key_bgr_output(struct vrend_shader_key *key)
+{
+   key->fs_swizzle_output_rgb_to_bgr = 1;
+}
+
+static void key_vertex_fetch(struct vrend_shader_key *key)
+{
+   key->vs_attrib_zyxw_bitmask = 1 << 2;
+   key->vs_attrib_r11g11b10_bitmask = 1 << 1;
+}
+
+static const struct bench_key bench_keys[] = {
+   { "default", ALL_STAGES, key_default },
+   { "ucp", STAGE_BIT(TGSI_PROCESSOR_VERTEX), key_clip_planes },
+   { "gs", STAGE_BIT(TGSI_PROCESSOR_VERTEX), key_gs_present },
+   { "alpha", STAGE_BIT(TGSI_PROCESSOR_FRAGMENT), key_alpha_test },
+   { "twoside", STAGE_BIT(TGSI_PROCESSOR_FRAGMENT), key_two_side_flat },
+   { "bgr", STAGE_BIT(TGSI_PROCESSOR_FRAGMENT), key_bgr_output },
+   { "vfetch", STAGE_BIT(TGSI_PROCESSOR_VERTEX), key_vertex_fetch },
+};
+
+static uint64_t now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static char *read_file(const char *path)
+{
+   FILE *fp = fopen(path, "rb");
+   char *text = NULL;
+   long size;
+
+   if (!fp)
+      return NULL;
+
+   if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 &&
+       fseek(fp, 0, SEEK_SET) == 0) {
+      text = malloc(size + 1);
+      if (text && fread(text, 1, size, fp) != (size_t)size) {
+         free(text);
+         text = NULL;
+      } else if (text) {
+         text[size] = '\0';
+      }
+   }
+   fclose(fp);
+   return text;
+}
+
+static bool load_shader(const char *path, struct bench_shader *shader)
+{
+   struct tgsi_parse_context parse;
+   const char *base = strrchr(path, '/');
+   char *text = read_file(path);
+
+   if (!text) {
+      fprintf(stderr, "%s: can not read\n", path);
+      return false;
+   }
+
+   shader->tokens = calloc(BENCH_MAX_TOKENS, sizeof(struct tgsi_token));
+   if (!shader->tokens || !tgsi_text_translate(text, shader->tokens, BENCH_MAX_TOKENS)) {
+      fprintf(stderr, "%s: not valid TGSI\n", path);
+      free(shader->tokens);
+      free(text);
+      return false;
+   }
+   free(text);
+
+   tgsi_parse_init(&parse, shader->tokens);
+   shader->processor = parse.FullHeader.Processor.Processor;
+   tgsi_parse_free(&parse);
+
+   shader->name = strdup(base ? base + 1 : path);
+   return true;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+   return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* loads path itself or, for a directory, every *.tgsi in it by name */
+static void load_path(const char *path, struct bench_shader *shaders, int *num_shaders)
+{
+   char *names[BENCH_MAX_SHADERS];
+   int num_names = 0;
+   struct dirent *entry;
+   DIR *dir = opendir(path);
+   int i;
+
+   if (!dir) {
+      if (*num_shaders < BENCH_MAX_SHADERS &&
+          load_shader(path, &shaders[*num_shaders]))
+         (*num_shaders)++;
+      return;
+   }
+
+   while ((entry = readdir(dir)) && num_names < BENCH_MAX_SHADERS) {
+      size_t len = strlen(entry->d_name);
+
+      if (len > 5 && !strcmp(entry->d_name + len - 5, ".tgsi"))
+         names[num_names++] = strdup(entry->d_name);
+   }
+   closedir(dir);
+
+   qsort(names, num_names, sizeof(names[0]), compare_names);
+   for (i = 0; i < num_names; i++) {
+      char file[4096];
+
+      snprintf(file, sizeof(file), "%s/%s", path, names[i]);
+      if (*num_shaders < BENCH_MAX_SHADERS &&
+          load_shader(file, &shaders[*num_shaders]))
+         (*num_shaders)++;
+      free(names[i]);
+   }
+}
+
+static void free_shader_info(struct vrend_shader_info *sinfo)
+{
+   uint32_t i;
+
+   if (sinfo->so_names) {
+      for (i = 0; i < sinfo->so_info.num_outputs; i++)
+         free(sinfo->so_names[i]);
+   }
+   free(sinfo->so_names);
+   free(sinfo->interpinfo);
+   free(sinfo->sampler_arrays);
+   free(sinfo->image_arrays);
+}
+
+struct bench_result {
+   uint64_t ns;
+   uint64_t allocs;
+   uint64_t bytes;
+   size_t glsl_size;
+};
+
+/* returns false if the translation fails */
+static bool bench_run(struct vrend_shader_cfg *cfg, const struct bench_shader *shader,
+                      const struct bench_key *bkey, int iterations,
+                      struct bench_result *result)
+{
+   struct vrend_shader_key key;
+   int i, j;
+
+   memset(result, 0, sizeof(*result));
+
+   for (i = 0; i < iterations; i++) {
+      struct vrend_shader_info sinfo;
+      struct vrend_strarray glsl;
+      uint64_t start, count, bytes;
+      bool ok;
+
+      memset(&key, 0, sizeof(key));
+      bkey->setup(&key);
+      memset(&sinfo, 0, sizeof(sinfo));
+      if (!strarray_alloc(&glsl, SHADER_MAX_STRINGS))
+         return false;
+
+      count = alloc_count;
+      bytes = alloc_bytes;
+      start = now_ns();
+      ok = vrend_convert_shader(NULL, cfg, shader->tokens, 0, &key, &sinfo, &glsl, NULL);
+      result->ns += now_ns() - start;
+      result->allocs += alloc_count - count;
+      result->bytes += alloc_bytes - bytes;
+
+      if (ok && i == 0) {
+         for (j = 0; j < glsl.num_strings; j++)
+            result->glsl_size += strbuf_get_len(&glsl.strings[j]);
+      }
+
+      strarray_free(&glsl, ok);
+      free_shader_info(&sinfo);
+      if (!ok)
+         return false;
+   }
+   return true;
+}
+
+static void usage(const char *prog)
+{
+   fprintf(stderr, "usage: %s [-n iterations] [-g glsl_version] [file.tgsi|dir...]\n"
+                   "without paths the corpus in %s is used\n",
+           prog, VREND_BENCH_CORPUS_DIR);
+}
+
+int main(int argc, char **argv)
+{
+   static struct bench_shader shaders[BENCH_MAX_SHADERS];
+   struct vrend_shader_cfg cfg = {
+      .glsl_version = 320,
+      .max_draw_buffers = 8,
+      .use_explicit_locations = true,
+      .has_es31_compat = true,
+   };
+   int iterations = BENCH_DEFAULT_ITERATIONS;
+   int num_shaders = 0;
+   uint64_t total_ns = 0, total_allocs = 0, total_bytes = 0;
+   int runs = 0, failures = 0;
+   bool have_paths = false;
+   int i, k;
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+         iterations = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+         cfg.glsl_version = atoi(argv[++i]);
+      } else if (argv[i][0] == '-') {
+         usage(argv[0]);
+         return 1;
+      } else {
+         load_path(argv[i], shaders, &num_shaders);
+         have_paths = true;
+      }
+   }
+   if (!have_paths)
+      load_path(VREND_BENCH_CORPUS_DIR, shaders, &num_shaders);
+
+   if (!num_shaders || iterations <= 0) {
+      usage(argv[0]);
+      return 1;
+   }
+
+   printf("%-28s %-8s %10s %10s %10s %8s\n",
+          "shader", "key", "us", "allocs", "KiB", "glsl");
+
+   for (i = 0; i < num_shaders; i++) {
+      for (k = 0; k < (int)ARRAY_SIZE(bench_keys); k++) {
+         struct bench_result result;
+
+         if (!(bench_keys[k].stages & STAGE_BIT(shaders[i].processor)))
+            continue;
+
+         if (!bench_run(&cfg, &shaders[i], &bench_keys[k], iterations, &result)) {
+            printf("%-28s %-8s translation failed\n", shaders[i].name, bench_keys[k].name);
+            failures++;
+            continue;
+         }
+
+         printf("%-28s %-8s %10.2f %10.1f %10.1f %8zu\n",
+                shaders[i].name, bench_keys[k].name,
+                result.ns / 1000.0 / iterations,
+                (double)result.allocs / iterations,
+                result.bytes / 1024.0 / iterations,
+                result.glsl_size);
+
+         total_ns += result.ns / iterations;
+         total_allocs += result.allocs / iterations;
+         total_bytes += result.bytes / iterations;
+         runs++;
+      }
+   }
+
+   printf("\n%d translations of %d shaders: %.2f us, %llu allocs, %.1f KiB per corpus pass\n",
+          runs, num_shaders, total_ns / 1000.0,
+          (unsigned long long)total_allocs, total_bytes / 1024.0);
+
+   for (i = 0; i < num_shaders; i++) {
+      free(shaders[i].name);
+      free(shaders[i].tokens);
+   }
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <EGL/egl.h>
+
+#include "util/u_memory.h"
+#include "virgl_protocol.h"
+#include "vrend_handle_table.h"
+#include "vrend_renderer.h"
+
+#include "virgl_server.h"
+#include "virgl_server_protocol.h"
+#include "virgl_server_trace.h"
+
+/* the renderer headers send printf to logcat, the report goes to stdout */
+#undef printf
+
+/*
+ * Replays a trace captured by virgl_server_trace.c without the guest.
+ *
+ * Requests run on an offscreen EGL pbuffer context through the same
+ * vrend_renderer calls the server makes, guest memory lives in plain
+ * allocations filled from the trace's shm records.  Submissions are
+ * decoded one command at a time so the CPU time of every VIRGL_CCMD_*
+ * can be reported next to the frame times and a few GL call counts.
+ * With -s every frame ends with glFinish and so includes the GPU time.
+ */
+
+#define REPLAY_CTX_ID 1
+#define REPLAY_TRANSFER_CHUNK 32
+
+/* wrapped with -Wl,--wrap in CMakeLists.txt, keep both lists in sync */
+#define REPLAY_GL_CALLS(X)                                                        \
+   X(glDrawArrays, (GLenum a, GLint b, GLsizei c), (a, b, c))                     \
+   X(glDrawElements, (GLenum a, GLsizei b, GLenum c, const void *d), (a, b, c, d)) \
+   X(glDrawRangeElements, (GLenum a, GLuint b, GLuint c, GLsizei d, GLenum e,     \
+                           const void *f), (a, b, c, d, e, f))                    \
+   X(glDrawArraysInstanced, (GLenum a, GLint b, GLsizei c, GLsizei d), (a, b, c, d)) \
+   X(glDrawElementsInstanced, (GLenum a, GLsizei b, GLenum c, const void *d,      \
+                               GLsizei e), (a, b, c, d, e))                       \
+   X(glDrawElementsBaseVertex, (GLenum a, GLsizei b, GLenum c, const void *d,     \
+                                GLint e), (a, b, c, d, e))                        \
+   X(glDrawRangeElementsBaseVertex, (GLenum a, GLuint b, GLuint c, GLsizei d,     \
+                                     GLenum e, const void *f, GLint g),           \
+                                    (a, b, c, d, e, f, g))                        \
+   X(glDrawElementsInstancedBaseVertex, (GLenum a, GLsizei b, GLenum c,           \
+                                         const void *d, GLsizei e, GLint f),      \
+                                        (a, b, c, d, e, f))                       \
+   X(glBufferSubData, (GLenum a, GLintptr b, GLsizeiptr c, const void *d), (a, b, c, d)) \
+   X(glTexSubImage2D, (GLenum a, GLint b, GLint c, GLint d, GLsizei e, GLsizei f, \
+                       GLenum g, GLenum h, const void *i), (a, b, c, d, e, f, g, h, i)) \
+   X(glTexSubImage3D, (GLenum a, GLint b, GLint c, GLint d, GLint e, GLsizei f,   \
+                       GLsizei g, GLsizei h, GLenum i, GLenum j, const void *k),  \
+                      (a, b, c, d, e, f, g, h, i, j, k))                          \
+   X(glReadPixels, (GLint a, GLint b, GLsizei c, GLsizei d, GLenum e, GLenum f,   \
+                    void *g), (a, b, c, d, e, f, g))                              \
+   X(glUseProgram, (GLuint a), (a))                                               \
+   X(glBindTexture, (GLenum a, GLuint b), (a, b))                                 \
+   X(glBindFramebuffer, (GLenum a, GLuint b), (a, b))                             \
+   X(glCompileShader, (GLuint a), (a))                                            \
+   X(glLinkProgram, (GLuint a), (a))
+
+#define GL_CALL_ENUM(name, params, args) GL_CALL_##name,
+enum { REPLAY_GL_CALLS(GL_CALL_ENUM) GL_CALL_COUNT };
+
+#define GL_CALL_NAME(name, params, args) #name,
+static const char *gl_call_names[GL_CALL_COUNT] = { REPLAY_GL_CALLS(GL_CALL_NAME) };
+
+static uint64_t gl_calls[GL_CALL_COUNT];
+
+#define GL_CALL_WRAP(name, params, args)              \
+   void __real_##name params;                         \
+   void __wrap_##name params                          \
+   {                                                  \
+      gl_calls[GL_CALL_##name]++;                     \
+      __real_##name args;                             \
+   }
+REPLAY_GL_CALLS(GL_CALL_WRAP)
+
+static const char *ccmd_names[VIRGL_MAX_COMMANDS] = {
+   [VIRGL_CCMD_NOP] = "NOP",
+   [VIRGL_CCMD_CREATE_OBJECT] = "CREATE_OBJECT",
+   [VIRGL_CCMD_BIND_OBJECT] = "BIND_OBJECT",
+   [VIRGL_CCMD_DESTROY_OBJECT] = "DESTROY_OBJECT",
+   [VIRGL_CCMD_SET_VIEWPORT_STATE] = "SET_VIEWPORT_STATE",
+   [VIRGL_CCMD_SET_FRAMEBUFFER_STATE] = "SET_FRAMEBUFFER_STATE",
+   [VIRGL_CCMD_SET_VERTEX_BUFFERS] = "SET_VERTEX_BUFFERS",
+   [VIRGL_CCMD_CLEAR] = "CLEAR",
+   [VIRGL_CCMD_DRAW_VBO] = "DRAW_VBO",
+   [VIRGL_CCMD_RESOURCE_INLINE_WRITE] = "RESOURCE_INLINE_WRITE",
+   [VIRGL_CCMD_SET_SAMPLER_VIEWS] = "SET_SAMPLER_VIEWS",
+   [VIRGL_CCMD_SET_INDEX_BUFFER] = "SET_INDEX_BUFFER",
+   [VIRGL_CCMD_SET_CONSTANT_BUFFER] = "SET_CONSTANT_BUFFER",
+   [VIRGL_CCMD_SET_STENCIL_REF] = "SET_STENCIL_REF",
+   [VIRGL_CCMD_SET_BLEND_COLOR] = "SET_BLEND_COLOR",
+   [VIRGL_CCMD_SET_SCISSOR_STATE] = "SET_SCISSOR_STATE",
+   [VIRGL_CCMD_BLIT] = "BLIT",
+   [VIRGL_CCMD_RESOURCE_COPY_REGION] = "RESOURCE_COPY_REGION",
+   [VIRGL_CCMD_BIND_SAMPLER_STATES] = "BIND_SAMPLER_STATES",
+   [VIRGL_CCMD_BEGIN_QUERY] = "BEGIN_QUERY",
+   [VIRGL_CCMD_END_QUERY] = "END_QUERY",
+   [VIRGL_CCMD_GET_QUERY_RESULT] = "GET_QUERY_RESULT",
+   [VIRGL_CCMD_SET_POLYGON_STIPPLE] = "SET_POLYGON_STIPPLE",
+   [VIRGL_CCMD_SET_CLIP_STATE] = "SET_CLIP_STATE",
+   [VIRGL_CCMD_SET_SAMPLE_MASK] = "SET_SAMPLE_MASK",
+   [VIRGL_CCMD_SET_STREAMOUT_TARGETS] = "SET_STREAMOUT_TARGETS",
+   [VIRGL_CCMD_SET_RENDER_CONDITION] = "SET_RENDER_CONDITION",
+   [VIRGL_CCMD_SET_UNIFORM_BUFFER] = "SET_UNIFORM_BUFFER",
+   [VIRGL_CCMD_SET_SUB_CTX] = "SET_SUB_CTX",
+   [VIRGL_CCMD_CREATE_SUB_CTX] = "CREATE_SUB_CTX",
+   [VIRGL_CCMD_DESTROY_SUB_CTX] = "DESTROY_SUB_CTX",
+   [VIRGL_CCMD_BIND_SHADER] = "BIND_SHADER",
+   [VIRGL_CCMD_SET_TESS_STATE] = "SET_TESS_STATE",
+   [VIRGL_CCMD_SET_MIN_SAMPLES] = "SET_MIN_SAMPLES",
+   [VIRGL_CCMD_SET_SHADER_BUFFERS] = "SET_SHADER_BUFFERS",
+   [VIRGL_CCMD_SET_SHADER_IMAGES] = "SET_SHADER_IMAGES",
+   [VIRGL_CCMD_MEMORY_BARRIER] = "MEMORY_BARRIER",
+   [VIRGL_CCMD_LAUNCH_GRID] = "LAUNCH_GRID",
+   [VIRGL_CCMD_SET_FRAMEBUFFER_STATE_NO_ATTACH] = "SET_FRAMEBUFFER_STATE_NO_ATTACH",
+   [VIRGL_CCMD_TEXTURE_BARRIER] = "TEXTURE_BARRIER",
+   [VIRGL_CCMD_SET_ATOMIC_BUFFERS] = "SET_ATOMIC_BUFFERS",
+   [VIRGL_CCMD_SET_DEBUG_FLAGS] = "SET_DEBUG_FLAGS",
+   [VIRGL_CCMD_GET_QUERY_RESULT_QBO] = "GET_QUERY_RESULT_QBO",
+   [VIRGL_CCMD_TRANSFER3D] = "TRANSFER3D",
+   [VIRGL_CCMD_END_TRANSFERS] = "END_TRANSFERS",
+   [VIRGL_CCMD_COPY_TRANSFER3D] = "COPY_TRANSFER3D",
+   [VIRGL_CCMD_SET_TWEAKS] = "SET_TWEAKS",
+};
+
+struct replay_stat {
+   uint64_t count;
+   uint64_t ns;
+};
+
+struct replay {
+   struct virgl_client client;
+   EGLDisplay display;
+   EGLConfig config;
+   EGLSurface surface;
+   EGLContext context;
+   bool sync_frames;
+
+   /* handle -> struct iovec, guest memory rebuilt from the trace */
+   struct vrend_handle_table *iovecs;
+   uint32_t next_fence_id;
+
+   struct replay_stat ccmds[VIRGL_MAX_COMMANDS];
+   uint64_t *frame_ns;
+   uint32_t num_frames;
+   uint32_t frame_alloc;
+   uint64_t frame_start;
+};
+
+static uint64_t now_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct replay *replay_from_client(struct virgl_client *client)
+{
+   return (struct replay *)((char *)client - offsetof(struct replay, client));
+}
+
+static void replay_write_fence(UNUSED struct virgl_client *client, UNUSED unsigned fence_id)
+{
+}
+
+static virgl_gl_context replay_create_context(struct virgl_client *client)
+{
+   struct replay *replay = replay_from_client(client);
+   static const EGLint ctx_att[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+
+   return (virgl_gl_context)eglCreateContext(replay->display, replay->config,
+                                             replay->context, ctx_att);
+}
+
+static void replay_destroy_context(struct virgl_client *client, virgl_gl_context ctx)
+{
+   eglDestroyContext(replay_from_client(client)->display, (EGLContext)ctx);
+}
+
+static int replay_make_current(struct virgl_client *client, virgl_gl_context ctx)
+{
+   struct replay *replay = replay_from_client(client);
+
+   return eglMakeCurrent(replay->display, replay->surface, replay->surface, (EGLContext)ctx);
+}
+
+static struct vrend_if_cbs replay_cbs = {
+   .write_fence = replay_write_fence,
+   .create_gl_context = replay_create_context,
+   .destroy_gl_context = replay_destroy_context,
+   .make_current = replay_make_current,
+};
+
+static bool replay_egl_init(struct replay *replay)
+{
+   static const EGLint conf_att[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_NONE,
+   };
+   static const EGLint pbuffer_att[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+   static const EGLint ctx_att[] = { EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE };
+   EGLint num_configs;
+
+   replay->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+   if (replay->display == EGL_NO_DISPLAY || !eglInitialize(replay->display, NULL, NULL))
+      return false;
+
+   if (!eglBindAPI(EGL_OPENGL_ES_API) ||
+       !eglChooseConfig(replay->display, conf_att, &replay->config, 1, &num_configs) ||
+       num_configs != 1)
+      return false;
+
+   replay->surface = eglCreatePbufferSurface(replay->display, replay->config, pbuffer_att);
+   replay->context = eglCreateContext(replay->display, replay->config, EGL_NO_CONTEXT, ctx_att);
+   if (replay->surface == EGL_NO_SURFACE || replay->context == EGL_NO_CONTEXT)
+      return false;
+
+   return eglMakeCurrent(replay->display, replay->surface, replay->surface, replay->context);
+}
+
+static void free_iovec(void *value)
+{
+   struct iovec *iovec = value;
+
+   free(iovec->iov_base);
+   free(iovec);
+}
+
+static void replay_fence(struct replay *replay)
+{
+   vrend_renderer_create_fence(&replay->client, ++replay->next_fence_id, REPLAY_CTX_ID);
+   vrend_renderer_check_fences(&replay->client);
+}
+
+static void replay_resource_create(struct replay *replay, const uint32_t *args, uint32_t ndw)
+{
+   struct vrend_renderer_resource_create_args create;
+   struct iovec *iovec;
+
+   if (ndw < 11 || vrend_handle_table_get(replay->iovecs, args[0]))
+      return;
+
+   create.handle = args[0];
+   create.target = args[1];
+   create.format = args[2];
+   create.bind = args[3];
+   create.width = args[4];
+   create.height = args[5];
+   create.depth = args[6];
+   create.array_size = args[7];
+   create.last_level = args[8];
+   create.nr_samples = args[9];
+   create.flags = 0;
+
+   if (vrend_renderer_resource_create(&replay->client, &create, NULL, 0))
+      return;
+   vrend_renderer_attach_res_ctx(&replay->client, REPLAY_CTX_ID, create.handle);
+
+   iovec = CALLOC_STRUCT(iovec);
+   if (!iovec)
+      return;
+   iovec->iov_len = args[10];
+   iovec->iov_base = iovec->iov_len ? calloc(1, iovec->iov_len) : NULL;
+
+   vrend_renderer_resource_attach_iov(&replay->client, create.handle, iovec, 1);
+   vrend_handle_table_set(replay->iovecs, create.handle, iovec);
+}
+
+static void replay_resource_destroy(struct replay *replay, const uint32_t *args, uint32_t ndw)
+{
+   if (ndw < 1)
+      return;
+
+   vrend_renderer_attach_res_ctx(&replay->client, REPLAY_CTX_ID, args[0]);
+   vrend_renderer_resource_detach_iov(&replay->client, args[0], NULL, NULL);
+   vrend_handle_table_remove(replay->iovecs, args[0]);
+   vrend_renderer_resource_unref(&replay->client, args[0]);
+}
+
+static void replay_shm(struct replay *replay, const uint32_t *args, uint32_t ndw)
+{
+   struct iovec *iovec;
+
+   if (ndw < VIRGL_SERVER_TRACE_SHM_HEADER ||
+       (uint64_t)args[2] > (ndw - VIRGL_SERVER_TRACE_SHM_HEADER) * 4ull)
+      return;
+
+   iovec = vrend_handle_table_get(replay->iovecs, args[0]);
+   if (!iovec || (uint64_t)args[1] + args[2] > iovec->iov_len)
+      return;
+
+   memcpy((char *)iovec->iov_base + args[1], args + VIRGL_SERVER_TRACE_SHM_HEADER, args[2]);
+}
+
+/* same as virgl_server_fill_transfer() */
+static void replay_fill_transfer(const uint32_t *args, struct pipe_box *box,
+                                 struct vrend_transfer_info *info)
+{
+   box->x = args[2];
+   box->y = args[3];
+   box->z = args[4];
+   box->width = args[5];
+   box->height = args[6];
+   box->depth = args[7];
+
+   memset(info, 0, sizeof(*info));
+   info->handle = args[0];
+   info->ctx_id = REPLAY_CTX_ID;
+   info->level = args[1];
+   info->box = box;
+   info->offset = args[9];
+   info->context0 = true;
+}
+
+static void replay_transfer(struct replay *replay, const uint32_t *args, uint32_t ndw, int mode)
+{
+   struct vrend_transfer_info info;
+   struct pipe_box box;
+
+   if (ndw < VCMD_TRANSFER_ARGS || !vrend_handle_table_get(replay->iovecs, args[0]))
+      return;
+
+   replay_fill_transfer(args, &box, &info);
+   vrend_renderer_transfer_iov(&replay->client, &info, mode);
+}
+
+static void replay_transfer_batch(struct replay *replay, const uint32_t *buf, uint32_t ndw)
+{
+   struct vrend_transfer_info infos[REPLAY_TRANSFER_CHUNK];
+   struct pipe_box boxes[REPLAY_TRANSFER_CHUNK];
+   int modes[REPLAY_TRANSFER_CHUNK];
+   uint32_t i;
+   int n = 0;
+
+   for (i = 0; i + VCMD_TRANSFER_BATCH_RECORD <= ndw; i += VCMD_TRANSFER_BATCH_RECORD) {
+      const uint32_t *args = buf + i;
+
+      if ((args[0] != VCMD_TRANSFER_GET && args[0] != VCMD_TRANSFER_PUT) ||
+          !vrend_handle_table_get(replay->iovecs, args[1]))
+         continue;
+
+      replay_fill_transfer(args + 1, &boxes[n], &infos[n]);
+      modes[n] = args[0] == VCMD_TRANSFER_GET ? VIRGL_TRANSFER_FROM_HOST : VIRGL_TRANSFER_TO_HOST;
+      if (++n == REPLAY_TRANSFER_CHUNK) {
+         vrend_renderer_transfer_iov_batch(&replay->client, infos, modes, n);
+         n = 0;
+      }
+   }
+
+   if (n)
+      vrend_renderer_transfer_iov_batch(&replay->client, infos, modes, n);
+}
+
+static void replay_submit(struct replay *replay, uint32_t *cbuf, uint32_t ndw)
+{
+   uint32_t offset = 0;
+
+   while (offset < ndw) {
+      uint32_t header = cbuf[offset];
+      uint32_t len = header >> 16;
+      uint32_t cmd = header & 0xff;
+      uint64_t start;
+
+      if (offset + len + 1 > ndw)
+         break;
+
+      start = now_ns();
+      vrend_decode_block(&replay->client, REPLAY_CTX_ID, cbuf + offset, len + 1);
+      if (cmd < VIRGL_MAX_COMMANDS) {
+         replay->ccmds[cmd].ns += now_ns() - start;
+         replay->ccmds[cmd].count++;
+      }
+      offset += len + 1;
+   }
+}
+
+static void replay_end_frame(struct replay *replay)
+{
+   uint64_t now;
+
+   vrend_renderer_end_frame(&replay->client);
+   replay_fence(replay);
+   if (replay->sync_frames)
+      glFinish();
+
+   now = now_ns();
+   if (replay->num_frames == replay->frame_alloc) {
+      uint32_t alloc = MAX2(replay->frame_alloc * 2, 1024);
+      uint64_t *frames = realloc(replay->frame_ns, alloc * sizeof(uint64_t));
+
+      if (!frames)
+         return;
+      replay->frame_ns = frames;
+      replay->frame_alloc = alloc;
+   }
+   replay->frame_ns[replay->num_frames++] = now - replay->frame_start;
+   replay->frame_start = now;
+}
+
+static void replay_record(struct replay *replay, uint32_t cmd, uint32_t *payload, uint32_t ndw)
+{
+   switch (cmd) {
+   case VCMD_RESOURCE_CREATE:
+      replay_resource_create(replay, payload, ndw);
+      break;
+   case VCMD_RESOURCE_DESTROY:
+      replay_resource_destroy(replay, payload, ndw);
+      break;
+   case VIRGL_SERVER_TRACE_SHM:
+      replay_shm(replay, payload, ndw);
+      break;
+   case VCMD_TRANSFER_GET:
+      replay_transfer(replay, payload, ndw, VIRGL_TRANSFER_FROM_HOST);
+      break;
+   case VCMD_TRANSFER_PUT:
+      replay_transfer(replay, payload, ndw, VIRGL_TRANSFER_TO_HOST);
+      break;
+   case VCMD_TRANSFER_BATCH:
+      replay_transfer_batch(replay, payload, ndw);
+      break;
+   case VCMD_SUBMIT_CMD:
+      replay_submit(replay, payload, ndw);
+      break;
+   case VCMD_RESOURCE_BUSY_WAIT:
+      /* the guest waited here, so does the replay */
+      replay_fence(replay);
+      vrend_renderer_wait_fence(&replay->client, replay->next_fence_id, UINT64_MAX);
+      break;
+   case VCMD_FLUSH_FRONTBUFFER:
+      replay_end_frame(replay);
+      break;
+   default:
+      break;
+   }
+
+   /* back to context 0 like virgl_server_execute_request() */
+   if (cmd != VCMD_SUBMIT_CMD && cmd != VCMD_RESOURCE_BUSY_WAIT)
+      vrend_renderer_force_ctx_0(&replay->client);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+static void replay_report(struct replay *replay, uint64_t total_ns)
+{
+   uint64_t sum = 0;
+   uint32_t i;
+
+   printf("%u frames in %.1f ms\n", replay->num_frames, total_ns / 1e6);
+   if (replay->num_frames) {
+      for (i = 0; i < replay->num_frames; i++)
+         sum += replay->frame_ns[i];
+      qsort(replay->frame_ns, replay->num_frames, sizeof(uint64_t), compare_u64);
+      printf("frame ms: mean %.3f  median %.3f  p99 %.3f  max %.3f\n",
+             sum / 1e6 / replay->num_frames,
+             replay->frame_ns[replay->num_frames / 2] / 1e6,
+             replay->frame_ns[(uint64_t)replay->num_frames * 99 / 100] / 1e6,
+             replay->frame_ns[replay->num_frames - 1] / 1e6);
+   }
+
+   printf("\n%-32s %10s %12s %10s\n", "command", "count", "total ms", "us each");
+   for (i = 0; i < VIRGL_MAX_COMMANDS; i++) {
+      struct replay_stat *stat = &replay->ccmds[i];
+
+      if (!stat->count)
+         continue;
+      printf("%-32s %10llu %12.3f %10.3f\n", ccmd_names[i] ? ccmd_names[i] : "?",
+             (unsigned long long)stat->count, stat->ns / 1e6,
+             stat->ns / 1e3 / stat->count);
+   }
+
+   printf("\n%-32s %10s\n", "GL call", "count");
+   for (i = 0; i < GL_CALL_COUNT; i++)
+      printf("%-32s %10llu\n", gl_call_names[i], (unsigned long long)gl_calls[i]);
+}
+
+int main(int argc, char **argv)
+{
+   struct virgl_server_trace_file_header header;
+   struct virgl_server_trace_record record;
+   struct replay *replay;
+   uint32_t *payload = NULL;
+   uint32_t payload_alloc = 0;
+   const char *path = NULL;
+   uint64_t start;
+   FILE *fp;
+   int i;
+
+   replay = CALLOC_STRUCT(replay);
+   if (!replay)
+      return 1;
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-s"))
+         replay->sync_frames = true;
+      else
+         path = argv[i];
+   }
+   if (!path) {
+      fprintf(stderr, "usage: %s [-s] trace\n", argv[0]);
+      return 1;
+   }
+
+   fp = fopen(path, "rb");
+   if (!fp || fread(&header, sizeof(header), 1, fp) != 1 ||
+       header.magic != VIRGL_SERVER_TRACE_MAGIC || header.version != VIRGL_SERVER_TRACE_VERSION) {
+      fprintf(stderr, "%s: not a virgl trace\n", path);
+      return 1;
+   }
+
+   if (!replay_egl_init(replay)) {
+      fprintf(stderr, "no EGL pbuffer context\n");
+      return 1;
+   }
+
+   replay->iovecs = vrend_handle_table_create(free_iovec);
+   if (vrend_renderer_init(&replay->client, &replay_cbs) ||
+       vrend_renderer_context_create(&replay->client, REPLAY_CTX_ID)) {
+      fprintf(stderr, "renderer init failed\n");
+      return 1;
+   }
+   replay->client.initialized = true;
+
+   start = replay->frame_start = now_ns();
+   while (fread(&record, sizeof(record), 1, fp) == 1) {
+      if (record.ndw > payload_alloc) {
+         uint32_t *buf = realloc(payload, record.ndw * sizeof(uint32_t));
+
+         if (!buf)
+            break;
+         payload = buf;
+         payload_alloc = record.ndw;
+      }
+      if (record.ndw && fread(payload, sizeof(uint32_t), record.ndw, fp) != record.ndw)
+         break;
+
+      replay_record(replay, record.cmd, payload, record.ndw);
+   }
+   glFinish();
+   replay_report(replay, now_ns() - start);
+
+   fclose(fp);
+   free(payload);
+   vrend_renderer_context_destroy(&replay->client, REPLAY_CTX_ID);
+   vrend_renderer_fini(&replay->client);
+   vrend_handle_table_destroy(replay->iovecs);
+   free(replay->frame_ns);
+   FREE(replay);
+   return 0;
+}
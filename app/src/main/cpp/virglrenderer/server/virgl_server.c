@@ -33,13 +33,103 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include <time.h>
 
 #include "util/u_memory.h"
+#include "os/os_thread.h"
+#include "native_trace.h"
 #include "virgl_server.h"
+#include "virgl_server_pipeline.h"
 #include "virgl_server_protocol.h"
 
+#define VIRGL_SERVER_DEFAULT_RENDER_THREADS 4
+
+/* longest an idle client thread sleeps on a fence fd */
+#define VIRGL_SERVER_FENCE_POLL_TIMEOUT_MS 100
+
 struct jni_info jni_info;
 
+/* Every client is served by its own thread, at most max_render_threads
+ * of them decode at the same time */
+pipe_static_mutex(server_lock);
+static pipe_semaphore render_slots;
+static int max_render_threads;
+
+/* bumped for every trim request, each client catches up on its next request */
+static uint32_t trim_generation;
+static int trim_level;
+
+JNIEnv *virgl_server_jni_env(void)
+{
+   JNIEnv *env = NULL;
+
+   if ((*jni_info.vm)->GetEnv(jni_info.vm, (void **)&env, JNI_VERSION_1_6) != JNI_OK)
+      (*jni_info.vm)->AttachCurrentThread(jni_info.vm, &env, NULL);
+   return env;
+}
+
+void virgl_server_set_thread_role(int role)
+{
+   static void (*register_role)(int);
+
+   /* looked up until libwinlator is loaded, then cached */
+   if (!register_role) {
+      void *handle = dlopen("libwinlator.so", RTLD_NOW | RTLD_NOLOAD);
+      if (!handle)
+         return;
+      register_role = (void (*)(int))dlsym(handle, "ThreadRoles_register");
+      if (!register_role)
+         return;
+   }
+   register_role(role);
+}
+
+static void virgl_server_init_jni(JNIEnv *env, jobject obj)
+{
+   jclass cls;
+
+   pipe_mutex_lock(server_lock);
+   if (jni_info.obj && (*env)->IsSameObject(env, jni_info.obj, obj)) {
+      pipe_mutex_unlock(server_lock);
+      return;
+   }
+
+   if (jni_info.obj)
+      (*env)->DeleteGlobalRef(env, jni_info.obj);
+
+   (*env)->GetJavaVM(env, &jni_info.vm);
+   jni_info.obj = (*env)->NewGlobalRef(env, obj);
+
+   cls = (*env)->GetObjectClass(env, obj);
+   jni_info.kill_connection = (*env)->GetMethodID(env, cls, "killConnection", "(I)V");
+   jni_info.get_shared_egl_context = (*env)->GetMethodID(env, cls, "getSharedEGLContext", "()J");
+   jni_info.flush_frontbuffer = (*env)->GetMethodID(env, cls, "flushFrontbuffer", "(II)V");
+   jni_info.flush_frontbuffer_hardware_buffer = (*env)->GetMethodID(env, cls, "flushFrontbufferHardwareBuffer", "(IJJ)V");
+   jni_info.get_program_cache_dir = (*env)->GetMethodID(env, cls, "getProgramCacheDir", "()Ljava/lang/String;");
+   jni_info.get_shader_variant_log = (*env)->GetMethodID(env, cls, "getShaderVariantLog", "()Ljava/lang/String;");
+   jni_info.get_shader_compile_threads = (*env)->GetMethodID(env, cls, "getShaderCompileThreads", "()I");
+   jni_info.get_skip_draws_until_ready = (*env)->GetMethodID(env, cls, "getSkipDrawsUntilReady", "()Z");
+   jni_info.get_max_render_threads = (*env)->GetMethodID(env, cls, "getMaxRenderThreads", "()I");
+   jni_info.get_async_readback = (*env)->GetMethodID(env, cls, "getAsyncReadback", "()Z");
+   jni_info.get_pipelined_decode = (*env)->GetMethodID(env, cls, "getPipelinedDecode", "()Z");
+   jni_info.get_constant_buffer_ubo = (*env)->GetMethodID(env, cls, "getConstantBufferUbo", "()Z");
+   jni_info.get_separable_programs = (*env)->GetMethodID(env, cls, "getSeparablePrograms", "()Z");
+   jni_info.get_trace_dir = (*env)->GetMethodID(env, cls, "getTraceDir", "()Ljava/lang/String;");
+   jni_info.get_decode_stats_enabled = (*env)->GetMethodID(env, cls, "getDecodeStatsEnabled", "()Z");
+   (*env)->DeleteLocalRef(env, cls);
+
+   if (!max_render_threads) {
+      max_render_threads = (*env)->CallIntMethod(env, jni_info.obj, jni_info.get_max_render_threads);
+      if (max_render_threads <= 0)
+         max_render_threads = VIRGL_SERVER_DEFAULT_RENDER_THREADS;
+      pipe_semaphore_init(&render_slots, max_render_threads);
+   }
+   pipe_mutex_unlock(server_lock);
+}
+
 static struct virgl_client *virgl_server_handle_new_connection(int fd)
 {
    struct virgl_client *client = calloc(1, sizeof(struct virgl_client));
@@ -50,40 +140,52 @@ static struct virgl_client *virgl_server_handle_new_connection(int fd)
 
 static void virgl_server_kill_connection(struct virgl_client *client)
 {
-   (*jni_info.env)->CallVoidMethod(jni_info.env, jni_info.obj, jni_info.kill_connection, client->fd);
+   JNIEnv *env = virgl_server_jni_env();
+   (*env)->CallVoidMethod(env, jni_info.obj, jni_info.kill_connection, client->fd);
 }
 
 static void virgl_server_destroy_client(struct virgl_client **client)
 {
+   virgl_server_pipeline_destroy(*client);
    virgl_server_destroy_renderer(*client);
+   vrend_decode_free_stats(*client);
 
    free(*client);
    *client = NULL;
 }
 
-static void virgl_server_handle_request(struct virgl_client *client)
+static bool virgl_server_has_pending_data(int fd)
 {
-   int ret;
-   uint32_t header[2];
+   int bytes = 0;
+   return ioctl(fd, FIONREAD, &bytes) == 0 && bytes > 0;
+}
 
-   ret = virgl_block_read(client->fd, &header, sizeof(header));
-   if (ret < 0 || (size_t)ret < sizeof(header)) {
-      virgl_server_kill_connection(client);
-      return;
-   }
+/* Runs a request whose header has been read, on the thread owning the
+ * client's GL context */
+static int virgl_server_execute_request(struct virgl_client *client, const uint32_t *header)
+{
+   int ret = 0;
 
    if (!client->initialized) {
-      if (header[1] != VCMD_CREATE_RENDERER) {
-         virgl_server_kill_connection(client);
-         return;
-      }
+      if (header[1] != VCMD_CREATE_RENDERER)
+         return -1;
 
       ret = virgl_server_create_renderer(client, header[0]);
       client->initialized = true;
    }
 
    vrend_renderer_check_fences(client);
-   
+
+   /* anything the client put in the ring precedes this command */
+   if (client->renderer && virgl_server_ring_process(client) < 0)
+      return -1;
+
+   /* submissions switch to their own context and fence waits work in any,
+    * everything else expects context 0 */
+   if (client->renderer && header[1] != VCMD_SUBMIT_CMD && header[1] != VCMD_RING_KICK &&
+       header[1] != VCMD_RESOURCE_BUSY_WAIT)
+      vrend_renderer_force_ctx_0(client);
+
    switch (header[1]) {
       case VCMD_GET_CAPS:
          ret = virgl_server_send_caps(client, header[0]);
@@ -109,29 +211,159 @@ static void virgl_server_handle_request(struct virgl_client *client)
       case VCMD_FLUSH_FRONTBUFFER:
          ret = virgl_server_flush_frontbuffer(client, header[0]);
          break;
+      case VCMD_RING_CREATE:
+         ret = virgl_server_ring_create_cmd(client, header[0]);
+         break;
+      case VCMD_RING_KICK:
+         ret = 0;
+         break;
+      case VCMD_TRANSFER_BATCH:
+         ret = virgl_server_transfer_batch(client, header[0]);
+         break;
    }
-   
+   return ret;
+}
+
+/* fence once the client stops streaming commands */
+void virgl_server_idle_fence(struct virgl_client *client)
+{
+   if (!virgl_server_has_pending_data(client->fd))
+      virgl_server_renderer_flush_fence(client);
+}
+
+void virgl_server_wait_fences(struct virgl_client *client, int wake_fd)
+{
+   struct pollfd pfds[2];
+   int ret;
+
+   for (;;) {
+      pfds[0].fd = wake_fd;
+      pfds[0].events = POLLIN;
+      pfds[1].fd = virgl_server_renderer_fence_fd(client);
+      pfds[1].events = POLLIN;
+      if (pfds[1].fd < 0)
+         return;
+
+      /* a fence that takes this long is left to the next request */
+      ret = poll(pfds, 2, VIRGL_SERVER_FENCE_POLL_TIMEOUT_MS);
+      if (ret == 0 || (ret < 0 && errno != EINTR) || pfds[0].revents)
+         return;
+
+      pipe_semaphore_wait(&render_slots);
+      vrend_renderer_check_fences(client);
+      pipe_semaphore_signal(&render_slots);
+      virgl_server_renderer_retire_fence_fds(client);
+   }
+}
+
+void virgl_server_check_trim(struct virgl_client *client)
+{
+   uint32_t generation = __atomic_load_n(&trim_generation, __ATOMIC_ACQUIRE);
+
+   if (generation == client->trim_generation || !client->renderer || !client->vrend_state)
+      return;
+
+   client->trim_generation = generation;
+   virgl_server_renderer_trim(client, __atomic_load_n(&trim_level, __ATOMIC_RELAXED));
+}
+
+static uint64_t virgl_server_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* request execution counts as the frame's work for the performance hints */
+static void virgl_server_add_work(struct virgl_client *client, uint64_t start)
+{
+   if (client->renderer)
+      virgl_server_hint_add_work(&client->renderer->hint, virgl_server_now_ns() - start);
+}
+
+int virgl_server_run_request(struct virgl_client *client, const uint32_t *header)
+{
+   uint64_t start;
+   int ret;
+
+   /* held back without a render slot, other clients keep decoding */
+   if (header[1] == VCMD_FLUSH_FRONTBUFFER && client->renderer)
+      virgl_server_pacer_wait(&client->renderer->pacer);
+
+   pipe_semaphore_wait(&render_slots);
+   start = virgl_server_now_ns();
+   virgl_server_check_trim(client);
+   ret = virgl_server_execute_request(client, header);
+   pipe_semaphore_signal(&render_slots);
+
+   virgl_server_add_work(client, start);
+   if (header[1] == VCMD_FLUSH_FRONTBUFFER && client->renderer)
+      virgl_server_hint_present(&client->renderer->hint);
+   return ret;
+}
+
+int virgl_server_run_submit(struct virgl_client *client, uint32_t *cbuf, uint32_t ndw)
+{
+   uint64_t start;
+   int ret = 0;
+
+   pipe_semaphore_wait(&render_slots);
+   start = virgl_server_now_ns();
+   virgl_server_check_trim(client);
+   vrend_renderer_check_fences(client);
+   if (virgl_server_ring_process(client) < 0)
+      ret = -1;
+   else
+      virgl_server_submit_block(client, cbuf, ndw);
+   pipe_semaphore_signal(&render_slots);
+
+   virgl_server_add_work(client, start);
+   return ret;
+}
+
+static void virgl_server_handle_request(struct virgl_client *client)
+{
+   int ret;
+   uint32_t header[2];
+   NATIVE_TRACE_SCOPE("virgl_server_handle_request");
+
+   ret = virgl_block_read(client->fd, &header, sizeof(header));
+   if (ret < 0 || (size_t)ret < sizeof(header)) {
+      virgl_server_kill_connection(client);
+      return;
+   }
+
+   if (client->pipelined && !client->pipeline)
+      client->pipeline = virgl_server_pipeline_create(client);
+
+   if (client->pipeline) {
+      ret = virgl_server_pipeline_request(client->pipeline, header);
+   } else {
+      ret = virgl_server_run_request(client, header);
+      if (ret >= 0) {
+         virgl_server_idle_fence(client);
+         virgl_server_wait_fences(client, client->fd);
+      }
+   }
+
    if (ret < 0)
       virgl_server_kill_connection(client);
 }
 
 JNIEXPORT jlong JNICALL
 Java_com_winlator_xenvironment_components_VirGLRendererComponent_handleNewConnection(JNIEnv *env, jobject obj, jint fd) {
-   jni_info.env = env;
-   jni_info.obj = obj;
-   
-   jclass cls = (*env)->GetObjectClass(env, obj);
-   jni_info.kill_connection = (*env)->GetMethodID(env, cls, "killConnection", "(I)V");
-   jni_info.get_shared_egl_context = (*env)->GetMethodID(env, cls, "getSharedEGLContext", "()J");
-   jni_info.flush_frontbuffer = (*env)->GetMethodID(env, cls, "flushFrontbuffer", "(II)V");
-   
-   return (jlong)virgl_server_handle_new_connection(fd);
+   struct virgl_client *client;
+
+   virgl_server_init_jni(env, obj);
+   client = virgl_server_handle_new_connection(fd);
+   client->pipelined = (*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_pipelined_decode);
+   if ((*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_decode_stats_enabled))
+      vrend_decode_enable_stats(client);
+   return (jlong)client;
 }
 
 JNIEXPORT void JNICALL
 Java_com_winlator_xenvironment_components_VirGLRendererComponent_handleRequest(JNIEnv *env, jobject obj, jlong clientPtr) {
-   jni_info.env = env;
-   jni_info.obj = obj;
    virgl_server_handle_request((struct virgl_client*)clientPtr);
 }
 
@@ -141,7 +373,63 @@ Java_com_winlator_xenvironment_components_VirGLRendererComponent_destroyClient(J
    virgl_server_destroy_client(&client);
 }
 
+JNIEXPORT void JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_trimMemory(JNIEnv *env, jobject obj, jint level) {
+   __atomic_store_n(&trim_level, level, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&trim_generation, 1, __ATOMIC_RELEASE);
+}
+
+JNIEXPORT void JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_setFrameRateLimitNative(JNIEnv *env, jobject obj, jint fps) {
+   virgl_server_pacer_set_limit(fps);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_getPresentationTime(JNIEnv *env, jobject obj) {
+   return (jlong)virgl_server_pacer_presentation_time();
+}
+
+JNIEXPORT void JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_getMemoryStats(JNIEnv *env, jobject obj, jlong clientPtr, jlongArray stats) {
+   struct virgl_client *client = (struct virgl_client*)clientPtr;
+   jlong values[3] = {0};
+
+   if (client->renderer) {
+      values[0] = __atomic_load_n(&client->renderer->gl_bytes, __ATOMIC_RELAXED);
+      values[1] = __atomic_load_n(&client->renderer->shm_bytes, __ATOMIC_RELAXED);
+      values[2] = __atomic_load_n(&client->renderer->shm_released_bytes, __ATOMIC_RELAXED);
+   }
+   (*env)->SetLongArrayRegion(env, stats, 0, 3, values);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_getDecodeCommandNamesNative(JNIEnv *env, jobject obj) {
+   jclass string_cls = (*env)->FindClass(env, "java/lang/String");
+   jobjectArray names = (*env)->NewObjectArray(env, VIRGL_MAX_COMMANDS, string_cls, NULL);
+   int cmd;
+
+   for (cmd = 0; names && cmd < VIRGL_MAX_COMMANDS; cmd++) {
+      jstring name = (*env)->NewStringUTF(env, vrend_decode_command_name(cmd));
+      (*env)->SetObjectArrayElement(env, names, cmd, name);
+      (*env)->DeleteLocalRef(env, name);
+   }
+   (*env)->DeleteLocalRef(env, string_cls);
+   return names;
+}
+
+JNIEXPORT void JNICALL
+Java_com_winlator_xenvironment_components_VirGLRendererComponent_getDecodeStats(JNIEnv *env, jobject obj, jlong clientPtr, jlongArray counts, jlongArray nanos, jboolean reset) {
+   struct virgl_client *client = (struct virgl_client*)clientPtr;
+   struct vrend_decode_stats stats;
+
+   vrend_decode_get_stats(client, &stats, reset);
+   (*env)->SetLongArrayRegion(env, counts, 0, VIRGL_MAX_COMMANDS, (const jlong *)stats.count);
+   (*env)->SetLongArrayRegion(env, nanos, 0, VIRGL_MAX_COMMANDS, (const jlong *)stats.ns);
+}
+
 JNIEXPORT void JNICALL
 Java_com_winlator_xenvironment_components_VirGLRendererComponent_destroyRenderer(JNIEnv *env, jobject obj, jlong clientPtr) {
-   virgl_server_destroy_renderer((struct virgl_client*)clientPtr);
+   struct virgl_client *client = (struct virgl_client*)clientPtr;
+   virgl_server_pipeline_destroy(client);
+   virgl_server_destroy_renderer(client);
 }
\ No newline at end of file
@@ -31,58 +31,182 @@
 #include <stdio.h>
 
 #include "vrend_renderer.h"
+#include "virgl_server_hint.h"
+#include "virgl_server_pacer.h"
+#include "virgl_server_ring.h"
+#include "virgl_server_shm.h"
+#include "virgl_server_trace.h"
 
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
 
 #define printf(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__);
 
+/* shared by every client thread, JNIEnv is per thread so use virgl_server_jni_env() */
 struct jni_info {
+   JavaVM *vm;
    jobject obj;
-   JNIEnv *env;
    jmethodID kill_connection;
    jmethodID get_shared_egl_context;
    jmethodID flush_frontbuffer;
+   jmethodID flush_frontbuffer_hardware_buffer;
+   jmethodID get_program_cache_dir;
+   jmethodID get_shader_variant_log;
+   jmethodID get_shader_compile_threads;
+   jmethodID get_skip_draws_until_ready;
+   jmethodID get_max_render_threads;
+   jmethodID get_async_readback;
+   jmethodID get_pipelined_decode;
+   jmethodID get_constant_buffer_ubo;
+   jmethodID get_separable_programs;
+   jmethodID get_trace_dir;
+   jmethodID get_decode_stats_enabled;
 };
 
-struct virgl_server_renderer {
-   struct util_hash_table *iovec_hash;
+/* native fence fds kept for the fences the GPU has not signaled yet,
+ * older ones are dropped and reported on the next request instead */
+#define VIRGL_SERVER_MAX_FENCE_FDS 8
+
+struct virgl_server_fence_fd {
+   uint32_t fence_id;
+   int fd;
+};
+
+/* presented resources, double/triple buffering alternates between a few */
+#define VIRGL_SERVER_FB_CACHE_SIZE 4
+
+struct virgl_server_fb_cache_entry {
+   uint32_t handle;
    GLuint framebuffer;
-   int handle;
+};
+
+/* presents whose GPU completion has not been reported to the frame
+ * statistics yet, later ones go unmeasured while it is full */
+#define VIRGL_SERVER_MAX_PENDING_FRAMES 4
+
+struct virgl_server_pending_frame {
+   uint32_t sequence;
+   /* the fence covering the frame's rendering */
+   uint32_t fence_id;
+};
+
+struct virgl_server_renderer {
+   struct vrend_handle_table *iovec_hash;
+   /* most recently presented first, unused entries have handle 0 */
+   struct virgl_server_fb_cache_entry fb_cache[VIRGL_SERVER_FB_CACHE_SIZE];
    int ctx_id;
    int fence_id;
    int last_fence_id;
+   /* submissions since the last fence, fenced once the client goes idle */
+   bool fence_pending;
+
+   /* command buffer reused across submissions */
+   uint32_t *cmd_buf;
+   uint32_t cmd_buf_size;
+
+   /* resource memfds released by the client, reused by later creates */
+   struct virgl_server_shm_pool shm_pool;
+
+   /* shared memory submission ring, if the client negotiated one */
+   struct virgl_server_ring ring;
+
+   /* command stream capture, NULL unless a trace directory is set */
+   struct virgl_server_trace *trace;
+
+   /* memory statistics, written by the GL thread and read by any thread
+    * through the atomic builtins; gl_bytes is refreshed every few frames */
+   uint64_t gl_bytes;
+   uint64_t shm_bytes;
+   uint64_t shm_released_bytes;
+   uint32_t stats_frames;
+
+   /* frame pacing statistics, see frame_stats_present() */
+   uint64_t frame_decode_ns;
+   struct virgl_server_pending_frame pending_frames[VIRGL_SERVER_MAX_PENDING_FRAMES];
+   int num_pending_frames;
+
+   /* frame rate limit state, see virgl_server_pacer.h */
+   struct virgl_server_pacer pacer;
+   /* Android performance hint session of the executing thread */
+   struct virgl_server_hint hint;
+
+   /* EGL_ANDROID_native_fence_sync fds of the outstanding fences, oldest first */
+   bool native_fence_sync;
+   struct virgl_server_fence_fd fence_fds[VIRGL_SERVER_MAX_FENCE_FDS];
+   int num_fence_fds;
 
    EGLDisplay egl_display;
    EGLConfig egl_conf;
    EGLContext egl_ctx;
+   /* the Java context egl_ctx shares with, see virgl_server_context_pool_take() */
+   EGLContext shared_egl_ctx;
+   /* blitter taken from or handed back to the context pool */
+   struct vrend_blitter_ctx *pooled_blit_ctx;
 };
 
 struct virgl_client {
    int fd;
    struct virgl_server_renderer *renderer;
    struct vrend_state *vrend_state;
-   struct util_hash_table *res_hash;
+   struct vrend_handle_table *res_hash;
    struct vrend_decode_ctx *dec_ctx[VREND_MAX_CTX];
    struct vrend_blitter_ctx *vrend_blit_ctx;
    bool initialized;
+   /* decode submissions on a separate GL thread, see virgl_server_pipeline.h */
+   bool pipelined;
+   struct virgl_server_pipeline *pipeline;
+   /* last virgl_server_trim generation handled */
+   uint32_t trim_generation;
+   /* per context decode counters, see vrend_decode_enable_stats() */
+   bool decode_stats_enabled;
+   struct vrend_decode_stats *decode_stats[VREND_MAX_CTX];
 };
 
 extern struct jni_info jni_info;
 
+JNIEnv *virgl_server_jni_env(void);
+
+/* thread roles of libwinlator (thread_roles.c), pinned by its policy */
+#define VIRGL_SERVER_THREAD_ROLE_GL 0
+#define VIRGL_SERVER_THREAD_ROLE_DECODE 1
+
+void virgl_server_set_thread_role(int role);
+
 int virgl_server_create_renderer(struct virgl_client *client, uint32_t length);
 int virgl_server_send_caps(struct virgl_client *client, uint32_t length);
 int virgl_server_resource_create(struct virgl_client *client, uint32_t length);
 int virgl_server_resource_destroy(struct virgl_client *client, uint32_t length);
 int virgl_server_transfer_get(struct virgl_client *client, uint32_t length);
 int virgl_server_transfer_put(struct virgl_client *client, uint32_t length);
+int virgl_server_transfer_batch(struct virgl_client *client, uint32_t length);
 int virgl_server_submit_cmd(struct virgl_client *client, uint32_t length);
 int virgl_server_resource_busy_wait(struct virgl_client *client, uint32_t length);
 int virgl_server_flush_frontbuffer(struct virgl_client *client, uint32_t length);
+int virgl_server_ring_create_cmd(struct virgl_client *client, uint32_t length);
+int virgl_server_ring_process(struct virgl_client *client);
 
 int virgl_block_read(int fd, void *buf, int size);
 
+/* called on the thread owning the client's GL context */
+int virgl_server_run_request(struct virgl_client *client, const uint32_t *header);
+int virgl_server_run_submit(struct virgl_client *client, uint32_t *cbuf, uint32_t ndw);
+void virgl_server_idle_fence(struct virgl_client *client);
+/* reports fences as the GPU signals them until wake_fd turns readable */
+void virgl_server_wait_fences(struct virgl_client *client, int wake_fd);
+void virgl_server_submit_block(struct virgl_client *client, uint32_t *cbuf, uint32_t ndw);
+
+/* ComponentCallbacks2 trim levels that release guest staging memory */
+#define VIRGL_SERVER_TRIM_RUNNING_CRITICAL 15
+
+/* applies a trim requested from Java, on the client's GL thread */
+void virgl_server_check_trim(struct virgl_client *client);
+void virgl_server_renderer_trim(struct virgl_client *client, int level);
+
 int virgl_server_renderer_create_fence(struct virgl_client *client);
+void virgl_server_renderer_flush_fence(struct virgl_client *client);
+/* fd of the oldest fence still outstanding, -1 if there is nothing to wait for */
+int virgl_server_renderer_fence_fd(struct virgl_client *client);
+void virgl_server_renderer_retire_fence_fds(struct virgl_client *client);
 
 void virgl_server_destroy_renderer(struct virgl_client *client);
 
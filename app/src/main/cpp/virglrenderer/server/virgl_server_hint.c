@@ -0,0 +1,81 @@
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#include "virgl_server_hint.h"
+#include "virgl_server_pacer.h"
+
+/* reported while neither a frame rate limit nor the refresh rate is known */
+#define VIRGL_SERVER_HINT_DEFAULT_TARGET_NS 16666667ULL
+
+typedef struct APerformanceHintManager APerformanceHintManager;
+typedef struct APerformanceHintSession APerformanceHintSession;
+
+static struct {
+   APerformanceHintManager *(*get_manager)(void);
+   APerformanceHintSession *(*create_session)(APerformanceHintManager *, const int32_t *, size_t, int64_t);
+   int (*update_target)(APerformanceHintSession *, int64_t);
+   int (*report_actual)(APerformanceHintSession *, int64_t);
+   void (*close_session)(APerformanceHintSession *);
+   APerformanceHintManager *manager;
+} adpf;
+
+static pthread_once_t adpf_once = PTHREAD_ONCE_INIT;
+
+static void hint_load(void)
+{
+   void *handle = dlopen("libandroid.so", RTLD_NOW);
+
+   if (!handle)
+      return;
+
+   adpf.get_manager = dlsym(handle, "APerformanceHint_getManager");
+   adpf.create_session = dlsym(handle, "APerformanceHint_createSession");
+   adpf.update_target = dlsym(handle, "APerformanceHint_updateTargetWorkDuration");
+   adpf.report_actual = dlsym(handle, "APerformanceHint_reportActualWorkDuration");
+   adpf.close_session = dlsym(handle, "APerformanceHint_closeSession");
+   if (adpf.get_manager && adpf.create_session && adpf.update_target &&
+       adpf.report_actual && adpf.close_session)
+      adpf.manager = adpf.get_manager();
+}
+
+void virgl_server_hint_present(struct virgl_server_hint *hint)
+{
+   uint64_t target = virgl_server_pacer_frame_interval();
+   uint64_t work = hint->work_ns;
+
+   hint->work_ns = 0;
+   if (hint->unavailable)
+      return;
+   if (!target)
+      target = VIRGL_SERVER_HINT_DEFAULT_TARGET_NS;
+
+   if (!hint->session) {
+      int32_t tid = gettid();
+
+      pthread_once(&adpf_once, hint_load);
+      if (adpf.manager)
+         hint->session = adpf.create_session(adpf.manager, &tid, 1, (int64_t)target);
+      if (!hint->session) {
+         hint->unavailable = true;
+         __android_log_print(ANDROID_LOG_INFO, "virgl_server", "no performance hint session for thread %d", tid);
+         return;
+      }
+      hint->target_ns = target;
+   } else if (target != hint->target_ns) {
+      adpf.update_target(hint->session, (int64_t)target);
+      hint->target_ns = target;
+   }
+
+   /* a frame without request execution, e.g. a repeated present, says nothing */
+   if (work)
+      adpf.report_actual(hint->session, (int64_t)work);
+}
+
+void virgl_server_hint_destroy(struct virgl_server_hint *hint)
+{
+   if (hint->session)
+      adpf.close_session(hint->session);
+   hint->session = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef VIRGL_SERVER_HINT_H
+#define VIRGL_SERVER_HINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Android performance hints (ADPF) for the thread executing a client's
+ * requests.
+ *
+ * The time that thread spends executing requests is summed up per frame
+ * and reported on every present together with the frame interval the
+ * client is paced to, so the CPU governor ramps the cores up for a frame
+ * that is about to miss it instead of clocking down between frames.
+ *
+ * APerformanceHint is API 33, it is looked up at runtime and everything
+ * here is a no-op on older systems.
+ */
+
+struct virgl_server_hint {
+   void *session;
+   bool unavailable;
+   uint64_t target_ns;
+   /* request execution time since the last present */
+   uint64_t work_ns;
+};
+
+static inline void virgl_server_hint_add_work(struct virgl_server_hint *hint, uint64_t ns)
+{
+   hint->work_ns += ns;
+}
+
+/* called on a present by the thread executing the client's requests */
+void virgl_server_hint_present(struct virgl_server_hint *hint);
+void virgl_server_hint_destroy(struct virgl_server_hint *hint);
+
+#endif
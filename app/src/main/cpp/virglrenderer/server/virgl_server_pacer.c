@@ -0,0 +1,193 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <android/choreographer.h>
+#include <android/log.h>
+#include <android/looper.h>
+
+#include <GLES2/gl2.h>
+
+#include "os/os_misc.h"
+#include "virgl_server_pacer.h"
+
+/* vsync tracking stops once no client presented for this long */
+#define VIRGL_SERVER_PACER_IDLE_NS 1000000000ULL
+/* older vsync timestamps are not trusted for alignment */
+#define VIRGL_SERVER_PACER_VSYNC_MAX_AGE_NS 100000000ULL
+/* refresh periods outside of this are missed or bogus callbacks */
+#define VIRGL_SERVER_PACER_MIN_PERIOD_NS 4000000ULL
+#define VIRGL_SERVER_PACER_MAX_PERIOD_NS 50000000ULL
+
+static int fps_limit;
+static uint64_t presentation_time_ns;
+
+/* written by the vsync thread, read by the client threads */
+static uint64_t vsync_ns;
+static uint64_t vsync_period_ns;
+static uint64_t last_present_ns;
+static bool vsync_active;
+
+static pthread_once_t vsync_once = PTHREAD_ONCE_INIT;
+static int vsync_wake_fd = -1;
+
+static uint64_t pacer_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void pacer_frame_callback(long frame_time_ns, void *data)
+{
+   AChoreographer *choreographer = data;
+   uint64_t frame_ns = (uint64_t)frame_time_ns;
+   uint64_t prev_ns = __atomic_load_n(&vsync_ns, __ATOMIC_RELAXED);
+   uint64_t period = __atomic_load_n(&vsync_period_ns, __ATOMIC_RELAXED);
+
+   /* a callback can skip vsyncs, so the delta is divided by the vsyncs
+    * it spans before it is averaged in */
+   if (prev_ns && frame_ns > prev_ns) {
+      uint64_t delta = frame_ns - prev_ns;
+      uint64_t n = period ? (delta + period / 2) / period : 1;
+
+      if (n >= 1 && delta / n >= VIRGL_SERVER_PACER_MIN_PERIOD_NS &&
+          delta / n <= VIRGL_SERVER_PACER_MAX_PERIOD_NS) {
+         period = period ? (period * 7 + delta / n) / 8 : delta;
+         __atomic_store_n(&vsync_period_ns, period, __ATOMIC_RELAXED);
+      }
+   }
+   __atomic_store_n(&vsync_ns, frame_ns, __ATOMIC_RELEASE);
+
+   if (pacer_now_ns() - __atomic_load_n(&last_present_ns, __ATOMIC_RELAXED) < VIRGL_SERVER_PACER_IDLE_NS)
+      AChoreographer_postFrameCallback(choreographer, pacer_frame_callback, choreographer);
+   else
+      __atomic_store_n(&vsync_active, false, __ATOMIC_RELEASE);
+}
+
+static int pacer_wake_callback(int fd, UNUSED int events, void *data)
+{
+   AChoreographer *choreographer = data;
+   uint64_t count;
+
+   if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+      return 1;
+
+   if (!__atomic_exchange_n(&vsync_active, true, __ATOMIC_ACQ_REL)) {
+      /* the gap since the last callback is no refresh period */
+      __atomic_store_n(&vsync_ns, 0, __ATOMIC_RELAXED);
+      AChoreographer_postFrameCallback(choreographer, pacer_frame_callback, choreographer);
+   }
+   return 1;
+}
+
+static void *pacer_vsync_thread(UNUSED void *arg)
+{
+   ALooper *looper = ALooper_prepare(0);
+   AChoreographer *choreographer = AChoreographer_getInstance();
+
+   if (!choreographer) {
+      __android_log_print(ANDROID_LOG_WARN, "virgl_server", "no AChoreographer, presents are not vsync aligned");
+      return NULL;
+   }
+
+   ALooper_addFd(looper, vsync_wake_fd, ALOOPER_POLL_CALLBACK, ALOOPER_EVENT_INPUT,
+                 pacer_wake_callback, choreographer);
+   for (;;)
+      ALooper_pollOnce(-1, NULL, NULL, NULL);
+   return NULL;
+}
+
+static void pacer_start_vsync_thread(void)
+{
+   pthread_t thread;
+
+   vsync_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (vsync_wake_fd < 0)
+      return;
+   if (pthread_create(&thread, NULL, pacer_vsync_thread, NULL) == 0)
+      pthread_detach(thread);
+}
+
+/* tracks vsync again after the clients were idle */
+static void pacer_wake_vsync(void)
+{
+   uint64_t one = 1;
+
+   pthread_once(&vsync_once, pacer_start_vsync_thread);
+   if (vsync_wake_fd >= 0 && !__atomic_load_n(&vsync_active, __ATOMIC_ACQUIRE))
+      write(vsync_wake_fd, &one, sizeof(one));
+}
+
+void virgl_server_pacer_set_limit(int fps)
+{
+   __atomic_store_n(&fps_limit, fps > 0 ? fps : 0, __ATOMIC_RELAXED);
+   if (fps <= 0)
+      __atomic_store_n(&presentation_time_ns, 0, __ATOMIC_RELAXED);
+}
+
+void virgl_server_pacer_wait(struct virgl_server_pacer *pacer)
+{
+   int fps = __atomic_load_n(&fps_limit, __ATOMIC_RELAXED);
+   uint64_t interval, now, target, wake, vsync, period;
+   struct timespec ts;
+
+   if (!fps) {
+      pacer->target_ns = 0;
+      return;
+   }
+
+   /* the GPU works through the frame while the present waits */
+   glFlush();
+
+   interval = 1000000000ULL / fps;
+   now = pacer_now_ns();
+   __atomic_store_n(&last_present_ns, now, __ATOMIC_RELAXED);
+   pacer_wake_vsync();
+
+   vsync = __atomic_load_n(&vsync_ns, __ATOMIC_ACQUIRE);
+   period = __atomic_load_n(&vsync_period_ns, __ATOMIC_RELAXED);
+   if (!vsync || !period || now - vsync > VIRGL_SERVER_PACER_VSYNC_MAX_AGE_NS)
+      period = 0;
+
+   /* a client that fell behind starts over instead of catching up */
+   target = pacer->target_ns + interval;
+   if (!pacer->target_ns || target < now + period)
+      target = now + period;
+   pacer->target_ns = target;
+
+   if (period) {
+      /* nearest vsync, at least half a period out for the composition */
+      target = vsync + (target - vsync + period / 2) / period * period;
+      if (target < now + period / 2)
+         target += period;
+      wake = target - period;
+   } else {
+      wake = target;
+   }
+   __atomic_store_n(&presentation_time_ns, period ? target : 0, __ATOMIC_RELAXED);
+
+   if (wake <= now)
+      return;
+
+   ts.tv_sec = wake / 1000000000ULL;
+   ts.tv_nsec = wake % 1000000000ULL;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+}
+
+uint64_t virgl_server_pacer_frame_interval(void)
+{
+   int fps = __atomic_load_n(&fps_limit, __ATOMIC_RELAXED);
+
+   if (fps)
+      return 1000000000ULL / fps;
+   return __atomic_load_n(&vsync_period_ns, __ATOMIC_RELAXED);
+}
+
+uint64_t virgl_server_pacer_presentation_time(void)
+{
+   return __atomic_load_n(&presentation_time_ns, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,41 @@
+#ifndef VIRGL_SERVER_PACER_H
+#define VIRGL_SERVER_PACER_H
+
+#include <stdint.h>
+
+/*
+ * Present scheduling for a frame rate limit.
+ *
+ * Clients have no reply to wait for on a present, so a limit is enforced
+ * by holding the present back: the thread serving the client sleeps
+ * before it runs VCMD_FLUSH_FRONTBUFFER, the guest's next requests queue
+ * up behind it and its fence waits stall, which throttles it without a
+ * protocol change.
+ *
+ * Presents are aligned to the display's vsync, tracked with AChoreographer
+ * on a thread of its own while clients present.  Each present is released
+ * one refresh period ahead of the vsync it is meant for and the compositor
+ * queues its frame for that vsync with eglPresentationTimeANDROID.
+ */
+
+struct virgl_server_pacer {
+   /* ideal display time of the last present, before vsync alignment */
+   uint64_t target_ns;
+};
+
+/* frames per second, 0 lifts the limit; applies from the next present */
+void virgl_server_pacer_set_limit(int fps);
+
+/* called before a present with the client's GL context current, returns
+ * once it is time to present */
+void virgl_server_pacer_wait(struct virgl_server_pacer *pacer);
+
+/* interval a present is paced to in ns: the frame rate limit, else the
+ * refresh period while vsync is tracked, else 0 */
+uint64_t virgl_server_pacer_frame_interval(void);
+
+/* vsync the last paced present is meant for in CLOCK_MONOTONIC ns, 0 when
+ * not limited or the display timing is unknown */
+uint64_t virgl_server_pacer_presentation_time(void);
+
+#endif
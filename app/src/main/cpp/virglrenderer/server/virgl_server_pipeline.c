@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "util/u_memory.h"
+#include "util/u_double_list.h"
+#include "util/u_math.h"
+#include "os/os_thread.h"
+
+#include "virgl_server.h"
+#include "virgl_server_pipeline.h"
+#include "virgl_server_protocol.h"
+
+enum virgl_server_pipeline_item_type {
+   VIRGL_SERVER_PIPELINE_REQUEST,
+   VIRGL_SERVER_PIPELINE_SUBMIT,
+   VIRGL_SERVER_PIPELINE_QUIT,
+};
+
+struct virgl_server_pipeline_item {
+   struct list_head head;
+   enum virgl_server_pipeline_item_type type;
+   uint32_t header[2];
+
+   /* submit payload read ahead by the request thread */
+   uint32_t *cbuf;
+   uint32_t cbuf_size;
+};
+
+struct virgl_server_pipeline {
+   struct virgl_client *client;
+   pipe_thread thread;
+
+   pipe_mutex lock;
+   pipe_condvar queue_cond;
+   pipe_condvar done_cond;
+   struct list_head queue;
+   struct list_head free_submits;
+
+   struct virgl_server_pipeline_item submits[VIRGL_SERVER_PIPELINE_DEPTH];
+   /* requests other than submit are waited for, so one item is enough */
+   struct virgl_server_pipeline_item request;
+   bool request_done;
+   int request_result;
+
+   /* first failure of a submission nobody waited for */
+   int error;
+
+   /* written while the GL thread sleeps on the fence fds and work comes in */
+   int wake_fd;
+   bool fence_waiting;
+};
+
+/* called with the lock held after queueing an item */
+static void virgl_server_pipeline_wake(struct virgl_server_pipeline *pipeline)
+{
+   pipe_condvar_signal(pipeline->queue_cond);
+   if (pipeline->fence_waiting)
+      eventfd_write(pipeline->wake_fd, 1);
+}
+
+static PIPE_THREAD_ROUTINE(virgl_server_pipeline_main, param)
+{
+   struct virgl_server_pipeline *pipeline = param;
+   struct virgl_client *client = pipeline->client;
+   struct virgl_server_pipeline_item *item;
+   enum virgl_server_pipeline_item_type type;
+   bool idle;
+   int ret = 0;
+
+   virgl_server_set_thread_role(VIRGL_SERVER_THREAD_ROLE_GL);
+
+   pipe_mutex_lock(pipeline->lock);
+   for (;;) {
+      if (LIST_IS_EMPTY(&pipeline->queue)) {
+         pipe_condvar_wait(pipeline->queue_cond, pipeline->lock);
+         continue;
+      }
+
+      item = LIST_ENTRY(struct virgl_server_pipeline_item, pipeline->queue.next, head);
+      list_delinit(&item->head);
+      type = item->type;
+      pipe_mutex_unlock(pipeline->lock);
+
+      switch (type) {
+      case VIRGL_SERVER_PIPELINE_REQUEST:
+         ret = virgl_server_run_request(client, item->header);
+         break;
+      case VIRGL_SERVER_PIPELINE_SUBMIT:
+         ret = virgl_server_run_submit(client, item->cbuf, item->header[0]);
+         break;
+      case VIRGL_SERVER_PIPELINE_QUIT:
+         virgl_server_destroy_renderer(client);
+         break;
+      }
+
+      if (type == VIRGL_SERVER_PIPELINE_QUIT)
+         break;
+
+      pipe_mutex_lock(pipeline->lock);
+      if (type == VIRGL_SERVER_PIPELINE_REQUEST) {
+         pipeline->request_result = ret;
+         pipeline->request_done = true;
+      } else {
+         if (ret < 0 && !pipeline->error)
+            pipeline->error = ret;
+         list_addtail(&item->head, &pipeline->free_submits);
+      }
+      pipe_condvar_broadcast(pipeline->done_cond);
+      idle = LIST_IS_EMPTY(&pipeline->queue);
+      pipe_mutex_unlock(pipeline->lock);
+
+      if (idle && ret >= 0 && client->initialized) {
+         eventfd_t count;
+
+         virgl_server_idle_fence(client);
+
+         pipe_mutex_lock(pipeline->lock);
+         pipeline->fence_waiting = LIST_IS_EMPTY(&pipeline->queue);
+         pipe_mutex_unlock(pipeline->lock);
+
+         if (pipeline->fence_waiting)
+            virgl_server_wait_fences(client, pipeline->wake_fd);
+
+         pipe_mutex_lock(pipeline->lock);
+         pipeline->fence_waiting = false;
+         eventfd_read(pipeline->wake_fd, &count);
+         continue;
+      }
+
+      pipe_mutex_lock(pipeline->lock);
+   }
+
+   /* JNI aborts on threads that exit attached */
+   (*jni_info.vm)->DetachCurrentThread(jni_info.vm);
+   return 0;
+}
+
+struct virgl_server_pipeline *virgl_server_pipeline_create(struct virgl_client *client)
+{
+   struct virgl_server_pipeline *pipeline;
+   int i;
+
+   pipeline = CALLOC_STRUCT(virgl_server_pipeline);
+   if (!pipeline)
+      return NULL;
+
+   pipeline->client = client;
+   pipeline->wake_fd = eventfd(0, EFD_NONBLOCK);
+   if (pipeline->wake_fd < 0) {
+      FREE(pipeline);
+      return NULL;
+   }
+   pipe_mutex_init(pipeline->lock);
+   pipe_condvar_init(pipeline->queue_cond);
+   pipe_condvar_init(pipeline->done_cond);
+   list_inithead(&pipeline->queue);
+   list_inithead(&pipeline->free_submits);
+
+   for (i = 0; i < VIRGL_SERVER_PIPELINE_DEPTH; i++)
+      list_addtail(&pipeline->submits[i].head, &pipeline->free_submits);
+   pipeline->request.type = VIRGL_SERVER_PIPELINE_REQUEST;
+
+   pipeline->thread = pipe_thread_create(virgl_server_pipeline_main, pipeline);
+   if (!pipeline->thread) {
+      pipe_condvar_destroy(pipeline->done_cond);
+      pipe_condvar_destroy(pipeline->queue_cond);
+      pipe_mutex_destroy(pipeline->lock);
+      close(pipeline->wake_fd);
+      FREE(pipeline);
+      return NULL;
+   }
+
+   /* the calling thread is left with reading ahead */
+   virgl_server_set_thread_role(VIRGL_SERVER_THREAD_ROLE_DECODE);
+   return pipeline;
+}
+
+void virgl_server_pipeline_destroy(struct virgl_client *client)
+{
+   struct virgl_server_pipeline *pipeline = client->pipeline;
+   int i;
+
+   if (!pipeline)
+      return;
+
+   pipe_mutex_lock(pipeline->lock);
+   pipeline->request.type = VIRGL_SERVER_PIPELINE_QUIT;
+   list_addtail(&pipeline->request.head, &pipeline->queue);
+   virgl_server_pipeline_wake(pipeline);
+   pipe_mutex_unlock(pipeline->lock);
+
+   pipe_thread_wait(pipeline->thread);
+
+   for (i = 0; i < VIRGL_SERVER_PIPELINE_DEPTH; i++)
+      free(pipeline->submits[i].cbuf);
+   pipe_condvar_destroy(pipeline->done_cond);
+   pipe_condvar_destroy(pipeline->queue_cond);
+   pipe_mutex_destroy(pipeline->lock);
+   close(pipeline->wake_fd);
+   FREE(pipeline);
+   client->pipeline = NULL;
+}
+
+static bool virgl_server_pipeline_reserve(struct virgl_server_pipeline_item *item, uint32_t size)
+{
+   uint32_t new_size;
+   uint32_t *buf;
+
+   if (size <= item->cbuf_size)
+      return true;
+
+   new_size = MAX2(item->cbuf_size, 4096);
+   while (new_size < size)
+      new_size *= 2;
+
+   buf = realloc(item->cbuf, new_size);
+   if (!buf)
+      return false;
+
+   item->cbuf = buf;
+   item->cbuf_size = new_size;
+   return true;
+}
+
+static int virgl_server_pipeline_submit(struct virgl_server_pipeline *pipeline, const uint32_t *header)
+{
+   struct virgl_server_pipeline_item *item;
+   int size = header[0] * 4;
+   bool ok;
+
+   /* bounded read-ahead, wait for the GL thread to retire a submission */
+   while (LIST_IS_EMPTY(&pipeline->free_submits))
+      pipe_condvar_wait(pipeline->done_cond, pipeline->lock);
+
+   item = LIST_ENTRY(struct virgl_server_pipeline_item, pipeline->free_submits.next, head);
+   list_delinit(&item->head);
+   pipe_mutex_unlock(pipeline->lock);
+
+   ok = virgl_server_pipeline_reserve(item, size) &&
+        virgl_block_read(pipeline->client->fd, item->cbuf, size) == size;
+
+   item->type = VIRGL_SERVER_PIPELINE_SUBMIT;
+   item->header[0] = header[0];
+   item->header[1] = header[1];
+
+   pipe_mutex_lock(pipeline->lock);
+   if (!ok) {
+      list_addtail(&item->head, &pipeline->free_submits);
+      return -1;
+   }
+
+   list_addtail(&item->head, &pipeline->queue);
+   virgl_server_pipeline_wake(pipeline);
+   return 0;
+}
+
+int virgl_server_pipeline_request(struct virgl_server_pipeline *pipeline, const uint32_t *header)
+{
+   int ret;
+
+   pipe_mutex_lock(pipeline->lock);
+   ret = pipeline->error;
+   if (ret < 0) {
+      pipe_mutex_unlock(pipeline->lock);
+      return ret;
+   }
+
+   /* initialized only changes while this thread waits on a request */
+   if (header[1] == VCMD_SUBMIT_CMD && pipeline->client->initialized) {
+      ret = virgl_server_pipeline_submit(pipeline, header);
+      pipe_mutex_unlock(pipeline->lock);
+      return ret;
+   }
+
+   pipeline->request.header[0] = header[0];
+   pipeline->request.header[1] = header[1];
+   pipeline->request_done = false;
+   list_addtail(&pipeline->request.head, &pipeline->queue);
+   virgl_server_pipeline_wake(pipeline);
+
+   while (!pipeline->request_done)
+      pipe_condvar_wait(pipeline->done_cond, pipeline->lock);
+   ret = pipeline->request_result;
+   pipe_mutex_unlock(pipeline->lock);
+   return ret;
+}
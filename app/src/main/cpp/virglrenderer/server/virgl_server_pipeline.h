@@ -0,0 +1,31 @@
+#ifndef VIRGL_SERVER_PIPELINE_H
+#define VIRGL_SERVER_PIPELINE_H
+
+#include <stdint.h>
+
+/*
+ * Pipelined request handling.
+ *
+ * A dedicated GL thread owns the client's EGL context and runs every
+ * request.  The Java thread that gets woken up for the socket only reads
+ * ahead: submissions are copied into a small queue and handed over without
+ * waiting, so reading and copying submit N+1 overlaps the decoding and GL
+ * execution of submit N.  Every other request is handed over in order and
+ * waited for, since its handler reads its arguments from the socket and
+ * may reply on it.
+ */
+
+#define VIRGL_SERVER_PIPELINE_DEPTH 3
+
+struct virgl_client;
+struct virgl_server_pipeline;
+
+struct virgl_server_pipeline *virgl_server_pipeline_create(struct virgl_client *client);
+/* runs the renderer teardown on the GL thread and joins it, no-op without a pipeline */
+void virgl_server_pipeline_destroy(struct virgl_client *client);
+
+/* called with the request header already read, returns < 0 if the
+ * connection has to be killed */
+int virgl_server_pipeline_request(struct virgl_server_pipeline *pipeline, const uint32_t *header);
+
+#endif
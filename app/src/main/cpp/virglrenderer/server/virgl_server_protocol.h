@@ -32,7 +32,57 @@
 #define VCMD_SUBMIT_CMD 7
 #define VCMD_RESOURCE_BUSY_WAIT 8
 #define VCMD_FLUSH_FRONTBUFFER 9
+#define VCMD_RING_CREATE 10
+#define VCMD_RING_KICK 11
+#define VCMD_TRANSFER_BATCH 12
+
+/* VCMD_TRANSFER_GET/PUT payload: handle, level, x, y, z, w, h, d, unused, offset */
+#define VCMD_TRANSFER_ARGS 10
+/* VCMD_TRANSFER_BATCH payload is a list of records, each one being
+ * VCMD_TRANSFER_GET or VCMD_TRANSFER_PUT followed by the transfer args */
+#define VCMD_TRANSFER_BATCH_RECORD (1 + VCMD_TRANSFER_ARGS)
 
 #define VCMD_BUSY_WAIT_FLAG_WAIT 1
 
+/*
+ * Shared memory command ring, negotiated with VCMD_RING_CREATE.
+ *
+ * request:  { size in bytes }
+ * response: { 1, VCMD_RING_CREATE, status } followed by the memfd when
+ *           status is 0.
+ *
+ * The memfd starts with struct virgl_server_ring_header, the data area
+ * follows at VIRGL_SERVER_RING_DATA_OFFSET.  head and tail are free
+ * running dword counters, each entry is a length dword followed by that
+ * many dwords of VCMD_SUBMIT_CMD payload, and entries may wrap.  The
+ * client sends VCMD_RING_KICK over the socket only after publishing head
+ * and finding server_idle set.  The server drains the ring before every
+ * socket command, so ordering with socket commands is preserved.
+ *
+ * fence_id holds the last retired fence; clients may FUTEX_WAIT on it
+ * after incrementing fence_waiters.
+ *
+ * busy_entries dwords at busy_offset hold, per resource handle, the fence
+ * that retires the last submission using the resource.  A resource is
+ * idle when its entry is not above fence_id, which saves the
+ * VCMD_RESOURCE_BUSY_WAIT round trip.  The table only covers decoded
+ * submissions: it is current for the entries published up to
+ * decoded_tail.  A busy resource still needs VCMD_RESOURCE_BUSY_WAIT to
+ * wait, as that also fences work the server didn't fence yet.
+ */
+struct virgl_server_ring_header {
+   uint32_t head;
+   uint32_t tail;
+   uint32_t size;
+   uint32_t server_idle;
+   uint32_t fence_id;
+   uint32_t fence_waiters;
+   uint32_t decoded_tail;
+   uint32_t busy_offset;
+   uint32_t busy_entries;
+};
+
+#define VIRGL_SERVER_RING_DATA_OFFSET 64
+#define VIRGL_SERVER_RING_BUSY_ENTRIES 4096
+
 #endif
@@ -1,3 +1,5 @@
+#define EGL_EGLEXT_PROTOTYPES
+
 /**************************************************************************
  *
  * Copyright (C) 2015 Red Hat Inc.
@@ -28,6 +30,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <dlfcn.h>
+#include <time.h>
 
 #include "virgl_hw.h"
 
@@ -37,20 +41,104 @@
 
 #include <vrend_renderer.h>
 
+#include "native_trace.h"
 #include "virgl_server.h"
 #include "virgl_server_shm.h"
 #include "virgl_server_protocol.h"
+#include "virgl_server_scanout.h"
+#include "vrend_program_cache.h"
+#include "vrend_variant_log.h"
 
 #include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
-#include "util/u_hash_table.h"
+#include "os/os_thread.h"
+#include "vrend_handle_table.h"
 
+#include <EGL/eglext.h>
 #include <jni.h>
 
+/* frames between two refreshes of the GL memory statistics */
+#define VIRGL_SERVER_STATS_INTERVAL 64
+
+/* bounds each blocking wait so stalled fences still get retired */
+#define VIRGL_SERVER_FENCE_WAIT_TIMEOUT_NS 100000000ULL
+
+/* frame pacing statistics live in libwinlator (frame_stats.c) */
+#define FRAME_SOURCE_VIRGL 0
+
+static uint32_t (*frame_stats_present_fn)(int, int64_t);
+static void (*frame_stats_gpu_done_fn)(uint32_t);
+
+static uint64_t frame_stats_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool frame_stats_lookup(void)
+{
+   void *handle;
+
+   /* looked up until libwinlator is loaded, then cached */
+   if (frame_stats_present_fn)
+      return true;
+
+   handle = dlopen("libwinlator.so", RTLD_NOW | RTLD_NOLOAD);
+   if (!handle)
+      return false;
+   frame_stats_gpu_done_fn = (void (*)(uint32_t))dlsym(handle, "FrameStats_gpuDone");
+   frame_stats_present_fn = (uint32_t (*)(int, int64_t))dlsym(handle, "FrameStats_present");
+   return frame_stats_present_fn && frame_stats_gpu_done_fn;
+}
+
+/* reports the frames whose fence signaled */
+static void frame_stats_retire(struct virgl_server_renderer *renderer)
+{
+   int i, n = 0;
+
+   for (i = 0; i < renderer->num_pending_frames; i++) {
+      struct virgl_server_pending_frame *frame = &renderer->pending_frames[i];
+
+      if ((int)frame->fence_id <= renderer->last_fence_id)
+         frame_stats_gpu_done_fn(frame->sequence);
+      else
+         renderer->pending_frames[n++] = *frame;
+   }
+   renderer->num_pending_frames = n;
+}
+
+/* closes the frame with the decode time spent on it, its GPU time is
+ * reported once the fence covering its commands signals */
+static void frame_stats_present(struct virgl_client *client)
+{
+   struct virgl_server_renderer *renderer = client->renderer;
+   struct virgl_server_pending_frame *frame;
+   uint32_t sequence;
+
+   if (!frame_stats_lookup())
+      return;
+
+   sequence = frame_stats_present_fn(FRAME_SOURCE_VIRGL, (int64_t)renderer->frame_decode_ns);
+   renderer->frame_decode_ns = 0;
+   if (!sequence || renderer->num_pending_frames == VIRGL_SERVER_MAX_PENDING_FRAMES)
+      return;
+
+   /* pending submissions get the next fence, see virgl_server_renderer_flush_fence() */
+   frame = &renderer->pending_frames[renderer->num_pending_frames++];
+   frame->sequence = sequence;
+   frame->fence_id = renderer->fence_id + (renderer->fence_pending ? 1 : 0);
+   frame_stats_retire(renderer);
+}
+
 static void virgl_server_write_fence(struct virgl_client *client, uint32_t fence_id)
 {
    client->renderer->last_fence_id = fence_id;
+   if (client->renderer->num_pending_frames)
+      frame_stats_retire(client->renderer);
+   if (client->renderer->ring.header)
+      virgl_server_ring_signal_fence(&client->renderer->ring, fence_id);
 }
 
 static virgl_gl_context virgl_server_egl_create_context(struct virgl_client *client)
@@ -82,8 +170,129 @@ struct vrend_if_cbs virgl_server_cbs = {
    .create_gl_context = virgl_server_egl_create_context,
    .destroy_gl_context = virgl_server_egl_destroy_context,
    .make_current = virgl_server_egl_make_current,
+   .create_scanout_buffer = virgl_server_scanout_create,
+   .destroy_scanout_buffer = virgl_server_scanout_destroy,
 };
 
+/* renderer instances of destroyed clients kept warm for the next ones,
+ * Wine starts and drops many short lived GL clients */
+#define VIRGL_SERVER_CONTEXT_POOL_SIZE 2
+
+struct virgl_server_pooled_context {
+   EGLDisplay egl_display;
+   EGLConfig egl_conf;
+   EGLContext egl_ctx;
+   /* the Java context egl_ctx shares with, a new one retires the entry */
+   EGLContext shared_egl_ctx;
+   bool native_fence_sync;
+   /* blit programs built by the previous owner, NULL if it never blitted */
+   struct vrend_blitter_ctx *blit_ctx;
+};
+
+static struct virgl_server_pooled_context context_pool[VIRGL_SERVER_CONTEXT_POOL_SIZE];
+static int context_pool_size;
+pipe_static_mutex(context_pool_lock);
+
+static EGLContext virgl_server_shared_egl_context(void)
+{
+   JNIEnv *env = virgl_server_jni_env();
+   jlong shared_egl_ctx_ptr = (*env)->CallLongMethod(env, jni_info.obj, jni_info.get_shared_egl_context);
+   return (EGLContext)shared_egl_ctx_ptr;
+}
+
+/* the contexts of an entry are current on no thread once it is pooled */
+static void virgl_server_pooled_context_destroy(struct virgl_client *client,
+                                                struct virgl_server_pooled_context *entry)
+{
+   struct vrend_blitter_ctx *blit_ctx = client->vrend_blit_ctx;
+   EGLDisplay egl_display = client->renderer->egl_display;
+
+   /* vrend_blitter_fini() destroys through the client's display */
+   if (entry->blit_ctx) {
+      client->vrend_blit_ctx = entry->blit_ctx;
+      client->renderer->egl_display = entry->egl_display;
+      vrend_blitter_fini(client);
+      client->vrend_blit_ctx = blit_ctx;
+      client->renderer->egl_display = egl_display;
+   }
+   eglDestroyContext(entry->egl_display, entry->egl_ctx);
+}
+
+static bool virgl_server_context_pool_take(struct virgl_client *client)
+{
+   struct virgl_server_renderer *renderer = client->renderer;
+   struct virgl_server_pooled_context entry;
+   EGLContext shared_egl_ctx = virgl_server_shared_egl_context();
+   bool found = false;
+
+   pipe_mutex_lock(context_pool_lock);
+   while (context_pool_size && !found) {
+      entry = context_pool[--context_pool_size];
+      found = entry.shared_egl_ctx == shared_egl_ctx;
+      if (!found)
+         virgl_server_pooled_context_destroy(client, &entry);
+   }
+   pipe_mutex_unlock(context_pool_lock);
+
+   if (!found)
+      return false;
+
+   renderer->egl_display = entry.egl_display;
+   renderer->egl_conf = entry.egl_conf;
+   renderer->egl_ctx = entry.egl_ctx;
+   renderer->shared_egl_ctx = entry.shared_egl_ctx;
+   renderer->native_fence_sync = entry.native_fence_sync;
+   renderer->pooled_blit_ctx = entry.blit_ctx;
+
+   if (!eglMakeCurrent(renderer->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, renderer->egl_ctx)) {
+      renderer->pooled_blit_ctx = NULL;
+      virgl_server_pooled_context_destroy(client, &entry);
+      return false;
+   }
+   return true;
+}
+
+/* Called once vrend let go of the client; its blitter was detached before */
+static void virgl_server_context_pool_put(struct virgl_client *client)
+{
+   struct virgl_server_renderer *renderer = client->renderer;
+   struct virgl_server_pooled_context entry = {
+      .egl_display = renderer->egl_display,
+      .egl_conf = renderer->egl_conf,
+      .egl_ctx = renderer->egl_ctx,
+      .shared_egl_ctx = renderer->shared_egl_ctx,
+      .native_fence_sync = renderer->native_fence_sync,
+      .blit_ctx = renderer->pooled_blit_ctx,
+   };
+
+   renderer->pooled_blit_ctx = NULL;
+   if (!entry.egl_ctx)
+      return;
+
+   /* another client thread may make it current next */
+   eglMakeCurrent(entry.egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+   pipe_mutex_lock(context_pool_lock);
+   if (context_pool_size < VIRGL_SERVER_CONTEXT_POOL_SIZE &&
+       entry.shared_egl_ctx == virgl_server_shared_egl_context()) {
+      context_pool[context_pool_size++] = entry;
+      entry.egl_ctx = EGL_NO_CONTEXT;
+   }
+   pipe_mutex_unlock(context_pool_lock);
+
+   if (entry.egl_ctx)
+      virgl_server_pooled_context_destroy(client, &entry);
+}
+
+/* warm contexts are only a start up optimization, memory comes first */
+static void virgl_server_context_pool_drain(struct virgl_client *client)
+{
+   pipe_mutex_lock(context_pool_lock);
+   while (context_pool_size)
+      virgl_server_pooled_context_destroy(client, &context_pool[--context_pool_size]);
+   pipe_mutex_unlock(context_pool_lock);
+}
+
 static bool virgl_server_egl_init(struct virgl_server_renderer *renderer)
 {
     static EGLint conf_att[] = {
@@ -122,9 +331,9 @@ static bool virgl_server_egl_init(struct virgl_server_renderer *renderer)
     if (!success || num_configs != 1)
         return false;
 
-    jlong shared_egl_ctx_ptr = (*jni_info.env)->CallLongMethod(jni_info.env, jni_info.obj, jni_info.get_shared_egl_context);
-    EGLContext shared_egl_ctx = (EGLContext)shared_egl_ctx_ptr;
+    EGLContext shared_egl_ctx = virgl_server_shared_egl_context();
 
+    renderer->shared_egl_ctx = shared_egl_ctx;
     renderer->egl_ctx = eglCreateContext(renderer->egl_display,
                                          renderer->egl_conf,
                                          shared_egl_ctx ? shared_egl_ctx : EGL_NO_CONTEXT,
@@ -134,34 +343,83 @@ static bool virgl_server_egl_init(struct virgl_server_renderer *renderer)
     if (!renderer->egl_ctx)
         return false;
 
+    renderer->native_fence_sync =
+       strstr(eglQueryString(renderer->egl_display, EGL_EXTENSIONS), "EGL_ANDROID_native_fence_sync") != NULL;
+
     return true;
 }
 
-static unsigned
-hash_func(void *key)
+static void virgl_server_program_cache_init(void)
 {
-   intptr_t ip = pointer_to_intptr(key);
-   return (unsigned)(ip & 0xffffffff);
+   JNIEnv *env = virgl_server_jni_env();
+   jstring dir = (*env)->CallObjectMethod(env, jni_info.obj, jni_info.get_program_cache_dir);
+   const char *path;
+
+   if (!dir)
+      return;
+
+   path = (*env)->GetStringUTFChars(env, dir, NULL);
+   if (path) {
+      vrend_program_cache_init(path);
+      (*env)->ReleaseStringUTFChars(env, dir, path);
+   }
+   (*env)->DeleteLocalRef(env, dir);
 }
 
-static int
-compare_iovecs(void *key1, void *key2)
+static void virgl_server_variant_log_init(void)
 {
-   if (key1 < key2) {
-      return -1;
-   } else if (key1 > key2) {
-      return 1;
-   } else {
-      return 0;
+   JNIEnv *env = virgl_server_jni_env();
+   jstring file = (*env)->CallObjectMethod(env, jni_info.obj, jni_info.get_shader_variant_log);
+   const char *path;
+
+   if (!file) {
+      vrend_variant_log_init(NULL);
+      return;
    }
+
+   path = (*env)->GetStringUTFChars(env, file, NULL);
+   if (path) {
+      vrend_variant_log_init(path);
+      (*env)->ReleaseStringUTFChars(env, file, path);
+   }
+   (*env)->DeleteLocalRef(env, file);
+}
+
+static void virgl_server_async_compile_init(struct virgl_client *client)
+{
+   JNIEnv *env = virgl_server_jni_env();
+   jint threads = (*env)->CallIntMethod(env, jni_info.obj, jni_info.get_shader_compile_threads);
+   jboolean skip_draws = (*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_skip_draws_until_ready);
+
+   vrend_renderer_set_async_compile(client, threads, skip_draws);
+   vrend_renderer_set_async_readback(client, (*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_async_readback));
+   vrend_renderer_set_const_ubo(client, (*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_constant_buffer_ubo));
+   vrend_renderer_set_separable_programs(client, (*env)->CallBooleanMethod(env, jni_info.obj, jni_info.get_separable_programs));
+}
+
+static void virgl_server_trace_init(struct virgl_client *client)
+{
+   JNIEnv *env = virgl_server_jni_env();
+   jstring dir = (*env)->CallObjectMethod(env, jni_info.obj, jni_info.get_trace_dir);
+   const char *path;
+
+   if (!dir)
+      return;
+
+   path = (*env)->GetStringUTFChars(env, dir, NULL);
+   if (path) {
+      client->renderer->trace = virgl_server_trace_open(path);
+      (*env)->ReleaseStringUTFChars(env, dir, path);
+   }
+   (*env)->DeleteLocalRef(env, dir);
+
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_CREATE_RENDERER, NULL, 0);
 }
 
 static void free_iovec(void *value)
 {
-   struct iovec *iovec = value;
-   if (iovec->iov_base)
-      munmap(iovec->iov_base, iovec->iov_len);
-   free(iovec);
+   virgl_server_shm_release(value);
 }
 
 static int virgl_block_write(int fd, void *buf, int size)
@@ -239,33 +497,114 @@ int virgl_server_create_renderer(struct virgl_client *client, uint32_t length)
    int ret;
 
    struct virgl_server_renderer *renderer = calloc(1, sizeof(struct virgl_server_renderer));
-   renderer->iovec_hash = util_hash_table_create(hash_func, compare_iovecs, free_iovec);
+   renderer->iovec_hash = vrend_handle_table_create(free_iovec);
    renderer->ctx_id = 1;
 
    client->renderer = renderer;
 
-   virgl_server_egl_init(renderer);
+   if (!virgl_server_context_pool_take(client))
+      virgl_server_egl_init(renderer);
 
    ret = vrend_renderer_init(client, &virgl_server_cbs);
    if (ret)
       return -1;
 
+   client->vrend_blit_ctx = renderer->pooled_blit_ctx;
+   renderer->pooled_blit_ctx = NULL;
+
+   virgl_server_program_cache_init();
+   virgl_server_variant_log_init();
+   virgl_server_async_compile_init(client);
+   virgl_server_trace_init(client);
+
    ret = vrend_renderer_context_create(client, renderer->ctx_id);
    return ret;
 }
 
+static void virgl_server_fb_cache_clear(struct virgl_client *client)
+{
+   struct virgl_server_fb_cache_entry *cache = client->renderer->fb_cache;
+   int i;
+
+   for (i = 0; i < VIRGL_SERVER_FB_CACHE_SIZE; i++) {
+      if (cache[i].handle)
+         glDeleteFramebuffers(1, &cache[i].framebuffer);
+      cache[i].handle = 0;
+      cache[i].framebuffer = 0;
+   }
+}
+
+static void virgl_server_fb_cache_remove(struct virgl_client *client, uint32_t handle)
+{
+   struct virgl_server_fb_cache_entry *cache = client->renderer->fb_cache;
+   int i;
+
+   for (i = 0; i < VIRGL_SERVER_FB_CACHE_SIZE; i++) {
+      if (cache[i].handle != handle)
+         continue;
+
+      glDeleteFramebuffers(1, &cache[i].framebuffer);
+      memmove(&cache[i], &cache[i + 1], (VIRGL_SERVER_FB_CACHE_SIZE - i - 1) * sizeof(*cache));
+      cache[VIRGL_SERVER_FB_CACHE_SIZE - 1].handle = 0;
+      cache[VIRGL_SERVER_FB_CACHE_SIZE - 1].framebuffer = 0;
+      return;
+   }
+}
+
+/* Returns the framebuffer wrapping res, building one only on a miss; the
+ * least recently presented entry is evicted when the cache is full. */
+static GLuint virgl_server_fb_cache_get(struct virgl_client *client, struct vrend_resource *res,
+                                        uint32_t handle)
+{
+   struct virgl_server_fb_cache_entry *cache = client->renderer->fb_cache;
+   struct virgl_server_fb_cache_entry entry;
+   int i;
+
+   for (i = 0; i < VIRGL_SERVER_FB_CACHE_SIZE - 1; i++) {
+      if (cache[i].handle == handle || !cache[i].handle)
+         break;
+   }
+
+   if (cache[i].handle == handle) {
+      entry = cache[i];
+   } else {
+      if (cache[i].handle)
+         glDeleteFramebuffers(1, &cache[i].framebuffer);
+
+      entry.handle = handle;
+      glGenFramebuffers(1, &entry.framebuffer);
+      glBindFramebuffer(GL_FRAMEBUFFER, entry.framebuffer);
+      vrend_fb_bind_texture(res, 0, 0, 0);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+   }
+
+   memmove(&cache[1], &cache[0], i * sizeof(*cache));
+   cache[0] = entry;
+   return entry.framebuffer;
+}
+
 void virgl_server_destroy_renderer(struct virgl_client *client)
 {
    if (!client->initialized)
       return;
 
-   if (client->renderer->framebuffer)
-      glDeleteFramebuffers(1, &client->renderer->framebuffer);
+   virgl_server_fb_cache_clear(client);
+   while (client->renderer->num_fence_fds)
+      close(client->renderer->fence_fds[--client->renderer->num_fence_fds].fd);
 
    vrend_renderer_context_destroy(client, client->renderer->ctx_id);
+   /* the blit programs stay with the pooled context */
+   client->renderer->pooled_blit_ctx = client->vrend_blit_ctx;
+   client->vrend_blit_ctx = NULL;
    vrend_renderer_fini(client);
-   util_hash_table_destroy(client->renderer->iovec_hash);
+   virgl_server_context_pool_put(client);
+   vrend_handle_table_destroy(client->renderer->iovec_hash);
    client->renderer->iovec_hash = NULL;
+   virgl_server_shm_pool_trim(&client->renderer->shm_pool);
+   free(client->renderer->cmd_buf);
+   virgl_server_ring_destroy(&client->renderer->ring);
+   virgl_server_trace_close(client->renderer->trace);
+   virgl_server_hint_destroy(&client->renderer->hint);
 
    free(client->renderer);
    client->renderer = NULL;
@@ -279,6 +618,9 @@ int virgl_server_send_caps(struct virgl_client *client, UNUSED uint32_t length)
    int ret;
    uint32_t max_ver, max_size;
 
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_GET_CAPS, NULL, 0);
+
    vrend_renderer_get_cap_set(2, &max_ver, &max_size);
 
    if (max_size == 0)
@@ -307,13 +649,17 @@ int virgl_server_resource_create(struct virgl_client *client, UNUSED uint32_t le
 {
    uint32_t recv_buf[11];
    struct vrend_renderer_resource_create_args args;
+   struct virgl_server_shm_region *region;
    struct iovec *iovec;
-   int ret, fd;
+   int ret;
 
    ret = virgl_block_read(client->fd, &recv_buf, sizeof(recv_buf));
    if (ret != sizeof(recv_buf))
       return -1;
 
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_RESOURCE_CREATE, recv_buf, ARRAY_SIZE(recv_buf));
+
    args.handle = recv_buf[0];
    args.target = recv_buf[1];
    args.format = recv_buf[2];
@@ -326,7 +672,7 @@ int virgl_server_resource_create(struct virgl_client *client, UNUSED uint32_t le
    args.nr_samples = recv_buf[9];
    args.flags = 0;
 
-   if (util_hash_table_get(client->renderer->iovec_hash, intptr_to_pointer(args.handle)))
+   if (vrend_handle_table_get(client->renderer->iovec_hash, args.handle))
       return -EEXIST;
 
    ret = vrend_renderer_resource_create(client, &args, NULL, 0);
@@ -335,50 +681,32 @@ int virgl_server_resource_create(struct virgl_client *client, UNUSED uint32_t le
 
    vrend_renderer_attach_res_ctx(client, client->renderer->ctx_id, args.handle);
 
-   iovec = CALLOC_STRUCT(iovec);
-   if (!iovec)
+   region = virgl_server_shm_alloc(&client->renderer->shm_pool, args.handle, recv_buf[10]);
+   if (!region)
       return -ENOMEM;
+   iovec = &region->iov;
 
-   iovec->iov_len = recv_buf[10];
-
-   if (iovec->iov_len == 0) {
-      iovec->iov_base = NULL;
+   if (region->fd < 0)
       goto out;
-   }
 
-   fd = virgl_server_new_shm(args.handle, iovec->iov_len);
-   if (fd < 0) {
-      FREE(iovec);
-      return fd;
-   }
-
-   iovec->iov_base = mmap(NULL, iovec->iov_len, PROT_WRITE | PROT_READ,
-                          MAP_SHARED, fd, 0);
-
-   if (iovec->iov_base == MAP_FAILED) {
-      close(fd);
-      FREE(iovec);
-      return -ENOMEM;
-   }
-
-   ret = virgl_server_send_fd(client->fd, fd);
+   ret = virgl_server_send_fd(client->fd, region->fd);
    if (ret < 0) {
-      close(fd);
-      munmap(iovec->iov_base, iovec->iov_len);
+      virgl_server_shm_release(region);
       return ret;
    }
 
-   close(fd);
+   __atomic_add_fetch(&client->renderer->shm_bytes, iovec->iov_len, __ATOMIC_RELAXED);
 
 out:
    vrend_renderer_resource_attach_iov(client, args.handle, iovec, 1);
-   util_hash_table_set(client->renderer->iovec_hash, intptr_to_pointer(args.handle), iovec);
+   vrend_handle_table_set(client->renderer->iovec_hash, args.handle, iovec);
    return 0;
 }
 
 int virgl_server_resource_destroy(struct virgl_client *client, UNUSED uint32_t length)
 {
    uint32_t recv_buf[1];
+   struct iovec *iovec;
    int ret;
    uint32_t handle;
 
@@ -387,53 +715,73 @@ int virgl_server_resource_destroy(struct virgl_client *client, UNUSED uint32_t l
       return -1;
 
    handle = recv_buf[0];
+   if (client->renderer->trace) {
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_RESOURCE_DESTROY, recv_buf, ARRAY_SIZE(recv_buf));
+      virgl_server_trace_forget(client->renderer->trace, handle);
+   }
+
+   iovec = vrend_handle_table_get(client->renderer->iovec_hash, handle);
+   if (iovec)
+      __atomic_sub_fetch(&client->renderer->shm_bytes, iovec->iov_len, __ATOMIC_RELAXED);
+   virgl_server_fb_cache_remove(client, handle);
    vrend_renderer_attach_res_ctx(client, client->renderer->ctx_id, handle);
 
    vrend_renderer_resource_detach_iov(client, handle, NULL, NULL);
-   util_hash_table_remove(client->renderer->iovec_hash, intptr_to_pointer(handle));
+   vrend_handle_table_remove(client->renderer->iovec_hash, handle);
 
    vrend_renderer_resource_unref(client, handle);
    return 0;
 }
 
+static void virgl_server_fill_transfer(struct virgl_client *client, const uint32_t *args,
+                                      struct pipe_box *box, struct vrend_transfer_info *transfer_info)
+{
+   box->x = args[2];
+   box->y = args[3];
+   box->z = args[4];
+   box->width = args[5];
+   box->height = args[6];
+   box->depth = args[7];
+
+   transfer_info->handle = args[0];
+   transfer_info->ctx_id = client->renderer->ctx_id;
+   transfer_info->level = args[1];
+   transfer_info->stride = 0;
+   transfer_info->layer_stride = 0;
+   transfer_info->box = box;
+   transfer_info->offset = args[9];
+   transfer_info->iovec = NULL;
+   transfer_info->iovec_cnt = 0;
+   transfer_info->context0 = true;
+   transfer_info->synchronized = false;
+}
+
 int virgl_server_transfer_get(struct virgl_client *client, UNUSED uint32_t length)
 {
-   uint32_t recv_buf[10];
+   uint32_t recv_buf[VCMD_TRANSFER_ARGS];
    int ret;
    struct pipe_box box;
    struct iovec *iovec;
    struct vrend_transfer_info transfer_info;
 
+   NATIVE_TRACE_SCOPE("virgl_server_transfer_get");
+
    ret = virgl_block_read(client->fd, &recv_buf, sizeof(recv_buf));
    if (ret != sizeof(recv_buf))
       return ret;
 
-   box.x = recv_buf[2];
-   box.y = recv_buf[3];
-   box.z = recv_buf[4];
-   box.width = recv_buf[5];
-   box.height = recv_buf[6];
-   box.depth = recv_buf[7];
-
-   transfer_info.handle = recv_buf[0];
-   transfer_info.ctx_id = client->renderer->ctx_id;
-   transfer_info.level = recv_buf[1];
-   transfer_info.stride = 0;
-   transfer_info.layer_stride = 0;
-   transfer_info.box = &box;
-   transfer_info.offset = recv_buf[9];
-   transfer_info.iovec = NULL;
-   transfer_info.iovec_cnt = 0;
-   transfer_info.context0 = true;
-   transfer_info.synchronized = false;
-
-   iovec = util_hash_table_get(client->renderer->iovec_hash, intptr_to_pointer(transfer_info.handle));
+   virgl_server_fill_transfer(client, recv_buf, &box, &transfer_info);
+
+   iovec = vrend_handle_table_get(client->renderer->iovec_hash, transfer_info.handle);
    if (!iovec)
       return -ESRCH;
 
    if (transfer_info.offset >= iovec->iov_len)
       return -EFAULT;
 
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_TRANSFER_GET, recv_buf, ARRAY_SIZE(recv_buf));
+
     ret = vrend_renderer_transfer_iov(client, &transfer_info, VIRGL_TRANSFER_FROM_HOST);
 
    if (ret)
@@ -444,39 +792,29 @@ int virgl_server_transfer_get(struct virgl_client *client, UNUSED uint32_t lengt
 
 int virgl_server_transfer_put(struct virgl_client *client, UNUSED uint32_t length)
 {
-   uint32_t recv_buf[10];
+   uint32_t recv_buf[VCMD_TRANSFER_ARGS];
    int ret;
    struct pipe_box box;
    struct iovec *iovec;
    struct vrend_transfer_info transfer_info;
 
+   NATIVE_TRACE_SCOPE("virgl_server_transfer_put");
+
    ret = virgl_block_read(client->fd, &recv_buf, sizeof(recv_buf));
    if (ret != sizeof(recv_buf))
       return ret;
 
-   box.x = recv_buf[2];
-   box.y = recv_buf[3];
-   box.z = recv_buf[4];
-   box.width = recv_buf[5];
-   box.height = recv_buf[6];
-   box.depth = recv_buf[7];
-
-   transfer_info.handle = recv_buf[0];
-   transfer_info.ctx_id = client->renderer->ctx_id;
-   transfer_info.level = recv_buf[1];
-   transfer_info.stride = 0;
-   transfer_info.layer_stride = 0;
-   transfer_info.box = &box;
-   transfer_info.offset = recv_buf[9];
-   transfer_info.iovec = NULL;
-   transfer_info.iovec_cnt = 0;
-   transfer_info.context0 = true;
-   transfer_info.synchronized = false;
-
-   iovec = util_hash_table_get(client->renderer->iovec_hash, intptr_to_pointer(transfer_info.handle));
+   virgl_server_fill_transfer(client, recv_buf, &box, &transfer_info);
+
+   iovec = vrend_handle_table_get(client->renderer->iovec_hash, transfer_info.handle);
    if (!iovec)
       return -ESRCH;
 
+   if (client->renderer->trace) {
+      virgl_server_trace_shm(client->renderer->trace, transfer_info.handle, iovec);
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_TRANSFER_PUT, recv_buf, ARRAY_SIZE(recv_buf));
+   }
+
    vrend_renderer_transfer_iov(client, &transfer_info, VIRGL_TRANSFER_TO_HOST);
 
    if (ret)
@@ -485,33 +823,197 @@ int virgl_server_transfer_put(struct virgl_client *client, UNUSED uint32_t lengt
    return 0;
 }
 
+static uint32_t *virgl_server_get_cmd_buf(struct virgl_server_renderer *renderer, uint32_t size)
+{
+   uint32_t new_size;
+   uint32_t *buf;
+
+   if (size <= renderer->cmd_buf_size)
+      return renderer->cmd_buf;
+
+   new_size = MAX2(renderer->cmd_buf_size, 4096);
+   while (new_size < size)
+      new_size *= 2;
+
+   buf = realloc(renderer->cmd_buf, new_size);
+   if (!buf)
+      return NULL;
+
+   renderer->cmd_buf = buf;
+   renderer->cmd_buf_size = new_size;
+   return buf;
+}
+
 int virgl_server_submit_cmd(struct virgl_client *client, uint32_t length)
 {
    uint32_t *cbuf;
    int cbuf_len, ret;
 
    cbuf_len = length * 4;
-   cbuf = malloc(cbuf_len);
+   cbuf = virgl_server_get_cmd_buf(client->renderer, cbuf_len);
    if (!cbuf)
       return -1;
 
    ret = virgl_block_read(client->fd, cbuf, cbuf_len);
-   if (ret != cbuf_len) {
-      free(cbuf);
+   if (ret != cbuf_len)
+      return -1;
+
+   virgl_server_submit_block(client, cbuf, length);
+   return 0;
+}
+
+void virgl_server_submit_block(struct virgl_client *client, uint32_t *cbuf, uint32_t ndw)
+{
+   if (client->renderer->trace) {
+      virgl_server_trace_submit_shm(client->renderer->trace, client->renderer->iovec_hash, cbuf, ndw);
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_SUBMIT_CMD, cbuf, ndw);
+   }
+
+   if (frame_stats_present_fn) {
+      uint64_t start = frame_stats_now_ns();
+      vrend_decode_block(client, client->renderer->ctx_id, cbuf, ndw);
+      client->renderer->frame_decode_ns += frame_stats_now_ns() - start;
+   } else {
+      vrend_decode_block(client, client->renderer->ctx_id, cbuf, ndw);
+   }
+
+   /* back-to-back submissions share one fence, see virgl_server_renderer_flush_fence() */
+   client->renderer->fence_pending = true;
+}
+
+#define VIRGL_SERVER_TRANSFER_CHUNK 32
+
+int virgl_server_transfer_batch(struct virgl_client *client, uint32_t length)
+{
+   struct vrend_transfer_info infos[VIRGL_SERVER_TRANSFER_CHUNK];
+   struct pipe_box boxes[VIRGL_SERVER_TRANSFER_CHUNK];
+   int modes[VIRGL_SERVER_TRANSFER_CHUNK];
+   struct iovec *iovec;
+   uint32_t *args, *buf;
+   uint32_t count, i;
+   int n = 0, ret;
+
+   NATIVE_TRACE_SCOPE("virgl_server_transfer_batch");
+
+   if (length % VCMD_TRANSFER_BATCH_RECORD)
       return -1;
+
+   buf = virgl_server_get_cmd_buf(client->renderer, length * 4);
+   if (!buf)
+      return -1;
+
+   ret = virgl_block_read(client->fd, buf, length * 4);
+   if (ret != (int)(length * 4))
+      return -1;
+
+   count = length / VCMD_TRANSFER_BATCH_RECORD;
+   if (client->renderer->trace) {
+      for (i = 0; i < count; i++) {
+         args = buf + i * VCMD_TRANSFER_BATCH_RECORD;
+         iovec = vrend_handle_table_get(client->renderer->iovec_hash, args[1]);
+         if (args[0] == VCMD_TRANSFER_PUT && iovec)
+            virgl_server_trace_shm(client->renderer->trace, args[1], iovec);
+      }
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_TRANSFER_BATCH, buf, length);
    }
 
-   vrend_decode_block(client, client->renderer->ctx_id, cbuf, length);
+   for (i = 0; i < count; i++) {
+      args = buf + i * VCMD_TRANSFER_BATCH_RECORD;
+
+      /* skip what the single transfer commands would reject */
+      if (args[0] != VCMD_TRANSFER_GET && args[0] != VCMD_TRANSFER_PUT)
+         continue;
+
+      iovec = vrend_handle_table_get(client->renderer->iovec_hash, args[1]);
+      if (!iovec)
+         continue;
+
+      virgl_server_fill_transfer(client, args + 1, &boxes[n], &infos[n]);
+      if (args[0] == VCMD_TRANSFER_GET && infos[n].offset >= iovec->iov_len)
+         continue;
+
+      modes[n] = args[0] == VCMD_TRANSFER_GET ? VIRGL_TRANSFER_FROM_HOST : VIRGL_TRANSFER_TO_HOST;
+      if (++n == VIRGL_SERVER_TRANSFER_CHUNK) {
+         vrend_renderer_transfer_iov_batch(client, infos, modes, n);
+         n = 0;
+      }
+   }
+
+   if (n)
+      vrend_renderer_transfer_iov_batch(client, infos, modes, n);
+   return 0;
+}
+
+int virgl_server_ring_create_cmd(struct virgl_client *client, UNUSED uint32_t length)
+{
+   uint32_t recv_buf[1];
+   uint32_t send_buf[3];
+   int ret, fd;
+
+   ret = virgl_block_read(client->fd, &recv_buf, sizeof(recv_buf));
+   if (ret != sizeof(recv_buf))
+      return -1;
+
+   vrend_renderer_set_busy_table(client, NULL, 0);
+   virgl_server_ring_destroy(&client->renderer->ring);
+   fd = virgl_server_ring_create(&client->renderer->ring, recv_buf[0]);
+   if (fd >= 0)
+      vrend_renderer_set_busy_table(client, client->renderer->ring.busy_table, VIRGL_SERVER_RING_BUSY_ENTRIES);
+
+   send_buf[0] = 1;
+   send_buf[1] = VCMD_RING_CREATE;
+   send_buf[2] = fd < 0 ? -fd : 0;
+
+   ret = virgl_block_write(client->fd, send_buf, sizeof(send_buf));
+   if (ret < 0 || fd < 0) {
+      if (fd >= 0)
+         close(fd);
+      return ret < 0 ? ret : 0;
+   }
+
+   ret = virgl_server_send_fd(client->fd, fd);
+   close(fd);
+   if (ret < 0) {
+      vrend_renderer_set_busy_table(client, NULL, 0);
+      virgl_server_ring_destroy(&client->renderer->ring);
+   }
+   return ret;
+}
+
+/* Decodes every submission published in the ring until it is empty */
+int virgl_server_ring_process(struct virgl_client *client)
+{
+   struct virgl_server_ring *ring = &client->renderer->ring;
+   uint32_t *cbuf;
+   int ndw;
+
+   if (!ring->header)
+      return 0;
+
+   do {
+      while ((ndw = virgl_server_ring_peek(ring)) != 0) {
+         if (ndw < 0)
+            return -1;
+
+         cbuf = virgl_server_get_cmd_buf(client->renderer, ndw * 4);
+         if (!cbuf)
+            return -1;
+
+         virgl_server_ring_pop(ring, cbuf, ndw);
+         virgl_server_submit_block(client, cbuf, ndw);
+         virgl_server_ring_set_decoded(ring);
+      }
+   } while (!virgl_server_ring_set_idle(ring));
 
-   free(cbuf);
-   virgl_server_renderer_create_fence(client);
    return 0;
 }
 
 int virgl_server_resource_busy_wait(struct virgl_client *client, UNUSED uint32_t length)
 {
+   struct vrend_context *ctx;
    uint32_t recv_buf[2];
    uint32_t send_buf[3];
+   uint32_t fence_id;
    int ret;
    int flags;
    bool busy = false;
@@ -521,13 +1023,23 @@ int virgl_server_resource_busy_wait(struct virgl_client *client, UNUSED uint32_t
       return -1;
 
    flags = recv_buf[1];
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_RESOURCE_BUSY_WAIT, recv_buf, ARRAY_SIZE(recv_buf));
+
+   /* only the fence of the last submission using this resource matters */
+   ctx = vrend_lookup_renderer_ctx(client, client->renderer->ctx_id);
+   fence_id = ctx ? vrend_renderer_resource_fence_id(ctx, recv_buf[0]) : 0;
+
+   /* not fenced yet, either a coalesced submission or an async readback */
+   if ((int)fence_id > client->renderer->fence_id)
+      virgl_server_renderer_create_fence(client);
 
    do {
-      busy = client->renderer->last_fence_id != client->renderer->fence_id;
+      busy = (int)fence_id > client->renderer->last_fence_id;
       if (!busy || !(flags & VCMD_BUSY_WAIT_FLAG_WAIT))
          break;
 
-      vrend_renderer_check_fences(client);
+      vrend_renderer_wait_fence(client, fence_id, VIRGL_SERVER_FENCE_WAIT_TIMEOUT_NS);
    } while (1);
 
    send_buf[0] = 1;
@@ -541,10 +1053,54 @@ int virgl_server_resource_busy_wait(struct virgl_client *client, UNUSED uint32_t
    return 0;
 }
 
+/* input-to-photon statistics live in libwinlator (latency_stats.c) */
+#define LATENCY_STAGE_FLUSH 2
+
+static void latency_mark_flush(void)
+{
+   static void (*latency_mark)(int);
+
+   /* looked up until libwinlator is loaded, then cached */
+   if (!latency_mark) {
+      void *handle = dlopen("libwinlator.so", RTLD_NOW | RTLD_NOLOAD);
+      if (!handle)
+         return;
+      latency_mark = (void (*)(int))dlsym(handle, "LatencyStats_mark");
+      if (!latency_mark)
+         return;
+   }
+   latency_mark(LATENCY_STAGE_FLUSH);
+}
+
+/* exports the decode counters as trace counters while a trace records */
+static void decode_stats_atrace(struct virgl_client *client)
+{
+   struct vrend_decode_stats stats;
+   char name[64];
+   uint32_t cmd;
+
+   if (!NativeTrace_isEnabled())
+      return;
+
+   vrend_decode_get_stats(client, &stats, false);
+   for (cmd = 0; cmd < VIRGL_MAX_COMMANDS; cmd++) {
+      if (!stats.count[cmd])
+         continue;
+      snprintf(name, sizeof(name), "virgl%d %s count", client->fd, vrend_decode_command_name(cmd));
+      NativeTrace_counter(name, stats.count[cmd]);
+      snprintf(name, sizeof(name), "virgl%d %s ns", client->fd, vrend_decode_command_name(cmd));
+      NativeTrace_counter(name, stats.ns[cmd]);
+   }
+}
+
 int virgl_server_flush_frontbuffer(struct virgl_client *client, UNUSED uint32_t length)
 {
    uint32_t recv_buf[2];
    uint32_t handle, drawable;
+   struct vrend_context *ctx;
+   struct vrend_resource *res;
+   GLuint framebuffer;
+   JNIEnv *env;
    int ret;
 
    ret = virgl_block_read(client->fd, &recv_buf, sizeof(recv_buf));
@@ -553,36 +1109,158 @@ int virgl_server_flush_frontbuffer(struct virgl_client *client, UNUSED uint32_t
 
    handle = recv_buf[0];
    drawable = recv_buf[1];
+   if (client->renderer->trace)
+      virgl_server_trace_cmd(client->renderer->trace, VCMD_FLUSH_FRONTBUFFER, recv_buf, ARRAY_SIZE(recv_buf));
+
+   /* a present closes the frame for the per-frame statistics */
+   vrend_renderer_end_frame(client);
+   latency_mark_flush();
+   frame_stats_present(client);
+   if (client->decode_stats_enabled)
+      decode_stats_atrace(client);
+
+   if (client->renderer->stats_frames++ % VIRGL_SERVER_STATS_INTERVAL == 0)
+      __atomic_store_n(&client->renderer->gl_bytes, vrend_renderer_get_gl_bytes(client), __ATOMIC_RELAXED);
+
+   ctx = vrend_lookup_renderer_ctx(client, client->renderer->ctx_id);
+   res = vrend_renderer_ctx_res_lookup(ctx, handle);
+   if (!res)
+      return 0;
 
-   if (handle != client->renderer->handle) {
-      struct vrend_context *ctx = vrend_lookup_renderer_ctx(client, client->renderer->ctx_id);
-      struct vrend_resource *res = vrend_renderer_ctx_res_lookup(ctx, handle);
-
-      if (client->renderer->framebuffer)
-         glDeleteFramebuffers(1, &client->renderer->framebuffer);
+   vrend_renderer_invalidate_ancillary(ctx);
+   env = virgl_server_jni_env();
+   vrend_resource_ensure_storage(res);
 
-      GLuint framebuffer;
-      glGenFramebuffers(1, &framebuffer);
-      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+   if (res->scanout_buffer) {
+      struct virgl_server_scanout *scanout = res->scanout_buffer;
 
-      vrend_fb_bind_texture(res, 0, 0, 0);
-
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      /* the compositor samples the buffer itself, it only has to wait for
+       * the rendering submitted so far; it takes ownership of the sync */
+      GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
 
-      client->renderer->framebuffer = framebuffer;
-      client->renderer->handle = handle;
+      (*env)->CallVoidMethod(env, jni_info.obj, jni_info.flush_frontbuffer_hardware_buffer, drawable,
+                             (jlong)scanout->hardware_buffer, (jlong)sync);
+      return 0;
    }
 
-   (*jni_info.env)->CallVoidMethod(jni_info.env, jni_info.obj, jni_info.flush_frontbuffer, drawable, client->renderer->framebuffer);
+   framebuffer = virgl_server_fb_cache_get(client, res, handle);
+   (*env)->CallVoidMethod(env, jni_info.obj, jni_info.flush_frontbuffer, drawable, framebuffer);
    return 0;
 }
 
+static void virgl_server_fence_fd_pop(struct virgl_server_renderer *renderer)
+{
+   close(renderer->fence_fds[0].fd);
+   renderer->num_fence_fds--;
+   memmove(&renderer->fence_fds[0], &renderer->fence_fds[1],
+           renderer->num_fence_fds * sizeof(renderer->fence_fds[0]));
+}
+
+/* Exports the point just fenced as a native fence fd, so an idle client
+ * thread can sleep on it and report the fence as soon as it signals.
+ * Only ring clients wait on fences without asking, the others find out
+ * through their next busy wait anyway. */
+static void virgl_server_export_fence(struct virgl_client *client, uint32_t fence_id)
+{
+   struct virgl_server_renderer *renderer = client->renderer;
+   const EGLint attribs[] = {
+      EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+      EGL_NONE
+   };
+   EGLSyncKHR sync;
+   int fd;
+
+   if (!renderer->native_fence_sync || !renderer->ring.header)
+      return;
+
+   sync = eglCreateSyncKHR(renderer->egl_display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+   if (sync == EGL_NO_SYNC_KHR)
+      return;
+
+   /* the fd only exists once the fence command reached the driver */
+   glFlush();
+   fd = eglDupNativeFenceFDANDROID(renderer->egl_display, sync);
+   eglDestroySyncKHR(renderer->egl_display, sync);
+   if (fd < 0)
+      return;
+
+   if (renderer->num_fence_fds == VIRGL_SERVER_MAX_FENCE_FDS)
+      virgl_server_fence_fd_pop(renderer);
+   renderer->fence_fds[renderer->num_fence_fds].fence_id = fence_id;
+   renderer->fence_fds[renderer->num_fence_fds].fd = fd;
+   renderer->num_fence_fds++;
+}
+
+/* Textures the guest only samples from keep their shm around for the
+ * next upload, but its contents already live in the GL texture.  Under
+ * critical pressure those pages are dropped from the memfd, for the
+ * guest mapping too; touching them again faults in zeroed pages, so the
+ * staging memory comes back on its own with the next upload. */
+static bool virgl_server_shm_is_staging(struct virgl_client *client, uint32_t handle)
+{
+   struct vrend_context *ctx = vrend_lookup_renderer_ctx(client, client->renderer->ctx_id);
+   struct vrend_resource *res = ctx ? vrend_renderer_ctx_res_lookup(ctx, handle) : NULL;
+
+   return res && res->base.target != PIPE_BUFFER && res->base.bind == VIRGL_BIND_SAMPLER_VIEW &&
+          !res->scanout_buffer && (int)res->fence_id <= client->renderer->last_fence_id;
+}
+
+static void trim_staging_iovec(uint32_t handle, void *value, void *closure)
+{
+   struct virgl_client *client = closure;
+   struct iovec *iovec = value;
+
+   if (!iovec->iov_base || !virgl_server_shm_is_staging(client, handle))
+      return;
+   if (madvise(iovec->iov_base, iovec->iov_len, MADV_REMOVE) == 0)
+      __atomic_add_fetch(&client->renderer->shm_released_bytes, iovec->iov_len, __ATOMIC_RELAXED);
+}
+
+void virgl_server_renderer_trim(struct virgl_client *client, int level)
+{
+   vrend_renderer_trim(client);
+   virgl_server_shm_pool_trim(&client->renderer->shm_pool);
+
+   if (level < VIRGL_SERVER_TRIM_RUNNING_CRITICAL)
+      return;
+
+   vrend_handle_table_foreach(client->renderer->iovec_hash, trim_staging_iovec, client);
+   virgl_server_context_pool_drain(client);
+}
+
 int virgl_server_renderer_create_fence(struct virgl_client *client)
 {
+   client->renderer->fence_pending = false;
    vrend_renderer_create_fence(client, ++client->renderer->fence_id, 0);
+   virgl_server_export_fence(client, client->renderer->fence_id);
    return 0;
 }
 
+int virgl_server_renderer_fence_fd(struct virgl_client *client)
+{
+   if (!client->renderer || !client->renderer->num_fence_fds)
+      return -1;
+   return client->renderer->fence_fds[0].fd;
+}
+
+/* Drops the fds of the fences already written to the client */
+void virgl_server_renderer_retire_fence_fds(struct virgl_client *client)
+{
+   struct virgl_server_renderer *renderer = client->renderer;
+
+   while (renderer->num_fence_fds &&
+          (int)renderer->fence_fds[0].fence_id <= renderer->last_fence_id)
+      virgl_server_fence_fd_pop(renderer);
+}
+
+/* Fences the submissions made since the last fence, if any */
+void virgl_server_renderer_flush_fence(struct virgl_client *client)
+{
+   if (client->renderer && client->renderer->fence_pending)
+      virgl_server_renderer_create_fence(client);
+}
+
 JNIEXPORT jlong JNICALL
 Java_com_winlator_xenvironment_components_VirGLRendererComponent_getCurrentEGLContextPtr(JNIEnv *env, jobject obj) {
    EGLContext egl_ctx = eglGetCurrentContext();
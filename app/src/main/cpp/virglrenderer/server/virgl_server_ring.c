@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "virgl_server_ring.h"
+#include "virgl_server_shm.h"
+
+#include "util/u_math.h"
+
+#define VIRGL_SERVER_RING_MIN_SIZE (64 * 1024)
+#define VIRGL_SERVER_RING_MAX_SIZE (64 * 1024 * 1024)
+
+int virgl_server_ring_create(struct virgl_server_ring *ring, uint32_t size)
+{
+   uint32_t data_size = VIRGL_SERVER_RING_MIN_SIZE;
+   void *ptr;
+   int fd;
+
+   while (data_size < size && data_size < VIRGL_SERVER_RING_MAX_SIZE)
+      data_size *= 2;
+
+   ring->map_size = VIRGL_SERVER_RING_DATA_OFFSET + data_size + VIRGL_SERVER_RING_BUSY_ENTRIES * 4;
+   fd = virgl_server_new_named_shm("virgl-ring", ring->map_size);
+   if (fd < 0)
+      return fd;
+
+   ptr = mmap(NULL, ring->map_size, PROT_WRITE | PROT_READ, MAP_SHARED, fd, 0);
+   if (ptr == MAP_FAILED) {
+      close(fd);
+      return -ENOMEM;
+   }
+
+   ring->header = ptr;
+   ring->data = (uint32_t *)((char *)ptr + VIRGL_SERVER_RING_DATA_OFFSET);
+   ring->busy_table = (uint32_t *)((char *)ring->data + data_size);
+   ring->size_dw = data_size / 4;
+   ring->header->size = data_size;
+   ring->header->server_idle = 1;
+   ring->header->busy_offset = VIRGL_SERVER_RING_DATA_OFFSET + data_size;
+   ring->header->busy_entries = VIRGL_SERVER_RING_BUSY_ENTRIES;
+   return fd;
+}
+
+void virgl_server_ring_destroy(struct virgl_server_ring *ring)
+{
+   if (!ring->header)
+      return;
+
+   munmap(ring->header, ring->map_size);
+   ring->header = NULL;
+   ring->data = NULL;
+   ring->busy_table = NULL;
+}
+
+int virgl_server_ring_peek(struct virgl_server_ring *ring)
+{
+   uint32_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+   uint32_t tail = ring->header->tail;
+   uint32_t ndw;
+
+   if (head == tail)
+      return 0;
+
+   /* a zero length entry would read as an empty ring and never be popped */
+   ndw = ring->data[tail & (ring->size_dw - 1)];
+   if (head - tail > ring->size_dw || !ndw || ndw >= head - tail || ndw > INT_MAX)
+      return -1;
+   return ndw;
+}
+
+void virgl_server_ring_pop(struct virgl_server_ring *ring, uint32_t *dst, uint32_t ndw)
+{
+   uint32_t tail = ring->header->tail + 1;
+   uint32_t offset = tail & (ring->size_dw - 1);
+   uint32_t first = MIN2(ndw, ring->size_dw - offset);
+
+   memcpy(dst, ring->data + offset, first * 4);
+   memcpy(dst + first, ring->data, (ndw - first) * 4);
+
+   __atomic_store_n(&ring->header->tail, tail + ndw, __ATOMIC_RELEASE);
+}
+
+bool virgl_server_ring_set_idle(struct virgl_server_ring *ring)
+{
+   __atomic_store_n(&ring->header->server_idle, 1, __ATOMIC_SEQ_CST);
+
+   /* the client checks server_idle after publishing head, so look again */
+   if (__atomic_load_n(&ring->header->head, __ATOMIC_SEQ_CST) != ring->header->tail) {
+      __atomic_store_n(&ring->header->server_idle, 0, __ATOMIC_RELAXED);
+      return false;
+   }
+   return true;
+}
+
+void virgl_server_ring_set_decoded(struct virgl_server_ring *ring)
+{
+   __atomic_store_n(&ring->header->decoded_tail, ring->header->tail, __ATOMIC_RELEASE);
+}
+
+void virgl_server_ring_signal_fence(struct virgl_server_ring *ring, uint32_t fence_id)
+{
+   __atomic_store_n(&ring->header->fence_id, fence_id, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&ring->header->fence_waiters, __ATOMIC_SEQ_CST))
+      syscall(SYS_futex, &ring->header->fence_id, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,35 @@
+#ifndef VIRGL_SERVER_RING_H
+#define VIRGL_SERVER_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "virgl_server_protocol.h"
+
+struct virgl_server_ring {
+   struct virgl_server_ring_header *header;
+   uint32_t *data;
+   uint32_t *busy_table;
+   uint32_t size_dw;
+   size_t map_size;
+};
+
+/* returns the memfd to hand to the client or a negative errno */
+int virgl_server_ring_create(struct virgl_server_ring *ring, uint32_t size);
+void virgl_server_ring_destroy(struct virgl_server_ring *ring);
+
+/* length of the next entry in dwords, 0 if the ring is empty and -1 if
+ * the client published a corrupt (or zero length) entry */
+int virgl_server_ring_peek(struct virgl_server_ring *ring);
+void virgl_server_ring_pop(struct virgl_server_ring *ring, uint32_t *dst, uint32_t ndw);
+
+/* marks the server idle, returns false if the client published more
+ * entries in the meantime */
+bool virgl_server_ring_set_idle(struct virgl_server_ring *ring);
+
+/* publishes that every popped entry was decoded */
+void virgl_server_ring_set_decoded(struct virgl_server_ring *ring);
+
+void virgl_server_ring_signal_fence(struct virgl_server_ring *ring, uint32_t fence_id);
+
+#endif
@@ -0,0 +1,89 @@
+#define EGL_EGLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+
+#include <stdlib.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "virgl_server_scanout.h"
+
+#include "util/u_memory.h"
+
+/* what gpu_image.c allocates for X drawables, so both paths look alike */
+#define HAL_PIXEL_FORMAT_BGRA_8888 5
+
+static uint32_t virgl_server_scanout_format(enum virgl_formats format)
+{
+   switch (format) {
+   case VIRGL_FORMAT_B8G8R8A8_UNORM:
+   case VIRGL_FORMAT_B8G8R8X8_UNORM:
+      return HAL_PIXEL_FORMAT_BGRA_8888;
+   case VIRGL_FORMAT_R8G8B8A8_UNORM:
+      return AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+   case VIRGL_FORMAT_R8G8B8X8_UNORM:
+      return AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM;
+   default:
+      return 0;
+   }
+}
+
+void *virgl_server_scanout_create(uint32_t width, uint32_t height, enum virgl_formats format)
+{
+   const EGLint attrib_list[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+   AHardwareBuffer_Desc desc = {0};
+   struct virgl_server_scanout *scanout;
+   EGLClientBuffer client_buffer;
+   EGLImageKHR image;
+
+   desc.format = virgl_server_scanout_format(format);
+   if (!desc.format)
+      return NULL;
+
+   desc.width = width;
+   desc.height = height;
+   desc.layers = 1;
+   desc.usage = AHARDWAREBUFFER_USAGE_GPU_COLOR_OUTPUT | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE;
+
+   scanout = CALLOC_STRUCT(virgl_server_scanout);
+   if (!scanout)
+      return NULL;
+
+   if (AHardwareBuffer_allocate(&desc, &scanout->hardware_buffer) != 0)
+      goto fail;
+
+   client_buffer = eglGetNativeClientBufferANDROID(scanout->hardware_buffer);
+   if (!client_buffer)
+      goto fail;
+
+   image = eglCreateImageKHR(eglGetDisplay(EGL_DEFAULT_DISPLAY), EGL_NO_CONTEXT,
+                             EGL_NATIVE_BUFFER_ANDROID, client_buffer, attrib_list);
+   if (image == EGL_NO_IMAGE_KHR)
+      goto fail;
+   scanout->image = image;
+
+   /* the caller has the resource texture bound */
+   while (glGetError() != GL_NO_ERROR);
+   glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)image);
+   if (glGetError() != GL_NO_ERROR)
+      goto fail;
+
+   return scanout;
+
+fail:
+   virgl_server_scanout_destroy(scanout);
+   return NULL;
+}
+
+void virgl_server_scanout_destroy(void *buffer)
+{
+   struct virgl_server_scanout *scanout = buffer;
+
+   if (scanout->image)
+      eglDestroyImageKHR(eglGetDisplay(EGL_DEFAULT_DISPLAY), (EGLImageKHR)scanout->image);
+   if (scanout->hardware_buffer)
+      AHardwareBuffer_release(scanout->hardware_buffer);
+   FREE(scanout);
+}
@@ -0,0 +1,26 @@
+#ifndef VIRGL_SERVER_SCANOUT_H
+#define VIRGL_SERVER_SCANOUT_H
+
+#include <stdint.h>
+#include <android/hardware_buffer.h>
+
+#include "virgl_hw.h"
+
+/*
+ * AHardwareBuffer backed storage for scanout resources.
+ *
+ * The buffer is bound to the resource texture through an EGLImage, so the
+ * guest renders straight into memory the compositor can sample and
+ * flush_frontbuffer only has to hand the buffer over instead of copying.
+ */
+
+struct virgl_server_scanout {
+   AHardwareBuffer *hardware_buffer;
+   void *image;
+};
+
+/* vrend_if_cbs::create_scanout_buffer/destroy_scanout_buffer */
+void *virgl_server_scanout_create(uint32_t width, uint32_t height, enum virgl_formats format);
+void virgl_server_scanout_destroy(void *buffer);
+
+#endif
@@ -23,16 +23,23 @@
  **************************************************************************/
 
 #include "virgl_server_shm.h"
+#include "native_trace.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
-static int memfd_create(const char *name, unsigned int flags)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static int shm_memfd_create(const char *name, unsigned int flags)
 {
 #ifdef __NR_memfd_create
     return syscall(__NR_memfd_create, name, flags);
@@ -42,14 +49,18 @@ static int memfd_create(const char *name, unsigned int flags)
 }
 
 int virgl_server_new_shm(uint32_t handle, size_t size)
+{
+   char name[32];
+
+   snprintf(name, sizeof(name), "virgl-res-%u", handle);
+   return virgl_server_new_named_shm(name, size);
+}
+
+static int virgl_server_new_shm_flags(const char *name, size_t size, unsigned int flags)
 {
    int fd, ret;
-   int length = snprintf(NULL, 0, "virgl-res-%u", handle);
-   char *str = malloc(length + 1);
-   snprintf(str, length + 1, "virgl-res-%u", handle);
 
-   fd = memfd_create(str, MFD_ALLOW_SEALING);
-   free(str);
+   fd = shm_memfd_create(name, flags);
    if (fd < 0)
       return -errno;
 
@@ -61,3 +72,160 @@ int virgl_server_new_shm(uint32_t handle, size_t size)
 
    return fd;
 }
+
+int virgl_server_new_named_shm(const char *name, size_t size)
+{
+   return virgl_server_new_shm_flags(name, size, MFD_ALLOW_SEALING);
+}
+
+/* hugetlbfs only has pages when the system reserved some, which most
+ * Android kernels do not; after the first failure it is not tried again */
+static bool hugetlb_unavailable;
+
+static void *virgl_server_shm_map_huge(struct virgl_server_shm_region *region, uint32_t handle)
+{
+   char name[32];
+   void *ptr;
+
+   if (__atomic_load_n(&hugetlb_unavailable, __ATOMIC_RELAXED))
+      return NULL;
+
+   snprintf(name, sizeof(name), "virgl-res-%u", handle);
+   region->fd = virgl_server_new_shm_flags(name, region->size,
+                                           MFD_HUGETLB | (VIRGL_SERVER_SHM_HUGE_SHIFT << MFD_HUGE_SHIFT));
+   if (region->fd >= 0) {
+      /* hugetlb pages are reserved on mmap, so a failure shows up here */
+      ptr = mmap(NULL, region->size, PROT_WRITE | PROT_READ, MAP_SHARED | MAP_POPULATE, region->fd, 0);
+      if (ptr != MAP_FAILED)
+         return ptr;
+      close(region->fd);
+      region->fd = -1;
+   }
+
+   __atomic_store_n(&hugetlb_unavailable, true, __ATOMIC_RELAXED);
+   return NULL;
+}
+
+/* Faults the backing in up front: the first upload of a large texture would
+ * otherwise take a fault per page.  The pages land in the memfd, so the
+ * client's own faults on its mapping only map them. */
+static void virgl_server_shm_prefault(void *ptr, size_t size)
+{
+   size_t page = sysconf(_SC_PAGESIZE);
+   volatile char *bytes = ptr;
+   size_t offset;
+
+   /* transparent huge pages for shmem, if the kernel is set to "advise" */
+   madvise(ptr, size, MADV_HUGEPAGE);
+   if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+      return;
+
+   /* kernels before 5.14, writing the zeroes it already holds */
+   for (offset = 0; offset < size; offset += page)
+      bytes[offset] = 0;
+}
+
+/* size class of size, -1 if it is too large to be pooled */
+static int virgl_server_shm_class(size_t size)
+{
+   int shift = VIRGL_SERVER_SHM_MIN_SHIFT;
+
+   while (((size_t)1 << shift) < size) {
+      if (++shift > VIRGL_SERVER_SHM_MAX_POOLED_SHIFT)
+         return -1;
+   }
+   return shift - VIRGL_SERVER_SHM_MIN_SHIFT;
+}
+
+static void virgl_server_shm_destroy(struct virgl_server_shm_region *region)
+{
+   if (region->iov.iov_base)
+      munmap(region->iov.iov_base, region->size);
+   if (region->fd >= 0)
+      close(region->fd);
+   free(region);
+}
+
+struct virgl_server_shm_region *virgl_server_shm_alloc(struct virgl_server_shm_pool *pool,
+                                                       uint32_t handle, size_t size)
+{
+   struct virgl_server_shm_region *region;
+   int class = virgl_server_shm_class(size);
+
+   if (size && class >= 0 && pool->num_free[class]) {
+      region = pool->free[class][--pool->num_free[class]];
+      pool->free_bytes -= region->size;
+      region->iov.iov_len = size;
+      return region;
+   }
+
+   region = calloc(1, sizeof(*region));
+   if (!region)
+      return NULL;
+
+   region->pool = pool;
+   region->fd = -1;
+   region->iov.iov_len = size;
+   if (!size)
+      return region;
+
+   region->size = class >= 0 ? (size_t)1 << (class + VIRGL_SERVER_SHM_MIN_SHIFT) : size;
+
+   if (region->size >= ((size_t)1 << VIRGL_SERVER_SHM_HUGE_SHIFT)) {
+      NATIVE_TRACE_SCOPE("virgl_server_shm_prefault");
+      size_t huge_page = (size_t)1 << VIRGL_SERVER_SHM_HUGE_SHIFT;
+      size_t normal_size = region->size;
+
+      region->size = (normal_size + huge_page - 1) & ~(huge_page - 1);
+      region->iov.iov_base = virgl_server_shm_map_huge(region, handle);
+      if (region->iov.iov_base)
+         return region;
+      region->size = normal_size;
+   }
+
+   region->fd = virgl_server_new_shm(handle, region->size);
+   if (region->fd < 0) {
+      free(region);
+      return NULL;
+   }
+
+   region->iov.iov_base = mmap(NULL, region->size, PROT_WRITE | PROT_READ, MAP_SHARED, region->fd, 0);
+   if (region->iov.iov_base == MAP_FAILED) {
+      region->iov.iov_base = NULL;
+      virgl_server_shm_destroy(region);
+      return NULL;
+   }
+
+   if (region->size >= VIRGL_SERVER_SHM_PREFAULT_BYTES) {
+      NATIVE_TRACE_SCOPE("virgl_server_shm_prefault");
+      virgl_server_shm_prefault(region->iov.iov_base, region->size);
+   }
+   return region;
+}
+
+void virgl_server_shm_release(struct virgl_server_shm_region *region)
+{
+   struct virgl_server_shm_pool *pool = region->pool;
+   int class = virgl_server_shm_class(region->size);
+
+   if (pool && region->fd >= 0 && class >= 0 &&
+       pool->num_free[class] < VIRGL_SERVER_SHM_CLASS_DEPTH &&
+       pool->free_bytes + region->size <= VIRGL_SERVER_SHM_POOL_MAX_BYTES) {
+      pool->free[class][pool->num_free[class]++] = region;
+      pool->free_bytes += region->size;
+      return;
+   }
+
+   virgl_server_shm_destroy(region);
+}
+
+void virgl_server_shm_pool_trim(struct virgl_server_shm_pool *pool)
+{
+   int class;
+
+   for (class = 0; class < VIRGL_SERVER_SHM_CLASSES; class++) {
+      while (pool->num_free[class])
+         virgl_server_shm_destroy(pool->free[class][--pool->num_free[class]]);
+   }
+   pool->free_bytes = 0;
+}
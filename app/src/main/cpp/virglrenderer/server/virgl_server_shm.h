@@ -33,7 +33,48 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
+
+/* released resource memfds are recycled by power of two size class, from
+ * one page up to VIRGL_SERVER_SHM_MAX_POOLED_SHIFT; larger ones are sized
+ * exactly and never pooled */
+#define VIRGL_SERVER_SHM_MIN_SHIFT 12
+#define VIRGL_SERVER_SHM_MAX_POOLED_SHIFT 24
+#define VIRGL_SERVER_SHM_CLASSES (VIRGL_SERVER_SHM_MAX_POOLED_SHIFT - VIRGL_SERVER_SHM_MIN_SHIFT + 1)
+#define VIRGL_SERVER_SHM_CLASS_DEPTH 8
+#define VIRGL_SERVER_SHM_POOL_MAX_BYTES (64u << 20)
+
+/* larger backings are faulted in when created, from hugetlbfs if the
+ * system has huge pages reserved */
+#define VIRGL_SERVER_SHM_PREFAULT_BYTES (1u << 20)
+#define VIRGL_SERVER_SHM_HUGE_SHIFT 21
+
+struct virgl_server_shm_pool;
+
+struct virgl_server_shm_region {
+   /* first, the iovec hash and vrend only ever see this part */
+   struct iovec iov;
+   struct virgl_server_shm_pool *pool;
+   int fd;
+   /* size of the memfd and its mapping, iov.iov_len is what was asked for */
+   size_t size;
+};
+
+/* per client, the guest may still hold a stale mapping of a region */
+struct virgl_server_shm_pool {
+   struct virgl_server_shm_region *free[VIRGL_SERVER_SHM_CLASSES][VIRGL_SERVER_SHM_CLASS_DEPTH];
+   int num_free[VIRGL_SERVER_SHM_CLASSES];
+   size_t free_bytes;
+};
 
 int virgl_server_new_shm(uint32_t handle, size_t size);
+int virgl_server_new_named_shm(const char *name, size_t size);
+
+/* a mapped region of at least size bytes, its fd stays owned by the region */
+struct virgl_server_shm_region *virgl_server_shm_alloc(struct virgl_server_shm_pool *pool,
+                                                       uint32_t handle, size_t size);
+/* returns the region to its pool, or unmaps it once the pool is full */
+void virgl_server_shm_release(struct virgl_server_shm_region *region);
+void virgl_server_shm_pool_trim(struct virgl_server_shm_pool *pool);
 
 #endif
@@ -0,0 +1,220 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "virgl_protocol.h"
+#include "vrend_handle_table.h"
+#include "virgl_server_trace.h"
+
+/* large writes, traces grow by hundreds of MB per minute */
+#define TRACE_FILE_BUFFER (1024 * 1024)
+
+struct trace_shadow {
+   void *data;
+   size_t size;
+};
+
+struct virgl_server_trace {
+   FILE *fp;
+   char *buffer;
+   /* handle -> struct trace_shadow, guest memory as last captured */
+   struct vrend_handle_table *shadows;
+   bool error;
+};
+
+static uint32_t trace_sequence;
+
+static void trace_shadow_free(void *value)
+{
+   struct trace_shadow *shadow = value;
+
+   free(shadow->data);
+   free(shadow);
+}
+
+static uint64_t trace_time_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_write(struct virgl_server_trace *trace, const void *data, size_t size)
+{
+   if (!trace->error && size && fwrite(data, 1, size, trace->fp) != size)
+      trace->error = true;
+}
+
+static void trace_write_record(struct virgl_server_trace *trace, uint32_t cmd, uint32_t ndw)
+{
+   struct virgl_server_trace_record record;
+
+   record.cmd = cmd;
+   record.ndw = ndw;
+   record.time_ns = trace_time_ns();
+   trace_write(trace, &record, sizeof(record));
+}
+
+struct virgl_server_trace *virgl_server_trace_open(const char *dir)
+{
+   struct virgl_server_trace_file_header header = {
+      .magic = VIRGL_SERVER_TRACE_MAGIC,
+      .version = VIRGL_SERVER_TRACE_VERSION,
+   };
+   struct virgl_server_trace *trace;
+   char path[PATH_MAX];
+
+   snprintf(path, sizeof(path), "%s/virgl-%d-%u.trace", dir, getpid(),
+            __atomic_fetch_add(&trace_sequence, 1, __ATOMIC_RELAXED));
+
+   trace = CALLOC_STRUCT(virgl_server_trace);
+   if (!trace)
+      return NULL;
+
+   trace->fp = fopen(path, "wb");
+   trace->shadows = vrend_handle_table_create(trace_shadow_free);
+   if (!trace->fp || !trace->shadows) {
+      virgl_server_trace_close(trace);
+      return NULL;
+   }
+
+   trace->buffer = malloc(TRACE_FILE_BUFFER);
+   if (trace->buffer)
+      setvbuf(trace->fp, trace->buffer, _IOFBF, TRACE_FILE_BUFFER);
+
+   trace_write(trace, &header, sizeof(header));
+   return trace;
+}
+
+void virgl_server_trace_close(struct virgl_server_trace *trace)
+{
+   if (!trace)
+      return;
+
+   if (trace->fp)
+      fclose(trace->fp);
+   if (trace->shadows)
+      vrend_handle_table_destroy(trace->shadows);
+   free(trace->buffer);
+   FREE(trace);
+}
+
+void virgl_server_trace_cmd(struct virgl_server_trace *trace, uint32_t cmd,
+                            const uint32_t *payload, uint32_t ndw)
+{
+   trace_write_record(trace, cmd, ndw);
+   trace_write(trace, payload, ndw * sizeof(uint32_t));
+}
+
+static void trace_write_shm(struct virgl_server_trace *trace, uint32_t handle,
+                            const char *data, size_t offset, size_t size)
+{
+   static const uint32_t zero;
+   uint32_t args[VIRGL_SERVER_TRACE_SHM_HEADER] = { handle, offset, size };
+   uint32_t ndw = VIRGL_SERVER_TRACE_SHM_HEADER + (size + 3) / 4;
+
+   trace_write_record(trace, VIRGL_SERVER_TRACE_SHM, ndw);
+   trace_write(trace, args, sizeof(args));
+   trace_write(trace, data + offset, size);
+   trace_write(trace, &zero, ndw * 4 - sizeof(args) - size);
+}
+
+void virgl_server_trace_shm(struct virgl_server_trace *trace, uint32_t handle,
+                            const struct iovec *iov)
+{
+   struct trace_shadow *shadow;
+   const char *data = iov->iov_base;
+   size_t num_pages, page, offset, end, run_start = 0;
+   bool in_run = false;
+
+   if (!iov->iov_base || !iov->iov_len)
+      return;
+
+   shadow = vrend_handle_table_get(trace->shadows, handle);
+   if (!shadow || shadow->size != iov->iov_len) {
+      shadow = CALLOC_STRUCT(trace_shadow);
+      if (!shadow)
+         return;
+      shadow->data = malloc(iov->iov_len);
+      shadow->size = iov->iov_len;
+      if (!shadow->data) {
+         FREE(shadow);
+         return;
+      }
+      memcpy(shadow->data, data, iov->iov_len);
+      vrend_handle_table_set(trace->shadows, handle, shadow);
+      trace_write_shm(trace, handle, data, 0, iov->iov_len);
+      return;
+   }
+
+   /* runs of changed pages, each written as one record; the pass one
+    * past the last page closes a run reaching the end */
+   num_pages = (shadow->size + VIRGL_SERVER_TRACE_PAGE_SIZE - 1) / VIRGL_SERVER_TRACE_PAGE_SIZE;
+   for (page = 0; page <= num_pages; page++) {
+      bool changed = false;
+
+      offset = page * VIRGL_SERVER_TRACE_PAGE_SIZE;
+      if (page < num_pages) {
+         end = MIN2(offset + VIRGL_SERVER_TRACE_PAGE_SIZE, shadow->size);
+         changed = memcmp((char *)shadow->data + offset, data + offset, end - offset) != 0;
+      }
+
+      if (changed && !in_run) {
+         run_start = offset;
+         in_run = true;
+      } else if (!changed && in_run) {
+         end = MIN2(offset, shadow->size);
+         memcpy((char *)shadow->data + run_start, data + run_start, end - run_start);
+         trace_write_shm(trace, handle, data, run_start, end - run_start);
+         in_run = false;
+      }
+   }
+}
+
+void virgl_server_trace_submit_shm(struct virgl_server_trace *trace,
+                                   struct vrend_handle_table *iovec_hash,
+                                   const uint32_t *cbuf, uint32_t ndw)
+{
+   uint32_t offset = 0;
+
+   while (offset < ndw) {
+      uint32_t header = cbuf[offset];
+      uint32_t len = header >> 16;
+      uint32_t handle = 0;
+      struct iovec *iov;
+
+      if (offset + len + 1 > ndw)
+         break;
+
+      switch (header & 0xff) {
+      case VIRGL_CCMD_TRANSFER3D:
+         if (len >= VIRGL_TRANSFER3D_SIZE &&
+             cbuf[offset + VIRGL_TRANSFER3D_DIRECTION] == VIRGL_TRANSFER_TO_HOST)
+            handle = cbuf[offset + VIRGL_RESOURCE_IW_RES_HANDLE];
+         break;
+      case VIRGL_CCMD_COPY_TRANSFER3D:
+         if (len == VIRGL_COPY_TRANSFER3D_SIZE)
+            handle = cbuf[offset + VIRGL_COPY_TRANSFER3D_SRC_RES_HANDLE];
+         break;
+      default:
+         break;
+      }
+
+      if (handle && (iov = vrend_handle_table_get(iovec_hash, handle)))
+         virgl_server_trace_shm(trace, handle, iov);
+
+      offset += len + 1;
+   }
+}
+
+void virgl_server_trace_forget(struct virgl_server_trace *trace, uint32_t handle)
+{
+   vrend_handle_table_remove(trace->shadows, handle);
+}
@@ -0,0 +1,61 @@
+#ifndef VIRGL_SERVER_TRACE_H
+#define VIRGL_SERVER_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Command stream capture for offline replay.
+ *
+ * A trace is a struct virgl_server_trace_file_header followed by records,
+ * each a struct virgl_server_trace_record and ndw payload dwords.  Records
+ * carry the VCMD_* id and payload of every request the server decoded,
+ * ring submissions included as VCMD_SUBMIT_CMD, in the order they ran.
+ * Guest memory is captured as VIRGL_SERVER_TRACE_SHM records right before
+ * the transfer reading it: only the pages that changed since the last
+ * capture of that resource are written, the trace keeps a copy of every
+ * resource's shm to tell.
+ */
+
+#define VIRGL_SERVER_TRACE_MAGIC 0x544c4756 /* "VGLT" */
+#define VIRGL_SERVER_TRACE_VERSION 1
+
+/* payload: handle, offset, size, then size bytes padded to a dword */
+#define VIRGL_SERVER_TRACE_SHM 0x100
+#define VIRGL_SERVER_TRACE_SHM_HEADER 3
+
+#define VIRGL_SERVER_TRACE_PAGE_SIZE 4096
+
+struct virgl_server_trace_file_header {
+   uint32_t magic;
+   uint32_t version;
+};
+
+struct virgl_server_trace_record {
+   uint32_t cmd;
+   uint32_t ndw;
+   /* CLOCK_MONOTONIC at capture */
+   uint64_t time_ns;
+};
+
+struct virgl_server_trace;
+struct vrend_handle_table;
+
+/* opens a new trace file in dir, NULL on failure */
+struct virgl_server_trace *virgl_server_trace_open(const char *dir);
+void virgl_server_trace_close(struct virgl_server_trace *trace);
+
+void virgl_server_trace_cmd(struct virgl_server_trace *trace, uint32_t cmd,
+                            const uint32_t *payload, uint32_t ndw);
+
+/* writes the pages of the resource's shm that changed since the last call */
+void virgl_server_trace_shm(struct virgl_server_trace *trace, uint32_t handle,
+                            const struct iovec *iov);
+/* captures the guest memory the transfers of a submission read */
+void virgl_server_trace_submit_shm(struct virgl_server_trace *trace,
+                                   struct vrend_handle_table *iovec_hash,
+                                   const uint32_t *cbuf, uint32_t ndw);
+void virgl_server_trace_forget(struct virgl_server_trace *trace, uint32_t handle);
+
+#endif
@@ -40,7 +40,8 @@
 #include "util/u_bitmask.h"
 
 
-typedef uint32_t util_bitmask_word;  
+/* scanned a word at a time with __builtin_ctzll */
+typedef uint64_t util_bitmask_word;
 
 
 #define UTIL_BITMASK_INITIAL_WORDS 16
@@ -165,28 +166,28 @@ util_bitmask_add(struct util_bitmask *bm)
    
    assert(bm);
 
-   /* linear search for an empty index */
+   /* The bits below filled are all set, so the lowest clear bit of the
+    * first word that has one is the first empty index.
+    */
    word = bm->filled / UTIL_BITMASK_BITS_PER_WORD;
-   bit  = bm->filled % UTIL_BITMASK_BITS_PER_WORD;
-   mask = 1 << bit;
    while(word < bm->size / UTIL_BITMASK_BITS_PER_WORD) {
-      while(bit < UTIL_BITMASK_BITS_PER_WORD) {
-         if(!(bm->words[word] & mask))
-            goto found;
-         ++bm->filled;
-         ++bit;
-         mask <<= 1;
+      util_bitmask_word free_bits = ~bm->words[word];
+      if(free_bits) {
+         bm->filled = word * UTIL_BITMASK_BITS_PER_WORD + __builtin_ctzll(free_bits);
+         goto found;
       }
       ++word;
-      bit = 0;
-      mask = 1;
    }
+   bm->filled = bm->size;
 found:
 
    /* grow the bitmask if necessary */
    if(!util_bitmask_resize(bm, bm->filled))
       return UTIL_BITMASK_INVALID_INDEX;
 
+   word = bm->filled / UTIL_BITMASK_BITS_PER_WORD;
+   bit  = bm->filled % UTIL_BITMASK_BITS_PER_WORD;
+   mask = (util_bitmask_word)1 << bit;
    assert(!(bm->words[word] & mask));
    bm->words[word] |= mask;
 
@@ -210,7 +211,7 @@ util_bitmask_set(struct util_bitmask *bm,
 
    word = index / UTIL_BITMASK_BITS_PER_WORD;
    bit  = index % UTIL_BITMASK_BITS_PER_WORD;
-   mask = 1 << bit;
+   mask = (util_bitmask_word)1 << bit;
 
    bm->words[word] |= mask;
 
@@ -235,7 +236,7 @@ util_bitmask_clear(struct util_bitmask *bm,
 
    word = index / UTIL_BITMASK_BITS_PER_WORD;
    bit  = index % UTIL_BITMASK_BITS_PER_WORD;
-   mask = 1 << bit;
+   mask = (util_bitmask_word)1 << bit;
 
    bm->words[word] &= ~mask;
    
@@ -249,7 +250,7 @@ util_bitmask_get(struct util_bitmask *bm,
 {
    unsigned word = index / UTIL_BITMASK_BITS_PER_WORD;
    unsigned bit  = index % UTIL_BITMASK_BITS_PER_WORD;
-   util_bitmask_word mask = 1 << bit;
+   util_bitmask_word mask = (util_bitmask_word)1 << bit;
    
    assert(bm);
    
@@ -276,7 +277,8 @@ util_bitmask_get_next_index(struct util_bitmask *bm,
 {
    unsigned word = index / UTIL_BITMASK_BITS_PER_WORD;
    unsigned bit  = index % UTIL_BITMASK_BITS_PER_WORD;
-   util_bitmask_word mask = 1 << bit;
+   util_bitmask_word mask = (util_bitmask_word)1 << bit;
+   util_bitmask_word bits;
 
    if(index < bm->filled) {
       assert(bm->words[word] & mask);
@@ -287,26 +289,20 @@ util_bitmask_get_next_index(struct util_bitmask *bm,
       return UTIL_BITMASK_INVALID_INDEX;
    }
 
-   /* Do a linear search */
-   while(word < bm->size / UTIL_BITMASK_BITS_PER_WORD) {
-      while(bit < UTIL_BITMASK_BITS_PER_WORD) {
-         if(bm->words[word] & mask) {
-            if(index == bm->filled) {
-               ++bm->filled;
-               assert(bm->filled <= bm->size);
-            }
-            return index;
-         }
-         ++index;
-         ++bit;
-         mask <<= 1;
-      }
-      ++word;
-      bit = 0;
-      mask = 1;
+   /* skip to the first word with a bit set at or after index */
+   bits = bm->words[word] & (~(util_bitmask_word)0 << bit);
+   while(!bits) {
+      if(++word >= bm->size / UTIL_BITMASK_BITS_PER_WORD)
+         return UTIL_BITMASK_INVALID_INDEX;
+      bits = bm->words[word];
    }
-   
-   return UTIL_BITMASK_INVALID_INDEX;
+
+   index = word * UTIL_BITMASK_BITS_PER_WORD + __builtin_ctzll(bits);
+   if(index == bm->filled) {
+      ++bm->filled;
+      assert(bm->filled <= bm->size);
+   }
+   return index;
 }
 
 
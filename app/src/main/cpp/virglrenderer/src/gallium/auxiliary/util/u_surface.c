@@ -200,17 +200,27 @@ util_fill_rect(ubyte * dst,
          dst += dst_stride;
       }
       break;
-   default:
-      for (i = 0; i < height; i++) {
-         ubyte *row = dst;
-         for (j = 0; j < width; j++) {
-            memcpy(row, uc, blocksize);
-            row += blocksize;
-         }
+   default: {
+      /* The first row doubles itself and the other rows are copies of it,
+       * so the wide blocks are written by memcpy rather than block by block.
+       */
+      ubyte *first = dst;
+      unsigned filled;
+
+      if (!height || !width)
+         break;
+
+      memcpy(first, uc, blocksize);
+      for (filled = blocksize; filled < width_size; filled *= 2)
+         memcpy(first + filled, first, MIN2(filled, width_size - filled));
+
+      for (i = 1; i < height; i++) {
          dst += dst_stride;
+         memcpy(dst, first, width_size);
       }
       break;
    }
+   }
 }
 
 
@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "vrend_iov.h"
+#include "util/u_math.h"
 
 size_t vrend_get_iovec_size(const struct iovec *iov, int iovlen) {
   size_t size = 0;
@@ -62,6 +63,15 @@ size_t vrend_read_from_iovec(const struct iovec *iov, int iovlen,
   size_t read = 0;
   size_t len;
 
+  /* resources created by the server have a single iov */
+  if (iovlen == 1) {
+    if (offset >= iov->iov_len)
+      return 0;
+    len = MIN2(count, iov->iov_len - offset);
+    memcpy(buf, (char*)iov->iov_base + offset, len);
+    return len;
+  }
+
   while (count > 0 && iovlen > 0) {
     if (iov->iov_len > offset) {
       len = iov->iov_len - offset;
@@ -91,6 +101,14 @@ size_t vrend_write_to_iovec(const struct iovec *iov, int iovlen,
   size_t written = 0;
   size_t len;
 
+  if (iovlen == 1) {
+    if (offset >= iov->iov_len)
+      return 0;
+    len = MIN2(count, iov->iov_len - offset);
+    memcpy((char*)iov->iov_base + offset, buf, len);
+    return len;
+  }
+
   while (count > 0 && iovlen > 0) {
     if (iov->iov_len > offset) {
       len = iov->iov_len - offset;
@@ -146,7 +164,8 @@ size_t vrend_read_from_iovec_cb(const struct iovec *iov, int iovlen,
 /**
  * Copy data from one iovec to another iovec.
  *
- * TODO: Implement iovec copy without copy to intermediate buffer.
+ * TODO: Implement iovec copy without copy to intermediate buffer when
+ * either side has several memory regions.
  *
  * \param src_iov    The source iov.
  * \param src_iovlen The number of memory regions in the source iov.
@@ -174,6 +193,16 @@ int vrend_copy_iovec(const struct iovec *src_iov, int src_iovlen, size_t src_off
   if (src_iov == dst_iov && src_offset == dst_offset)
     return 0;
 
+  /* both sides may be the same memory, hence memmove */
+  if (src_iovlen == 1 && dst_iovlen == 1) {
+    if (src_offset > src_iov->iov_len || count > src_iov->iov_len - src_offset ||
+        dst_offset > dst_iov->iov_len || count > dst_iov->iov_len - dst_offset)
+      return -1;
+    memmove((char*)dst_iov->iov_base + dst_offset,
+            (char*)src_iov->iov_base + src_offset, count);
+    return 0;
+  }
+
   if (!buf) {
     buf = malloc(count);
     needs_free = true;
@@ -202,3 +231,61 @@ out:
 
   return ret;
 }
+
+void vrend_iov_cursor_init(struct vrend_iov_cursor *cursor,
+                           const struct iovec *iov, int iovlen)
+{
+  cursor->iov = iov;
+  cursor->iovlen = iovlen;
+  cursor->index = 0;
+  cursor->base = 0;
+}
+
+/* Moves the cursor to the segment holding offset, backwards for
+ * bottom-up transfers.  Returns false past the end of the iovec.
+ */
+static bool vrend_iov_cursor_seek(struct vrend_iov_cursor *cursor, size_t offset)
+{
+  while (offset < cursor->base) {
+    cursor->index--;
+    cursor->base -= cursor->iov[cursor->index].iov_len;
+  }
+
+  while (cursor->index < cursor->iovlen &&
+         offset - cursor->base >= cursor->iov[cursor->index].iov_len) {
+    cursor->base += cursor->iov[cursor->index].iov_len;
+    cursor->index++;
+  }
+
+  return cursor->index < cursor->iovlen;
+}
+
+size_t vrend_iov_cursor_read(struct vrend_iov_cursor *cursor, size_t offset,
+                             char *buf, size_t count)
+{
+  if (cursor->iovlen == 1)
+    return vrend_read_from_iovec(cursor->iov, 1, offset, buf, count);
+
+  if (count == 0 || !vrend_iov_cursor_seek(cursor, offset))
+    return 0;
+
+  /* the cursor is left on the segment of the first byte, so the next
+   * row seeks from there */
+  return vrend_read_from_iovec(cursor->iov + cursor->index,
+                               cursor->iovlen - cursor->index,
+                               offset - cursor->base, buf, count);
+}
+
+size_t vrend_iov_cursor_write(struct vrend_iov_cursor *cursor, size_t offset,
+                              const char *buf, size_t count)
+{
+  if (cursor->iovlen == 1)
+    return vrend_write_to_iovec(cursor->iov, 1, offset, buf, count);
+
+  if (count == 0 || !vrend_iov_cursor_seek(cursor, offset))
+    return 0;
+
+  return vrend_write_to_iovec(cursor->iov + cursor->index,
+                              cursor->iovlen - cursor->index,
+                              offset - cursor->base, buf, count);
+}
@@ -44,11 +44,27 @@
 #include "vrend_shader.h"
 
 #include "vrend_renderer.h"
+#include "vrend_program_cache.h"
 
 #include "vrend_blitter.h"
 
 #define DEST_SWIZZLE_SNIPPET_SIZE 64
 
+/* linked programs kept per blit context, least recently used is dropped */
+#define BLIT_PROGRAM_CACHE_SIZE 32
+/* quads written round-robin into the vbo before it is orphaned */
+#define BLIT_VBO_QUADS 64
+
+#define BLIT_ATTRIB_POS 0
+#define BLIT_ATTRIB_TEXCOORD 1
+
+struct vrend_blitter_program {
+    uint64_t hash;   /**< of the vertex and fragment sources */
+    GLuint prog_id;
+    GLint samp_loc;
+    unsigned last_used;
+};
+
 struct vrend_blitter_ctx {
     virgl_gl_context gl_context;
     bool initialised;
@@ -56,16 +72,22 @@ struct vrend_blitter_ctx {
     GLuint vaoid;
 
     GLuint vs;
-    GLuint fs_texfetch_col[PIPE_MAX_TEXTURE_TYPES];
-    GLuint fs_texfetch_depth[PIPE_MAX_TEXTURE_TYPES];
-    GLuint fs_texfetch_depth_msaa[PIPE_MAX_TEXTURE_TYPES];
-    GLuint fs_texfetch_col_swizzle;
     GLuint fb_id;
 
+    struct vrend_blitter_program programs[BLIT_PROGRAM_CACHE_SIZE];
+    unsigned use_counter;
+
+    /* state of the private blit context, only changed when it differs */
+    GLuint cur_prog_id;
+    unsigned viewport_width;
+    unsigned viewport_height;
+    bool scissor_enabled;
+
     unsigned dst_width;
     unsigned dst_height;
 
     GLuint vbo_id;
+    unsigned vbo_quad;
     GLfloat vertices[4][2][4];   /**< {pos, color} or {pos, texcoord} */
 };
 
@@ -91,6 +113,90 @@ static bool build_and_check(GLuint id, const char *buf)
    return true;
 }
 
+static void blit_release_program(struct vrend_blitter_ctx *blit_ctx,
+                                 struct vrend_blitter_program *program)
+{
+   if (blit_ctx->cur_prog_id == program->prog_id)
+      blit_ctx->cur_prog_id = 0;
+   glDeleteProgram(program->prog_id);
+   memset(program, 0, sizeof(*program));
+}
+
+static bool blit_link_program(struct vrend_blitter_ctx *blit_ctx, GLuint prog_id,
+                              uint64_t hash, const char *fs_src)
+{
+   GLint lret;
+   GLuint fs_id;
+
+   /* fixed locations keep the vao valid for every program */
+   glBindAttribLocation(prog_id, BLIT_ATTRIB_POS, "arg0");
+   glBindAttribLocation(prog_id, BLIT_ATTRIB_TEXCOORD, "arg1");
+
+   if (vrend_program_cache_load(prog_id, hash))
+      return true;
+
+   fs_id = glCreateShader(GL_FRAGMENT_SHADER);
+   if (!build_and_check(fs_id, fs_src)) {
+      glDeleteShader(fs_id);
+      return false;
+   }
+
+   glProgramParameteri(prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   glAttachShader(prog_id, blit_ctx->vs);
+   glAttachShader(prog_id, fs_id);
+   glLinkProgram(prog_id);
+   glDetachShader(prog_id, blit_ctx->vs);
+   glDetachShader(prog_id, fs_id);
+   glDeleteShader(fs_id);
+
+   glGetProgramiv(prog_id, GL_LINK_STATUS, &lret);
+   if (lret == GL_FALSE)
+      return false;
+
+   vrend_program_cache_store(prog_id, hash);
+   return true;
+}
+
+/* Look up the linked program for a fragment shader source, building it (or
+ * loading its binary from the on-disk program cache) on first use */
+static struct vrend_blitter_program *blit_get_program(struct vrend_blitter_ctx *blit_ctx,
+                                                      const char *fs_src)
+{
+   struct vrend_blitter_program *program, *victim = NULL;
+   uint64_t hash;
+   int i;
+
+   hash = vrend_program_cache_hash_begin();
+   hash = vrend_program_cache_hash_data(hash, VS_PASSTHROUGH_GLES, strlen(VS_PASSTHROUGH_GLES));
+   hash = vrend_program_cache_hash_data(hash, fs_src, strlen(fs_src));
+
+   for (i = 0; i < BLIT_PROGRAM_CACHE_SIZE; i++) {
+      program = &blit_ctx->programs[i];
+      if (program->prog_id && program->hash == hash) {
+         program->last_used = ++blit_ctx->use_counter;
+         return program;
+      }
+      if (!victim || !program->prog_id ||
+          (victim->prog_id && program->last_used < victim->last_used))
+         victim = program;
+   }
+
+   if (victim->prog_id)
+      blit_release_program(blit_ctx, victim);
+
+   victim->prog_id = glCreateProgram();
+   if (!blit_link_program(blit_ctx, victim->prog_id, hash, fs_src)) {
+      glDeleteProgram(victim->prog_id);
+      victim->prog_id = 0;
+      return NULL;
+   }
+
+   victim->hash = hash;
+   victim->samp_loc = glGetUniformLocation(victim->prog_id, "samp");
+   victim->last_used = ++blit_ctx->use_counter;
+   return victim;
+}
+
 static bool blit_build_vs_passthrough(struct vrend_blitter_ctx *blit_ctx)
 {
    blit_ctx->vs = glCreateShader(GL_VERTEX_SHADER);
@@ -150,12 +256,11 @@ static enum tgsi_return_type tgsi_ret_for_format(enum virgl_formats format)
    return TGSI_RETURN_TYPE_UNORM;
 }
 
-static GLuint blit_build_frag_tex_col(struct vrend_blitter_ctx *blit_ctx,
+static struct vrend_blitter_program *blit_build_frag_tex_col(struct vrend_blitter_ctx *blit_ctx,
                                       int tgsi_tex_target,
                                       enum tgsi_return_type tgsi_ret,
                                       const uint8_t swizzle[4])
 {
-   GLuint fs_id;
    char shader_buf[4096];
    const char *twm;
    const char *ext_str = "";
@@ -204,23 +309,15 @@ static GLuint blit_build_frag_tex_col(struct vrend_blitter_ctx *blit_ctx,
             vrend_shader_samplertypeconv(tgsi_tex_target), twm,
             dest_swizzle_snippet);
 
-   fs_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-   if (!build_and_check(fs_id, shader_buf)) {
-      glDeleteShader(fs_id);
-      return 0;
-   }
-
-   return fs_id;
+   return blit_get_program(blit_ctx, shader_buf);
 }
 
-static GLuint blit_build_frag_tex_col_msaa(struct vrend_blitter_ctx *blit_ctx,
+static struct vrend_blitter_program *blit_build_frag_tex_col_msaa(struct vrend_blitter_ctx *blit_ctx,
                                            int tgsi_tex_target,
                                            enum tgsi_return_type tgsi_ret,
                                            const uint8_t swizzle[4],
                                            int nr_samples)
 {
-   GLuint fs_id;
    char shader_buf[4096];
    const char *twm;
    const char *ivec;
@@ -239,7 +336,7 @@ static GLuint blit_build_frag_tex_col_msaa(struct vrend_blitter_ctx *blit_ctx,
       is_array = true;
       break;
    default:
-      return 0;
+      return NULL;
    }
 
    if (swizzle)
@@ -252,19 +349,11 @@ static GLuint blit_build_frag_tex_col_msaa(struct vrend_blitter_ctx *blit_ctx,
             vrend_shader_samplertypeconv(tgsi_tex_target),
             nr_samples, ivec, twm, dest_swizzle_snippet);
 
-   fs_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-   if (!build_and_check(fs_id, shader_buf)) {
-      glDeleteShader(fs_id);
-      return 0;
-   }
-
-   return fs_id;
+   return blit_get_program(blit_ctx, shader_buf);
 }
 
-static GLuint blit_build_frag_tex_writedepth(struct vrend_blitter_ctx *blit_ctx, int tgsi_tex_target)
+static struct vrend_blitter_program *blit_build_frag_tex_writedepth(struct vrend_blitter_ctx *blit_ctx, int tgsi_tex_target)
 {
-   GLuint fs_id;
    char shader_buf[4096];
    const char *twm;
 
@@ -304,19 +393,11 @@ static GLuint blit_build_frag_tex_writedepth(struct vrend_blitter_ctx *blit_ctx,
    snprintf(shader_buf, 4096, FS_TEXFETCH_DS_GLES,
       vrend_shader_samplertypeconv(tgsi_tex_target), twm);
 
-   fs_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-   if (!build_and_check(fs_id, shader_buf)) {
-      glDeleteShader(fs_id);
-      return 0;
-   }
-
-   return fs_id;
+   return blit_get_program(blit_ctx, shader_buf);
 }
 
-static GLuint blit_build_frag_blit_msaa_depth(struct vrend_blitter_ctx *blit_ctx, int tgsi_tex_target)
+static struct vrend_blitter_program *blit_build_frag_blit_msaa_depth(struct vrend_blitter_ctx *blit_ctx, int tgsi_tex_target)
 {
-   GLuint fs_id;
    char shader_buf[4096];
    const char *twm;
    const char *ivec;
@@ -333,92 +414,66 @@ static GLuint blit_build_frag_blit_msaa_depth(struct vrend_blitter_ctx *blit_ctx
       is_array = true;
       break;
    default:
-      return 0;
+      return NULL;
    }
 
    snprintf(shader_buf, 4096, is_array ?  FS_TEXFETCH_DS_MSAA_ARRAY_GLES : FS_TEXFETCH_DS_MSAA_GLES,
       vrend_shader_samplertypeconv(tgsi_tex_target), ivec, twm);
 
-   fs_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-   if (!build_and_check(fs_id, shader_buf)) {
-      glDeleteShader(fs_id);
-      return 0;
-   }
-
-   return fs_id;
+   return blit_get_program(blit_ctx, shader_buf);
 }
 
-static GLuint blit_get_frag_tex_writedepth(struct vrend_blitter_ctx *blit_ctx, int pipe_tex_target, unsigned nr_samples)
+static struct vrend_blitter_program *blit_get_frag_tex_writedepth(struct vrend_blitter_ctx *blit_ctx,
+                                                                  int pipe_tex_target,
+                                                                  unsigned nr_samples)
 {
    assert(pipe_tex_target < PIPE_MAX_TEXTURE_TYPES);
 
-   if (nr_samples > 0) {
-      GLuint *shader = &blit_ctx->fs_texfetch_depth_msaa[pipe_tex_target];
-
-      if (!*shader) {
-         unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, nr_samples);
-
-         *shader = blit_build_frag_blit_msaa_depth(blit_ctx, tgsi_tex);
-      }
-      return *shader;
-
-   } else {
-      GLuint *shader = &blit_ctx->fs_texfetch_depth[pipe_tex_target];
-
-      if (!*shader) {
-         unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, 0);
+   unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, nr_samples);
 
-         *shader = blit_build_frag_tex_writedepth(blit_ctx, tgsi_tex);
-      }
-      return *shader;
-   }
+   if (nr_samples > 0)
+      return blit_build_frag_blit_msaa_depth(blit_ctx, tgsi_tex);
+   else
+      return blit_build_frag_tex_writedepth(blit_ctx, tgsi_tex);
 }
 
-static GLuint blit_get_frag_tex_col(struct vrend_blitter_ctx *blit_ctx,
-                                    int pipe_tex_target,
-                                    unsigned nr_samples,
-                                    const struct vrend_format_table *src_entry,
-                                    const struct vrend_format_table *dst_entry,
-                                    bool skip_dest_swizzle)
+static struct vrend_blitter_program *blit_get_frag_tex_col(struct vrend_blitter_ctx *blit_ctx,
+                                                           int pipe_tex_target,
+                                                           unsigned nr_samples,
+                                                           const struct vrend_format_table *src_entry,
+                                                           const struct vrend_format_table *dst_entry,
+                                                           bool skip_dest_swizzle)
 {
    assert(pipe_tex_target < PIPE_MAX_TEXTURE_TYPES);
 
    bool needs_swizzle = !skip_dest_swizzle && (dst_entry->flags & VIRGL_TEXTURE_NEED_SWIZZLE);
+   const uint8_t *swizzle = needs_swizzle ? dst_entry->swizzle : NULL;
+   unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, nr_samples);
+   enum tgsi_return_type tgsi_ret = tgsi_ret_for_format(src_entry->format);
+
+   if (nr_samples > 1) {
+      // Integer textures are resolved using just one sample
+      int msaa_samples = tgsi_ret == TGSI_RETURN_TYPE_UNORM ? nr_samples : 1;
+      return blit_build_frag_tex_col_msaa(blit_ctx, tgsi_tex, tgsi_ret,
+                                          swizzle, msaa_samples);
+   }
 
-   if (needs_swizzle || nr_samples > 1) {
-      const uint8_t *swizzle = needs_swizzle ? dst_entry->swizzle : NULL;
-      GLuint *shader = &blit_ctx->fs_texfetch_col_swizzle;
-      if (shader) {
-         glDeleteShader(*shader);
-      }
-
-      unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, nr_samples);
-      enum tgsi_return_type tgsi_ret = tgsi_ret_for_format(src_entry->format);
-
-      if (nr_samples > 0) {
-         // Integer textures are resolved using just one sample
-         int msaa_samples = tgsi_ret == TGSI_RETURN_TYPE_UNORM ? nr_samples : 1;
-         *shader = blit_build_frag_tex_col_msaa(blit_ctx, tgsi_tex, tgsi_ret,
-                                                swizzle, msaa_samples);
-      } else {
-         *shader = blit_build_frag_tex_col(blit_ctx, tgsi_tex, tgsi_ret, swizzle);
-      }
-
-      return *shader;
-   } else {
-      GLuint *shader = &blit_ctx->fs_texfetch_col[pipe_tex_target];
+   return blit_build_frag_tex_col(blit_ctx, tgsi_tex, tgsi_ret, swizzle);
+}
 
-      if (!*shader) {
-         unsigned tgsi_tex = util_pipe_tex_to_tgsi_tex(pipe_tex_target, 0);
-         enum tgsi_return_type tgsi_ret = tgsi_ret_for_format(src_entry->format);
+static void blit_use_program(struct vrend_blitter_ctx *blit_ctx,
+                             const struct vrend_blitter_program *program)
+{
+   if (blit_ctx->cur_prog_id == program->prog_id)
+      return;
 
-         *shader = blit_build_frag_tex_col(blit_ctx, tgsi_tex, tgsi_ret, NULL);
-      }
-      return *shader;
-   }
+   glUseProgram(program->prog_id);
+   glUniform1i(program->samp_loc, 0);
+   blit_ctx->cur_prog_id = program->prog_id;
 }
 
+static void set_dsa_write_depth_keep_stencil(void);
+
 static void vrend_renderer_init_blit_ctx(struct virgl_client *client, struct vrend_blitter_ctx *blit_ctx)
 {
    int i;
@@ -440,8 +495,27 @@ static void vrend_renderer_init_blit_ctx(struct virgl_client *client, struct vre
 
    for (i = 0; i < 4; i++)
       blit_ctx->vertices[i][0][3] = 1; /*v.w*/
+
+   /* The context is private to the blitter, so the vertex layout, draw
+    * buffer and depth state are set up once and stay bound */
    glBindVertexArray(blit_ctx->vaoid);
    glBindBuffer(GL_ARRAY_BUFFER, blit_ctx->vbo_id);
+   glBufferData(GL_ARRAY_BUFFER, BLIT_VBO_QUADS * sizeof(blit_ctx->vertices), NULL, GL_STREAM_DRAW);
+   glVertexAttribPointer(BLIT_ATTRIB_POS, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+   glVertexAttribPointer(BLIT_ATTRIB_TEXCOORD, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(4 * sizeof(float)));
+   glEnableVertexAttribArray(BLIT_ATTRIB_POS);
+   glEnableVertexAttribArray(BLIT_ATTRIB_TEXCOORD);
+
+   GLenum buffers = GL_COLOR_ATTACHMENT0;
+   glBindFramebuffer(GL_FRAMEBUFFER, blit_ctx->fb_id);
+   glDrawBuffers(1, &buffers);
+
+   set_dsa_write_depth_keep_stencil();
+   glDisable(GL_SCISSOR_TEST);
+
+   /* Warm the common variants: plain 2D color copies and depth copies */
+   blit_build_frag_tex_col(blit_ctx, TGSI_TEXTURE_2D, TGSI_RETURN_TYPE_UNORM, NULL);
+   blit_build_frag_tex_writedepth(blit_ctx, TGSI_TEXTURE_2D);
 }
 
 static inline GLenum convert_mag_filter(unsigned int filter)
@@ -480,7 +554,27 @@ static void blitter_set_rectangle(struct vrend_blitter_ctx *blit_ctx,
    for (i = 0; i < 4; i++)
       blit_ctx->vertices[i][0][2] = depth; /*z*/
 
-   glViewport(0, 0, blit_ctx->dst_width, blit_ctx->dst_height);
+   if (blit_ctx->viewport_width != blit_ctx->dst_width ||
+       blit_ctx->viewport_height != blit_ctx->dst_height) {
+      glViewport(0, 0, blit_ctx->dst_width, blit_ctx->dst_height);
+      blit_ctx->viewport_width = blit_ctx->dst_width;
+      blit_ctx->viewport_height = blit_ctx->dst_height;
+   }
+}
+
+/* Write the quad into the next free slot of the vbo and draw it */
+static void blitter_draw_quad(struct vrend_blitter_ctx *blit_ctx)
+{
+   if (blit_ctx->vbo_quad == BLIT_VBO_QUADS) {
+      /* orphan instead of waiting for the draws still reading the old storage */
+      glBufferData(GL_ARRAY_BUFFER, BLIT_VBO_QUADS * sizeof(blit_ctx->vertices), NULL, GL_STREAM_DRAW);
+      blit_ctx->vbo_quad = 0;
+   }
+
+   glBufferSubData(GL_ARRAY_BUFFER, blit_ctx->vbo_quad * sizeof(blit_ctx->vertices),
+                   sizeof(blit_ctx->vertices), blit_ctx->vertices);
+   glDrawArrays(GL_TRIANGLE_FAN, blit_ctx->vbo_quad * 4, 4);
+   blit_ctx->vbo_quad++;
 }
 
 static void get_texcoords(struct vrend_blitter_ctx *blit_ctx,
@@ -672,13 +766,8 @@ void vrend_renderer_blit_gl(struct virgl_client *client,
 
    blit_ctx = client->vrend_blit_ctx;
 
-   GLuint buffers;
-   GLuint prog_id;
-   GLuint fs_id;
-   GLint lret;
+   struct vrend_blitter_program *program;
    GLenum filter;
-   GLuint pos_loc, tc_loc;
-   GLuint samp_loc;
    bool has_depth, has_stencil;
    bool blit_stencil, blit_depth;
    int dst_z;
@@ -722,34 +811,19 @@ void vrend_renderer_blit_gl(struct virgl_client *client,
 
    blitter_set_rectangle(blit_ctx, dst0.x, dst0.y, dst1.x, dst1.y, 0);
 
-   prog_id = glCreateProgram();
-   glAttachShader(prog_id, blit_ctx->vs);
-
    if (blit_depth || blit_stencil) {
-      fs_id = blit_get_frag_tex_writedepth(blit_ctx, src_res->base.target,
-                                           src_res->base.nr_samples);
+      program = blit_get_frag_tex_writedepth(blit_ctx, src_res->base.target,
+                                             src_res->base.nr_samples);
    } else {
-      fs_id = blit_get_frag_tex_col(blit_ctx, src_res->base.target,
-                                    src_res->base.nr_samples,
-                                    src_entry, dst_entry,
-                                    skip_dest_swizzle);
+      program = blit_get_frag_tex_col(blit_ctx, src_res->base.target,
+                                      src_res->base.nr_samples,
+                                      src_entry, dst_entry,
+                                      skip_dest_swizzle);
    }
-   glAttachShader(prog_id, fs_id);
-
-   glLinkProgram(prog_id);
-   glGetProgramiv(prog_id, GL_LINK_STATUS, &lret);
-   if (lret == GL_FALSE) {
-      glDeleteProgram(prog_id);
+   if (!program)
       return;
-   }
 
-   glUseProgram(prog_id);
-
-   glBindFramebuffer(GL_FRAMEBUFFER, blit_ctx->fb_id);
-   vrend_fb_bind_texture_id(dst_res, blit_views[1], 0, info->dst.level, info->dst.box.z);
-
-   buffers = GL_COLOR_ATTACHMENT0;
-   glDrawBuffers(1, &buffers);
+   blit_use_program(blit_ctx, program);
 
    glBindTexture(src_res->target, blit_views[0]);
 
@@ -782,25 +856,14 @@ void vrend_renderer_blit_gl(struct virgl_client *client,
       glTexParameterf(src_res->target, GL_TEXTURE_MAG_FILTER, filter);
       glTexParameterf(src_res->target, GL_TEXTURE_MIN_FILTER, filter);
    }
-   pos_loc = glGetAttribLocation(prog_id, "arg0");
-   tc_loc = glGetAttribLocation(prog_id, "arg1");
-   samp_loc = glGetUniformLocation(prog_id, "samp");
-
-   glUniform1i(samp_loc, 0);
-
-   glVertexAttribPointer(pos_loc, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-   glVertexAttribPointer(tc_loc, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(4 * sizeof(float)));
-
-   glEnableVertexAttribArray(pos_loc);
-   glEnableVertexAttribArray(tc_loc);
-
-   set_dsa_write_depth_keep_stencil();
 
    if (info->scissor_enable) {
       glScissor(info->scissor.minx, info->scissor.miny, info->scissor.maxx - info->scissor.minx, info->scissor.maxy - info->scissor.miny);
-      glEnable(GL_SCISSOR_TEST);
-   } else
+      if (!blit_ctx->scissor_enabled)
+         glEnable(GL_SCISSOR_TEST);
+   } else if (blit_ctx->scissor_enabled)
       glDisable(GL_SCISSOR_TEST);
+   blit_ctx->scissor_enabled = info->scissor_enable;
 
    for (dst_z = 0; dst_z < info->dst.box.depth; dst_z++) {
       float dst2src_scale = info->src.box.depth / (float)info->dst.box.depth;
@@ -809,21 +872,15 @@ void vrend_renderer_blit_gl(struct virgl_client *client,
       float src_z = (dst_z + dst_offset) * dst2src_scale;
       uint32_t layer = (dst_res->target == GL_TEXTURE_CUBE_MAP) ? info->dst.box.z : dst_z;
 
-      glBindFramebuffer(GL_FRAMEBUFFER, blit_ctx->fb_id);
       vrend_fb_bind_texture_id(dst_res, blit_views[1], 0, info->dst.level, layer);
 
-      buffers = GL_COLOR_ATTACHMENT0;
-      glDrawBuffers(1, &buffers);
       blitter_set_texcoords(blit_ctx, src_res, info->src.level,
                             info->src.box.z + src_z, 0,
                             src0.x, src0.y, src1.x, src1.y);
 
-      glBufferData(GL_ARRAY_BUFFER, sizeof(blit_ctx->vertices), blit_ctx->vertices, GL_STATIC_DRAW);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+      blitter_draw_quad(blit_ctx);
    }
 
-   glUseProgram(0);
-   glDeleteProgram(prog_id);
    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
                              GL_TEXTURE_2D, 0, 0);
    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
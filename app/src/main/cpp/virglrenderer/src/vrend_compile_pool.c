@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "util/u_double_list.h"
+#include "os/os_thread.h"
+
+#include "native_trace.h"
+#include "vrend_compile_pool.h"
+
+enum vrend_compile_job_type {
+   VREND_COMPILE_JOB_SHADER,
+   VREND_COMPILE_JOB_PROGRAM,
+};
+
+enum vrend_compile_job_state {
+   VREND_COMPILE_JOB_QUEUED,
+   VREND_COMPILE_JOB_RUNNING,
+   VREND_COMPILE_JOB_DONE,
+};
+
+struct vrend_compile_job {
+   struct list_head head;
+   enum vrend_compile_job_type type;
+   enum vrend_compile_job_state state;
+   GLuint id;
+   bool result;
+   struct vrend_compile_pool *pool;
+
+   const char **strings;
+   int num_strings;
+
+   struct vrend_compile_job *deps[VREND_COMPILE_JOB_MAX_DEPS];
+   int num_deps;
+};
+
+struct vrend_compile_pool {
+   struct virgl_client *client;
+
+   pipe_mutex lock;
+   pipe_condvar queue_cond;
+   pipe_condvar done_cond;
+   struct list_head queue;
+   bool quit;
+
+   int num_threads;
+   pipe_thread threads[VREND_COMPILE_POOL_MAX_THREADS];
+   virgl_gl_context contexts[VREND_COMPILE_POOL_MAX_THREADS];
+};
+
+struct vrend_compile_worker {
+   struct vrend_compile_pool *pool;
+   virgl_gl_context gl_context;
+};
+
+static bool vrend_compile_job_run(struct vrend_compile_job *job)
+{
+   GLint status = GL_FALSE;
+   int i;
+
+   for (i = 0; i < job->num_deps; i++) {
+      if (!vrend_compile_job_wait(job->deps[i]))
+         return false;
+   }
+
+   switch (job->type) {
+   case VREND_COMPILE_JOB_SHADER: {
+      NATIVE_TRACE_SCOPE("vrend_compile_shader");
+      glShaderSource(job->id, job->num_strings, job->strings, NULL);
+      glCompileShader(job->id);
+      glGetShaderiv(job->id, GL_COMPILE_STATUS, &status);
+      break;
+   }
+   case VREND_COMPILE_JOB_PROGRAM: {
+      NATIVE_TRACE_SCOPE("vrend_link_program");
+      glLinkProgram(job->id);
+      glGetProgramiv(job->id, GL_LINK_STATUS, &status);
+      break;
+   }
+   }
+   return status != GL_FALSE;
+}
+
+static void vrend_compile_job_finish(struct vrend_compile_pool *pool,
+                                     struct vrend_compile_job *job, bool result)
+{
+   pipe_mutex_lock(pool->lock);
+   job->result = result;
+   job->state = VREND_COMPILE_JOB_DONE;
+   pipe_condvar_broadcast(pool->done_cond);
+   pipe_mutex_unlock(pool->lock);
+}
+
+static PIPE_THREAD_ROUTINE(vrend_compile_worker_main, param)
+{
+   struct vrend_compile_worker *worker = param;
+   struct vrend_compile_pool *pool = worker->pool;
+   struct vrend_compile_job *job;
+   bool result;
+
+   vrend_clicbs->make_current(pool->client, worker->gl_context);
+   FREE(worker);
+
+   pipe_mutex_lock(pool->lock);
+   while (!pool->quit) {
+      if (LIST_IS_EMPTY(&pool->queue)) {
+         pipe_condvar_wait(pool->queue_cond, pool->lock);
+         continue;
+      }
+
+      job = LIST_ENTRY(struct vrend_compile_job, pool->queue.next, head);
+      list_delinit(&job->head);
+      job->state = VREND_COMPILE_JOB_RUNNING;
+      pipe_mutex_unlock(pool->lock);
+
+      result = vrend_compile_job_run(job);
+      /* make the compiled/linked object visible to the renderer contexts */
+      glFinish();
+
+      vrend_compile_job_finish(pool, job, result);
+      pipe_mutex_lock(pool->lock);
+   }
+   pipe_mutex_unlock(pool->lock);
+
+   vrend_clicbs->make_current(pool->client, NULL);
+   return 0;
+}
+
+struct vrend_compile_pool *vrend_compile_pool_create(struct virgl_client *client, int num_threads)
+{
+   struct vrend_compile_pool *pool;
+   struct vrend_compile_worker *worker;
+   int i;
+
+   if (num_threads <= 0)
+      return NULL;
+   if (num_threads > VREND_COMPILE_POOL_MAX_THREADS)
+      num_threads = VREND_COMPILE_POOL_MAX_THREADS;
+
+   pool = CALLOC_STRUCT(vrend_compile_pool);
+   if (!pool)
+      return NULL;
+
+   pool->client = client;
+   pipe_mutex_init(pool->lock);
+   pipe_condvar_init(pool->queue_cond);
+   pipe_condvar_init(pool->done_cond);
+   list_inithead(&pool->queue);
+
+   for (i = 0; i < num_threads; i++) {
+      virgl_gl_context gl_context = vrend_clicbs->create_gl_context(client);
+      if (!gl_context)
+         break;
+
+      worker = CALLOC_STRUCT(vrend_compile_worker);
+      if (!worker) {
+         vrend_clicbs->destroy_gl_context(client, gl_context);
+         break;
+      }
+      worker->pool = pool;
+      worker->gl_context = gl_context;
+
+      pool->threads[i] = pipe_thread_create(vrend_compile_worker_main, worker);
+      if (!pool->threads[i]) {
+         FREE(worker);
+         vrend_clicbs->destroy_gl_context(client, gl_context);
+         break;
+      }
+      pool->contexts[i] = gl_context;
+      pool->num_threads++;
+   }
+
+   if (!pool->num_threads) {
+      vrend_compile_pool_destroy(pool);
+      return NULL;
+   }
+   return pool;
+}
+
+void vrend_compile_pool_destroy(struct vrend_compile_pool *pool)
+{
+   struct vrend_compile_job *job, *tmp;
+   int i;
+
+   if (!pool)
+      return;
+
+   pipe_mutex_lock(pool->lock);
+   pool->quit = true;
+   pipe_condvar_broadcast(pool->queue_cond);
+   pipe_mutex_unlock(pool->lock);
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_thread_wait(pool->threads[i]);
+      vrend_clicbs->destroy_gl_context(pool->client, pool->contexts[i]);
+   }
+
+   /* jobs are owned by their submitters, just detach what never ran */
+   LIST_FOR_EACH_ENTRY_SAFE(job, tmp, &pool->queue, head) {
+      list_delinit(&job->head);
+      job->state = VREND_COMPILE_JOB_DONE;
+      job->result = false;
+   }
+
+   pipe_condvar_destroy(pool->done_cond);
+   pipe_condvar_destroy(pool->queue_cond);
+   pipe_mutex_destroy(pool->lock);
+   FREE(pool);
+}
+
+static struct vrend_compile_job *vrend_compile_pool_submit(struct vrend_compile_pool *pool,
+                                                           struct vrend_compile_job *job)
+{
+   pipe_mutex_lock(pool->lock);
+   job->pool = pool;
+   job->state = VREND_COMPILE_JOB_QUEUED;
+   list_addtail(&job->head, &pool->queue);
+   pipe_condvar_signal(pool->queue_cond);
+   pipe_mutex_unlock(pool->lock);
+   return job;
+}
+
+struct vrend_compile_job *vrend_compile_pool_compile(struct vrend_compile_pool *pool,
+                                                     GLuint shader_id,
+                                                     const char **strings,
+                                                     int num_strings)
+{
+   struct vrend_compile_job *job = CALLOC_STRUCT(vrend_compile_job);
+   if (!job)
+      return NULL;
+
+   job->strings = malloc(num_strings * sizeof(*job->strings));
+   if (!job->strings) {
+      FREE(job);
+      return NULL;
+   }
+   memcpy(job->strings, strings, num_strings * sizeof(*job->strings));
+   job->num_strings = num_strings;
+   job->type = VREND_COMPILE_JOB_SHADER;
+   job->id = shader_id;
+   return vrend_compile_pool_submit(pool, job);
+}
+
+struct vrend_compile_job *vrend_compile_pool_link(struct vrend_compile_pool *pool,
+                                                  GLuint prog_id,
+                                                  struct vrend_compile_job **deps,
+                                                  int num_deps)
+{
+   struct vrend_compile_job *job = CALLOC_STRUCT(vrend_compile_job);
+   int i;
+
+   if (!job)
+      return NULL;
+
+   job->type = VREND_COMPILE_JOB_PROGRAM;
+   job->id = prog_id;
+   for (i = 0; i < num_deps && job->num_deps < VREND_COMPILE_JOB_MAX_DEPS; i++) {
+      if (deps[i])
+         job->deps[job->num_deps++] = deps[i];
+   }
+   return vrend_compile_pool_submit(pool, job);
+}
+
+bool vrend_compile_job_done(struct vrend_compile_job *job)
+{
+   struct vrend_compile_pool *pool = job->pool;
+   bool done;
+
+   pipe_mutex_lock(pool->lock);
+   done = job->state == VREND_COMPILE_JOB_DONE;
+   pipe_mutex_unlock(pool->lock);
+   return done;
+}
+
+bool vrend_compile_job_wait(struct vrend_compile_job *job)
+{
+   struct vrend_compile_pool *pool = job->pool;
+   bool result;
+
+   pipe_mutex_lock(pool->lock);
+   if (job->state == VREND_COMPILE_JOB_QUEUED) {
+      /* nobody picked it up yet, run it on this thread's context */
+      list_delinit(&job->head);
+      job->state = VREND_COMPILE_JOB_RUNNING;
+      pipe_mutex_unlock(pool->lock);
+
+      vrend_compile_job_finish(pool, job, vrend_compile_job_run(job));
+      pipe_mutex_lock(pool->lock);
+   }
+
+   while (job->state != VREND_COMPILE_JOB_DONE)
+      pipe_condvar_wait(pool->done_cond, pool->lock);
+   result = job->result;
+   pipe_mutex_unlock(pool->lock);
+   return result;
+}
+
+void vrend_compile_job_release(struct vrend_compile_job **job)
+{
+   if (!*job)
+      return;
+
+   vrend_compile_job_wait(*job);
+   free((*job)->strings);
+   FREE(*job);
+   *job = NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef VREND_COMPILE_POOL_H
+#define VREND_COMPILE_POOL_H
+
+#include <stdbool.h>
+
+#include "vrend_renderer.h"
+
+/*
+ * Background shader compile / program link workers.
+ *
+ * Each worker owns a GL context created through vrend_clicbs, so it shares
+ * objects with every renderer context.  Jobs run in submission order; a
+ * job may depend on earlier jobs (a link on the compiles of its stages).
+ * Waiting on a job that no worker has picked up yet runs it inline on the
+ * calling thread instead of waiting for a worker to get to it.
+ */
+
+#define VREND_COMPILE_POOL_MAX_THREADS 4
+#define VREND_COMPILE_JOB_MAX_DEPS 6
+
+struct vrend_compile_pool;
+struct vrend_compile_job;
+
+struct vrend_compile_pool *vrend_compile_pool_create(struct virgl_client *client, int num_threads);
+void vrend_compile_pool_destroy(struct vrend_compile_pool *pool);
+
+/* strings must stay valid and unmodified until the job is done */
+struct vrend_compile_job *vrend_compile_pool_compile(struct vrend_compile_pool *pool,
+                                                     GLuint shader_id,
+                                                     const char **strings,
+                                                     int num_strings);
+/* deps may contain NULL entries, which are ignored */
+struct vrend_compile_job *vrend_compile_pool_link(struct vrend_compile_pool *pool,
+                                                  GLuint prog_id,
+                                                  struct vrend_compile_job **deps,
+                                                  int num_deps);
+
+bool vrend_compile_job_done(struct vrend_compile_job *job);
+/* blocks until the job has run and returns whether it succeeded */
+bool vrend_compile_job_wait(struct vrend_compile_job *job);
+/* waits for the job and frees it; *job is cleared.  Every job must be
+ * released before its pool is destroyed. */
+void vrend_compile_job_release(struct vrend_compile_job **job);
+
+#endif
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 #include "util/u_memory.h"
 #include "pipe/p_defines.h"
@@ -384,45 +385,109 @@ static int vrend_decode_resource_inline_write(struct vrend_decode_ctx *ctx, uint
    return vrend_transfer_inline_write(ctx->grctx, &info);
 }
 
-static int vrend_decode_draw_vbo(struct vrend_decode_ctx *ctx, int length)
+static int vrend_decode_draw_info(struct vrend_decode_ctx *ctx, int length,
+                                  struct pipe_draw_info *info, uint32_t *cso,
+                                  uint32_t *handle, uint32_t *indirect_draw_count_handle)
 {
-   struct pipe_draw_info info;
-   uint32_t cso;
-   uint32_t handle = 0, indirect_draw_count_handle = 0;
    if (length != VIRGL_DRAW_VBO_SIZE && length != VIRGL_DRAW_VBO_SIZE_TESS &&
        length != VIRGL_DRAW_VBO_SIZE_INDIRECT)
       return EINVAL;
-   memset(&info, 0, sizeof(struct pipe_draw_info));
-
-   info.start = get_buf_entry(ctx, VIRGL_DRAW_VBO_START);
-   info.count = get_buf_entry(ctx, VIRGL_DRAW_VBO_COUNT);
-   info.mode = get_buf_entry(ctx, VIRGL_DRAW_VBO_MODE);
-   info.indexed = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDEXED);
-   info.instance_count = get_buf_entry(ctx, VIRGL_DRAW_VBO_INSTANCE_COUNT);
-   info.index_bias = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDEX_BIAS);
-   info.start_instance = get_buf_entry(ctx, VIRGL_DRAW_VBO_START_INSTANCE);
-   info.primitive_restart = get_buf_entry(ctx, VIRGL_DRAW_VBO_PRIMITIVE_RESTART);
-   info.restart_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_RESTART_INDEX);
-   info.min_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_MIN_INDEX);
-   info.max_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_MAX_INDEX);
+   memset(info, 0, sizeof(struct pipe_draw_info));
+   *handle = 0;
+   *indirect_draw_count_handle = 0;
+
+   info->start = get_buf_entry(ctx, VIRGL_DRAW_VBO_START);
+   info->count = get_buf_entry(ctx, VIRGL_DRAW_VBO_COUNT);
+   info->mode = get_buf_entry(ctx, VIRGL_DRAW_VBO_MODE);
+   info->indexed = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDEXED);
+   info->instance_count = get_buf_entry(ctx, VIRGL_DRAW_VBO_INSTANCE_COUNT);
+   info->index_bias = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDEX_BIAS);
+   info->start_instance = get_buf_entry(ctx, VIRGL_DRAW_VBO_START_INSTANCE);
+   info->primitive_restart = get_buf_entry(ctx, VIRGL_DRAW_VBO_PRIMITIVE_RESTART);
+   info->restart_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_RESTART_INDEX);
+   info->min_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_MIN_INDEX);
+   info->max_index = get_buf_entry(ctx, VIRGL_DRAW_VBO_MAX_INDEX);
 
    if (length >= VIRGL_DRAW_VBO_SIZE_TESS) {
-      info.vertices_per_patch = get_buf_entry(ctx, VIRGL_DRAW_VBO_VERTICES_PER_PATCH);
-      info.drawid = get_buf_entry(ctx, VIRGL_DRAW_VBO_DRAWID);
+      info->vertices_per_patch = get_buf_entry(ctx, VIRGL_DRAW_VBO_VERTICES_PER_PATCH);
+      info->drawid = get_buf_entry(ctx, VIRGL_DRAW_VBO_DRAWID);
    }
 
    if (length == VIRGL_DRAW_VBO_SIZE_INDIRECT) {
-      handle = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_HANDLE);
-      info.indirect.offset = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_OFFSET);
-      info.indirect.stride = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_STRIDE);
-      info.indirect.draw_count = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT);
-      info.indirect.indirect_draw_count_offset = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_OFFSET);
-      indirect_draw_count_handle = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_HANDLE);
+      *handle = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_HANDLE);
+      info->indirect.offset = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_OFFSET);
+      info->indirect.stride = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_STRIDE);
+      info->indirect.draw_count = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT);
+      info->indirect.indirect_draw_count_offset = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_OFFSET);
+      *indirect_draw_count_handle = get_buf_entry(ctx, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_HANDLE);
    }
 
-   cso = get_buf_entry(ctx, VIRGL_DRAW_VBO_COUNT_FROM_SO);
+   *cso = get_buf_entry(ctx, VIRGL_DRAW_VBO_COUNT_FROM_SO);
+   return 0;
+}
+
+/* a draw everything of which but start, count and index_bias is state
+ * already set, so it can be merged with the draws right after it */
+static bool vrend_decode_draw_mergeable(const struct pipe_draw_info *info, uint32_t cso, int length)
+{
+   return length != VIRGL_DRAW_VBO_SIZE_INDIRECT && !cso &&
+          info->instance_count <= 1 && !info->start_instance &&
+          !info->primitive_restart && !info->vertices_per_patch && !info->drawid;
+}
+
+/* Collects the DRAW_VBO commands directly following the current one that
+ * can be drawn together with it into infos[1..], leaving the decoder on
+ * the last one merged.  Nothing but another draw comes in between, so all
+ * of them see the same state; the guest driver folds the draw start into
+ * the index buffer offset, so indexed draws only merge when that stayed. */
+static int vrend_decode_merge_draws(struct vrend_decode_ctx *ctx, int length,
+                                    struct pipe_draw_info *infos)
+{
+   struct vrend_decoder_state *ds = ctx->ds;
+   uint32_t last = ds->buf_offset;
+   uint32_t next = last + length + 1;
+   int num_draws = 1;
+
+   while (num_draws < VREND_MAX_MERGED_DRAWS && next + length + 1 <= ds->buf_total) {
+      uint32_t header = ds->buf[next];
+      struct pipe_draw_info *info = &infos[num_draws];
+      uint32_t cso, handle, indirect_draw_count_handle;
+
+      if ((header & 0xff) != VIRGL_CCMD_DRAW_VBO || (header >> 16) != (uint32_t)length)
+         break;
+
+      ds->buf_offset = next;
+      vrend_decode_draw_info(ctx, length, info, &cso, &handle, &indirect_draw_count_handle);
+      if (!vrend_decode_draw_mergeable(info, cso, length) ||
+          info->mode != infos[0].mode || info->indexed != infos[0].indexed)
+         break;
 
-   return vrend_draw_vbo(ctx->grctx, &info, cso, handle, indirect_draw_count_handle);
+      num_draws++;
+      last = next;
+      next += length + 1;
+   }
+
+   ds->buf_offset = last;
+   return num_draws;
+}
+
+static int vrend_decode_draw_vbo(struct vrend_decode_ctx *ctx, int length)
+{
+   struct pipe_draw_info infos[VREND_MAX_MERGED_DRAWS];
+   uint32_t cso, handle, indirect_draw_count_handle;
+   int num_draws, ret;
+
+   ret = vrend_decode_draw_info(ctx, length, &infos[0], &cso, &handle, &indirect_draw_count_handle);
+   if (ret)
+      return ret;
+
+   if (!vrend_decode_draw_mergeable(&infos[0], cso, length))
+      return vrend_draw_vbo(ctx->grctx, &infos[0], cso, handle, indirect_draw_count_handle);
+
+   num_draws = vrend_decode_merge_draws(ctx, length, infos);
+   if (num_draws == 1)
+      return vrend_draw_vbo(ctx->grctx, &infos[0], 0, 0, 0);
+   return vrend_draw_vbo_merged(ctx->grctx, infos, num_draws);
 }
 
 static int vrend_decode_create_blend(struct vrend_decode_ctx *ctx, uint32_t handle, uint16_t length)
@@ -435,7 +500,7 @@ static int vrend_decode_create_blend(struct vrend_decode_ctx *ctx, uint32_t hand
       return EINVAL;
    }
 
-   blend_state = CALLOC_STRUCT(pipe_blend_state);
+   blend_state = vrend_renderer_object_alloc(ctx->grctx, VIRGL_OBJECT_BLEND);
    if (!blend_state)
       return ENOMEM;
 
@@ -464,7 +529,7 @@ static int vrend_decode_create_blend(struct vrend_decode_ctx *ctx, uint32_t hand
    tmp = vrend_renderer_object_insert(ctx->grctx, blend_state, sizeof(struct pipe_blend_state), handle,
                                       VIRGL_OBJECT_BLEND);
    if (tmp == 0) {
-      FREE(blend_state);
+      vrend_renderer_object_free(blend_state);
       return ENOMEM;
    }
    return 0;
@@ -479,7 +544,7 @@ static int vrend_decode_create_dsa(struct vrend_decode_ctx *ctx, uint32_t handle
    if (length != VIRGL_OBJ_DSA_SIZE)
       return EINVAL;
 
-   dsa_state = CALLOC_STRUCT(pipe_depth_stencil_alpha_state);
+   dsa_state = vrend_renderer_object_alloc(ctx->grctx, VIRGL_OBJECT_DSA);
    if (!dsa_state)
       return ENOMEM;
 
@@ -508,7 +573,7 @@ static int vrend_decode_create_dsa(struct vrend_decode_ctx *ctx, uint32_t handle
    tmp = vrend_renderer_object_insert(ctx->grctx, dsa_state, sizeof(struct pipe_depth_stencil_alpha_state), handle,
                                       VIRGL_OBJECT_DSA);
    if (tmp == 0) {
-      FREE(dsa_state);
+      vrend_renderer_object_free(dsa_state);
       return ENOMEM;
    }
    return 0;
@@ -522,7 +587,7 @@ static int vrend_decode_create_rasterizer(struct vrend_decode_ctx *ctx, uint32_t
    if (length != VIRGL_OBJ_RS_SIZE)
       return EINVAL;
 
-   rs_state = CALLOC_STRUCT(pipe_rasterizer_state);
+   rs_state = vrend_renderer_object_alloc(ctx->grctx, VIRGL_OBJECT_RASTERIZER);
    if (!rs_state)
       return ENOMEM;
 
@@ -574,7 +639,7 @@ static int vrend_decode_create_rasterizer(struct vrend_decode_ctx *ctx, uint32_t
    tmp = vrend_renderer_object_insert(ctx->grctx, rs_state, sizeof(struct pipe_rasterizer_state), handle,
                                       VIRGL_OBJECT_RASTERIZER);
    if (tmp == 0) {
-      FREE(rs_state);
+      vrend_renderer_object_free(rs_state);
       return ENOMEM;
    }
    return 0;
@@ -648,10 +713,9 @@ static int vrend_decode_create_sampler_state(struct vrend_decode_ctx *ctx, uint3
 
 static int vrend_decode_create_ve(struct vrend_decode_ctx *ctx, uint32_t handle, uint16_t length)
 {
-   struct pipe_vertex_element *ve = NULL;
+   struct pipe_vertex_element ve[PIPE_MAX_ATTRIBS];
    int num_elements;
    int i;
-   int ret;
 
    if (length < 1)
       return EINVAL;
@@ -661,30 +725,22 @@ static int vrend_decode_create_ve(struct vrend_decode_ctx *ctx, uint32_t handle,
 
    num_elements = (length - 1) / 4;
 
-   if (num_elements) {
-      ve = calloc(num_elements, sizeof(struct pipe_vertex_element));
-
-      if (!ve)
-         return ENOMEM;
+   if (num_elements > PIPE_MAX_ATTRIBS)
+      return EINVAL;
 
-      for (i = 0; i < num_elements; i++) {
-         ve[i].src_offset = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_SRC_OFFSET(i));
-         ve[i].instance_divisor = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_INSTANCE_DIVISOR(i));
-         ve[i].vertex_buffer_index = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_VERTEX_BUFFER_INDEX(i));
+   for (i = 0; i < num_elements; i++) {
+      memset(&ve[i], 0, sizeof(ve[i]));
+      ve[i].src_offset = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_SRC_OFFSET(i));
+      ve[i].instance_divisor = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_INSTANCE_DIVISOR(i));
+      ve[i].vertex_buffer_index = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_VERTEX_BUFFER_INDEX(i));
 
-         if (ve[i].vertex_buffer_index >= PIPE_MAX_ATTRIBS) {
-            FREE(ve);
-            return EINVAL;
-         }
+      if (ve[i].vertex_buffer_index >= PIPE_MAX_ATTRIBS)
+         return EINVAL;
 
-         ve[i].src_format = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_SRC_FORMAT(i));
-      }
+      ve[i].src_format = get_buf_entry(ctx, VIRGL_OBJ_VERTEX_ELEMENTS_V0_SRC_FORMAT(i));
    }
 
-   ret = vrend_create_vertex_elements_state(ctx->grctx, handle, num_elements, ve);
-
-   FREE(ve);
-   return ret;
+   return vrend_create_vertex_elements_state(ctx->grctx, handle, num_elements, ve);
 }
 
 static int vrend_decode_create_query(struct vrend_decode_ctx *ctx, uint32_t handle, uint16_t length)
@@ -1355,11 +1411,96 @@ struct vrend_context *vrend_lookup_renderer_ctx(struct virgl_client *client, uin
    return client->dec_ctx[ctx_id]->grctx;
 }
 
+static const char *vrend_decode_command_names[VIRGL_MAX_COMMANDS] = {
+   [VIRGL_CCMD_NOP] = "nop",
+   [VIRGL_CCMD_CREATE_OBJECT] = "create_object",
+   [VIRGL_CCMD_BIND_OBJECT] = "bind_object",
+   [VIRGL_CCMD_DESTROY_OBJECT] = "destroy_object",
+   [VIRGL_CCMD_SET_VIEWPORT_STATE] = "set_viewport_state",
+   [VIRGL_CCMD_SET_FRAMEBUFFER_STATE] = "set_framebuffer_state",
+   [VIRGL_CCMD_SET_VERTEX_BUFFERS] = "set_vertex_buffers",
+   [VIRGL_CCMD_CLEAR] = "clear",
+   [VIRGL_CCMD_DRAW_VBO] = "draw_vbo",
+   [VIRGL_CCMD_RESOURCE_INLINE_WRITE] = "resource_inline_write",
+   [VIRGL_CCMD_SET_SAMPLER_VIEWS] = "set_sampler_views",
+   [VIRGL_CCMD_SET_INDEX_BUFFER] = "set_index_buffer",
+   [VIRGL_CCMD_SET_CONSTANT_BUFFER] = "set_constant_buffer",
+   [VIRGL_CCMD_SET_STENCIL_REF] = "set_stencil_ref",
+   [VIRGL_CCMD_SET_BLEND_COLOR] = "set_blend_color",
+   [VIRGL_CCMD_SET_SCISSOR_STATE] = "set_scissor_state",
+   [VIRGL_CCMD_BLIT] = "blit",
+   [VIRGL_CCMD_RESOURCE_COPY_REGION] = "resource_copy_region",
+   [VIRGL_CCMD_BIND_SAMPLER_STATES] = "bind_sampler_states",
+   [VIRGL_CCMD_BEGIN_QUERY] = "begin_query",
+   [VIRGL_CCMD_END_QUERY] = "end_query",
+   [VIRGL_CCMD_GET_QUERY_RESULT] = "get_query_result",
+   [VIRGL_CCMD_SET_POLYGON_STIPPLE] = "set_polygon_stipple",
+   [VIRGL_CCMD_SET_CLIP_STATE] = "set_clip_state",
+   [VIRGL_CCMD_SET_SAMPLE_MASK] = "set_sample_mask",
+   [VIRGL_CCMD_SET_STREAMOUT_TARGETS] = "set_streamout_targets",
+   [VIRGL_CCMD_SET_RENDER_CONDITION] = "set_render_condition",
+   [VIRGL_CCMD_SET_UNIFORM_BUFFER] = "set_uniform_buffer",
+   [VIRGL_CCMD_SET_SUB_CTX] = "set_sub_ctx",
+   [VIRGL_CCMD_CREATE_SUB_CTX] = "create_sub_ctx",
+   [VIRGL_CCMD_DESTROY_SUB_CTX] = "destroy_sub_ctx",
+   [VIRGL_CCMD_BIND_SHADER] = "bind_shader",
+   [VIRGL_CCMD_SET_TESS_STATE] = "set_tess_state",
+   [VIRGL_CCMD_SET_MIN_SAMPLES] = "set_min_samples",
+   [VIRGL_CCMD_SET_SHADER_BUFFERS] = "set_shader_buffers",
+   [VIRGL_CCMD_SET_SHADER_IMAGES] = "set_shader_images",
+   [VIRGL_CCMD_MEMORY_BARRIER] = "memory_barrier",
+   [VIRGL_CCMD_LAUNCH_GRID] = "launch_grid",
+   [VIRGL_CCMD_SET_FRAMEBUFFER_STATE_NO_ATTACH] = "set_framebuffer_state_no_attach",
+   [VIRGL_CCMD_TEXTURE_BARRIER] = "texture_barrier",
+   [VIRGL_CCMD_SET_ATOMIC_BUFFERS] = "set_atomic_buffers",
+   [VIRGL_CCMD_SET_DEBUG_FLAGS] = "set_debug_flags",
+   [VIRGL_CCMD_GET_QUERY_RESULT_QBO] = "get_query_result_qbo",
+   [VIRGL_CCMD_TRANSFER3D] = "transfer3d",
+   [VIRGL_CCMD_END_TRANSFERS] = "end_transfers",
+   [VIRGL_CCMD_COPY_TRANSFER3D] = "copy_transfer3d",
+   [VIRGL_CCMD_SET_TWEAKS] = "set_tweaks",
+};
+
+static uint64_t vrend_decode_time_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* NULL unless the client enabled the counters, allocated on first use */
+static struct vrend_decode_stats *vrend_decode_ctx_stats(struct virgl_client *client, uint32_t ctx_id)
+{
+   struct vrend_decode_stats *stats;
+
+   if (!client->decode_stats_enabled)
+      return NULL;
+
+   stats = client->decode_stats[ctx_id];
+   if (!stats) {
+      stats = CALLOC_STRUCT(vrend_decode_stats);
+      __atomic_store_n(&client->decode_stats[ctx_id], stats, __ATOMIC_RELEASE);
+   }
+   return stats;
+}
+
+static void vrend_decode_account(struct vrend_decode_stats *stats, uint32_t cmd, uint64_t start)
+{
+   if (cmd >= VIRGL_MAX_COMMANDS)
+      return;
+
+   __atomic_add_fetch(&stats->count[cmd], 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&stats->ns[cmd], vrend_decode_time_ns() - start, __ATOMIC_RELAXED);
+}
+
 int vrend_decode_block(struct virgl_client *client, uint32_t ctx_id, uint32_t *block, int ndw)
 {
    struct vrend_decode_ctx *gdctx;
    bool bret;
    int ret;
+   struct vrend_decode_stats *stats;
+   uint64_t start = 0;
    if (ctx_id >= VREND_MAX_CTX)
       return EINVAL;
 
@@ -1375,6 +1516,10 @@ int vrend_decode_block(struct virgl_client *client, uint32_t ctx_id, uint32_t *b
    gdctx->ds->buf = block;
    gdctx->ds->buf_total = ndw;
    gdctx->ds->buf_offset = 0;
+   stats = vrend_decode_ctx_stats(client, ctx_id);
+
+   /* resources referenced from here on are covered by the next fence */
+   client->vrend_state->decoding = true;
 
    while (gdctx->ds->buf_offset < gdctx->ds->buf_total) {
       uint32_t header = gdctx->ds->buf[gdctx->ds->buf_offset];
@@ -1385,6 +1530,9 @@ int vrend_decode_block(struct virgl_client *client, uint32_t ctx_id, uint32_t *b
       if (gdctx->ds->buf_offset + len + 1 > gdctx->ds->buf_total)
          break;
 
+      if (stats)
+         start = vrend_decode_time_ns();
+
       switch (header & 0xff) {
       case VIRGL_CCMD_CREATE_OBJECT:
          ret = vrend_decode_create_object(gdctx, len);
@@ -1516,15 +1664,65 @@ int vrend_decode_block(struct virgl_client *client, uint32_t ctx_id, uint32_t *b
          ret = EINVAL;
       }
 
+      if (stats)
+         vrend_decode_account(stats, header & 0xff, start);
+
       if (ret == EINVAL || ret == ENOMEM)
          goto out;
       gdctx->ds->buf_offset += (len) + 1;
    }
+   client->vrend_state->decoding = false;
    return 0;
  out:
+   client->vrend_state->decoding = false;
    return ret;
 }
 
+void vrend_decode_enable_stats(struct virgl_client *client)
+{
+   client->decode_stats_enabled = true;
+}
+
+void vrend_decode_free_stats(struct virgl_client *client)
+{
+   int i;
+
+   for (i = 0; i < VREND_MAX_CTX; i++) {
+      FREE(client->decode_stats[i]);
+      client->decode_stats[i] = NULL;
+   }
+}
+
+void vrend_decode_get_stats(struct virgl_client *client, struct vrend_decode_stats *stats, bool reset)
+{
+   int i, cmd;
+
+   memset(stats, 0, sizeof(*stats));
+   for (i = 0; i < VREND_MAX_CTX; i++) {
+      struct vrend_decode_stats *ctx_stats = __atomic_load_n(&client->decode_stats[i], __ATOMIC_ACQUIRE);
+
+      if (!ctx_stats)
+         continue;
+
+      for (cmd = 0; cmd < VIRGL_MAX_COMMANDS; cmd++) {
+         if (reset) {
+            stats->count[cmd] += __atomic_exchange_n(&ctx_stats->count[cmd], 0, __ATOMIC_RELAXED);
+            stats->ns[cmd] += __atomic_exchange_n(&ctx_stats->ns[cmd], 0, __ATOMIC_RELAXED);
+         } else {
+            stats->count[cmd] += __atomic_load_n(&ctx_stats->count[cmd], __ATOMIC_RELAXED);
+            stats->ns[cmd] += __atomic_load_n(&ctx_stats->ns[cmd], __ATOMIC_RELAXED);
+         }
+      }
+   }
+}
+
+const char *vrend_decode_command_name(uint32_t cmd)
+{
+   if (cmd >= VIRGL_MAX_COMMANDS || !vrend_decode_command_names[cmd])
+      return "unknown";
+   return vrend_decode_command_names[cmd];
+}
+
 void vrend_decode_reset(struct virgl_client *client, bool ctx_0_only)
 {
    int i;
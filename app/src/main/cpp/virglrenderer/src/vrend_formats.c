@@ -25,6 +25,7 @@
 #include "vrend_util.h"
 #include "util/u_memory.h"
 #include "util/u_format.h"
+#include "vrend_texture_decode.h"
 
 #define SWIZZLE_INVALID 0xff
 #define NO_SWIZZLE { SWIZZLE_INVALID, SWIZZLE_INVALID, SWIZZLE_INVALID, SWIZZLE_INVALID }
@@ -177,6 +178,51 @@ static struct vrend_format_table exponent_float_formats[] = {
    { VIRGL_FORMAT_R9G9B9E5_FLOAT, GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, NO_SWIZZLE },
 };
 
+/* native block compression, only with the matching extension */
+static struct vrend_format_table s3tc_formats[] = {
+   { VIRGL_FORMAT_DXT1_RGB, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT1_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT3_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT5_RGBA, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+};
+
+static struct vrend_format_table s3tc_srgb_formats[] = {
+   { VIRGL_FORMAT_DXT1_SRGB, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT1_SRGBA, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT3_SRGBA, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_DXT5_SRGBA, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+};
+
+static struct vrend_format_table rgtc_formats[] = {
+   { VIRGL_FORMAT_RGTC1_UNORM, GL_COMPRESSED_RED_RGTC1_EXT, GL_RED, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_RGTC1_SNORM, GL_COMPRESSED_SIGNED_RED_RGTC1_EXT, GL_RED, GL_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_RGTC2_UNORM, GL_COMPRESSED_RED_GREEN_RGTC2_EXT, GL_RG, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_RGTC2_SNORM, GL_COMPRESSED_SIGNED_RED_GREEN_RGTC2_EXT, GL_RG, GL_BYTE, NO_SWIZZLE },
+};
+
+static struct vrend_format_table bptc_formats[] = {
+   { VIRGL_FORMAT_BPTC_RGBA_UNORM, GL_COMPRESSED_RGBA_BPTC_UNORM_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_BPTC_SRGBA, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_EXT, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE },
+   { VIRGL_FORMAT_BPTC_RGB_FLOAT, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_EXT, GL_RGB, GL_FLOAT, NO_SWIZZLE },
+   { VIRGL_FORMAT_BPTC_RGB_UFLOAT, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_EXT, GL_RGB, GL_FLOAT, NO_SWIZZLE },
+};
+
+/* otherwise the blocks are decoded on upload (vrend_texture_decode.c) */
+static struct vrend_format_table decoded_block_formats[] = {
+   { VIRGL_FORMAT_DXT1_RGB, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, RGB1_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT1_RGBA, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT3_RGBA, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT5_RGBA, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT1_SRGB, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, RGB1_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT1_SRGBA, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT3_SRGBA, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_DXT5_SRGBA, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_RGTC1_UNORM, GL_R8, GL_RED, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_RGTC1_SNORM, GL_R8_SNORM, GL_RED, GL_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_RGTC2_UNORM, GL_RG8, GL_RG, GL_UNSIGNED_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+   { VIRGL_FORMAT_RGTC2_SNORM, GL_RG8_SNORM, GL_RG, GL_BYTE, NO_SWIZZLE, 0, VIRGL_TEXTURE_NEED_DECODE },
+};
+
 static bool color_format_can_readback(struct vrend_format_table *virgl_format, int gles_ver)
 {
    GLint imp = 0;
@@ -270,6 +316,13 @@ static void vrend_add_formats(struct vrend_format_table *table, int num_entries)
     glDeleteTextures(1, &tex_id);
     glDeleteFramebuffers(1, &fb_id);
 
+    /* decoded block formats are only ever sampled, and read back as blocks */
+    flags |= table[i].flags;
+    if (flags & VIRGL_TEXTURE_NEED_DECODE) {
+       binding = VIRGL_BIND_SAMPLER_VIEW;
+       flags &= ~VIRGL_TEXTURE_CAN_READBACK;
+    }
+
     if (table[i].swizzle[0] != SWIZZLE_INVALID)
        vrend_insert_format_swizzle(table[i].format, &table[i], binding, table[i].swizzle, flags);
     else
@@ -277,7 +330,45 @@ static void vrend_add_formats(struct vrend_format_table *table, int num_entries)
   }
 }
 
+/* glTexImage2D without data is no valid probe for compressed formats on
+ * GLES, upload one zeroed block instead */
+static void vrend_add_compressed_formats(struct vrend_format_table *table, int num_entries)
+{
+  static const uint8_t zero_block[16];
+  int i;
+
+  for (i = 0; i < num_entries; i++) {
+    GLuint tex_id;
+    GLenum status;
+
+    glGenTextures(1, &tex_id);
+    glBindTexture(GL_TEXTURE_2D, tex_id);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, table[i].internalformat, 4, 4, 0,
+                           util_format_get_blocksize(table[i].format), zero_block);
+    status = glGetError();
+    glDeleteTextures(1, &tex_id);
+    if (status != GL_NO_ERROR)
+      continue;
+
+    vrend_insert_format(&table[i], VIRGL_BIND_SAMPLER_VIEW, 0);
+  }
+}
+
+/* falls back to decoding the formats the driver did not take natively */
+static void vrend_add_decoded_formats(struct vrend_format_table *table, int num_entries)
+{
+  int i;
+
+  for (i = 0; i < num_entries; i++) {
+    if (vrend_get_format_table_entry(table[i].format)->internalformat != 0 ||
+        !vrend_texture_decode_supported(table[i].format))
+      continue;
+    vrend_add_formats(&table[i], 1);
+  }
+}
+
 #define add_formats(x) vrend_add_formats((x), ARRAY_SIZE((x)))
+#define add_compressed_formats(x) vrend_add_compressed_formats((x), ARRAY_SIZE((x)))
 
 void vrend_build_format_list(void)
 {
@@ -312,6 +403,20 @@ void vrend_build_format_list(void)
 
    add_formats(packed_float_formats);
    add_formats(exponent_float_formats);
+
+   /* block compression: native when the driver has it, else decoded */
+   if (vrend_has_gl_extension("GL_EXT_texture_compression_s3tc") ||
+       vrend_has_gl_extension("GL_EXT_texture_compression_dxt1")) {
+      add_compressed_formats(s3tc_formats);
+      if (vrend_has_gl_extension("GL_EXT_texture_compression_s3tc_srgb"))
+         add_compressed_formats(s3tc_srgb_formats);
+   }
+   if (vrend_has_gl_extension("GL_EXT_texture_compression_rgtc"))
+      add_compressed_formats(rgtc_formats);
+   if (vrend_has_gl_extension("GL_EXT_texture_compression_bptc"))
+      add_compressed_formats(bptc_formats);
+
+   vrend_add_decoded_formats(decoded_block_formats, ARRAY_SIZE(decoded_block_formats));
 }
 
 /* glTexStorage may not support all that is supported by glTexImage,
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+
+#include "vrend_handle_table.h"
+
+#define VREND_HANDLE_TABLE_INITIAL_SIZE 64
+
+/* what a table being destroyed looks up and removes from */
+static struct vrend_handle_table_slot empty_slot;
+
+static bool vrend_handle_table_alloc(struct vrend_handle_table *table, uint32_t size)
+{
+   table->slots = calloc(size, sizeof(*table->slots));
+   if (!table->slots)
+      return false;
+   table->mask = size - 1;
+   return true;
+}
+
+struct vrend_handle_table *vrend_handle_table_create(void (*destroy)(void *value))
+{
+   struct vrend_handle_table *table = CALLOC_STRUCT(vrend_handle_table);
+
+   if (!table)
+      return NULL;
+
+   if (!vrend_handle_table_alloc(table, VREND_HANDLE_TABLE_INITIAL_SIZE)) {
+      FREE(table);
+      return NULL;
+   }
+   table->destroy = destroy;
+   return table;
+}
+
+void vrend_handle_table_destroy(struct vrend_handle_table *table)
+{
+   void **pages[VREND_HANDLE_TABLE_PAGES];
+   struct vrend_handle_table_slot *slots;
+   uint32_t i, j, size;
+
+   if (!table)
+      return;
+
+   /* detach everything first, destroy callbacks may still get or remove */
+   memcpy(pages, table->pages, sizeof(pages));
+   memset(table->pages, 0, sizeof(table->pages));
+   slots = table->slots;
+   size = table->mask + 1;
+   table->slots = &empty_slot;
+   table->mask = 0;
+   table->count = 0;
+
+   for (i = 0; i < VREND_HANDLE_TABLE_PAGES; i++) {
+      if (!pages[i])
+         continue;
+      for (j = 0; j < VREND_HANDLE_TABLE_PAGE_SIZE; j++) {
+         if (pages[i][j] && table->destroy)
+            table->destroy(pages[i][j]);
+      }
+      free(pages[i]);
+   }
+   for (i = 0; i < size; i++) {
+      if (slots[i].value && table->destroy)
+         table->destroy(slots[i].value);
+   }
+   free(slots);
+   FREE(table);
+}
+
+static bool vrend_handle_table_grow(struct vrend_handle_table *table)
+{
+   struct vrend_handle_table_slot *old = table->slots;
+   uint32_t old_size = table->mask + 1;
+   uint32_t i;
+
+   if (!vrend_handle_table_alloc(table, old_size * 2)) {
+      table->slots = old;
+      return false;
+   }
+
+   for (i = 0; i < old_size; i++) {
+      uint32_t j;
+
+      if (!old[i].value)
+         continue;
+
+      j = vrend_handle_table_bucket(table, old[i].handle);
+      while (table->slots[j].value)
+         j = (j + 1) & table->mask;
+      table->slots[j] = old[i];
+   }
+   free(old);
+   return true;
+}
+
+/* pages are kept once allocated, the guest reuses freed handles */
+static bool vrend_handle_table_set_direct(struct vrend_handle_table *table, uint32_t handle,
+                                          void *value)
+{
+   void ***page = &table->pages[handle >> VREND_HANDLE_TABLE_PAGE_SHIFT];
+   void **slot;
+   void *old;
+
+   if (!*page) {
+      *page = calloc(VREND_HANDLE_TABLE_PAGE_SIZE, sizeof(**page));
+      if (!*page)
+         return false;
+   }
+
+   slot = &(*page)[handle & (VREND_HANDLE_TABLE_PAGE_SIZE - 1)];
+   old = *slot;
+   *slot = value;
+   if (old && table->destroy)
+      table->destroy(old);
+   return true;
+}
+
+bool vrend_handle_table_set(struct vrend_handle_table *table, uint32_t handle, void *value)
+{
+   uint32_t i;
+
+   if (!value)
+      return false;
+
+   if (handle < VREND_HANDLE_TABLE_DIRECT_SIZE)
+      return vrend_handle_table_set_direct(table, handle, value);
+
+   i = vrend_handle_table_bucket(table, handle);
+   while (table->slots[i].value) {
+      if (table->slots[i].handle == handle) {
+         void *old = table->slots[i].value;
+
+         table->slots[i].value = value;
+         if (table->destroy)
+            table->destroy(old);
+         return true;
+      }
+      i = (i + 1) & table->mask;
+   }
+
+   /* keep the load under 3/4 so probe runs stay short */
+   if ((table->count + 1) * 4 > (table->mask + 1) * 3) {
+      if (!vrend_handle_table_grow(table))
+         return false;
+      i = vrend_handle_table_bucket(table, handle);
+      while (table->slots[i].value)
+         i = (i + 1) & table->mask;
+   }
+
+   table->slots[i].handle = handle;
+   table->slots[i].value = value;
+   table->count++;
+   return true;
+}
+
+void vrend_handle_table_remove(struct vrend_handle_table *table, uint32_t handle)
+{
+   uint32_t i, j;
+   void *value;
+
+   if (handle < VREND_HANDLE_TABLE_DIRECT_SIZE) {
+      void **page = table->pages[handle >> VREND_HANDLE_TABLE_PAGE_SHIFT];
+
+      if (!page)
+         return;
+      i = handle & (VREND_HANDLE_TABLE_PAGE_SIZE - 1);
+      value = page[i];
+      page[i] = NULL;
+      if (value && table->destroy)
+         table->destroy(value);
+      return;
+   }
+
+   i = vrend_handle_table_bucket(table, handle);
+   while (table->slots[i].value && table->slots[i].handle != handle)
+      i = (i + 1) & table->mask;
+
+   value = table->slots[i].value;
+   if (!value)
+      return;
+
+   /* pull back every later entry of the run that may no longer be
+    * reachable from its bucket once slot i is empty */
+   j = i;
+   for (;;) {
+      uint32_t bucket;
+
+      j = (j + 1) & table->mask;
+      if (!table->slots[j].value)
+         break;
+
+      bucket = vrend_handle_table_bucket(table, table->slots[j].handle);
+      /* the entry stays if its bucket lies cyclically in (i, j] */
+      if (i <= j ? (i < bucket && bucket <= j) : (i < bucket || bucket <= j))
+         continue;
+
+      table->slots[i] = table->slots[j];
+      i = j;
+   }
+   table->slots[i].value = NULL;
+   table->count--;
+
+   /* the entry is out of the table before anything it owns goes away */
+   if (table->destroy)
+      table->destroy(value);
+}
+
+void vrend_handle_table_foreach(const struct vrend_handle_table *table,
+                                void (*cb)(uint32_t handle, void *value, void *closure),
+                                void *closure)
+{
+   uint32_t i, j;
+
+   for (i = 0; i < VREND_HANDLE_TABLE_PAGES; i++) {
+      void **page = table->pages[i];
+
+      if (!page)
+         continue;
+      for (j = 0; j < VREND_HANDLE_TABLE_PAGE_SIZE; j++) {
+         if (page[j])
+            cb((i << VREND_HANDLE_TABLE_PAGE_SHIFT) | j, page[j], closure);
+      }
+   }
+   for (i = 0; i <= table->mask; i++) {
+      if (table->slots[i].value)
+         cb(table->slots[i].handle, table->slots[i].value, closure);
+   }
+}
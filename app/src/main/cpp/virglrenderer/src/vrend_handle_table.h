@@ -0,0 +1,80 @@
+#ifndef VREND_HANDLE_TABLE_H
+#define VREND_HANDLE_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Table from 32-bit handles to pointers.
+ *
+ * Guests hand out mostly small, dense handles, those below
+ * VREND_HANDLE_TABLE_DIRECT_SIZE index a two-level array whose pages are
+ * allocated on first use, so a lookup is two loads.  Other handles go to
+ * a hash table with open addressing and linear probing in one flat array,
+ * usually a single cache line instead of the chained nodes and hash/compare
+ * callbacks of util_hash_table.  Removal shifts the following entries
+ * back, so there are no tombstones.  NULL values cannot be stored, an
+ * empty slot is one without a value.
+ */
+
+#define VREND_HANDLE_TABLE_PAGE_SHIFT 8
+#define VREND_HANDLE_TABLE_PAGE_SIZE (1u << VREND_HANDLE_TABLE_PAGE_SHIFT)
+#define VREND_HANDLE_TABLE_PAGES 256
+#define VREND_HANDLE_TABLE_DIRECT_SIZE (VREND_HANDLE_TABLE_PAGES * VREND_HANDLE_TABLE_PAGE_SIZE)
+
+struct vrend_handle_table_slot {
+   uint32_t handle;
+   void *value;
+};
+
+struct vrend_handle_table {
+   /* handles below VREND_HANDLE_TABLE_DIRECT_SIZE */
+   void **pages[VREND_HANDLE_TABLE_PAGES];
+
+   /* the others, count is the number of values in slots */
+   struct vrend_handle_table_slot *slots;
+   uint32_t mask;
+   uint32_t count;
+   void (*destroy)(void *value);
+};
+
+struct vrend_handle_table *vrend_handle_table_create(void (*destroy)(void *value));
+/* calls destroy on every value left */
+void vrend_handle_table_destroy(struct vrend_handle_table *table);
+
+/* replaces and destroys the value already stored for handle */
+bool vrend_handle_table_set(struct vrend_handle_table *table, uint32_t handle, void *value);
+void vrend_handle_table_remove(struct vrend_handle_table *table, uint32_t handle);
+/* calls cb for every value, in no particular order; cb must not add or remove */
+void vrend_handle_table_foreach(const struct vrend_handle_table *table,
+                                void (*cb)(uint32_t handle, void *value, void *closure),
+                                void *closure);
+
+static inline uint32_t vrend_handle_table_bucket(const struct vrend_handle_table *table,
+                                                 uint32_t handle)
+{
+   /* handles are mostly small and sequential, spread them over the table */
+   return (handle * 0x9e3779b1u) & table->mask;
+}
+
+static inline void *vrend_handle_table_get(const struct vrend_handle_table *table,
+                                           uint32_t handle)
+{
+   uint32_t i;
+
+   if (handle < VREND_HANDLE_TABLE_DIRECT_SIZE) {
+      void **page = table->pages[handle >> VREND_HANDLE_TABLE_PAGE_SHIFT];
+      return page ? page[handle & (VREND_HANDLE_TABLE_PAGE_SIZE - 1)] : NULL;
+   }
+
+   i = vrend_handle_table_bucket(table, handle);
+   while (table->slots[i].value) {
+      if (table->slots[i].handle == handle)
+         return table->slots[i].value;
+      i = (i + 1) & table->mask;
+   }
+   return NULL;
+}
+
+#endif
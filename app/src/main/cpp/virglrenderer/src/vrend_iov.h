@@ -57,4 +57,22 @@ int vrend_copy_iovec(const struct iovec *src_iov, int src_iovlen, size_t src_off
                      const struct iovec *dst_iov, int dst_iovlen, size_t dst_offset,
                      size_t count, char *buf);
 
+/* Remembers the iov segment of the last access, so row by row transfers
+ * seek from there instead of from the first segment on every row.
+ */
+struct vrend_iov_cursor {
+   const struct iovec *iov;
+   int iovlen;
+   int index;
+   /* offset of iov[index] in the whole iovec */
+   size_t base;
+};
+
+void vrend_iov_cursor_init(struct vrend_iov_cursor *cursor,
+                           const struct iovec *iov, int iovlen);
+size_t vrend_iov_cursor_read(struct vrend_iov_cursor *cursor, size_t offset,
+                             char *buf, size_t bytes);
+size_t vrend_iov_cursor_write(struct vrend_iov_cursor *cursor, size_t offset,
+                              const char *buf, size_t bytes);
+
 #endif
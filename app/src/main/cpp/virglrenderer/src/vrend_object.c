@@ -22,10 +22,9 @@
  *
  **************************************************************************/
 
-#include "util/u_pointer.h"
 #include "util/u_memory.h"
-#include "util/u_hash_table.h"
 
+#include "vrend_handle_table.h"
 #include "vrend_object.h"
 
 struct vrend_object_types {
@@ -44,24 +43,6 @@ void vrend_resource_set_destroy_callback(void (*cb)(void *))
    resource_unref = cb;
 }
 
-static unsigned
-hash_func(void *key)
-{
-   intptr_t ip = pointer_to_intptr(key);
-   return (unsigned)(ip & 0xffffffff);
-}
-
-static int
-compare(void *key1, void *key2)
-{
-   if (key1 < key2)
-      return -1;
-   if (key1 > key2)
-      return 1;
-   else
-      return 0;
-}
-
 struct vrend_object {
    enum virgl_object_type type;
    uint32_t handle;
@@ -84,19 +65,14 @@ static void free_object(void *value)
    free(obj);
 }
 
-struct util_hash_table *vrend_object_init_ctx_table(void)
+struct vrend_handle_table *vrend_object_init_ctx_table(void)
 {
-   struct util_hash_table *ctx_hash;
-   ctx_hash = util_hash_table_create(hash_func, compare, free_object);
-   return ctx_hash;
+   return vrend_handle_table_create(free_object);
 }
 
-void vrend_object_fini_ctx_table(struct util_hash_table *ctx_hash)
+void vrend_object_fini_ctx_table(struct vrend_handle_table *ctx_hash)
 {
-   if (!ctx_hash)
-      return;
-
-   util_hash_table_destroy(ctx_hash);
+   vrend_handle_table_destroy(ctx_hash);
 }
 
 static void free_res(void *value)
@@ -109,18 +85,16 @@ static void free_res(void *value)
 void vrend_object_init_resource_table(struct virgl_client *client)
 {
    if (!client->res_hash)
-      client->res_hash = util_hash_table_create(hash_func, compare, free_res);
+      client->res_hash = vrend_handle_table_create(free_res);
 }
 
 void vrend_object_fini_resource_table(struct virgl_client *client)
 {
-   if (client->res_hash)
-      util_hash_table_destroy(client->res_hash);
-
+   vrend_handle_table_destroy(client->res_hash);
    client->res_hash = NULL;
 }
 
-uint32_t vrend_object_insert_nofree(struct util_hash_table *handle_hash,
+uint32_t vrend_object_insert_nofree(struct vrend_handle_table *handle_hash,
                                     void *data, UNUSED uint32_t length, uint32_t handle,
                                     enum virgl_object_type type, bool free_data)
 {
@@ -132,12 +106,15 @@ uint32_t vrend_object_insert_nofree(struct util_hash_table *handle_hash,
    obj->data = data;
    obj->type = type;
    obj->free_data = free_data;
-   util_hash_table_set(handle_hash, intptr_to_pointer(obj->handle), obj);
+   if (!vrend_handle_table_set(handle_hash, obj->handle, obj)) {
+      FREE(obj);
+      return 0;
+   }
    return obj->handle;
 }
 
 uint32_t
-vrend_object_insert(struct util_hash_table *handle_hash,
+vrend_object_insert(struct vrend_handle_table *handle_hash,
                     void *data, uint32_t length, uint32_t handle, enum virgl_object_type type)
 {
    return vrend_object_insert_nofree(handle_hash, data, length,
@@ -145,18 +122,18 @@ vrend_object_insert(struct util_hash_table *handle_hash,
 }
 
 void
-vrend_object_remove(struct util_hash_table *handle_hash,
+vrend_object_remove(struct vrend_handle_table *handle_hash,
                     uint32_t handle, UNUSED enum virgl_object_type type)
 {
-   util_hash_table_remove(handle_hash, intptr_to_pointer(handle));
+   vrend_handle_table_remove(handle_hash, handle);
 }
 
-void *vrend_object_lookup(struct util_hash_table *handle_hash,
+void *vrend_object_lookup(struct vrend_handle_table *handle_hash,
                           uint32_t handle, enum virgl_object_type type)
 {
    struct vrend_object *obj;
 
-   obj = util_hash_table_get(handle_hash, intptr_to_pointer(handle));
+   obj = vrend_handle_table_get(handle_hash, handle);
    if (!obj) {
       return NULL;
    }
@@ -179,19 +156,42 @@ int vrend_resource_insert(struct virgl_client *client, void *data, uint32_t hand
 
    obj->handle = handle;
    obj->data = data;
-   util_hash_table_set(client->res_hash, intptr_to_pointer(obj->handle), obj);
+   if (!vrend_handle_table_set(client->res_hash, obj->handle, obj)) {
+      FREE(obj);
+      return 0;
+   }
    return obj->handle;
 }
 
 void vrend_resource_remove(struct virgl_client *client, uint32_t handle)
 {
-   util_hash_table_remove(client->res_hash, intptr_to_pointer(handle));
+   vrend_handle_table_remove(client->res_hash, handle);
+}
+
+struct resource_foreach_closure {
+   void (*cb)(void *data, void *closure);
+   void *closure;
+};
+
+static void resource_foreach_cb(UNUSED uint32_t handle, void *value, void *closure)
+{
+   const struct vrend_object *obj = value;
+   const struct resource_foreach_closure *foreach = closure;
+
+   foreach->cb(obj->data, foreach->closure);
+}
+
+void vrend_resource_foreach(struct virgl_client *client, void (*cb)(void *data, void *closure), void *closure)
+{
+   struct resource_foreach_closure foreach = { cb, closure };
+
+   vrend_handle_table_foreach(client->res_hash, resource_foreach_cb, &foreach);
 }
 
 void *vrend_resource_lookup(struct virgl_client *client, uint32_t handle, UNUSED uint32_t ctx_id)
 {
    struct vrend_object *obj;
-   obj = util_hash_table_get(client->res_hash, intptr_to_pointer(handle));
+   obj = vrend_handle_table_get(client->res_hash, handle);
    if (!obj)
       return NULL;
    return obj->data;
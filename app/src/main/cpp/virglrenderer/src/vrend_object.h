@@ -28,16 +28,18 @@
 #include "virgl_protocol.h"
 #include "virgl_server.h"
 
+struct vrend_handle_table;
+
 void vrend_object_init_resource_table(struct virgl_client *client);
 void vrend_object_fini_resource_table(struct virgl_client *client);
 
-struct util_hash_table *vrend_object_init_ctx_table(void);
-void vrend_object_fini_ctx_table(struct util_hash_table *ctx_hash);
+struct vrend_handle_table *vrend_object_init_ctx_table(void);
+void vrend_object_fini_ctx_table(struct vrend_handle_table *ctx_hash);
 
-void vrend_object_remove(struct util_hash_table *handle_hash, uint32_t handle, enum virgl_object_type obj);
-void *vrend_object_lookup(struct util_hash_table *handle_hash, uint32_t handle, enum virgl_object_type obj);
-uint32_t vrend_object_insert(struct util_hash_table *handle_hash, void *data, uint32_t length, uint32_t handle, enum virgl_object_type type);
-uint32_t vrend_object_insert_nofree(struct util_hash_table *handle_hash,
+void vrend_object_remove(struct vrend_handle_table *handle_hash, uint32_t handle, enum virgl_object_type obj);
+void *vrend_object_lookup(struct vrend_handle_table *handle_hash, uint32_t handle, enum virgl_object_type obj);
+uint32_t vrend_object_insert(struct vrend_handle_table *handle_hash, void *data, uint32_t length, uint32_t handle, enum virgl_object_type type);
+uint32_t vrend_object_insert_nofree(struct vrend_handle_table *handle_hash,
                                     void *data, uint32_t length,
                                     uint32_t handle,
                                     enum virgl_object_type type,
@@ -47,6 +49,8 @@ int vrend_resource_insert(struct virgl_client *client, void *data, uint32_t hand
 
 void vrend_resource_remove(struct virgl_client *client, uint32_t handle);
 void *vrend_resource_lookup(struct virgl_client *client, uint32_t handle, uint32_t ctx_id);
+/* calls cb for every resource of the client, in no particular order */
+void vrend_resource_foreach(struct virgl_client *client, void (*cb)(void *data, void *closure), void *closure);
 
 void vrend_object_set_destroy_callback(int type, void (*cb)(void *));
 void vrend_resource_set_destroy_callback(void (*cb)(void *));
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "vrend_program_cache.h"
+#include "os/os_thread.h"
+
+#define PROGRAM_CACHE_MAGIC 0x56504243 /* "VPBC" */
+#define PROGRAM_CACHE_VERSION 1
+#define PROGRAM_CACHE_DRIVER_FILE "driver"
+#define PROGRAM_CACHE_SUFFIX ".bin"
+#define PROGRAM_CACHE_BLOB_SUFFIX ".glsl"
+
+#define FNV64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+struct program_cache_header {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t hash;
+   uint32_t binary_format;
+   uint32_t binary_length;
+};
+
+/* render threads of different clients share the cache */
+pipe_static_mutex(program_cache_lock);
+
+static struct {
+   char *dir;
+   uint64_t driver_hash;
+   bool enabled;
+} program_cache;
+
+static uint64_t fnv1a64(uint64_t hash, const void *data, size_t size)
+{
+   const uint8_t *p = data;
+   size_t i;
+
+   for (i = 0; i < size; i++) {
+      hash ^= p[i];
+      hash *= FNV64_PRIME;
+   }
+   return hash;
+}
+
+static char *program_cache_driver_string(void)
+{
+   const char *vendor = (const char *)glGetString(GL_VENDOR);
+   const char *renderer = (const char *)glGetString(GL_RENDERER);
+   const char *version = (const char *)glGetString(GL_VERSION);
+   char *str;
+   int length;
+
+   length = snprintf(NULL, 0, "%s\n%s\n%s\n", vendor ? vendor : "",
+                     renderer ? renderer : "", version ? version : "");
+   str = malloc(length + 1);
+   if (!str)
+      return NULL;
+
+   snprintf(str, length + 1, "%s\n%s\n%s\n", vendor ? vendor : "",
+            renderer ? renderer : "", version ? version : "");
+   return str;
+}
+
+static char *program_cache_path(const char *name)
+{
+   int length = snprintf(NULL, 0, "%s/%s", program_cache.dir, name);
+   char *path = malloc(length + 1);
+   if (path)
+      snprintf(path, length + 1, "%s/%s", program_cache.dir, name);
+   return path;
+}
+
+static void program_cache_entry_name(char *buf, size_t size, uint64_t hash, const char *suffix)
+{
+   snprintf(buf, size, "%016llx%s", (unsigned long long)hash, suffix);
+}
+
+static bool program_cache_has_suffix(const char *name, const char *suffix)
+{
+   size_t len = strlen(name);
+   size_t suffix_len = strlen(suffix);
+
+   return len > suffix_len && !strcmp(name + len - suffix_len, suffix);
+}
+
+static void program_cache_clear(void)
+{
+   DIR *dir = opendir(program_cache.dir);
+   struct dirent *entry;
+
+   if (!dir)
+      return;
+
+   while ((entry = readdir(dir)) != NULL) {
+      char *path;
+
+      if (!program_cache_has_suffix(entry->d_name, PROGRAM_CACHE_SUFFIX) &&
+          !program_cache_has_suffix(entry->d_name, PROGRAM_CACHE_BLOB_SUFFIX))
+         continue;
+
+      path = program_cache_path(entry->d_name);
+      if (path) {
+         unlink(path);
+         free(path);
+      }
+   }
+   closedir(dir);
+}
+
+/* Returns true if the cache directory was written by the current driver,
+ * otherwise drops every cached binary and records the new driver. */
+static bool program_cache_check_driver(const char *driver)
+{
+   char *path = program_cache_path(PROGRAM_CACHE_DRIVER_FILE);
+   size_t driver_len = strlen(driver);
+   bool match = false;
+   char *stored;
+   FILE *file;
+
+   if (!path)
+      return false;
+
+   file = fopen(path, "rb");
+   if (file) {
+      stored = malloc(driver_len + 1);
+      if (stored) {
+         size_t count = fread(stored, 1, driver_len + 1, file);
+         match = count == driver_len && !memcmp(stored, driver, driver_len);
+         free(stored);
+      }
+      fclose(file);
+   }
+
+   if (!match) {
+      program_cache_clear();
+      file = fopen(path, "wb");
+      if (file) {
+         match = fwrite(driver, 1, driver_len, file) == driver_len;
+         fclose(file);
+      }
+   }
+
+   free(path);
+   return match;
+}
+
+static void program_cache_fini_locked(void)
+{
+   free(program_cache.dir);
+   program_cache.dir = NULL;
+   program_cache.driver_hash = 0;
+   program_cache.enabled = false;
+}
+
+static void program_cache_init_locked(const char *dir)
+{
+   GLint num_formats = 0;
+   char *driver;
+
+   if (program_cache.dir) {
+      if (dir && !strcmp(program_cache.dir, dir))
+         return;
+      program_cache_fini_locked();
+   }
+
+   if (!dir || !*dir)
+      return;
+
+   glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+   if (num_formats <= 0)
+      return;
+
+   if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+      return;
+
+   program_cache.dir = strdup(dir);
+   if (!program_cache.dir)
+      return;
+
+   driver = program_cache_driver_string();
+   if (!driver) {
+      program_cache_fini_locked();
+      return;
+   }
+
+   program_cache.enabled = program_cache_check_driver(driver);
+   program_cache.driver_hash = fnv1a64(FNV64_OFFSET_BASIS, driver, strlen(driver));
+   free(driver);
+
+   if (!program_cache.enabled)
+      program_cache_fini_locked();
+}
+
+void vrend_program_cache_init(const char *dir)
+{
+   pipe_mutex_lock(program_cache_lock);
+   program_cache_init_locked(dir);
+   pipe_mutex_unlock(program_cache_lock);
+}
+
+void vrend_program_cache_fini(void)
+{
+   pipe_mutex_lock(program_cache_lock);
+   program_cache_fini_locked();
+   pipe_mutex_unlock(program_cache_lock);
+}
+
+bool vrend_program_cache_enabled(void)
+{
+   return program_cache.enabled;
+}
+
+uint64_t vrend_program_cache_hash_begin(void)
+{
+   return program_cache.driver_hash;
+}
+
+uint64_t vrend_program_cache_hash_data(uint64_t hash, const void *data, size_t size)
+{
+   return fnv1a64(hash, data, size);
+}
+
+uint64_t vrend_program_cache_hash_strings(uint64_t hash, const struct vrend_strarray *strings)
+{
+   int i;
+
+   for (i = 0; i < strings->num_strings; i++)
+      hash = fnv1a64(hash, strings->strings[i].buf, strings->strings[i].size);
+
+   /* separate stages so moving text between them changes the key */
+   return fnv1a64(hash, &strings->num_strings, sizeof(strings->num_strings));
+}
+
+/* Returns the payload of the entry, which has been validated against
+ * hash, or NULL.  A malformed entry is removed. */
+static void *program_cache_read_entry_locked(uint64_t hash, const char *suffix,
+                                             struct program_cache_header *header)
+{
+   char name[32];
+   char *path;
+   void *data = NULL;
+   FILE *file;
+
+   if (!program_cache.enabled)
+      return NULL;
+
+   program_cache_entry_name(name, sizeof(name), hash, suffix);
+   path = program_cache_path(name);
+   if (!path)
+      return NULL;
+
+   file = fopen(path, "rb");
+   if (!file) {
+      free(path);
+      return NULL;
+   }
+
+   if (fread(header, sizeof(*header), 1, file) != 1 ||
+       header->magic != PROGRAM_CACHE_MAGIC ||
+       header->version != PROGRAM_CACHE_VERSION ||
+       header->hash != hash ||
+       header->binary_length == 0) {
+      fclose(file);
+      unlink(path);
+      free(path);
+      return NULL;
+   }
+
+   data = malloc(header->binary_length);
+   if (data && fread(data, header->binary_length, 1, file) != 1) {
+      free(data);
+      data = NULL;
+   }
+   fclose(file);
+   free(path);
+   return data;
+}
+
+static void program_cache_remove_entry_locked(uint64_t hash, const char *suffix)
+{
+   char name[32];
+   char *path;
+
+   program_cache_entry_name(name, sizeof(name), hash, suffix);
+   path = program_cache_path(name);
+   if (path) {
+      unlink(path);
+      free(path);
+   }
+}
+
+static void program_cache_write_entry_locked(uint64_t hash, const char *suffix, uint32_t format,
+                                             const void *data, uint32_t length)
+{
+   struct program_cache_header header;
+   char name[32], tmp_name[40];
+   char *path = NULL, *tmp_path = NULL;
+   FILE *file;
+   bool ok;
+
+   program_cache_entry_name(name, sizeof(name), hash, suffix);
+   snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name);
+   path = program_cache_path(name);
+   tmp_path = program_cache_path(tmp_name);
+   if (!path || !tmp_path)
+      goto out;
+
+   header.magic = PROGRAM_CACHE_MAGIC;
+   header.version = PROGRAM_CACHE_VERSION;
+   header.hash = hash;
+   header.binary_format = format;
+   header.binary_length = length;
+
+   /* write to a temporary file first so a crash never leaves a torn entry */
+   file = fopen(tmp_path, "wb");
+   if (!file)
+      goto out;
+
+   ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(data, length, 1, file) == 1;
+   ok = fclose(file) == 0 && ok;
+
+   if (!ok || rename(tmp_path, path) < 0)
+      unlink(tmp_path);
+
+out:
+   free(tmp_path);
+   free(path);
+}
+
+static bool program_cache_load_locked(GLuint prog_id, uint64_t hash)
+{
+   struct program_cache_header header;
+   GLint status = GL_FALSE;
+   void *binary;
+
+   binary = program_cache_read_entry_locked(hash, PROGRAM_CACHE_SUFFIX, &header);
+   if (!binary)
+      return false;
+
+   glProgramBinary(prog_id, header.binary_format, binary, header.binary_length);
+   glGetProgramiv(prog_id, GL_LINK_STATUS, &status);
+   free(binary);
+
+   /* a rejected binary is stale (e.g. driver update with the same strings) */
+   if (status == GL_FALSE)
+      program_cache_remove_entry_locked(hash, PROGRAM_CACHE_SUFFIX);
+
+   return status != GL_FALSE;
+}
+
+static void program_cache_store_locked(GLuint prog_id, uint64_t hash)
+{
+   GLint length = 0;
+   GLenum format;
+   void *binary;
+
+   if (!program_cache.enabled)
+      return;
+
+   glGetProgramiv(prog_id, GL_PROGRAM_BINARY_LENGTH, &length);
+   if (length <= 0)
+      return;
+
+   binary = malloc(length);
+   if (!binary)
+      return;
+
+   glGetProgramBinary(prog_id, length, &length, &format, binary);
+   if (length > 0)
+      program_cache_write_entry_locked(hash, PROGRAM_CACHE_SUFFIX, format, binary, length);
+   free(binary);
+}
+
+bool vrend_program_cache_load(GLuint prog_id, uint64_t hash)
+{
+   bool loaded;
+
+   pipe_mutex_lock(program_cache_lock);
+   loaded = program_cache_load_locked(prog_id, hash);
+   pipe_mutex_unlock(program_cache_lock);
+   return loaded;
+}
+
+void vrend_program_cache_store(GLuint prog_id, uint64_t hash)
+{
+   pipe_mutex_lock(program_cache_lock);
+   program_cache_store_locked(prog_id, hash);
+   pipe_mutex_unlock(program_cache_lock);
+}
+
+void *vrend_program_cache_load_blob(uint64_t hash, uint32_t *size)
+{
+   struct program_cache_header header;
+   void *data;
+
+   pipe_mutex_lock(program_cache_lock);
+   data = program_cache_read_entry_locked(hash, PROGRAM_CACHE_BLOB_SUFFIX, &header);
+   pipe_mutex_unlock(program_cache_lock);
+
+   if (data)
+      *size = header.binary_length;
+   return data;
+}
+
+void vrend_program_cache_store_blob(uint64_t hash, const void *data, uint32_t size)
+{
+   if (!size)
+      return;
+
+   pipe_mutex_lock(program_cache_lock);
+   if (program_cache.enabled)
+      program_cache_write_entry_locked(hash, PROGRAM_CACHE_BLOB_SUFFIX, 0, data, size);
+   pipe_mutex_unlock(program_cache_lock);
+}
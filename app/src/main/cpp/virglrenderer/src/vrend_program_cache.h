@@ -0,0 +1,39 @@
+#ifndef VREND_PROGRAM_CACHE_H
+#define VREND_PROGRAM_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vrend_strbuf.h"
+#include "vrend_util.h"
+
+/*
+ * On-disk cache of linked GLSL program binaries.
+ *
+ * Entries are keyed by a 64-bit hash of the GLSL sources attached to the
+ * program, seeded with the GL vendor/renderer/version strings.  The cache
+ * directory remembers which driver produced it and is wiped when the
+ * driver changes, since program binaries are not portable across drivers.
+ *
+ * The directory also holds opaque blobs of other driver dependent data
+ * (shader translations), stored next to the binaries under their own
+ * hashes.
+ */
+
+void vrend_program_cache_init(const char *dir);
+void vrend_program_cache_fini(void);
+bool vrend_program_cache_enabled(void);
+
+uint64_t vrend_program_cache_hash_begin(void);
+uint64_t vrend_program_cache_hash_data(uint64_t hash, const void *data, size_t size);
+uint64_t vrend_program_cache_hash_strings(uint64_t hash, const struct vrend_strarray *strings);
+
+/* returns true if prog_id was successfully loaded and linked from the cache */
+bool vrend_program_cache_load(GLuint prog_id, uint64_t hash);
+void vrend_program_cache_store(GLuint prog_id, uint64_t hash);
+
+/* returns a malloc'ed copy of the blob stored under hash, or NULL */
+void *vrend_program_cache_load_blob(uint64_t hash, uint32_t *size);
+void vrend_program_cache_store_blob(uint64_t hash, const void *data, uint32_t size);
+
+#endif
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/u_memory.h"
+
+#include "vrend_readback_compute.h"
+
+#define READBACK_LOCAL_SIZE 8
+
+enum readback_kind {
+   READBACK_BGRA,
+   READBACK_BGRX,
+   READBACK_Z24X8,
+   READBACK_Z32F,
+   READBACK_KIND_COUNT
+};
+
+struct readback_program {
+   GLuint prog_id;
+   GLint samp_loc;
+   GLint box_loc;
+   GLint level_loc;
+   bool failed;
+};
+
+struct vrend_readback_compute {
+   struct readback_program programs[READBACK_KIND_COUNT];
+   GLuint sampler_id;
+};
+
+static const char *readback_pack[READBACK_KIND_COUNT] = {
+   [READBACK_BGRA] = "packUnorm4x8(t.bgra)",
+   [READBACK_BGRX] = "packUnorm4x8(vec4(t.bgr, 1.0))",
+   /* 24 bit depth in the low bits, the X8 byte left zero */
+   [READBACK_Z24X8] = "uint(clamp(t.r, 0.0, 1.0) * 16777215.0 + 0.5)",
+   [READBACK_Z32F] = "floatBitsToUint(t.r)",
+};
+
+static const char readback_cs_template[] =
+   "#version 310 es\n"
+   "layout(local_size_x = %d, local_size_y = %d) in;\n"
+   "uniform highp sampler2D samp;\n"
+   "uniform ivec4 box;\n"
+   "uniform int level;\n"
+   "layout(std430, binding = 0) writeonly buffer Texels { highp uint texels[]; };\n"
+   "void main() {\n"
+   "   ivec2 p = ivec2(gl_GlobalInvocationID.xy);\n"
+   "   if (p.x >= box.z || p.y >= box.w)\n"
+   "      return;\n"
+   "   highp vec4 t = texelFetch(samp, box.xy + p, level);\n"
+   "   texels[p.y * box.z + p.x] = %s;\n"
+   "}\n";
+
+static int readback_kind_for_format(enum virgl_formats format)
+{
+   switch (format) {
+   case VIRGL_FORMAT_B8G8R8A8_UNORM: return READBACK_BGRA;
+   case VIRGL_FORMAT_B8G8R8X8_UNORM: return READBACK_BGRX;
+   case VIRGL_FORMAT_Z24X8_UNORM: return READBACK_Z24X8;
+   case VIRGL_FORMAT_Z32_FLOAT: return READBACK_Z32F;
+   default: return -1;
+   }
+}
+
+static bool readback_build_program(struct readback_program *program, int kind)
+{
+   char source[1024];
+   const char *src = source;
+   GLuint cs_id;
+   GLint status;
+
+   snprintf(source, sizeof(source), readback_cs_template,
+            READBACK_LOCAL_SIZE, READBACK_LOCAL_SIZE, readback_pack[kind]);
+
+   cs_id = glCreateShader(GL_COMPUTE_SHADER);
+   glShaderSource(cs_id, 1, &src, NULL);
+   glCompileShader(cs_id);
+   glGetShaderiv(cs_id, GL_COMPILE_STATUS, &status);
+   if (status == GL_FALSE) {
+      glDeleteShader(cs_id);
+      return false;
+   }
+
+   program->prog_id = glCreateProgram();
+   glAttachShader(program->prog_id, cs_id);
+   glLinkProgram(program->prog_id);
+   glDeleteShader(cs_id);
+   glGetProgramiv(program->prog_id, GL_LINK_STATUS, &status);
+   if (status == GL_FALSE) {
+      glDeleteProgram(program->prog_id);
+      program->prog_id = 0;
+      return false;
+   }
+
+   program->samp_loc = glGetUniformLocation(program->prog_id, "samp");
+   program->box_loc = glGetUniformLocation(program->prog_id, "box");
+   program->level_loc = glGetUniformLocation(program->prog_id, "level");
+   return true;
+}
+
+struct vrend_readback_compute *vrend_readback_compute_create(void)
+{
+   struct vrend_readback_compute *rc = CALLOC_STRUCT(vrend_readback_compute);
+   if (!rc)
+      return NULL;
+
+   /* overrides whatever compare mode and filters the texture carries */
+   glGenSamplers(1, &rc->sampler_id);
+   glSamplerParameteri(rc->sampler_id, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+   glSamplerParameteri(rc->sampler_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glSamplerParameteri(rc->sampler_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   return rc;
+}
+
+void vrend_readback_compute_destroy(struct vrend_readback_compute *rc)
+{
+   int i;
+
+   if (!rc)
+      return;
+
+   for (i = 0; i < READBACK_KIND_COUNT; i++) {
+      if (rc->programs[i].prog_id)
+         glDeleteProgram(rc->programs[i].prog_id);
+   }
+   glDeleteSamplers(1, &rc->sampler_id);
+   FREE(rc);
+}
+
+bool vrend_readback_compute_supported(enum virgl_formats format)
+{
+   return readback_kind_for_format(format) >= 0;
+}
+
+bool vrend_readback_compute_run(struct vrend_readback_compute *rc,
+                                enum virgl_formats format,
+                                GLuint tex_id, int level,
+                                int x, int y, int width, int height,
+                                GLuint buffer)
+{
+   int kind = readback_kind_for_format(format);
+   struct readback_program *program;
+   GLint active_texture;
+   GLuint unit;
+
+   if (kind < 0)
+      return false;
+
+   program = &rc->programs[kind];
+   if (!program->prog_id) {
+      if (program->failed)
+         return false;
+      if (!readback_build_program(program, kind)) {
+         program->failed = true;
+         return false;
+      }
+   }
+
+   /* sample on whatever unit is active, the caller marks the bindings clobbered */
+   glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+   unit = active_texture - GL_TEXTURE0;
+
+   glUseProgram(program->prog_id);
+   glUniform1i(program->samp_loc, unit);
+   glUniform4i(program->box_loc, x, y, width, height);
+   glUniform1i(program->level_loc, level);
+
+   glBindTexture(GL_TEXTURE_2D, tex_id);
+   glBindSampler(unit, rc->sampler_id);
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+
+   glDispatchCompute((width + READBACK_LOCAL_SIZE - 1) / READBACK_LOCAL_SIZE,
+                     (height + READBACK_LOCAL_SIZE - 1) / READBACK_LOCAL_SIZE, 1);
+
+   /* the buffer is read through a mapping once its fence passed */
+   glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+   glBindSampler(unit, 0);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glUseProgram(0);
+   return true;
+}
@@ -0,0 +1,36 @@
+#ifndef VREND_READBACK_COMPUTE_H
+#define VREND_READBACK_COMPUTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "virgl_hw.h"
+#include "vrend_util.h"
+
+/*
+ * GPU conversion for texture readbacks glReadPixels can not serve.
+ *
+ * GLES can not read depth through glReadPixels, and BGRA only with
+ * GL_EXT_read_format_bgra.  For those formats a GLES 3.1 compute shader
+ * fetches the texels and writes them, already packed in the guest's
+ * layout, into a buffer that is then copied out like a pixel pack
+ * buffer.  Rows come out bottom-up as glReadPixels would return them.
+ */
+
+struct vrend_readback_compute;
+
+struct vrend_readback_compute *vrend_readback_compute_create(void);
+void vrend_readback_compute_destroy(struct vrend_readback_compute *rc);
+
+/* formats with a conversion shader, all of them 4 bytes per texel */
+bool vrend_readback_compute_supported(enum virgl_formats format);
+
+/* converts the box of a GL_TEXTURE_2D level into buffer at offset 0,
+ * tightly packed; returns false if the shader is unavailable */
+bool vrend_readback_compute_run(struct vrend_readback_compute *rc,
+                                enum virgl_formats format,
+                                GLuint tex_id, int level,
+                                int x, int y, int width, int height,
+                                GLuint buffer);
+
+#endif
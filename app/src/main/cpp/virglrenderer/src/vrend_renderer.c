@@ -25,6 +25,10 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
+#include <EGL/egl.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 #include "pipe/p_shader_tokens.h"
 
 #include "pipe/p_context.h"
@@ -36,10 +40,21 @@
 #include "util/u_dual_blend.h"
 
 #include "util/u_format.h"
+#include "util/u_hash_table.h"
 #include "tgsi/tgsi_parse.h"
+#include "cso_cache/cso_cache.h"
 
 #include "vrend_object.h"
 #include "vrend_shader.h"
+#include "vrend_program_cache.h"
+#include "vrend_compile_pool.h"
+#include "vrend_upload_ring.h"
+#include "vrend_readback_compute.h"
+#include "vrend_variant_log.h"
+#include "vrend_slab.h"
+#include "vrend_texture_decode.h"
+#include "native_trace.h"
+#include "os/os_thread.h"
 
 #include "vrend_renderer.h"
 
@@ -62,6 +77,23 @@ struct vrend_fence {
    struct list_head fences;
 };
 
+/* keep a few pack buffers around for the next readbacks */
+#define VREND_READBACK_POOL_SIZE 8
+
+struct vrend_readback {
+   struct list_head head;
+   struct vrend_resource *res;
+   GLuint pbo;
+   uint32_t pbo_size;
+   GLsync sync;
+
+   struct pipe_box box;
+   uint32_t level;
+   uint32_t stride;
+   uint64_t offset;
+   bool invert;
+};
+
 struct vrend_query {
    struct list_head waiting_queries;
 
@@ -72,6 +104,8 @@ struct vrend_query {
    int ctx_id;
    struct vrend_resource *res;
    bool fake_samples_passed;
+   /* the first fence submitted after the query started waiting */
+   uint32_t fence_id;
 };
 
 enum features_id
@@ -94,6 +128,7 @@ enum features_id
    feat_indep_blend,
    feat_indep_blend_func,
    feat_indirect_draw,
+   feat_invalidate_framebuffer,
    feat_multisample,
    feat_occlusion_query_boolean,
    feat_robust_buffer_access,
@@ -149,6 +184,7 @@ static const  struct {
    FEAT(indep_blend, 30, 32,  "GL_EXT_draw_buffers2", "GL_OES_draw_buffers_indexed" ),
    FEAT(indep_blend_func, 40, 32,  "GL_ARB_draw_buffers_blend", "GL_OES_draw_buffers_indexed"),
    FEAT(indirect_draw, 40, 31,  "GL_ARB_draw_indirect" ),
+   FEAT(invalidate_framebuffer, 43, 30,  "GL_ARB_invalidate_subdata" ),
    FEAT(multisample, 32, 30,  "GL_ARB_texture_multisample" ),
    FEAT(occlusion_query_boolean, 33, 30, "GL_EXT_occlusion_query_boolean", "GL_ARB_occlusion_query2"),
    FEAT(robust_buffer_access, 43, UNAVAIL,  "GL_ARB_robust_buffer_access_behavior", "GL_KHR_robust_buffer_access_behavior" ),
@@ -176,6 +212,23 @@ static const  struct {
 static bool features[feat_last];
 static bool features_initialized = false;
 
+/* GL_EXT_multi_draw_arrays, the base vertex variant also needs
+ * GL_EXT_draw_elements_base_vertex or GLES 3.2; NULL when unsupported */
+static PFNGLMULTIDRAWARRAYSEXTPROC multi_draw_arrays;
+static PFNGLMULTIDRAWELEMENTSBASEVERTEXEXTPROC multi_draw_elements_base_vertex;
+/* GL_KHR_parallel_shader_compile, NULL when unsupported */
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_shader_compiler_threads;
+/* GL_OES_texture_view or GL_EXT_texture_view, NULL when unsupported */
+static PFNGLTEXTUREVIEWOESPROC texture_view;
+/* guards the process wide tables built by the first vrend_renderer_init() */
+pipe_static_mutex(vrend_global_lock);
+
+/* every client shares the one GL context and driver, so the caps and
+ * GL_MAX_DRAW_BUFFERS are only queried for the first of them */
+static union virgl_caps cached_caps[2];
+static bool cached_caps_valid[2];
+static GLint cached_max_draw_buffers = -1;
+
 static inline bool has_feature(enum features_id feature_id)
 {
    return features[feature_id];
@@ -186,11 +239,100 @@ static inline void set_feature(enum features_id feature_id)
    features[feature_id] = true;
 }
 
+/* Upper bound on linked programs kept per sub-context; the least recently
+ * used program is unlinked once a new one pushes the count past it. */
+#define VREND_PROGRAM_CACHE_SIZE 1024
+
+/* Size of the per sub-context ring constant buffer 0 is streamed into when
+ * it is bound as a uniform block; orphaned and restarted when full. */
+#define VREND_CONST_RING_SIZE (1 << 20)
+
+/* Per client staging ring for synchronized buffer uploads, larger uploads
+ * keep mapping the destination directly. */
+#define VREND_UPLOAD_RING_SIZE (4 << 20)
+#define VREND_UPLOAD_RING_MAX_UPLOAD (VREND_UPLOAD_RING_SIZE / 4)
+
+/* Inline buffer writes up to this size go through glBufferSubData when the
+ * buffer is idle, which is cheaper than mapping the range. */
+#define VREND_INLINE_WRITE_SUBDATA_MAX 4096
+
+/* Objects per slab page for the state objects a sub context keeps. */
+#define VREND_OBJECT_SLAB_PAGE 32
+
+/* Passthrough TCSs a sub context keeps for TESs bound without a TCS. */
+#define VREND_PASSTHROUGH_TCS_CACHE_SIZE 8
+
+/* Upper bound on vertex array objects the legacy vertex path keeps per
+ * sub-context, the least recently used one is deleted past it. */
+#define VREND_VAO_CACHE_SIZE 256
+
+/* Everything vrend_draw_bind_vertex_legacy() sets up for one attribute */
+struct vrend_vao_attrib {
+   GLuint buffer;
+   GLint loc;
+   GLsizei stride;
+   GLuint offset;
+   GLenum type;
+   GLuint nr_chan;
+   /* GLuint so the key has no padding */
+   GLuint norm;
+   GLuint integer;
+   GLuint divisor;
+};
+
+/* only the first num_attribs attributes are hashed and compared */
+struct vrend_vao_key {
+   uint32_t num_attribs;
+   struct vrend_vao_attrib attribs[PIPE_MAX_ATTRIBS];
+};
+
+struct vrend_vao {
+   struct list_head head;
+   struct vrend_vao_key key;
+   GLuint id;
+};
+
+/* bumped when a buffer a cached VAO points to is deleted, its name may be
+ * handed out again; every sub-context then drops its VAOs */
+static uint32_t vao_cache_generation;
+
+struct vrend_linked_program_key {
+   GLuint ids[PIPE_SHADER_TYPES];
+   bool dual_src;
+};
+
+/* One stage linked on its own for program pipelines, shared by every
+ * pipeline binding it; owned by its vrend_shader. */
+struct vrend_separable_program {
+   struct vrend_separable_program *next;
+   GLuint id;
+   /* what the stage was linked for, see vrend_separable_fs_key() */
+   uint64_t key;
+   /* the uniform lives in the stage, not in any one pipeline */
+   float viewport_neg_val;
+};
+
 struct vrend_linked_shader_program {
    struct list_head head;
    struct list_head sl[PIPE_SHADER_TYPES];
+   /* 0 for a program pipeline */
    GLuint id;
 
+   /* separable mode: the pipeline of the stages' separable programs and
+    * the stage whose program glUniform* currently writes */
+   GLuint pipeline;
+   struct vrend_separable_program *stages[PIPE_SHADER_TYPES];
+   int active_stage;
+
+   struct vrend_linked_program_key key;
+   struct vrend_sub_context *sub;
+
+   /* pending background link, the program is unusable until it is done */
+   struct vrend_compile_job *link_job;
+   /* linked by the driver's compiler threads, the status is not queried yet */
+   bool link_pending;
+   uint64_t binary_hash;
+
    bool dual_src_linked;
    struct vrend_shader *ss[PIPE_SHADER_TYPES];
 
@@ -201,6 +343,7 @@ struct vrend_linked_shader_program {
    GLuint *shadow_samp_add_locs[PIPE_SHADER_TYPES];
 
    GLint const_location[PIPE_SHADER_TYPES];
+   bool const_ubo[PIPE_SHADER_TYPES];
 
    GLuint *attrib_locs;
    uint32_t shadow_samp_mask[PIPE_SHADER_TYPES];
@@ -226,9 +369,16 @@ struct vrend_shader {
 
    struct vrend_strarray glsl_strings;
    GLuint id;
-   GLuint compiled_fs_id;
    struct vrend_shader_key key;
    struct list_head programs;
+   /* separable programs built from this variant */
+   struct vrend_separable_program *separable;
+   /* copies with the outputs patched for the fragment shaders linked with
+    * this one, chained by next_variant, see vrend_interp_variant() */
+   struct vrend_shader *interp_variants;
+   uint64_t interp_key;
+
+   struct vrend_compile_job *compile_job;
 };
 
 struct vrend_shader_selector {
@@ -240,11 +390,16 @@ struct vrend_shader_selector {
 
    struct vrend_shader *current;
    struct tgsi_token *tokens;
+   /* key independent TGSI analysis, shared by the variants */
+   struct vrend_shader_analysis *analysis;
 
    uint32_t req_local_mem;
    char *tmp_buf;
    uint32_t buf_len;
    uint32_t buf_offset;
+
+   /* identifies the selector across runs in the variant log */
+   uint64_t log_hash;
 };
 
 struct vrend_texture {
@@ -256,6 +411,8 @@ struct vrend_texture {
    GLenum cur_swizzle_a;
    GLuint cur_srgb_decode;
    GLuint cur_base, cur_max;
+   /* 0 until a view set GL_DEPTH_STENCIL_TEXTURE_MODE */
+   GLenum cur_ds_mode;
 };
 
 struct vrend_surface {
@@ -267,9 +424,30 @@ struct vrend_surface {
    struct vrend_resource *texture;
 };
 
+/* the state a GL sampler object is created with, zero padded for hashing */
+struct vrend_sampler_key {
+   uint8_t wrap_s, wrap_t, wrap_r;
+   uint8_t min_img_filter, min_mip_filter, mag_img_filter;
+   uint8_t compare_func;
+   uint8_t pad;
+   float min_lod, max_lod;
+   uint32_t border_color[4];
+};
+
+/* GL sampler pair shared by all sampler states of a client with the same
+ * key, ids[0] skips sRGB decode and ids[1] decodes */
+struct vrend_sampler_entry {
+   struct vrend_sampler_key key;
+   struct util_hash_table *cache;
+   GLuint ids[2];
+   uint32_t refcount;
+   /* border color currently set on ids[], swizzled for the last view */
+   uint32_t border_color[2][4];
+};
+
 struct vrend_sampler_state {
    struct pipe_sampler_state base;
-   GLuint ids[2];
+   struct vrend_sampler_entry *entry;
 };
 
 struct vrend_so_target {
@@ -330,12 +508,18 @@ struct vrend_vertex_element {
    GLenum type;
    GLboolean norm;
    GLuint nr_chan;
+   /* fetched as integers, pure integer formats and packed ones the vertex
+    * shader decodes */
+   bool integer;
 };
 
 struct vrend_vertex_element_array {
    unsigned count;
    struct vrend_vertex_element elements[PIPE_MAX_ATTRIBS];
    GLuint id;
+   /* see vrend_shader_key::vs_attrib_zyxw_bitmask */
+   uint32_t zyxw_bitmask;
+   uint32_t r11g11b10_bitmask;
 };
 
 struct vrend_constants {
@@ -344,6 +528,11 @@ struct vrend_constants {
    uint32_t num_allocated_consts;
 };
 
+struct vrend_const_ring {
+   GLuint id;
+   uint32_t offset;
+};
+
 struct vrend_shader_view {
    int num_views;
    struct vrend_sampler_view *views[PIPE_MAX_SHADER_SAMPLER_VIEWS];
@@ -372,18 +561,248 @@ struct vrend_streamout_object {
 #define XFB_STATE_STARTED 2
 #define XFB_STATE_PAUSED 3
 
+enum vrend_shadow_cap {
+   VREND_CAP_SAMPLE_ALPHA_TO_COVERAGE,
+   VREND_CAP_DITHER,
+   VREND_CAP_POLYGON_OFFSET_FILL,
+   VREND_CAP_CULL_FACE,
+   VREND_CAP_SAMPLE_MASK,
+   VREND_CAP_SAMPLE_SHADING,
+   VREND_CAP_SCISSOR_TEST,
+   VREND_CAP_COUNT
+};
+
+#define VREND_SHADOW_TEXTURE_UNITS 32
+
+struct vrend_shadow_range {
+   GLuint id;
+   unsigned offset;
+   unsigned size;
+};
+
+struct vrend_shadow_image {
+   GLuint id;
+   GLint level;
+   GLboolean layered;
+   GLint layer;
+   GLenum access;
+   GLenum format;
+};
+
+/* What was last handed to the sub context's GL context, so calls that
+ * would not change anything can be dropped.  Values start out as all ones,
+ * which never matches a real enum and makes float compares fail. */
+struct vrend_shadow_state {
+   uint32_t caps_known;
+   uint32_t caps_enabled;
+
+   uint32_t blend_known;
+   uint32_t blend_enabled;
+   GLenum blend_func[PIPE_MAX_COLOR_BUFS][4];
+   GLenum blend_eq[PIPE_MAX_COLOR_BUFS][2];
+   GLfloat blend_color[4];
+
+   GLfloat line_width;
+   GLfloat polygon_offset[2];
+   GLenum cull_face;
+   GLenum front_face;
+   GLenum depth_func;
+   GLboolean depth_mask;
+
+   /* texture and sampler bindings go stale whenever a texture or sampler
+    * name is freed or bound behind our back, see vrend_shadow_textures_clobbered */
+   int32_t texture_gen;
+   GLenum active_texture;
+   GLenum texture_target[VREND_SHADOW_TEXTURE_UNITS];
+   GLuint texture_id[VREND_SHADOW_TEXTURE_UNITS];
+   GLuint sampler_id[VREND_SHADOW_TEXTURE_UNITS];
+
+   /* image and indexed buffer bindings, the binding points are shared by all
+    * stages so they are tracked per GL index, see vrend_shadow_indexed_clobbered */
+   int32_t indexed_gen;
+   struct vrend_shadow_image image[PIPE_MAX_SHADER_IMAGES];
+   struct vrend_shadow_range ssbo[PIPE_MAX_SHADER_BUFFERS];
+   struct vrend_shadow_range abo[PIPE_MAX_HW_ATOMIC_BUFFERS];
+};
+
+/* bumped whenever a texture or sampler binding may have changed without
+ * going through the shadow state, shared by all clients to stay cheap */
+static int32_t vrend_shadow_texture_gen;
+
+static void vrend_shadow_textures_clobbered(void)
+{
+   p_atomic_inc(&vrend_shadow_texture_gen);
+}
+
+/* the same for image and indexed buffer bindings, which only go stale when
+ * a name they may hold is freed and can be handed out again */
+static int32_t vrend_shadow_indexed_gen;
+
+static void vrend_shadow_indexed_clobbered(void)
+{
+   p_atomic_inc(&vrend_shadow_indexed_gen);
+}
+
+/* GL names whose glDelete* waits until the last submission using them
+ * retired, drivers can block there while the object is still in flight */
+enum vrend_delete_type {
+   VREND_DELETE_TEXTURE,
+   VREND_DELETE_BUFFER,
+   VREND_DELETE_PROGRAM,
+   VREND_DELETE_TYPES
+};
+
+/* the queue is drained in full past this, fences may not come at all */
+#define VREND_MAX_DEFERRED_DELETES 1024
+#define VREND_DELETE_BATCH 64
+
+struct vrend_deferred_delete {
+   uint32_t fence_id;
+   enum vrend_delete_type type;
+   GLuint id;
+};
+
+static void vrend_delete_names(enum vrend_delete_type type, GLsizei n, const GLuint *ids)
+{
+   GLsizei i;
+
+   switch (type) {
+   case VREND_DELETE_TEXTURE:
+      glDeleteTextures(n, ids);
+      vrend_shadow_textures_clobbered();
+      vrend_shadow_indexed_clobbered();
+      break;
+   case VREND_DELETE_BUFFER:
+      glDeleteBuffers(n, ids);
+      vrend_shadow_indexed_clobbered();
+      break;
+   case VREND_DELETE_PROGRAM:
+      for (i = 0; i < n; i++)
+         glDeleteProgram(ids[i]);
+      break;
+   default:
+      break;
+   }
+}
+
+/* deletes the names queued for fence latest_id or an older one, batched
+ * into one glDelete* per type and VREND_DELETE_BATCH names */
+static void vrend_drain_deletes(struct vrend_state *state, uint32_t latest_id)
+{
+   GLuint ids[VREND_DELETE_TYPES][VREND_DELETE_BATCH];
+   GLsizei counts[VREND_DELETE_TYPES] = { 0 };
+   uint32_t i, kept = 0;
+   int type;
+
+   for (i = 0; i < state->num_deferred_deletes; i++) {
+      struct vrend_deferred_delete *entry = &state->deferred_deletes[i];
+
+      if (entry->fence_id > latest_id) {
+         state->deferred_deletes[kept++] = *entry;
+         continue;
+      }
+
+      ids[entry->type][counts[entry->type]++] = entry->id;
+      if (counts[entry->type] == VREND_DELETE_BATCH) {
+         vrend_delete_names(entry->type, VREND_DELETE_BATCH, ids[entry->type]);
+         counts[entry->type] = 0;
+      }
+   }
+   state->num_deferred_deletes = kept;
+
+   for (type = 0; type < VREND_DELETE_TYPES; type++) {
+      if (counts[type])
+         vrend_delete_names(type, counts[type], ids[type]);
+   }
+}
+
+/* Deletes id once fence fence_id signaled, right away when it already did.
+ * Textures, buffers and programs are shared by all contexts of a client,
+ * so the queue is drained in whatever context vrend_renderer_check_fences
+ * runs in. */
+static void vrend_delete_later(struct vrend_state *state, enum vrend_delete_type type,
+                               GLuint id, uint32_t fence_id)
+{
+   struct vrend_deferred_delete *entry;
+
+   if (!id)
+      return;
+
+   if (!state || !state->defer_deletes || fence_id <= state->last_signaled_fence_id) {
+      vrend_delete_names(type, 1, &id);
+      return;
+   }
+
+   if (state->num_deferred_deletes == VREND_MAX_DEFERRED_DELETES)
+      vrend_drain_deletes(state, UINT32_MAX);
+
+   if (state->num_deferred_deletes == state->max_deferred_deletes) {
+      uint32_t max = state->max_deferred_deletes ? state->max_deferred_deletes * 2 : VREND_DELETE_BATCH;
+      void *entries = realloc(state->deferred_deletes, max * sizeof(*entry));
+
+      if (!entries) {
+         vrend_delete_names(type, 1, &id);
+         return;
+      }
+      state->deferred_deletes = entries;
+      state->max_deferred_deletes = max;
+   }
+
+   entry = &state->deferred_deletes[state->num_deferred_deletes++];
+   entry->fence_id = fence_id;
+   entry->type = type;
+   entry->id = id;
+}
+
+/* VREND_FB_CACHE_SIZE framebuffer objects per sub context, one per set of
+ * attachments, so switching between render targets is a single bind */
+#define VREND_FB_CACHE_SIZE 8
+
+struct vrend_fb_cache_entry {
+   GLuint id;
+   uint32_t last_use;
+   int nr_cbufs;
+   struct vrend_surface *zsurf;
+   struct vrend_surface *surf[PIPE_MAX_COLOR_BUFS];
+};
+
 struct vrend_sub_context {
    struct list_head head;
 
    virgl_gl_context gl_context;
+   /* of the client owning the context, for vrend_delete_later */
+   struct vrend_state *state;
 
    int sub_ctx_id;
 
    GLuint vaoid;
    uint32_t enabled_attribs_bitmask;
 
+   /* VAOs of the legacy vertex path in LRU order, least recently used
+    * first, and the one bound: vaoid or one of them */
+   struct list_head vaos;
+   struct util_hash_table *vao_hash;
+   uint32_t num_vaos;
+   uint32_t vao_generation;
+   GLuint bound_vao;
+
+   /* linked programs in LRU order, least recently used first */
    struct list_head programs;
-   struct util_hash_table *object_hash;
+   struct util_hash_table *program_hash;
+   uint32_t num_programs;
+   uint64_t program_cache_hits;
+   uint64_t program_cache_misses;
+
+   /* injected passthrough TCSs with the hash of their GLSL, replaced
+    * round robin */
+   struct vrend_shader_selector *passthrough_tcs[VREND_PASSTHROUGH_TCS_CACHE_SIZE];
+   uint64_t passthrough_tcs_hash[VREND_PASSTHROUGH_TCS_CACHE_SIZE];
+   unsigned passthrough_tcs_next;
+
+   struct vrend_handle_table *object_hash;
+   /* backing store of the fixed size state objects, released in bulk
+    * with the sub context */
+   struct vrend_slab object_slabs[VIRGL_MAX_OBJECTS];
 
    struct vrend_vertex_element_array *ve;
    int num_vbos;
@@ -420,7 +839,11 @@ struct vrend_sub_context {
 
    uint32_t sampler_views_dirty[PIPE_SHADER_TYPES];
 
+   /* the bound framebuffer, base_fb_id while nothing is attached */
    uint32_t fb_id;
+   uint32_t base_fb_id;
+   struct vrend_fb_cache_entry fb_cache[VREND_FB_CACHE_SIZE];
+   uint32_t fb_cache_clock;
    int nr_cbufs, old_nr_cbufs;
    struct vrend_surface *zsurf;
    struct vrend_surface *surf[PIPE_MAX_COLOR_BUFS];
@@ -456,6 +879,7 @@ struct vrend_sub_context {
    bool framebuffer_srgb_enabled;
 
    GLuint program_id;
+   GLuint pipeline_id;
    int last_shader_idx;
 
    GLint draw_indirect_buffer;
@@ -464,6 +888,12 @@ struct vrend_sub_context {
 
    struct pipe_rasterizer_state hw_rs_state;
    struct pipe_blend_state hw_blend_state;
+   struct vrend_shadow_state shadow;
+
+   /* constant buffer 0 snapshots for stages that read it from a block,
+    * const_ubo_size is what is bound for the stage (0 when nothing) */
+   struct vrend_const_ring const_ring;
+   uint32_t const_ubo_size[PIPE_SHADER_TYPES];
 
    struct list_head streamout_list;
    struct vrend_streamout_object *current_so;
@@ -499,7 +929,7 @@ struct vrend_context {
    GLuint pstipple_tex_id;
 
    /* resource bounds to this context */
-   struct util_hash_table *res_hash;
+   struct vrend_handle_table *res_hash;
 
    struct list_head active_nontimer_query_list;
    struct list_head ctx_entry;
@@ -512,11 +942,15 @@ static void vrend_update_viewport_state(struct vrend_context *ctx);
 static void vrend_update_scissor_state(struct vrend_context *ctx);
 static void vrend_destroy_query_object(void *obj_ptr);
 static void vrend_finish_context_switch(struct vrend_context *ctx);
+static void vrend_make_sub_current(struct vrend_context *ctx, struct vrend_sub_context *sub);
+static void vrend_shadow_textures_bound(struct vrend_state *state);
 static void vrend_patch_blend_state(struct vrend_context *ctx);
 static void vrend_update_frontface_state(struct vrend_context *ctx);
 static void vrend_destroy_resource_object(void *obj_ptr);
 static void vrend_renderer_detach_res_ctx(struct vrend_context *ctx, int res_handle);
 static void vrend_destroy_program(struct vrend_linked_shader_program *ent);
+static void vrend_renderer_finish_readbacks(struct virgl_client *client, struct vrend_resource *res);
+static void vrend_renderer_fini_readbacks(struct virgl_client *client);
 static void vrend_apply_sampler_state(struct vrend_context *ctx,
                                       struct vrend_resource *res,
                                       uint32_t shader_type,
@@ -601,10 +1035,36 @@ static void init_features(int gles_ver)
    }
 }
 
+static void init_multi_draw(int gles_ver)
+{
+   if (!vrend_has_gl_extension("GL_EXT_multi_draw_arrays"))
+      return;
+
+   multi_draw_arrays = (PFNGLMULTIDRAWARRAYSEXTPROC)eglGetProcAddress("glMultiDrawArraysEXT");
+   if (gles_ver >= 32 || vrend_has_gl_extension("GL_EXT_draw_elements_base_vertex") ||
+       vrend_has_gl_extension("GL_OES_draw_elements_base_vertex"))
+      multi_draw_elements_base_vertex = (PFNGLMULTIDRAWELEMENTSBASEVERTEXEXTPROC)eglGetProcAddress("glMultiDrawElementsBaseVertexEXT");
+}
+
+static void init_parallel_compile(void)
+{
+   if (vrend_has_gl_extension("GL_KHR_parallel_shader_compile"))
+      max_shader_compiler_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+}
+
+static void init_texture_view(void)
+{
+   if (vrend_has_gl_extension("GL_OES_texture_view"))
+      texture_view = (PFNGLTEXTUREVIEWOESPROC)eglGetProcAddress("glTextureViewOES");
+   else if (vrend_has_gl_extension("GL_EXT_texture_view"))
+      texture_view = (PFNGLTEXTUREVIEWOESPROC)eglGetProcAddress("glTextureViewEXT");
+}
+
 static void vrend_destroy_surface(struct vrend_surface *surf)
 {
    if (surf->id != surf->texture->id)
-      glDeleteTextures(1, &surf->id);
+      vrend_delete_later(surf->texture->state, VREND_DELETE_TEXTURE, surf->id,
+                         surf->texture->fence_id);
    vrend_resource_reference(&surf->texture, NULL);
    free(surf);
 }
@@ -622,7 +1082,8 @@ vrend_surface_reference(struct vrend_surface **ptr, struct vrend_surface *surf)
 static void vrend_destroy_sampler_view(struct vrend_sampler_view *samp)
 {
    if (samp->texture->id != samp->id)
-      glDeleteTextures(1, &samp->id);
+      vrend_delete_later(samp->texture->state, VREND_DELETE_TEXTURE, samp->id,
+                         samp->texture->fence_id);
    vrend_resource_reference(&samp->texture, NULL);
    free(samp);
 }
@@ -656,11 +1117,26 @@ vrend_so_target_reference(struct vrend_so_target **ptr, struct vrend_so_target *
 static void vrend_shader_destroy(struct vrend_shader *shader)
 {
    struct vrend_linked_shader_program *ent, *tmp;
+   struct vrend_separable_program *stage;
+   struct vrend_shader *variant;
 
    LIST_FOR_EACH_ENTRY_SAFE(ent, tmp, &shader->programs, sl[shader->sel->type]) {
       vrend_destroy_program(ent);
    }
 
+   /* the pipelines using them went with the programs above */
+   while ((stage = shader->separable)) {
+      shader->separable = stage->next;
+      glDeleteProgram(stage->id);
+      free(stage);
+   }
+
+   while ((variant = shader->interp_variants)) {
+      shader->interp_variants = variant->next_variant;
+      vrend_shader_destroy(variant);
+   }
+
+   vrend_compile_job_release(&shader->compile_job);
    glDeleteShader(shader->id);
    strarray_free(&shader->glsl_strings, true);
    free(shader);
@@ -683,20 +1159,49 @@ static void vrend_destroy_shader_selector(struct vrend_shader_selector *sel)
    free(sel->sinfo.interpinfo);
    free(sel->sinfo.sampler_arrays);
    free(sel->sinfo.image_arrays);
+   free(sel->analysis);
    free(sel->tokens);
    free(sel);
 }
 
+/* Waits for a background compile of the shader and for the links of every
+ * program it is attached to, after which its source may be changed. */
+static void vrend_shader_wait_idle(struct vrend_shader *shader)
+{
+   struct vrend_linked_shader_program *ent;
+
+   LIST_FOR_EACH_ENTRY(ent, &shader->programs, sl[shader->sel->type]) {
+      if (ent->link_job)
+         vrend_compile_job_wait(ent->link_job);
+   }
+   vrend_compile_job_release(&shader->compile_job);
+}
+
 static bool vrend_compile_shader(struct vrend_context *ctx,
                                  struct vrend_shader *shader)
 {
+   struct vrend_compile_pool *pool = ctx->client->vrend_state->compile_pool;
    GLint param;
    const char *shader_parts[SHADER_MAX_STRINGS];
 
    for (int i = 0; i < shader->glsl_strings.num_strings; i++)
       shader_parts[i] = shader->glsl_strings.strings[i].buf;
+
+   /* compile errors then surface as a failed link of the programs using it */
+   if (pool) {
+      vrend_shader_wait_idle(shader);
+      shader->compile_job = vrend_compile_pool_compile(pool, shader->id, shader_parts,
+                                                       shader->glsl_strings.num_strings);
+      if (shader->compile_job)
+         return true;
+   }
+
+   NATIVE_TRACE_SCOPE("vrend_compile_shader");
    glShaderSource(shader->id, shader->glsl_strings.num_strings, shader_parts, NULL);
    glCompileShader(shader->id);
+   /* querying the status would wait for the driver's compiler thread */
+   if (ctx->client->vrend_state->parallel_compile)
+      return true;
    glGetShaderiv(shader->id, GL_COMPILE_STATUS, &param);
    if (param == GL_FALSE)
       return false;
@@ -739,6 +1244,32 @@ vrend_get_format_table_entry(enum virgl_formats format)
    return &tex_conv_table[format];
 }
 
+static uint64_t vrend_resource_write_seq;
+
+/* Gives res a new contents version, see vrend_blit_is_repeated_resolve();
+ * versions are unique across resources. */
+static inline void vrend_resource_new_contents(struct vrend_resource *res)
+{
+   res->write_seq = __atomic_add_fetch(&vrend_resource_write_seq, 1, __ATOMIC_RELAXED);
+}
+
+/* res is written by GPU work submitted with the fence fence_id */
+/* stamps res with the fence retiring its last use, also for the client */
+static inline void vrend_resource_set_fence(struct vrend_state *state, struct vrend_resource *res,
+                                            uint32_t fence_id)
+{
+   res->fence_id = fence_id;
+   if (res->handle < state->busy_table_size)
+      __atomic_store_n(&state->busy_table[res->handle], fence_id, __ATOMIC_RELEASE);
+}
+
+static inline void vrend_resource_written(struct vrend_state *state, struct vrend_resource *res,
+                                          uint32_t fence_id)
+{
+   vrend_resource_new_contents(res);
+   vrend_resource_set_fence(state, res, fence_id);
+}
+
 static void vrend_use_program(struct vrend_context *ctx, GLuint program_id)
 {
    if (ctx->sub->program_id != program_id) {
@@ -747,10 +1278,45 @@ static void vrend_use_program(struct vrend_context *ctx, GLuint program_id)
    }
 }
 
+static void vrend_use_linked_program(struct vrend_context *ctx,
+                                     struct vrend_linked_shader_program *prog)
+{
+   if (!prog->pipeline) {
+      vrend_use_program(ctx, prog->id);
+      return;
+   }
+
+   /* a current program takes precedence over the bound pipeline */
+   vrend_use_program(ctx, 0);
+   if (ctx->sub->pipeline_id != prog->pipeline) {
+      glBindProgramPipeline(prog->pipeline);
+      ctx->sub->pipeline_id = prog->pipeline;
+   }
+}
+
+/* the program object holding the uniforms of shader_type */
+static inline GLuint vrend_program_stage_id(const struct vrend_linked_shader_program *prog,
+                                            int shader_type)
+{
+   return prog->pipeline ? prog->stages[shader_type]->id : prog->id;
+}
+
+/* Points the glUniform* calls that follow at shader_type's program, for a
+ * pipeline that is its active program. */
+static void vrend_uniform_stage(struct vrend_linked_shader_program *prog, int shader_type)
+{
+   if (!prog->pipeline || prog->active_stage == shader_type)
+      return;
+
+   glActiveShaderProgram(prog->pipeline, prog->stages[shader_type]->id);
+   prog->active_stage = shader_type;
+}
+
 static void vrend_init_pstipple_texture(struct vrend_context *ctx)
 {
    glGenTextures(1, &ctx->pstipple_tex_id);
    glBindTexture(GL_TEXTURE_2D, ctx->pstipple_tex_id);
+   vrend_shadow_textures_bound(ctx->client->vrend_state);
    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 32, 32, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -782,87 +1348,426 @@ static void vrend_stencil_test_enable(struct vrend_context *ctx, bool stencil_te
    }
 }
 
-static int bind_sampler_locs(struct vrend_linked_shader_program *sprog,
-                             int id, int next_sampler_id)
+static const GLenum vrend_shadow_cap_enums[VREND_CAP_COUNT] = {
+   [VREND_CAP_SAMPLE_ALPHA_TO_COVERAGE] = GL_SAMPLE_ALPHA_TO_COVERAGE,
+   [VREND_CAP_DITHER] = GL_DITHER,
+   [VREND_CAP_POLYGON_OFFSET_FILL] = GL_POLYGON_OFFSET_FILL,
+   [VREND_CAP_CULL_FACE] = GL_CULL_FACE,
+   [VREND_CAP_SAMPLE_MASK] = GL_SAMPLE_MASK,
+   [VREND_CAP_SAMPLE_SHADING] = GL_SAMPLE_SHADING,
+   [VREND_CAP_SCISSOR_TEST] = GL_SCISSOR_TEST,
+};
+
+static void vrend_shadow_reset(struct vrend_shadow_state *shadow)
 {
-   if (sprog->ss[id]->sel->sinfo.samplers_used_mask) {
-      uint32_t mask = sprog->ss[id]->sel->sinfo.samplers_used_mask;
-      int nsamp = util_bitcount(sprog->ss[id]->sel->sinfo.samplers_used_mask);
-      int index;
-      sprog->shadow_samp_mask[id] = sprog->ss[id]->sel->sinfo.shadow_samp_mask;
-      if (sprog->ss[id]->sel->sinfo.shadow_samp_mask) {
-         sprog->shadow_samp_mask_locs[id] = calloc(nsamp, sizeof(uint32_t));
-         sprog->shadow_samp_add_locs[id] = calloc(nsamp, sizeof(uint32_t));
-      } else {
-         sprog->shadow_samp_mask_locs[id] = sprog->shadow_samp_add_locs[id] = NULL;
-      }
-      const char *prefix = pipe_shader_to_prefix(id);
-      index = 0;
-      while(mask) {
-         uint32_t i = u_bit_scan(&mask);
-         char name[64];
-         if (sprog->ss[id]->sel->sinfo.num_sampler_arrays) {
-            int arr_idx = vrend_shader_lookup_sampler_array(&sprog->ss[id]->sel->sinfo, i);
-            snprintf(name, 32, "%ssamp%d[%d]", prefix, arr_idx, i - arr_idx);
-         } else
-            snprintf(name, 32, "%ssamp%d", prefix, i);
+   memset(shadow, 0xff, sizeof(*shadow));
+   shadow->caps_known = 0;
+   shadow->blend_known = 0;
+}
 
-         glUniform1i(glGetUniformLocation(sprog->id, name), next_sampler_id++);
+/* returns true, and counts the call as filtered, if it would be a no-op */
+static inline bool vrend_shadow_filter(struct vrend_context *ctx, bool redundant)
+{
+   if (redundant)
+      ctx->client->vrend_state->filtered_gl_calls++;
+   return redundant;
+}
 
-         if (sprog->ss[id]->sel->sinfo.shadow_samp_mask & (1 << i)) {
-            snprintf(name, 32, "%sshadmask%d", prefix, i);
-            sprog->shadow_samp_mask_locs[id][index] = glGetUniformLocation(sprog->id, name);
-            snprintf(name, 32, "%sshadadd%d", prefix, i);
-            sprog->shadow_samp_add_locs[id][index] = glGetUniformLocation(sprog->id, name);
-         }
-         index++;
-      }
+static void vrend_set_cap(struct vrend_context *ctx, enum vrend_shadow_cap cap, bool enable)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   uint32_t bit = 1u << cap;
+
+   if (vrend_shadow_filter(ctx, (shadow->caps_known & bit) &&
+                                !!(shadow->caps_enabled & bit) == enable))
+      return;
+
+   shadow->caps_known |= bit;
+   if (enable) {
+      shadow->caps_enabled |= bit;
+      glEnable(vrend_shadow_cap_enums[cap]);
    } else {
-      sprog->shadow_samp_mask_locs[id] = NULL;
-      sprog->shadow_samp_add_locs[id] = NULL;
-      sprog->shadow_samp_mask[id] = 0;
+      shadow->caps_enabled &= ~bit;
+      glDisable(vrend_shadow_cap_enums[cap]);
    }
-   sprog->samplers_used_mask[id] = sprog->ss[id]->sel->sinfo.samplers_used_mask;
-
-   return next_sampler_id;
 }
 
-static void bind_const_locs(struct vrend_linked_shader_program *sprog,
-                            int id)
+/* rt < 0 sets every color buffer at once */
+static void vrend_blend_enable(struct vrend_context *ctx, int rt, bool enable)
 {
-  if (sprog->ss[id]->sel->sinfo.num_consts) {
-     char name[32];
-     snprintf(name, 32, "%sconst0", pipe_shader_to_prefix(id));
-     sprog->const_location[id] = glGetUniformLocation(sprog->id, name);
-  } else
-      sprog->const_location[id] = -1;
-}
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   uint32_t mask = rt < 0 ? (1u << PIPE_MAX_COLOR_BUFS) - 1 : 1u << rt;
 
-static int bind_ubo_locs(struct vrend_linked_shader_program *sprog,
-                         int id, int next_ubo_id)
-{
-   if (!has_feature(feat_ubo))
-      return next_ubo_id;
-   if (sprog->ss[id]->sel->sinfo.ubo_used_mask) {
-      const char *prefix = pipe_shader_to_prefix(id);
+   if (vrend_shadow_filter(ctx, (shadow->blend_known & mask) == mask &&
+                                (shadow->blend_enabled & mask) == (enable ? mask : 0)))
+      return;
 
-      unsigned mask = sprog->ss[id]->sel->sinfo.ubo_used_mask;
-      while (mask) {
-         uint32_t ubo_idx = u_bit_scan(&mask);
-         char name[32];
-         if (sprog->ss[id]->sel->sinfo.ubo_indirect)
-            snprintf(name, 32, "%subo[%d]", prefix, ubo_idx - 1);
-         else
-            snprintf(name, 32, "%subo%d", prefix, ubo_idx);
+   shadow->blend_known |= mask;
+   if (enable)
+      shadow->blend_enabled |= mask;
+   else
+      shadow->blend_enabled &= ~mask;
 
-         GLuint loc = glGetUniformBlockIndex(sprog->id, name);
-         glUniformBlockBinding(sprog->id, loc, next_ubo_id++);
-      }
+   if (rt < 0) {
+      if (enable)
+         glEnable(GL_BLEND);
+      else
+         glDisable(GL_BLEND);
+   } else {
+      if (enable)
+         glEnablei(GL_BLEND, rt);
+      else
+         glDisablei(GL_BLEND, rt);
    }
+}
 
-   sprog->ubo_used_mask[id] = sprog->ss[id]->sel->sinfo.ubo_used_mask;
+static void vrend_blend_func(struct vrend_context *ctx, int rt, GLenum src_rgb, GLenum dst_rgb,
+                             GLenum src_alpha, GLenum dst_alpha)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   const GLenum func[4] = { src_rgb, dst_rgb, src_alpha, dst_alpha };
+   int i, first = rt < 0 ? 0 : rt, last = rt < 0 ? PIPE_MAX_COLOR_BUFS - 1 : rt;
+   bool redundant = true;
 
-   return next_ubo_id;
+   for (i = first; i <= last && redundant; i++)
+      redundant = !memcmp(shadow->blend_func[i], func, sizeof(func));
+   if (vrend_shadow_filter(ctx, redundant))
+      return;
+
+   for (i = first; i <= last; i++)
+      memcpy(shadow->blend_func[i], func, sizeof(func));
+
+   if (rt < 0)
+      glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+   else
+      glBlendFuncSeparatei(rt, src_rgb, dst_rgb, src_alpha, dst_alpha);
+}
+
+static void vrend_blend_equation(struct vrend_context *ctx, int rt, GLenum mode_rgb, GLenum mode_alpha)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   int i, first = rt < 0 ? 0 : rt, last = rt < 0 ? PIPE_MAX_COLOR_BUFS - 1 : rt;
+   bool redundant = true;
+
+   for (i = first; i <= last && redundant; i++)
+      redundant = shadow->blend_eq[i][0] == mode_rgb && shadow->blend_eq[i][1] == mode_alpha;
+   if (vrend_shadow_filter(ctx, redundant))
+      return;
+
+   for (i = first; i <= last; i++) {
+      shadow->blend_eq[i][0] = mode_rgb;
+      shadow->blend_eq[i][1] = mode_alpha;
+   }
+
+   if (rt < 0)
+      glBlendEquationSeparate(mode_rgb, mode_alpha);
+   else
+      glBlendEquationSeparatei(rt, mode_rgb, mode_alpha);
+}
+
+static void vrend_blend_color(struct vrend_context *ctx, const GLfloat color[4])
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+
+   if (vrend_shadow_filter(ctx, shadow->blend_color[0] == color[0] &&
+                                shadow->blend_color[1] == color[1] &&
+                                shadow->blend_color[2] == color[2] &&
+                                shadow->blend_color[3] == color[3]))
+      return;
+
+   memcpy(shadow->blend_color, color, sizeof(shadow->blend_color));
+   glBlendColor(color[0], color[1], color[2], color[3]);
+}
+
+static void vrend_line_width(struct vrend_context *ctx, GLfloat width)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.line_width == width))
+      return;
+
+   ctx->sub->shadow.line_width = width;
+   glLineWidth(width);
+}
+
+static void vrend_polygon_offset(struct vrend_context *ctx, GLfloat factor, GLfloat units)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+
+   if (vrend_shadow_filter(ctx, shadow->polygon_offset[0] == factor &&
+                                shadow->polygon_offset[1] == units))
+      return;
+
+   shadow->polygon_offset[0] = factor;
+   shadow->polygon_offset[1] = units;
+   glPolygonOffset(factor, units);
+}
+
+static void vrend_cull_face(struct vrend_context *ctx, GLenum mode)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.cull_face == mode))
+      return;
+
+   ctx->sub->shadow.cull_face = mode;
+   glCullFace(mode);
+}
+
+static void vrend_front_face(struct vrend_context *ctx, GLenum mode)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.front_face == mode))
+      return;
+
+   ctx->sub->shadow.front_face = mode;
+   glFrontFace(mode);
+}
+
+static void vrend_depth_func(struct vrend_context *ctx, GLenum func)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.depth_func == func))
+      return;
+
+   ctx->sub->shadow.depth_func = func;
+   glDepthFunc(func);
+}
+
+static void vrend_depth_mask(struct vrend_context *ctx, GLboolean mask)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.depth_mask == mask))
+      return;
+
+   ctx->sub->shadow.depth_mask = mask;
+   glDepthMask(mask);
+}
+
+static void vrend_shadow_forget_textures(struct vrend_shadow_state *shadow)
+{
+   memset(shadow->texture_target, 0xff, sizeof(shadow->texture_target));
+   memset(shadow->texture_id, 0xff, sizeof(shadow->texture_id));
+   memset(shadow->sampler_id, 0xff, sizeof(shadow->sampler_id));
+}
+
+static void vrend_shadow_check_textures(struct vrend_shadow_state *shadow)
+{
+   int32_t gen = p_atomic_read(&vrend_shadow_texture_gen);
+
+   if (shadow->texture_gen == gen)
+      return;
+
+   vrend_shadow_forget_textures(shadow);
+   shadow->texture_gen = gen;
+}
+
+/* a texture or sampler was bound behind the shadow state's back, that only
+ * touched the current GL context so the other sub contexts keep theirs */
+static void vrend_shadow_textures_bound(struct vrend_state *state)
+{
+   if (state->current_sub)
+      vrend_shadow_forget_textures(&state->current_sub->shadow);
+   else
+      vrend_shadow_textures_clobbered();
+}
+
+static void vrend_shadow_check_indexed(struct vrend_shadow_state *shadow)
+{
+   int32_t gen = p_atomic_read(&vrend_shadow_indexed_gen);
+
+   if (shadow->indexed_gen == gen)
+      return;
+
+   memset(shadow->image, 0xff, sizeof(shadow->image));
+   memset(shadow->ssbo, 0xff, sizeof(shadow->ssbo));
+   memset(shadow->abo, 0xff, sizeof(shadow->abo));
+   shadow->indexed_gen = gen;
+}
+
+/* binds a range of a shader storage or atomic counter buffer to index */
+static void vrend_bind_buffer_range(struct vrend_context *ctx, GLenum target, GLuint index,
+                                    GLuint id, unsigned offset, unsigned size)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   struct vrend_shadow_range *range;
+
+   vrend_shadow_check_indexed(shadow);
+   range = target == GL_SHADER_STORAGE_BUFFER ? &shadow->ssbo[index] : &shadow->abo[index];
+   if (vrend_shadow_filter(ctx, range->id == id && range->offset == offset &&
+                                range->size == size))
+      return;
+
+   range->id = id;
+   range->offset = offset;
+   range->size = size;
+   glBindBufferRange(target, index, id, offset, size);
+}
+
+static void vrend_bind_image_unit(struct vrend_context *ctx, GLuint unit, GLuint id,
+                                  GLint level, GLboolean layered, GLint layer,
+                                  GLenum access, GLenum format)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+   struct vrend_shadow_image *image = &shadow->image[unit];
+
+   vrend_shadow_check_indexed(shadow);
+   if (vrend_shadow_filter(ctx, image->id == id && image->level == level &&
+                                image->layered == layered && image->layer == layer &&
+                                image->access == access && image->format == format))
+      return;
+
+   image->id = id;
+   image->level = level;
+   image->layered = layered;
+   image->layer = layer;
+   image->access = access;
+   image->format = format;
+   glBindImageTexture(unit, id, level, layered, layer, access, format);
+}
+
+static void vrend_active_texture(struct vrend_context *ctx, GLuint unit)
+{
+   if (vrend_shadow_filter(ctx, ctx->sub->shadow.active_texture == GL_TEXTURE0 + unit))
+      return;
+
+   ctx->sub->shadow.active_texture = GL_TEXTURE0 + unit;
+   glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+/* leaves unit as the active texture unit */
+static void vrend_bind_texture_unit(struct vrend_context *ctx, GLuint unit, GLenum target, GLuint id)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+
+   vrend_active_texture(ctx, unit);
+   if (unit >= VREND_SHADOW_TEXTURE_UNITS) {
+      glBindTexture(target, id);
+      return;
+   }
+
+   vrend_shadow_check_textures(shadow);
+   if (vrend_shadow_filter(ctx, shadow->texture_target[unit] == target &&
+                                shadow->texture_id[unit] == id))
+      return;
+
+   shadow->texture_target[unit] = target;
+   shadow->texture_id[unit] = id;
+   glBindTexture(target, id);
+}
+
+static void vrend_bind_sampler_unit(struct vrend_context *ctx, GLuint unit, GLuint sampler)
+{
+   struct vrend_shadow_state *shadow = &ctx->sub->shadow;
+
+   if (unit >= VREND_SHADOW_TEXTURE_UNITS) {
+      glBindSampler(unit, sampler);
+      return;
+   }
+
+   vrend_shadow_check_textures(shadow);
+   if (vrend_shadow_filter(ctx, shadow->sampler_id[unit] == sampler))
+      return;
+
+   shadow->sampler_id[unit] = sampler;
+   glBindSampler(unit, sampler);
+}
+
+static int bind_sampler_locs(struct vrend_linked_shader_program *sprog,
+                             int id, int next_sampler_id)
+{
+   GLuint prog_id = vrend_program_stage_id(sprog, id);
+
+   if (sprog->ss[id]->sel->sinfo.samplers_used_mask) {
+      uint32_t mask = sprog->ss[id]->sel->sinfo.samplers_used_mask;
+      int nsamp = util_bitcount(sprog->ss[id]->sel->sinfo.samplers_used_mask);
+      int index;
+      sprog->shadow_samp_mask[id] = sprog->ss[id]->sel->sinfo.shadow_samp_mask;
+      if (sprog->ss[id]->sel->sinfo.shadow_samp_mask) {
+         sprog->shadow_samp_mask_locs[id] = calloc(nsamp, sizeof(uint32_t));
+         sprog->shadow_samp_add_locs[id] = calloc(nsamp, sizeof(uint32_t));
+      } else {
+         sprog->shadow_samp_mask_locs[id] = sprog->shadow_samp_add_locs[id] = NULL;
+      }
+      const char *prefix = pipe_shader_to_prefix(id);
+      index = 0;
+      while(mask) {
+         uint32_t i = u_bit_scan(&mask);
+         char name[64];
+         if (sprog->ss[id]->sel->sinfo.num_sampler_arrays) {
+            int arr_idx = vrend_shader_lookup_sampler_array(&sprog->ss[id]->sel->sinfo, i);
+            snprintf(name, 32, "%ssamp%d[%d]", prefix, arr_idx, i - arr_idx);
+         } else
+            snprintf(name, 32, "%ssamp%d", prefix, i);
+
+         if (sprog->pipeline)
+            glProgramUniform1i(prog_id, glGetUniformLocation(prog_id, name), next_sampler_id++);
+         else
+            glUniform1i(glGetUniformLocation(prog_id, name), next_sampler_id++);
+
+         if (sprog->ss[id]->sel->sinfo.shadow_samp_mask & (1 << i)) {
+            snprintf(name, 32, "%sshadmask%d", prefix, i);
+            sprog->shadow_samp_mask_locs[id][index] = glGetUniformLocation(prog_id, name);
+            snprintf(name, 32, "%sshadadd%d", prefix, i);
+            sprog->shadow_samp_add_locs[id][index] = glGetUniformLocation(prog_id, name);
+         }
+         index++;
+      }
+   } else {
+      sprog->shadow_samp_mask_locs[id] = NULL;
+      sprog->shadow_samp_add_locs[id] = NULL;
+      sprog->shadow_samp_mask[id] = 0;
+   }
+   sprog->samplers_used_mask[id] = sprog->ss[id]->sel->sinfo.samplers_used_mask;
+
+   return next_sampler_id;
+}
+
+static void bind_const_locs(struct vrend_context *ctx,
+                            struct vrend_linked_shader_program *sprog,
+                            int id)
+{
+  GLuint prog_id = vrend_program_stage_id(sprog, id);
+
+  sprog->const_ubo[id] = false;
+  if (sprog->ss[id]->sel->sinfo.consts_in_ubo) {
+     char name[32];
+     snprintf(name, 32, "%sconstbuf", pipe_shader_to_prefix(id));
+     GLuint index = glGetUniformBlockIndex(prog_id, name);
+     if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(prog_id, index,
+                              ctx->client->vrend_state->const_ubo_binding_base + id);
+        sprog->const_ubo[id] = true;
+     }
+     sprog->const_location[id] = -1;
+  } else if (sprog->ss[id]->sel->sinfo.num_consts) {
+     char name[32];
+     snprintf(name, 32, "%sconst0", pipe_shader_to_prefix(id));
+     sprog->const_location[id] = glGetUniformLocation(prog_id, name);
+  } else
+      sprog->const_location[id] = -1;
+}
+
+static int bind_ubo_locs(struct vrend_linked_shader_program *sprog,
+                         int id, int next_ubo_id)
+{
+   GLuint prog_id = vrend_program_stage_id(sprog, id);
+
+   if (!has_feature(feat_ubo))
+      return next_ubo_id;
+   if (sprog->ss[id]->sel->sinfo.ubo_used_mask) {
+      const char *prefix = pipe_shader_to_prefix(id);
+
+      unsigned mask = sprog->ss[id]->sel->sinfo.ubo_used_mask;
+      while (mask) {
+         uint32_t ubo_idx = u_bit_scan(&mask);
+         char name[32];
+         if (sprog->ss[id]->sel->sinfo.ubo_indirect)
+            snprintf(name, 32, "%subo[%d]", prefix, ubo_idx - 1);
+         else
+            snprintf(name, 32, "%subo%d", prefix, ubo_idx);
+
+         GLuint loc = glGetUniformBlockIndex(prog_id, name);
+         glUniformBlockBinding(prog_id, loc, next_ubo_id++);
+      }
+   }
+
+   sprog->ubo_used_mask[id] = sprog->ss[id]->sel->sinfo.ubo_used_mask;
+
+   return next_ubo_id;
 }
 
 static void bind_ssbo_locs(struct vrend_linked_shader_program *sprog,
@@ -880,7 +1785,8 @@ static void bind_ssbo_locs(struct vrend_linked_shader_program *sprog,
       while (mask) {
          i = u_bit_scan(&mask);
          snprintf(name, 32, "%sssbo%d", prefix, i);
-         sprog->ssbo_locs[id][i] = glGetProgramResourceIndex(sprog->id, GL_SHADER_STORAGE_BLOCK, name);
+         sprog->ssbo_locs[id][i] = glGetProgramResourceIndex(vrend_program_stage_id(sprog, id),
+                                                             GL_SHADER_STORAGE_BLOCK, name);
       }
    } else
       sprog->ssbo_locs[id] = NULL;
@@ -908,25 +1814,289 @@ static void bind_image_locs(struct vrend_linked_shader_program *sprog,
    } else
       sprog->img_locs[id] = NULL;
 
-   if (sprog->ss[id]->sel->sinfo.num_image_arrays) {
-      for (i = 0; i < sprog->ss[id]->sel->sinfo.num_image_arrays; i++) {
-         struct vrend_array *img_array = &sprog->ss[id]->sel->sinfo.image_arrays[i];
-         for (int j = 0; j < img_array->array_size; j++) {
-            snprintf(name, 32, "%simg%d[%d]", prefix, img_array->first, j);
-            sprog->img_locs[id][img_array->first + j] = glGetUniformLocation(sprog->id, name);
-         }
-      }
-   } else if (mask) {
-      for (i = 0; i < nsamp; i++) {
-         if (mask & (1 << i)) {
-            snprintf(name, 32, "%simg%d", prefix, i);
-            sprog->img_locs[id][i] = glGetUniformLocation(sprog->id, name);
-         } else {
-            sprog->img_locs[id][i] = -1;
-         }
+   if (sprog->ss[id]->sel->sinfo.num_image_arrays) {
+      for (i = 0; i < sprog->ss[id]->sel->sinfo.num_image_arrays; i++) {
+         struct vrend_array *img_array = &sprog->ss[id]->sel->sinfo.image_arrays[i];
+         for (int j = 0; j < img_array->array_size; j++) {
+            snprintf(name, 32, "%simg%d[%d]", prefix, img_array->first, j);
+            sprog->img_locs[id][img_array->first + j] = glGetUniformLocation(vrend_program_stage_id(sprog, id), name);
+         }
+      }
+   } else if (mask) {
+      for (i = 0; i < nsamp; i++) {
+         if (mask & (1 << i)) {
+            snprintf(name, 32, "%simg%d", prefix, i);
+            sprog->img_locs[id][i] = glGetUniformLocation(vrend_program_stage_id(sprog, id), name);
+         } else {
+            sprog->img_locs[id][i] = -1;
+         }
+      }
+   }
+   sprog->images_used_mask[id] = mask;
+}
+
+static unsigned vrend_program_key_hash(void *key)
+{
+   return cso_construct_key(key, sizeof(struct vrend_linked_program_key));
+}
+
+static int vrend_program_key_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct vrend_linked_program_key));
+}
+
+static void vrend_program_key_destroy(UNUSED void *value)
+{
+   /* programs are owned by sub->programs, the hash only indexes them */
+}
+
+static void vrend_program_cache_evict(struct vrend_sub_context *sub,
+                                      struct vrend_linked_shader_program *keep)
+{
+   struct vrend_linked_shader_program *ent, *tmp;
+
+   LIST_FOR_EACH_ENTRY_SAFE(ent, tmp, &sub->programs, head) {
+      if (sub->num_programs <= VREND_PROGRAM_CACHE_SIZE)
+         break;
+      if (ent == keep || ent == sub->prog || (ent->id && ent->id == sub->program_id))
+         continue;
+      vrend_destroy_program(ent);
+   }
+}
+
+static void vrend_program_cache_insert(struct vrend_sub_context *sub,
+                                       struct vrend_linked_shader_program *sprog)
+{
+   int i;
+
+   memset(&sprog->key, 0, sizeof(sprog->key));
+   for (i = 0; i < PIPE_SHADER_TYPES; i++)
+      sprog->key.ids[i] = sprog->ss[i] ? sprog->ss[i]->id : 0;
+   sprog->key.dual_src = sprog->dual_src_linked;
+   sprog->sub = sub;
+
+   list_addtail(&sprog->head, &sub->programs);
+   util_hash_table_set(sub->program_hash, &sprog->key, sprog);
+   sub->num_programs++;
+
+   if (sub->num_programs > VREND_PROGRAM_CACHE_SIZE)
+      vrend_program_cache_evict(sub, sprog);
+}
+
+static struct vrend_linked_shader_program *
+vrend_program_cache_lookup(struct vrend_sub_context *sub,
+                           struct vrend_linked_program_key *key)
+{
+   struct vrend_linked_shader_program *ent;
+
+   ent = util_hash_table_get(sub->program_hash, key);
+   if (!ent) {
+      sub->program_cache_misses++;
+      return NULL;
+   }
+
+   sub->program_cache_hits++;
+   list_del(&ent->head);
+   list_addtail(&ent->head, &sub->programs);
+   return ent;
+}
+
+/* Links sprog->id, first trying a binary from the on-disk program cache
+ * keyed on the GLSL of every attached stage (NULL for unattached stages).
+ * With a compile pool the link may still be pending in sprog->link_job,
+ * with parallel_compile in the driver (sprog->link_pending). */
+static bool vrend_link_program(struct vrend_context *ctx,
+                               struct vrend_linked_shader_program *sprog,
+                               struct vrend_shader *s0,
+                               struct vrend_shader *s1,
+                               struct vrend_shader *s2,
+                               struct vrend_shader *s3)
+{
+   struct vrend_compile_pool *pool = ctx->client->vrend_state->compile_pool;
+   struct vrend_shader *stages[] = { s0, s1, s2, s3 };
+   uint64_t hash = 0;
+   GLint lret;
+   unsigned i;
+
+   if (vrend_program_cache_enabled()) {
+      hash = vrend_program_cache_hash_begin();
+      for (i = 0; i < ARRAY_SIZE(stages); i++) {
+         if (stages[i])
+            hash = vrend_program_cache_hash_strings(hash, &stages[i]->glsl_strings);
+         else
+            hash = vrend_program_cache_hash_strings(hash, &(struct vrend_strarray){ 0 });
+      }
+
+      if (vrend_program_cache_load(sprog->id, hash))
+         return true;
+
+      glProgramParameteri(sprog->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      sprog->binary_hash = hash;
+   }
+
+   if (pool) {
+      struct vrend_compile_job *deps[ARRAY_SIZE(stages)];
+
+      for (i = 0; i < ARRAY_SIZE(stages); i++)
+         deps[i] = stages[i] ? stages[i]->compile_job : NULL;
+
+      sprog->link_job = vrend_compile_pool_link(pool, sprog->id, deps, ARRAY_SIZE(deps));
+      if (sprog->link_job)
+         return true;
+   }
+
+   /* shaders compiled in the background must be done before a local link */
+   for (i = 0; i < ARRAY_SIZE(stages); i++) {
+      if (stages[i] && stages[i]->compile_job)
+         vrend_compile_job_wait(stages[i]->compile_job);
+   }
+
+   {
+      NATIVE_TRACE_SCOPE("vrend_link_program");
+      glLinkProgram(sprog->id);
+      if (ctx->client->vrend_state->parallel_compile) {
+         sprog->link_pending = true;
+         return true;
+      }
+      glGetProgramiv(sprog->id, GL_LINK_STATUS, &lret);
+   }
+   if (lret == GL_FALSE)
+      return false;
+
+   if (sprog->binary_hash) {
+      vrend_program_cache_store(sprog->id, sprog->binary_hash);
+      sprog->binary_hash = 0;
+   }
+   return true;
+}
+
+static void vrend_setup_linked_program(struct vrend_context *ctx,
+                                       struct vrend_linked_shader_program *sprog)
+{
+   struct vrend_shader *vs = sprog->ss[PIPE_SHADER_VERTEX];
+   struct vrend_shader *fs = sprog->ss[PIPE_SHADER_FRAGMENT];
+   GLuint prog_id = sprog->id;
+   GLuint vs_id = vrend_program_stage_id(sprog, PIPE_SHADER_VERTEX);
+   char name[64];
+   int i, id, last_shader;
+
+   if (!sprog->pipeline)
+      vrend_use_program(ctx, prog_id);
+
+   if (sprog->ss[PIPE_SHADER_COMPUTE]) {
+      bind_sampler_locs(sprog, PIPE_SHADER_COMPUTE, 0);
+      bind_ubo_locs(sprog, PIPE_SHADER_COMPUTE, 0);
+      bind_ssbo_locs(sprog, PIPE_SHADER_COMPUTE);
+      bind_const_locs(ctx, sprog, PIPE_SHADER_COMPUTE);
+      bind_image_locs(sprog, PIPE_SHADER_COMPUTE);
+      return;
+   }
+
+   last_shader = sprog->ss[PIPE_SHADER_TESS_EVAL] ? PIPE_SHADER_TESS_EVAL :
+                 (sprog->ss[PIPE_SHADER_GEOMETRY] ? PIPE_SHADER_GEOMETRY : PIPE_SHADER_FRAGMENT);
+
+   if (fs->key.pstipple_tex)
+      sprog->fs_stipple_loc = glGetUniformLocation(vrend_program_stage_id(sprog, PIPE_SHADER_FRAGMENT),
+                                                   "pstipple_sampler");
+   else
+      sprog->fs_stipple_loc = -1;
+   /* pipelines only have a vertex and a fragment stage */
+   sprog->vs_ws_adjust_loc = glGetUniformLocation(sprog->pipeline ? vs_id : prog_id, "winsys_adjust_y");
+
+   int next_ubo_id = 0, next_sampler_id = 0;
+   for (id = PIPE_SHADER_VERTEX; id <= last_shader; id++) {
+      if (!sprog->ss[id])
+         continue;
+
+      next_sampler_id = bind_sampler_locs(sprog, id, next_sampler_id);
+      bind_const_locs(ctx, sprog, id);
+      next_ubo_id = bind_ubo_locs(sprog, id, next_ubo_id);
+      bind_image_locs(sprog, id);
+      bind_ssbo_locs(sprog, id);
+   }
+
+   if (!has_feature(feat_gles31_vertex_attrib_binding)) {
+      if (vs->sel->sinfo.num_inputs) {
+         sprog->attrib_locs = calloc(vs->sel->sinfo.num_inputs, sizeof(uint32_t));
+         if (sprog->attrib_locs) {
+            for (i = 0; i < vs->sel->sinfo.num_inputs; i++) {
+               snprintf(name, 32, "in_%d", i);
+               sprog->attrib_locs[i] = glGetAttribLocation(vs_id, name);
+            }
+         }
+      } else
+         sprog->attrib_locs = NULL;
+   }
+
+   if (vs->sel->sinfo.num_ucp) {
+      for (i = 0; i < vs->sel->sinfo.num_ucp; i++) {
+         snprintf(name, 32, "clipp[%d]", i);
+         sprog->clip_locs[i] = glGetUniformLocation(vs_id, name);
+      }
+   }
+}
+
+/* Completes a background link.  Returns false if the link failed, in which
+ * case the caller must destroy the program. */
+static bool vrend_finish_program_link(struct vrend_context *ctx,
+                                      struct vrend_linked_shader_program *sprog)
+{
+   bool linked;
+
+   if (sprog->link_job) {
+      linked = vrend_compile_job_wait(sprog->link_job);
+      vrend_compile_job_release(&sprog->link_job);
+   } else if (sprog->link_pending) {
+      GLint status;
+
+      glGetProgramiv(sprog->id, GL_LINK_STATUS, &status);
+      sprog->link_pending = false;
+      linked = status == GL_TRUE;
+   } else
+      return true;
+
+   if (!linked)
+      return false;
+
+   if (sprog->binary_hash) {
+      vrend_program_cache_store(sprog->id, sprog->binary_hash);
+      sprog->binary_hash = 0;
+   }
+   vrend_setup_linked_program(ctx, sprog);
+   return true;
+}
+
+/* Returns true if prog can be used for the current draw or dispatch.  A
+ * program still linking in the background is waited for, unless the
+ * skip-until-ready policy is set, in which case *dirty is set so the next
+ * draw checks again.  A program that failed to link is destroyed. */
+static bool vrend_shader_program_ready(struct vrend_context *ctx,
+                                       struct vrend_linked_shader_program *prog,
+                                       bool *dirty)
+{
+   struct vrend_state *state = ctx->client->vrend_state;
+   GLint done = GL_TRUE;
+
+   if (prog->link_job)
+      done = vrend_compile_job_done(prog->link_job);
+   else if (prog->link_pending)
+      glGetProgramiv(prog->id, GL_COMPLETION_STATUS_KHR, &done);
+   else
+      return true;
+
+   if (!done) {
+      state->stalled_draws++;
+      if (state->compile_skip_until_ready) {
+         *dirty = true;
+         return false;
       }
    }
-   sprog->images_used_mask[id] = mask;
+
+   if (!vrend_finish_program_link(ctx, prog)) {
+      vrend_destroy_program(prog);
+      return false;
+   }
+   return true;
 }
 
 static struct vrend_linked_shader_program *add_cs_shader_program(struct vrend_context *ctx,
@@ -934,13 +2104,13 @@ static struct vrend_linked_shader_program *add_cs_shader_program(struct vrend_co
 {
    struct vrend_linked_shader_program *sprog = CALLOC_STRUCT(vrend_linked_shader_program);
    GLuint prog_id;
-   GLint lret;
+   if (!sprog)
+      return NULL;
+
    prog_id = glCreateProgram();
    glAttachShader(prog_id, cs->id);
-   glLinkProgram(prog_id);
-
-   glGetProgramiv(prog_id, GL_LINK_STATUS, &lret);
-   if (lret == GL_FALSE) {
+   sprog->id = prog_id;
+   if (!vrend_link_program(ctx, sprog, cs, NULL, NULL, NULL)) {
       glDeleteProgram(prog_id);
       free(sprog);
       return NULL;
@@ -948,16 +2118,232 @@ static struct vrend_linked_shader_program *add_cs_shader_program(struct vrend_co
    sprog->ss[PIPE_SHADER_COMPUTE] = cs;
 
    list_add(&sprog->sl[PIPE_SHADER_COMPUTE], &cs->programs);
-   sprog->id = prog_id;
-   list_addtail(&sprog->head, &ctx->sub->programs);
+   vrend_program_cache_insert(ctx->sub, sprog);
+
+   if (!sprog->link_job && !sprog->link_pending)
+      vrend_setup_linked_program(ctx, sprog);
+   return sprog;
+}
+
+static inline int conv_shader_type(int type)
+{
+   switch (type) {
+   case PIPE_SHADER_VERTEX: return GL_VERTEX_SHADER;
+   case PIPE_SHADER_FRAGMENT: return GL_FRAGMENT_SHADER;
+   case PIPE_SHADER_GEOMETRY: return GL_GEOMETRY_SHADER;
+   case PIPE_SHADER_TESS_CTRL: return GL_TESS_CONTROL_SHADER;
+   case PIPE_SHADER_TESS_EVAL: return GL_TESS_EVALUATION_SHADER;
+   case PIPE_SHADER_COMPUTE: return GL_COMPUTE_SHADER;
+   default:
+      return 0;
+   }
+}
+
+/* Identifies the interpolation a fragment shader reads its inputs with,
+ * which vrend_patch_vertex_shader_interpolants() writes into the outputs
+ * of the stage before it. */
+static uint64_t vrend_interp_key(struct vrend_shader *fs)
+{
+   const struct vrend_shader_info *fs_info = &fs->sel->sinfo;
+   uint64_t key;
+
+   key = vrend_program_cache_hash_data(0, &fs->key.flatshade, sizeof(fs->key.flatshade));
+   key = vrend_program_cache_hash_data(key, &fs_info->glsl_ver, sizeof(fs_info->glsl_ver));
+   key = vrend_program_cache_hash_data(key, &fs_info->has_sample_input, sizeof(fs_info->has_sample_input));
+   key = vrend_program_cache_hash_data(key, &fs_info->num_interps, sizeof(fs_info->num_interps));
+   if (fs_info->interpinfo)
+      key = vrend_program_cache_hash_data(key, fs_info->interpinfo,
+                                          fs_info->num_interps * sizeof(*fs_info->interpinfo));
+   return key;
+}
+
+/* Returns the last vertex stage with its outputs patched to the
+ * interpolation fs reads them with.  Each interpolation gets its own copy
+ * of the stage, compiled once and kept with the stage, so pairing it with
+ * fragment shaders in turn does not recompile it; the stage itself keeps
+ * its unpatched source. */
+static struct vrend_shader *vrend_interp_variant(struct vrend_context *ctx,
+                                                 struct vrend_shader *shader,
+                                                 struct vrend_shader *fs)
+{
+   struct vrend_shader *variant;
+   const char *oprefix;
+   uint64_t key;
+
+   if (!fs->sel->sinfo.interpinfo)
+      return shader;
+
+   key = vrend_interp_key(fs);
+   for (variant = shader->interp_variants; variant; variant = variant->next_variant) {
+      if (variant->interp_key == key)
+         return variant;
+   }
+
+   variant = CALLOC_STRUCT(vrend_shader);
+   if (!variant)
+      return NULL;
+   if (!strarray_dup(&variant->glsl_strings, &shader->glsl_strings)) {
+      free(variant);
+      return NULL;
+   }
+   variant->sel = shader->sel;
+   variant->key = shader->key;
+   variant->interp_key = key;
+   list_inithead(&variant->programs);
+
+   oprefix = shader->sel->type == PIPE_SHADER_TESS_EVAL ? "teo" : "vso";
+   vrend_patch_vertex_shader_interpolants(ctx, &ctx->shader_cfg, &variant->glsl_strings,
+                                          &shader->sel->sinfo,
+                                          &fs->sel->sinfo, oprefix, fs->key.flatshade);
+
+   variant->id = glCreateShader(conv_shader_type(shader->sel->type));
+   if (!vrend_compile_shader(ctx, variant)) {
+      glDeleteShader(variant->id);
+      strarray_free(&variant->glsl_strings, true);
+      free(variant);
+      return NULL;
+   }
+
+   variant->next_variant = shader->interp_variants;
+   shader->interp_variants = variant;
+   return variant;
+}
+
+/* Identifies the separable program a fragment shader needs in a VS + FS
+ * pipeline: it numbers its samplers and uniform blocks after the vertex
+ * shader's, as vrend_draw_bind_objects() binds them.  The vertex side is
+ * told apart by its interpolation variant. */
+static uint64_t vrend_separable_fs_key(struct vrend_shader *vs)
+{
+   const struct vrend_shader_info *vs_info = &vs->sel->sinfo;
+   uint32_t units[2] = {
+      util_bitcount(vs_info->samplers_used_mask),
+      has_feature(feat_ubo) ? util_bitcount(vs_info->ubo_used_mask) : 0,
+   };
+
+   return vrend_program_cache_hash_data(0, units, sizeof(units));
+}
+
+static struct vrend_separable_program *vrend_separable_program_find(struct vrend_shader *shader,
+                                                                    uint64_t key)
+{
+   struct vrend_separable_program *stage;
+
+   for (stage = shader->separable; stage; stage = stage->next) {
+      if (stage->key == key)
+         return stage;
+   }
+   return NULL;
+}
+
+/* Links the shader as it is compiled now into a separable program, which
+ * keeps that executable when the shader is patched again later. */
+static struct vrend_separable_program *vrend_separable_program_create(struct vrend_shader *shader,
+                                                                      uint64_t key)
+{
+   static const char tag[] = "separable";
+   struct vrend_separable_program *stage = CALLOC_STRUCT(vrend_separable_program);
+   uint64_t hash = 0;
+   GLint lret;
+   char name[64];
+   int i;
+
+   if (!stage)
+      return NULL;
+
+   stage->id = glCreateProgram();
+   stage->key = key;
+   glProgramParameteri(stage->id, GL_PROGRAM_SEPARABLE, GL_TRUE);
+   glAttachShader(stage->id, shader->id);
+
+   if (shader->sel->type == PIPE_SHADER_VERTEX && has_feature(feat_gles31_vertex_attrib_binding)) {
+      uint32_t mask = shader->sel->sinfo.attrib_input_mask;
+      while (mask) {
+         i = u_bit_scan(&mask);
+         snprintf(name, 32, "in_%d", i);
+         glBindAttribLocation(stage->id, i, name);
+      }
+   }
+
+   if (vrend_program_cache_enabled()) {
+      hash = vrend_program_cache_hash_begin();
+      hash = vrend_program_cache_hash_data(hash, tag, sizeof(tag));
+      hash = vrend_program_cache_hash_data(hash, &shader->sel->type, sizeof(shader->sel->type));
+      hash = vrend_program_cache_hash_strings(hash, &shader->glsl_strings);
+
+      if (vrend_program_cache_load(stage->id, hash))
+         goto done;
+
+      glProgramParameteri(stage->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   }
+
+   if (shader->compile_job)
+      vrend_compile_job_wait(shader->compile_job);
+
+   {
+      NATIVE_TRACE_SCOPE("vrend_link_program");
+      glLinkProgram(stage->id);
+      glGetProgramiv(stage->id, GL_LINK_STATUS, &lret);
+   }
+   if (lret == GL_FALSE) {
+      glDeleteProgram(stage->id);
+      free(stage);
+      return NULL;
+   }
+
+   if (hash)
+      vrend_program_cache_store(stage->id, hash);
+
+done:
+   stage->next = shader->separable;
+   shader->separable = stage;
+   return stage;
+}
+
+/* Separable mode: a VS + FS pair becomes a program pipeline of the two
+ * stages' separable programs; only a stage not linked for the same key
+ * before, which is rare compared to new pairs, still costs a link. */
+static struct vrend_linked_shader_program *add_separable_shader_program(struct vrend_context *ctx,
+                                                                        struct vrend_shader *vs,
+                                                                        struct vrend_shader *fs)
+{
+   struct vrend_linked_shader_program *sprog;
+   struct vrend_separable_program *vs_stage, *fs_stage;
+   struct vrend_shader *vs_code = vrend_interp_variant(ctx, vs, fs);
+   uint64_t fs_key = vrend_separable_fs_key(vs);
+
+   if (!vs_code)
+      return NULL;
+
+   vs_stage = vrend_separable_program_find(vs_code, 0);
+   if (!vs_stage)
+      vs_stage = vrend_separable_program_create(vs_code, 0);
+
+   fs_stage = vrend_separable_program_find(fs, fs_key);
+   if (!fs_stage)
+      fs_stage = vrend_separable_program_create(fs, fs_key);
+
+   if (!vs_stage || !fs_stage)
+      return NULL;
+
+   sprog = CALLOC_STRUCT(vrend_linked_shader_program);
+   if (!sprog)
+      return NULL;
+
+   glGenProgramPipelines(1, &sprog->pipeline);
+   glUseProgramStages(sprog->pipeline, GL_VERTEX_SHADER_BIT, vs_stage->id);
+   glUseProgramStages(sprog->pipeline, GL_FRAGMENT_SHADER_BIT, fs_stage->id);
+   sprog->stages[PIPE_SHADER_VERTEX] = vs_stage;
+   sprog->stages[PIPE_SHADER_FRAGMENT] = fs_stage;
+   sprog->active_stage = -1;
 
-   vrend_use_program(ctx, prog_id);
+   sprog->ss[PIPE_SHADER_VERTEX] = vs;
+   sprog->ss[PIPE_SHADER_FRAGMENT] = fs;
+   list_add(&sprog->sl[PIPE_SHADER_VERTEX], &vs->programs);
+   list_add(&sprog->sl[PIPE_SHADER_FRAGMENT], &fs->programs);
 
-   bind_sampler_locs(sprog, PIPE_SHADER_COMPUTE, 0);
-   bind_ubo_locs(sprog, PIPE_SHADER_COMPUTE, 0);
-   bind_ssbo_locs(sprog, PIPE_SHADER_COMPUTE);
-   bind_const_locs(sprog, PIPE_SHADER_COMPUTE);
-   bind_image_locs(sprog, PIPE_SHADER_COMPUTE);
+   vrend_program_cache_insert(ctx->sub, sprog);
+   vrend_setup_linked_program(ctx, sprog);
    return sprog;
 }
 
@@ -968,60 +2354,39 @@ static struct vrend_linked_shader_program *add_shader_program(struct vrend_conte
                                                               struct vrend_shader *tcs,
                                                               struct vrend_shader *tes)
 {
-   struct vrend_linked_shader_program *sprog = CALLOC_STRUCT(vrend_linked_shader_program);
+   struct vrend_linked_shader_program *sprog;
+   struct vrend_shader *vs_code = vs, *tes_code = tes;
    char name[64];
    int i;
    GLuint prog_id;
-   GLint lret;
-   int id;
-   int last_shader;
-   bool do_patch = false;
-   if (!sprog)
-      return NULL;
 
-   /* need to rewrite VS code to add interpolation params */
-   if (gs && gs->compiled_fs_id != fs->id)
-      do_patch = true;
-   if (!gs && tes && tes->compiled_fs_id != fs->id)
-      do_patch = true;
-   if (!gs && !tes && vs->compiled_fs_id != fs->id)
-      do_patch = true;
-
-   if (do_patch) {
-      bool ret;
-
-      if (gs)
-         vrend_patch_vertex_shader_interpolants(ctx, &ctx->shader_cfg, &gs->glsl_strings,
-                                                &gs->sel->sinfo,
-                                                &fs->sel->sinfo, "gso", fs->key.flatshade);
-      else if (tes)
-         vrend_patch_vertex_shader_interpolants(ctx, &ctx->shader_cfg, &tes->glsl_strings,
-                                                &tes->sel->sinfo,
-                                                &fs->sel->sinfo, "teo", fs->key.flatshade);
-      else
-         vrend_patch_vertex_shader_interpolants(ctx, &ctx->shader_cfg, &vs->glsl_strings,
-                                                &vs->sel->sinfo,
-                                                &fs->sel->sinfo, "vso", fs->key.flatshade);
-      ret = vrend_compile_shader(ctx, gs ? gs : (tes ? tes : vs));
-      if (ret == false) {
-         glDeleteShader(gs ? gs->id : (tes ? tes->id : vs->id));
-         free(sprog);
-         return NULL;
-      }
-      if (gs)
-         gs->compiled_fs_id = fs->id;
-      else if (tes)
-         tes->compiled_fs_id = fs->id;
-      else
-         vs->compiled_fs_id = fs->id;
+   /* a pair that does not link separably is linked the usual way, the
+    * program cache then finds that one */
+   if (ctx->client->vrend_state->separable_programs && !gs && !tcs && !tes) {
+      sprog = add_separable_shader_program(ctx, vs, fs);
+      if (sprog)
+         return sprog;
    }
 
+   /* the geometry shader is not part of linked programs, the stage feeding
+    * the fragment shader is the tessellation or vertex shader */
+   if (tes && tes->id > 0)
+      tes_code = vrend_interp_variant(ctx, tes, fs);
+   else
+      vs_code = vrend_interp_variant(ctx, vs, fs);
+   if (!vs_code || !tes_code)
+      return NULL;
+
+   sprog = CALLOC_STRUCT(vrend_linked_shader_program);
+   if (!sprog)
+      return NULL;
+
    prog_id = glCreateProgram();
-   glAttachShader(prog_id, vs->id);
+   glAttachShader(prog_id, vs_code->id);
    if (tcs && tcs->id > 0)
       glAttachShader(prog_id, tcs->id);
    if (tes && tes->id > 0)
-      glAttachShader(prog_id, tes->id);
+      glAttachShader(prog_id, tes_code->id);
 
    glAttachShader(prog_id, fs->id);
 
@@ -1036,10 +2401,11 @@ static struct vrend_linked_shader_program *add_shader_program(struct vrend_conte
       }
    }
 
-   glLinkProgram(prog_id);
-
-   glGetProgramiv(prog_id, GL_LINK_STATUS, &lret);
-   if (lret == GL_FALSE) {
+   sprog->id = prog_id;
+   if (!vrend_link_program(ctx, sprog, vs_code,
+                           tcs && tcs->id > 0 ? tcs : NULL,
+                           tes && tes->id > 0 ? tes_code : NULL,
+                           fs)) {
       glDeleteProgram(prog_id);
       free(sprog);
       return NULL;
@@ -1060,64 +2426,21 @@ static struct vrend_linked_shader_program *add_shader_program(struct vrend_conte
    if (tes)
       list_add(&sprog->sl[PIPE_SHADER_TESS_EVAL], &tes->programs);
 
-   last_shader = tes ? PIPE_SHADER_TESS_EVAL : (gs ? PIPE_SHADER_GEOMETRY : PIPE_SHADER_FRAGMENT);
-   sprog->id = prog_id;
-
-   list_addtail(&sprog->head, &ctx->sub->programs);
-
-   if (fs->key.pstipple_tex)
-      sprog->fs_stipple_loc = glGetUniformLocation(prog_id, "pstipple_sampler");
-   else
-      sprog->fs_stipple_loc = -1;
-   sprog->vs_ws_adjust_loc = glGetUniformLocation(prog_id, "winsys_adjust_y");
-
-   vrend_use_program(ctx, prog_id);
-
-   int next_ubo_id = 0, next_sampler_id = 0;
-   for (id = PIPE_SHADER_VERTEX; id <= last_shader; id++) {
-      if (!sprog->ss[id])
-         continue;
-
-      next_sampler_id = bind_sampler_locs(sprog, id, next_sampler_id);
-      bind_const_locs(sprog, id);
-      next_ubo_id = bind_ubo_locs(sprog, id, next_ubo_id);
-      bind_image_locs(sprog, id);
-      bind_ssbo_locs(sprog, id);
-   }
-
-   if (!has_feature(feat_gles31_vertex_attrib_binding)) {
-      if (vs->sel->sinfo.num_inputs) {
-         sprog->attrib_locs = calloc(vs->sel->sinfo.num_inputs, sizeof(uint32_t));
-         if (sprog->attrib_locs) {
-            for (i = 0; i < vs->sel->sinfo.num_inputs; i++) {
-               snprintf(name, 32, "in_%d", i);
-               sprog->attrib_locs[i] = glGetAttribLocation(prog_id, name);
-            }
-         }
-      } else
-         sprog->attrib_locs = NULL;
-   }
+   vrend_program_cache_insert(ctx->sub, sprog);
 
-   if (vs->sel->sinfo.num_ucp) {
-      for (i = 0; i < vs->sel->sinfo.num_ucp; i++) {
-         snprintf(name, 32, "clipp[%d]", i);
-         sprog->clip_locs[i] = glGetUniformLocation(prog_id, name);
-      }
-   }
+   if (!sprog->link_job && !sprog->link_pending)
+      vrend_setup_linked_program(ctx, sprog);
    return sprog;
 }
 
 static struct vrend_linked_shader_program *lookup_cs_shader_program(struct vrend_context *ctx,
                                                                     GLuint cs_id)
 {
-   struct vrend_linked_shader_program *ent;
-   LIST_FOR_EACH_ENTRY(ent, &ctx->sub->programs, head) {
-      if (!ent->ss[PIPE_SHADER_COMPUTE])
-         continue;
-      if (ent->ss[PIPE_SHADER_COMPUTE]->id == cs_id)
-         return ent;
-   }
-   return NULL;
+   struct vrend_linked_program_key key;
+
+   memset(&key, 0, sizeof(key));
+   key.ids[PIPE_SHADER_COMPUTE] = cs_id;
+   return vrend_program_cache_lookup(ctx->sub, &key);
 }
 
 static struct vrend_linked_shader_program *lookup_shader_program(struct vrend_context *ctx,
@@ -1128,28 +2451,16 @@ static struct vrend_linked_shader_program *lookup_shader_program(struct vrend_co
                                                                  GLuint tes_id,
                                                                  bool dual_src)
 {
-   struct vrend_linked_shader_program *ent;
-   LIST_FOR_EACH_ENTRY(ent, &ctx->sub->programs, head) {
-      if (ent->dual_src_linked != dual_src)
-         continue;
-      if (ent->ss[PIPE_SHADER_COMPUTE])
-         continue;
-      if (ent->ss[PIPE_SHADER_VERTEX]->id != vs_id)
-        continue;
-      if (ent->ss[PIPE_SHADER_FRAGMENT]->id != fs_id)
-        continue;
-      if (ent->ss[PIPE_SHADER_GEOMETRY] &&
-          ent->ss[PIPE_SHADER_GEOMETRY]->id != gs_id)
-        continue;
-      if (ent->ss[PIPE_SHADER_TESS_CTRL] &&
-          ent->ss[PIPE_SHADER_TESS_CTRL]->id != tcs_id)
-         continue;
-      if (ent->ss[PIPE_SHADER_TESS_EVAL] &&
-          ent->ss[PIPE_SHADER_TESS_EVAL]->id != tes_id)
-         continue;
-      return ent;
-   }
-   return NULL;
+   struct vrend_linked_program_key key;
+
+   memset(&key, 0, sizeof(key));
+   key.ids[PIPE_SHADER_VERTEX] = vs_id;
+   key.ids[PIPE_SHADER_FRAGMENT] = fs_id;
+   key.ids[PIPE_SHADER_GEOMETRY] = gs_id;
+   key.ids[PIPE_SHADER_TESS_CTRL] = tcs_id;
+   key.ids[PIPE_SHADER_TESS_EVAL] = tes_id;
+   key.dual_src = dual_src;
+   return vrend_program_cache_lookup(ctx->sub, &key);
 }
 
 static void vrend_destroy_program(struct vrend_linked_shader_program *ent)
@@ -1158,8 +2469,21 @@ static void vrend_destroy_program(struct vrend_linked_shader_program *ent)
    if (ent->ref_context && ent->ref_context->prog == ent)
       ent->ref_context->prog = NULL;
 
-   glDeleteProgram(ent->id);
+   vrend_compile_job_release(&ent->link_job);
+   if (ent->sub)
+      vrend_delete_later(ent->sub->state, VREND_DELETE_PROGRAM, ent->id, ent->sub->state->next_fence_id);
+   else
+      glDeleteProgram(ent->id);
+   if (ent->pipeline) {
+      if (ent->sub && ent->sub->pipeline_id == ent->pipeline)
+         ent->sub->pipeline_id = 0;
+      glDeleteProgramPipelines(1, &ent->pipeline);
+   }
    list_del(&ent->head);
+   if (ent->sub) {
+      util_hash_table_remove(ent->sub->program_hash, &ent->key);
+      ent->sub->num_programs--;
+   }
 
    for (i = PIPE_SHADER_VERTEX; i <= PIPE_SHADER_COMPUTE; i++) {
       if (ent->ss[i])
@@ -1212,6 +2536,7 @@ int vrend_create_surface(struct vrend_context *ctx,
    res = vrend_renderer_ctx_res_lookup(ctx, res_handle);
    if (!res)
       return EINVAL;
+   vrend_resource_ensure_storage(res);
 
    surf = CALLOC_STRUCT(vrend_surface);
    if (!surf)
@@ -1290,16 +2615,26 @@ static void vrend_destroy_vertex_elements_object(void *obj_ptr)
    if (has_feature(feat_gles31_vertex_attrib_binding)) {
       glDeleteVertexArrays(1, &v->id);
    }
-   FREE(v);
+   vrend_slab_free(v);
+}
+
+static void vrend_sampler_entry_unref(struct vrend_sampler_entry *entry)
+{
+   if (entry && --entry->refcount == 0)
+      util_hash_table_remove(entry->cache, &entry->key);
 }
 
 static void vrend_destroy_sampler_state_object(void *obj_ptr)
 {
    struct vrend_sampler_state *state = obj_ptr;
 
-   if (has_feature(feat_samplers))
-      glDeleteSamplers(2, state->ids);
-   FREE(state);
+   vrend_sampler_entry_unref(state->entry);
+   vrend_slab_free(state);
+}
+
+static void vrend_destroy_slab_object(void *obj_ptr)
+{
+   vrend_slab_free(obj_ptr);
 }
 
 static GLuint convert_wrap(int wrap)
@@ -1346,58 +2681,206 @@ static inline GLenum convert_min_filter(unsigned int filter, unsigned int mip_fi
    return 0;
 }
 
+static unsigned vrend_sampler_key_hash(void *key)
+{
+   return cso_construct_key(key, sizeof(struct vrend_sampler_key));
+}
+
+static int vrend_sampler_key_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct vrend_sampler_key));
+}
+
+static void vrend_sampler_entry_destroy(void *value)
+{
+   struct vrend_sampler_entry *entry = value;
+
+   glDeleteSamplers(2, entry->ids);
+   vrend_shadow_textures_clobbered();
+   FREE(entry);
+}
+
+static void vrend_sampler_key_build(const struct pipe_sampler_state *templ,
+                                    struct vrend_sampler_key *key)
+{
+   /* the decoder leaves the fields GL samplers do not use uninitialized */
+   memset(key, 0, sizeof(*key));
+   key->wrap_s = templ->wrap_s;
+   key->wrap_t = templ->wrap_t;
+   key->wrap_r = templ->wrap_r;
+   key->min_img_filter = templ->min_img_filter;
+   key->min_mip_filter = templ->min_mip_filter;
+   key->mag_img_filter = templ->mag_img_filter;
+   key->compare_func = templ->compare_func;
+   key->min_lod = templ->min_lod;
+   key->max_lod = templ->max_lod;
+   memcpy(key->border_color, templ->border_color.ui, sizeof(key->border_color));
+}
+
+/* guests create a sampler state per texture bind point, most of them
+ * equal, share one GL sampler pair between all of those */
+static struct vrend_sampler_entry *vrend_sampler_cache_get(struct vrend_context *ctx,
+                                                           const struct pipe_sampler_state *templ)
+{
+   struct vrend_state *vstate = ctx->client->vrend_state;
+   struct vrend_sampler_entry *entry;
+   struct vrend_sampler_key key;
+
+   if (!vstate->sampler_cache) {
+      vstate->sampler_cache = util_hash_table_create(vrend_sampler_key_hash,
+                                                     vrend_sampler_key_compare,
+                                                     vrend_sampler_entry_destroy);
+      if (!vstate->sampler_cache)
+         return NULL;
+   }
+
+   vrend_sampler_key_build(templ, &key);
+   entry = util_hash_table_get(vstate->sampler_cache, &key);
+   if (entry) {
+      entry->refcount++;
+      return entry;
+   }
+
+   entry = CALLOC_STRUCT(vrend_sampler_entry);
+   if (!entry)
+      return NULL;
+   entry->key = key;
+   entry->cache = vstate->sampler_cache;
+   entry->refcount = 1;
+
+   glGenSamplers(2, entry->ids);
+   for (int i = 0; i < 2; ++i) {
+      glSamplerParameteri(entry->ids[i], GL_TEXTURE_WRAP_S, convert_wrap(templ->wrap_s));
+      glSamplerParameteri(entry->ids[i], GL_TEXTURE_WRAP_T, convert_wrap(templ->wrap_t));
+      glSamplerParameteri(entry->ids[i], GL_TEXTURE_WRAP_R, convert_wrap(templ->wrap_r));
+      glSamplerParameterf(entry->ids[i], GL_TEXTURE_MIN_FILTER, convert_min_filter(templ->min_img_filter, templ->min_mip_filter));
+      glSamplerParameterf(entry->ids[i], GL_TEXTURE_MAG_FILTER, convert_mag_filter(templ->mag_img_filter));
+      glSamplerParameterf(entry->ids[i], GL_TEXTURE_MIN_LOD, templ->min_lod);
+      glSamplerParameterf(entry->ids[i], GL_TEXTURE_MAX_LOD, templ->max_lod);
+      glSamplerParameteri(entry->ids[i], GL_TEXTURE_COMPARE_FUNC, GL_NEVER + templ->compare_func);
+      glSamplerParameterIuiv(entry->ids[i], GL_TEXTURE_BORDER_COLOR, key.border_color);
+      glSamplerParameteri(entry->ids[i], GL_TEXTURE_SRGB_DECODE_EXT, i == 0 ? GL_SKIP_DECODE_EXT : GL_DECODE_EXT);
+      memcpy(entry->border_color[i], key.border_color, sizeof(key.border_color));
+   }
+
+   if (util_hash_table_set(vstate->sampler_cache, &entry->key, entry) != PIPE_OK) {
+      vrend_sampler_entry_destroy(entry);
+      return NULL;
+   }
+   return entry;
+}
+
 int vrend_create_sampler_state(struct vrend_context *ctx,
                                uint32_t handle,
                                struct pipe_sampler_state *templ)
 {
-   struct vrend_sampler_state *state = CALLOC_STRUCT(vrend_sampler_state);
+   struct vrend_sampler_state *state = vrend_renderer_object_alloc(ctx, VIRGL_OBJECT_SAMPLER_STATE);
    int ret_handle;
 
    if (!state)
       return ENOMEM;
 
    state->base = *templ;
+   state->entry = NULL;
 
    if (has_feature(feat_samplers)) {
-      glGenSamplers(2, state->ids);
-
-      for (int i = 0; i < 2; ++i) {
-         glSamplerParameteri(state->ids[i], GL_TEXTURE_WRAP_S, convert_wrap(templ->wrap_s));
-         glSamplerParameteri(state->ids[i], GL_TEXTURE_WRAP_T, convert_wrap(templ->wrap_t));
-         glSamplerParameteri(state->ids[i], GL_TEXTURE_WRAP_R, convert_wrap(templ->wrap_r));
-         glSamplerParameterf(state->ids[i], GL_TEXTURE_MIN_FILTER, convert_min_filter(templ->min_img_filter, templ->min_mip_filter));
-         glSamplerParameterf(state->ids[i], GL_TEXTURE_MAG_FILTER, convert_mag_filter(templ->mag_img_filter));
-         glSamplerParameterf(state->ids[i], GL_TEXTURE_MIN_LOD, templ->min_lod);
-         glSamplerParameterf(state->ids[i], GL_TEXTURE_MAX_LOD, templ->max_lod);
-         glSamplerParameteri(state->ids[i], GL_TEXTURE_COMPARE_FUNC, GL_NEVER + templ->compare_func);
-         glSamplerParameterIuiv(state->ids[i], GL_TEXTURE_BORDER_COLOR, templ->border_color.ui);
-         glSamplerParameteri(state->ids[i], GL_TEXTURE_SRGB_DECODE_EXT, i == 0 ? GL_SKIP_DECODE_EXT : GL_DECODE_EXT);
+      state->entry = vrend_sampler_cache_get(ctx, templ);
+      if (!state->entry) {
+         vrend_slab_free(state);
+         return ENOMEM;
       }
    }
    ret_handle = vrend_renderer_object_insert(ctx, state, sizeof(struct vrend_sampler_state), handle,
                                              VIRGL_OBJECT_SAMPLER_STATE);
    if (!ret_handle) {
-      if (has_feature(feat_samplers))
-         glDeleteSamplers(2, state->ids);
-      FREE(state);
+      vrend_sampler_entry_unref(state->entry);
+      vrend_slab_free(state);
       return ENOMEM;
    }
-   return 0;
-}
+   return 0;
+}
+
+static inline GLenum to_gl_swizzle(int swizzle)
+{
+   switch (swizzle) {
+   case PIPE_SWIZZLE_RED: return GL_RED;
+   case PIPE_SWIZZLE_GREEN: return GL_GREEN;
+   case PIPE_SWIZZLE_BLUE: return GL_BLUE;
+   case PIPE_SWIZZLE_ALPHA: return GL_ALPHA;
+   case PIPE_SWIZZLE_ZERO: return GL_ZERO;
+   case PIPE_SWIZZLE_ONE: return GL_ONE;
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
+/* Gives the view a texture of its own holding its swizzle, levels, layers
+ * and depth/stencil mode, so views of one texture that alternate leave the
+ * shared texture object alone and binding them costs no revalidation.
+ * Views of mutable storage, another internal format or target keep
+ * patching the texture, see vrend_set_single_sampler_view.  Without
+ * sampler objects the filtering lives on the texture object and is
+ * tracked per resource, so that path is kept as well. */
+static void vrend_sampler_view_create_texture_view(struct vrend_sampler_view *view)
+{
+   struct vrend_resource *res = view->texture;
+   GLuint base_level = view->val1 & 0xff;
+   GLuint max_level = (view->val1 >> 8) & 0xff;
+   GLuint first_layer = 0, num_layers = 1;
+   GLuint id;
+
+   if (!texture_view || !has_feature(feat_samplers) ||
+       !has_bit(res->storage_bits, VREND_STORAGE_GL_TEXTURE) ||
+       !has_bit(res->storage_bits, VREND_STORAGE_GL_IMMUTABLE) ||
+       view->target != res->target ||
+       tex_conv_table[view->format].internalformat != tex_conv_table[res->base.format].internalformat)
+      return;
+
+   if (max_level > res->base.last_level)
+      max_level = res->base.last_level;
+   if (res->base.nr_samples > 0)
+      base_level = max_level = 0;
+   if (base_level > max_level)
+      return;
+
+   switch (view->target) {
+   case GL_TEXTURE_1D_ARRAY:
+   case GL_TEXTURE_2D_ARRAY:
+   case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+   case GL_TEXTURE_CUBE_MAP_ARRAY:
+      first_layer = view->val0 & 0xffff;
+      num_layers = ((view->val0 >> 16) & 0xffff) + 1;
+      if (num_layers <= first_layer || num_layers > res->base.array_size)
+         return;
+      num_layers -= first_layer;
+      if (view->target == GL_TEXTURE_CUBE_MAP_ARRAY && num_layers % 6)
+         return;
+      break;
+   case GL_TEXTURE_CUBE_MAP:
+      num_layers = 6;
+      break;
+   default:
+      break;
+   }
 
-static inline GLenum to_gl_swizzle(int swizzle)
-{
-   switch (swizzle) {
-   case PIPE_SWIZZLE_RED: return GL_RED;
-   case PIPE_SWIZZLE_GREEN: return GL_GREEN;
-   case PIPE_SWIZZLE_BLUE: return GL_BLUE;
-   case PIPE_SWIZZLE_ALPHA: return GL_ALPHA;
-   case PIPE_SWIZZLE_ZERO: return GL_ZERO;
-   case PIPE_SWIZZLE_ONE: return GL_ONE;
-   default:
-      assert(0);
-      return 0;
+   glGenTextures(1, &id);
+   texture_view(id, view->target, res->id, tex_conv_table[view->format].internalformat,
+                base_level, max_level - base_level + 1, first_layer, num_layers);
+   glBindTexture(view->target, id);
+   vrend_shadow_textures_bound(res->state);
+
+   if (util_format_is_depth_or_stencil(view->format) && has_feature(feat_stencil_texturing)) {
+      const struct util_format_description *desc = util_format_description(view->format);
+      glTexParameteri(view->target, GL_DEPTH_STENCIL_TEXTURE_MODE,
+                      util_format_has_depth(desc) ? GL_DEPTH_COMPONENT : GL_STENCIL_INDEX);
    }
+   glTexParameteri(view->target, GL_TEXTURE_SWIZZLE_R, view->gl_swizzle_r);
+   glTexParameteri(view->target, GL_TEXTURE_SWIZZLE_G, view->gl_swizzle_g);
+   glTexParameteri(view->target, GL_TEXTURE_SWIZZLE_B, view->gl_swizzle_b);
+   glTexParameteri(view->target, GL_TEXTURE_SWIZZLE_A, view->gl_swizzle_a);
+
+   view->id = id;
 }
 
 int vrend_create_sampler_view(struct vrend_context *ctx,
@@ -1413,6 +2896,7 @@ int vrend_create_sampler_view(struct vrend_context *ctx,
    res = vrend_renderer_ctx_res_lookup(ctx, res_handle);
    if (!res)
       return EINVAL;
+   vrend_resource_ensure_storage(res);
 
    view = CALLOC_STRUCT(vrend_sampler_view);
    if (!view)
@@ -1483,6 +2967,8 @@ int vrend_create_sampler_view(struct vrend_context *ctx,
    view->gl_swizzle_b = to_gl_swizzle(swizzle[2]);
    view->gl_swizzle_a = to_gl_swizzle(swizzle[3]);
 
+   vrend_sampler_view_create_texture_view(view);
+
    ret_handle = vrend_renderer_object_insert(ctx, view, sizeof(*view), handle, VIRGL_OBJECT_SAMPLER_VIEW);
    if (ret_handle == 0) {
       FREE(view);
@@ -1499,6 +2985,8 @@ void vrend_fb_bind_texture_id(struct vrend_resource *res,
    const struct util_format_description *desc = util_format_description(res->base.format);
    GLenum attachment = GL_COLOR_ATTACHMENT0 + idx;
 
+   vrend_resource_ensure_storage(res);
+
    if (vrend_format_is_ds(res->base.format)) {
       if (util_format_has_stencil(desc)) {
          if (util_format_has_depth(desc))
@@ -1640,18 +3128,98 @@ static void vrend_hw_emit_framebuffer_state(struct vrend_context *ctx)
    glDrawBuffers(ctx->sub->nr_cbufs, buffers);
 }
 
+static void vrend_fb_cache_evict(struct vrend_fb_cache_entry *entry)
+{
+   int i;
+
+   if (!entry->id)
+      return;
+
+   glDeleteFramebuffers(1, &entry->id);
+   entry->id = 0;
+   vrend_surface_reference(&entry->zsurf, NULL);
+   for (i = 0; i < entry->nr_cbufs; i++)
+      vrend_surface_reference(&entry->surf[i], NULL);
+   entry->nr_cbufs = 0;
+}
+
+/* The cache holds references to its surfaces, a surface the guest destroys
+ * would only be released once its framebuffers are evicted. */
+static void vrend_fb_cache_evict_surface(struct vrend_sub_context *sub, struct vrend_surface *surf)
+{
+   int i, j;
+
+   for (i = 0; i < VREND_FB_CACHE_SIZE; i++) {
+      struct vrend_fb_cache_entry *entry = &sub->fb_cache[i];
+      bool uses_surf = entry->zsurf == surf;
+
+      /* the bound one goes once the guest binds another set */
+      if (!entry->id || entry->id == sub->fb_id)
+         continue;
+      for (j = 0; j < entry->nr_cbufs; j++)
+         uses_surf |= entry->surf[j] == surf;
+      if (uses_surf)
+         vrend_fb_cache_evict(entry);
+   }
+}
+
+/* Binds the framebuffer object with the current attachments of the sub
+ * context, replacing the least recently used one if there is none yet. */
+static void vrend_fb_cache_bind(struct vrend_context *ctx)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   struct vrend_fb_cache_entry *entry = NULL;
+   int i;
+
+   if (sub->nr_cbufs == 0 && !sub->zsurf) {
+      sub->fb_id = sub->base_fb_id;
+      glBindFramebuffer(GL_FRAMEBUFFER, sub->fb_id);
+      return;
+   }
+
+   for (i = 0; i < VREND_FB_CACHE_SIZE; i++) {
+      struct vrend_fb_cache_entry *e = &sub->fb_cache[i];
+
+      if (e->id && e->nr_cbufs == sub->nr_cbufs && e->zsurf == sub->zsurf &&
+          !memcmp(e->surf, sub->surf, sub->nr_cbufs * sizeof(sub->surf[0]))) {
+         e->last_use = ++sub->fb_cache_clock;
+         sub->fb_id = e->id;
+         glBindFramebuffer(GL_FRAMEBUFFER, sub->fb_id);
+         return;
+      }
+      if (!entry || (entry->id && (!e->id || e->last_use < entry->last_use)))
+         entry = e;
+   }
+
+   vrend_fb_cache_evict(entry);
+   glGenFramebuffers(1, &entry->id);
+   entry->last_use = ++sub->fb_cache_clock;
+   entry->nr_cbufs = sub->nr_cbufs;
+   vrend_surface_reference(&entry->zsurf, sub->zsurf);
+   for (i = 0; i < sub->nr_cbufs; i++)
+      vrend_surface_reference(&entry->surf[i], sub->surf[i]);
+
+   sub->fb_id = entry->id;
+   glBindFramebuffer(GL_FRAMEBUFFER, sub->fb_id);
+   if (sub->zsurf)
+      vrend_hw_set_zsurf_texture(ctx);
+   for (i = 0; i < sub->nr_cbufs; i++) {
+      if (sub->surf[i])
+         vrend_hw_set_color_surface(ctx, i);
+   }
+}
+
 void vrend_set_framebuffer_state(struct vrend_context *ctx,
                                  uint32_t nr_cbufs, uint32_t surf_handle[PIPE_MAX_COLOR_BUFS],
                                  uint32_t zsurf_handle)
 {
+   struct vrend_surface *surfs[PIPE_MAX_COLOR_BUFS];
    struct vrend_surface *surf, *zsurf;
    int i;
    int old_num;
    GLint new_height = -1;
    bool new_ibf = false;
 
-   glBindFramebuffer(GL_FRAMEBUFFER, ctx->sub->fb_id);
-
    if (zsurf_handle) {
       zsurf = vrend_object_lookup(ctx->sub->object_hash, zsurf_handle, VIRGL_OBJECT_SURFACE);
       if (!zsurf)
@@ -1659,35 +3227,27 @@ void vrend_set_framebuffer_state(struct vrend_context *ctx,
    } else
       zsurf = NULL;
 
-   if (ctx->sub->zsurf != zsurf) {
-      vrend_surface_reference(&ctx->sub->zsurf, zsurf);
-      vrend_hw_set_zsurf_texture(ctx);
+   for (i = 0; i < (int)nr_cbufs; i++) {
+      if (surf_handle[i] != 0) {
+         surfs[i] = vrend_object_lookup(ctx->sub->object_hash, surf_handle[i], VIRGL_OBJECT_SURFACE);
+         if (!surfs[i])
+            return;
+      } else
+         surfs[i] = NULL;
    }
 
+   vrend_surface_reference(&ctx->sub->zsurf, zsurf);
+
    old_num = ctx->sub->nr_cbufs;
    ctx->sub->nr_cbufs = nr_cbufs;
    ctx->sub->old_nr_cbufs = old_num;
 
-   for (i = 0; i < (int)nr_cbufs; i++) {
-      if (surf_handle[i] != 0) {
-         surf = vrend_object_lookup(ctx->sub->object_hash, surf_handle[i], VIRGL_OBJECT_SURFACE);
-         if (!surf)
-            return;
-      } else
-         surf = NULL;
-
-      if (ctx->sub->surf[i] != surf) {
-         vrend_surface_reference(&ctx->sub->surf[i], surf);
-         vrend_hw_set_color_surface(ctx, i);
-      }
-   }
+   for (i = 0; i < (int)nr_cbufs; i++)
+      vrend_surface_reference(&ctx->sub->surf[i], surfs[i]);
+   for (i = nr_cbufs; i < old_num; i++)
+      vrend_surface_reference(&ctx->sub->surf[i], NULL);
 
-   if (old_num > ctx->sub->nr_cbufs) {
-      for (i = ctx->sub->nr_cbufs; i < old_num; i++) {
-         vrend_surface_reference(&ctx->sub->surf[i], NULL);
-         vrend_hw_set_color_surface(ctx, i);
-      }
-   }
+   vrend_fb_cache_bind(ctx);
 
    /* find a buffer to set fb_height from */
    if (ctx->sub->nr_cbufs == 0 && !ctx->sub->zsurf) {
@@ -1815,7 +3375,7 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
    if (num_elements > PIPE_MAX_ATTRIBS)
       return EINVAL;
 
-   v = CALLOC_STRUCT(vrend_vertex_element_array);
+   v = vrend_renderer_object_alloc(ctx, VIRGL_OBJECT_VERTEX_ELEMENTS);
    if (!v)
       return ENOMEM;
 
@@ -1825,7 +3385,7 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
 
       desc = util_format_description(elements[i].src_format);
       if (!desc) {
-         FREE(v);
+         vrend_slab_free(v);
          return EINVAL;
       }
 
@@ -1866,6 +3426,14 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
       else if (elements[i].src_format == PIPE_FORMAT_R11G11B10_FLOAT)
          type = GL_UNSIGNED_INT_10F_11F_11F_REV;
 
+      /* GLES has no 10F_11F_11F_REV attributes, the vertex shader unpacks
+       * the uint */
+      if (type == GL_UNSIGNED_INT_10F_11F_11F_REV &&
+          !vrend_has_gl_extension("GL_ARB_vertex_type_10f_11f_11f_rev")) {
+         type = GL_UNSIGNED_INT;
+         v->r11g11b10_bitmask |= 1u << i;
+      }
+
       if (type == GL_FALSE) {
          FREE(v);
          return EINVAL;
@@ -1875,12 +3443,19 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
       if (desc->channel[0].normalized)
          v->elements[i].norm = GL_TRUE;
 
-      if (desc->nr_channels == 4 && desc->swizzle[0] == UTIL_FORMAT_SWIZZLE_Z)
+      /* GLES has no GL_BGRA size, the vertex shader swaps the channels */
+      if (desc->nr_channels == 4 && desc->swizzle[0] == UTIL_FORMAT_SWIZZLE_Z) {
          v->elements[i].nr_chan = 4;
+         v->zyxw_bitmask |= 1u << i;
+      } else if (v->r11g11b10_bitmask & (1u << i))
+         v->elements[i].nr_chan = 1;
       else if (elements[i].src_format == PIPE_FORMAT_R11G11B10_FLOAT)
          v->elements[i].nr_chan = 3;
       else
          v->elements[i].nr_chan = desc->nr_channels;
+
+      v->elements[i].integer = util_format_is_pure_integer(elements[i].src_format) ||
+                               (v->r11g11b10_bitmask & (1u << i));
    }
 
    if (has_feature(feat_gles31_vertex_attrib_binding)) {
@@ -1889,7 +3464,7 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
       for (i = 0; i < num_elements; i++) {
          struct vrend_vertex_element *ve = &v->elements[i];
 
-         if (util_format_is_pure_integer(ve->base.src_format))
+         if (ve->integer)
             glVertexAttribIFormat(i, ve->nr_chan, ve->type, ve->base.src_offset);
          else
             glVertexAttribFormat(i, ve->nr_chan, ve->type, ve->norm, ve->base.src_offset);
@@ -1901,7 +3476,7 @@ int vrend_create_vertex_elements_state(struct vrend_context *ctx,
    ret_handle = vrend_renderer_object_insert(ctx, v, sizeof(struct vrend_vertex_element), handle,
                                              VIRGL_OBJECT_VERTEX_ELEMENTS);
    if (!ret_handle) {
-      FREE(v);
+      vrend_slab_free(v);
       return ENOMEM;
    }
    return 0;
@@ -1922,6 +3497,10 @@ void vrend_bind_vertex_elements_state(struct vrend_context *ctx,
 
    if (ctx->sub->ve != v)
       ctx->sub->vbo_dirty = true;
+   /* the vertex shader variant depends on the attributes it decodes */
+   if (!ctx->sub->ve || ctx->sub->ve->zyxw_bitmask != v->zyxw_bitmask ||
+       ctx->sub->ve->r11g11b10_bitmask != v->r11g11b10_bitmask)
+      ctx->sub->shader_dirty = true;
    ctx->sub->ve = v;
 }
 
@@ -1934,6 +3513,13 @@ void vrend_set_constants(struct vrend_context *ctx,
    struct vrend_constants *consts;
 
    consts = &ctx->sub->consts[shader];
+
+   /* guests tend to resend the whole buffer after touching a few vectors,
+    * or without touching it at all; an unchanged buffer needs no upload */
+   if (consts->consts && consts->num_consts == num_constant &&
+       !memcmp(consts->consts, data, num_constant * sizeof(unsigned int)))
+      return;
+
    ctx->sub->const_dirty[shader] = true;
 
    /* avoid reallocations by only growing the buffer */
@@ -2083,14 +3669,15 @@ void vrend_set_single_sampler_view(struct vrend_context *ctx,
       if (!has_bit(view->texture->storage_bits, VREND_STORAGE_GL_BUFFER)) {
          if (view->texture->id == view->id) {
             glBindTexture(view->target, view->id);
+            vrend_shadow_textures_bound(ctx->client->vrend_state);
 
             if (util_format_is_depth_or_stencil(view->format)) {
                if (has_feature(feat_stencil_texturing)) {
                   const struct util_format_description *desc = util_format_description(view->format);
-                  if (!util_format_has_depth(desc)) {
-                     glTexParameteri(view->texture->target, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_STENCIL_INDEX);
-                  } else {
-                     glTexParameteri(view->texture->target, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_DEPTH_COMPONENT);
+                  GLenum ds_mode = util_format_has_depth(desc) ? GL_DEPTH_COMPONENT : GL_STENCIL_INDEX;
+                  if (tex->cur_ds_mode != ds_mode) {
+                     glTexParameteri(view->texture->target, GL_DEPTH_STENCIL_TEXTURE_MODE, ds_mode);
+                     tex->cur_ds_mode = ds_mode;
                   }
                }
             }
@@ -2139,6 +3726,7 @@ void vrend_set_single_sampler_view(struct vrend_context *ctx,
             glGenTextures(1, &view->texture->tbo_tex_id);
 
          glBindTexture(GL_TEXTURE_BUFFER, view->texture->tbo_tex_id);
+         vrend_shadow_textures_bound(ctx->client->vrend_state);
          internalformat = tex_conv_table[view->format].internalformat;
          if (has_feature(feat_texture_buffer_range)) {
             unsigned offset = view->val0;
@@ -2187,6 +3775,7 @@ void vrend_set_single_image_view(struct vrend_context *ctx,
       res = vrend_renderer_ctx_res_lookup(ctx, handle);
       if (!res)
          return;
+      vrend_resource_ensure_storage(res);
       iview->texture = res;
       iview->format = tex_conv_table[format].internalformat;
       iview->access = access;
@@ -2354,6 +3943,11 @@ static inline void vrend_fill_shader_key(struct vrend_context *ctx,
    if (type == PIPE_SHADER_FRAGMENT)
       key->fs_swizzle_output_rgb_to_bgr = ctx->sub->swizzle_output_rgb_to_bgr;
 
+   if (type == PIPE_SHADER_VERTEX && ctx->sub->ve) {
+      key->vs_attrib_zyxw_bitmask = ctx->sub->ve->zyxw_bitmask;
+      key->vs_attrib_r11g11b10_bitmask = ctx->sub->ve->r11g11b10_bitmask;
+   }
+
    if (ctx->sub->shaders[PIPE_SHADER_GEOMETRY])
       key->gs_present = true;
    if (ctx->sub->shaders[PIPE_SHADER_TESS_CTRL])
@@ -2443,31 +4037,17 @@ static inline void vrend_fill_shader_key(struct vrend_context *ctx,
    }
 }
 
-static inline int conv_shader_type(int type)
-{
-   switch (type) {
-   case PIPE_SHADER_VERTEX: return GL_VERTEX_SHADER;
-   case PIPE_SHADER_FRAGMENT: return GL_FRAGMENT_SHADER;
-   case PIPE_SHADER_GEOMETRY: return GL_GEOMETRY_SHADER;
-   case PIPE_SHADER_TESS_CTRL: return GL_TESS_CONTROL_SHADER;
-   case PIPE_SHADER_TESS_EVAL: return GL_TESS_EVALUATION_SHADER;
-   case PIPE_SHADER_COMPUTE: return GL_COMPUTE_SHADER;
-   default:
-      return 0;
-   }
-}
-
 static int vrend_shader_create(struct vrend_context *ctx,
                                struct vrend_shader *shader,
                                struct vrend_shader_key key)
 {
 
    shader->id = glCreateShader(conv_shader_type(shader->sel->type));
-   shader->compiled_fs_id = 0;
 
    if (shader->sel->tokens) {
       bool ret = vrend_convert_shader(ctx, &ctx->shader_cfg, shader->sel->tokens,
-                                      shader->sel->req_local_mem, &key, &shader->sel->sinfo, &shader->glsl_strings);
+                                      shader->sel->req_local_mem, &key, &shader->sel->sinfo, &shader->glsl_strings,
+                                      &shader->sel->analysis);
       if (!ret) {
          glDeleteShader(shader->id);
          return -1;
@@ -2526,6 +4106,8 @@ static int vrend_shader_select(struct vrend_context *ctx,
          return r;
       }
       sel->num_shaders++;
+      if (sel->tokens)
+         vrend_variant_log_record(sel->log_hash, &key);
    }
    if (dirty)
       *dirty = true;
@@ -2553,6 +4135,50 @@ static void *vrend_create_shader_state(UNUSED struct vrend_context *ctx,
    return sel;
 }
 
+/* Builds the variants an earlier run of the game logged for this selector
+ * except the one about to be selected, compiling them in the background.
+ * They go in before the current one because every translation overwrites
+ * sel->sinfo, which has to describe the variant selected last. */
+static void vrend_shader_precompile_variants(struct vrend_context *ctx,
+                                             struct vrend_shader_selector *sel)
+{
+   struct vrend_shader_key current_key, *keys;
+   int i, num_keys;
+
+   if (!ctx->client->vrend_state->compile_pool)
+      return;
+
+   num_keys = vrend_variant_log_lookup(sel->log_hash, &keys);
+   if (!num_keys)
+      return;
+
+   memset(&current_key, 0, sizeof(current_key));
+   vrend_fill_shader_key(ctx, sel, &current_key);
+
+   for (i = 0; i < num_keys; i++) {
+      struct vrend_shader *shader;
+
+      if (!memcmp(&keys[i], &current_key, sizeof(current_key)))
+         continue;
+
+      shader = CALLOC_STRUCT(vrend_shader);
+      if (!shader)
+         break;
+      shader->sel = sel;
+      list_inithead(&shader->programs);
+      strarray_alloc(&shader->glsl_strings, SHADER_MAX_STRINGS);
+
+      if (vrend_shader_create(ctx, shader, keys[i])) {
+         FREE(shader);
+         continue;
+      }
+      shader->next_variant = sel->current;
+      sel->current = shader;
+      sel->num_shaders++;
+   }
+   free(keys);
+}
+
 static int vrend_finish_shader(struct vrend_context *ctx,
                                struct vrend_shader_selector *sel,
                                const struct tgsi_token *tokens)
@@ -2560,7 +4186,11 @@ static int vrend_finish_shader(struct vrend_context *ctx,
    int r;
 
    sel->tokens = tgsi_dup_tokens(tokens);
-
+   if (sel->tokens) {
+      sel->log_hash = vrend_variant_log_hash(sel->type, sel->tokens, &sel->sinfo.so_info,
+                                             sel->req_local_mem);
+      vrend_shader_precompile_variants(ctx, sel);
+   }
    r = vrend_shader_select(ctx, sel, NULL);
    if (r) {
       return EINVAL;
@@ -2751,11 +4381,63 @@ void vrend_bind_shader(struct vrend_context *ctx,
    vrend_shader_state_reference(&ctx->sub->shaders[sel->type], sel);
 }
 
+/* Whether every attachment of the framebuffer has the same size, so that
+ * a clear, which only covers their intersection, covers each of them. */
+static bool vrend_fb_attachments_match(struct vrend_sub_context *sub)
+{
+   uint32_t width = 0, height = 0;
+   int i;
+
+   for (i = -1; i < sub->nr_cbufs; i++) {
+      struct vrend_surface *surf = i < 0 ? sub->zsurf : sub->surf[i];
+      uint32_t w, h;
+
+      if (!surf || !surf->texture)
+         continue;
+      w = u_minify(surf->texture->base.width0, surf->val0);
+      h = u_minify(surf->texture->base.height0, surf->val0);
+      if (width && (w != width || h != height))
+         return false;
+      width = w;
+      height = h;
+   }
+   return true;
+}
+
+/* Tells a tiler that the cleared attachments are overwritten anyway, so
+ * the pass starts without loading their old contents from memory. */
+static void vrend_invalidate_cleared(struct vrend_context *ctx, GLbitfield bits)
+{
+   GLenum attachments[PIPE_MAX_COLOR_BUFS + 2];
+   GLsizei count = 0;
+   int i;
+
+   if (!has_feature(feat_invalidate_framebuffer) || !vrend_fb_attachments_match(ctx->sub))
+      return;
+
+   if (bits & GL_COLOR_BUFFER_BIT) {
+      for (i = 0; i < ctx->sub->nr_cbufs; i++) {
+         if (ctx->sub->surf[i])
+            attachments[count++] = GL_COLOR_ATTACHMENT0 + i;
+      }
+   }
+   if (ctx->sub->zsurf) {
+      if (bits & GL_DEPTH_BUFFER_BIT)
+         attachments[count++] = GL_DEPTH_ATTACHMENT;
+      if (bits & GL_STENCIL_BUFFER_BIT)
+         attachments[count++] = GL_STENCIL_ATTACHMENT;
+   }
+
+   if (count)
+      glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+}
+
 void vrend_clear(struct vrend_context *ctx,
                  unsigned buffers,
                  const union pipe_color_union *color,
                  double depth, unsigned stencil)
 {
+   struct vrend_state *state = ctx->client->vrend_state;
    GLbitfield bits = 0;
 
    if (ctx->in_error)
@@ -2774,7 +4456,14 @@ void vrend_clear(struct vrend_context *ctx,
 
    vrend_use_program(ctx, 0);
 
-   glDisable(GL_SCISSOR_TEST);
+   vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, false);
+
+   for (int i = 0; i < ctx->sub->nr_cbufs; i++) {
+      if ((buffers & PIPE_CLEAR_COLOR) && ctx->sub->surf[i])
+         vrend_resource_written(state, ctx->sub->surf[i]->texture, state->next_fence_id);
+   }
+   if ((buffers & PIPE_CLEAR_DEPTHSTENCIL) && ctx->sub->zsurf)
+      vrend_resource_written(state, ctx->sub->zsurf->texture, state->next_fence_id);
 
    if (buffers & PIPE_CLEAR_COLOR) {
       glClearColor(color->f[0], color->f[1], color->f[2], color->f[3]);
@@ -2793,7 +4482,7 @@ void vrend_clear(struct vrend_context *ctx,
 
    if (buffers & PIPE_CLEAR_DEPTH) {
       /* gallium clears don't respect depth mask */
-      glDepthMask(GL_TRUE);
+      vrend_depth_mask(ctx, GL_TRUE);
       glClearDepthf(depth);
    }
 
@@ -2835,8 +4524,10 @@ void vrend_clear(struct vrend_context *ctx,
    if (buffers & PIPE_CLEAR_STENCIL)
       bits |= GL_STENCIL_BUFFER_BIT;
 
-   if (bits)
+   if (bits) {
+      vrend_invalidate_cleared(ctx, bits);
       glClear(bits);
+   }
 
    /* Is it really necessary to restore the old states? The only reason we
     * get here is because the guest cleared all those states but gallium
@@ -2847,7 +4538,7 @@ void vrend_clear(struct vrend_context *ctx,
 
    if (buffers & PIPE_CLEAR_DEPTH) {
       if (!ctx->sub->dsa_state.depth.writemask)
-         glDepthMask(GL_FALSE);
+         vrend_depth_mask(ctx, GL_FALSE);
    }
 
    /* Restore previous stencil buffer write masks for both front and back faces */
@@ -2863,10 +4554,7 @@ void vrend_clear(struct vrend_context *ctx,
                   ctx->sub->hw_blend_state.rt[0].colormask & PIPE_MASK_B ? GL_TRUE : GL_FALSE,
                   ctx->sub->hw_blend_state.rt[0].colormask & PIPE_MASK_A ? GL_TRUE : GL_FALSE);
    }
-   if (ctx->sub->hw_rs_state.scissor)
-      glEnable(GL_SCISSOR_TEST);
-   else
-      glDisable(GL_SCISSOR_TEST);
+   vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, ctx->sub->hw_rs_state.scissor);
 }
 
 static void vrend_update_scissor_state(struct vrend_context *ctx)
@@ -2958,6 +4646,178 @@ static GLenum get_xfb_mode(GLenum mode)
    }
 }
 
+static size_t vrend_vao_key_size(const struct vrend_vao_key *key)
+{
+   return offsetof(struct vrend_vao_key, attribs) + key->num_attribs * sizeof(key->attribs[0]);
+}
+
+static unsigned vrend_vao_key_hash(void *key)
+{
+   return cso_construct_key(key, vrend_vao_key_size(key));
+}
+
+static int vrend_vao_key_compare(void *key1, void *key2)
+{
+   struct vrend_vao_key *a = key1, *b = key2;
+
+   if (a->num_attribs != b->num_attribs)
+      return 1;
+   return memcmp(a, b, vrend_vao_key_size(a));
+}
+
+static void vrend_vao_key_destroy(UNUSED void *value)
+{
+   /* VAOs are owned by sub->vaos, the hash only indexes them */
+}
+
+static void vrend_vao_destroy(struct vrend_sub_context *sub, struct vrend_vao *vao)
+{
+   util_hash_table_remove(sub->vao_hash, &vao->key);
+   list_del(&vao->head);
+   if (sub->bound_vao == vao->id) {
+      glBindVertexArray(sub->vaoid);
+      sub->bound_vao = sub->vaoid;
+   }
+   glDeleteVertexArrays(1, &vao->id);
+   FREE(vao);
+   sub->num_vaos--;
+}
+
+static void vrend_vao_cache_flush(struct vrend_sub_context *sub)
+{
+   struct vrend_vao *vao, *tmp;
+
+   LIST_FOR_EACH_ENTRY_SAFE(vao, tmp, &sub->vaos, head)
+      vrend_vao_destroy(sub, vao);
+}
+
+/* Builds the key of what the legacy path would set up for va; false for
+ * the layouts it handles specially, zero stride attributes that are read
+ * back and set as constants on every draw and the cases it bails on. */
+static bool vrend_vao_key_build(struct vrend_context *ctx,
+                                struct vrend_vertex_element_array *va,
+                                struct vrend_vao_key *key)
+{
+   int i;
+
+   key->num_attribs = 0;
+   for (i = 0; i < (int)va->count; i++) {
+      struct vrend_vertex_element *ve = &va->elements[i];
+      int vbo_index = ve->base.vertex_buffer_index;
+      struct vrend_vao_attrib *attrib;
+      struct vrend_resource *res;
+      GLint loc;
+
+      if (i >= ctx->sub->prog->ss[PIPE_SHADER_VERTEX]->sel->sinfo.num_inputs)
+         break;
+      res = (struct vrend_resource *)ctx->sub->vbo[vbo_index].buffer;
+      if (!res)
+         continue;
+
+      if (ctx->client->vrend_state->use_explicit_locations) {
+         loc = i;
+      } else {
+         loc = ctx->sub->prog->attrib_locs ? ctx->sub->prog->attrib_locs[i] : -1;
+         if (loc == -1) {
+            if (i == 0)
+               return false;
+            continue;
+         }
+      }
+
+      if (ve->type == GL_FALSE || ctx->sub->vbo[vbo_index].stride == 0)
+         return false;
+
+      /* its deletion has to invalidate the VAOs pointing to it */
+      res->vao_cached = true;
+
+      attrib = &key->attribs[key->num_attribs++];
+      attrib->buffer = res->id;
+      attrib->loc = loc;
+      attrib->stride = ctx->sub->vbo[vbo_index].stride;
+      attrib->offset = ve->base.src_offset + ctx->sub->vbo[vbo_index].buffer_offset;
+      attrib->type = ve->type;
+      attrib->nr_chan = ve->nr_chan;
+      attrib->norm = ve->norm;
+      attrib->integer = ve->integer;
+      attrib->divisor = ve->base.instance_divisor;
+   }
+   return true;
+}
+
+static GLuint vrend_vao_create(struct vrend_context *ctx, const struct vrend_vao_key *key)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   struct vrend_vao *vao = CALLOC_STRUCT(vrend_vao);
+   uint32_t i;
+
+   if (!vao)
+      return 0;
+
+   memcpy(&vao->key, key, vrend_vao_key_size(key));
+   glGenVertexArrays(1, &vao->id);
+   glBindVertexArray(vao->id);
+   for (i = 0; i < key->num_attribs; i++) {
+      const struct vrend_vao_attrib *attrib = &key->attribs[i];
+
+      glBindBuffer(GL_ARRAY_BUFFER, attrib->buffer);
+      if (attrib->integer)
+         glVertexAttribIPointer(attrib->loc, attrib->nr_chan, attrib->type, attrib->stride,
+                                (void *)(unsigned long)attrib->offset);
+      else
+         glVertexAttribPointer(attrib->loc, attrib->nr_chan, attrib->type, attrib->norm, attrib->stride,
+                               (void *)(unsigned long)attrib->offset);
+      glVertexAttribDivisor(attrib->loc, attrib->divisor);
+      glEnableVertexAttribArray(attrib->loc);
+   }
+   sub->bound_vao = vao->id;
+
+   list_addtail(&vao->head, &sub->vaos);
+   util_hash_table_set(sub->vao_hash, &vao->key, vao);
+   sub->num_vaos++;
+
+   if (sub->num_vaos > VREND_VAO_CACHE_SIZE)
+      vrend_vao_destroy(sub, LIST_ENTRY(struct vrend_vao, sub->vaos.next, head));
+   return vao->id;
+}
+
+/* Binds a cached VAO with the layout of va, false if the layout can not
+ * be cached and has to be set up on sub->vaoid instead */
+static bool vrend_draw_bind_vertex_cached(struct vrend_context *ctx,
+                                          struct vrend_vertex_element_array *va)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   struct vrend_vao_key key;
+   struct vrend_vao *vao;
+   GLuint id;
+   uint32_t generation = __atomic_load_n(&vao_cache_generation, __ATOMIC_RELAXED);
+
+   if (sub->vao_generation != generation) {
+      vrend_vao_cache_flush(sub);
+      sub->vao_generation = generation;
+   }
+
+   if (!vrend_vao_key_build(ctx, va, &key))
+      return false;
+
+   vao = util_hash_table_get(sub->vao_hash, &key);
+   if (vao) {
+      list_del(&vao->head);
+      list_addtail(&vao->head, &sub->vaos);
+      id = vao->id;
+   } else {
+      id = vrend_vao_create(ctx, &key);
+      if (!id)
+         return false;
+   }
+
+   if (sub->bound_vao != id) {
+      glBindVertexArray(id);
+      sub->bound_vao = id;
+   }
+   return true;
+}
+
 static void vrend_draw_bind_vertex_legacy(struct vrend_context *ctx,
                                           struct vrend_vertex_element_array *va)
 {
@@ -2965,6 +4825,14 @@ static void vrend_draw_bind_vertex_legacy(struct vrend_context *ctx,
    uint32_t disable_bitmask;
    int i;
 
+   if (vrend_draw_bind_vertex_cached(ctx, va))
+      return;
+
+   if (ctx->sub->bound_vao != ctx->sub->vaoid) {
+      glBindVertexArray(ctx->sub->vaoid);
+      ctx->sub->bound_vao = ctx->sub->vaoid;
+   }
+
    enable_bitmask = 0;
    disable_bitmask = ~((1ull << va->count) - 1);
    for (i = 0; i < (int)va->count; i++) {
@@ -3023,7 +4891,7 @@ static void vrend_draw_bind_vertex_legacy(struct vrend_context *ctx,
          disable_bitmask |= (1 << loc);
       } else {
          enable_bitmask |= (1 << loc);
-         if (util_format_is_pure_integer(ve->base.src_format)) {
+         if (ve->integer) {
             glVertexAttribIPointer(loc, ve->nr_chan, ve->type, ctx->sub->vbo[vbo_index].stride, (void *)(unsigned long)(ve->base.src_offset + ctx->sub->vbo[vbo_index].buffer_offset));
          } else {
             glVertexAttribPointer(loc, ve->nr_chan, ve->type, ve->norm, ctx->sub->vbo[vbo_index].stride, (void *)(unsigned long)(ve->base.src_offset + ctx->sub->vbo[vbo_index].buffer_offset));
@@ -3103,6 +4971,7 @@ static int vrend_draw_bind_samplers_shader(struct vrend_context *ctx,
       struct vrend_sampler_view *tview = ctx->sub->views[shader_type].views[i];
       if (dirty & (1 << i) && tview) {
          if (ctx->sub->prog->shadow_samp_mask[shader_type] & (1 << i)) {
+            vrend_uniform_stage(ctx->sub->prog, shader_type);
             glUniform4f(ctx->sub->prog->shadow_samp_mask_locs[shader_type][index],
                         (tview->gl_swizzle_r == GL_ZERO || tview->gl_swizzle_r == GL_ONE) ? 0.0 : 1.0,
                         (tview->gl_swizzle_g == GL_ZERO || tview->gl_swizzle_g == GL_ONE) ? 0.0 : 1.0,
@@ -3126,8 +4995,7 @@ static int vrend_draw_bind_samplers_shader(struct vrend_context *ctx,
             } else
                id = tview->id;
 
-            glActiveTexture(GL_TEXTURE0 + next_sampler_id);
-            glBindTexture(target, id);
+            vrend_bind_texture_unit(ctx, next_sampler_id, target, id);
 
             if (ctx->sub->views[shader_type].old_ids[i] != id ||
                 ctx->sub->sampler_views_dirty[shader_type] & (1 << i)) {
@@ -3178,18 +5046,115 @@ static int vrend_draw_bind_ubo_shader(struct vrend_context *ctx,
       }
       next_ubo_id++;
    }
-   ctx->sub->const_bufs_dirty[shader_type] = dirty;
+   ctx->sub->const_bufs_dirty[shader_type] = dirty;
+
+   return next_ubo_id;
+}
+
+static int vrend_const_ring_upload(struct vrend_context *ctx,
+                                   const struct vrend_constants *consts,
+                                   uint32_t size)
+{
+   struct vrend_const_ring *ring = &ctx->sub->const_ring;
+   GLint alignment = ctx->client->vrend_state->const_ubo_alignment;
+   uint32_t aligned = align(size, alignment);
+   uint32_t copy = MIN2(size, consts->num_consts * sizeof(unsigned int));
+   uint32_t offset;
+   char *ptr;
+
+   if (ring->offset + aligned > VREND_CONST_RING_SIZE)
+      return -1;
+
+   if (!ring->id) {
+      glGenBuffers(1, &ring->id);
+      glBindBuffer(GL_UNIFORM_BUFFER, ring->id);
+      glBufferData(GL_UNIFORM_BUFFER, VREND_CONST_RING_SIZE, NULL, GL_STREAM_DRAW);
+      ring->offset = 0;
+   } else
+      glBindBuffer(GL_UNIFORM_BUFFER, ring->id);
+
+   ptr = glMapBufferRange(GL_UNIFORM_BUFFER, ring->offset, size,
+                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                          GL_MAP_UNSYNCHRONIZED_BIT);
+   if (!ptr)
+      return -1;
+
+   memcpy(ptr, consts->consts, copy);
+   if (copy < size)
+      memset(ptr + copy, 0, size - copy);
+   glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+   offset = ring->offset;
+   ring->offset += aligned;
+   return offset;
+}
+
+/* Makes room for the snapshots of stages first..last before any of them is
+ * uploaded: orphaning replaces the storage every stage's range points to,
+ * so it must not happen halfway through binding a draw. */
+static void vrend_const_ring_reserve(struct vrend_context *ctx, int first, int last)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   struct vrend_const_ring *ring = &sub->const_ring;
+   GLint alignment = ctx->client->vrend_state->const_ubo_alignment;
+   uint32_t needed = 0;
+   int i;
+
+   for (i = first; i <= last; i++) {
+      if (sub->prog->const_ubo[i] && sub->shaders[i])
+         needed += align(sub->shaders[i]->sinfo.num_consts * 4 * sizeof(unsigned int), alignment);
+   }
+
+   if (!needed || ring->offset + needed <= VREND_CONST_RING_SIZE)
+      return;
+
+   /* older snapshots may still be read by queued draws, orphan the storage
+    * instead of waiting for them */
+   if (ring->id) {
+      glBindBuffer(GL_UNIFORM_BUFFER, ring->id);
+      glBufferData(GL_UNIFORM_BUFFER, VREND_CONST_RING_SIZE, NULL, GL_STREAM_DRAW);
+   }
+   ring->offset = 0;
+   memset(sub->const_ubo_size, 0, sizeof(sub->const_ubo_size));
+}
 
-   return next_ubo_id;
+static void vrend_draw_bind_const_ubo(struct vrend_context *ctx, int shader_type)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   uint32_t size = sub->shaders[shader_type]->sinfo.num_consts * 4 * sizeof(unsigned int);
+   int offset;
+
+   /* the binding point belongs to the stage, so switching programs keeps
+    * the snapshot as long as it covers what the new shader reads */
+   if (!sub->const_dirty[shader_type] && size <= sub->const_ubo_size[shader_type])
+      return;
+
+   offset = vrend_const_ring_upload(ctx, &sub->consts[shader_type], size);
+   if (offset < 0)
+      return;
+
+   glBindBufferRange(GL_UNIFORM_BUFFER,
+                     ctx->client->vrend_state->const_ubo_binding_base + shader_type,
+                     sub->const_ring.id, offset, size);
+   sub->const_ubo_size[shader_type] = size;
+   sub->const_dirty[shader_type] = false;
 }
 
 static void vrend_draw_bind_const_shader(struct vrend_context *ctx,
                                          int shader_type, bool new_program)
 {
+   if (ctx->sub->consts[shader_type].consts &&
+       ctx->sub->shaders[shader_type] &&
+       ctx->sub->prog->const_ubo[shader_type]) {
+      vrend_draw_bind_const_ubo(ctx, shader_type);
+      return;
+   }
+
    if (ctx->sub->consts[shader_type].consts &&
        ctx->sub->shaders[shader_type] &&
        (ctx->sub->prog->const_location[shader_type] != -1) &&
        (ctx->sub->const_dirty[shader_type] || new_program)) {
+      vrend_uniform_stage(ctx->sub->prog, shader_type);
       glUniform4uiv(ctx->sub->prog->const_location[shader_type],
             ctx->sub->shaders[shader_type]->sinfo.num_consts,
             ctx->sub->consts[shader_type].consts);
@@ -3219,8 +5184,8 @@ static void vrend_draw_bind_ssbo_shader(struct vrend_context *ctx, int shader_ty
 
       ssbo = &ctx->sub->ssbo[shader_type][i];
       res = (struct vrend_resource *)ssbo->res;
-      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i, res->id,
-                        ssbo->buffer_offset, ssbo->buffer_size);
+      vrend_bind_buffer_range(ctx, GL_SHADER_STORAGE_BUFFER, i, res->id,
+                              ssbo->buffer_offset, ssbo->buffer_size);
    }
 }
 
@@ -3240,8 +5205,8 @@ static void vrend_draw_bind_abo_shader(struct vrend_context *ctx)
 
       abo = &ctx->sub->abo[i];
       res = (struct vrend_resource *)abo->res;
-      glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, i, res->id,
-                        abo->buffer_offset, abo->buffer_size);
+      vrend_bind_buffer_range(ctx, GL_ATOMIC_COUNTER_BUFFER, i, res->id,
+                              abo->buffer_offset, abo->buffer_size);
    }
 }
 
@@ -3279,6 +5244,7 @@ static void vrend_draw_bind_images_shader(struct vrend_context *ctx, int shader_
 
          glBindBuffer(GL_TEXTURE_BUFFER, iview->texture->id);
          glBindTexture(GL_TEXTURE_BUFFER, iview->texture->tbo_tex_id);
+         vrend_shadow_textures_bound(ctx->client->vrend_state);
 
          if (has_feature(feat_arb_or_gles_ext_texture_buffer))
             glTexBuffer(GL_TEXTURE_BUFFER, format, iview->texture->id);
@@ -3307,13 +5273,63 @@ static void vrend_draw_bind_images_shader(struct vrend_context *ctx, int shader_
          return;
       }
 
-      glBindImageTexture(i, tex_id, level, layered, first_layer, access, iview->format);
+      vrend_bind_image_unit(ctx, i, tex_id, level, layered, first_layer, access, iview->format);
+   }
+}
+
+/* Bindings outlive the submission that set them up, so stamp everything
+ * a draw or dispatch can write with the fence that will cover it. */
+static void vrend_mark_written_resources(struct vrend_context *ctx)
+{
+   struct vrend_sub_context *sub = ctx->sub;
+   struct vrend_state *state = ctx->client->vrend_state;
+   uint32_t fence_id = state->next_fence_id;
+   uint32_t mask;
+   int i, shader_type;
+
+   for (i = 0; i < sub->nr_cbufs; i++) {
+      if (sub->surf[i])
+         vrend_resource_written(state, sub->surf[i]->texture, fence_id);
+   }
+   if (sub->zsurf)
+      vrend_resource_written(state, sub->zsurf->texture, fence_id);
+
+   if (sub->current_so) {
+      for (i = 0; i < (int)sub->current_so->num_targets; i++) {
+         if (sub->current_so->so_targets[i])
+            vrend_resource_written(state, sub->current_so->so_targets[i]->buffer, fence_id);
+      }
+   }
+
+   for (shader_type = 0; shader_type < PIPE_SHADER_TYPES; shader_type++) {
+      mask = sub->images_used_mask[shader_type];
+      while (mask) {
+         i = u_bit_scan(&mask);
+         if (sub->image_views[shader_type][i].texture)
+            vrend_resource_written(state, sub->image_views[shader_type][i].texture, fence_id);
+      }
+
+      mask = sub->ssbo_used_mask[shader_type];
+      while (mask) {
+         i = u_bit_scan(&mask);
+         if (sub->ssbo[shader_type][i].res)
+            vrend_resource_written(state, sub->ssbo[shader_type][i].res, fence_id);
+      }
+   }
+
+   mask = sub->abo_used_mask;
+   while (mask) {
+      i = u_bit_scan(&mask);
+      if (sub->abo[i].res)
+         vrend_resource_written(state, sub->abo[i].res, fence_id);
    }
 }
 
 static void vrend_draw_bind_objects(struct vrend_context *ctx, bool new_program)
 {
    int next_ubo_id = 0, next_sampler_id = 0;
+
+   vrend_const_ring_reserve(ctx, PIPE_SHADER_VERTEX, ctx->sub->last_shader_idx);
    for (int shader_type = PIPE_SHADER_VERTEX; shader_type <= ctx->sub->last_shader_idx; shader_type++) {
       next_ubo_id = vrend_draw_bind_ubo_shader(ctx, shader_type, next_ubo_id);
       vrend_draw_bind_const_shader(ctx, shader_type, new_program);
@@ -3324,18 +5340,41 @@ static void vrend_draw_bind_objects(struct vrend_context *ctx, bool new_program)
    }
 
    vrend_draw_bind_abo_shader(ctx);
+   vrend_mark_written_resources(ctx);
 
    if (ctx->sub->prog->fs_stipple_loc != -1) {
-      glActiveTexture(GL_TEXTURE0 + next_sampler_id);
-      glBindTexture(GL_TEXTURE_2D, ctx->pstipple_tex_id);
+      vrend_bind_texture_unit(ctx, next_sampler_id, GL_TEXTURE_2D, ctx->pstipple_tex_id);
+      vrend_uniform_stage(ctx->sub->prog, PIPE_SHADER_FRAGMENT);
       glUniform1i(ctx->sub->prog->fs_stipple_loc, next_sampler_id);
    }
 }
 
+static bool vrend_strarray_equal(const struct vrend_strarray *a, const struct vrend_strarray *b)
+{
+   int i;
+
+   if (a->num_strings != b->num_strings)
+      return false;
+   for (i = 0; i < a->num_strings; i++) {
+      if (a->strings[i].size != b->strings[i].size ||
+          memcmp(a->strings[i].buf, b->strings[i].buf, a->strings[i].size))
+         return false;
+   }
+   return true;
+}
+
+/* Binds a passthrough TCS for the TES.  The GLSL is generated every time,
+ * it depends on the VS outputs, vertices_per_patch and the tess factors,
+ * but a TCS generated before with the same text is bound again instead of
+ * compiling a new one, so the linked program and its cached binary are
+ * found again as well. */
 static
 void vrend_inject_tcs(struct vrend_context *ctx, int vertices_per_patch)
 {
+   struct vrend_sub_context *sub = ctx->sub;
    struct pipe_stream_output_info so_info;
+   uint64_t hash;
+   unsigned i;
 
    memset(&so_info, 0, sizeof(so_info));
    struct vrend_shader_selector *sel = vrend_create_shader_state(ctx,
@@ -3350,28 +5389,95 @@ void vrend_inject_tcs(struct vrend_context *ctx, int vertices_per_patch)
    strarray_alloc(&shader->glsl_strings, SHADER_MAX_STRINGS);
 
    vrend_shader_create_passthrough_tcs(ctx, &ctx->shader_cfg,
-                                       ctx->sub->shaders[PIPE_SHADER_VERTEX]->tokens,
+                                       sub->shaders[PIPE_SHADER_VERTEX]->tokens,
                                        &shader->key, ctx->client->vrend_state->tess_factors, &sel->sinfo,
                                        &shader->glsl_strings, vertices_per_patch);
    // Need to add inject the selected shader to the shader selector and then the code below
    // can continue
    sel->tokens = NULL;
    sel->current = shader;
-   ctx->sub->shaders[PIPE_SHADER_TESS_CTRL] = sel;
-   ctx->sub->shaders[PIPE_SHADER_TESS_CTRL]->num_shaders = 1;
+   sel->num_shaders = 1;
+
+   hash = vrend_program_cache_hash_strings(0, &shader->glsl_strings);
+   for (i = 0; i < VREND_PASSTHROUGH_TCS_CACHE_SIZE; i++) {
+      struct vrend_shader_selector *cached = sub->passthrough_tcs[i];
+
+      if (cached && sub->passthrough_tcs_hash[i] == hash &&
+          vrend_strarray_equal(&cached->current->glsl_strings, &shader->glsl_strings)) {
+         vrend_destroy_shader_selector(sel);
+         vrend_shader_state_reference(&sub->shaders[PIPE_SHADER_TESS_CTRL], cached);
+         return;
+      }
+   }
 
    shader->id = glCreateShader(conv_shader_type(shader->sel->type));
    vrend_compile_shader(ctx, shader);
+
+   /* the cache and the bound slot both hold a reference */
+   i = sub->passthrough_tcs_next++ % VREND_PASSTHROUGH_TCS_CACHE_SIZE;
+   vrend_shader_state_reference(&sub->passthrough_tcs[i], sel);
+   sub->passthrough_tcs_hash[i] = hash;
+   vrend_shader_state_reference(&sub->shaders[PIPE_SHADER_TESS_CTRL], sel);
+   vrend_shader_state_reference(&sel, NULL);
 }
 
-int vrend_draw_vbo(struct vrend_context *ctx,
-                   const struct pipe_draw_info *info,
-                   uint32_t cso, uint32_t indirect_handle,
-                   uint32_t indirect_draw_count_handle)
+static void vrend_draw_arrays_merged(const struct pipe_draw_info *infos, int num_draws)
+{
+   GLint first[VREND_MAX_MERGED_DRAWS];
+   GLsizei count[VREND_MAX_MERGED_DRAWS];
+   int i;
+
+   if (!multi_draw_arrays) {
+      for (i = 0; i < num_draws; i++)
+         glDrawArrays(infos[i].mode, infos[i].start, infos[i].count);
+      return;
+   }
+
+   for (i = 0; i < num_draws; i++) {
+      first[i] = infos[i].start;
+      count[i] = infos[i].count;
+   }
+   multi_draw_arrays(infos[0].mode, first, count, num_draws);
+}
+
+static void vrend_draw_elements_merged(struct vrend_context *ctx, const struct pipe_draw_info *infos,
+                                       int num_draws, GLenum elsz)
+{
+   const void *indices[VREND_MAX_MERGED_DRAWS];
+   GLsizei count[VREND_MAX_MERGED_DRAWS];
+   GLint basevertex[VREND_MAX_MERGED_DRAWS];
+   const void *offset = (const void *)(unsigned long)ctx->sub->ib.offset;
+   int i;
+
+   if (!multi_draw_elements_base_vertex) {
+      for (i = 0; i < num_draws; i++) {
+         if (infos[i].index_bias)
+            glDrawElementsBaseVertex(infos[i].mode, infos[i].count, elsz, offset, infos[i].index_bias);
+         else
+            glDrawElements(infos[i].mode, infos[i].count, elsz, offset);
+      }
+      return;
+   }
+
+   for (i = 0; i < num_draws; i++) {
+      indices[i] = offset;
+      count[i] = infos[i].count;
+      basevertex[i] = infos[i].index_bias;
+   }
+   multi_draw_elements_base_vertex(infos[0].mode, count, elsz, indices, num_draws, basevertex);
+}
+
+/* info points to num_draws draws, more than one only for a merged run
+ * which is never indirect, instanced or drawn from stream output */
+static int vrend_draw_vbo_common(struct vrend_context *ctx,
+                                 const struct pipe_draw_info *info, int num_draws,
+                                 uint32_t cso, uint32_t indirect_handle,
+                                 uint32_t indirect_draw_count_handle)
 {
    int i;
    bool new_program = false;
    struct vrend_resource *indirect_res = NULL;
+   NATIVE_TRACE_SCOPE("vrend_draw_vbo");
 
    if (ctx->in_error)
       return 0;
@@ -3476,6 +5582,9 @@ int vrend_draw_vbo(struct vrend_context *ctx,
                return 0;
          }
 
+         if (!vrend_shader_program_ready(ctx, prog, &ctx->sub->shader_dirty))
+            return 0;
+
          ctx->sub->last_shader_idx = ctx->sub->shaders[PIPE_SHADER_TESS_EVAL] ? PIPE_SHADER_TESS_EVAL : (ctx->sub->shaders[PIPE_SHADER_GEOMETRY] ? PIPE_SHADER_GEOMETRY : PIPE_SHADER_FRAGMENT);
       } else
          prog = ctx->sub->prog;
@@ -3504,19 +5613,25 @@ int vrend_draw_vbo(struct vrend_context *ctx,
    if (!ctx->sub->prog)
       return 0;
 
-   vrend_use_program(ctx, ctx->sub->prog->id);
+   vrend_use_linked_program(ctx, ctx->sub->prog);
 
    vrend_draw_bind_objects(ctx, new_program);
 
    if (!ctx->sub->ve)
       return 0;
    float viewport_neg_val = ctx->sub->viewport_is_negative ? -1.0 : 1.0;
-   if (ctx->sub->prog->viewport_neg_val != viewport_neg_val) {
+   /* a separable vertex program is shared by pipelines, it caches its own */
+   float *cached_neg_val = ctx->sub->prog->pipeline ?
+      &ctx->sub->prog->stages[PIPE_SHADER_VERTEX]->viewport_neg_val :
+      &ctx->sub->prog->viewport_neg_val;
+   if (*cached_neg_val != viewport_neg_val) {
+      vrend_uniform_stage(ctx->sub->prog, PIPE_SHADER_VERTEX);
       glUniform1f(ctx->sub->prog->vs_ws_adjust_loc, viewport_neg_val);
-      ctx->sub->prog->viewport_neg_val = viewport_neg_val;
+      *cached_neg_val = viewport_neg_val;
    }
 
    if (ctx->sub->rs_state.clip_plane_enable) {
+      vrend_uniform_stage(ctx->sub->prog, PIPE_SHADER_VERTEX);
       for (i = 0 ; i < 8; i++) {
          glUniform4fv(ctx->sub->prog->clip_locs[i], 1, (const GLfloat *)&ctx->sub->ucp_state.ucp[i]);
       }
@@ -3580,7 +5695,9 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       int count = cso ? cso : info->count;
       int start = cso ? 0 : info->start;
 
-      if (indirect_handle) {
+      if (num_draws > 1) {
+         vrend_draw_arrays_merged(info, num_draws);
+      } else if (indirect_handle) {
          glDrawArraysIndirect(mode, (GLvoid const *)(unsigned long)info->indirect.offset);
       } else if (info->instance_count <= 1)
          glDrawArrays(mode, start, count);
@@ -3602,7 +5719,9 @@ int vrend_draw_vbo(struct vrend_context *ctx,
          break;
       }
 
-      if (indirect_handle) {
+      if (num_draws > 1) {
+         vrend_draw_elements_merged(ctx, info, num_draws, elsz);
+      } else if (indirect_handle) {
          glDrawElementsIndirect(mode, elsz, (GLvoid const *)(unsigned long)info->indirect.offset);
       } else if (info->index_bias) {
          if (info->instance_count > 1)
@@ -3632,6 +5751,20 @@ int vrend_draw_vbo(struct vrend_context *ctx,
    return 0;
 }
 
+int vrend_draw_vbo(struct vrend_context *ctx,
+                   const struct pipe_draw_info *info,
+                   uint32_t cso, uint32_t indirect_handle,
+                   uint32_t indirect_draw_count_handle)
+{
+   return vrend_draw_vbo_common(ctx, info, 1, cso, indirect_handle, indirect_draw_count_handle);
+}
+
+int vrend_draw_vbo_merged(struct vrend_context *ctx,
+                          const struct pipe_draw_info *infos, int num_draws)
+{
+   return vrend_draw_vbo_common(ctx, infos, num_draws, 0, 0, 0);
+}
+
 void vrend_launch_grid(struct vrend_context *ctx,
                        UNUSED uint32_t *block,
                        uint32_t *grid,
@@ -3663,6 +5796,8 @@ void vrend_launch_grid(struct vrend_context *ctx,
             if (!prog)
                return;
          }
+         if (!vrend_shader_program_ready(ctx, prog, &ctx->sub->cs_shader_dirty))
+            return;
       } else
          prog = ctx->sub->prog;
 
@@ -3678,11 +5813,13 @@ void vrend_launch_grid(struct vrend_context *ctx,
    vrend_use_program(ctx, ctx->sub->prog->id);
 
    vrend_draw_bind_ubo_shader(ctx, PIPE_SHADER_COMPUTE, 0);
+   vrend_const_ring_reserve(ctx, PIPE_SHADER_COMPUTE, PIPE_SHADER_COMPUTE);
    vrend_draw_bind_const_shader(ctx, PIPE_SHADER_COMPUTE, new_program);
    vrend_draw_bind_samplers_shader(ctx, PIPE_SHADER_COMPUTE, 0);
    vrend_draw_bind_images_shader(ctx, PIPE_SHADER_COMPUTE);
    vrend_draw_bind_ssbo_shader(ctx, PIPE_SHADER_COMPUTE);
    vrend_draw_bind_abo_shader(ctx);
+   vrend_mark_written_resources(ctx);
 
    if (indirect_handle) {
       indirect_res = vrend_renderer_ctx_res_lookup(ctx, indirect_handle);
@@ -3798,15 +5935,15 @@ static void vrend_hw_emit_blend(struct vrend_context *ctx, struct pipe_blend_sta
 
       for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
          if (state->rt[i].blend_enable) {
-            glBlendFuncSeparatei(i, translate_blend_factor(state->rt[i].rgb_src_factor),
-                                    translate_blend_factor(state->rt[i].rgb_dst_factor),
-                                    translate_blend_factor(state->rt[i].alpha_src_factor),
-                                    translate_blend_factor(state->rt[i].alpha_dst_factor));
-            glBlendEquationSeparatei(i, translate_blend_func(state->rt[i].rgb_func),
-                                        translate_blend_func(state->rt[i].alpha_func));
-            glEnablei(GL_BLEND, i);
+            vrend_blend_func(ctx, i, translate_blend_factor(state->rt[i].rgb_src_factor),
+                                     translate_blend_factor(state->rt[i].rgb_dst_factor),
+                                     translate_blend_factor(state->rt[i].alpha_src_factor),
+                                     translate_blend_factor(state->rt[i].alpha_dst_factor));
+            vrend_blend_equation(ctx, i, translate_blend_func(state->rt[i].rgb_func),
+                                         translate_blend_func(state->rt[i].alpha_func));
+            vrend_blend_enable(ctx, i, true);
          } else {
-            glDisablei(GL_BLEND, i);
+            vrend_blend_enable(ctx, i, false);
 		 }
 
          if (state->rt[i].colormask != ctx->sub->hw_blend_state.rt[i].colormask) {
@@ -3819,16 +5956,16 @@ static void vrend_hw_emit_blend(struct vrend_context *ctx, struct pipe_blend_sta
       }
    } else {
       if (state->rt[0].blend_enable) {
-         glBlendFuncSeparate(translate_blend_factor(state->rt[0].rgb_src_factor),
-                             translate_blend_factor(state->rt[0].rgb_dst_factor),
-                             translate_blend_factor(state->rt[0].alpha_src_factor),
-                             translate_blend_factor(state->rt[0].alpha_dst_factor));
-         glBlendEquationSeparate(translate_blend_func(state->rt[0].rgb_func),
-                                 translate_blend_func(state->rt[0].alpha_func));
-         glEnable(GL_BLEND);
+         vrend_blend_func(ctx, -1, translate_blend_factor(state->rt[0].rgb_src_factor),
+                                   translate_blend_factor(state->rt[0].rgb_dst_factor),
+                                   translate_blend_factor(state->rt[0].alpha_src_factor),
+                                   translate_blend_factor(state->rt[0].alpha_dst_factor));
+         vrend_blend_equation(ctx, -1, translate_blend_func(state->rt[0].rgb_func),
+                                       translate_blend_func(state->rt[0].alpha_func));
+         vrend_blend_enable(ctx, -1, true);
       }
       else {
-         glDisable(GL_BLEND);
+         vrend_blend_enable(ctx, -1, false);
 	  }
 
       if (state->rt[0].colormask != ctx->sub->hw_blend_state.rt[0].colormask) {
@@ -3843,17 +5980,10 @@ static void vrend_hw_emit_blend(struct vrend_context *ctx, struct pipe_blend_sta
    }
    ctx->sub->hw_blend_state.independent_blend_enable = state->independent_blend_enable;
 
-   if (has_feature(feat_multisample)) {
-      if (state->alpha_to_coverage)
-         glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-      else
-         glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-   }
+   if (has_feature(feat_multisample))
+      vrend_set_cap(ctx, VREND_CAP_SAMPLE_ALPHA_TO_COVERAGE, state->alpha_to_coverage);
 
-   if (state->dither)
-      glEnable(GL_DITHER);
-   else
-      glDisable(GL_DITHER);
+   vrend_set_cap(ctx, VREND_CAP_DITHER, state->dither);
 }
 
 /* there are a few reasons we might need to patch the blend state.
@@ -3899,10 +6029,7 @@ static void vrend_patch_blend_state(struct vrend_context *ctx)
       blend_color.color[3] = 0.0f;
    }
 
-   glBlendColor(blend_color.color[0],
-                blend_color.color[1],
-                blend_color.color[2],
-                blend_color.color[3]);
+   vrend_blend_color(ctx, blend_color.color);
 
    ctx->sub->blend_state_dirty = false;
 }
@@ -3914,7 +6041,7 @@ void vrend_object_bind_blend(struct vrend_context *ctx,
 
    if (handle == 0) {
       memset(&ctx->sub->blend_state, 0, sizeof(ctx->sub->blend_state));
-      glDisable(GL_BLEND);
+      vrend_blend_enable(ctx, -1, false);
       return;
    }
    state = vrend_object_lookup(ctx->sub->object_hash, handle, VIRGL_OBJECT_BLEND);
@@ -3933,11 +6060,8 @@ static void vrend_hw_emit_dsa(struct vrend_context *ctx)
 
    if (state->depth.enabled) {
       vrend_depth_test_enable(ctx, true);
-      glDepthFunc(GL_NEVER + state->depth.func);
-      if (state->depth.writemask)
-         glDepthMask(GL_TRUE);
-      else
-         glDepthMask(GL_FALSE);
+      vrend_depth_func(ctx, GL_NEVER + state->depth.func);
+      vrend_depth_mask(ctx, state->depth.writemask ? GL_TRUE : GL_FALSE);
    } else
       vrend_depth_test_enable(ctx, false);
 
@@ -3976,10 +6100,7 @@ static void vrend_update_frontface_state(struct vrend_context *ctx)
    int front_ccw = state->front_ccw;
 
    front_ccw ^= (ctx->sub->inverted_fbo_content ? 0 : 1);
-   if (front_ccw)
-      glFrontFace(GL_CCW);
-   else
-      glFrontFace(GL_CW);
+   vrend_front_face(ctx, front_ccw ? GL_CCW : GL_CW);
 }
 
 void vrend_update_stencil_state(struct vrend_context *ctx)
@@ -4028,7 +6149,7 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    int i;
 
    /* line_width < 0 is invalid, the guest sometimes forgot to set it. */
-   glLineWidth(state->line_width <= 0 ? 1.0f : state->line_width);
+   vrend_line_width(ctx, state->line_width <= 0 ? 1.0f : state->line_width);
 
    if (state->rasterizer_discard != ctx->sub->hw_rs_state.rasterizer_discard) {
       ctx->sub->hw_rs_state.rasterizer_discard = state->rasterizer_discard;
@@ -4038,11 +6159,7 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
          glDisable(GL_RASTERIZER_DISCARD);
    }
 
-   if (state->offset_tri) {
-      glEnable(GL_POLYGON_OFFSET_FILL);
-   } else {
-      glDisable(GL_POLYGON_OFFSET_FILL);
-   }
+   vrend_set_cap(ctx, VREND_CAP_POLYGON_OFFSET_FILL, state->offset_tri);
 
    if (state->flatshade != ctx->sub->hw_rs_state.flatshade) {
       ctx->sub->hw_rs_state.flatshade = state->flatshade;
@@ -4052,7 +6169,7 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
       ctx->sub->hw_rs_state.flatshade_first = state->flatshade_first;
    }
 
-   glPolygonOffset(state->offset_scale, state->offset_units);
+   vrend_polygon_offset(ctx, state->offset_scale, state->offset_units);
 
    if (state->poly_stipple_enable && !ctx->pstip_inited) {
       vrend_init_pstipple_texture(ctx);
@@ -4061,39 +6178,28 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    if (state->cull_face != PIPE_FACE_NONE) {
       switch (state->cull_face) {
       case PIPE_FACE_FRONT:
-         glCullFace(GL_FRONT);
+         vrend_cull_face(ctx, GL_FRONT);
          break;
       case PIPE_FACE_BACK:
-         glCullFace(GL_BACK);
+         vrend_cull_face(ctx, GL_BACK);
          break;
       case PIPE_FACE_FRONT_AND_BACK:
-         glCullFace(GL_FRONT_AND_BACK);
+         vrend_cull_face(ctx, GL_FRONT_AND_BACK);
          break;
       }
-      glEnable(GL_CULL_FACE);
+      vrend_set_cap(ctx, VREND_CAP_CULL_FACE, true);
    } else
-      glDisable(GL_CULL_FACE);
+      vrend_set_cap(ctx, VREND_CAP_CULL_FACE, false);
 
    if (has_feature(feat_multisample)) {
-      if (has_feature(feat_sample_mask)) {
-	 if (state->multisample)
-	    glEnable(GL_SAMPLE_MASK);
-	 else
-	    glDisable(GL_SAMPLE_MASK);
-      }
+      if (has_feature(feat_sample_mask))
+         vrend_set_cap(ctx, VREND_CAP_SAMPLE_MASK, state->multisample);
 
-      if (has_feature(feat_sample_shading)) {
-         if (state->force_persample_interp)
-            glEnable(GL_SAMPLE_SHADING);
-         else
-            glDisable(GL_SAMPLE_SHADING);
-      }
+      if (has_feature(feat_sample_shading))
+         vrend_set_cap(ctx, VREND_CAP_SAMPLE_SHADING, state->force_persample_interp);
    }
 
-   if (state->scissor)
-      glEnable(GL_SCISSOR_TEST);
-   else
-      glDisable(GL_SCISSOR_TEST);
+   vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, state->scissor);
    ctx->sub->hw_rs_state.scissor = state->scissor;
 
 }
@@ -4198,12 +6304,20 @@ static void vrend_apply_sampler_state(struct vrend_context *ctx,
    }
 
    if (has_feature(feat_samplers)) {
-      int sampler = vstate->ids[tview->srgb_decode == GL_SKIP_DECODE_EXT ? 0 : 1];
+      struct vrend_sampler_entry *entry = vstate->entry;
+      int index = tview->srgb_decode == GL_SKIP_DECODE_EXT ? 0 : 1;
       union pipe_color_union border_color;
-      if (get_swizzled_border_color(tview->format, &state->border_color, &border_color))
-         glSamplerParameterIuiv(sampler, GL_TEXTURE_BORDER_COLOR, border_color.ui);
 
-      glBindSampler(sampler_id, sampler);
+      /* the shared sampler keeps the color of its last bind, only touch it
+       * when this view needs a different one */
+      if (!get_swizzled_border_color(tview->format, &state->border_color, &border_color))
+         border_color = state->border_color;
+      if (memcmp(entry->border_color[index], border_color.ui, sizeof(border_color.ui))) {
+         glSamplerParameterIuiv(entry->ids[index], GL_TEXTURE_BORDER_COLOR, border_color.ui);
+         memcpy(entry->border_color[index], border_color.ui, sizeof(border_color.ui));
+      }
+
+      vrend_bind_sampler_unit(ctx, sampler_id, entry->ids[index]);
       return;
    }
 
@@ -4307,12 +6421,18 @@ int vrend_renderer_init(struct virgl_client *client, struct vrend_if_cbs *cbs)
 
    gles_ver = vrend_gl_version();
 
+   pipe_mutex_lock(vrend_global_lock);
    if (!features_initialized) {
       features_initialized = true;
       init_features(gles_ver);
+      init_multi_draw(gles_ver);
+      init_parallel_compile();
+      init_texture_view();
    }
 
-   glGetIntegerv(GL_MAX_DRAW_BUFFERS, (GLint *)&client->vrend_state->max_draw_buffers);
+   if (cached_max_draw_buffers < 0)
+      glGetIntegerv(GL_MAX_DRAW_BUFFERS, &cached_max_draw_buffers);
+   client->vrend_state->max_draw_buffers = cached_max_draw_buffers;
 
    vrend_resource_set_destroy_callback(vrend_destroy_resource_object);
    vrend_object_set_destroy_callback(VIRGL_OBJECT_QUERY, vrend_destroy_query_object);
@@ -4322,15 +6442,23 @@ int vrend_renderer_init(struct virgl_client *client, struct vrend_if_cbs *cbs)
    vrend_object_set_destroy_callback(VIRGL_OBJECT_STREAMOUT_TARGET, vrend_destroy_so_target_object);
    vrend_object_set_destroy_callback(VIRGL_OBJECT_SAMPLER_STATE, vrend_destroy_sampler_state_object);
    vrend_object_set_destroy_callback(VIRGL_OBJECT_VERTEX_ELEMENTS, vrend_destroy_vertex_elements_object);
+   vrend_object_set_destroy_callback(VIRGL_OBJECT_BLEND, vrend_destroy_slab_object);
+   vrend_object_set_destroy_callback(VIRGL_OBJECT_DSA, vrend_destroy_slab_object);
+   vrend_object_set_destroy_callback(VIRGL_OBJECT_RASTERIZER, vrend_destroy_slab_object);
 
    if (!tex_conv_table_initialized) {
        tex_conv_table_initialized = true;
        vrend_build_format_list();
        vrend_check_texture_storage(tex_conv_table);
    }
+   pipe_mutex_unlock(vrend_global_lock);
 
    list_inithead(&client->vrend_state->fence_list);
    list_inithead(&client->vrend_state->fence_wait_list);
+   client->vrend_state->next_fence_id = 1;
+   client->vrend_state->defer_deletes = true;
+   list_inithead(&client->vrend_state->readback_list);
+   list_inithead(&client->vrend_state->readback_free_list);
    list_inithead(&client->vrend_state->waiting_query_list);
    list_inithead(&client->vrend_state->active_ctx_list);
    /* create 0 context */
@@ -4348,11 +6476,33 @@ vrend_renderer_fini(struct virgl_client *client)
    typedef  void (*destroy_callback)(void *);
    vrend_resource_set_destroy_callback((destroy_callback)vrend_renderer_resource_destroy);
 
+   vrend_renderer_fini_readbacks(client);
+   vrend_upload_ring_destroy(client->vrend_state->upload_ring);
+   client->vrend_state->upload_ring = NULL;
+   vrend_readback_compute_destroy(client->vrend_state->readback_compute);
+   client->vrend_state->readback_compute = NULL;
    vrend_blitter_fini(client);
    vrend_decode_reset(client, false);
    vrend_object_fini_resource_table(client);
+
+   /* context 0 is still current, what it destroys is deleted right away */
+   vrend_drain_deletes(client->vrend_state, UINT32_MAX);
+   free(client->vrend_state->deferred_deletes);
+   client->vrend_state->deferred_deletes = NULL;
+   client->vrend_state->max_deferred_deletes = 0;
+   client->vrend_state->defer_deletes = false;
    vrend_decode_reset(client, true);
 
+   /* emptied by the sampler states destroyed above */
+   if (client->vrend_state->sampler_cache) {
+      util_hash_table_destroy(client->vrend_state->sampler_cache);
+      client->vrend_state->sampler_cache = NULL;
+   }
+
+   /* every job belonged to a shader or program destroyed above */
+   vrend_compile_pool_destroy(client->vrend_state->compile_pool);
+   client->vrend_state->compile_pool = NULL;
+
    client->vrend_state->current_ctx = NULL;
    client->vrend_state->current_hw_ctx = NULL;
 }
@@ -4362,8 +6512,10 @@ static void vrend_destroy_sub_context(struct virgl_client *client, struct vrend_
    int i, j;
    struct vrend_streamout_object *obj, *tmp;
 
-   if (sub->fb_id)
-      glDeleteFramebuffers(1, &sub->fb_id);
+   for (i = 0; i < VREND_FB_CACHE_SIZE; i++)
+      vrend_fb_cache_evict(&sub->fb_cache[i]);
+   if (sub->base_fb_id)
+      glDeleteFramebuffers(1, &sub->base_fb_id);
 
    if (sub->blit_fb_ids[0])
       glDeleteFramebuffers(2, sub->blit_fb_ids);
@@ -4371,6 +6523,8 @@ static void vrend_destroy_sub_context(struct virgl_client *client, struct vrend_
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
    if (!has_feature(feat_gles31_vertex_attrib_binding)) {
+      vrend_vao_cache_flush(sub);
+      glBindVertexArray(sub->vaoid);
       while (sub->enabled_attribs_bitmask) {
          i = u_bit_scan(&sub->enabled_attribs_bitmask);
 
@@ -4394,11 +6548,15 @@ static void vrend_destroy_sub_context(struct virgl_client *client, struct vrend_
    vrend_shader_state_reference(&sub->shaders[PIPE_SHADER_TESS_CTRL], NULL);
    vrend_shader_state_reference(&sub->shaders[PIPE_SHADER_TESS_EVAL], NULL);
    vrend_shader_state_reference(&sub->shaders[PIPE_SHADER_COMPUTE], NULL);
+   for (i = 0; i < VREND_PASSTHROUGH_TCS_CACHE_SIZE; i++)
+      vrend_shader_state_reference(&sub->passthrough_tcs[i], NULL);
 
    if (sub->prog)
       sub->prog->ref_context = NULL;
 
    vrend_free_programs(sub);
+   if (sub->const_ring.id)
+      glDeleteBuffers(1, &sub->const_ring.id);
    for (i = 0; i < PIPE_SHADER_TYPES; i++) {
       free(sub->consts[i].consts);
       sub->consts[i].consts = NULL;
@@ -4420,7 +6578,13 @@ static void vrend_destroy_sub_context(struct virgl_client *client, struct vrend_
    vrend_resource_reference((struct vrend_resource **)&sub->ib.buffer, NULL);
 
    vrend_object_fini_ctx_table(sub->object_hash);
+   for (i = 0; i < VIRGL_MAX_OBJECTS; i++)
+      vrend_slab_fini(&sub->object_slabs[i]);
+   util_hash_table_destroy(sub->program_hash);
+   util_hash_table_destroy(sub->vao_hash);
    vrend_clicbs->destroy_gl_context(client, sub->gl_context);
+   if (client->vrend_state->current_sub == sub)
+      client->vrend_state->current_sub = NULL;
 
    list_del(&sub->head);
    FREE(sub);
@@ -4437,8 +6601,10 @@ bool vrend_destroy_context(struct vrend_context *ctx)
       ctx->client->vrend_state->current_hw_ctx = NULL;
    }
 
-   if (ctx->pstip_inited)
+   if (ctx->pstip_inited) {
       glDeleteTextures(1, &ctx->pstipple_tex_id);
+      vrend_shadow_textures_clobbered();
+   }
    ctx->pstip_inited = false;
 
    /* reset references on framebuffers */
@@ -4490,6 +6656,10 @@ struct vrend_context *vrend_create_context(struct virgl_client *client, int id)
    grctx->shader_cfg.use_explicit_locations = client->vrend_state->use_explicit_locations;
    grctx->shader_cfg.max_draw_buffers = client->vrend_state->max_draw_buffers;
    grctx->shader_cfg.has_es31_compat = has_feature(feat_gles31_compatibility);
+   if (client->vrend_state->const_ubo) {
+      grctx->shader_cfg.max_const_ubo_consts = client->vrend_state->const_ubo_max_consts;
+      grctx->shader_cfg.max_uniform_blocks = client->vrend_state->const_ubo_max_blocks;
+   }
 
    vrend_renderer_create_sub_ctx(grctx, 0);
    vrend_renderer_set_sub_ctx(grctx, 0);
@@ -4541,6 +6711,7 @@ void vrend_renderer_resource_detach_iov(struct virgl_client *client, int res_han
             res->ptr, res->base.width0);
    }
 
+   vrend_renderer_finish_readbacks(client, res);
    res->iov = NULL;
    res->num_iovs = 0;
 }
@@ -4732,10 +6903,34 @@ vrend_renderer_resource_copy_args(struct vrend_renderer_resource_create_args *ar
    gr->base.array_size = args->array_size;
 }
 
-static int vrend_renderer_resource_allocate_texture(struct vrend_resource *gr)
+/* Only single level 2D color buffers that can end up on screen are worth
+ * backing with a presentable buffer, everything else keeps GL storage. */
+static bool vrend_resource_wants_scanout_buffer(struct vrend_resource *gr)
+{
+   struct pipe_resource *pr = &gr->base;
+
+   return vrend_clicbs->create_scanout_buffer &&
+          (pr->bind & (VIRGL_BIND_SCANOUT | VIRGL_BIND_DISPLAY_TARGET)) &&
+          pr->target == PIPE_TEXTURE_2D && pr->nr_samples <= 1 &&
+          pr->last_level == 0 && pr->array_size <= 1;
+}
+
+static uint64_t vrend_resource_texture_size(const struct pipe_resource *pr)
 {
+   uint64_t size = 0;
    uint level;
-   GLenum internalformat, glformat, gltype;
+
+   for (level = 0; level <= pr->last_level; level++) {
+      uint32_t depth = pr->target == PIPE_TEXTURE_3D ? u_minify(pr->depth0, level) : pr->array_size;
+      size += (uint64_t)util_format_get_nblocks(pr->format, u_minify(pr->width0, level),
+                                                u_minify(pr->height0, level)) *
+              util_format_get_blocksize(pr->format) * MAX2(depth, 1);
+   }
+   return size * MAX2(pr->nr_samples, 1);
+}
+
+static int vrend_renderer_resource_allocate_texture(struct vrend_resource *gr)
+{
    enum virgl_formats format = gr->base.format;
    struct vrend_texture *gt = (struct vrend_texture *)gr;
    struct pipe_resource *pr = &gr->base;
@@ -4763,20 +6958,52 @@ static int vrend_renderer_resource_allocate_texture(struct vrend_resource *gr)
    gr->target = translate_gles_emulation_texture_target(gr->target);
    gr->storage_bits |= VREND_STORAGE_GL_TEXTURE;
 
+   if (tex_conv_table[format].internalformat == 0)
+      return EINVAL;
+
+   /* the storage follows on first use, render targets created at level
+    * load and never drawn to then never take up any memory */
    glGenTextures(1, &gr->id);
+   gr->storage_pending = true;
+
+   gt->state.max_lod = -1;
+   gt->cur_swizzle_r = gt->cur_swizzle_g = gt->cur_swizzle_b = gt->cur_swizzle_a = -1;
+   gt->cur_base = -1;
+   gt->cur_max = 10000;
+   return 0;
+}
+
+/* Allocates the storage of a texture created by
+ * vrend_renderer_resource_allocate_texture, called before anything reads,
+ * writes, attaches or views the texture */
+void vrend_resource_ensure_storage(struct vrend_resource *gr)
+{
+   uint level;
+   GLenum internalformat, glformat, gltype;
+   enum virgl_formats format = gr->base.format;
+   struct pipe_resource *pr = &gr->base;
+   bool format_can_texture_storage = has_bit(gr->storage_bits, VREND_STORAGE_GL_IMMUTABLE);
+
+   if (!gr->storage_pending)
+      return;
+   gr->storage_pending = false;
+   gr->gl_size = vrend_resource_texture_size(pr);
+
    glBindTexture(gr->target, gr->id);
+   vrend_shadow_textures_bound(gr->state);
 
    internalformat = tex_conv_table[format].internalformat;
    glformat = tex_conv_table[format].glformat;
    gltype = tex_conv_table[format].gltype;
 
-   if (internalformat == 0) {
-      glBindTexture(gr->target, 0);
-      FREE(gt);
-      return EINVAL;
-   }
+   if (gr->target == GL_TEXTURE_2D && vrend_resource_wants_scanout_buffer(gr))
+      gr->scanout_buffer = vrend_clicbs->create_scanout_buffer(pr->width0, pr->height0, format);
 
-   if (pr->nr_samples > 0) {
+   if (gr->scanout_buffer) {
+      /* storage comes from the buffer's EGLImage, which is never immutable */
+      gr->storage_bits &= ~VREND_STORAGE_GL_IMMUTABLE;
+      format_can_texture_storage = false;
+   } else if (pr->nr_samples > 0) {
       if (format_can_texture_storage) {
          if (gr->target == GL_TEXTURE_2D_MULTISAMPLE) {
             glTexStorage2DMultisample(gr->target, pr->nr_samples,
@@ -4842,12 +7069,6 @@ static int vrend_renderer_resource_allocate_texture(struct vrend_resource *gr)
    }
 
    glBindTexture(gr->target, 0);
-
-   gt->state.max_lod = -1;
-   gt->cur_swizzle_r = gt->cur_swizzle_g = gt->cur_swizzle_b = gt->cur_swizzle_a = -1;
-   gt->cur_base = -1;
-   gt->cur_max = 10000;
-   return 0;
 }
 
 int vrend_renderer_resource_create(struct virgl_client *client, struct vrend_renderer_resource_create_args *args, struct iovec *iov, uint32_t num_iovs)
@@ -4863,7 +7084,9 @@ int vrend_renderer_resource_create(struct virgl_client *client, struct vrend_ren
    if (!gr)
       return ENOMEM;
 
+   vrend_resource_new_contents(gr);
    vrend_renderer_resource_copy_args(args, gr);
+   gr->state = client->vrend_state;
    gr->iov = iov;
    gr->num_iovs = num_iovs;
    gr->storage_bits = VREND_STORAGE_GUEST_MEMORY;
@@ -4930,6 +7153,9 @@ int vrend_renderer_resource_create(struct virgl_client *client, struct vrend_ren
       }
    }
 
+   if (has_bit(gr->storage_bits, VREND_STORAGE_GL_BUFFER))
+      gr->gl_size = args->width;
+
    ret = vrend_resource_insert(client, gr, args->handle);
    if (ret == 0) {
       vrend_renderer_resource_destroy(gr);
@@ -4944,11 +7170,20 @@ void vrend_renderer_resource_destroy(struct vrend_resource *res)
       glDeleteFramebuffers(1, &res->readback_fb_id);
 
    if (has_bit(res->storage_bits, VREND_STORAGE_GL_TEXTURE)) {
-      glDeleteTextures(1, &res->id);
+      if (res->scanout_buffer) {
+         /* the buffer backing the storage can't outlive the texture */
+         glDeleteTextures(1, &res->id);
+         vrend_shadow_textures_clobbered();
+         vrend_shadow_indexed_clobbered();
+         vrend_clicbs->destroy_scanout_buffer(res->scanout_buffer);
+      } else {
+         vrend_delete_later(res->state, VREND_DELETE_TEXTURE, res->id, res->fence_id);
+      }
    } else if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
-      glDeleteBuffers(1, &res->id);
-      if (res->tbo_tex_id)
-         glDeleteTextures(1, &res->tbo_tex_id);
+      vrend_delete_later(res->state, VREND_DELETE_BUFFER, res->id, res->fence_id);
+      if (res->vao_cached)
+         __atomic_add_fetch(&vao_cache_generation, 1, __ATOMIC_RELAXED);
+      vrend_delete_later(res->state, VREND_DELETE_TEXTURE, res->tbo_tex_id, res->fence_id);
    } else if (has_bit(res->storage_bits, VREND_STORAGE_HOST_SYSTEM_MEMORY)) {
       free(res->ptr);
    }
@@ -4998,8 +7233,22 @@ static void vrend_scale_depth(void *ptr, int size, float scale_val)
 {
    GLuint *ival = ptr;
    const GLfloat myscale = 1.0f / 0xffffff;
-   int i;
-   for (i = 0; i < size / 4; i++) {
+   int i = 0;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+   /* same operation order as the scalar loop, so results are bit identical */
+   const float32x4_t vmyscale = vdupq_n_f32(myscale);
+   const float32x4_t vscale = vdupq_n_f32(scale_val);
+   const float32x4_t vzero = vdupq_n_f32(0.0f);
+   const float32x4_t vone = vdupq_n_f32(1.0f);
+   for (; i + 4 <= size / 4; i += 4) {
+      float32x4_t d = vcvtq_f32_u32(vshrq_n_u32(vld1q_u32(&ival[i]), 8));
+      d = vmulq_f32(vmulq_f32(d, vmyscale), vscale);
+      d = vminq_f32(vmaxq_f32(d, vzero), vone);
+      d = vdivq_f32(d, vmyscale);
+      vst1q_u32(&ival[i], vreinterpretq_u32_s32(vshlq_n_s32(vcvtq_s32_f32(d), 8)));
+   }
+#endif
+   for (; i < size / 4; i++) {
       GLuint value = ival[i];
       GLfloat d = ((float)(value >> 8) * myscale) * scale_val;
       d = CLAMP(d, 0.0F, 1.0F);
@@ -5023,17 +7272,23 @@ static void read_transfer_data(struct iovec *iov,
                                               box->height) * blsize * box->depth;
    uint32_t bwx = util_format_get_nblocksx(format, box->width) * blsize;
    int32_t bh = util_format_get_nblocksy(format, box->height);
+   struct vrend_iov_cursor cursor;
    int d, h;
 
-   if ((send_size == size || bh == 1) && !invert && box->depth == 1)
+   /* a box whose rows and layers the guest stored back to back is one read */
+   bool contiguous = (bh == 1 || src_stride == bwx) &&
+                     (box->depth == 1 || src_layer_stride == bh * bwx);
+
+   if (!invert && (contiguous || ((send_size == size || bh == 1) && box->depth == 1)))
       vrend_read_from_iovec(iov, num_iovs, offset, data, send_size);
    else {
+      vrend_iov_cursor_init(&cursor, iov, num_iovs);
       if (invert) {
          for (d = 0; d < box->depth; d++) {
             uint32_t myoffset = offset + d * src_layer_stride;
             for (h = bh - 1; h >= 0; h--) {
                void *ptr = data + (h * bwx) + d * (bh * bwx);
-               vrend_read_from_iovec(iov, num_iovs, myoffset, ptr, bwx);
+               vrend_iov_cursor_read(&cursor, myoffset, ptr, bwx);
                myoffset += src_stride;
             }
          }
@@ -5042,7 +7297,7 @@ static void read_transfer_data(struct iovec *iov,
             uint32_t myoffset = offset + d * src_layer_stride;
             for (h = 0; h < bh; h++) {
                void *ptr = data + (h * bwx) + d * (bh * bwx);
-               vrend_read_from_iovec(iov, num_iovs, myoffset, ptr, bwx);
+               vrend_iov_cursor_read(&cursor, myoffset, ptr, bwx);
                myoffset += src_stride;
             }
          }
@@ -5066,17 +7321,22 @@ static void write_transfer_data(struct pipe_resource *res,
                                                 box->height) * blsize * box->depth;
    uint32_t bwx = util_format_get_nblocksx(res->format, box->width) * blsize;
    int32_t bh = util_format_get_nblocksy(res->format, box->height);
+   struct vrend_iov_cursor cursor;
    int d, h;
    uint32_t stride = dst_stride ? dst_stride : util_format_get_nblocksx(res->format, u_minify(res->width0, level)) * blsize;
 
    if ((send_size == size || bh == 1) && !invert && box->depth == 1) {
       vrend_write_to_iovec(iov, num_iovs, offset, data, send_size);
-   } else if (invert) {
+      return;
+   }
+
+   vrend_iov_cursor_init(&cursor, iov, num_iovs);
+   if (invert) {
       for (d = 0; d < box->depth; d++) {
          uint32_t myoffset = offset + d * stride * u_minify(res->height0, level);
          for (h = bh - 1; h >= 0; h--) {
             void *ptr = data + (h * bwx) + d * (bh * bwx);
-            vrend_write_to_iovec(iov, num_iovs, myoffset, ptr, bwx);
+            vrend_iov_cursor_write(&cursor, myoffset, ptr, bwx);
             myoffset += stride;
          }
       }
@@ -5085,7 +7345,7 @@ static void write_transfer_data(struct pipe_resource *res,
          uint32_t myoffset = offset + d * stride * u_minify(res->height0, level);
          for (h = 0; h < bh; h++) {
             void *ptr = data + (h * bwx) + d * (bh * bwx);
-            vrend_write_to_iovec(iov, num_iovs, myoffset, ptr, bwx);
+            vrend_iov_cursor_write(&cursor, myoffset, ptr, bwx);
             myoffset += stride;
          }
       }
@@ -5230,6 +7490,113 @@ static bool check_iov_bounds(struct vrend_resource *res,
    return true;
 }
 
+/* Stages a buffer upload through the upload ring and copies it into place
+ * on the GPU, so it neither waits for nor renames buffers still in use. */
+static bool vrend_buffer_upload_staged(struct vrend_context *ctx,
+                                       struct vrend_resource *res,
+                                       struct iovec *iov, int num_iovs,
+                                       const struct vrend_transfer_info *info)
+{
+   struct vrend_state *state = ctx->client->vrend_state;
+   uint32_t size = info->box->width;
+   uint32_t offset;
+   void *data;
+
+   if (size > VREND_UPLOAD_RING_MAX_UPLOAD)
+      return false;
+
+   if (!state->upload_ring) {
+      state->upload_ring = vrend_upload_ring_create(VREND_UPLOAD_RING_SIZE);
+      if (!state->upload_ring)
+         return false;
+   }
+
+   data = vrend_upload_ring_map(state->upload_ring, size, &offset);
+   if (!data)
+      return false;
+
+   vrend_read_from_iovec(iov, num_iovs, info->offset, data, size);
+   vrend_upload_ring_unmap(state->upload_ring, state->next_fence_id);
+
+   glBindBuffer(GL_COPY_READ_BUFFER, vrend_upload_ring_buffer(state->upload_ring));
+   glBindBuffer(GL_COPY_WRITE_BUFFER, res->id);
+   glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, info->box->x, size);
+   glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+   glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+   vrend_resource_set_fence(state, res, state->next_fence_id);
+   return true;
+}
+
+/* A buffer whose last fence already signaled has no GPU work left to
+ * wait for, so a contiguous guest range is copied straight into an
+ * unsynchronized mapping instead of going through the upload ring. */
+static bool vrend_buffer_upload_direct(struct vrend_context *ctx,
+                                       struct vrend_resource *res,
+                                       struct iovec *iov, int num_iovs,
+                                       const struct vrend_transfer_info *info)
+{
+   struct vrend_state *state = ctx->client->vrend_state;
+   uint32_t size = info->box->width;
+   void *data;
+
+   if (num_iovs != 1 || info->offset + size > iov[0].iov_len)
+      return false;
+
+   if (res->fence_id > state->last_signaled_fence_id)
+      return false;
+
+   glBindBuffer(res->target, res->id);
+   data = glMapBufferRange(res->target, info->box->x, size,
+                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                           GL_MAP_UNSYNCHRONIZED_BIT);
+   if (!data) {
+      glBindBuffer(res->target, 0);
+      return false;
+   }
+
+   memcpy(data, (char *)iov[0].iov_base + info->offset, size);
+   glUnmapBuffer(res->target);
+   glBindBuffer(res->target, 0);
+   return true;
+}
+
+/* Stages the size bytes of texels a texture upload reads into the upload
+ * ring and binds it for unpacking, so glTexSubImage sources a buffer the
+ * driver copies from on the GPU instead of the decode thread waiting while
+ * it copies client memory.  Returns the pixels argument for the upload,
+ * data itself when it stays a client memory upload. */
+static const void *vrend_texture_upload_staged(struct vrend_context *ctx,
+                                               const void *data, uint32_t size,
+                                               bool *staged)
+{
+   struct vrend_state *state;
+   uint32_t offset;
+   void *ptr;
+
+   *staged = false;
+   if (!ctx || !size || size > VREND_UPLOAD_RING_MAX_UPLOAD)
+      return data;
+
+   state = ctx->client->vrend_state;
+   if (!state->upload_ring) {
+      state->upload_ring = vrend_upload_ring_create(VREND_UPLOAD_RING_SIZE);
+      if (!state->upload_ring)
+         return data;
+   }
+
+   ptr = vrend_upload_ring_map(state->upload_ring, size, &offset);
+   if (!ptr)
+      return data;
+
+   memcpy(ptr, data, size);
+   vrend_upload_ring_unmap(state->upload_ring, state->next_fence_id);
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, vrend_upload_ring_buffer(state->upload_ring));
+   *staged = true;
+   return (const void *)(uintptr_t)offset;
+}
+
 static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
                                              struct vrend_resource *res,
                                              struct iovec *iov, int num_iovs,
@@ -5237,6 +7604,9 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
 {
    void *data;
 
+   vrend_resource_ensure_storage(res);
+   vrend_resource_new_contents(res);
+
    if (is_only_bit(res->storage_bits, VREND_STORAGE_GUEST_MEMORY) ||
        (has_bit(res->storage_bits, VREND_STORAGE_HOST_SYSTEM_MEMORY) && res->iov)) {
       return vrend_copy_iovec(iov, num_iovs, info->offset,
@@ -5259,6 +7629,10 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
 
       if (!info->synchronized)
          map_flags |= GL_MAP_UNSYNCHRONIZED_BIT;
+      else if (ctx && vrend_buffer_upload_direct(ctx, res, iov, num_iovs, info))
+         return 0;
+      else if (ctx && vrend_buffer_upload_staged(ctx, res, iov, num_iovs, info))
+         return 0;
 
       glBindBuffer(res->target, res->id);
       data = glMapBufferRange(res->target, info->box->x, info->box->width, map_flags);
@@ -5276,9 +7650,14 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
       int elsize = util_format_get_blocksize(res->base.format);
       int x = 0, y = 0;
       bool compressed;
+      bool decode;
+      int unpack_elsize = elsize;
       bool invert = false;
       float depth_scale;
       GLuint send_size = 0;
+      uint32_t upload_size;
+      const void *pixels;
+      bool staged;
       uint32_t stride = info->stride;
       uint32_t layer_stride = info->layer_stride;
 
@@ -5295,6 +7674,7 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
                                                 u_minify(res->base.height0, info->level));
 
       compressed = util_format_is_compressed(res->base.format);
+      decode = tex_conv_table[res->base.format].flags & VIRGL_TEXTURE_NEED_DECODE;
       if (num_iovs > 1 || compressed) {
          need_temp = true;
       }
@@ -5311,17 +7691,79 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
           res->target == GL_TEXTURE_2D_ARRAY ||
           res->target == GL_TEXTURE_CUBE_MAP_ARRAY)
           send_size *= info->box->depth;
+      upload_size = send_size;
+
+      /* The blocks of a compressed box in a single iov are read in place
+       * when no copy is needed to pack them: the decoder takes the guest
+       * strides as they are, GL only rows and layers stored back to back. */
+      uint32_t block_stride = util_format_get_nblocksx(res->base.format, info->box->width) * elsize;
+      uint32_t block_rows = util_format_get_nblocksy(res->base.format, info->box->height);
+      uint32_t slices = block_stride && block_rows ? send_size / (block_stride * block_rows) : 0;
+      bool in_place = false;
+
+      if (compressed && num_iovs == 1 && !invert && slices && info->offset <= iov[0].iov_len &&
+          (uint64_t)(slices - 1) * layer_stride + (uint64_t)(block_rows - 1) * stride +
+          block_stride <= iov[0].iov_len - info->offset)
+         in_place = decode || ((block_rows == 1 || stride == block_stride) &&
+                               (slices == 1 || layer_stride == block_stride * block_rows));
+
+      if (need_temp && in_place && !decode) {
+         data = (char*)iov[0].iov_base + info->offset;
+      } else if (need_temp) {
+         uint32_t src_stride = block_stride;
+         uint32_t src_slice = slices ? send_size / slices : 0;
+
+         if (in_place) {
+            data = (char*)iov[0].iov_base + info->offset;
+            src_stride = stride;
+            src_slice = layer_stride;
+         } else {
+            data = malloc(send_size);
+            if (!data)
+               return ENOMEM;
+            read_transfer_data(iov, num_iovs, data, res->base.format, info->offset,
+                               stride, layer_stride, info->box, invert);
+         }
 
-      if (need_temp) {
-         data = malloc(send_size);
-         if (!data)
-            return ENOMEM;
-         read_transfer_data(iov, num_iovs, data, res->base.format, info->offset,
-                            stride, layer_stride, info->box, invert);
+         /* the guest keeps the blocks, the driver gets plain texels */
+         if (decode) {
+            uint32_t texel_size = vrend_texture_decode_texel_size(res->base.format);
+            uint32_t slice_size = info->box->width * info->box->height * texel_size;
+            uint8_t *texels = malloc(slice_size * slices);
+            if (!texels) {
+               if (!in_place)
+                  free(data);
+               return ENOMEM;
+            }
+            for (uint32_t slice = 0; slice < slices; slice++)
+               vrend_texture_decode(res->base.format, (uint8_t *)data + slice * src_slice,
+                                    src_stride, texels + slice * slice_size,
+                                    info->box->width * texel_size,
+                                    info->box->width, info->box->height);
+            if (!in_place)
+               free(data);
+            data = texels;
+            in_place = false;
+            compressed = false;
+            unpack_elsize = texel_size;
+            upload_size = slice_size * slices;
+         }
       } else {
+         bool layered = res->target == GL_TEXTURE_3D ||
+                        res->target == GL_TEXTURE_2D_ARRAY ||
+                        res->target == GL_TEXTURE_CUBE_MAP_ARRAY;
+         uint32_t rows = res->target == GL_TEXTURE_1D_ARRAY ? info->box->depth : info->box->height;
+
          if (send_size > iov[0].iov_len - info->offset)
             return EINVAL;
          data = (char*)iov[0].iov_base + info->offset;
+
+         /* the rows as the unpack row length and image height lay them out,
+          * only staged when the guest really has all of them */
+         upload_size = (layered ? info->box->depth - 1 : 0) * layer_stride +
+                       (rows ? rows - 1 : 0) * stride + info->box->width * elsize;
+         if ((uint64_t)upload_size > iov[0].iov_len - info->offset)
+            upload_size = 0;
       }
 
       if (!need_temp) {
@@ -5331,7 +7773,7 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
       } else
          glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
-      switch (elsize) {
+      switch (unpack_elsize) {
       case 1:
       case 3:
          glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -5354,6 +7796,7 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
 
       uint32_t comp_size;
       glBindTexture(res->target, res->id);
+      vrend_shadow_textures_bound(ctx->client->vrend_state);
 
       if (compressed) {
          glformat = tex_conv_table[res->base.format].internalformat;
@@ -5388,64 +7831,178 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
          depth_scale = 256.0;
          vrend_scale_depth(data, send_size, depth_scale);
       }
+
+      pixels = vrend_texture_upload_staged(ctx, data, upload_size, &staged);
+
       if (res->target == GL_TEXTURE_CUBE_MAP) {
          GLenum ctarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + info->box->z;
          if (compressed) {
             glCompressedTexSubImage2D(ctarget, info->level, x, y,
                                       info->box->width, info->box->height,
-                                      glformat, comp_size, data);
+                                      glformat, comp_size, pixels);
          } else {
             glTexSubImage2D(ctarget, info->level, x, y, info->box->width, info->box->height,
-                            glformat, gltype, data);
+                            glformat, gltype, pixels);
          }
       } else if (res->target == GL_TEXTURE_3D || res->target == GL_TEXTURE_2D_ARRAY || res->target == GL_TEXTURE_CUBE_MAP_ARRAY) {
          if (compressed) {
             glCompressedTexSubImage3D(res->target, info->level, x, y, info->box->z,
                                       info->box->width, info->box->height, info->box->depth,
-                                      glformat, comp_size, data);
+                                      glformat, comp_size, pixels);
          } else {
             glTexSubImage3D(res->target, info->level, x, y, info->box->z,
                             info->box->width, info->box->height, info->box->depth,
-                            glformat, gltype, data);
+                            glformat, gltype, pixels);
          }
       } else {
          if (compressed) {
             glCompressedTexSubImage2D(res->target, info->level, x, res->target == GL_TEXTURE_1D_ARRAY ? info->box->z : y,
                                       info->box->width, info->box->height,
-                                      glformat, comp_size, data);
+                                      glformat, comp_size, pixels);
          } else {
             glTexSubImage2D(res->target, info->level, x, res->target == GL_TEXTURE_1D_ARRAY ? info->box->z : y,
                             info->box->width,
                             res->target == GL_TEXTURE_1D_ARRAY ? info->box->depth : info->box->height,
-                            glformat, gltype, data);
+                            glformat, gltype, pixels);
          }
       }
 
-      glBindTexture(res->target, 0);
+      glBindTexture(res->target, 0);
+      if (staged)
+         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+      if (stride && !need_temp) {
+         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+         glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+      }
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+      if (need_temp && !in_place)
+         free(data);
+   }
+   return 0;
+}
+
+static uint32_t vrend_get_texture_depth(struct vrend_resource *res, uint32_t level)
+{
+   uint32_t depth = 1;
+   if (res->target == GL_TEXTURE_3D)
+      depth = u_minify(res->base.depth0, level);
+   else if (res->target == GL_TEXTURE_1D_ARRAY || res->target == GL_TEXTURE_2D_ARRAY ||
+            res->target == GL_TEXTURE_CUBE_MAP || res->target == GL_TEXTURE_CUBE_MAP_ARRAY)
+      depth = res->base.array_size;
+
+   return depth;
+}
+
+static struct vrend_readback *vrend_readback_alloc(struct vrend_state *state, uint32_t size)
+{
+   struct vrend_readback *rb = NULL;
+
+   if (!LIST_IS_EMPTY(&state->readback_free_list)) {
+      rb = LIST_ENTRY(struct vrend_readback, state->readback_free_list.next, head);
+      list_del(&rb->head);
+      state->num_free_readbacks--;
+   } else {
+      rb = CALLOC_STRUCT(vrend_readback);
+      if (!rb)
+         return NULL;
+      glGenBuffers(1, &rb->pbo);
+   }
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+   if (rb->pbo_size < size) {
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+      rb->pbo_size = size;
+   }
+   return rb;
+}
+
+static void vrend_readback_free(struct vrend_state *state, struct vrend_readback *rb)
+{
+   if (rb->sync) {
+      glDeleteSync(rb->sync);
+      rb->sync = NULL;
+   }
+   rb->res = NULL;
 
-      if (stride && !need_temp) {
-         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-         glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
-      }
+   if (state->num_free_readbacks < VREND_READBACK_POOL_SIZE) {
+      list_addtail(&rb->head, &state->readback_free_list);
+      state->num_free_readbacks++;
+   } else {
+      glDeleteBuffers(1, &rb->pbo);
+      free(rb);
+   }
+}
 
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+static void vrend_readback_complete(struct vrend_state *state, struct vrend_readback *rb)
+{
+   struct vrend_resource *res = rb->res;
+   uint32_t size = util_format_get_nblocks(res->base.format, rb->box.width, rb->box.height) *
+                   util_format_get_blocksize(res->base.format);
+   void *data;
 
-      if (need_temp)
-         free(data);
+   list_del(&rb->head);
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+   data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+   if (data && res->iov) {
+      write_transfer_data(&res->base, res->iov, res->num_iovs, data,
+                          rb->stride, &rb->box, rb->level, rb->offset, rb->invert);
    }
-   return 0;
+   if (data)
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   vrend_readback_free(state, rb);
 }
 
-static uint32_t vrend_get_texture_depth(struct vrend_resource *res, uint32_t level)
+/* Copies out every readback whose sync has signaled, in issue order */
+static void vrend_renderer_check_readbacks(struct virgl_client *client)
 {
-   uint32_t depth = 1;
-   if (res->target == GL_TEXTURE_3D)
-      depth = u_minify(res->base.depth0, level);
-   else if (res->target == GL_TEXTURE_1D_ARRAY || res->target == GL_TEXTURE_2D_ARRAY ||
-            res->target == GL_TEXTURE_CUBE_MAP || res->target == GL_TEXTURE_CUBE_MAP_ARRAY)
-      depth = res->base.array_size;
+   struct vrend_state *state = client->vrend_state;
+   struct vrend_readback *rb, *tmp;
 
-   return depth;
+   LIST_FOR_EACH_ENTRY_SAFE(rb, tmp, &state->readback_list, head) {
+      if (glClientWaitSync(rb->sync, 0, 0) == GL_TIMEOUT_EXPIRED)
+         break;
+      vrend_readback_complete(state, rb);
+   }
+}
+
+/* The guest memory of res is going away, finish its readbacks now */
+static void vrend_renderer_finish_readbacks(struct virgl_client *client, struct vrend_resource *res)
+{
+   struct vrend_state *state = client->vrend_state;
+   struct vrend_readback *rb, *tmp;
+
+   LIST_FOR_EACH_ENTRY_SAFE(rb, tmp, &state->readback_list, head) {
+      if (rb->res != res)
+         continue;
+      glClientWaitSync(rb->sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      vrend_readback_complete(state, rb);
+   }
+}
+
+static void vrend_renderer_fini_readbacks(struct virgl_client *client)
+{
+   struct vrend_state *state = client->vrend_state;
+   struct vrend_readback *rb, *tmp;
+
+   LIST_FOR_EACH_ENTRY_SAFE(rb, tmp, &state->readback_list, head) {
+      list_del(&rb->head);
+      glDeleteSync(rb->sync);
+      glDeleteBuffers(1, &rb->pbo);
+      free(rb);
+   }
+
+   LIST_FOR_EACH_ENTRY_SAFE(rb, tmp, &state->readback_free_list, head) {
+      list_del(&rb->head);
+      glDeleteBuffers(1, &rb->pbo);
+      free(rb);
+   }
+   state->num_free_readbacks = 0;
 }
 
 static void do_readpixels(GLint x, GLint y,
@@ -5456,10 +8013,91 @@ static void do_readpixels(GLint x, GLint y,
    glReadPixels(x, y, width, height, format, type, data);
 }
 
-static int vrend_transfer_send_readpixels(struct vrend_resource *res,
+/* Converts depth and BGRA readbacks GLES can not glReadPixels with a
+ * compute shader, returns -1 to fall back to the read pixels path */
+static int vrend_transfer_send_readback_compute(struct virgl_client *client,
+                                                struct vrend_resource *res,
+                                                struct iovec *iov, int num_iovs,
+                                                const struct vrend_transfer_info *info)
+{
+   struct vrend_state *state = client->vrend_state;
+   enum virgl_formats fmt = res->base.format;
+   struct vrend_readback *rb;
+   uint32_t send_size;
+   uint32_t h = u_minify(res->base.height0, info->level);
+   GLint y1;
+   void *data;
+
+   if (!has_feature(feat_compute_shader) || !has_feature(feat_ssbo) ||
+       res->target != GL_TEXTURE_2D || res->base.nr_samples > 0 ||
+       info->box->depth != 1 || !vrend_readback_compute_supported(fmt))
+      return -1;
+   if (!vrend_format_is_ds(fmt) && (tex_conv_table[fmt].flags & VIRGL_TEXTURE_CAN_READBACK))
+      return -1;
+
+   if (!state->readback_compute) {
+      state->readback_compute = vrend_readback_compute_create();
+      if (!state->readback_compute)
+         return -1;
+   }
+
+   send_size = util_format_get_nblocks(fmt, info->box->width, info->box->height) *
+               util_format_get_blocksize(fmt);
+   rb = vrend_readback_alloc(state, send_size);
+   if (!rb)
+      return -1;
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   if (res->y_0_top)
+      y1 = h - info->box->y - info->box->height;
+   else
+      y1 = info->box->y;
+
+   if (!vrend_readback_compute_run(state->readback_compute, fmt, res->id, info->level,
+                                   info->box->x, y1, info->box->width, info->box->height,
+                                   rb->pbo)) {
+      vrend_shadow_textures_bound(state);
+      vrend_shadow_indexed_clobbered();
+      vrend_readback_free(state, rb);
+      return -1;
+   }
+   vrend_shadow_textures_bound(state);
+   vrend_shadow_indexed_clobbered();
+
+   rb->res = res;
+   rb->box = *info->box;
+   rb->level = info->level;
+   rb->stride = info->stride;
+   rb->offset = info->offset;
+   rb->invert = res->y_0_top;
+
+   if (state->async_readback && iov == res->iov) {
+      rb->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      list_addtail(&rb->head, &state->readback_list);
+      vrend_resource_set_fence(state, res, state->next_fence_id);
+      return 0;
+   }
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+   data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, send_size, GL_MAP_READ_BIT);
+   if (data) {
+      write_transfer_data(&res->base, iov, num_iovs, data, info->stride,
+                          info->box, info->level, info->offset, rb->invert);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   }
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   vrend_readback_free(state, rb);
+
+   return data ? 0 : -1;
+}
+
+static int vrend_transfer_send_readpixels(struct virgl_client *client,
+                                          struct vrend_resource *res,
                                           struct iovec *iov, int num_iovs,
                                           const struct vrend_transfer_info *info)
 {
+   struct vrend_state *state = client->vrend_state;
+   struct vrend_readback *rb = NULL;
    char *myptr = (char*)iov[0].iov_base + info->offset;
    int need_temp = 0;
    GLuint fb_id;
@@ -5474,6 +8112,9 @@ static int vrend_transfer_send_readpixels(struct vrend_resource *res,
    int row_stride = info->stride / elsize;
    GLint old_fbo;
 
+   if (!vrend_transfer_send_readback_compute(client, res, iov, num_iovs, info))
+      return 0;
+
    glUseProgram(0);
 
    enum virgl_formats fmt = res->base.format;
@@ -5489,11 +8130,25 @@ static int vrend_transfer_send_readpixels(struct vrend_resource *res,
    if (num_iovs > 1 || separate_invert)
       need_temp = 1;
 
+   /* read into a pack buffer and copy out once the GPU got there, the
+    * guest waits for that through the resource's fence */
+   if (state->async_readback && iov == res->iov && info->box->depth == 1 &&
+       res->base.format != VIRGL_FORMAT_Z24X8_UNORM)
+      need_temp = 1;
+   else
+      state = NULL;
+
    if (need_temp) {
       send_size = util_format_get_nblocks(res->base.format, info->box->width, info->box->height) * info->box->depth * util_format_get_blocksize(res->base.format);
-      data = malloc(send_size);
-      if (!data)
-         return ENOMEM;
+      if (state)
+         rb = vrend_readback_alloc(state, send_size);
+      if (rb) {
+         data = NULL;
+      } else {
+         data = malloc(send_size);
+         if (!data)
+            return ENOMEM;
+      }
    } else {
       send_size = iov[0].iov_len - info->offset;
       data = myptr;
@@ -5562,7 +8217,20 @@ static int vrend_transfer_send_readpixels(struct vrend_resource *res,
       glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 
    glPixelStorei(GL_PACK_ALIGNMENT, 4);
-   if (need_temp) {
+   if (rb) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      rb->res = res;
+      rb->box = *info->box;
+      rb->level = info->level;
+      rb->stride = info->stride;
+      rb->offset = info->offset;
+      rb->invert = separate_invert;
+      rb->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      list_addtail(&rb->head, &state->readback_list);
+
+      vrend_resource_set_fence(state, res, state->next_fence_id);
+   } else if (need_temp) {
       write_transfer_data(&res->base, iov, num_iovs, data,
                           info->stride, info->box, info->level, info->offset,
                           separate_invert);
@@ -5605,10 +8273,13 @@ static int vrend_transfer_send_readonly(struct vrend_resource *res,
    return -1;
 }
 
-static int vrend_renderer_transfer_send_iov(struct vrend_resource *res,
+static int vrend_renderer_transfer_send_iov(struct virgl_client *client,
+                                            struct vrend_resource *res,
                                             struct iovec *iov, int num_iovs,
                                             const struct vrend_transfer_info *info)
 {
+   vrend_resource_ensure_storage(res);
+
    if (is_only_bit(res->storage_bits, VREND_STORAGE_GUEST_MEMORY) ||
        (has_bit(res->storage_bits, VREND_STORAGE_HOST_SYSTEM_MEMORY) && res->iov)) {
       return vrend_copy_iovec(res->iov, res->num_iovs, info->box->x,
@@ -5640,7 +8311,7 @@ static int vrend_renderer_transfer_send_iov(struct vrend_resource *res,
       can_readpixels = vrend_format_can_render(res->base.format) || vrend_format_is_ds(res->base.format);
 
       if (can_readpixels)
-         ret = vrend_transfer_send_readpixels(res, iov, num_iovs, info);
+         ret = vrend_transfer_send_readpixels(client, res, iov, num_iovs, info);
 
       /* Can hit this on a non-error path as well. */
       if (ret)
@@ -5651,7 +8322,9 @@ static int vrend_renderer_transfer_send_iov(struct vrend_resource *res,
    return 0;
 }
 
-int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_transfer_info *info, int transfer_mode)
+static int vrend_renderer_transfer_iov_internal(struct virgl_client *client,
+                                                const struct vrend_transfer_info *info,
+                                                int transfer_mode, bool ctx0_bound)
 {
    struct vrend_resource *res;
    struct vrend_context *ctx;
@@ -5691,7 +8364,8 @@ int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_
       return EINVAL;
 
    if (info->context0) {
-      vrend_renderer_force_ctx_0(client);
+      if (!ctx0_bound)
+         vrend_renderer_force_ctx_0(client);
       ctx = NULL;
    }
 
@@ -5699,7 +8373,7 @@ int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_
    case VIRGL_TRANSFER_TO_HOST:
       return vrend_renderer_transfer_write_iov(ctx, res, iov, num_iovs, info);
    case VIRGL_TRANSFER_FROM_HOST:
-      return vrend_renderer_transfer_send_iov(res, iov, num_iovs, info);
+      return vrend_renderer_transfer_send_iov(client, res, iov, num_iovs, info);
 
    default:
       assert(0);
@@ -5707,6 +8381,82 @@ int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_
    return 0;
 }
 
+int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_transfer_info *info, int transfer_mode)
+{
+   return vrend_renderer_transfer_iov_internal(client, info, transfer_mode, false);
+}
+
+/* Runs several transfers with a single switch to context 0.  Returns the
+ * first error, every transfer is attempted regardless. */
+int vrend_renderer_transfer_iov_batch(struct virgl_client *client, const struct vrend_transfer_info *infos,
+                                      const int *transfer_modes, int count)
+{
+   bool ctx0_bound = false;
+   int i, ret, first_error = 0;
+
+   for (i = 0; i < count; i++) {
+      if (infos[i].context0 && !ctx0_bound) {
+         vrend_renderer_force_ctx_0(client);
+         ctx0_bound = true;
+      } else if (!infos[i].context0) {
+         ctx0_bound = false;
+      }
+
+      ret = vrend_renderer_transfer_iov_internal(client, &infos[i], transfer_modes[i], ctx0_bound);
+      if (ret && !first_error)
+         first_error = ret;
+   }
+   return first_error;
+}
+
+/* Inline writes carry their data in the command stream, Mesa uses them
+ * for small constant and vertex updates many times per frame.  Buffers are
+ * written straight from the command buffer, binding GL_COPY_WRITE_BUFFER
+ * rather than the buffer's own target so no draw state is disturbed. */
+static bool vrend_buffer_inline_write(struct vrend_context *ctx,
+                                      struct vrend_resource *res,
+                                      const void *data,
+                                      const struct vrend_transfer_info *info)
+{
+   struct vrend_state *state = ctx->client->vrend_state;
+   uint32_t offset = info->box->x;
+   uint32_t size = info->box->width;
+   void *ptr;
+
+   vrend_resource_ensure_storage(res);
+   vrend_resource_new_contents(res);
+
+   if (has_bit(res->storage_bits, VREND_STORAGE_HOST_SYSTEM_MEMORY) && !res->iov) {
+      memcpy(res->ptr + offset, data, size);
+      return true;
+   }
+
+   if (!has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER))
+      return false;
+
+   if (!size)
+      return true;
+
+   glBindBuffer(GL_COPY_WRITE_BUFFER, res->id);
+   if (size <= VREND_INLINE_WRITE_SUBDATA_MAX &&
+       res->fence_id <= state->last_signaled_fence_id) {
+      glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+   } else {
+      /* like every unsynchronized transfer, the guest orders it */
+      ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                             GL_MAP_UNSYNCHRONIZED_BIT);
+      if (ptr) {
+         memcpy(ptr, data, size);
+         glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      } else {
+         glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+      }
+   }
+   glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+   return true;
+}
+
 int vrend_transfer_inline_write(struct vrend_context *ctx,
                                 struct vrend_transfer_info *info)
 {
@@ -5722,6 +8472,10 @@ int vrend_transfer_inline_write(struct vrend_context *ctx,
    if (!check_iov_bounds(res, info, info->iovec, info->iovec_cnt))
       return EINVAL;
 
+   if (res->base.target == PIPE_BUFFER && info->iovec_cnt == 1 && !info->synchronized &&
+       vrend_buffer_inline_write(ctx, res, (char *)info->iovec[0].iov_base + info->offset, info))
+      return 0;
+
    return vrend_renderer_transfer_write_iov(ctx, res, info->iovec, info->iovec_cnt, info);
 
 }
@@ -5769,8 +8523,7 @@ void vrend_set_blend_color(struct vrend_context *ctx,
                            struct pipe_blend_color *color)
 {
    ctx->sub->blend_color = *color;
-   glBlendColor(color->color[0], color->color[1], color->color[2],
-                color->color[3]);
+   vrend_blend_color(ctx, color->color);
 }
 
 void vrend_set_scissor_state(struct vrend_context *ctx,
@@ -5814,6 +8567,7 @@ void vrend_set_polygon_stipple(struct vrend_context *ctx,
    }
 
    glBindTexture(GL_TEXTURE_2D, ctx->pstipple_tex_id);
+   vrend_shadow_textures_bound(ctx->client->vrend_state);
    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 32, 32,
                    GL_RED, GL_UNSIGNED_BYTE, stip);
    glBindTexture(GL_TEXTURE_2D, 0);
@@ -6026,6 +8780,7 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
    }
 
    glBindTexture(dst_res->target, dst_res->id);
+   vrend_shadow_textures_bound(dst_res->state);
    slice_offset = src_box->z * slice_size;
    cube_slice = (src_res->target == GL_TEXTURE_CUBE_MAP) ? src_box->z + src_box->depth : cube_slice;
    i = (src_res->target == GL_TEXTURE_CUBE_MAP) ? src_box->z : 0;
@@ -6093,6 +8848,9 @@ void vrend_renderer_resource_copy_region(struct vrend_context *ctx,
       return;
    if (!dst_res)
       return;
+   vrend_resource_ensure_storage(src_res);
+   vrend_resource_ensure_storage(dst_res);
+   vrend_resource_new_contents(dst_res);
 
    if (src_res->base.target == PIPE_BUFFER && dst_res->base.target == PIPE_BUFFER) {
       /* do a buffer copy */
@@ -6132,7 +8890,7 @@ void vrend_renderer_resource_copy_region(struct vrend_context *ctx,
    glBindFramebuffer(GL_READ_FRAMEBUFFER, ctx->sub->blit_fb_ids[0]);
 
    glmask = GL_COLOR_BUFFER_BIT;
-   glDisable(GL_SCISSOR_TEST);
+   vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, false);
 
    if (!src_res->y_0_top) {
       sy1 = src_box->y;
@@ -6168,7 +8926,7 @@ void vrend_renderer_resource_copy_region(struct vrend_context *ctx,
    glBindFramebuffer(GL_FRAMEBUFFER, ctx->sub->fb_id);
 
    if (ctx->sub->rs_state.scissor)
-      glEnable(GL_SCISSOR_TEST);
+      vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, true);
 }
 
 static void vrend_renderer_blit_int(struct vrend_context *ctx,
@@ -6185,6 +8943,7 @@ static void vrend_renderer_blit_int(struct vrend_context *ctx,
    bool skip_dest_swizzle = false;
    GLuint intermediate_fbo = 0;
    struct vrend_resource *intermediate_copy = 0;
+   struct vrend_state *state = ctx->client->vrend_state;
 
    GLuint blitter_views[2] = {src_res->id, dst_res->id};
 
@@ -6268,7 +9027,7 @@ static void vrend_renderer_blit_int(struct vrend_context *ctx,
                              has_feature(feat_texture_srgb_decode),
                              has_feature(feat_srgb_write_control),
                              skip_dest_swizzle);
-      vrend_clicbs->make_current(ctx->client, ctx->sub->gl_context);
+      vrend_make_sub_current(ctx, ctx->sub);
       goto cleanup;
    }
 
@@ -6282,9 +9041,9 @@ static void vrend_renderer_blit_int(struct vrend_context *ctx,
    if (info->scissor_enable) {
       glScissor(info->scissor.minx, info->scissor.miny, info->scissor.maxx - info->scissor.minx, info->scissor.maxy - info->scissor.miny);
       ctx->sub->scissor_state_dirty = (1 << 0);
-      glEnable(GL_SCISSOR_TEST);
+      vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, true);
    } else
-      glDisable(GL_SCISSOR_TEST);
+      vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, false);
 
    /* An GLES GL_INVALID_OPERATION is generated if one wants to blit from a
     * multi-sample fbo to a non multi-sample fbo and the source and destination
@@ -6398,21 +9157,60 @@ static void vrend_renderer_blit_int(struct vrend_context *ctx,
    glBindFramebuffer(GL_FRAMEBUFFER, ctx->sub->fb_id);
 
    if (make_intermediate_copy) {
+      /* the copies above are likely still in flight */
+      intermediate_copy->state = state;
+      intermediate_copy->fence_id = state->next_fence_id;
       vrend_renderer_resource_destroy(intermediate_copy);
       glDeleteFramebuffers(1, &intermediate_fbo);
    }
 
-   if (ctx->sub->rs_state.scissor)
-      glEnable(GL_SCISSOR_TEST);
-   else
-      glDisable(GL_SCISSOR_TEST);
+   vrend_set_cap(ctx, VREND_CAP_SCISSOR_TEST, ctx->sub->rs_state.scissor);
 
 cleanup:
    if (blitter_views[0] != src_res->id)
-      glDeleteTextures(1, &blitter_views[0]);
+      vrend_delete_later(state, VREND_DELETE_TEXTURE, blitter_views[0], state->next_fence_id);
 
    if (blitter_views[1] != dst_res->id)
-      glDeleteTextures(1, &blitter_views[1]);
+      vrend_delete_later(state, VREND_DELETE_TEXTURE, blitter_views[1], state->next_fence_id);
+   vrend_shadow_textures_bound(ctx->client->vrend_state);
+}
+
+static bool vrend_blit_box_equal(const struct pipe_box *a, const struct pipe_box *b)
+{
+   return a->x == b->x && a->y == b->y && a->z == b->z &&
+          a->width == b->width && a->height == b->height && a->depth == b->depth;
+}
+
+/* Guests resolve the same multisampled surface again, for a present after
+ * a copy for instance, without drawing to it in between.  A resolve equal
+ * to the last one into dst_res while neither resource got new contents
+ * since would write what dst_res already holds. */
+static bool vrend_blit_is_repeated_resolve(const struct vrend_resource *src_res,
+                                           const struct vrend_resource *dst_res,
+                                           const struct pipe_blit_info *info)
+{
+   const struct pipe_blit_info *last = &dst_res->last_resolve;
+
+   if (src_res->base.nr_samples <= 1 || dst_res->base.nr_samples > 1 ||
+       info->render_condition_enable || info->alpha_blend)
+      return false;
+
+   if (dst_res->last_resolve_src != src_res ||
+       dst_res->last_resolve_src_seq != src_res->write_seq ||
+       dst_res->last_resolve_seq != dst_res->write_seq)
+      return false;
+
+   if (last->src.level != info->src.level || last->dst.level != info->dst.level ||
+       last->src.format != info->src.format || last->dst.format != info->dst.format ||
+       !vrend_blit_box_equal(&last->src.box, &info->src.box) ||
+       !vrend_blit_box_equal(&last->dst.box, &info->dst.box) ||
+       last->mask != info->mask || last->filter != info->filter ||
+       last->scissor_enable != info->scissor_enable)
+      return false;
+
+   return !info->scissor_enable ||
+          (last->scissor.minx == info->scissor.minx && last->scissor.miny == info->scissor.miny &&
+           last->scissor.maxx == info->scissor.maxx && last->scissor.maxy == info->scissor.maxy);
 }
 
 void vrend_renderer_blit(struct vrend_context *ctx,
@@ -6431,12 +9229,19 @@ void vrend_renderer_blit(struct vrend_context *ctx,
    if (ctx->in_error)
       return;
 
+   vrend_resource_ensure_storage(src_res);
+   vrend_resource_ensure_storage(dst_res);
+
    if (!info->src.format || info->src.format >= VIRGL_FORMAT_MAX)
       return;
 
    if (!info->dst.format || info->dst.format >= VIRGL_FORMAT_MAX)
       return;
 
+   if (vrend_blit_is_repeated_resolve(src_res, dst_res, info))
+      return;
+   vrend_resource_new_contents(dst_res);
+
    /* The Gallium blit function can be called for a general blit that may
     * scale, convert the data, and apply some rander states, or it is called via
     * glCopyImageSubData. If the src or the dst image are equal, or the two
@@ -6459,6 +9264,15 @@ void vrend_renderer_blit(struct vrend_context *ctx,
    } else {
       vrend_renderer_blit_int(ctx, src_res, dst_res, info);
    }
+
+   /* a render condition can drop the blit, leaving nothing to repeat */
+   if (src_res->base.nr_samples > 1 && dst_res->base.nr_samples <= 1 &&
+       !info->render_condition_enable) {
+      dst_res->last_resolve = *info;
+      dst_res->last_resolve_src = src_res;
+      dst_res->last_resolve_src_seq = src_res->write_seq;
+      dst_res->last_resolve_seq = dst_res->write_seq;
+   }
 }
 
 int vrend_renderer_create_fence(struct virgl_client *client, int client_fence_id, uint32_t ctx_id)
@@ -6478,6 +9292,7 @@ int vrend_renderer_create_fence(struct virgl_client *client, int client_fence_id
       goto fail;
 
    list_addtail(&fence->fences, &client->vrend_state->fence_list);
+   client->vrend_state->next_fence_id = client_fence_id + 1;
    return 0;
 
  fail:
@@ -6492,7 +9307,17 @@ static void free_fence_locked(struct vrend_fence *fence)
    free(fence);
 }
 
-static void vrend_renderer_check_queries(struct virgl_client *client);
+static void vrend_renderer_check_queries(struct virgl_client *client, uint32_t latest_id);
+
+/* Sync objects, pack buffers and the upload ring are shared by every
+ * context, so fence work runs in whatever context is bound and context 0
+ * is only made current when none is.  A single context client then stays
+ * in its own context across requests. */
+static void vrend_renderer_bind_fence_ctx(struct virgl_client *client)
+{
+   if (!client->vrend_state->current_hw_ctx)
+      vrend_renderer_force_ctx_0(client);
+}
 
 void vrend_renderer_check_fences(struct virgl_client *client)
 {
@@ -6500,7 +9325,7 @@ void vrend_renderer_check_fences(struct virgl_client *client)
    uint32_t latest_id = 0;
    GLenum glret;
 
-   vrend_renderer_force_ctx_0(client);
+   vrend_renderer_bind_fence_ctx(client);
 
    LIST_FOR_EACH_ENTRY_SAFE(fence, stor, &client->vrend_state->fence_list, fences) {
       glret = glClientWaitSync(fence->syncobj, 0, 0);
@@ -6514,37 +9339,72 @@ void vrend_renderer_check_fences(struct virgl_client *client)
       }
    }
 
+   /* after the fences, so every readback issued before latest_id has
+    * signaled by now and reaches guest memory before the fence does */
+   vrend_renderer_check_readbacks(client);
+
    if (latest_id == 0)
       return;
 
-   vrend_renderer_check_queries(client);
+   client->vrend_state->last_signaled_fence_id = latest_id;
+
+   if (client->vrend_state->num_deferred_deletes)
+      vrend_drain_deletes(client->vrend_state, latest_id);
+
+   if (client->vrend_state->upload_ring)
+      vrend_upload_ring_retire(client->vrend_state->upload_ring, latest_id);
+
+   vrend_renderer_check_queries(client, latest_id);
 
    vrend_clicbs->write_fence(client, latest_id);
 }
 
-static bool vrend_get_one_query_result(GLuint query_id, uint64_t *result)
+/* Blocks until the fence fence_id and every fence before it has signaled
+ * or timeout_ns has passed, then retires the signaled fences.  Returns
+ * false on timeout.  Fences signal in submission order, so only the
+ * first outstanding fence at or after fence_id needs to be waited on. */
+bool vrend_renderer_wait_fence(struct virgl_client *client, uint32_t fence_id, uint64_t timeout_ns)
+{
+   struct vrend_fence *fence;
+   GLenum glret = GL_ALREADY_SIGNALED;
+
+   vrend_renderer_bind_fence_ctx(client);
+
+   LIST_FOR_EACH_ENTRY(fence, &client->vrend_state->fence_list, fences) {
+      if (fence->fence_id >= fence_id) {
+         glret = glClientWaitSync(fence->syncobj, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+         break;
+      }
+   }
+
+   vrend_renderer_check_fences(client);
+   return glret == GL_ALREADY_SIGNALED || glret == GL_CONDITION_SATISFIED;
+}
+
+static bool vrend_get_one_query_result(GLuint query_id, bool signaled, uint64_t *result)
 {
    GLuint ready;
    GLuint passed;
-   GLuint64 pass64;
 
-   glGetQueryObjectuiv(query_id, GL_QUERY_RESULT_AVAILABLE, &ready);
-
-   if (!ready)
-      return false;
+   /* a signaled fence after the query means its result is available */
+   if (!signaled) {
+      glGetQueryObjectuiv(query_id, GL_QUERY_RESULT_AVAILABLE, &ready);
+      if (!ready)
+         return false;
+   }
 
    glGetQueryObjectuiv(query_id, GL_QUERY_RESULT, &passed);
    *result = passed;
    return true;
 }
 
-static bool vrend_check_query(struct vrend_query *query)
+static bool vrend_check_query(struct vrend_query *query, bool signaled)
 {
    struct virgl_host_query_state state;
    bool ret;
 
    state.result_size = 4;
-   ret = vrend_get_one_query_result(query->id, &state.result);
+   ret = vrend_get_one_query_result(query->id, signaled, &state.result);
    if (ret == false)
       return false;
 
@@ -6566,17 +9426,50 @@ static bool vrend_check_query(struct vrend_query *query)
    return true;
 }
 
-static void vrend_renderer_check_queries(struct virgl_client *client)
+/* Collects the results of the waiting queries covered by the fence
+ * latest_id.  The list is kept grouped by context, so each context with
+ * finished queries is switched to once, and queries behind a later fence
+ * are left alone without a round trip to the driver. */
+static void vrend_renderer_check_queries(struct virgl_client *client, uint32_t latest_id)
 {
    struct vrend_query *query, *stor;
+   int cur_ctx_id = -1;
+   bool switched = false;
 
    LIST_FOR_EACH_ENTRY_SAFE(query, stor, &client->vrend_state->waiting_query_list, waiting_queries) {
-      vrend_hw_switch_context(vrend_lookup_renderer_ctx(client, query->ctx_id), true);
-      if (vrend_check_query(query))
+      if (query->fence_id > latest_id)
+         continue;
+
+      if (query->ctx_id != cur_ctx_id) {
+         cur_ctx_id = query->ctx_id;
+         switched = vrend_hw_switch_context(vrend_lookup_renderer_ctx(client, cur_ctx_id), true);
+      }
+      if (switched && vrend_check_query(query, true))
          list_delinit(&query->waiting_queries);
    }
 }
 
+/* Queues query behind the last waiting query of its context */
+static void vrend_add_waiting_query(struct vrend_state *state, struct vrend_query *q)
+{
+   struct vrend_query *query;
+   struct list_head *pos = NULL;
+
+   q->fence_id = state->next_fence_id;
+
+   LIST_FOR_EACH_ENTRY(query, &state->waiting_query_list, waiting_queries) {
+      if (query->ctx_id == q->ctx_id)
+         pos = &query->waiting_queries;
+      else if (pos)
+         break;
+   }
+
+   if (pos)
+      list_add(&q->waiting_queries, pos);
+   else
+      list_addtail(&q->waiting_queries, &state->waiting_query_list);
+}
+
 bool vrend_hw_switch_context(struct vrend_context *ctx, bool now)
 {
    if (!ctx)
@@ -6607,12 +9500,24 @@ static void vrend_finish_context_switch(struct vrend_context *ctx)
 
    ctx->client->vrend_state->current_hw_ctx = ctx;
 
-   vrend_clicbs->make_current(ctx->client, ctx->sub->gl_context);
+   vrend_make_sub_current(ctx, ctx->sub);
+}
+
+/* the shadow state of sub describes its GL context, keep track of which
+ * one is bound for bindings made behind its back */
+static void vrend_make_sub_current(struct vrend_context *ctx, struct vrend_sub_context *sub)
+{
+   ctx->client->vrend_state->current_sub = sub;
+   vrend_clicbs->make_current(ctx->client, sub->gl_context);
 }
 
 void
 vrend_renderer_object_destroy(struct vrend_context *ctx, uint32_t handle)
 {
+   struct vrend_surface *surf = vrend_object_lookup(ctx->sub->object_hash, handle, VIRGL_OBJECT_SURFACE);
+
+   if (surf)
+      vrend_fb_cache_evict_surface(ctx->sub, surf);
    vrend_object_remove(ctx->sub->object_hash, handle, 0);
 }
 
@@ -6622,6 +9527,16 @@ uint32_t vrend_renderer_object_insert(struct vrend_context *ctx, void *data,
    return vrend_object_insert(ctx->sub->object_hash, data, size, handle, type);
 }
 
+void *vrend_renderer_object_alloc(struct vrend_context *ctx, enum virgl_object_type type)
+{
+   return vrend_slab_alloc(&ctx->sub->object_slabs[type]);
+}
+
+void vrend_renderer_object_free(void *data)
+{
+   vrend_slab_free(data);
+}
+
 int vrend_create_query(struct vrend_context *ctx, uint32_t handle,
                        uint32_t query_type, uint32_t query_index,
                        uint32_t res_handle, UNUSED uint32_t offset)
@@ -6751,11 +9666,11 @@ void vrend_get_query_result(struct vrend_context *ctx, uint32_t handle,
    if (!q)
       return;
 
-   ret = vrend_check_query(q);
+   ret = vrend_check_query(q, false);
    if (ret) {
       list_delinit(&q->waiting_queries);
    } else if (LIST_IS_EMPTY(&q->waiting_queries)) {
-      list_addtail(&q->waiting_queries, &ctx->client->vrend_state->waiting_query_list);
+      vrend_add_waiting_query(ctx->client->vrend_state, q);
    }
 }
 
@@ -6870,7 +9785,8 @@ static void vrend_renderer_fill_caps_v1(struct virgl_client *client, int gles_ve
    if (caps->v1.glsl_level >= 400 || has_feature(feat_tessellation))
       caps->v1.prim_mask |= (1 << PIPE_PRIM_PATCHES);
 
-   if (vrend_has_gl_extension("GL_ARB_vertex_type_10f_11f_11f_rev"))
+   /* without the extension the vertex shader unpacks them */
+   if (vrend_has_gl_extension("GL_ARB_vertex_type_10f_11f_11f_rev") || gles_ver >= 30)
       set_format_bit(&caps->v1.vertexbuffer, VIRGL_FORMAT_R11G11B10_FLOAT);
 
    if (has_feature(feat_indep_blend))
@@ -7195,7 +10111,7 @@ void vrend_renderer_fill_caps(struct virgl_client *client, uint32_t set, UNUSED
    if (!caps)
       return;
 
-   if (set > 2) {
+   if (set < 1 || set > 2) {
       caps->max_version = 0;
       return;
    }
@@ -7209,16 +10125,33 @@ void vrend_renderer_fill_caps(struct virgl_client *client, uint32_t set, UNUSED
       fill_capset2 = true;
    }
 
+   pipe_mutex_lock(vrend_global_lock);
+   if (cached_caps_valid[set - 1]) {
+      memcpy(caps, &cached_caps[set - 1],
+             fill_capset2 ? sizeof(*caps) : sizeof(struct virgl_caps_v1));
+      pipe_mutex_unlock(vrend_global_lock);
+
+      if (fill_capset2) {
+         client->vrend_state->max_texture_2d_size = caps->v2.max_texture_2d_size;
+         client->vrend_state->max_texture_3d_size = caps->v2.max_texture_3d_size;
+         client->vrend_state->max_texture_cube_size = caps->v2.max_texture_cube_size;
+      }
+      return;
+   }
+
    gles_ver = vrend_gl_version();
 
    vrend_fill_caps_glsl_version(gles_ver, caps);
 
    vrend_renderer_fill_caps_v1(client, gles_ver, caps);
 
-   if (!fill_capset2)
-      return;
+   if (fill_capset2)
+      vrend_renderer_fill_caps_v2(client, gles_ver, caps);
 
-   vrend_renderer_fill_caps_v2(client, gles_ver, caps);
+   memcpy(&cached_caps[set - 1], caps,
+          fill_capset2 ? sizeof(*caps) : sizeof(struct virgl_caps_v1));
+   cached_caps_valid[set - 1] = true;
+   pipe_mutex_unlock(vrend_global_lock);
 }
 
 void vrend_renderer_force_ctx_0(struct virgl_client *client)
@@ -7229,6 +10162,139 @@ void vrend_renderer_force_ctx_0(struct virgl_client *client)
    vrend_hw_switch_context(ctx0, true);
 }
 
+void vrend_renderer_get_program_cache_stats(struct vrend_context *ctx,
+                                            uint64_t *hits, uint64_t *misses)
+{
+   *hits = ctx->sub->program_cache_hits;
+   *misses = ctx->sub->program_cache_misses;
+}
+
+void vrend_renderer_set_async_compile(struct virgl_client *client, int num_threads,
+                                      bool skip_draws_until_ready)
+{
+   struct vrend_state *state = client->vrend_state;
+
+   state->compile_skip_until_ready = skip_draws_until_ready;
+   if (!state->compile_pool && num_threads > 0)
+      state->compile_pool = vrend_compile_pool_create(client, num_threads);
+
+   /* without a pool of our own the driver's compiler threads do the work,
+    * the statuses are queried at the first draw */
+   state->parallel_compile = !state->compile_pool && max_shader_compiler_threads;
+   if (state->parallel_compile)
+      max_shader_compiler_threads(0xffffffff);
+}
+
+uint64_t vrend_renderer_get_stalled_draw_count(struct virgl_client *client)
+{
+   return client->vrend_state->stalled_draws;
+}
+
+static void vrend_resource_add_gl_size(void *data, void *closure)
+{
+   *(uint64_t *)closure += ((struct vrend_resource *)data)->gl_size;
+}
+
+/* Sums the storage of the client's resources, textures only count once
+ * their storage got allocated on first use */
+uint64_t vrend_renderer_get_gl_bytes(struct virgl_client *client)
+{
+   uint64_t bytes = 0;
+
+   vrend_resource_foreach(client, vrend_resource_add_gl_size, &bytes);
+   return bytes;
+}
+
+void vrend_renderer_trim(struct virgl_client *client)
+{
+   struct vrend_state *state = client->vrend_state;
+   struct vrend_readback *rb, *tmp;
+
+   LIST_FOR_EACH_ENTRY_SAFE(rb, tmp, &state->readback_free_list, head) {
+      list_del(&rb->head);
+      glDeleteBuffers(1, &rb->pbo);
+      free(rb);
+   }
+   state->num_free_readbacks = 0;
+}
+
+void vrend_renderer_end_frame(struct virgl_client *client)
+{
+   struct vrend_state *state = client->vrend_state;
+
+   state->last_frame_filtered_gl_calls = state->filtered_gl_calls;
+   state->filtered_gl_calls = 0;
+}
+
+/* A present leaves the depth and stencil of the frame undefined, as EGL and
+ * GLX do for window surfaces, so a tiler doesn't write back the winsys
+ * depth buffer that is bound at that point.  Depth textures the guest can
+ * sample are kept, it may read them in the next frame. */
+void vrend_renderer_invalidate_ancillary(struct vrend_context *ctx)
+{
+   struct vrend_surface *zsurf = ctx->sub->zsurf;
+   const struct util_format_description *desc;
+   GLenum attachments[2];
+   GLsizei count = 0;
+
+   if (!has_feature(feat_invalidate_framebuffer) || !zsurf || !zsurf->texture ||
+       (zsurf->texture->base.bind & VIRGL_BIND_SAMPLER_VIEW))
+      return;
+
+   if (ctx->ctx_switch_pending)
+      vrend_finish_context_switch(ctx);
+
+   desc = util_format_description(zsurf->format);
+   if (util_format_has_depth(desc))
+      attachments[count++] = GL_DEPTH_ATTACHMENT;
+   if (util_format_has_stencil(desc))
+      attachments[count++] = GL_STENCIL_ATTACHMENT;
+
+   glBindFramebuffer(GL_FRAMEBUFFER, ctx->sub->fb_id);
+   glInvalidateFramebuffer(GL_FRAMEBUFFER, count, attachments);
+}
+
+uint64_t vrend_renderer_get_filtered_gl_calls(struct virgl_client *client)
+{
+   return client->vrend_state->last_frame_filtered_gl_calls;
+}
+
+void vrend_renderer_set_async_readback(struct virgl_client *client, bool enable)
+{
+   client->vrend_state->async_readback = enable;
+}
+
+void vrend_renderer_set_const_ubo(struct virgl_client *client, bool enable)
+{
+   struct vrend_state *state = client->vrend_state;
+   GLint block_size = 0, vs_blocks = 0, fs_blocks = 0, bindings = 0;
+
+   state->const_ubo = false;
+   if (!enable || !has_feature(feat_ubo))
+      return;
+
+   glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &block_size);
+   glGetIntegerv(GL_MAX_VERTEX_UNIFORM_BLOCKS, &vs_blocks);
+   glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_BLOCKS, &fs_blocks);
+   glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &bindings);
+   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &state->const_ubo_alignment);
+
+   /* the top binding points are reserved, one per stage, guest uniform
+    * buffers are numbered from zero below them */
+   if (bindings <= PIPE_SHADER_TYPES || block_size < 16 || state->const_ubo_alignment <= 0)
+      return;
+
+   state->const_ubo_binding_base = bindings - PIPE_SHADER_TYPES;
+   state->const_ubo_max_consts = block_size / 16;
+   state->const_ubo_max_blocks = MIN2(vs_blocks, fs_blocks);
+   state->const_ubo = true;
+}
+
+void vrend_renderer_set_separable_programs(struct virgl_client *client, bool enable)
+{
+   client->vrend_state->separable_programs = enable && has_feature(feat_separate_shader_objects);
+}
+
 void vrend_renderer_attach_res_ctx(struct virgl_client *client, int ctx_id, int resource_id)
 {
    struct vrend_context *ctx = vrend_lookup_renderer_ctx(client, ctx_id);
@@ -7258,9 +10324,32 @@ struct vrend_resource *vrend_renderer_ctx_res_lookup(struct vrend_context *ctx,
 {
    struct vrend_resource *res = vrend_object_lookup(ctx->res_hash, res_handle, 1);
 
+   /* server side lookups are synchronous, only submissions need a fence */
+   if (res && ctx->client->vrend_state->decoding)
+      vrend_resource_set_fence(ctx->client->vrend_state, res, ctx->client->vrend_state->next_fence_id);
    return res;
 }
 
+void vrend_renderer_set_busy_table(struct virgl_client *client, uint32_t *table, uint32_t size)
+{
+   struct vrend_state *state = client->vrend_state;
+   uint32_t i;
+
+   /* resources created before are not tracked, they stay busy until the
+    * next fence; the client asks the server then */
+   for (i = 0; i < size; i++)
+      table[i] = state->next_fence_id;
+   state->busy_table = table;
+   state->busy_table_size = size;
+}
+
+uint32_t vrend_renderer_resource_fence_id(struct vrend_context *ctx, int res_handle)
+{
+   struct vrend_resource *res = vrend_object_lookup(ctx->res_hash, res_handle, 1);
+
+   return res ? res->fence_id : 0;
+}
+
 void vrend_renderer_get_cap_set(uint32_t cap_set, uint32_t *max_ver,
                                 uint32_t *max_size)
 {
@@ -7295,10 +10384,14 @@ void vrend_renderer_create_sub_ctx(struct vrend_context *ctx, int sub_ctx_id)
    sub = CALLOC_STRUCT(vrend_sub_context);
    if (!sub)
       return;
+   vrend_shadow_reset(&sub->shadow);
 
    sub->gl_context = vrend_clicbs->create_gl_context(ctx->client);
-   vrend_clicbs->make_current(ctx->client, sub->gl_context);
+   vrend_make_sub_current(ctx, sub);
+   if (ctx->client->vrend_state->parallel_compile)
+      max_shader_compiler_threads(0xffffffff);
 
+   sub->state = ctx->client->vrend_state;
    sub->sub_ctx_id = sub_ctx_id;
 
    /* initialize the depth far_val to 1 */
@@ -7309,14 +10402,35 @@ void vrend_renderer_create_sub_ctx(struct vrend_context *ctx, int sub_ctx_id)
    if (!has_feature(feat_gles31_vertex_attrib_binding)) {
       glGenVertexArrays(1, &sub->vaoid);
       glBindVertexArray(sub->vaoid);
+      sub->bound_vao = sub->vaoid;
    }
+   list_inithead(&sub->vaos);
+   sub->vao_hash = util_hash_table_create(vrend_vao_key_hash,
+                                          vrend_vao_key_compare,
+                                          vrend_vao_key_destroy);
 
-   glGenFramebuffers(1, &sub->fb_id);
+   glGenFramebuffers(1, &sub->base_fb_id);
+   sub->fb_id = sub->base_fb_id;
    glGenFramebuffers(2, sub->blit_fb_ids);
 
    list_inithead(&sub->programs);
    list_inithead(&sub->streamout_list);
 
+   vrend_slab_init(&sub->object_slabs[VIRGL_OBJECT_BLEND],
+                   sizeof(struct pipe_blend_state), VREND_OBJECT_SLAB_PAGE);
+   vrend_slab_init(&sub->object_slabs[VIRGL_OBJECT_DSA],
+                   sizeof(struct pipe_depth_stencil_alpha_state), VREND_OBJECT_SLAB_PAGE);
+   vrend_slab_init(&sub->object_slabs[VIRGL_OBJECT_RASTERIZER],
+                   sizeof(struct pipe_rasterizer_state), VREND_OBJECT_SLAB_PAGE);
+   vrend_slab_init(&sub->object_slabs[VIRGL_OBJECT_SAMPLER_STATE],
+                   sizeof(struct vrend_sampler_state), VREND_OBJECT_SLAB_PAGE);
+   vrend_slab_init(&sub->object_slabs[VIRGL_OBJECT_VERTEX_ELEMENTS],
+                   sizeof(struct vrend_vertex_element_array), VREND_OBJECT_SLAB_PAGE);
+
+   sub->program_hash = util_hash_table_create(vrend_program_key_hash,
+                                              vrend_program_key_compare,
+                                              vrend_program_key_destroy);
+
    sub->object_hash = vrend_object_init_ctx_table();
 
    ctx->sub = sub;
@@ -7342,7 +10456,7 @@ void vrend_renderer_destroy_sub_ctx(struct vrend_context *ctx, int sub_ctx_id)
    if (tofree) {
       if (ctx->sub == tofree) {
          ctx->sub = ctx->sub0;
-         vrend_clicbs->make_current(ctx->client, ctx->sub->gl_context);
+         vrend_make_sub_current(ctx, ctx->sub);
       }
       vrend_destroy_sub_context(ctx->client, tofree);
    }
@@ -7359,7 +10473,7 @@ void vrend_renderer_set_sub_ctx(struct vrend_context *ctx, int sub_ctx_id)
    LIST_FOR_EACH_ENTRY(sub, &ctx->sub_ctxs, head) {
       if (sub->sub_ctx_id == sub_ctx_id) {
          ctx->sub = sub;
-         vrend_clicbs->make_current(ctx->client, sub->gl_context);
+         vrend_make_sub_current(ctx, sub);
          break;
       }
    }
@@ -39,6 +39,9 @@ typedef void *virgl_gl_context;
 
 struct vrend_context;
 struct virgl_client;
+struct vrend_compile_pool;
+struct vrend_upload_ring;
+struct vrend_readback_compute;
 
 /* Number of mipmap levels for which to keep the backing iov offsets.
  * Value mirrored from mesa/virgl
@@ -79,11 +82,38 @@ struct vrend_resource {
    struct iovec *iov;
    uint32_t num_iovs;
    uint64_t mipmap_offsets[VR_MAX_TEXTURE_2D_LEVELS];
+
+   /* fence of the last submission that referenced this resource */
+   uint32_t fence_id;
+   /* of the client owning the GL names, see vrend_delete_later */
+   struct vrend_state *state;
+
+   /* presentable buffer backing the texture storage, see create_scanout_buffer */
+   void *scanout_buffer;
+
+   /* texture created without storage yet, see vrend_resource_ensure_storage */
+   bool storage_pending;
+
+   /* bytes of GL storage once allocated, see vrend_renderer_get_gl_bytes */
+   uint64_t gl_size;
+
+   /* buffer referenced by a cached vertex array object */
+   bool vao_cached;
+
+   /* contents version, new with every write, see vrend_resource_new_contents */
+   uint64_t write_seq;
+   /* the last multisample resolve into this resource and the versions of
+    * both sides right after it */
+   struct pipe_blit_info last_resolve;
+   const struct vrend_resource *last_resolve_src;
+   uint64_t last_resolve_src_seq;
+   uint64_t last_resolve_seq;
 };
 
 #define VIRGL_TEXTURE_NEED_SWIZZLE        (1 << 0)
 #define VIRGL_TEXTURE_CAN_TEXTURE_STORAGE (1 << 1)
 #define VIRGL_TEXTURE_CAN_READBACK        (1 << 2)
+#define VIRGL_TEXTURE_NEED_DECODE         (1 << 3)
 
 struct vrend_format_table {
    enum virgl_formats format;
@@ -100,11 +130,18 @@ struct vrend_if_cbs {
    virgl_gl_context (*create_gl_context)(struct virgl_client *client);
    void (*destroy_gl_context)(struct virgl_client *client, virgl_gl_context ctx);
    int (*make_current)(struct virgl_client *client, virgl_gl_context ctx);
+   /* optional: allocates a buffer the compositor can sample directly and
+    * binds it as the storage of the currently bound GL_TEXTURE_2D.
+    * Returns NULL if the format or size can't be backed that way. */
+   void *(*create_scanout_buffer)(uint32_t width, uint32_t height, enum virgl_formats format);
+   void (*destroy_scanout_buffer)(void *buffer);
 };
 
 struct vrend_state {
     struct vrend_context *current_ctx;
     struct vrend_context *current_hw_ctx;
+    /* sub context whose GL context is bound, NULL if unknown */
+    struct vrend_sub_context *current_sub;
     struct list_head waiting_query_list;
 
     /* these appeared broken on at least one driver */
@@ -117,9 +154,62 @@ struct vrend_state {
 
     struct list_head fence_list;
     struct list_head fence_wait_list;
+    /* id the next fence will carry, stamped on resources referenced
+     * by vrend_decode_block() before it is created */
+    uint32_t next_fence_id;
+    /* newest fence retired by vrend_renderer_check_fences(), resources
+     * stamped with it or an older one are idle on the GPU */
+    uint32_t last_signaled_fence_id;
+    bool decoding;
+    /* client visible copy of the resource fences, indexed by handle */
+    uint32_t *busy_table;
+    uint32_t busy_table_size;
+
+    /* GL names waiting for a fence before they are deleted */
+    bool defer_deletes;
+    struct vrend_deferred_delete *deferred_deletes;
+    uint32_t num_deferred_deletes;
+    uint32_t max_deferred_deletes;
 
     /* Needed on GLES to inject a TCS */
     float tess_factors[6];
+
+    /* readbacks into pixel pack buffers, copied out once their sync signals */
+    bool async_readback;
+
+    /* constant buffer 0 streamed into uniform blocks instead of glUniform */
+    bool const_ubo;
+    GLint const_ubo_alignment;
+    GLint const_ubo_binding_base;
+    GLint const_ubo_max_consts;
+    GLint const_ubo_max_blocks;
+
+    /* VS + FS programs built as pipelines of separable stage programs */
+    bool separable_programs;
+    struct list_head readback_list;
+    struct list_head readback_free_list;
+    uint32_t num_free_readbacks;
+
+    /* staging space for synchronized buffer uploads, created on first use */
+    struct vrend_upload_ring *upload_ring;
+
+    /* compute conversion for readbacks glReadPixels can not do, created on first use */
+    struct vrend_readback_compute *readback_compute;
+
+    /* GL sampler objects shared by equal sampler states, see vrend_sampler_cache_get */
+    struct util_hash_table *sampler_cache;
+
+    /* background shader compiles, NULL when compiling synchronously */
+    struct vrend_compile_pool *compile_pool;
+    /* GL_KHR_parallel_shader_compile without a compile pool */
+    bool parallel_compile;
+    bool compile_skip_until_ready;
+    uint64_t stalled_draws;
+
+    /* GL state calls skipped by the shadow state, for the current frame
+     * and the last one finished by vrend_renderer_end_frame */
+    uint64_t filtered_gl_calls;
+    uint64_t last_frame_filtered_gl_calls;
 };
 
 int vrend_renderer_init(struct virgl_client *client, struct vrend_if_cbs *cbs);
@@ -151,6 +241,14 @@ int vrend_draw_vbo(struct vrend_context *ctx,
                    const struct pipe_draw_info *info,
                    uint32_t cso, uint32_t indirect_handle, uint32_t indirect_draw_count_handle);
 
+/* most consecutive draws the decoder merges into one multi draw */
+#define VREND_MAX_MERGED_DRAWS 64
+
+/* draws a run of plain draws that share all state, mode and index buffer
+ * offset and differ only in start, count and index_bias */
+int vrend_draw_vbo_merged(struct vrend_context *ctx,
+                          const struct pipe_draw_info *infos, int num_draws);
+
 void vrend_set_framebuffer_state(struct vrend_context *ctx,
                                  uint32_t nr_cbufs, uint32_t surf_handle[PIPE_MAX_COLOR_BUFS],
                                  uint32_t zsurf_handle);
@@ -279,6 +377,8 @@ void vrend_set_framebuffer_state_no_attach(struct vrend_context *ctx,
                                            uint32_t layers, uint32_t samples);
 
 int vrend_renderer_transfer_iov(struct virgl_client *client, const struct vrend_transfer_info *info, int transfer_mode);
+int vrend_renderer_transfer_iov_batch(struct virgl_client *client, const struct vrend_transfer_info *infos,
+                                      const int *transfer_modes, int count);
 
 void vrend_renderer_resource_copy_region(struct vrend_context *ctx,
                                          uint32_t dst_handle, uint32_t dst_level,
@@ -323,16 +423,37 @@ void vrend_set_tess_state(struct vrend_context *ctx, const float tess_factors[6]
 void vrend_renderer_fini(struct virgl_client *client);
 
 int vrend_decode_block(struct virgl_client *client, uint32_t ctx_id, uint32_t *block, int ndw);
+
+/* per command type counters of vrend_decode_block(), kept for each context
+ * once enabled; written with relaxed atomics so any thread can read them */
+struct vrend_decode_stats {
+   uint64_t count[VIRGL_MAX_COMMANDS];
+   uint64_t ns[VIRGL_MAX_COMMANDS];
+};
+
+void vrend_decode_enable_stats(struct virgl_client *client);
+void vrend_decode_free_stats(struct virgl_client *client);
+/* sums the counters of all contexts, clearing them if reset */
+void vrend_decode_get_stats(struct virgl_client *client, struct vrend_decode_stats *stats, bool reset);
+const char *vrend_decode_command_name(uint32_t cmd);
 struct vrend_context *vrend_lookup_renderer_ctx(struct virgl_client *client, uint32_t ctx_id);
 
 int vrend_renderer_create_fence(struct virgl_client *client, int client_fence_id, uint32_t ctx_id);
 
 void vrend_renderer_check_fences(struct virgl_client *client);
+bool vrend_renderer_wait_fence(struct virgl_client *client, uint32_t fence_id, uint64_t timeout_ns);
+/* publishes the fence of every resource with a handle below size to table */
+void vrend_renderer_set_busy_table(struct virgl_client *client, uint32_t *table, uint32_t size);
+uint32_t vrend_renderer_resource_fence_id(struct vrend_context *ctx, int res_handle);
 
 bool vrend_hw_switch_context(struct vrend_context *ctx, bool now);
 uint32_t vrend_renderer_object_insert(struct vrend_context *ctx, void *data,
                                       uint32_t size, uint32_t handle, enum virgl_object_type type);
 void vrend_renderer_object_destroy(struct vrend_context *ctx, uint32_t handle);
+/* zeroed storage for blend, dsa, rasterizer, sampler state and vertex
+ * elements objects of the current sub context */
+void *vrend_renderer_object_alloc(struct vrend_context *ctx, enum virgl_object_type type);
+void vrend_renderer_object_free(void *data);
 
 int vrend_create_query(struct vrend_context *ctx, uint32_t handle,
                        uint32_t query_type, uint32_t query_index,
@@ -367,6 +488,7 @@ void vrend_renderer_force_ctx_0(struct virgl_client *client);
 void vrend_renderer_attach_res_ctx(struct virgl_client *client, int ctx_id, int resource_id);
 
 struct vrend_resource *vrend_renderer_ctx_res_lookup(struct vrend_context *ctx, int res_handle);
+void vrend_resource_ensure_storage(struct vrend_resource *res);
 
 #define VREND_CAP_SET 1
 #define VREND_CAP_SET2 2
@@ -377,6 +499,24 @@ void vrend_renderer_get_cap_set(uint32_t cap_set, uint32_t *max_ver,
 void vrend_renderer_create_sub_ctx(struct vrend_context *ctx, int sub_ctx_id);
 void vrend_renderer_destroy_sub_ctx(struct vrend_context *ctx, int sub_ctx_id);
 void vrend_renderer_set_sub_ctx(struct vrend_context *ctx, int sub_ctx_id);
+void vrend_renderer_get_program_cache_stats(struct vrend_context *ctx,
+                                            uint64_t *hits, uint64_t *misses);
+
+void vrend_renderer_set_async_compile(struct virgl_client *client, int num_threads,
+                                      bool skip_draws_until_ready);
+uint64_t vrend_renderer_get_stalled_draw_count(struct virgl_client *client);
+
+uint64_t vrend_renderer_get_gl_bytes(struct virgl_client *client);
+/* releases the GL memory cached for reuse, for memory pressure */
+void vrend_renderer_trim(struct virgl_client *client);
+
+void vrend_renderer_end_frame(struct virgl_client *client);
+void vrend_renderer_invalidate_ancillary(struct vrend_context *ctx);
+uint64_t vrend_renderer_get_filtered_gl_calls(struct virgl_client *client);
+
+void vrend_renderer_set_async_readback(struct virgl_client *client, bool enable);
+void vrend_renderer_set_const_ubo(struct virgl_client *client, bool enable);
+void vrend_renderer_set_separable_programs(struct virgl_client *client, bool enable);
 
 void vrend_fb_bind_texture(struct vrend_resource *res,
                            int idx,
@@ -32,6 +32,7 @@
 #include <math.h>
 #include <errno.h>
 #include "vrend_shader.h"
+#include "vrend_shader_cache.h"
 
 #include "vrend_strbuf.h"
 #include "vrend_util.h"
@@ -513,13 +514,12 @@ static void require_glsl_ver(struct dump_ctx *ctx, int glsl_ver)
 
 static void emit_indent(struct dump_ctx *ctx)
 {
+   static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
    if (ctx->indent_level > 0) {
       /* very high levels of indentation doesn't improve readability */
       int indent_level = MIN2(ctx->indent_level, 15);
-      char buf[16];
-      memset(buf, '\t', indent_level);
-      buf[indent_level] = '\0';
-      strbuf_append(&ctx->glsl_main, buf);
+      strbuf_append_buffer(&ctx->glsl_main, tabs, indent_level);
    }
 }
 
@@ -832,6 +832,18 @@ static bool logiop_require_inout(struct vrend_shader_key *key)
    }
 }
 
+/* Whether the vertex shader input io reads an attribute the key asks to
+ * decode; inputs accessed indirectly are merged into one array and left
+ * as they are. */
+static bool vs_input_decoded(const struct dump_ctx *ctx, const struct vrend_shader_io *io)
+{
+   uint32_t mask = ctx->key->vs_attrib_zyxw_bitmask | ctx->key->vs_attrib_r11g11b10_bitmask;
+
+   if (ctx->info.indirect_files & (1 << TGSI_FILE_INPUT))
+      return false;
+   return io->first == io->last && io->first < 32 && (mask & (1u << io->first));
+}
+
 static boolean
 iter_declaration(struct tgsi_iterate_context *iter,
                  struct tgsi_full_declaration *decl )
@@ -1086,6 +1098,10 @@ iter_declaration(struct tgsi_iterate_context *iter,
          else
             snprintf(ctx->inputs[i].glsl_name, 128, "%s_%d", name_prefix, ctx->inputs[i].first);
       }
+      /* the attribute keeps its name, the shader reads the decoded copy */
+      if (iter->processor.Processor == TGSI_PROCESSOR_VERTEX &&
+          vs_input_decoded(ctx, &ctx->inputs[i]))
+         snprintf(ctx->inputs[i].glsl_name, 128, "%s_%d_decoded", name_prefix, ctx->inputs[i].first);
       if (add_two_side) {
          snprintf(ctx->inputs[i + 1].glsl_name, 128, "%s_bc%d", name_prefix, ctx->inputs[i + 1].sid);
          if (!ctx->front_face_emitted) {
@@ -4235,6 +4251,28 @@ void rewrite_vs_pos_array(struct dump_ctx *ctx)
 }
 
 
+static
+void emit_vs_attrib_decode(struct dump_ctx *ctx)
+{
+   for (uint i = 0; i < ctx->num_inputs; ++i) {
+      const struct vrend_shader_io *io = &ctx->inputs[i];
+
+      if (io->glsl_predefined_no_emit || !vs_input_decoded(ctx, io))
+         continue;
+
+      if (ctx->key->vs_attrib_r11g11b10_bitmask & (1u << io->first)) {
+         /* the 11 and 10 bit floats are halfs without sign and with a
+          * shorter mantissa */
+         emit_buff(ctx, "%s = vec4(unpackHalf2x16(((in_%d & 0x7ffu) << 4) | "
+                   "(((in_%d >> 11) & 0x7ffu) << 20)), "
+                   "unpackHalf2x16(((in_%d >> 22) & 0x3ffu) << 5).x, 1.0);\n",
+                   io->glsl_name, io->first, io->first, io->first);
+      } else {
+         emit_buff(ctx, "%s = in_%d.zyxw;\n", io->glsl_name, io->first);
+      }
+   }
+}
+
 static
 void emit_fs_clipdistance_load(struct dump_ctx *ctx)
 {
@@ -4491,6 +4529,8 @@ iter_instruction(struct tgsi_iterate_context *iter,
       }
 
       emit_buf(ctx, "void main(void)\n{\n");
+      if (iter->processor.Processor == TGSI_PROCESSOR_VERTEX)
+         emit_vs_attrib_decode(ctx);
       if (iter->processor.Processor == TGSI_PROCESSOR_FRAGMENT) {
          emit_color_select(ctx);
          if (ctx->fs_uses_clipdist_input)
@@ -5369,6 +5409,13 @@ static void emit_image_decl(struct dump_ctx *ctx,
                access, volatile_str, precision, ptc, stc, sname, i);
 }
 
+static bool consts_in_ubo(const struct dump_ctx *ctx)
+{
+   return ctx->num_consts &&
+          ctx->num_consts <= ctx->cfg->max_const_ubo_consts &&
+          (int)util_bitcount(ctx->ubo_used_mask) < ctx->cfg->max_uniform_blocks;
+}
+
 static void emit_ios_common(struct dump_ctx *ctx)
 {
    uint i;
@@ -5402,7 +5449,10 @@ static void emit_ios_common(struct dump_ctx *ctx)
    }
    if (ctx->num_consts) {
       const char *cname = tgsi_proc_to_prefix(ctx->prog_type);
-      emit_hdrf(ctx, "uniform uvec4 %sconst0[%d];\n", cname, ctx->num_consts);
+      if (consts_in_ubo(ctx))
+         emit_hdrf(ctx, "layout(std140) uniform %sconstbuf { uvec4 %sconst0[%d]; };\n", cname, cname, ctx->num_consts);
+      else
+         emit_hdrf(ctx, "uniform uvec4 %sconst0[%d];\n", cname, ctx->num_consts);
    }
 
    if (ctx->ubo_used_mask) {
@@ -5739,7 +5789,12 @@ static void emit_ios_vs(struct dump_ctx *ctx)
          }
          if (ctx->inputs[i].first != ctx->inputs[i].last)
             snprintf(postfix, sizeof(postfix), "[%d]", ctx->inputs[i].last - ctx->inputs[i].first + 1);
-         emit_hdrf(ctx, "in vec4 %s%s;\n", ctx->inputs[i].glsl_name, postfix);
+         if (vs_input_decoded(ctx, &ctx->inputs[i])) {
+            bool packed = ctx->key->vs_attrib_r11g11b10_bitmask & (1u << ctx->inputs[i].first);
+            emit_hdrf(ctx, "in %s in_%d;\nvec4 %s;\n", packed ? "uint" : "vec4",
+                      ctx->inputs[i].first, ctx->inputs[i].glsl_name);
+         } else
+            emit_hdrf(ctx, "in vec4 %s%s;\n", ctx->inputs[i].glsl_name, postfix);
       }
    }
 
@@ -6261,6 +6316,7 @@ static void fill_sinfo(struct dump_ctx *ctx, struct vrend_shader_info *sinfo)
    sinfo->samplers_used_mask = ctx->samplers_used;
    sinfo->images_used_mask = ctx->images_used_mask;
    sinfo->num_consts = ctx->num_consts;
+   sinfo->consts_in_ubo = consts_in_ubo(ctx);
    sinfo->ubo_used_mask = ctx->ubo_used_mask;
 
    sinfo->ssbo_used_mask = ctx->ssbo_used_mask;
@@ -6329,9 +6385,18 @@ static void fill_sinfo(struct dump_ctx *ctx, struct vrend_shader_info *sinfo)
    }
 }
 
+/* rough GLSL size of one TGSI instruction, used to size the main buffer
+ * up front so large shaders are not built through a chain of reallocs */
+#define GLSL_BYTES_PER_INSTRUCTION 64
+#define GLSL_MAIN_MIN_ALLOC 4096
+#define GLSL_MAIN_MAX_ALLOC (1024 * 1024)
+
 static bool allocate_strbuffers(struct dump_ctx* ctx)
 {
-   if (!strbuf_alloc(&ctx->glsl_main, 4096))
+   size_t main_size = (size_t)ctx->info.num_instructions * GLSL_BYTES_PER_INSTRUCTION;
+
+   main_size = CLAMP(main_size, GLSL_MAIN_MIN_ALLOC, GLSL_MAIN_MAX_ALLOC);
+   if (!strbuf_alloc(&ctx->glsl_main, main_size))
       return false;
 
    if (strbuf_get_error(&ctx->glsl_main))
@@ -6360,20 +6425,47 @@ bool vrend_convert_shader(struct vrend_context *rctx,
 			  uint32_t req_local_mem,
 			  struct vrend_shader_key *key,
 			  struct vrend_shader_info *sinfo,
-                          struct vrend_strarray *shader)
+                          struct vrend_strarray *shader,
+                          struct vrend_shader_analysis **analysis)
 {
    struct dump_ctx ctx;
    boolean bret;
+   uint64_t cache_hash;
+
+   cache_hash = vrend_shader_cache_hash(cfg, tokens, req_local_mem, key, &sinfo->so_info);
+   if (vrend_shader_cache_lookup(cache_hash, sinfo, shader))
+      return true;
 
    memset(&ctx, 0, sizeof(struct dump_ctx));
 
-   /* First pass to deal with edge cases. */
-   if (ctx.prog_type == TGSI_PROCESSOR_FRAGMENT)
-      ctx.iter.iterate_declaration = iter_inputs;
-   ctx.iter.iterate_instruction = analyze_instruction;
-   bret = tgsi_iterate_shader(tokens, &ctx.iter);
-   if (bret == false)
-      return false;
+   if (analysis && *analysis) {
+      /* another variant of the selector already ran the passes that
+       * don't depend on the key */
+      ctx.info = (*analysis)->info;
+      ctx.ssbo_integer_mask = (*analysis)->ssbo_integer_mask;
+      ctx.integer_memory = (*analysis)->integer_memory;
+      ctx.fs_uses_clipdist_input = (*analysis)->fs_uses_clipdist_input;
+   } else {
+      /* First pass to deal with edge cases. */
+      if (ctx.prog_type == TGSI_PROCESSOR_FRAGMENT)
+         ctx.iter.iterate_declaration = iter_inputs;
+      ctx.iter.iterate_instruction = analyze_instruction;
+      bret = tgsi_iterate_shader(tokens, &ctx.iter);
+      if (bret == false)
+         return false;
+
+      tgsi_scan_shader(tokens, &ctx.info);
+
+      if (analysis) {
+         *analysis = malloc(sizeof(struct vrend_shader_analysis));
+         if (*analysis) {
+            (*analysis)->info = ctx.info;
+            (*analysis)->ssbo_integer_mask = ctx.ssbo_integer_mask;
+            (*analysis)->integer_memory = ctx.integer_memory;
+            (*analysis)->fs_uses_clipdist_input = ctx.fs_uses_clipdist_input;
+         }
+      }
+   }
 
    ctx.num_inputs = 0;
 
@@ -6397,8 +6489,6 @@ bool vrend_convert_shader(struct vrend_context *rctx,
    ctx.guest_sent_io_arrays = key->guest_sent_io_arrays;
    ctx.generic_outputs_expected_mask = key->generic_outputs_expected_mask;
 
-   tgsi_scan_shader(tokens, &ctx.info);
-   
    if (cfg->glsl_version >= 140)
       require_glsl_ver(&ctx, 140);
 
@@ -6446,6 +6536,7 @@ bool vrend_convert_shader(struct vrend_context *rctx,
    fill_sinfo(&ctx, sinfo);
    set_strbuffers(rctx, &ctx, shader);
 
+   vrend_shader_cache_store(cache_hash, sinfo, shader);
    return true;
  fail:
    strbuf_free(&ctx.glsl_main);
@@ -27,6 +27,7 @@
 
 #include "pipe/p_state.h"
 #include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_scan.h"
 
 #include "vrend_strbuf.h"
 /* need to store patching info for interpolation */
@@ -59,6 +60,8 @@ struct vrend_shader_info {
    bool guest_sent_io_arrays;
    struct vrend_layout_info generic_outputs_layout[64];
    int num_consts;
+   /* const0 lives in the <prefix>constbuf uniform block, not in uniforms */
+   bool consts_in_ubo;
    int num_inputs;
    int num_interps;
    int num_outputs;
@@ -124,6 +127,11 @@ struct vrend_shader_key {
    uint8_t num_indirect_patch_inputs;
    uint32_t generic_outputs_expected_mask;
    uint8_t fs_swizzle_output_rgb_to_bgr;
+   /* vertex attributes GLES can't fetch as the guest stored them, decoded
+    * in the vertex shader: BGRA ordered ones are swizzled, R11G11B10_FLOAT
+    * ones arrive as one uint */
+   uint32_t vs_attrib_zyxw_bitmask;
+   uint32_t vs_attrib_r11g11b10_bitmask;
 };
 
 struct vrend_shader_cfg {
@@ -131,6 +139,10 @@ struct vrend_shader_cfg {
    int max_draw_buffers;
    bool use_explicit_locations;
    bool has_es31_compat;
+   /* when non zero, constant buffer 0 of up to this many vec4 is declared
+    * as a uniform block if the stage has a block left for it */
+   int max_const_ubo_consts;
+   int max_uniform_blocks;
 };
 
 struct vrend_context;
@@ -146,13 +158,25 @@ bool vrend_patch_vertex_shader_interpolants(struct vrend_context *rctx,
                                             struct vrend_shader_info *fs_info,
                                             const char *oprefix, bool flatshade);
 
+/* Results of the TGSI passes that don't depend on the shader key, computed
+ * for the first variant of a selector and shared by the others. */
+struct vrend_shader_analysis {
+   struct tgsi_shader_info info;
+   uint32_t ssbo_integer_mask;
+   bool integer_memory;
+   bool fs_uses_clipdist_input;
+};
+
+/* analysis may be NULL; otherwise the first call allocates *analysis, which
+ * the caller frees with the tokens */
 bool vrend_convert_shader(struct  vrend_context *rctx,
                           struct vrend_shader_cfg *cfg,
                           const struct tgsi_token *tokens,
                           uint32_t req_local_mem,
                           struct vrend_shader_key *key,
                           struct vrend_shader_info *sinfo,
-                          struct vrend_strarray *shader);
+                          struct vrend_strarray *shader,
+                          struct vrend_shader_analysis **analysis);
 
 const char *vrend_shader_samplertypeconv(int sampler_type);
 
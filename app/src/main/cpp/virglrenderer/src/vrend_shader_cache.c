@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "util/u_double_list.h"
+#include "util/u_hash_table.h"
+#include "cso_cache/cso_cache.h"
+#include "tgsi/tgsi_parse.h"
+#include "os/os_thread.h"
+
+#include "vrend_shader_cache.h"
+#include "vrend_program_cache.h"
+
+#define SHADER_CACHE_MAGIC 0x56535443 /* "VSTC" */
+/* translations change with the translator, never reuse another build's */
+#define SHADER_CACHE_BUILD __DATE__ " " __TIME__
+#define SHADER_CACHE_NULL_STRING 0xffffffff
+
+struct shader_cache_entry {
+   struct list_head head;
+   uint64_t hash;
+   void *data;
+   uint32_t size;
+};
+
+struct shader_blob {
+   char *data;
+   uint32_t size;
+   uint32_t alloc_size;
+   bool error;
+};
+
+struct shader_blob_reader {
+   const char *data;
+   uint32_t size;
+   uint32_t pos;
+};
+
+/* clients translate on their own render threads */
+pipe_static_mutex(shader_cache_lock);
+
+static struct {
+   struct util_hash_table *table;
+   struct list_head entries;
+   uint32_t num_entries;
+} shader_cache;
+
+static unsigned shader_cache_key_hash(void *key)
+{
+   return cso_construct_key(key, sizeof(uint64_t));
+}
+
+static int shader_cache_key_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(uint64_t));
+}
+
+static void shader_cache_key_destroy(UNUSED void *value)
+{
+   /* entries are owned by shader_cache.entries */
+}
+
+uint64_t vrend_shader_cache_hash(const struct vrend_shader_cfg *cfg,
+                                 const struct tgsi_token *tokens,
+                                 uint32_t req_local_mem,
+                                 const struct vrend_shader_key *key,
+                                 const struct pipe_stream_output_info *so_info)
+{
+   uint64_t hash = vrend_program_cache_hash_begin();
+
+   hash = vrend_program_cache_hash_data(hash, SHADER_CACHE_BUILD, strlen(SHADER_CACHE_BUILD));
+   hash = vrend_program_cache_hash_data(hash, tokens,
+                                        tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   hash = vrend_program_cache_hash_data(hash, key, sizeof(*key));
+   hash = vrend_program_cache_hash_data(hash, cfg, sizeof(*cfg));
+   hash = vrend_program_cache_hash_data(hash, so_info, sizeof(*so_info));
+   return vrend_program_cache_hash_data(hash, &req_local_mem, sizeof(req_local_mem));
+}
+
+static void blob_write(struct shader_blob *blob, const void *data, uint32_t size)
+{
+   if (blob->error || !size)
+      return;
+
+   if (blob->size + size > blob->alloc_size) {
+      uint32_t alloc_size = MAX2(blob->alloc_size * 2, blob->size + size);
+      char *new_data = realloc(blob->data, alloc_size);
+      if (!new_data) {
+         blob->error = true;
+         return;
+      }
+      blob->data = new_data;
+      blob->alloc_size = alloc_size;
+   }
+   memcpy(blob->data + blob->size, data, size);
+   blob->size += size;
+}
+
+static void blob_write_u32(struct shader_blob *blob, uint32_t value)
+{
+   blob_write(blob, &value, sizeof(value));
+}
+
+static void blob_write_string(struct shader_blob *blob, const char *str, uint32_t size)
+{
+   if (!str) {
+      blob_write_u32(blob, SHADER_CACHE_NULL_STRING);
+      return;
+   }
+   blob_write_u32(blob, size);
+   blob_write(blob, str, size);
+}
+
+static const void *blob_read(struct shader_blob_reader *reader, uint32_t size)
+{
+   const void *data = reader->data + reader->pos;
+
+   if (size > reader->size - reader->pos)
+      return NULL;
+   reader->pos += size;
+   return data;
+}
+
+static bool blob_read_u32(struct shader_blob_reader *reader, uint32_t *value)
+{
+   const void *data = blob_read(reader, sizeof(*value));
+   if (!data)
+      return false;
+   memcpy(value, data, sizeof(*value));
+   return true;
+}
+
+/* returns a malloc'ed copy of a string written by blob_write_string */
+static bool blob_read_string(struct shader_blob_reader *reader, char **str, uint32_t *size)
+{
+   const char *data;
+
+   *str = NULL;
+   if (!blob_read_u32(reader, size))
+      return false;
+   if (*size == SHADER_CACHE_NULL_STRING)
+      return true;
+
+   data = blob_read(reader, *size);
+   if (!data)
+      return false;
+
+   *str = malloc(*size + 1);
+   if (!*str)
+      return false;
+   memcpy(*str, data, *size);
+   (*str)[*size] = 0;
+   return true;
+}
+
+static void *blob_read_array(struct shader_blob_reader *reader, int count, size_t elem_size)
+{
+   const void *data;
+   void *copy;
+
+   if (count <= 0)
+      return NULL;
+
+   data = blob_read(reader, count * elem_size);
+   if (!data)
+      return NULL;
+
+   copy = malloc(count * elem_size);
+   if (copy)
+      memcpy(copy, data, count * elem_size);
+   return copy;
+}
+
+void *vrend_shader_cache_serialize(const struct vrend_shader_info *sinfo,
+                                   const struct vrend_strarray *shader,
+                                   uint32_t *size)
+{
+   struct shader_blob blob = { 0 };
+   struct vrend_shader_info info = *sinfo;
+   bool has_interps = sinfo->interpinfo && sinfo->num_interps > 0;
+   uint32_t i;
+   int j;
+
+   info.sampler_arrays = NULL;
+   info.image_arrays = NULL;
+   info.interpinfo = NULL;
+   info.so_names = NULL;
+
+   blob_write_u32(&blob, SHADER_CACHE_MAGIC);
+   blob_write_u32(&blob, sizeof(info));
+   blob_write(&blob, &info, sizeof(info));
+
+   blob_write_u32(&blob, has_interps);
+   if (has_interps)
+      blob_write(&blob, sinfo->interpinfo, sinfo->num_interps * sizeof(*sinfo->interpinfo));
+   if (sinfo->num_sampler_arrays > 0)
+      blob_write(&blob, sinfo->sampler_arrays, sinfo->num_sampler_arrays * sizeof(*sinfo->sampler_arrays));
+   if (sinfo->num_image_arrays > 0)
+      blob_write(&blob, sinfo->image_arrays, sinfo->num_image_arrays * sizeof(*sinfo->image_arrays));
+
+   blob_write_u32(&blob, sinfo->so_names != NULL);
+   if (sinfo->so_names) {
+      for (i = 0; i < sinfo->so_info.num_outputs; i++) {
+         const char *name = sinfo->so_names[i];
+         blob_write_string(&blob, name, name ? strlen(name) : 0);
+      }
+   }
+
+   blob_write_u32(&blob, shader->num_strings);
+   for (j = 0; j < shader->num_strings; j++)
+      blob_write_string(&blob, shader->strings[j].buf, shader->strings[j].size);
+
+   if (blob.error) {
+      free(blob.data);
+      return NULL;
+   }
+
+   *size = blob.size;
+   return blob.data;
+}
+
+static void free_so_names(char **so_names, uint32_t count)
+{
+   uint32_t i;
+
+   if (!so_names)
+      return;
+   for (i = 0; i < count; i++)
+      free(so_names[i]);
+   free(so_names);
+}
+
+bool vrend_shader_cache_deserialize(const void *data, uint32_t size,
+                                    struct vrend_shader_info *sinfo,
+                                    struct vrend_strarray *shader)
+{
+   struct shader_blob_reader reader = { data, size, 0 };
+   struct vrend_shader_info info;
+   struct vrend_interp_info *interpinfo = NULL;
+   struct vrend_array *sampler_arrays = NULL, *image_arrays = NULL;
+   char **so_names = NULL;
+   const void *info_data;
+   uint32_t value, num_strings, i;
+
+   if (!blob_read_u32(&reader, &value) || value != SHADER_CACHE_MAGIC ||
+       !blob_read_u32(&reader, &value) || value != sizeof(info) ||
+       !(info_data = blob_read(&reader, sizeof(info))))
+      return false;
+   memcpy(&info, info_data, sizeof(info));
+
+   if (!blob_read_u32(&reader, &value))
+      return false;
+   if (value) {
+      interpinfo = blob_read_array(&reader, info.num_interps, sizeof(*interpinfo));
+      if (!interpinfo)
+         goto fail;
+   }
+   if (info.num_sampler_arrays > 0) {
+      sampler_arrays = blob_read_array(&reader, info.num_sampler_arrays, sizeof(*sampler_arrays));
+      if (!sampler_arrays)
+         goto fail;
+   }
+   if (info.num_image_arrays > 0) {
+      image_arrays = blob_read_array(&reader, info.num_image_arrays, sizeof(*image_arrays));
+      if (!image_arrays)
+         goto fail;
+   }
+
+   if (!blob_read_u32(&reader, &value))
+      goto fail;
+   if (value && info.so_info.num_outputs) {
+      so_names = calloc(info.so_info.num_outputs, sizeof(char *));
+      if (!so_names)
+         goto fail;
+      for (i = 0; i < info.so_info.num_outputs; i++) {
+         uint32_t length;
+         if (!blob_read_string(&reader, &so_names[i], &length))
+            goto fail;
+      }
+   }
+
+   if (!blob_read_u32(&reader, &num_strings) ||
+       num_strings > (uint32_t)(shader->num_alloced_strings - shader->num_strings))
+      goto fail;
+
+   for (i = 0; i < num_strings; i++) {
+      struct vrend_strbuf sb;
+      uint32_t length;
+      char *str;
+
+      if (!blob_read_string(&reader, &str, &length) || !str) {
+         free(str);
+         goto fail_strings;
+      }
+      sb.buf = str;
+      sb.alloc_size = length + 1;
+      sb.size = length;
+      sb.error_state = false;
+      strarray_addstrbuf(shader, &sb);
+   }
+
+   /* replace what the previous variant of the selector left behind, like
+    * a translation does */
+   free_so_names(sinfo->so_names, sinfo->so_info.num_outputs);
+   free(sinfo->sampler_arrays);
+   free(sinfo->image_arrays);
+   if (interpinfo)
+      free(sinfo->interpinfo);
+   else
+      interpinfo = sinfo->interpinfo;
+
+   *sinfo = info;
+   sinfo->interpinfo = interpinfo;
+   sinfo->sampler_arrays = sampler_arrays;
+   sinfo->image_arrays = image_arrays;
+   sinfo->so_names = so_names;
+   return true;
+
+fail_strings:
+   for (i = 0; i < (uint32_t)shader->num_strings; i++)
+      strbuf_free(&shader->strings[i]);
+   shader->num_strings = 0;
+fail:
+   free_so_names(so_names, info.so_info.num_outputs);
+   free(image_arrays);
+   free(sampler_arrays);
+   free(interpinfo);
+   return false;
+}
+
+static void shader_cache_init_locked(void)
+{
+   if (shader_cache.table)
+      return;
+
+   shader_cache.table = util_hash_table_create(shader_cache_key_hash,
+                                               shader_cache_key_compare,
+                                               shader_cache_key_destroy);
+   list_inithead(&shader_cache.entries);
+}
+
+static void shader_cache_insert_locked(uint64_t hash, void *data, uint32_t size)
+{
+   struct shader_cache_entry *entry;
+
+   shader_cache_init_locked();
+   if (!shader_cache.table || util_hash_table_get(shader_cache.table, &hash)) {
+      free(data);
+      return;
+   }
+
+   entry = CALLOC_STRUCT(shader_cache_entry);
+   if (!entry) {
+      free(data);
+      return;
+   }
+   entry->hash = hash;
+   entry->data = data;
+   entry->size = size;
+
+   util_hash_table_set(shader_cache.table, &entry->hash, entry);
+   list_add(&entry->head, &shader_cache.entries);
+   shader_cache.num_entries++;
+
+   if (shader_cache.num_entries > VREND_SHADER_CACHE_SIZE) {
+      struct shader_cache_entry *oldest;
+
+      oldest = LIST_ENTRY(struct shader_cache_entry, shader_cache.entries.prev, head);
+      util_hash_table_remove(shader_cache.table, &oldest->hash);
+      list_del(&oldest->head);
+      shader_cache.num_entries--;
+      free(oldest->data);
+      FREE(oldest);
+   }
+}
+
+bool vrend_shader_cache_lookup(uint64_t hash, struct vrend_shader_info *sinfo,
+                               struct vrend_strarray *shader)
+{
+   struct shader_cache_entry *entry = NULL;
+   bool found = false;
+   uint32_t size;
+   void *data;
+
+   pipe_mutex_lock(shader_cache_lock);
+   if (shader_cache.table)
+      entry = util_hash_table_get(shader_cache.table, &hash);
+   if (entry) {
+      list_del(&entry->head);
+      list_add(&entry->head, &shader_cache.entries);
+      found = vrend_shader_cache_deserialize(entry->data, entry->size, sinfo, shader);
+   }
+   pipe_mutex_unlock(shader_cache_lock);
+
+   if (entry)
+      return found;
+
+   data = vrend_program_cache_load_blob(hash, &size);
+   if (!data)
+      return false;
+
+   if (!vrend_shader_cache_deserialize(data, size, sinfo, shader)) {
+      free(data);
+      return false;
+   }
+
+   pipe_mutex_lock(shader_cache_lock);
+   shader_cache_insert_locked(hash, data, size);
+   pipe_mutex_unlock(shader_cache_lock);
+   return true;
+}
+
+void vrend_shader_cache_store(uint64_t hash, const struct vrend_shader_info *sinfo,
+                              const struct vrend_strarray *shader)
+{
+   uint32_t size;
+   void *data = vrend_shader_cache_serialize(sinfo, shader, &size);
+
+   if (!data)
+      return;
+
+   vrend_program_cache_store_blob(hash, data, size);
+
+   pipe_mutex_lock(shader_cache_lock);
+   shader_cache_insert_locked(hash, data, size);
+   pipe_mutex_unlock(shader_cache_lock);
+}
@@ -0,0 +1,42 @@
+#ifndef VREND_SHADER_CACHE_H
+#define VREND_SHADER_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vrend_shader.h"
+
+/*
+ * Cache of TGSI to GLSL translations.
+ *
+ * Entries are keyed by a 64-bit hash of everything vrend_convert_shader()
+ * reads: the tokens, the variant key, the shader config, the stream output
+ * info and the requested local memory, seeded with the program cache's
+ * driver hash and the build.  A translation is kept as one flat blob of its
+ * GLSL strings and vrend_shader_info, shared by every client in the process
+ * and written to the program cache directory for later sessions.
+ */
+
+#define VREND_SHADER_CACHE_SIZE 2048
+
+uint64_t vrend_shader_cache_hash(const struct vrend_shader_cfg *cfg,
+                                 const struct tgsi_token *tokens,
+                                 uint32_t req_local_mem,
+                                 const struct vrend_shader_key *key,
+                                 const struct pipe_stream_output_info *so_info);
+
+/* fills sinfo and the empty shader array like vrend_convert_shader() */
+bool vrend_shader_cache_lookup(uint64_t hash, struct vrend_shader_info *sinfo,
+                               struct vrend_strarray *shader);
+void vrend_shader_cache_store(uint64_t hash, const struct vrend_shader_info *sinfo,
+                              const struct vrend_strarray *shader);
+
+/* self contained serialized form of one translation, malloc'ed */
+void *vrend_shader_cache_serialize(const struct vrend_shader_info *sinfo,
+                                   const struct vrend_strarray *shader,
+                                   uint32_t *size);
+bool vrend_shader_cache_deserialize(const void *data, uint32_t size,
+                                    struct vrend_shader_info *sinfo,
+                                    struct vrend_strarray *shader);
+
+#endif
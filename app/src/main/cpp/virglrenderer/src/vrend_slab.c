@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_math.h"
+
+#include "vrend_slab.h"
+
+/* keeps the objects behind the header aligned for any type */
+#define VREND_SLAB_ALIGNMENT 16
+
+struct vrend_slab_elem {
+   union {
+      struct vrend_slab *slab;
+      struct vrend_slab_elem *next;
+   };
+};
+
+struct vrend_slab_page {
+   struct vrend_slab_page *next;
+};
+
+#define VREND_SLAB_HEADER_SIZE align(sizeof(struct vrend_slab_elem), VREND_SLAB_ALIGNMENT)
+#define VREND_SLAB_PAGE_HEADER_SIZE align(sizeof(struct vrend_slab_page), VREND_SLAB_ALIGNMENT)
+
+void vrend_slab_init(struct vrend_slab *slab, size_t size, unsigned elems_per_page)
+{
+   slab->elem_size = VREND_SLAB_HEADER_SIZE + align(size, VREND_SLAB_ALIGNMENT);
+   slab->elems_per_page = elems_per_page;
+   slab->pages = NULL;
+   slab->free_list = NULL;
+}
+
+void vrend_slab_fini(struct vrend_slab *slab)
+{
+   struct vrend_slab_page *page = slab->pages;
+
+   while (page) {
+      struct vrend_slab_page *next = page->next;
+      free(page);
+      page = next;
+   }
+   slab->pages = NULL;
+   slab->free_list = NULL;
+}
+
+static bool vrend_slab_add_page(struct vrend_slab *slab)
+{
+   struct vrend_slab_page *page;
+   char *elems;
+   unsigned i;
+
+   page = malloc(VREND_SLAB_PAGE_HEADER_SIZE + slab->elem_size * slab->elems_per_page);
+   if (!page)
+      return false;
+
+   page->next = slab->pages;
+   slab->pages = page;
+
+   /* thread the new objects in address order */
+   elems = (char *)page + VREND_SLAB_PAGE_HEADER_SIZE;
+   for (i = slab->elems_per_page; i > 0; i--) {
+      struct vrend_slab_elem *elem = (struct vrend_slab_elem *)(elems + (i - 1) * slab->elem_size);
+      elem->next = slab->free_list;
+      slab->free_list = elem;
+   }
+   return true;
+}
+
+void *vrend_slab_alloc(struct vrend_slab *slab)
+{
+   struct vrend_slab_elem *elem;
+   char *ptr;
+
+   if (!slab->free_list && !vrend_slab_add_page(slab))
+      return NULL;
+
+   elem = slab->free_list;
+   slab->free_list = elem->next;
+   elem->slab = slab;
+
+   ptr = (char *)elem + VREND_SLAB_HEADER_SIZE;
+   memset(ptr, 0, slab->elem_size - VREND_SLAB_HEADER_SIZE);
+   return ptr;
+}
+
+void vrend_slab_free(void *ptr)
+{
+   struct vrend_slab_elem *elem;
+   struct vrend_slab *slab;
+
+   if (!ptr)
+      return;
+
+   elem = (struct vrend_slab_elem *)((char *)ptr - VREND_SLAB_HEADER_SIZE);
+   slab = elem->slab;
+   elem->next = slab->free_list;
+   slab->free_list = elem;
+}
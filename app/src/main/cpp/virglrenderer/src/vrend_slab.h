@@ -0,0 +1,33 @@
+#ifndef VREND_SLAB_H
+#define VREND_SLAB_H
+
+#include <stddef.h>
+
+/*
+ * Fixed size object allocator.
+ *
+ * Objects are carved out of pages of elems_per_page objects and recycled
+ * through a free list; every object remembers its slab, so it can be freed
+ * without one at hand.  vrend_slab_fini() releases all pages at once, after
+ * every object has been freed.  Not thread safe, a slab belongs to one
+ * render thread.
+ */
+
+struct vrend_slab_elem;
+struct vrend_slab_page;
+
+struct vrend_slab {
+   size_t elem_size;
+   unsigned elems_per_page;
+   struct vrend_slab_page *pages;
+   struct vrend_slab_elem *free_list;
+};
+
+void vrend_slab_init(struct vrend_slab *slab, size_t size, unsigned elems_per_page);
+void vrend_slab_fini(struct vrend_slab *slab);
+
+/* returns a zeroed object like CALLOC_STRUCT */
+void *vrend_slab_alloc(struct vrend_slab *slab);
+void vrend_slab_free(void *ptr);
+
+#endif
@@ -80,10 +80,12 @@ static inline bool strbuf_alloc(struct vrend_strbuf *sb, int initial_size)
 static inline bool strbuf_grow(struct vrend_strbuf *sb, int len)
 {
    if (sb->size + len + 1 > sb->alloc_size) {
-      /* Reallocate to the larger size of current alloc + min realloc,
-       * or the resulting string size if larger.
+      /* Reallocate to twice the current alloc (at least min realloc more),
+       * or the resulting string size if larger, so appending n bytes costs
+       * O(n) copying overall instead of O(n^2).
        */
-      size_t new_size = MAX2(sb->size + len + 1, sb->alloc_size + STRBUF_MIN_MALLOC);
+      size_t new_size = MAX2(sb->size + len + 1,
+                             sb->alloc_size + MAX2(sb->alloc_size, STRBUF_MIN_MALLOC));
       char *new = realloc(sb->buf, new_size);
       if (!new) {
          strbuf_set_error(sb);
@@ -111,17 +113,29 @@ static inline void strbuf_append(struct vrend_strbuf *sb, const char *addstr)
    strbuf_append_buffer(sb, addstr, strlen(addstr));
 }
 
+/* headroom reserved before formatting, enough for nearly every emitted
+ * line so vsnprintf only has to run once */
+#define STRBUF_APPENDF_RESERVE 256
+
 static inline void strbuf_vappendf(struct vrend_strbuf *sb, const char *fmt, va_list ap)
 {
    va_list cp;
-   va_copy(cp, ap);
 
+   if (strbuf_get_error(sb) ||
+       !strbuf_grow(sb, STRBUF_APPENDF_RESERVE))
+      return;
+
+   va_copy(cp, ap);
    int len = vsnprintf(sb->buf + sb->size, sb->alloc_size - sb->size, fmt, ap);
    if (len >= (int)(sb->alloc_size - sb->size)) {
-      if (!strbuf_grow(sb, len))
-        return;
+      if (!strbuf_grow(sb, len)) {
+         sb->buf[sb->size] = '\0';
+         va_end(cp);
+         return;
+      }
       vsnprintf(sb->buf + sb->size, sb->alloc_size - sb->size, fmt, cp);
    }
+   va_end(cp);
    sb->size += len;
 }
 
@@ -183,6 +197,26 @@ static inline bool strarray_addstrbuf(struct vrend_strarray *sa, struct vrend_st
    return true;
 }
 
+/* deep copy of src into sa, which is not allocated yet */
+static inline bool strarray_dup(struct vrend_strarray *sa, const struct vrend_strarray *src)
+{
+   if (!strarray_alloc(sa, src->num_alloced_strings))
+      return false;
+   for (int i = 0; i < src->num_strings; i++) {
+      struct vrend_strbuf sb;
+      if (!strbuf_alloc(&sb, src->strings[i].size + 1)) {
+         for (int j = 0; j < sa->num_strings; j++)
+            strbuf_free(&sa->strings[j]);
+         free(sa->strings);
+         return false;
+      }
+      memcpy(sb.buf, src->strings[i].buf, src->strings[i].size + 1);
+      sb.size = src->strings[i].size;
+      strarray_addstrbuf(sa, &sb);
+   }
+   return true;
+}
+
 static inline void strarray_free(struct vrend_strarray *sa, bool free_strings)
 {
    if (free_strings) {
@@ -0,0 +1,234 @@
+#include <string.h>
+
+#include "vrend_texture_decode.h"
+
+#define BLOCK_DIM 4
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t read_le48(const uint8_t *p)
+{
+   return read_le32(p) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40);
+}
+
+static void expand_565(uint16_t c, uint8_t out[4])
+{
+   uint8_t r = (c >> 11) & 0x1f;
+   uint8_t g = (c >> 5) & 0x3f;
+   uint8_t b = c & 0x1f;
+
+   out[0] = (r << 3) | (r >> 2);
+   out[1] = (g << 2) | (g >> 4);
+   out[2] = (b << 3) | (b >> 2);
+   out[3] = 0xff;
+}
+
+/* BC1 color block into 16 RGBA texels; BC2/BC3 always use the four color mode */
+static void decode_color_block(const uint8_t *block, bool four_color_only, uint8_t texels[16][4])
+{
+   uint16_t c0 = block[0] | (block[1] << 8);
+   uint16_t c1 = block[2] | (block[3] << 8);
+   uint32_t indices = read_le32(block + 4);
+   uint8_t palette[4][4];
+   int i;
+
+   expand_565(c0, palette[0]);
+   expand_565(c1, palette[1]);
+
+   if (c0 > c1 || four_color_only) {
+      for (i = 0; i < 3; i++) {
+         palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+         palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+      }
+      palette[2][3] = palette[3][3] = 0xff;
+   } else {
+      for (i = 0; i < 3; i++)
+         palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+      palette[2][3] = 0xff;
+      memset(palette[3], 0, 4);
+   }
+
+   for (i = 0; i < 16; i++)
+      memcpy(texels[i], palette[(indices >> (2 * i)) & 3], 4);
+}
+
+/* BC4 block (also the alpha of BC3 and each channel of BC5) into 16 values */
+static void decode_unorm_block(const uint8_t *block, uint8_t values[16])
+{
+   uint8_t a0 = block[0], a1 = block[1];
+   uint64_t indices = read_le48(block + 2);
+   uint8_t palette[8];
+   int i;
+
+   palette[0] = a0;
+   palette[1] = a1;
+   if (a0 > a1) {
+      for (i = 1; i < 7; i++)
+         palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+   } else {
+      for (i = 1; i < 5; i++)
+         palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+      palette[6] = 0;
+      palette[7] = 0xff;
+   }
+
+   for (i = 0; i < 16; i++)
+      values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+static void decode_snorm_block(const uint8_t *block, int8_t values[16])
+{
+   /* -128 and -127 both map to -1.0 */
+   int a0 = (int8_t)block[0] < -127 ? -127 : (int8_t)block[0];
+   int a1 = (int8_t)block[1] < -127 ? -127 : (int8_t)block[1];
+   uint64_t indices = read_le48(block + 2);
+   int8_t palette[8];
+   int i;
+
+   palette[0] = a0;
+   palette[1] = a1;
+   if (a0 > a1) {
+      for (i = 1; i < 7; i++)
+         palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+   } else {
+      for (i = 1; i < 5; i++)
+         palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+      palette[6] = -127;
+      palette[7] = 127;
+   }
+
+   for (i = 0; i < 16; i++)
+      values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+/* decodes one block into 16 texels of texel_size bytes, row major */
+static void decode_block(enum virgl_formats format, const uint8_t *block, uint8_t *texels)
+{
+   uint8_t rgba[16][4];
+   uint8_t channel[2][16];
+   int i;
+
+   switch (format) {
+   case VIRGL_FORMAT_DXT1_RGB:
+   case VIRGL_FORMAT_DXT1_SRGB:
+   case VIRGL_FORMAT_DXT1_RGBA:
+   case VIRGL_FORMAT_DXT1_SRGBA:
+      decode_color_block(block, false, (uint8_t (*)[4])texels);
+      break;
+   case VIRGL_FORMAT_DXT3_RGBA:
+   case VIRGL_FORMAT_DXT3_SRGBA:
+      decode_color_block(block + 8, true, (uint8_t (*)[4])texels);
+      for (i = 0; i < 16; i++) {
+         uint8_t a = (block[i / 2] >> (4 * (i & 1))) & 0xf;
+         texels[i * 4 + 3] = (a << 4) | a;
+      }
+      break;
+   case VIRGL_FORMAT_DXT5_RGBA:
+   case VIRGL_FORMAT_DXT5_SRGBA:
+      decode_color_block(block + 8, true, rgba);
+      decode_unorm_block(block, channel[0]);
+      for (i = 0; i < 16; i++) {
+         memcpy(&texels[i * 4], rgba[i], 3);
+         texels[i * 4 + 3] = channel[0][i];
+      }
+      break;
+   case VIRGL_FORMAT_RGTC1_UNORM:
+      decode_unorm_block(block, texels);
+      break;
+   case VIRGL_FORMAT_RGTC1_SNORM:
+      decode_snorm_block(block, (int8_t *)texels);
+      break;
+   case VIRGL_FORMAT_RGTC2_UNORM:
+      decode_unorm_block(block, channel[0]);
+      decode_unorm_block(block + 8, channel[1]);
+      for (i = 0; i < 16; i++) {
+         texels[i * 2] = channel[0][i];
+         texels[i * 2 + 1] = channel[1][i];
+      }
+      break;
+   case VIRGL_FORMAT_RGTC2_SNORM:
+      decode_snorm_block(block, (int8_t *)channel[0]);
+      decode_snorm_block(block + 8, (int8_t *)channel[1]);
+      for (i = 0; i < 16; i++) {
+         texels[i * 2] = channel[0][i];
+         texels[i * 2 + 1] = channel[1][i];
+      }
+      break;
+   default:
+      break;
+   }
+}
+
+bool vrend_texture_decode_supported(enum virgl_formats format)
+{
+   return vrend_texture_decode_texel_size(format) != 0;
+}
+
+uint32_t vrend_texture_decode_texel_size(enum virgl_formats format)
+{
+   switch (format) {
+   case VIRGL_FORMAT_DXT1_RGB:
+   case VIRGL_FORMAT_DXT1_SRGB:
+   case VIRGL_FORMAT_DXT1_RGBA:
+   case VIRGL_FORMAT_DXT1_SRGBA:
+   case VIRGL_FORMAT_DXT3_RGBA:
+   case VIRGL_FORMAT_DXT3_SRGBA:
+   case VIRGL_FORMAT_DXT5_RGBA:
+   case VIRGL_FORMAT_DXT5_SRGBA:
+      return 4;
+   case VIRGL_FORMAT_RGTC1_UNORM:
+   case VIRGL_FORMAT_RGTC1_SNORM:
+      return 1;
+   case VIRGL_FORMAT_RGTC2_UNORM:
+   case VIRGL_FORMAT_RGTC2_SNORM:
+      return 2;
+   default:
+      return 0;
+   }
+}
+
+static uint32_t block_size(enum virgl_formats format)
+{
+   switch (format) {
+   case VIRGL_FORMAT_DXT1_RGB:
+   case VIRGL_FORMAT_DXT1_SRGB:
+   case VIRGL_FORMAT_DXT1_RGBA:
+   case VIRGL_FORMAT_DXT1_SRGBA:
+   case VIRGL_FORMAT_RGTC1_UNORM:
+   case VIRGL_FORMAT_RGTC1_SNORM:
+      return 8;
+   default:
+      return 16;
+   }
+}
+
+void vrend_texture_decode(enum virgl_formats format,
+                          const uint8_t *src, uint32_t src_stride,
+                          uint8_t *dst, uint32_t dst_stride,
+                          uint32_t width, uint32_t height)
+{
+   uint32_t texel_size = vrend_texture_decode_texel_size(format);
+   uint32_t bsize = block_size(format);
+   uint8_t texels[16 * 4];
+   uint32_t bx, by, row;
+
+   if (!texel_size)
+      return;
+
+   for (by = 0; by < height; by += BLOCK_DIM) {
+      const uint8_t *block = src + (by / BLOCK_DIM) * src_stride;
+      uint32_t rows = height - by < BLOCK_DIM ? height - by : BLOCK_DIM;
+
+      for (bx = 0; bx < width; bx += BLOCK_DIM, block += bsize) {
+         uint32_t cols = width - bx < BLOCK_DIM ? width - bx : BLOCK_DIM;
+
+         decode_block(format, block, texels);
+         for (row = 0; row < rows; row++)
+            memcpy(dst + (by + row) * dst_stride + bx * texel_size,
+                   &texels[row * BLOCK_DIM * texel_size], cols * texel_size);
+      }
+   }
+}
@@ -0,0 +1,33 @@
+#ifndef VREND_TEXTURE_DECODE_H
+#define VREND_TEXTURE_DECODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "virgl_hw.h"
+
+/*
+ * Server side decoding of BC1-BC5 (DXT/RGTC) blocks.
+ *
+ * GLES drivers rarely expose S3TC or RGTC, so the guest would otherwise
+ * decompress these textures on its CPU and send them over at 4-8 times
+ * their size.  Formats registered with VIRGL_TEXTURE_NEED_DECODE keep the
+ * compressed layout on the wire and are expanded here right before the
+ * upload: DXT to 8-bit RGBA, RGTC1 to R8 and RGTC2 to RG8 (signed for the
+ * SNORM variants).
+ */
+
+bool vrend_texture_decode_supported(enum virgl_formats format);
+
+/* bytes per decoded texel */
+uint32_t vrend_texture_decode_texel_size(enum virgl_formats format);
+
+/* decodes width x height texels of tightly packed block rows of src_stride
+ * bytes into dst, whose rows are dst_stride bytes apart; partial blocks at
+ * the right and bottom edges are clipped */
+void vrend_texture_decode(enum virgl_formats format,
+                          const uint8_t *src, uint32_t src_stride,
+                          uint8_t *dst, uint32_t dst_stride,
+                          uint32_t width, uint32_t height);
+
+#endif
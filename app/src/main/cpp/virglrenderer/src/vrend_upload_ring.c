@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+
+#include "vrend_upload_ring.h"
+
+#define VREND_UPLOAD_RING_MAX_REGIONS 256
+#define VREND_UPLOAD_RING_ALIGNMENT 16
+
+struct vrend_upload_region {
+   uint32_t start;
+   uint32_t end;
+   uint32_t fence_id;
+};
+
+struct vrend_upload_ring {
+   GLuint id;
+   uint32_t size;
+   char *persistent_ptr;
+
+   /* write position, live regions run from the oldest one up to it */
+   uint32_t head;
+   struct vrend_upload_region regions[VREND_UPLOAD_RING_MAX_REGIONS];
+   uint32_t first_region;
+   uint32_t num_regions;
+
+   /* region handed out by the last map */
+   uint32_t pending_start;
+   uint32_t pending_size;
+};
+
+typedef void (GL_APIENTRYP PFNGLBUFFERSTORAGEEXTPROC_) (GLenum target, GLsizeiptr size,
+                                                       const void *data, GLbitfield flags);
+
+#ifndef GL_MAP_PERSISTENT_BIT_EXT
+#define GL_MAP_PERSISTENT_BIT_EXT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT_EXT
+#define GL_MAP_COHERENT_BIT_EXT 0x0080
+#endif
+
+static PFNGLBUFFERSTORAGEEXTPROC_ vrend_get_buffer_storage(void)
+{
+   if (!vrend_has_gl_extension("GL_EXT_buffer_storage"))
+      return NULL;
+   return (PFNGLBUFFERSTORAGEEXTPROC_)eglGetProcAddress("glBufferStorageEXT");
+}
+
+struct vrend_upload_ring *vrend_upload_ring_create(uint32_t size)
+{
+   GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+   PFNGLBUFFERSTORAGEEXTPROC_ buffer_storage = vrend_get_buffer_storage();
+   struct vrend_upload_ring *ring;
+
+   ring = CALLOC_STRUCT(vrend_upload_ring);
+   if (!ring)
+      return NULL;
+
+   ring->size = size;
+   glGenBuffers(1, &ring->id);
+   glBindBuffer(GL_COPY_READ_BUFFER, ring->id);
+
+   if (buffer_storage) {
+      buffer_storage(GL_COPY_READ_BUFFER, size, NULL, flags);
+      if (glGetError() == GL_NO_ERROR)
+         ring->persistent_ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+   }
+
+   /* immutable storage that failed to map cannot be respecified */
+   if (buffer_storage && !ring->persistent_ptr) {
+      glDeleteBuffers(1, &ring->id);
+      glGenBuffers(1, &ring->id);
+      glBindBuffer(GL_COPY_READ_BUFFER, ring->id);
+   }
+   if (!ring->persistent_ptr)
+      glBufferData(GL_COPY_READ_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+   glBindBuffer(GL_COPY_READ_BUFFER, 0);
+   return ring;
+}
+
+void vrend_upload_ring_destroy(struct vrend_upload_ring *ring)
+{
+   if (!ring)
+      return;
+
+   if (ring->persistent_ptr) {
+      glBindBuffer(GL_COPY_READ_BUFFER, ring->id);
+      glUnmapBuffer(GL_COPY_READ_BUFFER);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+   }
+   glDeleteBuffers(1, &ring->id);
+   FREE(ring);
+}
+
+GLuint vrend_upload_ring_buffer(struct vrend_upload_ring *ring)
+{
+   return ring->id;
+}
+
+static bool vrend_upload_ring_alloc(struct vrend_upload_ring *ring, uint32_t size, uint32_t *offset)
+{
+   uint32_t tail;
+
+   if (!ring->num_regions) {
+      ring->head = 0;
+      *offset = 0;
+      return size <= ring->size;
+   }
+
+   if (ring->num_regions == VREND_UPLOAD_RING_MAX_REGIONS)
+      return false;
+
+   tail = ring->regions[ring->first_region].start;
+   if (ring->head > tail) {
+      if (ring->head + size <= ring->size) {
+         *offset = ring->head;
+         return true;
+      }
+      /* wrap, leaving the end of the buffer to the regions before it;
+       * stopping short of the oldest region keeps head == tail unambiguous */
+      *offset = 0;
+      return size < tail;
+   }
+
+   *offset = ring->head;
+   return ring->head + size < tail;
+}
+
+void *vrend_upload_ring_map(struct vrend_upload_ring *ring, uint32_t size, uint32_t *offset)
+{
+   uint32_t aligned = align(size, VREND_UPLOAD_RING_ALIGNMENT);
+   void *ptr;
+
+   if (!size || !vrend_upload_ring_alloc(ring, aligned, offset))
+      return NULL;
+
+   if (ring->persistent_ptr) {
+      ptr = ring->persistent_ptr + *offset;
+   } else {
+      glBindBuffer(GL_COPY_READ_BUFFER, ring->id);
+      ptr = glMapBufferRange(GL_COPY_READ_BUFFER, *offset, size,
+                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                             GL_MAP_UNSYNCHRONIZED_BIT);
+      if (!ptr)
+         return NULL;
+   }
+
+   ring->pending_start = *offset;
+   ring->pending_size = aligned;
+   return ptr;
+}
+
+void vrend_upload_ring_unmap(struct vrend_upload_ring *ring, uint32_t fence_id)
+{
+   struct vrend_upload_region *last = NULL;
+   uint32_t end = ring->pending_start + ring->pending_size;
+
+   if (!ring->persistent_ptr) {
+      glBindBuffer(GL_COPY_READ_BUFFER, ring->id);
+      glUnmapBuffer(GL_COPY_READ_BUFFER);
+   }
+
+   if (ring->num_regions) {
+      uint32_t index = (ring->first_region + ring->num_regions - 1) % VREND_UPLOAD_RING_MAX_REGIONS;
+      last = &ring->regions[index];
+   }
+
+   /* uploads between two fences usually follow each other */
+   if (last && last->fence_id == fence_id && last->end == ring->pending_start) {
+      last->end = end;
+   } else {
+      uint32_t index = (ring->first_region + ring->num_regions) % VREND_UPLOAD_RING_MAX_REGIONS;
+      ring->regions[index].start = ring->pending_start;
+      ring->regions[index].end = end;
+      ring->regions[index].fence_id = fence_id;
+      ring->num_regions++;
+   }
+
+   ring->head = end;
+   ring->pending_size = 0;
+}
+
+void vrend_upload_ring_retire(struct vrend_upload_ring *ring, uint32_t fence_id)
+{
+   while (ring->num_regions &&
+          ring->regions[ring->first_region].fence_id <= fence_id) {
+      ring->first_region = (ring->first_region + 1) % VREND_UPLOAD_RING_MAX_REGIONS;
+      ring->num_regions--;
+   }
+}
@@ -0,0 +1,37 @@
+#ifndef VREND_UPLOAD_RING_H
+#define VREND_UPLOAD_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vrend_util.h"
+
+/*
+ * Staging ring for buffer uploads.
+ *
+ * Data is written into free space of a single GL buffer and then copied
+ * into its destination with glCopyBufferSubData, which the GPU orders
+ * after the draws that still read the old contents instead of the CPU
+ * waiting for them.  Every region is tagged with the fence id that will
+ * cover its copy and is only reused once that fence has been retired.
+ * The buffer is persistently mapped when GL_EXT_buffer_storage is there,
+ * otherwise each region is mapped unsynchronized on its own.
+ */
+
+struct vrend_upload_ring;
+
+struct vrend_upload_ring *vrend_upload_ring_create(uint32_t size);
+void vrend_upload_ring_destroy(struct vrend_upload_ring *ring);
+
+GLuint vrend_upload_ring_buffer(struct vrend_upload_ring *ring);
+
+/* returns where to write size bytes and their offset in the ring buffer,
+ * NULL when there is no retired space left for them */
+void *vrend_upload_ring_map(struct vrend_upload_ring *ring, uint32_t size, uint32_t *offset);
+/* commits the region returned by the last map, the fence fence_id must
+ * be created after every command reading it */
+void vrend_upload_ring_unmap(struct vrend_upload_ring *ring, uint32_t fence_id);
+/* makes the regions of fences up to fence_id available again */
+void vrend_upload_ring_retire(struct vrend_upload_ring *ring, uint32_t fence_id);
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "util/u_double_list.h"
+#include "util/u_hash_table.h"
+#include "cso_cache/cso_cache.h"
+#include "tgsi/tgsi_parse.h"
+#include "os/os_thread.h"
+
+#include "vrend_variant_log.h"
+#include "vrend_program_cache.h"
+
+#define VARIANT_LOG_MAGIC 0x56564b4c /* "VVKL" */
+#define VARIANT_LOG_VERSION 1
+
+struct variant_log_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t key_size;
+};
+
+struct variant_log_record {
+   uint64_t sel_hash;
+   struct vrend_shader_key key;
+};
+
+struct variant_log_selector {
+   struct list_head head;
+   uint64_t hash;
+   uint32_t num_keys;
+   struct vrend_shader_key keys[VREND_VARIANT_LOG_MAX_KEYS];
+};
+
+/* render threads of different clients share the log */
+pipe_static_mutex(variant_log_lock);
+
+static struct {
+   char *path;
+   FILE *file;
+   struct util_hash_table *table;
+   struct list_head selectors;
+} variant_log;
+
+static unsigned variant_log_key_hash(void *key)
+{
+   return cso_construct_key(key, sizeof(uint64_t));
+}
+
+static int variant_log_key_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(uint64_t));
+}
+
+static void variant_log_key_destroy(UNUSED void *value)
+{
+   /* selectors are owned by variant_log.selectors */
+}
+
+uint64_t vrend_variant_log_hash(unsigned type, const struct tgsi_token *tokens,
+                                const struct pipe_stream_output_info *so_info,
+                                uint32_t req_local_mem)
+{
+   uint64_t hash = vrend_program_cache_hash_data(0, &type, sizeof(type));
+
+   hash = vrend_program_cache_hash_data(hash, tokens,
+                                        tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   hash = vrend_program_cache_hash_data(hash, so_info, sizeof(*so_info));
+   return vrend_program_cache_hash_data(hash, &req_local_mem, sizeof(req_local_mem));
+}
+
+/* Returns false if the key was already known or could not be added. */
+static bool variant_log_add_locked(uint64_t sel_hash, const struct vrend_shader_key *key)
+{
+   struct variant_log_selector *sel;
+   uint32_t i;
+
+   sel = util_hash_table_get(variant_log.table, &sel_hash);
+   if (!sel) {
+      sel = CALLOC_STRUCT(variant_log_selector);
+      if (!sel)
+         return false;
+      sel->hash = sel_hash;
+      util_hash_table_set(variant_log.table, &sel->hash, sel);
+      list_addtail(&sel->head, &variant_log.selectors);
+   }
+
+   for (i = 0; i < sel->num_keys; i++) {
+      if (!memcmp(&sel->keys[i], key, sizeof(*key)))
+         return false;
+   }
+
+   if (sel->num_keys == VREND_VARIANT_LOG_MAX_KEYS)
+      return false;
+
+   sel->keys[sel->num_keys++] = *key;
+   return true;
+}
+
+static bool variant_log_write_header(FILE *file)
+{
+   struct variant_log_header header;
+
+   header.magic = VARIANT_LOG_MAGIC;
+   header.version = VARIANT_LOG_VERSION;
+   header.key_size = sizeof(struct vrend_shader_key);
+   return fwrite(&header, sizeof(header), 1, file) == 1 && fflush(file) == 0;
+}
+
+/* Loads the records of an existing log and leaves the file positioned
+ * for appending; a log of another layout is started over. */
+static FILE *variant_log_open(const char *path)
+{
+   struct variant_log_header header;
+   struct variant_log_record record;
+   FILE *file = fopen(path, "r+b");
+
+   if (file) {
+      if (fread(&header, sizeof(header), 1, file) == 1 &&
+          header.magic == VARIANT_LOG_MAGIC &&
+          header.version == VARIANT_LOG_VERSION &&
+          header.key_size == sizeof(struct vrend_shader_key)) {
+         long end = ftell(file);
+
+         while (fread(&record, sizeof(record), 1, file) == 1) {
+            variant_log_add_locked(record.sel_hash, &record.key);
+            end = ftell(file);
+         }
+         /* drop a record torn by a crash, then append behind the last one */
+         if (fseek(file, end, SEEK_SET) == 0)
+            return file;
+      }
+      fclose(file);
+   }
+
+   file = fopen(path, "wb");
+   if (file && !variant_log_write_header(file)) {
+      fclose(file);
+      file = NULL;
+   }
+   return file;
+}
+
+static void variant_log_fini_locked(void)
+{
+   struct variant_log_selector *sel, *tmp;
+
+   if (variant_log.file)
+      fclose(variant_log.file);
+   variant_log.file = NULL;
+
+   if (variant_log.table) {
+      LIST_FOR_EACH_ENTRY_SAFE(sel, tmp, &variant_log.selectors, head) {
+         list_del(&sel->head);
+         FREE(sel);
+      }
+      util_hash_table_destroy(variant_log.table);
+      variant_log.table = NULL;
+   }
+
+   free(variant_log.path);
+   variant_log.path = NULL;
+}
+
+void vrend_variant_log_init(const char *path)
+{
+   pipe_mutex_lock(variant_log_lock);
+   if (variant_log.path && path && !strcmp(variant_log.path, path)) {
+      pipe_mutex_unlock(variant_log_lock);
+      return;
+   }
+   variant_log_fini_locked();
+
+   if (path && *path) {
+      variant_log.table = util_hash_table_create(variant_log_key_hash,
+                                                 variant_log_key_compare,
+                                                 variant_log_key_destroy);
+      list_inithead(&variant_log.selectors);
+      variant_log.path = strdup(path);
+      if (variant_log.table && variant_log.path)
+         variant_log.file = variant_log_open(path);
+      if (!variant_log.file)
+         variant_log_fini_locked();
+   }
+   pipe_mutex_unlock(variant_log_lock);
+}
+
+void vrend_variant_log_fini(void)
+{
+   pipe_mutex_lock(variant_log_lock);
+   variant_log_fini_locked();
+   pipe_mutex_unlock(variant_log_lock);
+}
+
+void vrend_variant_log_record(uint64_t sel_hash, const struct vrend_shader_key *key)
+{
+   struct variant_log_record record;
+
+   pipe_mutex_lock(variant_log_lock);
+   if (variant_log.file && variant_log_add_locked(sel_hash, key)) {
+      memset(&record, 0, sizeof(record));
+      record.sel_hash = sel_hash;
+      record.key = *key;
+      /* flushed right away so a crashing game still leaves its log */
+      if (fwrite(&record, sizeof(record), 1, variant_log.file) == 1)
+         fflush(variant_log.file);
+   }
+   pipe_mutex_unlock(variant_log_lock);
+}
+
+int vrend_variant_log_lookup(uint64_t sel_hash, struct vrend_shader_key **keys)
+{
+   struct variant_log_selector *sel = NULL;
+   int num_keys = 0;
+
+   *keys = NULL;
+
+   pipe_mutex_lock(variant_log_lock);
+   if (variant_log.table)
+      sel = util_hash_table_get(variant_log.table, &sel_hash);
+   if (sel && sel->num_keys) {
+      *keys = malloc(sel->num_keys * sizeof(**keys));
+      if (*keys) {
+         memcpy(*keys, sel->keys, sel->num_keys * sizeof(**keys));
+         num_keys = sel->num_keys;
+      }
+   }
+   pipe_mutex_unlock(variant_log_lock);
+   return num_keys;
+}
@@ -0,0 +1,34 @@
+#ifndef VREND_VARIANT_LOG_H
+#define VREND_VARIANT_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vrend_shader.h"
+
+/*
+ * Log of the shader variants a game ended up using.
+ *
+ * Every variant created for a draw is recorded as the hash of its
+ * selector (stage, tokens, stream output info and local memory, so it is
+ * the same across runs) together with its vrend_shader_key.  The file is
+ * read back on the next launch so the variants of a selector can be built
+ * as soon as the game creates the selector, instead of on first use.
+ */
+
+#define VREND_VARIANT_LOG_MAX_KEYS 32
+
+/* opens path, or disables the log when it is NULL or empty */
+void vrend_variant_log_init(const char *path);
+void vrend_variant_log_fini(void);
+
+uint64_t vrend_variant_log_hash(unsigned type, const struct tgsi_token *tokens,
+                                const struct pipe_stream_output_info *so_info,
+                                uint32_t req_local_mem);
+
+void vrend_variant_log_record(uint64_t sel_hash, const struct vrend_shader_key *key);
+/* returns the number of keys logged for the selector and a malloc'ed copy
+ * of them in *keys */
+int vrend_variant_log_lookup(uint64_t sel_hash, struct vrend_shader_key **keys);
+
+#endif
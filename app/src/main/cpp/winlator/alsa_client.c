@@ -1,7 +1,103 @@
 #include <aaudio/AAudio.h>
+#include <android/log.h>
 #include <jni.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "native_trace.h"
 
 #define WAIT_COMPLETION_TIMEOUT 100 * 1000000L
+#define MIN_BUFFER_BURSTS 2
+#define MIXER_MAX_STREAMS 16
+#define MIXER_MAX_SOURCES 4
+#define MIXER_CHANNELS 2
+#define MIXER_CHUNK_FRAMES 256
+
+// layout of the array filled by ALSAServer.getStats, keep in sync with ALSAServer.Stat
+enum Stat {STAT_UNDERRUNS, STAT_XRUNS, STAT_BUFFER_FILL, STAT_BUFFER_SIZE, STAT_FRAMES_PER_BURST,
+           STAT_EXCLUSIVE, STAT_LATENCY_MILLIS, STAT_COUNT};
+
+/*
+ * The ALSA client's thread is the only producer of the ring and the AAudio
+ * data callback the only consumer, so head and tail are each written by one
+ * side only. Both are free-running byte counters and the capacity is a power
+ * of two, so head - tail is the fill level even after they wrap.
+ */
+typedef struct AudioStream {
+    AAudioStream *aaudioStream;
+    uint8_t *ring;
+    uint32_t capacity;
+    int32_t format;
+    int32_t sampleBytes;
+    int32_t frameBytes;
+    int32_t srcSampleBytes;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_int underruns;
+    atomic_bool starved;
+    int32_t lastXRunCount;
+
+    // only used when the stream is mixed, in which case aaudioStream is NULL
+    atomic_bool playing;
+    int32_t channelCount;
+    int32_t sampleRate;
+    uint32_t step;
+    uint32_t phase;
+    float lastFrame[MIXER_CHANNELS];
+    float *frames;
+    uint8_t *rawFrames;
+    int32_t maxFrames;
+} AudioStream;
+
+/*
+ * With the mixer enabled every ALSA client only owns a ring, and one shared
+ * output stream pulls all of them, resamples each to the device rate and sums
+ * them. Slots are published with atomics; a detaching client clears its slot
+ * and then waits for the callback to leave, so a stream is never freed while
+ * it is being read.
+ *
+ * Other native code in the process (the MIDI synth) can add render sources
+ * through AudioMixer_addSource, which are pulled at the device rate.
+ */
+typedef void (*MixerRenderFunc)(void *data, float *out, int numFrames);
+
+typedef struct MixerSource {
+    MixerRenderFunc render;
+    void *data;
+} MixerSource;
+
+typedef struct AudioMixer {
+    AAudioStream *aaudioStream;
+    int32_t sampleRate;
+    int32_t numStreams;
+    int32_t numSources;
+    int32_t lastXRunCount;
+    _Atomic(AudioStream*) streams[MIXER_MAX_STREAMS];
+    _Atomic(MixerSource*) sources[MIXER_MAX_SOURCES];
+    atomic_bool busy;
+} AudioMixer;
+
+static AudioMixer mixer;
+static pthread_mutex_t mixerLock = PTHREAD_MUTEX_INITIALIZER;
+static bool mixerEnabled = false;
 
 enum Format {U8, S16LE, S16BE, FLOATLE, FLOATBE};
 
@@ -11,7 +107,6 @@ static aaudio_format_t toAAudioFormat(int format) {
         case FLOATBE:
             return AAUDIO_FORMAT_PCM_FLOAT;
         case U8:
-            return AAUDIO_FORMAT_UNSPECIFIED;
         case S16LE:
         case S16BE:
         default:
@@ -19,100 +114,996 @@ static aaudio_format_t toAAudioFormat(int format) {
     }
 }
 
-static AAudioStream *aaudioCreate(int32_t format, int8_t channelCount, int32_t sampleRate, int32_t bufferSize) {
-    aaudio_result_t result;
-    AAudioStreamBuilder *builder;
-    AAudioStream *stream;
+static int32_t getSampleBytes(int format) {
+    switch (format) {
+        case U8:
+            return 1;
+        case FLOATLE:
+        case FLOATBE:
+            return 4;
+        default:
+            return 2;
+    }
+}
 
-    result = AAudio_createStreamBuilder(&builder);
-    if (result != AAUDIO_OK) return NULL;
+// Converts client samples into the AAudio format: U8 is widened to I16 and
+// the big-endian formats are byte-swapped, everything else is copied.
+static void convertSamples(void *dst, const void *src, int count, int format) {
+    int i = 0;
+    switch (format) {
+        case U8: {
+            int16_t *out = dst;
+            const uint8_t *in = src;
+#ifdef __ARM_NEON
+            const uint8x16_t bias = vdupq_n_u8(0x80);
+            for (; i + 16 <= count; i += 16) {
+                int8x16_t value = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(in + i), bias));
+                vst1q_s16(out + i, vshll_n_s8(vget_low_s8(value), 8));
+                vst1q_s16(out + i + 8, vshll_n_s8(vget_high_s8(value), 8));
+            }
+#endif
+            for (; i < count; i++) out[i] = (int16_t)((in[i] - 128) << 8);
+            break;
+        }
+        case S16BE: {
+            uint16_t *out = dst;
+            const uint16_t *in = src;
+#ifdef __ARM_NEON
+            for (; i + 8 <= count; i += 8) {
+                vst1q_u8((uint8_t*)(out + i), vrev16q_u8(vld1q_u8((const uint8_t*)(in + i))));
+            }
+#endif
+            for (; i < count; i++) out[i] = __builtin_bswap16(in[i]);
+            break;
+        }
+        case FLOATBE: {
+            uint32_t *out = dst;
+            const uint32_t *in = src;
+#ifdef __ARM_NEON
+            for (; i + 4 <= count; i += 4) {
+                vst1q_u8((uint8_t*)(out + i), vrev32q_u8(vld1q_u8((const uint8_t*)(in + i))));
+            }
+#endif
+            for (; i < count; i++) out[i] = __builtin_bswap32(in[i]);
+            break;
+        }
+        default:
+            memcpy(dst, src, count * getSampleBytes(format));
+            break;
+    }
+}
 
+static uint32_t nextPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+// Asks for an exclusive (MMAP) stream first and falls back to a shared one
+// when the device or another client does not allow it.
+static aaudio_result_t openOutputStream(AAudioStreamBuilder *builder, AAudioStream **aaudioStream) {
     AAudioStreamBuilder_setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    AAudioStreamBuilder_setSharingMode(builder, AAUDIO_SHARING_MODE_EXCLUSIVE);
+    if (AAudioStreamBuilder_openStream(builder, aaudioStream) == AAUDIO_OK) return AAUDIO_OK;
+
+    AAudioStreamBuilder_setSharingMode(builder, AAUDIO_SHARING_MODE_SHARED);
+    return AAudioStreamBuilder_openStream(builder, aaudioStream);
+}
+
+// Sets the buffer to a whole number of bursts, at least MIN_BUFFER_BURSTS and
+// no more than needed to cover maxFrames.
+static void setBufferBursts(AAudioStream *aaudioStream, int32_t maxFrames) {
+    int32_t framesPerBurst = AAudioStream_getFramesPerBurst(aaudioStream);
+    if (framesPerBurst <= 0) {
+        if (maxFrames > 0) AAudioStream_setBufferSizeInFrames(aaudioStream, maxFrames);
+        return;
+    }
+
+    int32_t numBursts = maxFrames > 0 ? (maxFrames + framesPerBurst - 1) / framesPerBurst : MIN_BUFFER_BURSTS;
+    if (numBursts > MIN_BUFFER_BURSTS) numBursts = MIN_BUFFER_BURSTS;
+    if (numBursts < 1) numBursts = 1;
+    AAudioStream_setBufferSizeInFrames(aaudioStream, numBursts * framesPerBurst);
+}
+
+static void ringRead(AudioStream *stream, uint8_t *dst, uint32_t length) {
+    uint32_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+    uint32_t offset = tail & (stream->capacity - 1);
+    uint32_t firstPart = stream->capacity - offset;
+    if (firstPart > length) firstPart = length;
+    memcpy(dst, stream->ring + offset, firstPart);
+    memcpy(dst + firstPart, stream->ring, length - firstPart);
+    atomic_store_explicit(&stream->tail, tail + length, memory_order_release);
+}
+
+static uint32_t ringAvailable(AudioStream *stream) {
+    uint32_t tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&stream->head, memory_order_acquire);
+    return head - tail;
+}
+
+// counts each time playback runs dry, not every silent callback after it
+static void updateStarved(AudioStream *stream, bool starved) {
+    if (!starved) {
+        atomic_store_explicit(&stream->starved, false, memory_order_relaxed);
+    }
+    else if (!atomic_exchange_explicit(&stream->starved, true, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&stream->underruns, 1, memory_order_relaxed);
+    }
+}
+
+static aaudio_data_callback_result_t aaudioDataCallback(AAudioStream *aaudioStream, void *userData, void *audioData, int32_t numFrames) {
+    AudioStream *stream = userData;
+    uint8_t *dst = audioData;
+    uint32_t needed = numFrames * stream->frameBytes;
+    uint32_t available = ringAvailable(stream);
+    uint32_t length = available < needed ? available : needed;
+
+    ringRead(stream, dst, length);
+    if (length < needed) memset(dst + length, 0, needed - length);
+    updateStarved(stream, length < needed);
+
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+// Widens interleaved ring frames to stereo floats, dropping channels past the second.
+static void toStereoFloat(float *dst, const uint8_t *src, int numFrames, AudioStream *stream) {
+    int i = 0;
+    int channelCount = stream->channelCount;
+    if (stream->sampleBytes == 4) {
+        const float *in = (const float*)src;
+        if (channelCount == 2) {
+            memcpy(dst, in, numFrames * 2 * sizeof(float));
+            return;
+        }
+        for (; i < numFrames; i++) {
+            dst[i*2+0] = in[i*channelCount];
+            dst[i*2+1] = in[i*channelCount + (channelCount > 1 ? 1 : 0)];
+        }
+    }
+    else {
+        const int16_t *in = (const int16_t*)src;
+        const float scale = 1.0f / 32768.0f;
+        if (channelCount == 2) {
+#ifdef __ARM_NEON
+            for (; i + 4 <= numFrames * 2; i += 4) {
+                float32x4_t value = vcvtq_f32_s32(vmovl_s16(vld1_s16(in + i)));
+                vst1q_f32(dst + i, vmulq_n_f32(value, scale));
+            }
+#endif
+            for (; i < numFrames * 2; i++) dst[i] = in[i] * scale;
+            return;
+        }
+        for (; i < numFrames; i++) {
+            dst[i*2+0] = in[i*channelCount] * scale;
+            dst[i*2+1] = in[i*channelCount + (channelCount > 1 ? 1 : 0)] * scale;
+        }
+    }
+}
+
+/*
+ * Produces numFrames device-rate frames from the stream by linear
+ * interpolation. frames[0] holds the last frame of the previous call and
+ * phase is the 16.16 position relative to it.
+ */
+static void resampleStream(AudioStream *stream, float *dst, int numFrames) {
+    uint32_t endPhase = stream->phase + stream->step * numFrames;
+    int lastIndex = (stream->phase + stream->step * (numFrames - 1)) >> 16;
+    int numInput = (int)(endPhase >> 16) > lastIndex + 1 ? (int)(endPhase >> 16) : lastIndex + 1;
+    if (numInput > stream->maxFrames) numInput = stream->maxFrames;
+
+    uint32_t available = ringAvailable(stream) / stream->frameBytes;
+    int numRead = (uint32_t)numInput < available ? numInput : (int)available;
+    ringRead(stream, stream->rawFrames, numRead * stream->frameBytes);
+    updateStarved(stream, numRead < numInput);
+
+    float *frames = stream->frames;
+    frames[0] = stream->lastFrame[0];
+    frames[1] = stream->lastFrame[1];
+    toStereoFloat(frames + 2, stream->rawFrames, numRead, stream);
+    memset(frames + 2 + numRead * 2, 0, (numInput - numRead) * 2 * sizeof(float));
+
+    uint32_t phase = stream->phase;
+    for (int i = 0; i < numFrames; i++, phase += stream->step) {
+        int index = phase >> 16;
+        if (index >= numInput) index = numInput - 1;
+        float t = (phase & 0xffff) * (1.0f / 65536.0f);
+        const float *a = frames + index * 2;
+        dst[i*2+0] = a[0] + (a[2] - a[0]) * t;
+        dst[i*2+1] = a[1] + (a[3] - a[1]) * t;
+    }
+
+    int nextIndex = endPhase >> 16;
+    if (nextIndex > numInput) nextIndex = numInput;
+    stream->lastFrame[0] = frames[nextIndex * 2 + 0];
+    stream->lastFrame[1] = frames[nextIndex * 2 + 1];
+    stream->phase = endPhase - ((uint32_t)nextIndex << 16);
+}
+
+static void mixSamples(float *dst, const float *src, int count) {
+    int i = 0;
+#ifdef __ARM_NEON
+    for (; i + 4 <= count; i += 4) vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+#endif
+    for (; i < count; i++) dst[i] += src[i];
+}
+
+static void clampSamples(float *samples, int count) {
+    int i = 0;
+#ifdef __ARM_NEON
+    const float32x4_t low = vdupq_n_f32(-1.0f);
+    const float32x4_t high = vdupq_n_f32(1.0f);
+    for (; i + 4 <= count; i += 4) vst1q_f32(samples + i, vminq_f32(vmaxq_f32(vld1q_f32(samples + i), low), high));
+#endif
+    for (; i < count; i++) samples[i] = samples[i] < -1.0f ? -1.0f : (samples[i] > 1.0f ? 1.0f : samples[i]);
+}
+
+static aaudio_data_callback_result_t mixerDataCallback(AAudioStream *aaudioStream, void *userData, void *audioData, int32_t numFrames) {
+    float *out = audioData;
+    float chunk[MIXER_CHUNK_FRAMES * MIXER_CHANNELS];
+    memset(out, 0, numFrames * MIXER_CHANNELS * sizeof(float));
+
+    atomic_store(&mixer.busy, true);
+    for (int i = 0; i < MIXER_MAX_STREAMS; i++) {
+        AudioStream *stream = atomic_load(&mixer.streams[i]);
+        if (!stream || !atomic_load_explicit(&stream->playing, memory_order_relaxed)) continue;
+
+        for (int done = 0; done < numFrames; done += MIXER_CHUNK_FRAMES) {
+            int count = numFrames - done < MIXER_CHUNK_FRAMES ? numFrames - done : MIXER_CHUNK_FRAMES;
+            resampleStream(stream, chunk, count);
+            mixSamples(out + done * MIXER_CHANNELS, chunk, count * MIXER_CHANNELS);
+        }
+    }
+
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        MixerSource *source = atomic_load(&mixer.sources[i]);
+        if (!source) continue;
+
+        for (int done = 0; done < numFrames; done += MIXER_CHUNK_FRAMES) {
+            int count = numFrames - done < MIXER_CHUNK_FRAMES ? numFrames - done : MIXER_CHUNK_FRAMES;
+            source->render(source->data, chunk, count);
+            mixSamples(out + done * MIXER_CHANNELS, chunk, count * MIXER_CHANNELS);
+        }
+    }
+    atomic_store(&mixer.busy, false);
+
+    clampSamples(out, numFrames * MIXER_CHANNELS);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+static void mixerQuiesce(void) {
+    while (atomic_load(&mixer.busy)) sched_yield();
+}
+
+static bool mixerOpen(void) {
+    AAudioStreamBuilder *builder;
+    if (AAudio_createStreamBuilder(&builder) != AAUDIO_OK) return false;
+
+    AAudioStreamBuilder_setFormat(builder, AAUDIO_FORMAT_PCM_FLOAT);
+    AAudioStreamBuilder_setChannelCount(builder, MIXER_CHANNELS);
+    AAudioStreamBuilder_setDataCallback(builder, mixerDataCallback, NULL);
+
+    aaudio_result_t result = openOutputStream(builder, &mixer.aaudioStream);
+    AAudioStreamBuilder_delete(builder);
+    if (result != AAUDIO_OK) {
+        mixer.aaudioStream = NULL;
+        return false;
+    }
+
+    mixer.sampleRate = AAudioStream_getSampleRate(mixer.aaudioStream);
+    mixer.lastXRunCount = 0;
+    setBufferBursts(mixer.aaudioStream, 0);
+
+    AAudioStream_requestStart(mixer.aaudioStream);
+    return true;
+}
+
+static void mixerClose(void) {
+    AAudioStream_requestStop(mixer.aaudioStream);
+    AAudioStream_waitForStateChange(mixer.aaudioStream, AAUDIO_STREAM_STATE_STOPPING, NULL, WAIT_COMPLETION_TIMEOUT);
+    AAudioStream_close(mixer.aaudioStream);
+    mixer.aaudioStream = NULL;
+}
+
+static bool mixerAttach(AudioStream *stream) {
+    bool attached = false;
+    pthread_mutex_lock(&mixerLock);
+    if (mixer.numStreams < MIXER_MAX_STREAMS && (mixer.aaudioStream || mixerOpen())) {
+        stream->step = (uint32_t)(((uint64_t)stream->sampleRate << 16) / mixer.sampleRate);
+        stream->maxFrames = ((0xffff + (uint64_t)stream->step * MIXER_CHUNK_FRAMES) >> 16) + 1;
+        stream->frames = malloc((stream->maxFrames + 1) * MIXER_CHANNELS * sizeof(float));
+        stream->rawFrames = malloc(stream->maxFrames * stream->frameBytes);
+
+        for (int i = 0; stream->frames && stream->rawFrames && i < MIXER_MAX_STREAMS; i++) {
+            if (!atomic_load(&mixer.streams[i])) {
+                atomic_store(&mixer.streams[i], stream);
+                mixer.numStreams++;
+                attached = true;
+                break;
+            }
+        }
+        if (!attached && mixer.numStreams + mixer.numSources == 0) mixerClose();
+    }
+    pthread_mutex_unlock(&mixerLock);
+    return attached;
+}
+
+static void mixerDetach(AudioStream *stream) {
+    pthread_mutex_lock(&mixerLock);
+    for (int i = 0; i < MIXER_MAX_STREAMS; i++) {
+        if (atomic_load(&mixer.streams[i]) == stream) {
+            atomic_store(&mixer.streams[i], NULL);
+            mixerQuiesce();
+            if (--mixer.numStreams + mixer.numSources == 0) mixerClose();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mixerLock);
+}
+
+/*
+ * Adds a source that render() fills with interleaved stereo floats, numFrames
+ * at a time, from the mixer callback. Returns the device sample rate, or 0
+ * when the source could not be added. Looked up with dlsym by libmidihandler.
+ */
+int32_t AudioMixer_addSource(MixerRenderFunc render, void *data) {
+    int32_t sampleRate = 0;
+    pthread_mutex_lock(&mixerLock);
+    if (mixer.numSources < MIXER_MAX_SOURCES && (mixer.aaudioStream || mixerOpen())) {
+        MixerSource *source = malloc(sizeof(MixerSource));
+        for (int i = 0; source && i < MIXER_MAX_SOURCES; i++) {
+            if (!atomic_load(&mixer.sources[i])) {
+                source->render = render;
+                source->data = data;
+                atomic_store(&mixer.sources[i], source);
+                mixer.numSources++;
+                sampleRate = mixer.sampleRate;
+                break;
+            }
+        }
+        if (!sampleRate) {
+            free(source);
+            if (mixer.numStreams + mixer.numSources == 0) mixerClose();
+        }
+    }
+    pthread_mutex_unlock(&mixerLock);
+    return sampleRate;
+}
+
+// Once this returns, render() is not running and will not be called again.
+void AudioMixer_removeSource(MixerRenderFunc render, void *data) {
+    pthread_mutex_lock(&mixerLock);
+    for (int i = 0; i < MIXER_MAX_SOURCES; i++) {
+        MixerSource *source = atomic_load(&mixer.sources[i]);
+        if (source && source->render == render && source->data == data) {
+            atomic_store(&mixer.sources[i], NULL);
+            mixerQuiesce();
+            free(source);
+            if (mixer.numStreams + --mixer.numSources == 0) mixerClose();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mixerLock);
+}
+
+static void aaudioDestroy(AudioStream *stream) {
+    if (stream->aaudioStream) AAudioStream_close(stream->aaudioStream);
+    else mixerDetach(stream);
+    free(stream->frames);
+    free(stream->rawFrames);
+    free(stream->ring);
+    free(stream);
+}
+
+// Mixed streams keep the client layout in the ring; only U8 is widened.
+static bool aaudioCreateMixed(AudioStream *stream, int32_t format, int8_t channelCount, int32_t sampleRate) {
+    stream->sampleBytes = (format == FLOATLE || format == FLOATBE) ? 4 : 2;
+    stream->frameBytes = stream->sampleBytes * channelCount;
+    stream->channelCount = channelCount;
+    stream->sampleRate = sampleRate;
+    return channelCount > 0 && sampleRate > 0;
+}
+
+static bool aaudioCreateOutput(AudioStream *stream, int32_t format, int8_t channelCount, int32_t sampleRate) {
+    AAudioStreamBuilder *builder;
+    if (AAudio_createStreamBuilder(&builder) != AAUDIO_OK) return false;
+
     AAudioStreamBuilder_setFormat(builder, toAAudioFormat(format));
     AAudioStreamBuilder_setChannelCount(builder, channelCount);
     AAudioStreamBuilder_setSampleRate(builder, sampleRate);
+    AAudioStreamBuilder_setDataCallback(builder, aaudioDataCallback, stream);
 
-    result = AAudioStreamBuilder_openStream(builder, &stream);
+    aaudio_result_t result = openOutputStream(builder, &stream->aaudioStream);
+    AAudioStreamBuilder_delete(builder);
     if (result != AAUDIO_OK) {
-        AAudioStreamBuilder_delete(builder);
+        stream->aaudioStream = NULL;
+        return false;
+    }
+
+    stream->sampleBytes = AAudioStream_getFormat(stream->aaudioStream) == AAUDIO_FORMAT_PCM_FLOAT ? 4 : 2;
+    stream->frameBytes = stream->sampleBytes * AAudioStream_getChannelCount(stream->aaudioStream);
+    return true;
+}
+
+static AudioStream *aaudioCreate(int32_t format, int8_t channelCount, int32_t sampleRate, int32_t bufferSize) {
+    AudioStream *stream = calloc(1, sizeof(AudioStream));
+    if (!stream) return NULL;
+    atomic_init(&stream->head, 0);
+    atomic_init(&stream->tail, 0);
+    atomic_init(&stream->underruns, 0);
+    atomic_init(&stream->starved, true);
+    atomic_init(&stream->playing, false);
+
+    bool mixed = mixerEnabled && aaudioCreateMixed(stream, format, channelCount, sampleRate);
+    if (!mixed && !aaudioCreateOutput(stream, format, channelCount, sampleRate)) {
+        free(stream);
         return NULL;
     }
 
-    AAudioStream_setBufferSizeInFrames(stream, bufferSize);
+    stream->format = format;
+    stream->srcSampleBytes = getSampleBytes(format);
+
+    // the ring holds the whole ALSA buffer (with room for the client running
+    // one period ahead), so AAudio itself only needs to buffer a few bursts
+    stream->capacity = nextPowerOfTwo(2 * bufferSize * stream->frameBytes);
+    stream->ring = malloc(stream->capacity);
+    if (!stream->ring || (mixed && !mixerAttach(stream))) {
+        aaudioDestroy(stream);
+        return NULL;
+    }
+    if (mixed) return stream;
 
-    result = AAudioStreamBuilder_delete(builder);
-    if (result != AAUDIO_OK) return NULL;
+    setBufferBursts(stream->aaudioStream, bufferSize);
 
     return stream;
 }
 
-static int aaudioWrite(AAudioStream *aaudioStream, void *buffer, int numFrames) {
-    aaudio_result_t framesWritten = AAudioStream_write(aaudioStream, buffer, numFrames, WAIT_COMPLETION_TIMEOUT);
-    return framesWritten;
+// Grows the AAudio buffer by one burst each time the device reports an xrun,
+// so the latency settles at the smallest size this device can keep up with.
+static void aaudioTuneBufferSize(AAudioStream *aaudioStream, int32_t *lastXRunCount) {
+    int32_t xRunCount = AAudioStream_getXRunCount(aaudioStream);
+    if (xRunCount <= *lastXRunCount) return;
+    *lastXRunCount = xRunCount;
+
+    int32_t bufferSize = AAudioStream_getBufferSizeInFrames(aaudioStream);
+    int32_t framesPerBurst = AAudioStream_getFramesPerBurst(aaudioStream);
+    if (bufferSize + framesPerBurst <= AAudioStream_getBufferCapacityInFrames(aaudioStream)) {
+        AAudioStream_setBufferSizeInFrames(aaudioStream, bufferSize + framesPerBurst);
+    }
+}
+
+static int aaudioWrite(AudioStream *stream, void *buffer, int numFrames) {
+    uint32_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&stream->tail, memory_order_acquire);
+    uint32_t space = stream->capacity - (head - tail);
+    uint32_t length = numFrames * stream->frameBytes;
+    if (length > space) length = space - space % stream->frameBytes;
+
+    // the capacity is a power of two, so the wrap point always falls on a sample boundary
+    uint32_t offset = head & (stream->capacity - 1);
+    uint32_t firstPart = stream->capacity - offset;
+    if (firstPart > length) firstPart = length;
+    int firstSamples = firstPart / stream->sampleBytes;
+    convertSamples(stream->ring + offset, buffer, firstSamples, stream->format);
+    convertSamples(stream->ring, (uint8_t*)buffer + firstSamples * stream->srcSampleBytes,
+                   (length - firstPart) / stream->sampleBytes, stream->format);
+    atomic_store_explicit(&stream->head, head + length, memory_order_release);
+
+    if (stream->aaudioStream) {
+        aaudioTuneBufferSize(stream->aaudioStream, &stream->lastXRunCount);
+    }
+    else if (pthread_mutex_trylock(&mixerLock) == 0) {
+        if (mixer.aaudioStream) aaudioTuneBufferSize(mixer.aaudioStream, &mixer.lastXRunCount);
+        pthread_mutex_unlock(&mixerLock);
+    }
+    return length / stream->frameBytes;
 }
 
-static void aaudioStart(AAudioStream *aaudioStream) {
-    AAudioStream_requestStart(aaudioStream);
-    AAudioStream_waitForStateChange(aaudioStream, AAUDIO_STREAM_STATE_STARTING, NULL, WAIT_COMPLETION_TIMEOUT);
+static void aaudioResetRing(AudioStream *stream) {
+    atomic_store(&stream->tail, 0);
+    atomic_store(&stream->head, 0);
+    atomic_store(&stream->starved, true);
+    stream->phase = 0;
+    stream->lastFrame[0] = stream->lastFrame[1] = 0.0f;
 }
 
-static void aaudioStop(AAudioStream *aaudioStream) {
-    AAudioStream_requestStop(aaudioStream);
-    AAudioStream_waitForStateChange(aaudioStream, AAUDIO_STREAM_STATE_STOPPING, NULL, WAIT_COMPLETION_TIMEOUT);
+static void aaudioStart(AudioStream *stream) {
+    if (!stream->aaudioStream) {
+        atomic_store(&stream->playing, true);
+        return;
+    }
+    AAudioStream_requestStart(stream->aaudioStream);
+    AAudioStream_waitForStateChange(stream->aaudioStream, AAUDIO_STREAM_STATE_STARTING, NULL, WAIT_COMPLETION_TIMEOUT);
 }
 
-static void aaudioPause(AAudioStream *aaudioStream) {
-    AAudioStream_requestPause(aaudioStream);
-    AAudioStream_waitForStateChange(aaudioStream, AAUDIO_STREAM_STATE_PAUSING, NULL, WAIT_COMPLETION_TIMEOUT);
+static void aaudioStop(AudioStream *stream) {
+    if (!stream->aaudioStream) {
+        atomic_store(&stream->playing, false);
+        mixerQuiesce();
+    }
+    else {
+        AAudioStream_requestStop(stream->aaudioStream);
+        AAudioStream_waitForStateChange(stream->aaudioStream, AAUDIO_STREAM_STATE_STOPPING, NULL, WAIT_COMPLETION_TIMEOUT);
+    }
+    // the callback has stopped running, so both ends of the ring can be moved
+    aaudioResetRing(stream);
 }
 
-static void aaudioFlush(AAudioStream *aaudioStream) {
-    AAudioStream_requestFlush(aaudioStream);
-    AAudioStream_waitForStateChange(aaudioStream, AAUDIO_STREAM_STATE_FLUSHING, NULL, WAIT_COMPLETION_TIMEOUT);
+static void aaudioPause(AudioStream *stream) {
+    if (!stream->aaudioStream) {
+        atomic_store(&stream->playing, false);
+        return;
+    }
+    AAudioStream_requestPause(stream->aaudioStream);
+    AAudioStream_waitForStateChange(stream->aaudioStream, AAUDIO_STREAM_STATE_PAUSING, NULL, WAIT_COMPLETION_TIMEOUT);
 }
 
-JNIEXPORT jlong JNICALL
-Java_com_winlator_alsaserver_ALSAClient_create(JNIEnv *env, jobject obj, jint format,
-                                               jbyte channelCount, jint sampleRate, jint bufferSize) {
-    return (jlong)aaudioCreate(format, channelCount, sampleRate, bufferSize);
+static void aaudioFlush(AudioStream *stream) {
+    if (!stream->aaudioStream) return;
+    AAudioStream_requestFlush(stream->aaudioStream);
+    AAudioStream_waitForStateChange(stream->aaudioStream, AAUDIO_STREAM_STATE_FLUSHING, NULL, WAIT_COMPLETION_TIMEOUT);
 }
 
-JNIEXPORT jint JNICALL
-Java_com_winlator_alsaserver_ALSAClient_write(JNIEnv *env, jobject obj, jlong streamPtr, jobject buffer,
-                                              jint numFrames) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
+// Milliseconds until a frame written now is heard, from the presentation
+// timestamp of the device; -1 while the stream has no timestamp yet.
+static int32_t aaudioGetLatencyMillis(AAudioStream *aaudioStream, uint32_t queuedFrames) {
+    int64_t framePosition, timeNanos;
+    struct timespec now;
+    if (AAudioStream_getTimestamp(aaudioStream, CLOCK_MONOTONIC, &framePosition, &timeNanos) != AAUDIO_OK) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int32_t sampleRate = AAudioStream_getSampleRate(aaudioStream);
+    int64_t framesAhead = AAudioStream_getFramesWritten(aaudioStream) - framePosition;
+    int64_t presentNanos = timeNanos + framesAhead * 1000000000LL / sampleRate;
+    int64_t nowNanos = now.tv_sec * 1000000000LL + now.tv_nsec;
+    int64_t latencyNanos = presentNanos - nowNanos + (int64_t)queuedFrames * 1000000000LL / sampleRate;
+    return latencyNanos > 0 ? (int32_t)(latencyNanos / 1000000) : 0;
+}
+
+static void fillStats(AudioStream *stream, jint *values) {
+    values[STAT_UNDERRUNS] = atomic_load_explicit(&stream->underruns, memory_order_relaxed);
+    values[STAT_BUFFER_FILL] = ringAvailable(stream) / stream->frameBytes;
+
+    pthread_mutex_lock(&mixerLock);
+    AAudioStream *aaudioStream = stream->aaudioStream ? stream->aaudioStream : mixer.aaudioStream;
     if (aaudioStream) {
-        return aaudioWrite(aaudioStream, (*env)->GetDirectBufferAddress(env, buffer), numFrames);
+        values[STAT_XRUNS] = AAudioStream_getXRunCount(aaudioStream);
+        values[STAT_FRAMES_PER_BURST] = AAudioStream_getFramesPerBurst(aaudioStream);
+        values[STAT_BUFFER_SIZE] = AAudioStream_getBufferSizeInFrames(aaudioStream);
+        values[STAT_EXCLUSIVE] = AAudioStream_getSharingMode(aaudioStream) == AAUDIO_SHARING_MODE_EXCLUSIVE;
+        // queued ring frames are at the client rate, close enough for the mixer too
+        values[STAT_LATENCY_MILLIS] = aaudioGetLatencyMillis(aaudioStream, values[STAT_BUFFER_FILL]);
     }
-    else return -1;
+    pthread_mutex_unlock(&mixerLock);
 }
 
-JNIEXPORT void JNICALL
-Java_com_winlator_alsaserver_ALSAClient_start(JNIEnv *env, jobject obj, jlong streamPtr) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
-    if (aaudioStream) aaudioStart(aaudioStream);
+/*
+ * The ALSA server. The guest plugin sends a request code byte and a little
+ * endian 32-bit length; PREPARE and a WRITE without a shared buffer are
+ * followed by that many bytes of payload. The server thread only accepts:
+ * every client gets a thread of its own in the audio role, which parses the
+ * requests and writes the periods straight into its stream's ring, so a
+ * blocking AAudio state change never holds up another stream.
+ */
+enum RequestCode {REQUEST_CLOSE, REQUEST_START, REQUEST_STOP, REQUEST_PAUSE, REQUEST_PREPARE,
+                  REQUEST_WRITE, REQUEST_DRAIN, REQUEST_POINTER};
+
+#define REQUEST_HEADER_LENGTH 5
+#define PREPARE_LENGTH 10
+#define MAX_REQUEST_LENGTH (16 * 1024 * 1024)
+// ThreadRoles ROLE_AUDIO
+#define THREAD_ROLE_AUDIO 3
+
+void ThreadRoles_register(int role);
+
+typedef struct ALSAClient {
+    int fd;
+    struct ALSAServer *server;
+    // only changed under the server mutex, so that getStats never sees a freed stream
+    AudioStream *stream;
+    int32_t format;
+    int32_t channelCount;
+    int32_t sampleRate;
+    int32_t bufferSize;
+    int32_t frameBytes;
+    int32_t position;
+    bool playing;
+    uint8_t *sharedBuffer;
+    uint32_t sharedBufferSize;
+    // received bytes that don't make up a whole request yet
+    uint8_t *buffer;
+    uint32_t bufferLength;
+    uint32_t bufferCapacity;
+    struct ALSAClient *next;
+} ALSAClient;
+
+typedef struct ALSAServer {
+    int serverFd;
+    int shutdownFd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t clientsDone;
+    ALSAClient *clients;
+    atomic_int lastBufferId;
+} ALSAServer;
+
+static int32_t readInt(const uint8_t *data) {
+    int32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
 }
 
-JNIEXPORT void JNICALL
-Java_com_winlator_alsaserver_ALSAClient_stop(JNIEnv *env, jobject obj, jlong streamPtr) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
-    if (aaudioStream) aaudioStop(aaudioStream);
+static void sendReply(int clientFd, const void *data, int length, int ancillaryFd) {
+    struct iovec iovmsg = {.iov_base = (void*)data, .iov_len = length};
+    struct {
+        struct cmsghdr align;
+        int fds[1];
+    } ctrlmsg;
+
+    struct msghdr msg = {
+        .msg_iov = &iovmsg,
+        .msg_iovlen = 1
+    };
+
+    if (ancillaryFd >= 0) {
+        msg.msg_control = &ctrlmsg;
+        msg.msg_controllen = CMSG_LEN(sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        ((int*)CMSG_DATA(cmsg))[0] = ancillaryFd;
+    }
+
+    sendmsg(clientFd, &msg, MSG_NOSIGNAL);
+}
+
+static void clientSetStream(ALSAClient *client, AudioStream *stream) {
+    pthread_mutex_lock(&client->server->mutex);
+    client->stream = stream;
+    pthread_mutex_unlock(&client->server->mutex);
+}
+
+static void clientRelease(ALSAClient *client) {
+    if (client->sharedBuffer) {
+        munmap(client->sharedBuffer, client->sharedBufferSize);
+        client->sharedBuffer = NULL;
+    }
+
+    AudioStream *stream = client->stream;
+    if (stream) {
+        clientSetStream(client, NULL);
+        aaudioStop(stream);
+        aaudioDestroy(stream);
+    }
+    client->playing = false;
+}
+
+static void clientStart(ALSAClient *client) {
+    if (client->stream && !client->playing) {
+        aaudioStart(client->stream);
+        client->playing = true;
+    }
+}
+
+static void clientStop(ALSAClient *client) {
+    if (client->stream && client->playing) {
+        aaudioStop(client->stream);
+        client->playing = false;
+    }
+}
+
+static void clientPause(ALSAClient *client) {
+    if (client->stream) {
+        aaudioPause(client->stream);
+        client->playing = false;
+    }
+}
+
+// The period buffer is a memfd shared with the plugin, so a WRITE afterwards
+// only carries its length and the samples are read out of the mapping.
+static void clientCreateSharedBuffer(ALSAClient *client) {
+    uint32_t size = client->bufferSize * client->frameBytes;
+    char name[32];
+    sprintf(name, "alsa-shm%d", atomic_fetch_add(&client->server->lastBufferId, 1) + 1);
+
+    int fd = size > 0 ? syscall(__NR_memfd_create, name, MFD_CLOEXEC) : -1;
+    if (fd >= 0 && ftruncate(fd, size) == 0) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            client->sharedBuffer = data;
+            client->sharedBufferSize = size;
+        }
+    }
+
+    uint8_t status = 0;
+    sendReply(client->fd, &status, sizeof(status), fd);
+    if (fd >= 0) close(fd);
+}
+
+static void clientPrepare(ALSAClient *client, const uint8_t *payload) {
+    int32_t format = payload[1];
+    client->channelCount = payload[0];
+    client->format = format >= U8 && format <= FLOATBE ? format : U8;
+    client->sampleRate = readInt(payload + 2);
+    client->bufferSize = readInt(payload + 6);
+    client->frameBytes = client->channelCount * getSampleBytes(client->format);
+    client->position = 0;
+    clientRelease(client);
+
+    if (client->bufferSize > 0 && client->frameBytes > 0) {
+        AudioStream *stream = aaudioCreate(client->format, client->channelCount, client->sampleRate, client->bufferSize);
+        if (stream) {
+            clientSetStream(client, stream);
+            clientStart(client);
+        }
+    }
+
+    clientCreateSharedBuffer(client);
 }
 
+// Samples are converted to the stream format natively, so the data is passed through as is
+static void clientWrite(ALSAClient *client, const uint8_t *data, uint32_t length) {
+    NATIVE_TRACE_SCOPE("ALSAClient_write");
+    if (!client->playing) return;
+
+    int framesWritten = aaudioWrite(client->stream, (void*)data, length / client->frameBytes);
+    if (framesWritten > 0) client->position += framesWritten;
+}
+
+// Frames actually handed to AAudio; frames still queued in the ring are not played yet
+static int32_t clientPointer(ALSAClient *client) {
+    if (!client->stream) return client->position;
+    return client->position - (int32_t)(ringAvailable(client->stream) / client->stream->frameBytes);
+}
+
+// Handles every whole request in the buffer and returns how many bytes they took
+static uint32_t clientHandleRequests(ALSAClient *client, uint32_t *neededLength) {
+    uint32_t offset = 0;
+    *neededLength = 0;
+
+    while (client->bufferLength - offset >= REQUEST_HEADER_LENGTH) {
+        const uint8_t *request = client->buffer + offset;
+        uint8_t requestCode = request[0];
+        uint32_t requestLength = (uint32_t)readInt(request + 1);
+
+        uint32_t payloadLength = 0;
+        if (requestCode == REQUEST_PREPARE || (requestCode == REQUEST_WRITE && !client->sharedBuffer)) {
+            payloadLength = requestLength;
+        }
+        if (payloadLength > MAX_REQUEST_LENGTH) {
+            *neededLength = UINT32_MAX;
+            return offset;
+        }
+        if (client->bufferLength - offset - REQUEST_HEADER_LENGTH < payloadLength) {
+            *neededLength = REQUEST_HEADER_LENGTH + payloadLength;
+            return offset;
+        }
+
+        const uint8_t *payload = request + REQUEST_HEADER_LENGTH;
+        switch (requestCode) {
+            case REQUEST_CLOSE:
+                clientRelease(client);
+                break;
+            case REQUEST_START:
+                clientStart(client);
+                break;
+            case REQUEST_STOP:
+                clientStop(client);
+                break;
+            case REQUEST_PAUSE:
+                clientPause(client);
+                break;
+            case REQUEST_PREPARE:
+                if (payloadLength >= PREPARE_LENGTH) clientPrepare(client, payload);
+                break;
+            case REQUEST_WRITE:
+                if (client->sharedBuffer) {
+                    clientWrite(client, client->sharedBuffer, requestLength < client->sharedBufferSize ? requestLength : client->sharedBufferSize);
+                }
+                else clientWrite(client, payload, payloadLength);
+                break;
+            case REQUEST_DRAIN:
+                if (client->stream) aaudioFlush(client->stream);
+                break;
+            case REQUEST_POINTER: {
+                int32_t pointer = clientPointer(client);
+                sendReply(client->fd, &pointer, sizeof(pointer), -1);
+                break;
+            }
+        }
+        offset += REQUEST_HEADER_LENGTH + payloadLength;
+    }
+    return offset;
+}
+
+static bool clientReserve(ALSAClient *client, uint32_t capacity) {
+    if (capacity <= client->bufferCapacity) return true;
+    uint8_t *buffer = realloc(client->buffer, capacity);
+    if (!buffer) return false;
+    client->buffer = buffer;
+    client->bufferCapacity = capacity;
+    return true;
+}
+
+static void *runClient(void *param) {
+    ALSAClient *client = param;
+    ALSAServer *server = client->server;
+    ThreadRoles_register(THREAD_ROLE_AUDIO);
+
+    struct pollfd pfds[2] = {
+        {.fd = client->fd, .events = POLLIN},
+        {.fd = server->shutdownFd, .events = POLLIN}
+    };
+
+    uint32_t neededLength = 0;
+    for (;;) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfds[1].revents & POLLIN) break;
+
+        uint32_t capacity = client->bufferLength + 4096;
+        if (capacity < neededLength) capacity = neededLength;
+        if (!clientReserve(client, capacity)) break;
+
+        ssize_t size = recv(client->fd, client->buffer + client->bufferLength, client->bufferCapacity - client->bufferLength, 0);
+        if (size < 0 && errno == EINTR) continue;
+        if (size <= 0) break;
+        client->bufferLength += size;
+
+        uint32_t handledLength = clientHandleRequests(client, &neededLength);
+        if (neededLength == UINT32_MAX) break;
+        client->bufferLength -= handledLength;
+        memmove(client->buffer, client->buffer + handledLength, client->bufferLength);
+    }
+
+    clientRelease(client);
+    close(client->fd);
+    free(client->buffer);
+
+    pthread_mutex_lock(&server->mutex);
+    for (ALSAClient **link = &server->clients; *link; link = &(*link)->next) {
+        if (*link == client) {
+            *link = client->next;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&server->clientsDone);
+    pthread_mutex_unlock(&server->mutex);
+    free(client);
+    return NULL;
+}
+
+static void acceptClient(ALSAServer *server) {
+    int clientFd = accept4(server->serverFd, NULL, NULL, SOCK_CLOEXEC);
+    if (clientFd < 0) return;
+
+    ALSAClient *client = calloc(1, sizeof(ALSAClient));
+    if (!client) {
+        close(clientFd);
+        return;
+    }
+    client->fd = clientFd;
+    client->server = server;
+
+    pthread_mutex_lock(&server->mutex);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, runClient, client) == 0) {
+        pthread_detach(thread);
+        client->next = server->clients;
+        server->clients = client;
+    }
+    else {
+        close(clientFd);
+        free(client);
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+static void *runServer(void *param) {
+    ALSAServer *server = param;
+    struct pollfd pfds[2] = {
+        {.fd = server->serverFd, .events = POLLIN},
+        {.fd = server->shutdownFd, .events = POLLIN}
+    };
+
+    for (;;) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfds[1].revents & POLLIN) break;
+        if (pfds[0].revents & POLLIN) acceptClient(server);
+    }
+    return NULL;
+}
+
+static int createServerSocket(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sun_family = AF_LOCAL;
+    strncpy(serverAddr.sun_path, path, sizeof(serverAddr.sun_path) - 1);
+    int addrLength = sizeof(sa_family_t) + strlen(serverAddr.sun_path);
+
+    unlink(serverAddr.sun_path);
+    if (bind(fd, (struct sockaddr*)&serverAddr, addrLength) < 0 || listen(fd, SOMAXCONN) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "ALSAServer", "Failed to listen on %s: errno=%d", path, errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void destroyServer(ALSAServer *server) {
+    if (server->serverFd >= 0) close(server->serverFd);
+    if (server->shutdownFd >= 0) close(server->shutdownFd);
+    pthread_cond_destroy(&server->clientsDone);
+    pthread_mutex_destroy(&server->mutex);
+    free(server);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_startServer(JNIEnv *env, jobject obj, jstring path) {
+    ALSAServer *server = calloc(1, sizeof(ALSAServer));
+    if (!server) return 0;
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->clientsDone, NULL);
+    atomic_init(&server->lastBufferId, 0);
+
+    const char *pathPtr = (*env)->GetStringUTFChars(env, path, NULL);
+    server->serverFd = createServerSocket(pathPtr);
+    (*env)->ReleaseStringUTFChars(env, path, pathPtr);
+    server->shutdownFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->serverFd < 0 || server->shutdownFd < 0) goto error;
+
+    if (pthread_create(&server->thread, NULL, runServer, server) != 0) goto error;
+    return (jlong)server;
+error:
+    destroyServer(server);
+    return 0;
+}
+
+// The shutdown eventfd is never read, so it wakes every client thread and
+// each of them closes its stream before the server is freed.
 JNIEXPORT void JNICALL
-Java_com_winlator_alsaserver_ALSAClient_pause(JNIEnv *env, jobject obj, jlong streamPtr) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
-    if (aaudioStream) aaudioPause(aaudioStream);
+Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_stopServer(JNIEnv *env, jobject obj, jlong serverPtr) {
+    ALSAServer *server = (ALSAServer*)serverPtr;
+    uint64_t value = 1;
+    write(server->shutdownFd, &value, sizeof(value));
+    pthread_join(server->thread, NULL);
+
+    pthread_mutex_lock(&server->mutex);
+    while (server->clients) pthread_cond_wait(&server->clientsDone, &server->mutex);
+    pthread_mutex_unlock(&server->mutex);
+    destroyServer(server);
 }
 
+// Stats of the most recently connected client that has a stream
 JNIEXPORT void JNICALL
-Java_com_winlator_alsaserver_ALSAClient_flush(JNIEnv *env, jobject obj, jlong streamPtr) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
-    if (aaudioStream) aaudioFlush(aaudioStream);
+Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_getStats(JNIEnv *env, jobject obj, jlong serverPtr, jintArray stats) {
+    ALSAServer *server = (ALSAServer*)serverPtr;
+    jint values[STAT_COUNT] = {0};
+    if ((*env)->GetArrayLength(env, stats) < STAT_COUNT) return;
+
+    pthread_mutex_lock(&server->mutex);
+    for (ALSAClient *client = server->clients; client; client = client->next) {
+        if (client->stream) {
+            fillStats(client->stream, values);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+
+    (*env)->SetIntArrayRegion(env, stats, 0, STAT_COUNT, values);
 }
 
 JNIEXPORT void JNICALL
-Java_com_winlator_alsaserver_ALSAClient_close(JNIEnv *env, jobject obj, jlong streamPtr) {
-    AAudioStream *aaudioStream = (AAudioStream*)streamPtr;
-    if (aaudioStream) AAudioStream_close(aaudioStream);
-}
\ No newline at end of file
+Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_setMixerEnabled(JNIEnv *env, jclass obj, jboolean enabled) {
+    pthread_mutex_lock(&mixerLock);
+    mixerEnabled = enabled;
+    pthread_mutex_unlock(&mixerLock);
+}
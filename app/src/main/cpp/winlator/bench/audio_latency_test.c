@@ -0,0 +1,731 @@
+#include <aaudio/AAudio.h>
+#include <dlfcn.h>
+#include <getopt.h>
+#include <jni.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * On-device latency test of the audio output paths: an ALSA client speaking
+ * the guest plugin's protocol to the real ALSA server (alsa_client.c, built
+ * in), and MIDI events queued to libmidihandler rendering through the mixer.
+ * Every data callback that alsa_client.c registers goes through a probe that
+ * timestamps the callbacks and finds the frame an impulse lands on, whose
+ * presentation time then comes from AAudioStream_getTimestamp. An optional
+ * input stream picks the impulse up again for the acoustic round trip.
+ *
+ *   audio_latency_test [-d seconds] [-b buffer,...] [-i interval_ms] [-m] [-l]
+ *                      [-s soundfont.sf2] [-L libmidihandler.so]
+ */
+
+#define PROBE_MAX 32
+#define PROBE_MAX_INTERVALS 32768
+#define MAX_IMPULSES 1024
+#define IMPULSE_FRAMES 4
+#define IMPULSE_TIMEOUT_NS 1000000000LL
+#define ALSA_SAMPLE_RATE 48000
+#define ALSA_CHANNELS 2
+#define ALSA_THRESHOLD 0.5f
+#define MIDI_THRESHOLD 0.02f
+#define LOOPBACK_THRESHOLD 0.1f
+#define MIDI_CHANNEL 9
+#define MIDI_NOTE 38
+// bytes of one event passed to MIDIHandler.queueEvents
+#define MIDI_EVENT_SIZE 8
+
+typedef struct Probe {
+    AAudioStream_dataCallback callback;
+    void *userData;
+    _Atomic(AAudioStream*) aaudioStream;
+    int32_t sampleRate;
+    int32_t channelCount;
+    bool isFloat;
+    float threshold;
+    atomic_bool armed;
+    atomic_llong onsetFrame;
+    atomic_llong onsetNanos;
+    int64_t lastCallbackNanos;
+    atomic_int numIntervals;
+    // callback period minus the duration of the frames it was asked for
+    int32_t intervalErrors[PROBE_MAX_INTERVALS];
+} Probe;
+
+static Probe probes[PROBE_MAX];
+static atomic_int numProbes;
+static _Atomic(Probe*) activeProbe;
+
+static int64_t nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int findOnset(const void *audioData, int32_t numFrames, int32_t channelCount, bool isFloat, float threshold) {
+    int count = numFrames * channelCount;
+    if (isFloat) {
+        const float *samples = audioData;
+        for (int i = 0; i < count; i++) {
+            if (samples[i] > threshold || samples[i] < -threshold) return i / channelCount;
+        }
+    }
+    else {
+        const int16_t *samples = audioData;
+        int16_t limit = (int16_t)(threshold * 32767);
+        for (int i = 0; i < count; i++) {
+            if (samples[i] > limit || samples[i] < -limit) return i / channelCount;
+        }
+    }
+    return -1;
+}
+
+static aaudio_data_callback_result_t probeDataCallback(AAudioStream *aaudioStream, void *userData, void *audioData, int32_t numFrames) {
+    Probe *probe = userData;
+    int64_t now = nowNanos();
+    if (!atomic_load_explicit(&probe->aaudioStream, memory_order_relaxed)) {
+        probe->sampleRate = AAudioStream_getSampleRate(aaudioStream);
+        probe->channelCount = AAudioStream_getChannelCount(aaudioStream);
+        probe->isFloat = AAudioStream_getFormat(aaudioStream) == AAUDIO_FORMAT_PCM_FLOAT;
+        atomic_store_explicit(&probe->aaudioStream, aaudioStream, memory_order_release);
+    }
+
+    // the written frame count only moves once the callback returns
+    int64_t firstFrame = AAudioStream_getFramesWritten(aaudioStream);
+    aaudio_data_callback_result_t result = probe->callback(aaudioStream, probe->userData, audioData, numFrames);
+
+    int index = atomic_load_explicit(&probe->numIntervals, memory_order_relaxed);
+    if (probe->lastCallbackNanos && index < PROBE_MAX_INTERVALS) {
+        int64_t expected = (int64_t)numFrames * 1000000000LL / probe->sampleRate;
+        probe->intervalErrors[index] = (int32_t)(now - probe->lastCallbackNanos - expected);
+        atomic_store_explicit(&probe->numIntervals, index + 1, memory_order_release);
+    }
+    probe->lastCallbackNanos = now;
+
+    if (atomic_load_explicit(&probe->armed, memory_order_acquire)) {
+        int onset = findOnset(audioData, numFrames, probe->channelCount, probe->isFloat, probe->threshold);
+        if (onset >= 0) {
+            atomic_store_explicit(&probe->onsetNanos, now, memory_order_relaxed);
+            atomic_store_explicit(&probe->onsetFrame, firstFrame + onset, memory_order_release);
+            atomic_store_explicit(&probe->armed, false, memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+// Stands in for AAudioStreamBuilder_setDataCallback in alsa_client.c
+static void probeSetDataCallback(AAudioStreamBuilder *builder, AAudioStream_dataCallback callback, void *userData) {
+    int index = atomic_fetch_add(&numProbes, 1);
+    if (index >= PROBE_MAX) {
+        AAudioStreamBuilder_setDataCallback(builder, callback, userData);
+        return;
+    }
+
+    Probe *probe = &probes[index];
+    probe->callback = callback;
+    probe->userData = userData;
+    atomic_init(&probe->aaudioStream, NULL);
+    atomic_init(&probe->armed, false);
+    atomic_init(&probe->onsetFrame, -1);
+    atomic_init(&probe->onsetNanos, 0);
+    atomic_init(&probe->numIntervals, 0);
+    AAudioStreamBuilder_setDataCallback(builder, probeDataCallback, probe);
+    atomic_store(&activeProbe, probe);
+}
+
+#define AAudioStreamBuilder_setDataCallback probeSetDataCallback
+#include "../alsa_client.c"
+#undef AAudioStreamBuilder_setDataCallback
+
+// Frame positions of the input stream, so the impulse is found in what the microphone heard
+typedef struct Loopback {
+    AAudioStream *aaudioStream;
+    int32_t sampleRate;
+    atomic_bool armed;
+    atomic_llong onsetFrame;
+} Loopback;
+
+static aaudio_data_callback_result_t loopbackDataCallback(AAudioStream *aaudioStream, void *userData, void *audioData, int32_t numFrames) {
+    Loopback *loopback = userData;
+    int64_t firstFrame = AAudioStream_getFramesRead(aaudioStream);
+    if (atomic_load_explicit(&loopback->armed, memory_order_acquire)) {
+        int onset = findOnset(audioData, numFrames, 1, false, LOOPBACK_THRESHOLD);
+        if (onset >= 0) {
+            atomic_store_explicit(&loopback->onsetFrame, firstFrame + onset, memory_order_release);
+            atomic_store_explicit(&loopback->armed, false, memory_order_relaxed);
+        }
+    }
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+static bool loopbackOpen(Loopback *loopback) {
+    AAudioStreamBuilder *builder;
+    if (AAudio_createStreamBuilder(&builder) != AAUDIO_OK) return false;
+
+    atomic_init(&loopback->armed, false);
+    atomic_init(&loopback->onsetFrame, -1);
+    AAudioStreamBuilder_setDirection(builder, AAUDIO_DIRECTION_INPUT);
+    AAudioStreamBuilder_setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    AAudioStreamBuilder_setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+    AAudioStreamBuilder_setChannelCount(builder, 1);
+    AAudioStreamBuilder_setDataCallback(builder, loopbackDataCallback, loopback);
+
+    aaudio_result_t result = AAudioStreamBuilder_openStream(builder, &loopback->aaudioStream);
+    AAudioStreamBuilder_delete(builder);
+    if (result != AAUDIO_OK) return false;
+
+    loopback->sampleRate = AAudioStream_getSampleRate(loopback->aaudioStream);
+    AAudioStream_requestStart(loopback->aaudioStream);
+    return true;
+}
+
+static void loopbackClose(Loopback *loopback) {
+    AAudioStream_requestStop(loopback->aaudioStream);
+    AAudioStream_close(loopback->aaudioStream);
+}
+
+// Time the frame is presented (output) or was captured (input), from the latest timestamp
+static bool framePositionNanos(AAudioStream *aaudioStream, int32_t sampleRate, int64_t frame, int64_t *nanos) {
+    int64_t framePosition, timeNanos;
+    if (AAudioStream_getTimestamp(aaudioStream, CLOCK_MONOTONIC, &framePosition, &timeNanos) != AAUDIO_OK) return false;
+    *nanos = timeNanos + (frame - framePosition) * 1000000000LL / sampleRate;
+    return true;
+}
+
+typedef struct RunResult {
+    const char *path;
+    int32_t bufferFrames;
+    int numImpulses;
+    int missed;
+    int64_t outputLatency[MAX_IMPULSES];
+    int64_t callbackLatency[MAX_IMPULSES];
+    int64_t loopbackLatency[MAX_IMPULSES];
+    int numLoopback;
+    int32_t xruns;
+    int32_t underruns;
+    int32_t aaudioBufferFrames;
+    int32_t framesPerBurst;
+    bool exclusive;
+    Probe *probe;
+} RunResult;
+
+typedef void (*SubmitFunc)(void *data);
+
+/*
+ * Sends an impulse every interval once the last one was heard, and times it
+ * from its submission to the callback that rendered it, to its presentation
+ * and optionally to its capture. Called over and over by the path's loop.
+ */
+typedef struct ImpulseTimer {
+    RunResult *result;
+    Probe *probe;
+    Loopback *loopback;
+    int64_t intervalNanos;
+    int64_t nextNanos;
+    int64_t submitNanos;
+    bool pending;
+    bool presented;
+    bool captured;
+} ImpulseTimer;
+
+static void impulseTimerPoll(ImpulseTimer *timer, SubmitFunc submit, void *data) {
+    RunResult *result = timer->result;
+    Probe *probe = timer->probe;
+    int64_t now = nowNanos();
+
+    if (!timer->pending) {
+        if (now < timer->nextNanos || result->numImpulses >= MAX_IMPULSES) return;
+        atomic_store(&probe->onsetFrame, -1);
+        atomic_store(&probe->armed, true);
+        if (timer->loopback) {
+            atomic_store(&timer->loopback->onsetFrame, -1);
+            atomic_store(&timer->loopback->armed, true);
+        }
+        timer->pending = true;
+        timer->presented = false;
+        timer->captured = !timer->loopback;
+        timer->submitNanos = nowNanos();
+        submit(data);
+        return;
+    }
+
+    int i = result->numImpulses;
+    int64_t onsetFrame = atomic_load_explicit(&probe->onsetFrame, memory_order_acquire);
+    if (!timer->presented && onsetFrame >= 0) {
+        int64_t presentNanos;
+        AAudioStream *aaudioStream = atomic_load(&probe->aaudioStream);
+        if (framePositionNanos(aaudioStream, probe->sampleRate, onsetFrame, &presentNanos)) {
+            result->callbackLatency[i] = atomic_load(&probe->onsetNanos) - timer->submitNanos;
+            result->outputLatency[i] = presentNanos - timer->submitNanos;
+            timer->presented = true;
+        }
+    }
+    if (!timer->captured) {
+        int64_t captureFrame = atomic_load_explicit(&timer->loopback->onsetFrame, memory_order_acquire);
+        int64_t captureNanos;
+        if (captureFrame >= 0 && framePositionNanos(timer->loopback->aaudioStream, timer->loopback->sampleRate,
+                                                    captureFrame, &captureNanos)) {
+            result->loopbackLatency[result->numLoopback++] = captureNanos - timer->submitNanos;
+            timer->captured = true;
+        }
+    }
+
+    bool timedOut = now - timer->submitNanos > IMPULSE_TIMEOUT_NS;
+    if ((timer->presented && timer->captured) || timedOut) {
+        if (timer->presented) result->numImpulses++;
+        else result->missed++;
+        atomic_store(&probe->armed, false);
+        if (timer->loopback) atomic_store(&timer->loopback->armed, false);
+        timer->pending = false;
+        timer->nextNanos = now + timer->intervalNanos;
+    }
+}
+
+// Waits for the stream a run just opened to run its first callback
+static Probe *waitForProbe(int64_t timeoutNanos) {
+    int64_t deadline = nowNanos() + timeoutNanos;
+    while (nowNanos() < deadline) {
+        Probe *probe = atomic_load(&activeProbe);
+        if (probe && atomic_load(&probe->aaudioStream)) return probe;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static void fillStreamResult(RunResult *result, Probe *probe) {
+    AAudioStream *aaudioStream = atomic_load(&probe->aaudioStream);
+    result->probe = probe;
+    result->xruns = AAudioStream_getXRunCount(aaudioStream);
+    result->aaudioBufferFrames = AAudioStream_getBufferSizeInFrames(aaudioStream);
+    result->framesPerBurst = AAudioStream_getFramesPerBurst(aaudioStream);
+    result->exclusive = AAudioStream_getSharingMode(aaudioStream) == AAUDIO_SHARING_MODE_EXCLUSIVE;
+}
+
+// The JNI entry points only need strings and direct buffers
+typedef struct FakeDirectBuffer {
+    void *address;
+    jlong capacity;
+} FakeDirectBuffer;
+
+static const char *fakeGetStringUTFChars(JNIEnv *env, jstring string, jboolean *isCopy) {
+    return (const char*)string;
+}
+
+static void fakeReleaseStringUTFChars(JNIEnv *env, jstring string, const char *chars) {
+}
+
+static void *fakeGetDirectBufferAddress(JNIEnv *env, jobject buffer) {
+    return ((FakeDirectBuffer*)buffer)->address;
+}
+
+static jlong fakeGetDirectBufferCapacity(JNIEnv *env, jobject buffer) {
+    return ((FakeDirectBuffer*)buffer)->capacity;
+}
+
+static struct JNINativeInterface fakeFunctions;
+static JNIEnv fakeEnv;
+
+static void fakeEnvInit(void) {
+    memset(&fakeFunctions, 0, sizeof(fakeFunctions));
+    fakeFunctions.GetStringUTFChars = fakeGetStringUTFChars;
+    fakeFunctions.ReleaseStringUTFChars = fakeReleaseStringUTFChars;
+    fakeFunctions.GetDirectBufferAddress = fakeGetDirectBufferAddress;
+    fakeFunctions.GetDirectBufferCapacity = fakeGetDirectBufferCapacity;
+    fakeEnv = &fakeFunctions;
+}
+
+// The guest side of the ALSA protocol, as the plugin in the rootfs speaks it
+typedef struct ALSATestClient {
+    int fd;
+    int32_t bufferFrames;
+    int32_t periodFrames;
+    int32_t frameBytes;
+    uint8_t *sharedBuffer;
+    uint8_t *period;
+    bool impulse;
+    // set to when the period carrying the impulse was written
+    int64_t *impulseNanos;
+} ALSATestClient;
+
+static bool alsaSend(ALSATestClient *client, uint8_t requestCode, const void *payload, uint32_t length, bool withPayload) {
+    uint8_t header[REQUEST_HEADER_LENGTH];
+    header[0] = requestCode;
+    memcpy(header + 1, &length, sizeof(length));
+    if (send(client->fd, header, sizeof(header), MSG_NOSIGNAL) != sizeof(header)) return false;
+    return !withPayload || length == 0 || send(client->fd, payload, length, MSG_NOSIGNAL) == (ssize_t)length;
+}
+
+static bool alsaConnect(ALSATestClient *client, const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_LOCAL;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return client->fd >= 0 && connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+// PREPARE answers with a status byte and the memfd of the period buffer
+static bool alsaPrepare(ALSATestClient *client) {
+    uint8_t payload[PREPARE_LENGTH];
+    int32_t sampleRate = ALSA_SAMPLE_RATE;
+    payload[0] = ALSA_CHANNELS;
+    payload[1] = S16LE;
+    memcpy(payload + 2, &sampleRate, sizeof(sampleRate));
+    memcpy(payload + 6, &client->bufferFrames, sizeof(client->bufferFrames));
+    if (!alsaSend(client, REQUEST_PREPARE, payload, sizeof(payload), true)) return false;
+
+    uint8_t status;
+    struct iovec iov = {.iov_base = &status, .iov_len = sizeof(status)};
+    union {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = &control, .msg_controllen = sizeof(control)};
+    if (recvmsg(client->fd, &msg, 0) != sizeof(status)) return false;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+        void *data = mmap(NULL, client->bufferFrames * client->frameBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) client->sharedBuffer = data;
+        close(fd);
+    }
+    return true;
+}
+
+static int32_t alsaPointer(ALSATestClient *client) {
+    int32_t pointer = -1;
+    if (!alsaSend(client, REQUEST_POINTER, NULL, 0, false)) return -1;
+    if (recv(client->fd, &pointer, sizeof(pointer), MSG_WAITALL) != sizeof(pointer)) return -1;
+    return pointer;
+}
+
+// One period of silence, with a full scale impulse at its start when one was requested
+static bool alsaWritePeriod(ALSATestClient *client) {
+    uint32_t length = client->periodFrames * client->frameBytes;
+    memset(client->period, 0, length);
+    if (client->impulse) {
+        int16_t *samples = (int16_t*)client->period;
+        for (int i = 0; i < IMPULSE_FRAMES * ALSA_CHANNELS; i++) samples[i] = INT16_MAX;
+        client->impulse = false;
+        *client->impulseNanos = nowNanos();
+    }
+
+    if (client->sharedBuffer) {
+        memcpy(client->sharedBuffer, client->period, length);
+        return alsaSend(client, REQUEST_WRITE, NULL, length, false);
+    }
+    return alsaSend(client, REQUEST_WRITE, client->period, length, true);
+}
+
+static void alsaSubmitImpulse(void *data) {
+    ((ALSATestClient*)data)->impulse = true;
+}
+
+static int32_t serverUnderruns(ALSAServer *server) {
+    int32_t underruns = 0;
+    pthread_mutex_lock(&server->mutex);
+    for (ALSAClient *client = server->clients; client; client = client->next) {
+        if (client->stream) underruns = atomic_load(&client->stream->underruns);
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return underruns;
+}
+
+/*
+ * Plays silence through the ALSA server for the given time, writing a period
+ * whenever the buffer has room like the plugin does, with an impulse written
+ * at the head of the queue each interval. The POINTER round trip after every
+ * WRITE also guarantees the shared buffer was read before it is refilled.
+ */
+static bool runALSA(RunResult *result, ALSAServer *server, const char *socketPath, int32_t bufferFrames,
+                    int seconds, int intervalMillis, Loopback *loopback) {
+    ALSATestClient client = {.fd = -1};
+    client.bufferFrames = bufferFrames;
+    client.periodFrames = bufferFrames / 4 > 0 ? bufferFrames / 4 : 1;
+    client.frameBytes = ALSA_CHANNELS * sizeof(int16_t);
+    client.period = malloc(client.periodFrames * client.frameBytes);
+
+    atomic_store(&activeProbe, NULL);
+    bool ok = client.period && alsaConnect(&client, socketPath) && alsaPrepare(&client);
+    Probe *probe = NULL;
+
+    // the plugin fills the whole buffer before it starts
+    for (int i = 0; ok && i < 4; i++) ok = alsaWritePeriod(&client) && alsaPointer(&client) >= 0;
+    if (ok) probe = waitForProbe(IMPULSE_TIMEOUT_NS);
+
+    if (probe) {
+        probe->threshold = ALSA_THRESHOLD;
+        ImpulseTimer timer = {.result = result, .probe = probe, .loopback = loopback,
+                              .intervalNanos = intervalMillis * 1000000LL, .nextNanos = nowNanos()};
+        client.impulseNanos = &timer.submitNanos;
+        int64_t periodNanos = (int64_t)client.periodFrames * 1000000000LL / ALSA_SAMPLE_RATE;
+        int64_t endNanos = nowNanos() + seconds * 1000000000LL;
+        int64_t written = 4 * client.periodFrames;
+
+        while (nowNanos() < endNanos) {
+            int32_t pointer = alsaPointer(&client);
+            if (pointer < 0) break;
+
+            impulseTimerPoll(&timer, alsaSubmitImpulse, &client);
+            if (written - pointer + client.periodFrames <= client.bufferFrames) {
+                if (!alsaWritePeriod(&client)) break;
+                written += client.periodFrames;
+            }
+            else usleep(periodNanos / 2000);
+        }
+
+        fillStreamResult(result, probe);
+        result->underruns = serverUnderruns(server);
+    }
+
+    if (client.fd >= 0) {
+        alsaSend(&client, REQUEST_CLOSE, NULL, 0, false);
+        alsaPointer(&client);
+        close(client.fd);
+    }
+    if (client.sharedBuffer) munmap(client.sharedBuffer, client.bufferFrames * client.frameBytes);
+    free(client.period);
+    return probe != NULL;
+}
+
+// libmidihandler entry points, still named after the Winlator package
+typedef jlong (*MIDIAllocateFunc)(JNIEnv *env, jobject obj);
+typedef void (*MIDILoadSoundFontFunc)(JNIEnv *env, jobject obj, jlong nativePtr, jstring path);
+typedef void (*MIDIQueueEventsFunc)(JNIEnv *env, jobject obj, jlong nativePtr, jobject events, jint count);
+typedef void (*MIDIDestroyFunc)(JNIEnv *env, jobject obj, jlong nativePtr);
+
+typedef struct MIDITest {
+    MIDIQueueEventsFunc queueEvents;
+    jlong handler;
+} MIDITest;
+
+static void midiQueueEvent(MIDITest *test, uint8_t status, uint8_t data1, uint8_t data2) {
+    uint8_t event[MIDI_EVENT_SIZE] = {0};
+    uint32_t time = (uint32_t)(nowNanos() / 1000);
+    memcpy(event, &time, sizeof(time));
+    event[4] = status;
+    event[5] = data1;
+    event[6] = data2;
+
+    FakeDirectBuffer buffer = {event, sizeof(event)};
+    test->queueEvents(&fakeEnv, NULL, test->handler, (jobject)&buffer, 1);
+}
+
+// A note on of the snare, the note off follows right away as the drum kit ignores it
+static void midiSubmitImpulse(void *data) {
+    MIDITest *test = data;
+    midiQueueEvent(test, 0x90 | MIDI_CHANNEL, MIDI_NOTE, 127);
+    midiQueueEvent(test, 0x80 | MIDI_CHANNEL, MIDI_NOTE, 0);
+}
+
+static bool runMIDI(RunResult *result, const char *libraryPath, const char *soundfontPath,
+                    int seconds, int intervalMillis, Loopback *loopback) {
+    void *library = dlopen(libraryPath, RTLD_NOW);
+    if (!library) {
+        fprintf(stderr, "%s\n", dlerror());
+        return false;
+    }
+
+    MIDIAllocateFunc allocateMixed = dlsym(library, "Java_com_winlator_winhandler_MIDIHandler_nativeAllocateMixed");
+    MIDILoadSoundFontFunc loadSoundFont = dlsym(library, "Java_com_winlator_winhandler_MIDIHandler_loadSoundFont");
+    MIDIDestroyFunc destroy = dlsym(library, "Java_com_winlator_winhandler_MIDIHandler_destroy");
+    MIDITest test = {dlsym(library, "Java_com_winlator_winhandler_MIDIHandler_queueEvents"), 0};
+    if (!allocateMixed || !loadSoundFont || !destroy || !test.queueEvents) {
+        fprintf(stderr, "%s lacks the MIDIHandler entry points\n", libraryPath);
+        return false;
+    }
+
+    atomic_store(&activeProbe, NULL);
+    test.handler = allocateMixed(&fakeEnv, NULL);
+    if (!test.handler) return false;
+    loadSoundFont(&fakeEnv, NULL, test.handler, (jstring)soundfontPath);
+
+    // without the mixer the synth plays through its own Oboe stream, which isn't probed
+    Probe *probe = waitForProbe(IMPULSE_TIMEOUT_NS);
+    if (probe) {
+        probe->threshold = MIDI_THRESHOLD;
+        ImpulseTimer timer = {.result = result, .probe = probe, .loopback = loopback,
+                              .intervalNanos = intervalMillis * 1000000LL, .nextNanos = nowNanos()};
+        int64_t endNanos = nowNanos() + seconds * 1000000000LL;
+        while (nowNanos() < endNanos) {
+            impulseTimerPoll(&timer, midiSubmitImpulse, &test);
+            usleep(500);
+        }
+        fillStreamResult(result, probe);
+    }
+    else fprintf(stderr, "the MIDI handler did not render through the mixer\n");
+
+    destroy(&fakeEnv, NULL, test.handler);
+    return probe != NULL;
+}
+
+static int compareInt64(const void *a, const void *b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compareInt32(const void *a, const void *b) {
+    int32_t x = *(const int32_t*)a, y = *(const int32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts values in place
+static double percentileMillis(int64_t *values, int count, int percentile) {
+    if (count == 0) return -1.0;
+    qsort(values, count, sizeof(int64_t), compareInt64);
+    return values[(count - 1) * percentile / 100] / 1e6;
+}
+
+static void printHeader(bool loopback) {
+    printf("%-7s %7s %5s %5s %26s %8s", "path", "buffer", "hits", "miss", "output p50/p90/p99/max ms", "cb p50");
+    if (loopback) printf(" %14s", "loop p50/p99");
+    printf(" %21s %6s %6s %12s\n", "jitter p50/p99/max us", "xruns", "under", "aaudio/burst");
+}
+
+static void printResult(RunResult *result, bool loopback) {
+    int n = result->numImpulses;
+    char buffer[16];
+    if (result->bufferFrames > 0) snprintf(buffer, sizeof(buffer), "%d", result->bufferFrames);
+    else snprintf(buffer, sizeof(buffer), "-");
+
+    printf("%-7s %7s %5d %5d", result->path, buffer, n, result->missed);
+    double p50 = percentileMillis(result->outputLatency, n, 50);
+    double p90 = percentileMillis(result->outputLatency, n, 90);
+    double p99 = percentileMillis(result->outputLatency, n, 99);
+    double max = percentileMillis(result->outputLatency, n, 100);
+    printf("  %6.1f/%6.1f/%6.1f/%6.1f %8.1f", p50, p90, p99, max, percentileMillis(result->callbackLatency, n, 50));
+    if (loopback) {
+        double loop50 = percentileMillis(result->loopbackLatency, result->numLoopback, 50);
+        double loop99 = percentileMillis(result->loopbackLatency, result->numLoopback, 99);
+        printf("  %6.1f/%6.1f", loop50, loop99);
+    }
+
+    Probe *probe = result->probe;
+    int count = atomic_load(&probe->numIntervals);
+    for (int i = 0; i < count; i++) {
+        if (probe->intervalErrors[i] < 0) probe->intervalErrors[i] = -probe->intervalErrors[i];
+    }
+    qsort(probe->intervalErrors, count, sizeof(int32_t), compareInt32);
+    if (count > 0) {
+        printf("  %6d/%6d/%7d", probe->intervalErrors[(count - 1) / 2] / 1000,
+               probe->intervalErrors[(count - 1) * 99 / 100] / 1000, probe->intervalErrors[count - 1] / 1000);
+    }
+    else printf("  %21s", "-");
+
+    printf(" %6d %6d %6d/%-5d%s\n", result->xruns, result->underruns, result->aaudioBufferFrames,
+           result->framesPerBurst, result->exclusive ? " excl" : "");
+    fflush(stdout);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-d seconds] [-b buffer,...] [-i interval_ms] [-m] [-l] [-s soundfont.sf2] [-L libmidihandler.so]\n"
+                    "  -b  ALSA buffer sizes in frames at %d Hz\n"
+                    "  -m  also run the ALSA client through the mixer\n"
+                    "  -l  time the impulses through the microphone as well\n"
+                    "  -s  run the MIDI path with this soundfont\n", program, ALSA_SAMPLE_RATE);
+}
+
+int main(int argc, char *argv[]) {
+    int32_t bufferSizes[16] = {256, 512, 1024, 2048, 4096};
+    int numBufferSizes = 5;
+    int seconds = 10;
+    int intervalMillis = 300;
+    bool mixed = false;
+    bool useLoopback = false;
+    const char *soundfontPath = NULL;
+    const char *libraryPath = "libmidihandler.so";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:i:mls:L:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 'b': {
+                numBufferSizes = 0;
+                for (char *token = strtok(optarg, ","); token && numBufferSizes < 16; token = strtok(NULL, ",")) {
+                    bufferSizes[numBufferSizes++] = atoi(token);
+                }
+                break;
+            }
+            case 'i':
+                intervalMillis = atoi(optarg);
+                break;
+            case 'm':
+                mixed = true;
+                break;
+            case 'l':
+                useLoopback = true;
+                break;
+            case 's':
+                soundfontPath = optarg;
+                break;
+            case 'L':
+                libraryPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (seconds <= 0 || intervalMillis <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fakeEnvInit();
+    Loopback loopback;
+    if (useLoopback && !loopbackOpen(&loopback)) {
+        fprintf(stderr, "could not open the input stream, is RECORD_AUDIO granted?\n");
+        useLoopback = false;
+    }
+
+    char socketPath[108];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(socketPath, sizeof(socketPath), "%s/alsa-latency-%d", tmpdir ? tmpdir : "/data/local/tmp", getpid());
+    ALSAServer *server = (ALSAServer*)Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_startServer(&fakeEnv, NULL, (jstring)socketPath);
+    if (!server) {
+        fprintf(stderr, "could not start the ALSA server on %s\n", socketPath);
+        return 1;
+    }
+
+    static RunResult result;
+    printHeader(useLoopback);
+    for (int pass = 0; pass < (mixed ? 2 : 1); pass++) {
+        Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_setMixerEnabled(&fakeEnv, NULL, pass == 1);
+        for (int i = 0; i < numBufferSizes; i++) {
+            memset(&result, 0, sizeof(result));
+            result.path = pass == 1 ? "mixer" : "direct";
+            result.bufferFrames = bufferSizes[i];
+            if (runALSA(&result, server, socketPath, bufferSizes[i], seconds, intervalMillis, useLoopback ? &loopback : NULL)) {
+                printResult(&result, useLoopback);
+            }
+            else fprintf(stderr, "%s run with a %d frame buffer failed\n", result.path, bufferSizes[i]);
+        }
+    }
+
+    if (soundfontPath) {
+        memset(&result, 0, sizeof(result));
+        result.path = "midi";
+        // the synth is decaying long after an ALSA impulse, give it room
+        if (runMIDI(&result, libraryPath, soundfontPath, seconds, intervalMillis > 500 ? intervalMillis : 500,
+                    useLoopback ? &loopback : NULL)) {
+            printResult(&result, useLoopback);
+        }
+    }
+
+    Java_com_steamdeck_mobile_core_alsaserver_ALSAServer_stopServer(&fakeEnv, NULL, (jlong)server);
+    unlink(socketPath);
+    if (useLoopback) loopbackClose(&loopback);
+    return 0;
+}
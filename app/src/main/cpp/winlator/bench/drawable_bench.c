@@ -0,0 +1,339 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../drawable.c"
+#undef printf
+
+/*
+ * Pixel op benchmark: every op of drawable.c runs on each of the surface
+ * sizes below, from glyph sized blits to a full 1080p drawable, until it
+ * has taken the requested time. The JNI entry points are called directly
+ * with a JNIEnv whose only functions are the direct buffer and critical
+ * array accessors drawable.c uses; bitmaps are plain memory behind the
+ * AndroidBitmap calls. Reports the mean nanoseconds per pixel and the
+ * memory traffic of an op (bytes read plus bytes written) in GB/s.
+ */
+
+#define BENCH_DEFAULT_MILLIS 200
+#define BENCH_MARGIN 64
+
+struct BenchBuffer {
+    void *data;
+    jlong capacity;
+};
+
+struct BenchBitmap {
+    AndroidBitmapInfo info;
+    void *pixels;
+};
+
+struct BenchSize {
+    const char *name;
+    short width;
+    short height;
+};
+
+struct BenchContext {
+    JNIEnv *env;
+    short width;
+    short height;
+    int gcFunction;
+    struct BenchBuffer src;
+    struct BenchBuffer mask;
+    struct BenchBuffer dst;
+    /* dst of width + BENCH_MARGIN pixels per row, for sub rectangle copies */
+    struct BenchBuffer surface;
+    struct BenchBuffer bitmapData;
+    struct BenchBitmap bitmap;
+};
+
+struct BenchOp {
+    const char *name;
+    int gcFunction;
+    void (*run)(struct BenchContext *ctx);
+    /* pixels an op touches and the bytes it reads and writes for them */
+    double (*pixels)(const struct BenchContext *ctx);
+    double bytesPerPixel;
+};
+
+static const struct BenchSize sizes[] = {
+    {"16x16", 16, 16},
+    {"64x64", 64, 64},
+    {"256x256", 256, 256},
+    {"1920x1080", 1920, 1080},
+};
+
+static const char *gcFunctionNames[] = {
+    "clear", "and", "and_reverse", "copy", "and_inverted", "no_op", "xor", "or",
+    "nor", "equiv", "invert", "or_reverse", "copy_inverted", "or_inverted", "nand", "set",
+};
+
+static void *benchGetDirectBufferAddress(JNIEnv *env, jobject buf) {
+    return ((struct BenchBuffer*)buf)->data;
+}
+
+static jlong benchGetDirectBufferCapacity(JNIEnv *env, jobject buf) {
+    return ((struct BenchBuffer*)buf)->capacity;
+}
+
+static void *benchGetPrimitiveArrayCritical(JNIEnv *env, jarray array, jboolean *isCopy) {
+    if (isCopy) *isCopy = 0;
+    return ((struct BenchBuffer*)array)->data;
+}
+
+static void benchReleasePrimitiveArrayCritical(JNIEnv *env, jarray array, void *carray, jint mode) {
+}
+
+int AndroidBitmap_getInfo(JNIEnv *env, jobject jbitmap, AndroidBitmapInfo *info) {
+    *info = ((struct BenchBitmap*)jbitmap)->info;
+    return ANDROID_BITMAP_RESULT_SUCCESS;
+}
+
+int AndroidBitmap_lockPixels(JNIEnv *env, jobject jbitmap, void **addrPtr) {
+    *addrPtr = ((struct BenchBitmap*)jbitmap)->pixels;
+    return ANDROID_BITMAP_RESULT_SUCCESS;
+}
+
+int AndroidBitmap_unlockPixels(JNIEnv *env, jobject jbitmap) {
+    return ANDROID_BITMAP_RESULT_SUCCESS;
+}
+
+static uint64_t benchNowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* fills with noise, a constant buffer would make the raster ops look better
+ * than they are on branchy scalar paths */
+static void benchAllocBuffer(struct BenchBuffer *buffer, size_t size, uint32_t seed) {
+    buffer->data = malloc(size);
+    buffer->capacity = size;
+    if (!buffer->data) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    uint8_t *bytes = buffer->data;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        bytes[i] = seed >> 24;
+    }
+}
+
+static void benchSetup(struct BenchContext *ctx, const struct BenchSize *size) {
+    size_t pixels = (size_t)size->width * size->height;
+    ctx->width = size->width;
+    ctx->height = size->height;
+
+    benchAllocBuffer(&ctx->src, pixels * 4, 1);
+    benchAllocBuffer(&ctx->mask, pixels * 4, 2);
+    benchAllocBuffer(&ctx->dst, pixels * 4, 3);
+    benchAllocBuffer(&ctx->surface, (size_t)(size->width + BENCH_MARGIN) * size->height * 4, 4);
+    benchAllocBuffer(&ctx->bitmapData, (size_t)getBitmapBytePad(size->width) * size->height, 5);
+
+    /* half of the mask pixels white, as drawAlphaMaskedBitmap tests for */
+    uint32_t *mask = ctx->mask.data;
+    for (size_t i = 0; i < pixels; i++) mask[i] = (mask[i] & 1) ? WHITE : BLACK;
+
+    ctx->bitmap.info.width = size->width;
+    ctx->bitmap.info.height = size->height;
+    ctx->bitmap.info.stride = size->width * 4;
+    ctx->bitmap.info.format = ANDROID_BITMAP_FORMAT_RGBA_8888;
+    ctx->bitmap.pixels = malloc(pixels * 4);
+}
+
+static void benchTeardown(struct BenchContext *ctx) {
+    free(ctx->src.data);
+    free(ctx->mask.data);
+    free(ctx->dst.data);
+    free(ctx->surface.data);
+    free(ctx->bitmapData.data);
+    free(ctx->bitmap.pixels);
+}
+
+static double areaPixels(const struct BenchContext *ctx) {
+    return (double)ctx->width * ctx->height;
+}
+
+static double scrollPixels(const struct BenchContext *ctx) {
+    return (double)ctx->width * (ctx->height - 1);
+}
+
+static double linePixels(const struct BenchContext *ctx) {
+    return ctx->width > ctx->height ? ctx->width : ctx->height;
+}
+
+static double wideLinePixels(const struct BenchContext *ctx) {
+    return linePixels(ctx) * 16;
+}
+
+static double horizontalLinePixels(const struct BenchContext *ctx) {
+    return ctx->width;
+}
+
+static void runCopyAreaRows(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_copyArea(ctx->env, NULL, 0, 0, 0, 0, ctx->width, ctx->height,
+                                                             ctx->width, ctx->width, &ctx->src, &ctx->dst);
+}
+
+static void runCopyAreaRect(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_copyArea(ctx->env, NULL, 0, 0, BENCH_MARGIN / 2, 0,
+                                                             ctx->width, ctx->height, ctx->width,
+                                                             ctx->width + BENCH_MARGIN, &ctx->src, &ctx->surface);
+}
+
+static void runCopyAreaScroll(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_copyArea(ctx->env, NULL, BENCH_MARGIN / 2, 0, BENCH_MARGIN / 2, 1,
+                                                             ctx->width, ctx->height - 1, ctx->width + BENCH_MARGIN,
+                                                             ctx->width + BENCH_MARGIN, &ctx->surface, &ctx->surface);
+}
+
+static void runCopyAreaOp(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_copyAreaOp(ctx->env, NULL, 0, 0, 0, 0, ctx->width, ctx->height,
+                                                               ctx->width, ctx->width, &ctx->src, &ctx->dst,
+                                                               ctx->gcFunction);
+}
+
+static void runCopyAreaOpScroll(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_copyAreaOp(ctx->env, NULL, BENCH_MARGIN / 2, 0, BENCH_MARGIN / 2, 1,
+                                                               ctx->width, ctx->height - 1, ctx->width + BENCH_MARGIN,
+                                                               ctx->width + BENCH_MARGIN, &ctx->surface,
+                                                               &ctx->surface, ctx->gcFunction);
+}
+
+static void runFillRect(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_fillRect(ctx->env, NULL, 0, 0, ctx->width, ctx->height,
+                                                             0x336699, ctx->width, &ctx->dst);
+}
+
+static void runDrawLineHorizontal(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawLine(ctx->env, NULL, 0, ctx->height / 2, ctx->width - 1,
+                                                             ctx->height / 2, 0x336699, 1, ctx->width, &ctx->dst);
+}
+
+static void runDrawLineDiagonal(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawLine(ctx->env, NULL, 0, 0, ctx->width - 1, ctx->height - 1,
+                                                             0x336699, 1, ctx->width, &ctx->dst);
+}
+
+static void runDrawLineWide(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawLine(ctx->env, NULL, 0, 0, ctx->width - 4, ctx->height - 4,
+                                                             0x336699, 4, ctx->width, &ctx->dst);
+}
+
+static void runDrawBitmap(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawBitmap(ctx->env, NULL, ctx->width, ctx->height,
+                                                               &ctx->bitmapData, &ctx->dst);
+}
+
+static void runDrawBitmapColored(struct BenchContext *ctx) {
+    /* an odd source x, so the unaligned head of every line is in the cost */
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawBitmapColored(ctx->env, NULL, 3, 0, 0, 0, ctx->width - 3,
+                                                                      ctx->height, ctx->width, 0x336699, 0x000000,
+                                                                      ctx->width, &ctx->bitmapData, &ctx->dst);
+}
+
+static void runDrawAlphaMaskedBitmap(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Drawable_drawAlphaMaskedBitmap(ctx->env, NULL, -1, -1, -1, 0, 0, 0,
+                                                                          &ctx->mask, &ctx->mask, &ctx->dst);
+}
+
+static void runToBitmap(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Pixmap_toBitmap(ctx->env, NULL, &ctx->src, NULL, &ctx->bitmap);
+}
+
+static void runToBitmapMasked(struct BenchContext *ctx) {
+    Java_com_steamdeck_mobile_core_xserver_Pixmap_toBitmap(ctx->env, NULL, &ctx->src, &ctx->mask, &ctx->bitmap);
+}
+
+static const struct BenchOp fixedOps[] = {
+    {"copyArea/rows", 0, runCopyAreaRows, areaPixels, 8},
+    {"copyArea/rect", 0, runCopyAreaRect, areaPixels, 8},
+    {"copyArea/scroll", 0, runCopyAreaScroll, scrollPixels, 8},
+    {"fillRect", 0, runFillRect, areaPixels, 4},
+    {"drawLine/horizontal", 0, runDrawLineHorizontal, horizontalLinePixels, 4},
+    {"drawLine/diagonal", 0, runDrawLineDiagonal, linePixels, 4},
+    {"drawLine/wide", 0, runDrawLineWide, wideLinePixels, 4},
+    {"drawBitmap", 0, runDrawBitmap, areaPixels, 4.125},
+    {"drawBitmapColored", 0, runDrawBitmapColored, areaPixels, 4.125},
+    {"drawAlphaMaskedBitmap", 0, runDrawAlphaMaskedBitmap, areaPixels, 12},
+    {"toBitmap", 0, runToBitmap, areaPixels, 8},
+    {"toBitmap/masked", 0, runToBitmapMasked, areaPixels, 12},
+};
+
+static void benchRun(struct BenchContext *ctx, const struct BenchOp *op, const char *sizeName, uint64_t targetNanos) {
+    ctx->gcFunction = op->gcFunction;
+    op->run(ctx);
+
+    uint64_t iterations = 0;
+    uint64_t start = benchNowNanos(), elapsed;
+    do {
+        for (int i = 0; i < 16; i++) op->run(ctx);
+        iterations += 16;
+        elapsed = benchNowNanos() - start;
+    } while (elapsed < targetNanos);
+
+    double pixels = op->pixels(ctx) * iterations;
+    double nsPerPixel = elapsed / pixels;
+    double gbPerSecond = pixels * op->bytesPerPixel / elapsed;
+    printf("%-32s %-10s %10.3f ns/px %8.2f GB/s\n", op->name, sizeName, nsPerPixel, gbPerSecond);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [-t millis] [filter]\n"
+                    "  runs every op whose name contains filter for at least millis per size\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    uint64_t millis = BENCH_DEFAULT_MILLIS;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) millis = strtoull(argv[++i], NULL, 10);
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        else filter = argv[i];
+    }
+
+    struct JNINativeInterface functions;
+    memset(&functions, 0, sizeof(functions));
+    functions.GetDirectBufferAddress = benchGetDirectBufferAddress;
+    functions.GetDirectBufferCapacity = benchGetDirectBufferCapacity;
+    functions.GetPrimitiveArrayCritical = benchGetPrimitiveArrayCritical;
+    functions.ReleasePrimitiveArrayCritical = benchReleasePrimitiveArrayCritical;
+    JNIEnv env = &functions;
+
+    /* copyAreaOp twice per GC function: separate drawables and a scroll within one */
+    int numGcFunctions = sizeof(gcFunctionNames) / sizeof(gcFunctionNames[0]);
+    int numFixedOps = sizeof(fixedOps) / sizeof(fixedOps[0]);
+    int numOps = numFixedOps + numGcFunctions * 2;
+    struct BenchOp *ops = calloc(numOps, sizeof(struct BenchOp));
+    char (*names)[64] = calloc(numGcFunctions * 2, 64);
+    memcpy(ops, fixedOps, sizeof(fixedOps));
+    for (int i = 0; i < numGcFunctions; i++) {
+        struct BenchOp *op = &ops[numFixedOps + i * 2];
+        snprintf(names[i * 2], 64, "copyAreaOp/%s", gcFunctionNames[i]);
+        op[0] = (struct BenchOp){names[i * 2], i, runCopyAreaOp, areaPixels, 12};
+        snprintf(names[i * 2 + 1], 64, "copyAreaOp/%s/scroll", gcFunctionNames[i]);
+        op[1] = (struct BenchOp){names[i * 2 + 1], i, runCopyAreaOpScroll, scrollPixels, 12};
+    }
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        struct BenchContext ctx = {.env = &env};
+        benchSetup(&ctx, &sizes[s]);
+        for (int i = 0; i < numOps; i++) {
+            if (filter && !strstr(ops[i].name, filter)) continue;
+            benchRun(&ctx, &ops[i], sizes[s].name, millis * 1000000ULL);
+        }
+        benchTeardown(&ctx);
+    }
+
+    free(names);
+    free(ops);
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef DRAWABLE_BENCH_ANDROID_LOG_H
+#define DRAWABLE_BENCH_ANDROID_LOG_H
+
+#define ANDROID_LOG_DEBUG 3
+
+/* drawable.c only names it in its printf macro, which it never expands */
+int __android_log_print(int prio, const char *tag, const char *fmt, ...);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef DRAWABLE_BENCH_JNI_H
+#define DRAWABLE_BENCH_JNI_H
+
+#include <stdint.h>
+
+/* The part of jni.h drawable.c uses, laid out for the bench's own JNIEnv */
+
+#define JNIEXPORT
+#define JNICALL
+#define JNI_ABORT 2
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef void *jobject;
+typedef jobject jclass;
+typedef jobject jarray;
+typedef jarray jshortArray;
+
+struct JNINativeInterface {
+    void *(*GetPrimitiveArrayCritical)(const struct JNINativeInterface **env, jarray array, jboolean *isCopy);
+    void (*ReleasePrimitiveArrayCritical)(const struct JNINativeInterface **env, jarray array, void *carray, jint mode);
+    jobject (*NewDirectByteBuffer)(const struct JNINativeInterface **env, void *address, jlong capacity);
+    void *(*GetDirectBufferAddress)(const struct JNINativeInterface **env, jobject buf);
+    jlong (*GetDirectBufferCapacity)(const struct JNINativeInterface **env, jobject buf);
+};
+
+typedef const struct JNINativeInterface *JNIEnv;
+
+#endif
@@ -6,9 +6,14 @@
 #include <math.h>
 #include <android/bitmap.h>
 #include <android/log.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #define WHITE 0xffffff
 #define BLACK 0x000000
+#define RGB_MASK 0x00ffffff
+#define RASTER_OP_CHUNK 256
 #define printf(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__);
 
 enum GCFunction {GCF_CLEAR, GCF_AND, GCF_AND_REVERSE, GCF_COPY, GCF_AND_INVERTED, GCF_NO_OP, GCF_XOR, GCF_OR, GCF_NOR, GCF_EQUIV, GCF_INVERT, GCF_OR_REVERSE, GCF_COPY_INVERTED, GCF_OR_INVERTED, GCF_NAND, GCF_SET};
@@ -24,6 +29,34 @@ static void unpackColor(int color, uint8_t *rgba) {
     rgba[3] = 255;
 }
 
+static uint32_t toPixel(int color) {
+    uint8_t rgba[4];
+    uint32_t pixel;
+    unpackColor(color, rgba);
+    memcpy(&pixel, rgba, 4);
+    return pixel;
+}
+
+static void fillPixels(uint32_t *dst, uint32_t pixel, int count) {
+#ifdef __ARM_NEON
+    uint32x4_t pixels = vdupq_n_u32(pixel);
+    for (; count >= 16; count -= 16, dst += 16) {
+        vst1q_u32(dst + 0, pixels);
+        vst1q_u32(dst + 4, pixels);
+        vst1q_u32(dst + 8, pixels);
+        vst1q_u32(dst + 12, pixels);
+    }
+    for (; count >= 4; count -= 4, dst += 4) vst1q_u32(dst, pixels);
+#endif
+    while (count-- > 0) *dst++ = pixel;
+}
+
+static void fillPixelRect(uint32_t *dataAddr, int x, int y, int width, int height, uint32_t pixel, int stride) {
+    if (width <= 0) return;
+    uint32_t *dst = dataAddr + x + y * stride;
+    for (int i = 0; i < height; i++, dst += stride) fillPixels(dst, pixel, width);
+}
+
 static int8_t getBit(uint8_t *line, int x) {
     uint8_t mask = (1 << (x & 7));
     line += (x >> 3);
@@ -72,20 +105,134 @@ static int setPixelOp(int srcColor, int dstColor, enum GCFunction gcFunction) {
     }
 }
 
+typedef void (*RasterOp)(uint32_t *dst, const uint32_t *src, int count);
+
+/* Raster ops only touch the RGB bytes, the alpha byte of dst is kept */
+#ifdef __ARM_NEON
+#define DEFINE_RASTER_OP(name, scalarOp, vectorOp) \
+static void name(uint32_t *dst, const uint32_t *src, int count) { \
+    const uint32x4_t mask = vdupq_n_u32(RGB_MASK); \
+    for (; count >= 4; count -= 4, dst += 4, src += 4) { \
+        uint32x4_t s = vld1q_u32(src), d = vld1q_u32(dst); \
+        (void)s; \
+        vst1q_u32(dst, vbslq_u32(mask, vectorOp, d)); \
+    } \
+    for (; count > 0; count--, dst++, src++) { \
+        uint32_t s = *src, d = *dst; \
+        (void)s; \
+        *dst = (d & ~RGB_MASK) | ((scalarOp) & RGB_MASK); \
+    } \
+}
+#else
+#define DEFINE_RASTER_OP(name, scalarOp, vectorOp) \
+static void name(uint32_t *dst, const uint32_t *src, int count) { \
+    for (; count > 0; count--, dst++, src++) { \
+        uint32_t s = *src, d = *dst; \
+        (void)s; \
+        *dst = (d & ~RGB_MASK) | ((scalarOp) & RGB_MASK); \
+    } \
+}
+#endif
+
+DEFINE_RASTER_OP(rasterOpCopy, s, s)
+DEFINE_RASTER_OP(rasterOpXor, s ^ d, veorq_u32(s, d))
+DEFINE_RASTER_OP(rasterOpAnd, s & d, vandq_u32(s, d))
+DEFINE_RASTER_OP(rasterOpOr, s | d, vorrq_u32(s, d))
+DEFINE_RASTER_OP(rasterOpInvert, ~d, vmvnq_u32(d))
+
+static RasterOp getRasterOp(enum GCFunction gcFunction) {
+    switch (gcFunction) {
+        case GCF_COPY :
+            return rasterOpCopy;
+        case GCF_XOR :
+            return rasterOpXor;
+        case GCF_AND :
+            return rasterOpAnd;
+        case GCF_OR :
+            return rasterOpOr;
+        case GCF_INVERT :
+            return rasterOpInvert;
+        default:
+            return NULL;
+    }
+}
+
+static void rasterOpRow(RasterOp rasterOp, enum GCFunction gcFunction, uint32_t *dst, const uint32_t *src, int count) {
+    if (rasterOp) {
+        rasterOp(dst, src, count);
+        return;
+    }
+
+    for (; count > 0; count--, dst++, src++) {
+        uint32_t dstColor = *dst;
+        *dst = (dstColor & ~RGB_MASK) | (setPixelOp(*src, dstColor, gcFunction) & RGB_MASK);
+    }
+}
+
+/* Expands count bits of an LSB first bitmap line, starting at bit x, a source byte at a time */
+static void expandBitmapLine(uint32_t *dst, const uint8_t *line, int x, int count, uint32_t fg, uint32_t bg) {
+    for (; count > 0 && (x & 7); count--, x++) *dst++ = getBit((uint8_t*)line, x) ? fg : bg;
+    line += x >> 3;
+
+#ifdef __ARM_NEON
+    static const uint32_t lowBits[4] = {1, 2, 4, 8};
+    static const uint32_t highBits[4] = {16, 32, 64, 128};
+    uint32x4_t lowMask = vld1q_u32(lowBits), highMask = vld1q_u32(highBits);
+    uint32x4_t fgPixels = vdupq_n_u32(fg), bgPixels = vdupq_n_u32(bg);
+    for (; count >= 8; count -= 8, dst += 8) {
+        uint32x4_t bits = vdupq_n_u32(*line++);
+        vst1q_u32(dst + 0, vbslq_u32(vtstq_u32(bits, lowMask), fgPixels, bgPixels));
+        vst1q_u32(dst + 4, vbslq_u32(vtstq_u32(bits, highMask), fgPixels, bgPixels));
+    }
+#else
+    for (; count >= 8; count -= 8, dst += 8) {
+        uint8_t bits = *line++;
+        dst[0] = (bits & 0x01) ? fg : bg;
+        dst[1] = (bits & 0x02) ? fg : bg;
+        dst[2] = (bits & 0x04) ? fg : bg;
+        dst[3] = (bits & 0x08) ? fg : bg;
+        dst[4] = (bits & 0x10) ? fg : bg;
+        dst[5] = (bits & 0x20) ? fg : bg;
+        dst[6] = (bits & 0x40) ? fg : bg;
+        dst[7] = (bits & 0x80) ? fg : bg;
+    }
+#endif
+
+    for (x = 0; x < count; x++) *dst++ = getBit((uint8_t*)line, x) ? fg : bg;
+}
+
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Drawable_drawBitmap(JNIEnv *env, jclass obj,
                                               jshort width, jshort height, jobject srcData,
                                               jobject dstData) {
     uint8_t *srcDataAddr = (*env)->GetDirectBufferAddress(env, srcData);
-    int *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+    uint32_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
 
     int stride = getBitmapBytePad(width);
-    for (int16_t y = 0, x; y < height; y++) {
-        for (x = 0; x < width; x++) *dstDataAddr++ = getBit(srcDataAddr, x) ? WHITE : BLACK;
+    for (int16_t y = 0; y < height; y++) {
+        expandBitmapLine(dstDataAddr, srcDataAddr, 0, width, WHITE, BLACK);
+        dstDataAddr += width;
         srcDataAddr += stride;
     }
 }
 
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_Drawable_drawBitmapColored(JNIEnv *env, jclass obj,
+                                                     jshort srcX, jshort srcY, jshort dstX,
+                                                     jshort dstY, jshort width, jshort height,
+                                                     jshort srcWidth, jint foreground, jint background,
+                                                     jshort stride, jobject srcData, jobject dstData) {
+    uint8_t *srcDataAddr = (*env)->GetDirectBufferAddress(env, srcData);
+    uint32_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+
+    int srcStride = getBitmapBytePad(srcWidth);
+    const uint8_t *src = srcDataAddr + srcY * srcStride;
+    uint32_t *dst = dstDataAddr + dstX + dstY * stride;
+    for (int16_t y = 0; y < height; y++, src += srcStride, dst += stride) {
+        expandBitmapLine(dst, src, srcX, width, foreground, background);
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Drawable_copyArea(JNIEnv *env, jclass obj, jshort srcX,
                                             jshort srcY, jshort dstX, jshort dstY,
@@ -97,10 +244,26 @@ Java_com_steamdeck_mobile_core_xserver_Drawable_copyArea(JNIEnv *env, jclass obj
     jlong srcLength = (*env)->GetDirectBufferCapacity(env, srcData);
     jlong dstLength = (*env)->GetDirectBufferCapacity(env, dstData);
 
-    if (srcX != 0 || srcY != 0 || dstX != 0 || dstY != 0 || srcLength != dstLength) {
+    if (srcX == 0 && dstX == 0 && width == srcStride && width == dstStride) {
+        /* whole rows are contiguous, e.g. a full-width MIT-SHM PutImage from a page rounded segment */
+        memmove(dstDataAddr + dstY * dstStride * 4, srcDataAddr + srcY * srcStride * 4, width * height * 4);
+    }
+    else if (srcX != 0 || srcY != 0 || dstX != 0 || dstY != 0 || srcLength != dstLength) {
         int copyAmount = width * 4;
-        for (int16_t y = 0; y < height; y++) {
-            memcpy(dstDataAddr + (dstX + (y + dstY) * dstStride) * 4, srcDataAddr + (srcX + (y + srcY) * srcStride) * 4, copyAmount);
+        if (srcDataAddr == dstDataAddr && dstY > srcY) {
+            for (int16_t y = height - 1; y >= 0; y--) {
+                memmove(dstDataAddr + (dstX + (y + dstY) * dstStride) * 4, srcDataAddr + (srcX + (y + srcY) * srcStride) * 4, copyAmount);
+            }
+        }
+        else if (srcDataAddr == dstDataAddr) {
+            for (int16_t y = 0; y < height; y++) {
+                memmove(dstDataAddr + (dstX + (y + dstY) * dstStride) * 4, srcDataAddr + (srcX + (y + srcY) * srcStride) * 4, copyAmount);
+            }
+        }
+        else {
+            for (int16_t y = 0; y < height; y++) {
+                memcpy(dstDataAddr + (dstX + (y + dstY) * dstStride) * 4, srcDataAddr + (srcX + (y + srcY) * srcStride) * 4, copyAmount);
+            }
         }
     }
     else memcpy(dstDataAddr, srcDataAddr, dstLength);
@@ -112,22 +275,39 @@ Java_com_steamdeck_mobile_core_xserver_Drawable_copyAreaOp(JNIEnv *env, jclass o
                                               jshort width, jshort height, jshort srcStride,
                                               jshort dstStride, jobject srcData,
                                               jobject dstData, int gcFunction) {
-    uint8_t *srcDataAddr = (*env)->GetDirectBufferAddress(env, srcData);
-    uint8_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+    uint32_t *srcDataAddr = (*env)->GetDirectBufferAddress(env, srcData);
+    uint32_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+    if (width <= 0 || height <= 0) return;
 
-    for (int16_t y = 0; y < height; y++) {
-        for (int16_t x = 0; x < width; x++) {
-            int i = (x + srcX + (y + srcY) * srcStride) * 4;
-            int j = (x + dstX + (y + dstY) * dstStride) * 4;
-            int srcColor = (srcDataAddr[i+0] << 16) | (srcDataAddr[i+1] << 8) | srcDataAddr[i+2];
-            int dstColor = (dstDataAddr[j+0] << 16) | (dstDataAddr[j+1] << 8) | dstDataAddr[j+2];
+    RasterOp rasterOp = getRasterOp(gcFunction);
+    uint32_t *src = srcDataAddr + srcX + srcY * srcStride;
+    uint32_t *dst = dstDataAddr + dstX + dstY * dstStride;
+
+    if (srcDataAddr != dstDataAddr) {
+        for (int16_t y = 0; y < height; y++, src += srcStride, dst += dstStride) {
+            rasterOpRow(rasterOp, gcFunction, dst, src, width);
+        }
+        return;
+    }
 
-            dstColor = setPixelOp(srcColor, dstColor, gcFunction);
+    /* Same drawable: like memmove, walk away from the overlap and read each
+     * chunk of the source before any of it can be overwritten. */
+    uint32_t tmp[RASTER_OP_CHUNK];
+    bool backward = dst > src;
+    if (backward) {
+        src += (height - 1) * srcStride;
+        dst += (height - 1) * dstStride;
+    }
 
-            dstDataAddr[j+0] = (dstColor >> 16) & 0xff;
-            dstDataAddr[j+1] = (dstColor >> 8) & 0xff;
-            dstDataAddr[j+2] = dstColor & 0xff;
+    for (int16_t y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += RASTER_OP_CHUNK) {
+            int count = width - x < RASTER_OP_CHUNK ? width - x : RASTER_OP_CHUNK;
+            int offset = backward ? width - x - count : x;
+            memcpy(tmp, src + offset, count * 4);
+            rasterOpRow(rasterOp, gcFunction, dst + offset, tmp, count);
         }
+        src += backward ? -srcStride : srcStride;
+        dst += backward ? -dstStride : dstStride;
     }
 }
 
@@ -135,44 +315,40 @@ JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Drawable_fillRect(JNIEnv *env, jclass obj, jshort x, jshort y,
                                             jshort width, jshort height, jint color, jshort stride,
                                             jobject data) {
-    uint8_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
-
-    uint8_t rgba[4];
-    unpackColor(color, rgba);
-
-    int rowSize = width * 4;
-    uint8_t *row = malloc(rowSize);
+    uint32_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
+    fillPixelRect(dataAddr, x, y, width, height, toPixel(color), stride);
+}
 
-    for (int i = 0; i < rowSize; i += 4) memcpy(row + i, rgba, 4);
-    for (int16_t i = 0; i < height; i++) {
-        memcpy(dataAddr + (x + (i + y) * stride) * 4, row, rowSize);
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_Drawable_fillRects(JNIEnv *env, jclass obj, jshortArray rects,
+                                             jint numRects, jint color, jshort stride,
+                                             jobject data) {
+    uint32_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
+    uint32_t pixel = toPixel(color);
+
+    jshort *rectsAddr = (*env)->GetPrimitiveArrayCritical(env, rects, NULL);
+    for (int i = 0; i < numRects; i++) {
+        jshort *rect = rectsAddr + i * 4;
+        fillPixelRect(dataAddr, rect[0], rect[1], rect[2], rect[3], pixel, stride);
     }
-
-    free(row);
+    (*env)->ReleasePrimitiveArrayCritical(env, rects, rectsAddr, JNI_ABORT);
 }
 
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Drawable_drawLine(JNIEnv *env, jclass obj, jshort x0, jshort y0,
                                             jshort x1, jshort y1, jint color, jshort lineWidth,
                                             jshort stride, jobject data) {
-    uint8_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
+    uint32_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
     int dx =  abs(x1-x0);
     int dy = -abs(y1-y0);
     int8_t sx = x0 < x1 ? 1 : -1;
     int8_t sy = y0 < y1 ? 1 : -1;
     int e1 = dx + dy, e2;
 
-    uint8_t rgba[4];
-    unpackColor(color, rgba);
-
-    int rowSize = lineWidth * 4;
-    uint8_t *row = malloc(lineWidth * 4);
-
-    int16_t i;
-    for (i = 0; i < rowSize; i += 4) memcpy(row + i, rgba, 4);
+    uint32_t pixel = toPixel(color);
 
     while (true) {
-        for (i = 0; i < lineWidth; i++) memcpy(dataAddr + (x0 + (i + y0) * stride) * 4, row, rowSize);
+        fillPixelRect(dataAddr, x0, y0, lineWidth, lineWidth, pixel, stride);
         if (x0 == x1 && y0 == y1) break;
 
         e2 = e1 * 2;
@@ -185,8 +361,6 @@ Java_com_steamdeck_mobile_core_xserver_Drawable_drawLine(JNIEnv *env, jclass obj
             y0 += sy;
         }
     }
-
-    free(row);
 }
 
 JNIEXPORT void JNICALL
@@ -209,42 +383,221 @@ Java_com_steamdeck_mobile_core_xserver_Drawable_drawAlphaMaskedBitmap(JNIEnv *en
     }
 }
 
+/* Render extension operators, numbered as in the protocol. Pixels are
+ * premultiplied ARGB, masks are 8 bit coverage. */
+enum CompositeOp {COMPOSITE_OP_SRC = 1, COMPOSITE_OP_OVER = 3, COMPOSITE_OP_ADD = 12};
+#define COMPOSITE_SRC_OPAQUE 1
+#define COMPOSITE_DST_OPAQUE 2
+
+/* a * b / 255, rounded */
+static uint8_t mulUn8(uint8_t a, uint8_t b) {
+    uint16_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static uint8_t addUn8(uint8_t a, uint8_t b) {
+    uint16_t t = a + b;
+    return t > 255 ? 255 : t;
+}
+
+#ifdef __ARM_NEON
+static uint8x8_t mulUn8x8(uint8x8_t a, uint8x8_t b) {
+    uint16x8_t t = vmull_u8(a, b);
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+#endif
+
+/* Composites count pixels of src (the solid pixel when NULL) through the
+ * optional mask, whose coverage bytes are maskStep apart */
+static void compositeRow(enum CompositeOp op, int flags, uint32_t *dst, const uint32_t *src, uint32_t solid,
+                         const uint8_t *mask, int maskStep, int count) {
+    if (op == COMPOSITE_OP_SRC && !src && !mask) {
+        fillPixels(dst, (flags & COMPOSITE_DST_OPAQUE) ? solid | 0xff000000 : solid, count);
+        return;
+    }
+
+#ifdef __ARM_NEON
+    uint8x8x4_t solidPixels;
+    for (int c = 0; c < 4; c++) solidPixels.val[c] = vdup_n_u8((solid >> (c * 8)) & 255);
+
+    for (; count >= 8; count -= 8, dst += 8) {
+        uint8x8x4_t s = solidPixels;
+        if (src) {
+            s = vld4_u8((const uint8_t*)src);
+            src += 8;
+        }
+        if (flags & COMPOSITE_SRC_OPAQUE) s.val[3] = vdup_n_u8(255);
+
+        if (mask) {
+            uint8x8_t m = maskStep == 1 ? vld1_u8(mask) : vld4_u8(mask - 3).val[3];
+            mask += maskStep * 8;
+            for (int c = 0; c < 4; c++) s.val[c] = mulUn8x8(s.val[c], m);
+        }
+
+        if (op != COMPOSITE_OP_SRC) {
+            uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+            uint8x8_t ia = vmvn_u8(s.val[3]);
+            for (int c = 0; c < 4; c++) {
+                s.val[c] = vqadd_u8(s.val[c], op == COMPOSITE_OP_OVER ? mulUn8x8(d.val[c], ia) : d.val[c]);
+            }
+        }
+
+        if (flags & COMPOSITE_DST_OPAQUE) s.val[3] = vdup_n_u8(255);
+        vst4_u8((uint8_t*)dst, s);
+    }
+#endif
+
+    for (; count > 0; count--, dst++) {
+        uint8_t s[4], d[4];
+        uint32_t pixel = src ? *src++ : solid;
+        memcpy(s, &pixel, 4);
+        memcpy(d, dst, 4);
+        if (flags & COMPOSITE_SRC_OPAQUE) s[3] = 255;
+
+        if (mask) {
+            uint8_t m = *mask;
+            mask += maskStep;
+            for (int c = 0; c < 4; c++) s[c] = mulUn8(s[c], m);
+        }
+
+        if (op != COMPOSITE_OP_SRC) {
+            uint8_t ia = 255 - s[3];
+            for (int c = 0; c < 4; c++) s[c] = addUn8(s[c], op == COMPOSITE_OP_OVER ? mulUn8(d[c], ia) : d[c]);
+        }
+
+        if (flags & COMPOSITE_DST_OPAQUE) s[3] = 255;
+        memcpy(dst, s, 4);
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_Drawable_composite(JNIEnv *env, jclass obj, jbyte op, jint flags,
+                                             jshort srcX, jshort srcY, jshort maskX, jshort maskY,
+                                             jshort dstX, jshort dstY, jshort width, jshort height,
+                                             jshort srcStride, jshort maskStride, jshort dstStride,
+                                             jobject srcData, jint srcColor, jobject maskData,
+                                             jobject dstData) {
+    uint32_t *srcDataAddr = srcData ? (*env)->GetDirectBufferAddress(env, srcData) : NULL;
+    uint8_t *maskDataAddr = maskData ? (*env)->GetDirectBufferAddress(env, maskData) : NULL;
+    uint32_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+    if (width <= 0 || height <= 0) return;
+
+    const uint32_t *src = srcDataAddr ? srcDataAddr + srcX + srcY * srcStride : NULL;
+    /* the mask coverage is the alpha byte of its pixels */
+    const uint8_t *mask = maskDataAddr ? maskDataAddr + (maskX + maskY * maskStride) * 4 + 3 : NULL;
+    uint32_t *dst = dstDataAddr + dstX + dstY * dstStride;
+
+    for (int16_t y = 0; y < height; y++, dst += dstStride) {
+        compositeRow(op, flags, dst, src, srcColor, mask, 4, width);
+        if (src) src += srcStride;
+        if (mask) mask += maskStride * 4;
+    }
+}
+
+/* Composites a batch of glyphs from an a8 atlas with a solid source,
+ * glyphRects holds dst x, y, width, height and atlas x, y of each glyph */
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_Drawable_compositeGlyphs(JNIEnv *env, jclass obj, jbyte op, jint flags,
+                                                   jint srcColor, jobject atlasData, jshort atlasStride,
+                                                   jshortArray glyphRects, jint numGlyphs, jshort dstWidth,
+                                                   jshort dstHeight, jshort dstStride, jobject dstData) {
+    const uint8_t *atlasDataAddr = (*env)->GetDirectBufferAddress(env, atlasData);
+    uint32_t *dstDataAddr = (*env)->GetDirectBufferAddress(env, dstData);
+
+    jshort *rectsAddr = (*env)->GetPrimitiveArrayCritical(env, glyphRects, NULL);
+    for (int i = 0; i < numGlyphs; i++) {
+        const jshort *rect = rectsAddr + i * 6;
+
+        /* clip the glyph to the drawable */
+        int x0 = rect[0] > 0 ? rect[0] : 0, y0 = rect[1] > 0 ? rect[1] : 0;
+        int x1 = rect[0] + rect[2] < dstWidth ? rect[0] + rect[2] : dstWidth;
+        int y1 = rect[1] + rect[3] < dstHeight ? rect[1] + rect[3] : dstHeight;
+        if (x0 >= x1 || y0 >= y1) continue;
+
+        const uint8_t *mask = atlasDataAddr + (rect[4] + x0 - rect[0]) + (rect[5] + y0 - rect[1]) * atlasStride;
+        uint32_t *dst = dstDataAddr + x0 + y0 * dstStride;
+        for (int y = y0; y < y1; y++, dst += dstStride, mask += atlasStride) {
+            compositeRow(op, flags, dst, NULL, srcColor, mask, 1, x1 - x0);
+        }
+    }
+    (*env)->ReleasePrimitiveArrayCritical(env, glyphRects, rectsAddr, JNI_ABORT);
+}
+
+static void swizzleToRGBA(uint8_t *dst, const uint8_t *color, const uint8_t *mask, int count) {
+#ifdef __ARM_NEON
+    for (; count >= 16; count -= 16, dst += 64, color += 64) {
+        uint8x16x4_t src = vld4q_u8(color);
+        uint8x16x4_t rgba;
+        rgba.val[0] = src.val[2];
+        rgba.val[1] = src.val[1];
+        rgba.val[2] = src.val[0];
+        if (mask) {
+            rgba.val[3] = vld4q_u8(mask).val[0];
+            mask += 64;
+        }
+        else rgba.val[3] = src.val[3];
+        vst4q_u8(dst, rgba);
+    }
+#endif
+    for (; count > 0; count--, dst += 4, color += 4) {
+        dst[0] = color[2];
+        dst[1] = color[1];
+        dst[2] = color[0];
+        if (mask) {
+            dst[3] = mask[0];
+            mask += 4;
+        }
+        else dst[3] = color[3];
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Drawable_fromBitmap(JNIEnv *env, jclass obj, jobject bitmap,
                                               jobject data) {
-    char *dataAddr = (*env)->GetDirectBufferAddress(env, data);
+    uint8_t *dataAddr = (*env)->GetDirectBufferAddress(env, data);
 
     AndroidBitmapInfo info;
     uint8_t *pixels;
 
     AndroidBitmap_getInfo(env, bitmap, &info);
-    AndroidBitmap_lockPixels(env, bitmap, (void**)&pixels);
+    if (AndroidBitmap_lockPixels(env, bitmap, (void**)&pixels) != ANDROID_BITMAP_RESULT_SUCCESS) return;
 
-    for (int i = 0, size = info.width * info.height * 4; i < size; i++) {
-        memcpy(dataAddr + i, pixels + i, 4);
+    int rowSize = info.width * 4;
+    if (info.stride == rowSize) {
+        memcpy(dataAddr, pixels, rowSize * info.height);
+    }
+    else {
+        for (uint32_t y = 0; y < info.height; y++) memcpy(dataAddr + y * rowSize, pixels + y * info.stride, rowSize);
     }
 
     AndroidBitmap_unlockPixels(env, bitmap);
 }
 
+JNIEXPORT jobject JNICALL
+Java_com_steamdeck_mobile_core_xserver_Drawable_lockBitmapPixels(JNIEnv *env, jclass obj, jobject bitmap) {
+    AndroidBitmapInfo info;
+    void *pixels;
+
+    AndroidBitmap_getInfo(env, bitmap, &info);
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 || info.stride != info.width * 4) return NULL;
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) return NULL;
+
+    return (*env)->NewDirectByteBuffer(env, pixels, (jlong)info.stride * info.height);
+}
+
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_core_xserver_Pixmap_toBitmap(JNIEnv *env, jclass obj, jobject colorData,
                                           jobject maskData, jobject bitmap) {
-    char *colorDataAddr = (*env)->GetDirectBufferAddress(env, colorData);
-    char *maskDataAddr = maskData ? (*env)->GetDirectBufferAddress(env, maskData) : NULL;
+    uint8_t *colorDataAddr = (*env)->GetDirectBufferAddress(env, colorData);
+    uint8_t *maskDataAddr = maskData ? (*env)->GetDirectBufferAddress(env, maskData) : NULL;
 
     AndroidBitmapInfo info;
     uint8_t *pixels;
 
     AndroidBitmap_getInfo(env, bitmap, &info);
-    AndroidBitmap_lockPixels(env, bitmap, (void**)&pixels);
+    if (AndroidBitmap_lockPixels(env, bitmap, (void**)&pixels) != ANDROID_BITMAP_RESULT_SUCCESS) return;
 
-    for (int i = 0, size = info.width * info.height * 4; i < size; i += 4) {
-        pixels[i+2] = colorDataAddr[i+0];
-        pixels[i+1] = colorDataAddr[i+1];
-        pixels[i+0] = colorDataAddr[i+2];
-        pixels[i+3] = maskDataAddr ? maskDataAddr[i+0] : colorDataAddr[i+3];
-    }
+    swizzleToRGBA(pixels, colorDataAddr, maskDataAddr, info.width * info.height);
 
     AndroidBitmap_unlockPixels(env, bitmap);
-}
\ No newline at end of file
+}
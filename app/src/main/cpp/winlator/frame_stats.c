@@ -0,0 +1,150 @@
+#include <jni.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Frame pacing of the last presented frames: when each was presented, the CPU
+// time virgl spent decoding its commands and how long after the present the
+// GPU finished it. virgl presents feed the ring; while no virgl client is
+// presenting, the compositor's own presents do (llvmpipe, CPU drawn windows).
+enum FrameSource {
+    FRAME_SOURCE_VIRGL = 0,
+    FRAME_SOURCE_COMPOSITOR = 1
+};
+
+#define FRAME_SAMPLES 256
+// Compositor presents only count once virgl has been quiet for this long
+#define VIRGL_ACTIVE_NANOS 1000000000LL
+
+typedef struct FrameSample {
+    uint32_t sequence;
+    int64_t present;
+    int64_t interval;
+    int64_t cpu;
+    int64_t gpu;
+} FrameSample;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static FrameSample samples[FRAME_SAMPLES];
+static int sampleCount = 0;
+static uint32_t sequence = 0;
+static int64_t lastVirglNanos = 0;
+
+static int64_t getTimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Exported for libvirglrenderer, which looks it up with dlsym. Returns the
+// frame's sequence number for FrameStats_gpuDone(), 0 when it was dropped.
+uint32_t FrameStats_present(int source, int64_t cpuNanos) {
+    int64_t now = getTimeNanos();
+    uint32_t result = 0;
+    pthread_mutex_lock(&mutex);
+
+    if (source == FRAME_SOURCE_VIRGL) lastVirglNanos = now;
+    if (source == FRAME_SOURCE_VIRGL || now - lastVirglNanos >= VIRGL_ACTIVE_NANOS) {
+        // 0 is reserved for "no frame"
+        if (++sequence == 0) sequence = 1;
+
+        FrameSample* previous = sampleCount ? &samples[(sequence - 1) % FRAME_SAMPLES] : NULL;
+        FrameSample* sample = &samples[sequence % FRAME_SAMPLES];
+        sample->sequence = sequence;
+        sample->present = now;
+        sample->interval = previous ? now - previous->present : 0;
+        sample->cpu = cpuNanos;
+        sample->gpu = -1;
+        if (sampleCount < FRAME_SAMPLES) sampleCount++;
+        result = sequence;
+    }
+
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+// Exported for libvirglrenderer: the fence following frame sequenceNumber signaled
+void FrameStats_gpuDone(uint32_t sequenceNumber) {
+    int64_t now = getTimeNanos();
+    pthread_mutex_lock(&mutex);
+
+    FrameSample* sample = &samples[sequenceNumber % FRAME_SAMPLES];
+    if (sequenceNumber && sample->sequence == sequenceNumber) sample->gpu = now - sample->present;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_FrameStats_markPresent(JNIEnv *env, jclass obj) {
+    FrameStats_present(FRAME_SOURCE_COMPOSITOR, -1);
+}
+
+static jbyte toByte(int64_t nanos, int64_t scaleNanos) {
+    if (nanos <= 0) return 0;
+    int64_t value = nanos * 255 / scaleNanos;
+    return (jbyte)(value < 255 ? value : 255);
+}
+
+// Fills one RGBA texel per frame, oldest first: frame interval, CPU decode time
+// and GPU completion time, each scaled so that 255 is scaleMicros. Frames that
+// were not presented yet stay zero.
+JNIEXPORT jint JNICALL
+Java_com_steamdeck_mobile_core_xserver_FrameStats_fillGraph(JNIEnv *env, jclass obj, jobject buffer, jint frames, jint scaleMicros) {
+    jbyte* texels = (*env)->GetDirectBufferAddress(env, buffer);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer);
+    if (!texels || frames <= 0 || scaleMicros <= 0) return 0;
+    if (frames > FRAME_SAMPLES) frames = FRAME_SAMPLES;
+    if (frames * 4 > capacity) frames = capacity / 4;
+
+    int64_t scaleNanos = scaleMicros * 1000LL;
+    memset(texels, 0, frames * 4);
+
+    pthread_mutex_lock(&mutex);
+    int count = sampleCount < frames ? sampleCount : frames;
+    for (int i = 0; i < count; i++) {
+        const FrameSample* sample = &samples[(sequence - count + 1 + i) % FRAME_SAMPLES];
+        jbyte* texel = &texels[(frames - count + i) * 4];
+        texel[0] = toByte(sample->interval, scaleNanos);
+        texel[1] = toByte(sample->cpu, scaleNanos);
+        texel[2] = toByte(sample->gpu, scaleNanos);
+        texel[3] = (jbyte)255;
+    }
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_FrameStats_getAverages(JNIEnv *env, jclass obj, jlongArray averages) {
+    int64_t sums[4] = {0};
+    int counts[4] = {0};
+
+    pthread_mutex_lock(&mutex);
+    for (int i = 0; i < sampleCount; i++) {
+        const FrameSample* sample = &samples[i];
+        const int64_t values[3] = {sample->interval, sample->cpu, sample->gpu};
+        for (int j = 0; j < 3; j++) {
+            if (values[j] <= 0) continue;
+            sums[j] += values[j];
+            counts[j]++;
+        }
+        // worst frame interval
+        if (sample->interval > sums[3]) sums[3] = sample->interval;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    jlong result[4];
+    for (int j = 0; j < 3; j++) result[j] = counts[j] ? sums[j] / counts[j] / 1000 : -1;
+    result[3] = sampleCount > 1 ? sums[3] / 1000 : -1;
+
+    jsize length = (*env)->GetArrayLength(env, averages);
+    (*env)->SetLongArrayRegion(env, averages, 0, length < 4 ? length : 4, result);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_FrameStats_reset(JNIEnv *env, jclass obj) {
+    pthread_mutex_lock(&mutex);
+    sampleCount = 0;
+    memset(samples, 0, sizeof(samples));
+    pthread_mutex_unlock(&mutex);
+}
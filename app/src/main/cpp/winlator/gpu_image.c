@@ -12,9 +12,13 @@
 #include <jni.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/mman.h>
 
 #include "native_handle.h"
+#include "jni_cache.h"
 
 #define HAL_PIXEL_FORMAT_BGRA_8888 5
 #define println(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__);
@@ -59,18 +63,14 @@ Java_com_steamdeck_mobile_presentation_renderer_GPUImage_createHardwareBuffer(JN
                                                          jshort height, jboolean cpuAccess) {
     AHardwareBuffer* hardwareBuffer = createHardwareBuffer(width, height, cpuAccess);
     if (hardwareBuffer) {
-        jclass cls = (*env)->GetObjectClass(env, obj);
-
         AHardwareBuffer_Desc buffDesc;
         AHardwareBuffer_describe(hardwareBuffer, &buffDesc);
 
-        jmethodID setStride = (*env)->GetMethodID(env, cls, "setStride", "(S)V");
-        (*env)->CallVoidMethod(env, obj, setStride, (jshort)buffDesc.stride);
+        (*env)->CallVoidMethod(env, obj, jniCache.setStride, (jshort)buffDesc.stride);
 
         const native_handle_t* nativeHandle = AHardwareBuffer_getNativeHandle(hardwareBuffer);
         if (nativeHandle->numFds > 0) {
-            jmethodID setNativeHandle = (*env)->GetMethodID(env, cls, "setNativeHandle", "(I)V");
-            (*env)->CallVoidMethod(env, obj, setNativeHandle, nativeHandle->data[0]);
+            (*env)->CallVoidMethod(env, obj, jniCache.setNativeHandle, nativeHandle->data[0]);
         }
     }
     return (jlong)hardwareBuffer;
@@ -82,6 +82,13 @@ Java_com_steamdeck_mobile_presentation_renderer_GPUImage_createImageKHR(JNIEnv *
     return (jlong)createImageKHR((AHardwareBuffer*)hardwareBufferPtr, textureId);
 }
 
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_presentation_renderer_GPUImage_acquireHardwareBuffer(JNIEnv *env, jobject obj,
+                                                          jlong hardwareBufferPtr) {
+    AHardwareBuffer* hardwareBuffer = (AHardwareBuffer*)hardwareBufferPtr;
+    if (hardwareBuffer) AHardwareBuffer_acquire(hardwareBuffer);
+}
+
 JNIEXPORT void JNICALL
 Java_com_steamdeck_mobile_presentation_renderer_GPUImage_destroyHardwareBuffer(JNIEnv *env, jobject obj,
                                                           jlong hardwareBufferPtr, jboolean locked) {
@@ -116,4 +123,30 @@ Java_com_steamdeck_mobile_presentation_renderer_GPUImage_destroyImageKHR(JNIEnv
         EGLDisplay eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
         eglDestroyImageKHR(eglDisplay, imageKHR);
     }
+}
+
+JNIEXPORT jint JNICALL
+Java_com_steamdeck_mobile_presentation_renderer_GPUImage_createReleaseFence(JNIEnv *env, jclass obj) {
+    static const EGLint attribList[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID, EGL_NONE};
+
+    EGLDisplay eglDisplay = eglGetCurrentDisplay();
+    if (eglDisplay == EGL_NO_DISPLAY) return -1;
+
+    EGLSyncKHR sync = eglCreateSyncKHR(eglDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, attribList);
+    if (sync == EGL_NO_SYNC_KHR) return -1;
+
+    /* the fence fd only exists once the commands it follows are flushed */
+    glFlush();
+    int fenceFd = eglDupNativeFenceFDANDROID(eglDisplay, sync);
+    eglDestroySyncKHR(eglDisplay, sync);
+    return fenceFd;
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_presentation_renderer_GPUImage_waitFence(JNIEnv *env, jclass obj, jint fenceFd) {
+    if (fenceFd < 0) return;
+
+    struct pollfd pfd = {.fd = fenceFd, .events = POLLIN};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR);
+    close(fenceFd);
 }
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include <jni.h>
+#include <stddef.h>
+#include <android/log.h>
+
+#include "jni_cache.h"
+
+struct JNICache jniCache;
+
+static jmethodID getMethodID(JNIEnv *env, const char *className, const char *name, const char *signature) {
+    jclass cls = (*env)->FindClass(env, className);
+    if (!cls) {
+        (*env)->ExceptionClear(env);
+        __android_log_print(ANDROID_LOG_ERROR, "JNICache", "class not found: %s", className);
+        return NULL;
+    }
+
+    jmethodID method = (*env)->GetMethodID(env, cls, name, signature);
+    if (!method) {
+        (*env)->ExceptionClear(env);
+        __android_log_print(ANDROID_LOG_ERROR, "JNICache", "method not found: %s.%s", className, name);
+    }
+    (*env)->DeleteLocalRef(env, cls);
+    return method;
+}
+
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+    JNIEnv *env;
+    if ((*vm)->GetEnv(vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) return JNI_ERR;
+
+    jniCache.handleNewConnection = getMethodID(env, "com/steamdeck/mobile/core/xconnector/XConnectorEpoll", "handleNewConnection", "(I)V");
+    jniCache.handleExistingConnection = getMethodID(env, "com/steamdeck/mobile/core/xconnector/XConnectorEpoll", "handleExistingConnection", "(I)V");
+    jniCache.addAncillaryFd = getMethodID(env, "com/steamdeck/mobile/core/xconnector/ClientSocket", "addAncillaryFd", "(I)V");
+    jniCache.setStride = getMethodID(env, "com/steamdeck/mobile/presentation/renderer/GPUImage", "setStride", "(S)V");
+    jniCache.setNativeHandle = getMethodID(env, "com/steamdeck/mobile/presentation/renderer/GPUImage", "setNativeHandle", "(I)V");
+
+    return JNI_VERSION_1_6;
+}
@@ -0,0 +1,18 @@
+#ifndef WINLATOR_JNI_CACHE_H
+#define WINLATOR_JNI_CACHE_H
+
+#include <jni.h>
+
+/* Method IDs of the Java classes libwinlator calls back into, resolved
+ * once in JNI_OnLoad so no bridge looks them up by name per call. */
+struct JNICache {
+    jmethodID handleNewConnection;
+    jmethodID handleExistingConnection;
+    jmethodID addAncillaryFd;
+    jmethodID setStride;
+    jmethodID setNativeHandle;
+};
+
+extern struct JNICache jniCache;
+
+#endif
@@ -0,0 +1,135 @@
+#include <jni.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Input-to-photon latency, correlated per presented frame. The first input
+// after a present opens a frame; the first X dispatch and virgl flush after it
+// are recorded relative to it and the next present closes it.
+enum LatencyStage {
+    LATENCY_INPUT = 0,
+    LATENCY_DISPATCH = 1,
+    LATENCY_FLUSH = 2,
+    LATENCY_PRESENT = 3
+};
+
+#define LATENCY_SAMPLES 256
+#define HISTOGRAM_BUCKETS 33
+#define HISTOGRAM_BUCKET_NANOS 2000000LL
+// While virgl is flushing, a present is only the response once a flush followed the input
+#define FLUSH_ACTIVE_NANOS 1000000000LL
+
+typedef struct LatencySample {
+    int64_t dispatch;
+    int64_t flush;
+    int64_t present;
+} LatencySample;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static LatencySample samples[LATENCY_SAMPLES];
+static int sampleCount = 0;
+static int sampleIndex = 0;
+static int64_t inputNanos = 0;
+static int64_t dispatchNanos = 0;
+static int64_t flushNanos = 0;
+static int64_t lastFlushNanos = 0;
+
+static int64_t getTimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Exported for libuinput_bridge and libvirglrenderer, which look it up with dlsym
+void LatencyStats_mark(int stage) {
+    int64_t now = getTimeNanos();
+    pthread_mutex_lock(&mutex);
+
+    switch (stage) {
+        case LATENCY_INPUT:
+            if (!inputNanos) inputNanos = now;
+            break;
+        case LATENCY_DISPATCH:
+            if (inputNanos && !dispatchNanos) dispatchNanos = now;
+            break;
+        case LATENCY_FLUSH:
+            lastFlushNanos = now;
+            if (inputNanos && !flushNanos) flushNanos = now;
+            break;
+        case LATENCY_PRESENT:
+            if (!inputNanos) break;
+            if (!flushNanos && now - lastFlushNanos < FLUSH_ACTIVE_NANOS) break;
+
+            LatencySample* sample = &samples[sampleIndex];
+            sample->dispatch = dispatchNanos ? dispatchNanos - inputNanos : -1;
+            sample->flush = flushNanos ? flushNanos - inputNanos : -1;
+            sample->present = now - inputNanos;
+            sampleIndex = (sampleIndex + 1) % LATENCY_SAMPLES;
+            if (sampleCount < LATENCY_SAMPLES) sampleCount++;
+
+            inputNanos = 0;
+            dispatchNanos = 0;
+            flushNanos = 0;
+            break;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_LatencyStats_mark(JNIEnv *env, jclass obj, jint stage) {
+    LatencyStats_mark(stage);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_steamdeck_mobile_core_xserver_LatencyStats_getHistogram(JNIEnv *env, jclass obj, jintArray buckets) {
+    jint histogram[HISTOGRAM_BUCKETS];
+    memset(histogram, 0, sizeof(histogram));
+
+    pthread_mutex_lock(&mutex);
+    int count = sampleCount;
+    for (int i = 0; i < count; i++) {
+        int64_t bucket = samples[i].present / HISTOGRAM_BUCKET_NANOS;
+        histogram[bucket < HISTOGRAM_BUCKETS - 1 ? bucket : HISTOGRAM_BUCKETS - 1]++;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    jsize length = (*env)->GetArrayLength(env, buckets);
+    (*env)->SetIntArrayRegion(env, buckets, 0, length < HISTOGRAM_BUCKETS ? length : HISTOGRAM_BUCKETS, histogram);
+    return count;
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_LatencyStats_getAverages(JNIEnv *env, jclass obj, jlongArray averages) {
+    int64_t sums[3] = {0};
+    int counts[3] = {0};
+
+    pthread_mutex_lock(&mutex);
+    for (int i = 0; i < sampleCount; i++) {
+        const int64_t values[3] = {samples[i].dispatch, samples[i].flush, samples[i].present};
+        for (int j = 0; j < 3; j++) {
+            if (values[j] < 0) continue;
+            sums[j] += values[j];
+            counts[j]++;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    jlong result[3];
+    for (int j = 0; j < 3; j++) result[j] = counts[j] ? sums[j] / counts[j] / 1000 : -1;
+
+    jsize length = (*env)->GetArrayLength(env, averages);
+    (*env)->SetLongArrayRegion(env, averages, 0, length < 3 ? length : 3, result);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_xserver_LatencyStats_reset(JNIEnv *env, jclass obj) {
+    pthread_mutex_lock(&mutex);
+    sampleCount = 0;
+    sampleIndex = 0;
+    inputNanos = 0;
+    dispatchNanos = 0;
+    flushNanos = 0;
+    pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,341 @@
+#include <jni.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Samples CPU time, RSS, major faults and context switches of every thread of
+// a process tree (proot and the Wine processes it traces) into a direct buffer.
+// The /proc files stay open between samples and are re-read with pread, so a
+// sample costs a few syscalls per thread and no allocation on the Java side.
+// The tree is rediscovered every RESCAN_SAMPLES samples, threads every sample.
+
+#define MAX_PROCESSES 256
+#define MAX_THREADS 2048
+#define RESCAN_SAMPLES 4
+#define STAT_BUFFER_SIZE 512
+#define STATUS_BUFFER_SIZE 4096
+
+// Buffer layout, in longs; mirrored by ProcessSampler.kt
+enum SamplerHeader {
+    HEADER_THREADS = 0,
+    HEADER_ELAPSED_NANOS = 1,
+    HEADER_TICKS_PER_SECOND = 2,
+    HEADER_PROCESSES = 3,
+    HEADER_RSS_BYTES = 4,
+    HEADER_CPU_DELTA_TICKS = 5,
+    HEADER_FIELDS = 6
+};
+
+enum SamplerField {
+    FIELD_PID = 0,
+    FIELD_TID = 1,
+    FIELD_CPU_TICKS = 2,
+    FIELD_CPU_DELTA_TICKS = 3,
+    FIELD_RSS_BYTES = 4,
+    FIELD_MAJOR_FAULTS = 5,
+    FIELD_VOLUNTARY_SWITCHES = 6,
+    FIELD_INVOLUNTARY_SWITCHES = 7,
+    FIELD_STATE = 8,
+    THREAD_FIELDS = 9
+};
+
+typedef struct SampledThread {
+    pid_t pid;
+    pid_t tid;
+    int statFd;
+    int statusFd;
+    int64_t lastTicks;
+    bool seen;
+} SampledThread;
+
+typedef struct SampledProcess {
+    pid_t pid;
+    int statmFd;
+    int64_t rssBytes;
+    bool seen;
+} SampledProcess;
+
+typedef struct ProcessSampler {
+    pid_t root;
+    int samples;
+    int64_t lastNanos;
+    int64_t pageSize;
+    int processCount;
+    int threadCount;
+    SampledProcess processes[MAX_PROCESSES];
+    SampledThread threads[MAX_THREADS];
+} ProcessSampler;
+
+static int64_t getTimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int openProcFile(const char* format, pid_t pid, pid_t tid) {
+    char path[64];
+    snprintf(path, sizeof(path), format, pid, tid);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static ssize_t readProcFile(int fd, char* buffer, size_t size) {
+    ssize_t length = pread(fd, buffer, size - 1, 0);
+    if (length <= 0) return -1;
+    buffer[length] = '\0';
+    return length;
+}
+
+// Skips to the numeric field `index` after the command name, counting from the
+// state as 0. The command is the only field that may contain spaces.
+static const char* statField(const char* stat, int index) {
+    const char* p = strrchr(stat, ')');
+    if (!p) return NULL;
+    p += 2;
+    while (index-- > 0) {
+        p = strchr(p, ' ');
+        if (!p) return NULL;
+        p++;
+    }
+    return p;
+}
+
+static int64_t statLong(const char* stat, int index) {
+    const char* p = statField(stat, index);
+    return p ? strtoll(p, NULL, 10) : 0;
+}
+
+static int64_t statusLong(const char* status, const char* key) {
+    const char* p = strstr(status, key);
+    return p ? strtoll(p + strlen(key), NULL, 10) : 0;
+}
+
+static pid_t readParent(pid_t pid) {
+    char buffer[STAT_BUFFER_SIZE];
+    int fd = openProcFile("/proc/%d/stat", pid, 0);
+    if (fd < 0) return -1;
+    ssize_t length = readProcFile(fd, buffer, sizeof(buffer));
+    close(fd);
+    return length > 0 ? (pid_t)statLong(buffer, 1) : -1;
+}
+
+static SampledProcess* findProcess(ProcessSampler* sampler, pid_t pid) {
+    for (int i = 0; i < sampler->processCount; i++) {
+        if (sampler->processes[i].pid == pid) return &sampler->processes[i];
+    }
+    return NULL;
+}
+
+static void addProcess(ProcessSampler* sampler, pid_t pid) {
+    SampledProcess* process = findProcess(sampler, pid);
+    if (process) {
+        process->seen = true;
+        return;
+    }
+    if (sampler->processCount == MAX_PROCESSES) return;
+
+    int fd = openProcFile("/proc/%d/statm", pid, 0);
+    if (fd < 0) return;
+    process = &sampler->processes[sampler->processCount++];
+    process->pid = pid;
+    process->statmFd = fd;
+    process->rssBytes = 0;
+    process->seen = true;
+}
+
+static void removeThread(ProcessSampler* sampler, int index) {
+    SampledThread* thread = &sampler->threads[index];
+    close(thread->statFd);
+    close(thread->statusFd);
+    *thread = sampler->threads[--sampler->threadCount];
+}
+
+static void removeProcess(ProcessSampler* sampler, int index) {
+    pid_t pid = sampler->processes[index].pid;
+    for (int i = sampler->threadCount - 1; i >= 0; i--) {
+        if (sampler->threads[i].pid == pid) removeThread(sampler, i);
+    }
+    close(sampler->processes[index].statmFd);
+    sampler->processes[index] = sampler->processes[--sampler->processCount];
+}
+
+// /proc only lists the app's own processes (hidepid), so walking it for the
+// descendants of the root is cheap.
+static void discoverProcesses(ProcessSampler* sampler) {
+    pid_t pids[MAX_PROCESSES * 4];
+    pid_t parents[MAX_PROCESSES * 4];
+    int count = 0;
+
+    DIR* proc = opendir("/proc");
+    if (!proc) return;
+    struct dirent* entry;
+    while ((entry = readdir(proc)) && count < MAX_PROCESSES * 4) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        pid_t pid = (pid_t)atoi(entry->d_name);
+        pid_t parent = readParent(pid);
+        if (parent < 0) continue;
+        pids[count] = pid;
+        parents[count] = parent;
+        count++;
+    }
+    closedir(proc);
+
+    for (int i = 0; i < sampler->processCount; i++) sampler->processes[i].seen = false;
+    addProcess(sampler, sampler->root);
+
+    // Processes are listed in pid order, children may precede their parent
+    bool added = true;
+    while (added) {
+        added = false;
+        for (int i = 0; i < count; i++) {
+            if (pids[i] == 0) continue;
+            SampledProcess* parent = findProcess(sampler, parents[i]);
+            if (!parent || !parent->seen) continue;
+            addProcess(sampler, pids[i]);
+            pids[i] = 0;
+            added = true;
+        }
+    }
+
+    for (int i = sampler->processCount - 1; i >= 0; i--) {
+        if (!sampler->processes[i].seen) removeProcess(sampler, i);
+    }
+}
+
+static void discoverThreads(ProcessSampler* sampler, pid_t pid) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR* task = opendir(path);
+    if (!task) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(task))) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        pid_t tid = (pid_t)atoi(entry->d_name);
+
+        bool known = false;
+        for (int i = 0; i < sampler->threadCount; i++) {
+            if (sampler->threads[i].tid == tid) {
+                sampler->threads[i].seen = true;
+                known = true;
+                break;
+            }
+        }
+        if (known || sampler->threadCount == MAX_THREADS) continue;
+
+        int statFd = openProcFile("/proc/%d/task/%d/stat", pid, tid);
+        int statusFd = openProcFile("/proc/%d/task/%d/status", pid, tid);
+        if (statFd < 0 || statusFd < 0) {
+            if (statFd >= 0) close(statFd);
+            if (statusFd >= 0) close(statusFd);
+            continue;
+        }
+        SampledThread* thread = &sampler->threads[sampler->threadCount++];
+        thread->pid = pid;
+        thread->tid = tid;
+        thread->statFd = statFd;
+        thread->statusFd = statusFd;
+        thread->lastTicks = -1;
+        thread->seen = true;
+    }
+    closedir(task);
+}
+
+static int sample(ProcessSampler* sampler, int64_t* out, int capacity) {
+    char stat[STAT_BUFFER_SIZE];
+    char status[STATUS_BUFFER_SIZE];
+    int64_t now = getTimeNanos();
+    int64_t rssBytes = 0;
+    int64_t cpuDelta = 0;
+    int count = 0;
+
+    if (sampler->samples++ % RESCAN_SAMPLES == 0) discoverProcesses(sampler);
+
+    for (int i = 0; i < sampler->threadCount; i++) sampler->threads[i].seen = false;
+    for (int i = sampler->processCount - 1; i >= 0; i--) {
+        SampledProcess* process = &sampler->processes[i];
+        char statm[128];
+        if (readProcFile(process->statmFd, statm, sizeof(statm)) < 0) {
+            removeProcess(sampler, i);
+            continue;
+        }
+        const char* resident = strchr(statm, ' ');
+        process->rssBytes = resident ? strtoll(resident + 1, NULL, 10) * sampler->pageSize : 0;
+        rssBytes += process->rssBytes;
+        discoverThreads(sampler, process->pid);
+    }
+
+    for (int i = sampler->threadCount - 1; i >= 0; i--) {
+        SampledThread* thread = &sampler->threads[i];
+        if (!thread->seen ||
+            readProcFile(thread->statFd, stat, sizeof(stat)) < 0 ||
+            readProcFile(thread->statusFd, status, sizeof(status)) < 0) {
+            removeThread(sampler, i);
+            continue;
+        }
+
+        // After the command: state(0) ... majflt(9) ... utime(11) stime(12)
+        int64_t ticks = statLong(stat, 11) + statLong(stat, 12);
+        int64_t delta = thread->lastTicks >= 0 ? ticks - thread->lastTicks : 0;
+        thread->lastTicks = ticks;
+        cpuDelta += delta;
+
+        if (count == capacity) continue;
+        SampledProcess* process = findProcess(sampler, thread->pid);
+        const char* state = statField(stat, 0);
+        int64_t* record = out + HEADER_FIELDS + count * THREAD_FIELDS;
+        record[FIELD_PID] = thread->pid;
+        record[FIELD_TID] = thread->tid;
+        record[FIELD_CPU_TICKS] = ticks;
+        record[FIELD_CPU_DELTA_TICKS] = delta;
+        record[FIELD_RSS_BYTES] = process ? process->rssBytes : 0;
+        record[FIELD_MAJOR_FAULTS] = statLong(stat, 9);
+        record[FIELD_VOLUNTARY_SWITCHES] = statusLong(status, "\nvoluntary_ctxt_switches:");
+        record[FIELD_INVOLUNTARY_SWITCHES] = statusLong(status, "\nnonvoluntary_ctxt_switches:");
+        record[FIELD_STATE] = state ? *state : '?';
+        count++;
+    }
+
+    out[HEADER_THREADS] = count;
+    out[HEADER_ELAPSED_NANOS] = sampler->lastNanos ? now - sampler->lastNanos : 0;
+    out[HEADER_TICKS_PER_SECOND] = sysconf(_SC_CLK_TCK);
+    out[HEADER_PROCESSES] = sampler->processCount;
+    out[HEADER_RSS_BYTES] = rssBytes;
+    out[HEADER_CPU_DELTA_TICKS] = cpuDelta;
+    sampler->lastNanos = now;
+    return count;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_steamdeck_mobile_core_winlator_ProcessSampler_nativeCreate(JNIEnv *env, jclass obj, jint rootPid) {
+    ProcessSampler* sampler = calloc(1, sizeof(ProcessSampler));
+    if (!sampler) return 0;
+    sampler->root = rootPid;
+    sampler->pageSize = sysconf(_SC_PAGESIZE);
+    return (jlong)(intptr_t)sampler;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_steamdeck_mobile_core_winlator_ProcessSampler_nativeSample(JNIEnv *env, jclass obj, jlong handle, jobject buffer) {
+    ProcessSampler* sampler = (ProcessSampler*)(intptr_t)handle;
+    int64_t* out = (*env)->GetDirectBufferAddress(env, buffer);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer) / (jlong)sizeof(int64_t);
+    if (!sampler || !out || capacity < HEADER_FIELDS) return -1;
+
+    return sample(sampler, out, (int)((capacity - HEADER_FIELDS) / THREAD_FIELDS));
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ProcessSampler_nativeDestroy(JNIEnv *env, jclass obj, jlong handle) {
+    ProcessSampler* sampler = (ProcessSampler*)(intptr_t)handle;
+    if (!sampler) return;
+    while (sampler->processCount > 0) removeProcess(sampler, sampler->processCount - 1);
+    while (sampler->threadCount > 0) removeThread(sampler, sampler->threadCount - 1);
+    free(sampler);
+}
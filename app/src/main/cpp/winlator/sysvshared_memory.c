@@ -7,7 +7,11 @@
 #include <string.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ipc.h>
 #include <sys/syscall.h>
 #include <jni.h>
@@ -15,6 +19,7 @@
 
 #define __u32 uint32_t
 #include <linux/ashmem.h>
+#include <sys/ioctl.h>
 
 #define printf(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__);
 
@@ -46,30 +51,345 @@ static int memfd_create(const char *name, unsigned int flags) {
 #endif
 }
 
-JNIEXPORT jint JNICALL
-Java_com_winlator_sysvshm_SysVSharedMemory_ashmemCreateRegion(JNIEnv *env, jobject obj, jint index,
-                                                              jlong size) {
+// The sysvshm clients (the shmget/shmat/shmctl emulation in the rootfs) send a request code byte
+// followed by a little endian 32-bit argument: the size for SHMGET, the shmid otherwise
+enum RequestCode {
+    REQUEST_SHMGET = 0,
+    REQUEST_GET_FD = 1,
+    REQUEST_DELETE = 2
+};
+
+#define REQUEST_LENGTH 5
+#define MAX_EVENTS 32
+// Empty memfds kept ready, so that a burst of shmget calls doesn't wait on memfd_create for each
+#define MEMFD_POOL_SIZE 8
+
+typedef struct SHMSegment {
+    int id;
+    int fd;
+    int64_t size;
+} SHMSegment;
+
+typedef struct SHMClient {
+    int fd;
+    int length;
+    uint8_t request[REQUEST_LENGTH];
+    struct SHMClient* next;
+} SHMClient;
+
+// Owns the segment table. Only the server thread changes it, attach() reads it from the X server
+typedef struct SysVSHMServer {
+    int serverFd;
+    int epollFd;
+    int shutdownFd;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    SHMSegment* segments;
+    int numSegments;
+    int maxSegments;
+    int lastSegmentId;
+    int memfdPool[MEMFD_POOL_SIZE];
+    int numPooledMemfds;
+    SHMClient* clients;
+} SysVSHMServer;
+
+static int createServerSocket(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sun_family = AF_LOCAL;
+    strncpy(serverAddr.sun_path, path, sizeof(serverAddr.sun_path) - 1);
+    int addrLength = sizeof(sa_family_t) + strlen(serverAddr.sun_path);
+
+    unlink(serverAddr.sun_path);
+    if (bind(fd, (struct sockaddr*)&serverAddr, addrLength) < 0 || listen(fd, SOMAXCONN) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "SysVSharedMemory", "Failed to listen on %s: errno=%d", path, errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void fillMemfdPool(SysVSHMServer* server) {
+    while (server->numPooledMemfds < MEMFD_POOL_SIZE) {
+        int fd = memfd_create("sysvshm", MFD_CLOEXEC);
+        if (fd < 0) break;
+        server->memfdPool[server->numPooledMemfds++] = fd;
+    }
+}
+
+// A pooled memfd has never been mapped, so growing it yields the zeroed memory shmget promises
+static int createSegmentFd(SysVSHMServer* server, int64_t size) {
+    while (server->numPooledMemfds > 0) {
+        int fd = server->memfdPool[--server->numPooledMemfds];
+        if (ftruncate(fd, size) == 0) return fd;
+        close(fd);
+    }
+
+    // Pool drained (or never filled): a fresh memfd is still better than ashmem
+    int fd = memfd_create("sysvshm", MFD_CLOEXEC);
+    if (fd >= 0) {
+        if (ftruncate(fd, size) == 0) return fd;
+        close(fd);
+    }
+
     char name[32];
-    sprintf(name, "sysvshm-%d", index);
+    sprintf(name, "sysvshm-%d", server->numSegments);
     return ashmemCreateRegion(name, size);
 }
 
+static int findSegment(SysVSHMServer* server, int shmid) {
+    for (int i = 0; i < server->numSegments; i++) {
+        if (server->segments[i].id == shmid) return i;
+    }
+    return -1;
+}
+
+static int getSegment(SysVSHMServer* server, int64_t size) {
+    if (size <= 0) return -1;
+    int fd = createSegmentFd(server, size);
+    if (fd < 0) return -1;
+
+    pthread_mutex_lock(&server->mutex);
+    if (server->numSegments == server->maxSegments) {
+        int maxSegments = server->maxSegments ? server->maxSegments * 2 : 16;
+        SHMSegment* segments = realloc(server->segments, maxSegments * sizeof(SHMSegment));
+        if (!segments) {
+            pthread_mutex_unlock(&server->mutex);
+            close(fd);
+            return -1;
+        }
+        server->segments = segments;
+        server->maxSegments = maxSegments;
+    }
+
+    SHMSegment* segment = &server->segments[server->numSegments++];
+    segment->id = ++server->lastSegmentId;
+    segment->fd = fd;
+    segment->size = size;
+    pthread_mutex_unlock(&server->mutex);
+    return segment->id;
+}
+
+static void deleteSegment(SysVSHMServer* server, int shmid) {
+    pthread_mutex_lock(&server->mutex);
+    int index = findSegment(server, shmid);
+    if (index >= 0) {
+        close(server->segments[index].fd);
+        server->segments[index] = server->segments[--server->numSegments];
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+static void sendReply(int clientFd, const void* data, int length, int ancillaryFd) {
+    struct iovec iovmsg = {.iov_base = (void*)data, .iov_len = length};
+    struct {
+        struct cmsghdr align;
+        int fds[1];
+    } ctrlmsg;
+
+    struct msghdr msg = {
+        .msg_iov = &iovmsg,
+        .msg_iovlen = 1
+    };
+
+    if (ancillaryFd >= 0) {
+        msg.msg_control = &ctrlmsg;
+        msg.msg_controllen = CMSG_LEN(sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        ((int*)CMSG_DATA(cmsg))[0] = ancillaryFd;
+    }
+
+    sendmsg(clientFd, &msg, MSG_NOSIGNAL);
+}
+
+static void handleRequest(SysVSHMServer* server, SHMClient* client) {
+    uint32_t argument;
+    memcpy(&argument, client->request + 1, sizeof(argument));
+
+    switch (client->request[0]) {
+        case REQUEST_SHMGET: {
+            int32_t shmid = getSegment(server, argument);
+            sendReply(client->fd, &shmid, sizeof(shmid), -1);
+            break;
+        }
+        case REQUEST_GET_FD: {
+            // The segment can't go away before the reply is sent: this thread is the only one deleting
+            pthread_mutex_lock(&server->mutex);
+            int index = findSegment(server, (int)argument);
+            int fd = index >= 0 ? server->segments[index].fd : -1;
+            pthread_mutex_unlock(&server->mutex);
+
+            uint8_t status = 0;
+            sendReply(client->fd, &status, sizeof(status), fd);
+            break;
+        }
+        case REQUEST_DELETE:
+            deleteSegment(server, (int)argument);
+            break;
+    }
+}
+
+static void closeClient(SysVSHMServer* server, SHMClient* client) {
+    for (SHMClient** link = &server->clients; *link; link = &(*link)->next) {
+        if (*link == client) {
+            *link = client->next;
+            break;
+        }
+    }
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client);
+}
+
+static void acceptClient(SysVSHMServer* server) {
+    int clientFd = accept4(server->serverFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientFd < 0) return;
+
+    SHMClient* client = calloc(1, sizeof(SHMClient));
+    if (!client) {
+        close(clientFd);
+        return;
+    }
+    client->fd = clientFd;
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+    if (epoll_ctl(server->epollFd, EPOLL_CTL_ADD, clientFd, &event) < 0) {
+        close(clientFd);
+        free(client);
+        return;
+    }
+    client->next = server->clients;
+    server->clients = client;
+}
+
+static void readClient(SysVSHMServer* server, SHMClient* client) {
+    for (;;) {
+        ssize_t size = recv(client->fd, client->request + client->length, REQUEST_LENGTH - client->length, 0);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (size < 0 && errno == EINTR) continue;
+        if (size <= 0) {
+            closeClient(server, client);
+            return;
+        }
+
+        client->length += size;
+        if (client->length == REQUEST_LENGTH) {
+            handleRequest(server, client);
+            client->length = 0;
+        }
+    }
+}
+
+static void* runServer(void* param) {
+    SysVSHMServer* server = param;
+    struct epoll_event events[MAX_EVENTS];
+
+    fillMemfdPool(server);
+    for (;;) {
+        int numEvents = epoll_wait(server->epollFd, events, MAX_EVENTS, -1);
+        if (numEvents < 0 && errno == EINTR) continue;
+        if (numEvents < 0) break;
+
+        for (int i = 0; i < numEvents; i++) {
+            void* source = events[i].data.ptr;
+            if (source == &server->shutdownFd) return NULL;
+            else if (source == &server->serverFd) acceptClient(server);
+            else readClient(server, source);
+        }
+
+        // Refilled once the requests that woke the thread are answered
+        fillMemfdPool(server);
+    }
+    return NULL;
+}
+
+static void destroyServer(SysVSHMServer* server) {
+    while (server->clients) closeClient(server, server->clients);
+    for (int i = 0; i < server->numSegments; i++) close(server->segments[i].fd);
+    for (int i = 0; i < server->numPooledMemfds; i++) close(server->memfdPool[i]);
+    if (server->serverFd >= 0) close(server->serverFd);
+    if (server->epollFd >= 0) close(server->epollFd);
+    if (server->shutdownFd >= 0) close(server->shutdownFd);
+    pthread_mutex_destroy(&server->mutex);
+    free(server->segments);
+    free(server);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_startServer(JNIEnv *env, jobject obj, jstring path) {
+    SysVSHMServer* server = calloc(1, sizeof(SysVSHMServer));
+    if (!server) return 0;
+    pthread_mutex_init(&server->mutex, NULL);
+
+    const char *pathPtr = (*env)->GetStringUTFChars(env, path, NULL);
+    server->serverFd = createServerSocket(pathPtr);
+    (*env)->ReleaseStringUTFChars(env, path, pathPtr);
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server->shutdownFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->serverFd < 0 || server->epollFd < 0 || server->shutdownFd < 0) goto error;
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = &server->serverFd};
+    if (epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->serverFd, &event) < 0) goto error;
+    event.data.ptr = &server->shutdownFd;
+    if (epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->shutdownFd, &event) < 0) goto error;
+
+    if (pthread_create(&server->thread, NULL, runServer, server) != 0) goto error;
+    return (jlong)server;
+error:
+    destroyServer(server);
+    return 0;
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_stopServer(JNIEnv *env, jobject obj, jlong serverPtr) {
+    SysVSHMServer* server = (SysVSHMServer*)serverPtr;
+    uint64_t value = 1;
+    write(server->shutdownFd, &value, sizeof(value));
+    pthread_join(server->thread, NULL);
+    destroyServer(server);
+}
+
+// Maps a segment read-only for the X server. The mapping outlives the segment's deletion, like an shmat
+JNIEXPORT jobject JNICALL
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_attachSegment(JNIEnv *env, jobject obj, jlong serverPtr, jint shmid) {
+    SysVSHMServer* server = (SysVSHMServer*)serverPtr;
+    char *data = MAP_FAILED;
+    int64_t size = 0;
+
+    pthread_mutex_lock(&server->mutex);
+    int index = findSegment(server, shmid);
+    if (index >= 0) {
+        size = server->segments[index].size;
+        data = mmap(NULL, size, PROT_READ, MAP_SHARED, server->segments[index].fd, 0);
+    }
+    pthread_mutex_unlock(&server->mutex);
+
+    if (data == MAP_FAILED) return NULL;
+    return (*env)->NewDirectByteBuffer(env, data, size);
+}
+
 JNIEXPORT jobject JNICALL
-Java_com_winlator_sysvshm_SysVSharedMemory_mapSHMSegment(JNIEnv *env, jobject obj, jint fd, jlong size, jint offset, jboolean readonly) {
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_mapSHMSegment(JNIEnv *env, jobject obj, jint fd, jlong size, jint offset, jboolean readonly) {
     char *data = mmap(NULL, size, readonly ? PROT_READ : PROT_WRITE | PROT_READ, MAP_SHARED, fd, offset);
     if (data == MAP_FAILED) return NULL;
     return (*env)->NewDirectByteBuffer(env, data, size);
 }
 
 JNIEXPORT void JNICALL
-Java_com_winlator_sysvshm_SysVSharedMemory_unmapSHMSegment(JNIEnv *env, jobject obj, jobject data,
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_unmapSHMSegment(JNIEnv *env, jobject obj, jobject data,
                                                            jlong size) {
     char *dataAddr = (*env)->GetDirectBufferAddress(env, data);
     munmap(dataAddr, size);
 }
 
 JNIEXPORT jint JNICALL
-Java_com_winlator_sysvshm_SysVSharedMemory_createMemoryFd(JNIEnv *env, jclass obj, jstring name,
+Java_com_steamdeck_mobile_core_sysvshm_SysVSharedMemory_createMemoryFd(JNIEnv *env, jclass obj, jstring name,
                                                           jint size) {
     const char *namePtr = (*env)->GetStringUTFChars(env, name, 0);
 
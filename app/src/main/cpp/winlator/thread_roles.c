@@ -0,0 +1,437 @@
+#include <jni.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <android/log.h>
+
+// Thread role registry. Components register their threads by role and the
+// selected policy pins each role to a set of cores: prime, mid (the other big
+// cores) and little, told apart by their maximum frequency. Process trees
+// (Wine and box64 below proot) are registered by their root and re-applied
+// on refresh, since they keep creating threads.
+enum ThreadRole {
+    ROLE_GL = 0,
+    ROLE_DECODE = 1,
+    ROLE_TRACER = 2,
+    ROLE_AUDIO = 3,
+    ROLE_INPUT = 4,
+    ROLE_GAME = 5,
+    ROLE_COUNT = 6
+};
+
+enum ThreadPolicy {
+    // inherited scheduling, every core
+    POLICY_NONE = 0,
+    // GL, decode and game on the big cores, tracer on a core of its own,
+    // audio on a mid core with real-time priority where allowed
+    POLICY_PINNED = 1,
+    // everything off the prime cores, background roles on the little cores
+    POLICY_EFFICIENT = 2
+};
+
+#define MAX_THREADS 128
+#define MAX_TREES 8
+#define MAX_CPUS 32
+#define AUDIO_FIFO_PRIORITY 2
+// what apps may use for their own audio threads (THREAD_PRIORITY_URGENT_AUDIO)
+#define AUDIO_NICE -19
+#define LOG_TAG "ThreadRoles"
+
+typedef struct ThreadEntry {
+    pid_t tid;
+    int role;
+    bool boosted;
+} ThreadEntry;
+
+typedef struct TreeEntry {
+    pid_t root;
+    int role;
+} TreeEntry;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static ThreadEntry threads[MAX_THREADS];
+static int threadCount = 0;
+static TreeEntry trees[MAX_TREES];
+static int treeCount = 0;
+static int policy = POLICY_NONE;
+
+static bool topologyRead = false;
+static int cpuCount = 0;
+static cpu_set_t primeCpus, midCpus, littleCpus, allCpus;
+
+static long readMaxFreq(int cpu) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    long freq = 0;
+    if (fscanf(file, "%ld", &freq) != 1) freq = 0;
+    fclose(file);
+    return freq;
+}
+
+static void readTopology() {
+    long freqs[MAX_CPUS];
+    long maxFreq = 0, minFreq = 0;
+
+    cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpuCount > MAX_CPUS) cpuCount = MAX_CPUS;
+    CPU_ZERO(&primeCpus);
+    CPU_ZERO(&midCpus);
+    CPU_ZERO(&littleCpus);
+    CPU_ZERO(&allCpus);
+
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        freqs[cpu] = readMaxFreq(cpu);
+        if (freqs[cpu] > maxFreq) maxFreq = freqs[cpu];
+        if (freqs[cpu] && (!minFreq || freqs[cpu] < minFreq)) minFreq = freqs[cpu];
+        CPU_SET(cpu, &allCpus);
+    }
+
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        // unknown frequency (offline core) counts as little
+        if (freqs[cpu] == maxFreq && maxFreq != minFreq) CPU_SET(cpu, &primeCpus);
+        else if (freqs[cpu] > minFreq) CPU_SET(cpu, &midCpus);
+        else CPU_SET(cpu, &littleCpus);
+    }
+
+    // a symmetric SoC only has one cluster
+    if (!CPU_COUNT(&primeCpus)) primeCpus = allCpus;
+    topologyRead = true;
+}
+
+static int lastCpu(const cpu_set_t* set) {
+    for (int cpu = cpuCount - 1; cpu >= 0; cpu--) {
+        if (CPU_ISSET(cpu, set)) return cpu;
+    }
+    return -1;
+}
+
+static int firstCpu(const cpu_set_t* set) {
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        if (CPU_ISSET(cpu, set)) return cpu;
+    }
+    return -1;
+}
+
+// the tracer's core: the last mid core when there are enough of them, else a little one
+static int tracerCpu() {
+    if (CPU_COUNT(&midCpus) >= 2) return lastCpu(&midCpus);
+    if (CPU_COUNT(&littleCpus)) return lastCpu(&littleCpus);
+    return lastCpu(&allCpus);
+}
+
+static void roleCpus(int role, cpu_set_t* set) {
+    cpu_set_t big;
+    CPU_OR(&big, &primeCpus, &midCpus);
+
+    if (policy == POLICY_PINNED) {
+        int cpu;
+        switch (role) {
+            case ROLE_GL:
+            case ROLE_DECODE:
+            case ROLE_GAME:
+                *set = big;
+                cpu = tracerCpu();
+                if (CPU_COUNT(set) > 1 && cpu >= 0) CPU_CLR(cpu, set);
+                return;
+            case ROLE_TRACER:
+                CPU_ZERO(set);
+                CPU_SET(tracerCpu(), set);
+                return;
+            case ROLE_AUDIO:
+                cpu = CPU_COUNT(&midCpus) ? firstCpu(&midCpus) : firstCpu(&littleCpus);
+                CPU_ZERO(set);
+                CPU_SET(cpu >= 0 ? cpu : 0, set);
+                return;
+            case ROLE_INPUT:
+                CPU_OR(set, &midCpus, &littleCpus);
+                if (!CPU_COUNT(set)) *set = allCpus;
+                return;
+        }
+    }
+    else if (policy == POLICY_EFFICIENT) {
+        switch (role) {
+            case ROLE_GL:
+            case ROLE_DECODE:
+                *set = CPU_COUNT(&midCpus) ? midCpus : big;
+                return;
+            case ROLE_GAME:
+                CPU_OR(set, &midCpus, &littleCpus);
+                if (!CPU_COUNT(set)) *set = allCpus;
+                return;
+            default:
+                *set = CPU_COUNT(&littleCpus) ? littleCpus : allCpus;
+                return;
+        }
+    }
+    *set = allCpus;
+}
+
+// returns false once the thread is gone
+static bool applyThread(pid_t tid, int role, bool* boosted) {
+    cpu_set_t set;
+    roleCpus(role, &set);
+    if (sched_setaffinity(tid, sizeof(set), &set) < 0 && errno == ESRCH) return false;
+
+    bool boost = role == ROLE_AUDIO && policy == POLICY_PINNED;
+    if (!boosted || boost == *boosted) return true;
+
+    if (boost) {
+        struct sched_param param = {.sched_priority = AUDIO_FIFO_PRIORITY};
+        if (sched_setscheduler(tid, SCHED_FIFO, &param) < 0) setpriority(PRIO_PROCESS, tid, AUDIO_NICE);
+    }
+    else {
+        struct sched_param param = {.sched_priority = 0};
+        sched_setscheduler(tid, SCHED_OTHER, &param);
+        setpriority(PRIO_PROCESS, tid, 0);
+    }
+    *boosted = boost;
+    return true;
+}
+
+static bool isNumeric(const char* name) {
+    if (!*name) return false;
+    for (; *name; name++) {
+        if (!isdigit((unsigned char)*name)) return false;
+    }
+    return true;
+}
+
+// the fields after the command, which may contain spaces and parentheses
+static const char* statFields(const char* stat) {
+    const char* end = strrchr(stat, ')');
+    return end ? end + 2 : NULL;
+}
+
+static bool readStat(const char* path, pid_t* ppid, long* ticks) {
+    char buffer[1024];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) return false;
+    buffer[length] = '\0';
+
+    const char* fields = statFields(buffer);
+    if (!fields) return false;
+
+    // state ppid pgrp session tty tpgid flags minflt cminflt majflt cmajflt utime stime
+    char state;
+    int parent;
+    unsigned long utime, stime;
+    if (sscanf(fields, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &state, &parent, &utime, &stime) != 4) return false;
+    if (ppid) *ppid = parent;
+    if (ticks) *ticks = (long)(utime + stime);
+    return true;
+}
+
+static bool isDescendant(pid_t pid, pid_t root, const pid_t* pids, const pid_t* ppids, int count) {
+    for (int depth = 0; depth < 64 && pid > 1; depth++) {
+        pid_t parent = 0;
+        for (int i = 0; i < count; i++) {
+            if (pids[i] == pid) {
+                parent = ppids[i];
+                break;
+            }
+        }
+        if (parent == root) return true;
+        pid = parent;
+    }
+    return false;
+}
+
+typedef void (*ProcessCallback)(pid_t pid, int role, void* data);
+
+// calls back for every process below a registered tree root, roots excluded
+static void forEachTreeProcess(ProcessCallback callback, void* data) {
+    if (!treeCount) return;
+
+    DIR* proc = opendir("/proc");
+    if (!proc) return;
+
+    int capacity = 256, count = 0;
+    pid_t* pids = malloc(capacity * sizeof(pid_t));
+    pid_t* ppids = malloc(capacity * sizeof(pid_t));
+    struct dirent* entry;
+    char path[64];
+
+    while (pids && ppids && (entry = readdir(proc))) {
+        if (!isNumeric(entry->d_name)) continue;
+        pid_t pid = atoi(entry->d_name), ppid;
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        if (!readStat(path, &ppid, NULL)) continue;
+
+        if (count == capacity) {
+            capacity *= 2;
+            pid_t* newPids = realloc(pids, capacity * sizeof(pid_t));
+            pid_t* newPpids = newPids ? realloc(ppids, capacity * sizeof(pid_t)) : NULL;
+            if (newPids) pids = newPids;
+            if (!newPpids) break;
+            ppids = newPpids;
+        }
+        pids[count] = pid;
+        ppids[count] = ppid;
+        count++;
+    }
+    closedir(proc);
+
+    for (int i = 0; pids && ppids && i < count; i++) {
+        for (int t = 0; t < treeCount; t++) {
+            if (isDescendant(pids[i], trees[t].root, pids, ppids, count)) {
+                callback(pids[i], trees[t].role, data);
+                break;
+            }
+        }
+    }
+    free(pids);
+    free(ppids);
+}
+
+static void applyProcess(pid_t pid, int role, void* data) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR* tasks = opendir(path);
+    if (!tasks) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(tasks))) {
+        if (isNumeric(entry->d_name)) applyThread(atoi(entry->d_name), role, NULL);
+    }
+    closedir(tasks);
+}
+
+static void applyAll() {
+    int n = 0;
+    for (int i = 0; i < threadCount; i++) {
+        if (applyThread(threads[i].tid, threads[i].role, &threads[i].boosted)) threads[n++] = threads[i];
+    }
+    threadCount = n;
+    forEachTreeProcess(applyProcess, NULL);
+}
+
+static void registerThread(pid_t tid, int role) {
+    if (role < 0 || role >= ROLE_COUNT || tid <= 0) return;
+    pthread_mutex_lock(&mutex);
+    if (!topologyRead) readTopology();
+
+    ThreadEntry* thread = NULL;
+    for (int i = 0; i < threadCount; i++) {
+        if (threads[i].tid == tid) thread = &threads[i];
+    }
+    if (!thread && threadCount < MAX_THREADS) {
+        thread = &threads[threadCount++];
+        thread->tid = tid;
+        thread->boosted = false;
+    }
+    if (thread) {
+        thread->role = role;
+        if (!applyThread(tid, role, &thread->boosted)) *thread = threads[--threadCount];
+    }
+    else __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Registry full, thread %d keeps its scheduling", tid);
+
+    pthread_mutex_unlock(&mutex);
+}
+
+// Exported for libvirglrenderer, which looks it up with dlsym
+void ThreadRoles_register(int role) {
+    registerThread(gettid(), role);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_registerCurrentThread(JNIEnv *env, jclass obj, jint role) {
+    registerThread(gettid(), role);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_registerThread(JNIEnv *env, jclass obj, jint tid, jint role) {
+    registerThread(tid, role);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_registerProcessTree(JNIEnv *env, jclass obj, jint root, jint role) {
+    if (role < 0 || role >= ROLE_COUNT || root <= 0) return;
+    pthread_mutex_lock(&mutex);
+    if (!topologyRead) readTopology();
+
+    int i;
+    for (i = 0; i < treeCount && trees[i].root != root; i++);
+    if (i == treeCount) {
+        // the oldest tree gives way, its processes are most likely gone
+        if (treeCount == MAX_TREES) memmove(&trees[0], &trees[1], --treeCount * sizeof(TreeEntry));
+        i = treeCount++;
+    }
+    trees[i].root = root;
+    trees[i].role = role;
+    forEachTreeProcess(applyProcess, NULL);
+    pthread_mutex_unlock(&mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_unregisterProcessTree(JNIEnv *env, jclass obj, jint root) {
+    pthread_mutex_lock(&mutex);
+    int n = 0;
+    for (int i = 0; i < treeCount; i++) {
+        if (trees[i].root != root) trees[n++] = trees[i];
+    }
+    treeCount = n;
+    pthread_mutex_unlock(&mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_setPolicy(JNIEnv *env, jclass obj, jint newPolicy) {
+    pthread_mutex_lock(&mutex);
+    if (!topologyRead) readTopology();
+    policy = newPolicy >= POLICY_NONE && newPolicy <= POLICY_EFFICIENT ? newPolicy : POLICY_NONE;
+    applyAll();
+    pthread_mutex_unlock(&mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_refresh(JNIEnv *env, jclass obj) {
+    pthread_mutex_lock(&mutex);
+    // threads created since inherited whatever core their creator ran on
+    if (policy != POLICY_NONE) applyAll();
+    pthread_mutex_unlock(&mutex);
+}
+
+static void addProcessTicks(pid_t pid, int role, void* data) {
+    char path[64];
+    long ticks;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (readStat(path, NULL, &ticks)) ((jlong*)data)[role] += ticks;
+}
+
+// Fills the CPU time used so far per role in clock ticks, threads and tree
+// processes that exited since are no longer counted
+JNIEXPORT void JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_getRoleCpuTicks(JNIEnv *env, jclass obj, jlongArray ticks) {
+    jlong result[ROLE_COUNT] = {0};
+    char path[64];
+    long threadTicks;
+
+    pthread_mutex_lock(&mutex);
+    for (int i = 0; i < threadCount; i++) {
+        snprintf(path, sizeof(path), "/proc/%d/stat", threads[i].tid);
+        if (readStat(path, NULL, &threadTicks)) result[threads[i].role] += threadTicks;
+    }
+    forEachTreeProcess(addProcessTicks, result);
+    pthread_mutex_unlock(&mutex);
+
+    jsize length = (*env)->GetArrayLength(env, ticks);
+    (*env)->SetLongArrayRegion(env, ticks, 0, length < ROLE_COUNT ? length : ROLE_COUNT, result);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_steamdeck_mobile_core_winlator_ThreadRoles_getTicksPerSecond(JNIEnv *env, jclass obj) {
+    return sysconf(_SC_CLK_TCK);
+}
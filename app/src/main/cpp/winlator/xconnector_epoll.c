@@ -12,11 +12,14 @@
 #include <jni.h>
 #include <android/log.h>
 
+#include "jni_cache.h"
+#include "native_trace.h"
+
 #define printf(...) __android_log_print(ANDROID_LOG_DEBUG, "System.out", __VA_ARGS__);
-#define MAX_EVENTS 10
+#define MAX_EVENTS 256
 #define MAX_FDS 32
-
-struct epoll_event events[MAX_EVENTS];
+/* reads never block, an empty socket is reported with this instead of -1 */
+#define READ_WOULD_BLOCK -2
 
 JNIEXPORT jint JNICALL
 Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_createAFUnixSocket(JNIEnv *env, jobject obj,
@@ -40,7 +43,7 @@ Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_createAFUnixSocket(JNI
         __android_log_print(ANDROID_LOG_ERROR, "XConnectorEpoll", "bind() failed: errno=%d, path=%s", errno, serverAddr.sun_path);
         goto error;
     }
-    if (listen(fd, MAX_EVENTS) < 0) {
+    if (listen(fd, SOMAXCONN) < 0) {
         __android_log_print(ANDROID_LOG_ERROR, "XConnectorEpoll", "listen() failed: errno=%d", errno);
         goto error;
     }
@@ -62,15 +65,24 @@ Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_closeFd(JNIEnv *env, j
     close(fd);
 }
 
-JNIEXPORT jboolean JNICALL
+JNIEXPORT jint JNICALL
 Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_doEpollIndefinitely(JNIEnv *env, jobject obj,
                                                                  jint epollFd, jint serverFd,
-                                                                 jboolean addClientToEpoll) {
-    jclass cls = (*env)->GetObjectClass(env, obj);
-    jmethodID handleNewConnection = (*env)->GetMethodID(env, cls, "handleNewConnection", "(I)V");
-    jmethodID handleExistingConnection = (*env)->GetMethodID(env, cls, "handleExistingConnection", "(I)V");
-
-    int numFds = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+                                                                 jboolean addClientToEpoll,
+                                                                 jboolean edgeTriggered,
+                                                                 jintArray readyFds) {
+    /* the batch lives on the stack so connectors can poll from their own threads */
+    struct epoll_event events[MAX_EVENTS];
+    int maxEvents = (*env)->GetArrayLength(env, readyFds);
+    if (maxEvents > MAX_EVENTS) maxEvents = MAX_EVENTS;
+
+    /* readable clients are handed back in one array instead of an upcall per fd */
+    jint fds[MAX_EVENTS];
+    int numReadyFds = 0;
+
+    int numFds = epoll_wait(epollFd, events, maxEvents, -1);
+    // only the dispatch, the wait itself shows up as the thread sleeping
+    NATIVE_TRACE_SCOPE("XConnectorEpoll_doEpollIndefinitely");
     for (int i = 0; i < numFds; i++) {
         if (events[i].data.fd == serverFd) {
             int clientFd = accept(serverFd, NULL, NULL);
@@ -79,21 +91,23 @@ Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_doEpollIndefinitely(JN
                 if (addClientToEpoll) {
                     struct epoll_event event;
                     event.data.fd = clientFd;
-                    event.events = EPOLLIN;
+                    event.events = edgeTriggered ? EPOLLIN | EPOLLET : EPOLLIN;
 
                     if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &event) >= 0) {
-                        (*env)->CallVoidMethod(env, obj, handleNewConnection, clientFd);
+                        (*env)->CallVoidMethod(env, obj, jniCache.handleNewConnection, clientFd);
                     }
                 }
-                else (*env)->CallVoidMethod(env, obj, handleNewConnection, clientFd);
+                else (*env)->CallVoidMethod(env, obj, jniCache.handleNewConnection, clientFd);
             }
         }
         else if (events[i].events & EPOLLIN) {
-            (*env)->CallVoidMethod(env, obj, handleExistingConnection, events[i].data.fd);
+            fds[numReadyFds++] = events[i].data.fd;
         }
     }
 
-    return numFds >= 0;
+    if (numFds < 0) return -1;
+    if (numReadyFds > 0) (*env)->SetIntArrayRegion(env, readyFds, 0, numReadyFds, fds);
+    return numReadyFds;
 }
 
 JNIEXPORT jboolean JNICALL
@@ -117,7 +131,8 @@ JNIEXPORT jint JNICALL
 Java_com_steamdeck_mobile_core_xconnector_ClientSocket_read(JNIEnv *env, jobject obj, jint fd, jobject data,
                                                jint offset, jint length) {
     char *dataAddr = (*env)->GetDirectBufferAddress(env, data);
-    return read(fd, dataAddr + offset, length);
+    int size = recv(fd, dataAddr + offset, length, MSG_DONTWAIT);
+    return size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? READ_WOULD_BLOCK : size;
 }
 
 JNIEXPORT jint JNICALL
@@ -152,7 +167,8 @@ Java_com_steamdeck_mobile_core_xconnector_ClientSocket_recvAncillaryMsg(JNIEnv *
         .msg_controllen = sizeof(struct cmsghdr) + MAX_FDS * sizeof(int)
     };
 
-    int size = recvmsg(clientFd, &msg, 0);
+    int size = recvmsg(clientFd, &msg, MSG_DONTWAIT);
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return READ_WOULD_BLOCK;
 
     if (size >= 0) {
         struct cmsghdr *cmsg;
@@ -160,11 +176,9 @@ Java_com_steamdeck_mobile_core_xconnector_ClientSocket_recvAncillaryMsg(JNIEnv *
             if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
                 int numFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
                 if (numFds > 0) {
-                    jclass cls = (*env)->GetObjectClass(env, obj);
-                    jmethodID addAncillaryFd = (*env)->GetMethodID(env, cls, "addAncillaryFd", "(I)V");
                     for (int i = 0; i < numFds; i++) {
                         int ancillaryFd = ((int*)CMSG_DATA(cmsg))[i];
-                        (*env)->CallVoidMethod(env, obj, addAncillaryFd, ancillaryFd);
+                        (*env)->CallVoidMethod(env, obj, jniCache.addAncillaryFd, ancillaryFd);
                     }
                 }
             }
@@ -216,9 +230,7 @@ Java_com_steamdeck_mobile_core_xconnector_XConnectorEpoll_waitForSocketRead(JNIE
     if (res < 0 || (pfds[1].revents & POLLIN)) return JNI_FALSE;
 
     if (pfds[0].revents & POLLIN) {
-        jclass cls = (*env)->GetObjectClass(env, obj);
-        jmethodID handleExistingConnection = (*env)->GetMethodID(env, cls, "handleExistingConnection", "(I)V");
-        (*env)->CallVoidMethod(env, obj, handleExistingConnection, clientFd);
+        (*env)->CallVoidMethod(env, obj, jniCache.handleExistingConnection, clientFd);
     }
     return JNI_TRUE;
 }
\ No newline at end of file
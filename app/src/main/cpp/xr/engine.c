@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 
 void XrEngineInit(struct XrEngine* engine, void* system, const char* name, int version)
 {
@@ -46,6 +47,12 @@ void XrEngineInit(struct XrEngine* engine, void* system, const char* name, int v
         extensions[count++] = XR_EXT_PERFORMANCE_SETTINGS_EXTENSION_NAME;
         extensions[count++] = XR_KHR_ANDROID_THREAD_SETTINGS_EXTENSION_NAME;
     }
+    if (engine->PlatformFlag[PLATFORM_EXTENSION_FOVEATION])
+    {
+        extensions[count++] = XR_FB_FOVEATION_EXTENSION_NAME;
+        extensions[count++] = XR_FB_FOVEATION_CONFIGURATION_EXTENSION_NAME;
+        extensions[count++] = XR_FB_SWAPCHAIN_UPDATE_STATE_EXTENSION_NAME;
+    }
 #endif
 
     // Create the OpenXR instance.
@@ -192,8 +199,21 @@ void XrEngineLeave(struct XrEngine* engine)
     }
 }
 
+static XrTime XrEngineGetNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (XrTime)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 void XrEngineWaitForFrame(struct XrEngine* engine)
 {
+    XrTime wait_start = XrEngineGetNanos();
+    if (engine->FrameReturnTime)
+    {
+        engine->FrameWorkTime = wait_start - engine->FrameReturnTime;
+    }
+
     XrFrameWaitInfo wait_frame_info = {};
     wait_frame_info.type = XR_TYPE_FRAME_WAIT_INFO;
     wait_frame_info.next = NULL;
@@ -203,5 +223,7 @@ void XrEngineWaitForFrame(struct XrEngine* engine)
     frame_state.next = NULL;
 
     OXR(xrWaitFrame(engine->Session, &wait_frame_info, &frame_state));
+    engine->FrameReturnTime = XrEngineGetNanos();
     engine->PredictedDisplayTime = frame_state.predictedDisplayTime;
+    engine->DisplayPeriod = frame_state.predictedDisplayPeriod;
 }
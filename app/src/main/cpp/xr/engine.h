@@ -46,6 +46,10 @@ enum
 {
   XrMaxNumEyes = 2
 };
+enum
+{
+  XrMultiviewFbo = XrMaxNumEyes // both eyes as layers of one texture array swapchain
+};
 
 enum XrPlatformFlag
 {
@@ -54,6 +58,7 @@ enum XrPlatformFlag
   PLATFORM_EXTENSION_INSTANCE,
   PLATFORM_EXTENSION_PASSTHROUGH,
   PLATFORM_EXTENSION_PERFORMANCE,
+  PLATFORM_EXTENSION_FOVEATION,
   PLATFORM_TRACKING_FLOOR,
   PLATFORM_MAX
 };
@@ -84,6 +89,9 @@ struct XrEngine {
     XrSpace StageSpace;
 
     XrTime PredictedDisplayTime;
+    XrDuration DisplayPeriod;
+    XrDuration FrameWorkTime; // time between two xrWaitFrame calls not spent waiting
+    XrTime FrameReturnTime;
 
     int MainThreadId;
     int RenderThreadId;
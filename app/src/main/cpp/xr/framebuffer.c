@@ -1,18 +1,18 @@
 #include "framebuffer.h"
 
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 #include <GLES2/gl2ext.h>
 #endif
 
 #include <stdlib.h>
 #include <string.h>
 
-bool XrFramebufferCreate(struct XrFramebuffer *framebuffer, XrSession session, int width, int height)
+bool XrFramebufferCreate(struct XrFramebuffer *framebuffer, XrSession session, int width, int height, bool multiview)
 {
     memset(framebuffer, 0, sizeof(framebuffer));
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-    return XrFramebufferCreateGL(framebuffer, session, width, height);
+    return XrFramebufferCreateGL(framebuffer, session, width, height, multiview);
 #else
     return false;
 #endif
@@ -21,7 +21,14 @@ bool XrFramebufferCreate(struct XrFramebuffer *framebuffer, XrSession session, i
 void XrFramebufferDestroy(struct XrFramebuffer *framebuffer)
 {
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-    GL(glDeleteRenderbuffers(framebuffer->SwapchainLength, framebuffer->GLDepthBuffers));
+    if (framebuffer->ArraySize > 1)
+    {
+        GL(glDeleteTextures(framebuffer->SwapchainLength, framebuffer->GLDepthBuffers));
+    }
+    else
+    {
+        GL(glDeleteRenderbuffers(framebuffer->SwapchainLength, framebuffer->GLDepthBuffers));
+    }
     GL(glDeleteFramebuffers(framebuffer->SwapchainLength, framebuffer->GLFrameBuffers));
     free(framebuffer->GLDepthBuffers);
     free(framebuffer->GLFrameBuffers);
@@ -30,36 +37,45 @@ void XrFramebufferDestroy(struct XrFramebuffer *framebuffer)
     free(framebuffer->SwapchainImage);
 }
 
-void XrFramebufferAcquire(struct XrFramebuffer *framebuffer)
+void XrFramebufferAcquire(struct XrFramebuffer *framebuffer, bool clear)
 {
-    XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, NULL};
-    OXR(xrAcquireSwapchainImage(framebuffer->Handle, &acquire_info, &framebuffer->SwapchainIndex));
+    // The image is normally acquired already, right after the previous one was released
+    if (framebuffer->NextAcquired)
+    {
+        framebuffer->SwapchainIndex = framebuffer->NextSwapchainIndex;
+        framebuffer->NextAcquired = false;
+    }
+    else
+    {
+        XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, NULL};
+        OXR(xrAcquireSwapchainImage(framebuffer->Handle, &acquire_info, &framebuffer->SwapchainIndex));
+    }
 
+    // The compositor hands images back within a display period, a short timeout only
+    // made us render into an image that was still being read
     XrSwapchainImageWaitInfo wait_info;
     wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
     wait_info.next = NULL;
-    wait_info.timeout = 1000000; /* timeout in nanoseconds */
-    XrResult res = xrWaitSwapchainImage(framebuffer->Handle, &wait_info);
-    int i = 0;
-    while ((res != XR_SUCCESS) && (i < 10))
-    {
-        res = xrWaitSwapchainImage(framebuffer->Handle, &wait_info);
-        i++;
-        ALOGV("Retry xrWaitSwapchainImage %d times due XR_TIMEOUT_EXPIRED (duration %lf ms",
-              i, wait_info.timeout * (1E-9));
-    }
+    wait_info.timeout = XR_INFINITE_DURATION;
+    XrResult res;
+    OXR(res = xrWaitSwapchainImage(framebuffer->Handle, &wait_info));
 
     framebuffer->Acquired = res == XR_SUCCESS;
     XrFramebufferSetCurrent(framebuffer);
 
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-    GL(glEnable(GL_SCISSOR_TEST));
-    GL(glViewport(0, 0, framebuffer->Width, framebuffer->Height));
-    GL(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-    GL(glScissor(0, 0, framebuffer->Width, framebuffer->Height));
-    GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-    GL(glScissor(0, 0, 0, 0));
-    GL(glDisable(GL_SCISSOR_TEST));
+    // Skipped when the caller draws over the whole image anyway
+    if (clear)
+    {
+        GL(glEnable(GL_SCISSOR_TEST));
+        GL(glViewport(0, 0, framebuffer->Width, framebuffer->Height));
+        GL(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+        GL(glScissor(0, 0, framebuffer->Width, framebuffer->Height));
+        GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        GL(glScissor(0, 0, 0, 0));
+        GL(glDisable(GL_SCISSOR_TEST));
+    }
+    GL(glViewport(0, 0, framebuffer->ViewportWidth, framebuffer->ViewportHeight));
 #endif
 }
 
@@ -71,6 +87,15 @@ void XrFramebufferRelease(struct XrFramebuffer *framebuffer)
         OXR(xrReleaseSwapchainImage(framebuffer->Handle, &release_info));
         framebuffer->Acquired = false;
     }
+
+    // Pipeline the acquire of the next image, only its wait is left for the next frame
+    if (!framebuffer->NextAcquired && (framebuffer->SwapchainLength > 1))
+    {
+        XrSwapchainImageAcquireInfo acquire_info = {XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, NULL};
+        XrResult res;
+        OXR(res = xrAcquireSwapchainImage(framebuffer->Handle, &acquire_info, &framebuffer->NextSwapchainIndex));
+        framebuffer->NextAcquired = res == XR_SUCCESS;
+    }
 }
 
 void XrFramebufferSetCurrent(struct XrFramebuffer *framebuffer)
@@ -81,8 +106,20 @@ void XrFramebufferSetCurrent(struct XrFramebuffer *framebuffer)
 }
 
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session, int width, int height)
+bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session, int width, int height, bool multiview)
 {
+    static PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR = NULL;
+    if (multiview && !glFramebufferTextureMultiviewOVR)
+    {
+        glFramebufferTextureMultiviewOVR = (PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)
+                eglGetProcAddress("glFramebufferTextureMultiviewOVR");
+        if (!glFramebufferTextureMultiviewOVR)
+        {
+            ALOGE("glFramebufferTextureMultiviewOVR not available");
+            return false;
+        }
+    }
+
     XrSwapchainCreateInfo swapchain_info;
     memset(&swapchain_info, 0, sizeof(swapchain_info));
     swapchain_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
@@ -91,10 +128,13 @@ bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session,
     swapchain_info.height = height;
     swapchain_info.faceCount = 1;
     swapchain_info.mipCount = 1;
-    swapchain_info.arraySize = 1;
+    swapchain_info.arraySize = multiview ? XrMaxNumEyes : 1;
+    framebuffer->ArraySize = swapchain_info.arraySize;
 
     framebuffer->Width = swapchain_info.width;
     framebuffer->Height = swapchain_info.height;
+    framebuffer->ViewportWidth = swapchain_info.width;
+    framebuffer->ViewportHeight = swapchain_info.height;
 
     // Create the color swapchain.
     swapchain_info.format = GL_SRGB8_ALPHA8_EXT;
@@ -120,6 +160,30 @@ bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session,
     {
         // Create color and depth buffers.
         GLuint color_texture = ((XrSwapchainImageOpenGLESKHR*)framebuffer->SwapchainImage)[i].image;
+        if (multiview)
+        {
+            // Depth has to be a texture array as well, renderbuffers have no views
+            GL(glGenTextures(1, &framebuffer->GLDepthBuffers[i]));
+            GL(glBindTexture(GL_TEXTURE_2D_ARRAY, framebuffer->GLDepthBuffers[i]));
+            GL(glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH24_STENCIL8, width, height, XrMaxNumEyes));
+            GL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+            GL(glGenFramebuffers(1, &framebuffer->GLFrameBuffers[i]));
+            GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer->GLFrameBuffers[i]));
+            GL(glFramebufferTextureMultiviewOVR(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                                framebuffer->GLDepthBuffers[i], 0, 0, XrMaxNumEyes));
+            GL(glFramebufferTextureMultiviewOVR(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                                color_texture, 0, 0, XrMaxNumEyes));
+            GL(GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER));
+            GL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+            if (status != GL_FRAMEBUFFER_COMPLETE)
+            {
+                ALOGE("Incomplete multiview frame buffer object: %d", status);
+                return false;
+            }
+            continue;
+        }
+
         GL(glGenRenderbuffers(1, &framebuffer->GLDepthBuffers[i]));
         GL(glBindRenderbuffer(GL_RENDERBUFFER, framebuffer->GLDepthBuffers[i]));
         GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, width, height));
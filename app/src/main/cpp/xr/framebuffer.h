@@ -5,10 +5,15 @@
 struct XrFramebuffer {
     int Width;
     int Height;
+    int ViewportWidth;  // rendered part of the image, below Width/Height at a reduced resolution scale
+    int ViewportHeight;
     bool Acquired;
+    bool NextAcquired;
+    int ArraySize;
     XrSwapchain Handle;
 
     uint32_t SwapchainIndex;
+    uint32_t NextSwapchainIndex;
     uint32_t SwapchainLength;
     void* SwapchainImage;
 
@@ -16,13 +21,13 @@ struct XrFramebuffer {
     unsigned int* GLFrameBuffers;
 };
 
-bool XrFramebufferCreate(struct XrFramebuffer *framebuffer, XrSession session, int width, int height);
+bool XrFramebufferCreate(struct XrFramebuffer *framebuffer, XrSession session, int width, int height, bool multiview);
 void XrFramebufferDestroy(struct XrFramebuffer *framebuffer);
 
-void XrFramebufferAcquire(struct XrFramebuffer *framebuffer);
+void XrFramebufferAcquire(struct XrFramebuffer *framebuffer, bool clear);
 void XrFramebufferRelease(struct XrFramebuffer *framebuffer);
 void XrFramebufferSetCurrent(struct XrFramebuffer *framebuffer);
 
 #if XR_USE_GRAPHICS_API_OPENGL_ES
-bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session, int width, int height);
+bool XrFramebufferCreateGL(struct XrFramebuffer *framebuffer, XrSession session, int width, int height, bool multiview);
 #endif
@@ -1,9 +1,13 @@
 #include "input.h"
 #include "math.h"
 
+#include <math.h>
 #include <sys/time.h>
 #include <string.h>
 
+// Amplitude changes smaller than this keep the vibration that is already playing
+#define HAPTIC_AMPLITUDE_THRESHOLD 0.05f
+
 void XrInputInit(struct XrEngine* engine, struct XrInput* input)
 {
     if (input->Initialized)
@@ -152,6 +156,7 @@ void XrInputInit(struct XrEngine* engine, struct XrInput* input)
             }
         }
     }
+    input->QueryMask = QUERY_ALL;
     input->Initialized = true;
 }
 
@@ -190,55 +195,71 @@ void XrInputUpdate(struct XrEngine* engine, struct XrInput* input)
     sync_info.next = NULL;
     sync_info.countActiveActionSets = 1;
     sync_info.activeActionSets = &activeActionSet;
-    OXR(xrSyncActions(engine->Session, &sync_info));
-
-    // query input action states
-    XrActionStateGetInfo get_info = {};
-    get_info.type = XR_TYPE_ACTION_STATE_GET_INFO;
-    get_info.next = NULL;
-    get_info.subactionPath = XR_NULL_PATH;
+    XrResult sync_result;
+    OXR(sync_result = xrSyncActions(engine->Session, &sync_info));
 
     XrSession session = engine->Session;
     XrInputProcessHaptics(input, session);
 
-    if (input->LeftControllerSpace == XR_NULL_HANDLE)
+    uint32_t buttons_left = input->ButtonsLeft;
+    uint32_t buttons_right = input->ButtonsRight;
+    XrVector2f joysticks[2] = {input->JoystickState[0].currentState, input->JoystickState[1].currentState};
+
+    // without focus every action reads inactive, release everything once
+    if (sync_result != XR_SUCCESS)
     {
-        input->LeftControllerSpace = XrInputCreateActionSpace(session, input->HandPoseLeft, input->LeftHandPath);
+        input->ButtonsLeft = 0;
+        input->ButtonsRight = 0;
+        memset(input->JoystickState, 0, sizeof(input->JoystickState));
     }
-    if (input->RightControllerSpace == XR_NULL_HANDLE)
+    else
     {
-        input->RightControllerSpace = XrInputCreateActionSpace(session, input->HandPoseRight, input->RightHandPath);
+        if (input->QueryMask & QUERY_BUTTONS)
+        {
+            // button mapping
+            input->ButtonsLeft = 0;
+            if (XrInputGetActionStateBoolean(session, input->ButtonMenu).currentState)
+                input->ButtonsLeft |= (int)Enter;
+            if (XrInputGetActionStateBoolean(session, input->ButtonX).currentState)
+                input->ButtonsLeft |= (int)X;
+            if (XrInputGetActionStateBoolean(session, input->ButtonY).currentState)
+                input->ButtonsLeft |= (int)Y;
+            if (XrInputGetActionStateBoolean(session, input->IndexLeft).currentState)
+                input->ButtonsLeft |= (int)Trigger;
+            if (XrInputGetActionStateFloat(session, input->GripLeft).currentState > 0.5f)
+                input->ButtonsLeft |= (int)Grip;
+            if (XrInputGetActionStateBoolean(session, input->ThumbLeft).currentState)
+                input->ButtonsLeft |= (int)LThumb;
+            input->ButtonsRight = 0;
+            if (XrInputGetActionStateBoolean(session, input->ButtonA).currentState)
+                input->ButtonsRight |= (int)A;
+            if (XrInputGetActionStateBoolean(session, input->ButtonB).currentState)
+                input->ButtonsRight |= (int)B;
+            if (XrInputGetActionStateBoolean(session, input->IndexRight).currentState)
+                input->ButtonsRight |= (int)Trigger;
+            if (XrInputGetActionStateFloat(session, input->GripRight).currentState > 0.5f)
+                input->ButtonsRight |= (int)Grip;
+            if (XrInputGetActionStateBoolean(session, input->ThumbRight).currentState)
+                input->ButtonsRight |= (int)RThumb;
+        }
+        else
+        {
+            input->ButtonsLeft &= (int)(Up | Down | Left | Right);
+            input->ButtonsRight &= (int)(Up | Down | Left | Right);
+        }
+
+        if (input->QueryMask & QUERY_JOYSTICKS)
+        {
+            input->JoystickState[0] = XrInputGetActionStateVector2(session, input->JoystickLeft);
+            input->JoystickState[1] = XrInputGetActionStateVector2(session, input->JoystickRight);
+        }
+        else memset(input->JoystickState, 0, sizeof(input->JoystickState));
     }
 
-    // button mapping
-    input->ButtonsLeft = 0;
-    if (XrInputGetActionStateBoolean(session, input->ButtonMenu).currentState)
-        input->ButtonsLeft |= (int)Enter;
-    if (XrInputGetActionStateBoolean(session, input->ButtonX).currentState)
-        input->ButtonsLeft |= (int)X;
-    if (XrInputGetActionStateBoolean(session, input->ButtonY).currentState)
-        input->ButtonsLeft |= (int)Y;
-    if (XrInputGetActionStateBoolean(session, input->IndexLeft).currentState)
-        input->ButtonsLeft |= (int)Trigger;
-    if (XrInputGetActionStateFloat(session, input->GripLeft).currentState > 0.5f)
-        input->ButtonsLeft |= (int)Grip;
-    if (XrInputGetActionStateBoolean(session, input->ThumbLeft).currentState)
-        input->ButtonsLeft |= (int)LThumb;
-    input->ButtonsRight = 0;
-    if (XrInputGetActionStateBoolean(session, input->ButtonA).currentState)
-        input->ButtonsRight |= (int)A;
-    if (XrInputGetActionStateBoolean(session, input->ButtonB).currentState)
-        input->ButtonsRight |= (int)B;
-    if (XrInputGetActionStateBoolean(session, input->IndexRight).currentState)
-        input->ButtonsRight |= (int)Trigger;
-    if (XrInputGetActionStateFloat(session, input->GripRight).currentState > 0.5f)
-        input->ButtonsRight |= (int)Grip;
-    if (XrInputGetActionStateBoolean(session, input->ThumbRight).currentState)
-        input->ButtonsRight |= (int)RThumb;
-
-    // thumbstick
-    input->JoystickState[0] = XrInputGetActionStateVector2(session, input->JoystickLeft);
-    input->JoystickState[1] = XrInputGetActionStateVector2(session, input->JoystickRight);
+    // thumbstick directions
+    uint32_t directions = (int)(Up | Down | Left | Right);
+    input->ButtonsLeft &= ~directions;
+    input->ButtonsRight &= ~directions;
     if (input->JoystickState[0].currentState.x > 0.5)
         input->ButtonsLeft |= (int)Right;
     if (input->JoystickState[0].currentState.x < -0.5)
@@ -256,7 +277,30 @@ void XrInputUpdate(struct XrEngine* engine, struct XrInput* input)
     if (input->JoystickState[1].currentState.y < -0.5)
         input->ButtonsRight |= (int)Down;
 
+    // let consumers skip frames where nothing changed
+    bool changed = (buttons_left != input->ButtonsLeft) || (buttons_right != input->ButtonsRight);
+    for (int i = 0; i < 2; i++)
+    {
+        XrVector2f current = input->JoystickState[i].currentState;
+        if ((current.x != joysticks[i].x) || (current.y != joysticks[i].y))
+            changed = true;
+    }
+    if (changed)
+        input->StateVersion++;
+
     // pose
+    if ((sync_result != XR_SUCCESS) || !(input->QueryMask & QUERY_POSES))
+        return;
+
+    if (input->LeftControllerSpace == XR_NULL_HANDLE)
+    {
+        input->LeftControllerSpace = XrInputCreateActionSpace(session, input->HandPoseLeft, input->LeftHandPath);
+    }
+    if (input->RightControllerSpace == XR_NULL_HANDLE)
+    {
+        input->RightControllerSpace = XrInputCreateActionSpace(session, input->HandPoseRight, input->RightHandPath);
+    }
+
     for (int i = 0; i < 2; i++)
     {
         memset(&input->ControllerPose[i], 0, sizeof(input->ControllerPose[i]));
@@ -267,6 +311,11 @@ void XrInputUpdate(struct XrEngine* engine, struct XrInput* input)
     }
 }
 
+void XrInputSetQueryMask(struct XrInput* input, uint32_t mask)
+{
+    input->QueryMask = mask;
+}
+
 void XrInputVibrate(struct XrInput* input, int duration, int chan, float intensity)
 {
     for (int i = 0; i < 2; ++i)
@@ -395,6 +444,9 @@ int XrInputGetMilliseconds(struct XrInput* input)
     return (tp.tv_sec - input->SysTimeBase) * 1000 + tp.tv_usec / 1000;
 }
 
+// Only starts, stops and amplitude changes reach the runtime. A vibration is
+// submitted once with its remaining duration, or endless for -1, instead of
+// being applied again every frame while it lasts.
 void XrInputProcessHaptics(struct XrInput* input, XrSession session)
 {
     static float last_frame_timestamp = 0.0f;
@@ -404,20 +456,29 @@ void XrInputProcessHaptics(struct XrInput* input, XrSession session)
 
     for (int i = 0; i < 2; ++i)
     {
+        XrHapticActionInfo haptic_info = {};
+        haptic_info.type = XR_TYPE_HAPTIC_ACTION_INFO;
+        haptic_info.next = NULL;
+        haptic_info.action = i == 0 ? input->VibrateLeftFeedback : input->VibrateRightFeedback;
+
         if (input->VibrationChannelDuration[i] > 0.0f || input->VibrationChannelDuration[i] == -1.0f)
         {
-            // fire haptics using output action
-            XrHapticVibration vibration = {};
-            vibration.type = XR_TYPE_HAPTIC_VIBRATION;
-            vibration.next = NULL;
-            vibration.amplitude = input->VibrationChannelIntensity[i];
-            vibration.duration = ToXrTime(input->VibrationChannelDuration[i]);
-            vibration.frequency = 3000;
-            XrHapticActionInfo haptic_info = {};
-            haptic_info.type = XR_TYPE_HAPTIC_ACTION_INFO;
-            haptic_info.next = NULL;
-            haptic_info.action = i == 0 ? input->VibrateLeftFeedback : input->VibrateRightFeedback;
-            OXR(xrApplyHapticFeedback(session, &haptic_info, (const XrHapticBaseHeader*)&vibration));
+            float amplitude = input->VibrationChannelIntensity[i];
+            if (input->HapticAmplitude[i] == 0.0f ||
+                fabsf(amplitude - input->HapticAmplitude[i]) > HAPTIC_AMPLITUDE_THRESHOLD)
+            {
+                // fire haptics using output action
+                XrHapticVibration vibration = {};
+                vibration.type = XR_TYPE_HAPTIC_VIBRATION;
+                vibration.next = NULL;
+                vibration.amplitude = amplitude;
+                vibration.duration = input->VibrationChannelDuration[i] == -1.0f ? XR_INFINITE_DURATION :
+                                     (XrDuration)(input->VibrationChannelDuration[i] * 1000000.0f);
+                vibration.frequency = 3000;
+                OXR(xrApplyHapticFeedback(session, &haptic_info, (const XrHapticBaseHeader*)&vibration));
+                // a zero amplitude still counts as started, so it is not submitted every frame
+                input->HapticAmplitude[i] = amplitude > 0.0f ? amplitude : HAPTIC_AMPLITUDE_THRESHOLD / 2;
+            }
 
             if (input->VibrationChannelDuration[i] != -1.0f)
             {
@@ -430,14 +491,11 @@ void XrInputProcessHaptics(struct XrInput* input, XrSession session)
                 }
             }
         }
-        else
+        else if (input->HapticAmplitude[i] != 0.0f)
         {
             // Stop haptics
-            XrHapticActionInfo haptic_info = {};
-            haptic_info.type = XR_TYPE_HAPTIC_ACTION_INFO;
-            haptic_info.next = NULL;
-            haptic_info.action = i == 0 ? input->VibrateLeftFeedback : input->VibrateRightFeedback;
             OXR(xrStopHapticFeedback(session, &haptic_info));
+            input->HapticAmplitude[i] = 0.0f;
         }
     }
 }
@@ -24,6 +24,15 @@ enum XrButton
     Trigger = 0x20000000  //< Index Trigger engaged
 };
 
+// Input groups the active mapping consumes, anything else is not queried
+enum XrInputQuery
+{
+    QUERY_BUTTONS = 0x1,
+    QUERY_JOYSTICKS = 0x2,
+    QUERY_POSES = 0x4,
+    QUERY_ALL = QUERY_BUTTONS | QUERY_JOYSTICKS | QUERY_POSES
+};
+
 struct XrInput {
 
     bool Initialized;
@@ -53,12 +62,15 @@ struct XrInput {
     XrSpace RightControllerSpace;
 
     // Controller state
+    uint32_t QueryMask;
+    uint32_t StateVersion; // bumped whenever buttons or thumbsticks change
     uint32_t ButtonsLeft;
     uint32_t ButtonsRight;
     XrSpaceLocation ControllerPose[2];
     XrActionStateVector2f JoystickState[2];
     float VibrationChannelDuration[2];
     float VibrationChannelIntensity[2];
+    float HapticAmplitude[2]; // last submitted to the runtime, 0 while stopped
 
     // Timer
     unsigned long SysTimeBase;
@@ -69,6 +81,7 @@ uint32_t XrInputGetButtonState(struct XrInput* input, int controller);
 XrVector2f XrInputGetJoystickState(struct XrInput* input, int controller);
 XrPosef XrInputGetPose(struct XrInput* input, int controller);
 void XrInputUpdate(struct XrEngine* engine, struct XrInput* input);
+void XrInputSetQueryMask(struct XrInput* input, uint32_t mask);
 void XrInputVibrate(struct XrInput* input, int duration, int chan, float intensity);
 
 XrAction XrInputCreateAction(XrActionSet output_set, XrActionType type, const char* name,
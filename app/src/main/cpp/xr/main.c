@@ -9,6 +9,7 @@ struct XrEngine xr_module_engine;
 struct XrInput xr_module_input;
 struct XrRenderer xr_module_renderer;
 bool xr_initialized = false;
+bool xr_quad_mode = false;
 
 #if defined(_DEBUG)
 #include <GLES2/gl2.h>
@@ -43,6 +44,7 @@ JNIEXPORT void JNICALL Java_com_winlator_XrActivity_init(JNIEnv *env, jobject ob
     xr_module_engine.PlatformFlag[PLATFORM_CONTROLLER_QUEST] = true;
     xr_module_engine.PlatformFlag[PLATFORM_EXTENSION_PASSTHROUGH] = true;
     xr_module_engine.PlatformFlag[PLATFORM_EXTENSION_PERFORMANCE] = true;
+    xr_module_engine.PlatformFlag[PLATFORM_EXTENSION_FOVEATION] = true;
 
     // Get Java VM
     JavaVM* vm;
@@ -84,29 +86,47 @@ JNIEXPORT jboolean JNICALL Java_com_winlator_XrActivity_beginFrame(JNIEnv *env,
 
         // Set render canvas
         int mode = immersive ? RENDER_MODE_MONO_6DOF : RENDER_MODE_MONO_SCREEN;
+        if (immersive && xr_quad_mode) {
+            mode = RENDER_MODE_MONO_QUAD;
+        }
         xr_module_renderer.ConfigFloat[CONFIG_CANVAS_DISTANCE] = 5.0f;
         xr_module_renderer.ConfigInt[CONFIG_PASSTHROUGH] = !immersive;
+        int last_mode = xr_module_renderer.ConfigInt[CONFIG_MODE];
         xr_module_renderer.ConfigInt[CONFIG_MODE] = mode;
         xr_module_renderer.ConfigInt[CONFIG_SBS] = sbs;
+        // GLRenderer clears and draws the desktop over the whole framebuffer itself
+        xr_module_renderer.ConfigInt[CONFIG_FULL_COVERAGE] = true;
 
         // Recenter if mode switched
-        static bool last_immersive = false;
-        if (last_immersive != immersive) {
+        if (last_mode != mode) {
             XrRendererRecenter(&xr_module_engine, &xr_module_renderer);
-            last_immersive = immersive;
         }
 
         // Update controllers state
         XrInputUpdate(&xr_module_engine, &xr_module_input);
 
-        // Lock framebuffer
-        XrRendererBeginFrame(&xr_module_renderer, 0);
+        // Lock framebuffer, stereo draws both eyes in one pass when multiview is available
+        int fbo_index = 0;
+        if ((mode == RENDER_MODE_STEREO_6DOF) && (xr_module_renderer.FramebufferCount > XrMultiviewFbo)) {
+            fbo_index = XrMultiviewFbo;
+        }
+        XrRendererBeginFrame(&xr_module_renderer, fbo_index);
 
         return true;
     }
     return false;
 }
 
+JNIEXPORT jboolean JNICALL Java_com_winlator_XrActivity_isMultiviewSupported(JNIEnv *env, jobject obj) {
+    // Shaders have to be compiled with GL_OVR_multiview2 to draw into the stereo framebuffer
+    return xr_module_renderer.FramebufferCount > XrMultiviewFbo;
+}
+
+JNIEXPORT void JNICALL Java_com_winlator_XrActivity_setQuadMode(JNIEnv *env, jobject obj, jboolean enabled) {
+    // Immersive mode submits the desktop as a world-locked quad layer instead of a projection
+    xr_quad_mode = enabled;
+}
+
 JNIEXPORT void JNICALL Java_com_winlator_XrActivity_endFrame(JNIEnv *env, jobject obj) {
     XrRendererEndFrame(&xr_module_renderer);
     XrRendererFinishFrame(&xr_module_engine, &xr_module_renderer);
@@ -120,20 +140,22 @@ JNIEXPORT jfloatArray JNICALL Java_com_winlator_XrActivity_getAxes(JNIEnv *env,
     XrVector3f lPosition = xr_module_renderer.Projections[0].pose.position;
     XrVector3f rPosition = xr_module_renderer.Projections[1].pose.position;
     XrVector3f angles = xr_module_renderer.HmdOrientation;
+    XrVector3f lAngles = XrQuaternionfEulerAngles(lPose.orientation);
+    XrVector3f rAngles = XrQuaternionfEulerAngles(rPose.orientation);
 
     int count = 0;
     float data[32];
-    data[count++] = XrQuaternionfEulerAngles(lPose.orientation).x; //L_PITCH
-    data[count++] = XrQuaternionfEulerAngles(lPose.orientation).y; //L_YAW
-    data[count++] = XrQuaternionfEulerAngles(lPose.orientation).z; //L_ROLL
+    data[count++] = lAngles.x; //L_PITCH
+    data[count++] = lAngles.y; //L_YAW
+    data[count++] = lAngles.z; //L_ROLL
     data[count++] = lThumbstick.x; //L_THUMBSTICK_X
     data[count++] = lThumbstick.y; //L_THUMBSTICK_Y
     data[count++] = lPose.position.x; //L_X
     data[count++] = lPose.position.y; //L_Y
     data[count++] = lPose.position.z; //L_Z
-    data[count++] = XrQuaternionfEulerAngles(rPose.orientation).x; //R_PITCH
-    data[count++] = XrQuaternionfEulerAngles(rPose.orientation).y; //R_YAW
-    data[count++] = XrQuaternionfEulerAngles(rPose.orientation).z; //R_ROLL
+    data[count++] = rAngles.x; //R_PITCH
+    data[count++] = rAngles.y; //R_YAW
+    data[count++] = rAngles.z; //R_ROLL
     data[count++] = rThumbstick.x; //R_THUMBSTICK_X
     data[count++] = rThumbstick.y; //R_THUMBSTICK_Y
     data[count++] = rPose.position.x; //R_X
@@ -155,6 +177,16 @@ JNIEXPORT jfloatArray JNICALL Java_com_winlator_XrActivity_getAxes(JNIEnv *env,
     return output;
 }
 
+// Bitmask of XrInputQuery groups the current mapping reads, defaults to QUERY_ALL
+JNIEXPORT void JNICALL Java_com_winlator_XrActivity_setInputQueryMask(JNIEnv *env, jobject obj, jint mask) {
+    XrInputSetQueryMask(&xr_module_input, mask);
+}
+
+// Changes whenever buttons or thumbsticks change, getButtons() only needs re-reading then
+JNIEXPORT jint JNICALL Java_com_winlator_XrActivity_getInputVersion(JNIEnv *env, jobject obj) {
+    return (jint)xr_module_input.StateVersion;
+}
+
 JNIEXPORT jbooleanArray JNICALL Java_com_winlator_XrActivity_getButtons(JNIEnv *env, jobject obj) {
     uint32_t l = XrInputGetButtonState(&xr_module_input, 0);
     uint32_t r = XrInputGetButtonState(&xr_module_input, 1);
@@ -63,18 +63,20 @@ XrQuaternionf XrQuaternionfMultiply(const XrQuaternionf a, const XrQuaternionf b
     return c;
 }
 
+// The forward, right and up vectors are the rotated axes, that is columns of the
+// rotation matrix, so they are taken straight from the quaternion instead of
+// building the 4x4 matrix and multiplying it with each axis.
 XrVector3f XrQuaternionfEulerAngles(const XrQuaternionf q)
 {
-    float M[16];
-    XrQuaternionfToMatrix4f(&q, M);
-
-    XrVector4f v1 = {0, 0, -1, 0};
-    XrVector4f v2 = {1, 0, 0, 0};
-    XrVector4f v3 = {0, 1, 0, 0};
-
-    XrVector4f forwardInVRSpace = XrVector4fMultiplyMatrix4f(M, &v1);
-    XrVector4f rightInVRSpace = XrVector4fMultiplyMatrix4f(M, &v2);
-    XrVector4f upInVRSpace = XrVector4fMultiplyMatrix4f(M, &v3);
+    const float ww = q.w * q.w;
+    const float xx = q.x * q.x;
+    const float yy = q.y * q.y;
+    const float zz = q.z * q.z;
+
+    // columns 2, 0 and 1 of XrQuaternionfToMatrix4f, the first one negated
+    XrVector3f forwardInVRSpace = {-2 * (q.x * q.z + q.w * q.y), -2 * (q.y * q.z - q.w * q.x), -(ww - xx - yy + zz)};
+    XrVector3f rightInVRSpace = {ww + xx - yy - zz, 2 * (q.x * q.y + q.w * q.z), 2 * (q.x * q.z - q.w * q.y)};
+    XrVector3f upInVRSpace = {2 * (q.x * q.y - q.w * q.z), ww - xx + yy - zz, 2 * (q.y * q.z + q.w * q.x)};
 
     XrVector3f forward = {-forwardInVRSpace.z, -forwardInVRSpace.x, forwardInVRSpace.y};
     XrVector3f right = {-rightInVRSpace.z, -rightInVRSpace.x, rightInVRSpace.y};
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <string.h>
 #include <math.h>
+#include <GLES3/gl3.h>
 #include "engine.h"
 #include "math.h"
 #include "renderer.h"
@@ -17,6 +18,85 @@ DECL_PFN(xrCreatePassthroughLayerFB);
 DECL_PFN(xrDestroyPassthroughLayerFB);
 DECL_PFN(xrPassthroughLayerPauseFB);
 DECL_PFN(xrPassthroughLayerResumeFB);
+DECL_PFN(xrCreateFoveationProfileFB);
+DECL_PFN(xrDestroyFoveationProfileFB);
+DECL_PFN(xrUpdateSwapchainFB);
+
+#define RESOLUTION_SCALE_MIN 0.6f
+#define RESOLUTION_SCALE_STEP 0.05f
+#define RESOLUTION_SCALE_COOLDOWN 30
+// Fraction of the display period the frame may take before the resolution drops
+#define FRAME_LOAD_HIGH 0.9f
+#define FRAME_LOAD_LOW 0.7f
+
+static void XrRendererInitFoveation(struct XrEngine* engine, struct XrRenderer* renderer)
+{
+    INIT_PFN(xrCreateFoveationProfileFB);
+    INIT_PFN(xrDestroyFoveationProfileFB);
+    INIT_PFN(xrUpdateSwapchainFB);
+
+    // Dynamic: the runtime only applies the full level when the GPU needs it
+    XrFoveationLevelProfileCreateInfoFB level_info = {XR_TYPE_FOVEATION_LEVEL_PROFILE_CREATE_INFO_FB};
+    level_info.level = XR_FOVEATION_LEVEL_HIGH_FB;
+    level_info.verticalOffset = 0;
+    level_info.dynamic = XR_FOVEATION_DYNAMIC_LEVEL_ENABLED_FB;
+
+    XrFoveationProfileCreateInfoFB profile_info = {XR_TYPE_FOVEATION_PROFILE_CREATE_INFO_FB};
+    profile_info.next = &level_info;
+
+    XrResult result;
+    OXR(result = xrCreateFoveationProfileFB(engine->Session, &profile_info, &renderer->FoveationProfile));
+    if (XR_FAILED(result))
+    {
+        renderer->FoveationProfile = XR_NULL_HANDLE;
+        return;
+    }
+
+    XrSwapchainStateFoveationFB foveation_state = {XR_TYPE_SWAPCHAIN_STATE_FOVEATION_FB};
+    foveation_state.profile = renderer->FoveationProfile;
+    for (int i = 0; i < renderer->FramebufferCount; i++)
+    {
+        OXR(xrUpdateSwapchainFB(renderer->Framebuffer[i].Handle,
+                                (XrSwapchainStateBaseHeaderFB*)&foveation_state));
+    }
+}
+
+static void XrRendererUpdateResolutionScale(struct XrEngine* engine, struct XrRenderer* renderer)
+{
+    if ((engine->DisplayPeriod <= 0) || (engine->FrameWorkTime <= 0))
+    {
+        return;
+    }
+
+    float load = (float)engine->FrameWorkTime / (float)engine->DisplayPeriod;
+    if (load > 2.0f)
+    {
+        load = 2.0f; // pauses and session changes
+    }
+    renderer->FrameLoad = renderer->FrameLoad * 0.9f + load * 0.1f;
+
+    if (renderer->ScaleCooldown > 0)
+    {
+        renderer->ScaleCooldown--;
+        return;
+    }
+
+    float scale = renderer->ResolutionScale;
+    if ((renderer->FrameLoad > FRAME_LOAD_HIGH) && (scale > RESOLUTION_SCALE_MIN))
+    {
+        scale = fmaxf(scale - RESOLUTION_SCALE_STEP, RESOLUTION_SCALE_MIN);
+    }
+    else if ((renderer->FrameLoad < FRAME_LOAD_LOW) && (scale < 1.0f))
+    {
+        scale = fminf(scale + RESOLUTION_SCALE_STEP, 1.0f);
+    }
+
+    if (scale != renderer->ResolutionScale)
+    {
+        renderer->ResolutionScale = scale;
+        renderer->ScaleCooldown = RESOLUTION_SCALE_COOLDOWN;
+    }
+}
 
 void XrRendererInit(struct XrEngine* engine, struct XrRenderer* renderer)
 {
@@ -81,7 +161,28 @@ void XrRendererInit(struct XrEngine* engine, struct XrRenderer* renderer)
     int height = renderer->ViewConfig[0].recommendedImageRectHeight;
     for (int i = 0; i < XrMaxNumEyes; i++)
     {
-        XrFramebufferCreate(&renderer->Framebuffer[i], engine->Session, width, height);
+        XrFramebufferCreate(&renderer->Framebuffer[i], engine->Session, width, height, false);
+    }
+    renderer->FramebufferCount = XrMaxNumEyes;
+
+    // Single pass stereo: both eyes drawn at once into the layers of one swapchain
+    const char* gl_extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (gl_extensions && strstr(gl_extensions, "GL_OVR_multiview2"))
+    {
+        if (XrFramebufferCreate(&renderer->Framebuffer[XrMultiviewFbo], engine->Session, width, height, true))
+        {
+            renderer->FramebufferCount++;
+        }
+        else if (renderer->Framebuffer[XrMultiviewFbo].Handle != XR_NULL_HANDLE)
+        {
+            XrFramebufferDestroy(&renderer->Framebuffer[XrMultiviewFbo]);
+        }
+    }
+
+    renderer->ResolutionScale = 1.0f;
+    if (engine->PlatformFlag[PLATFORM_EXTENSION_FOVEATION])
+    {
+        XrRendererInitFoveation(engine, renderer);
     }
 
     if (engine->PlatformFlag[PLATFORM_EXTENSION_PASSTHROUGH])
@@ -117,7 +218,13 @@ void XrRendererDestroy(struct XrEngine* engine, struct XrRenderer* renderer)
         renderer->Passthrough = XR_NULL_HANDLE;
     }
 
-    for (int i = 0; i < XrMaxNumEyes; i++)
+    if (renderer->FoveationProfile != XR_NULL_HANDLE)
+    {
+        OXR(xrDestroyFoveationProfileFB(renderer->FoveationProfile));
+        renderer->FoveationProfile = XR_NULL_HANDLE;
+    }
+
+    for (int i = 0; i < renderer->FramebufferCount; i++)
     {
         XrFramebufferDestroy(&renderer->Framebuffer[i]);
     }
@@ -206,6 +313,24 @@ void XrRendererGetResolution(struct XrEngine* engine, struct XrRenderer* rendere
     }
 }
 
+static void XrRendererLocateViews(struct XrEngine* engine, struct XrRenderer* renderer)
+{
+    XrViewLocateInfo projection_info = {};
+    projection_info.type = XR_TYPE_VIEW_LOCATE_INFO;
+    projection_info.next = NULL;
+    projection_info.viewConfigurationType = renderer->ViewportConfig.viewConfigurationType;
+    projection_info.displayTime = engine->PredictedDisplayTime;
+    projection_info.space = engine->CurrentSpace;
+
+    XrViewState view_state = {XR_TYPE_VIEW_STATE, NULL};
+
+    uint32_t projection_capacity = XrMaxNumEyes;
+    uint32_t projection_count = projection_capacity;
+
+    OXR(xrLocateViews(engine->Session, &projection_info, &view_state, projection_capacity,
+                      &projection_count, renderer->Projections));
+}
+
 bool XrRendererInitFrame(struct XrEngine* engine, struct XrRenderer* renderer)
 {
     if (!renderer->Initialized)
@@ -235,21 +360,8 @@ bool XrRendererInitFrame(struct XrEngine* engine, struct XrRenderer* renderer)
     }
 
     XrEngineWaitForFrame(engine);
-
-    XrViewLocateInfo projection_info = {};
-    projection_info.type = XR_TYPE_VIEW_LOCATE_INFO;
-    projection_info.next = NULL;
-    projection_info.viewConfigurationType = renderer->ViewportConfig.viewConfigurationType;
-    projection_info.displayTime = engine->PredictedDisplayTime;
-    projection_info.space = engine->CurrentSpace;
-
-    XrViewState view_state = {XR_TYPE_VIEW_STATE, NULL};
-
-    uint32_t projection_capacity = XrMaxNumEyes;
-    uint32_t projection_count = projection_capacity;
-
-    OXR(xrLocateViews(engine->Session, &projection_info, &view_state, projection_capacity,
-                      &projection_count, renderer->Projections));
+    XrRendererUpdateResolutionScale(engine, renderer);
+    XrRendererLocateViews(engine, renderer);
 
     // Get the HMD pose, predicted for the middle of the time period during which
     // the new eye images will be displayed. The number of frames predicted ahead
@@ -282,7 +394,15 @@ bool XrRendererInitFrame(struct XrEngine* engine, struct XrRenderer* renderer)
 void XrRendererBeginFrame(struct XrRenderer* renderer, int fbo_index)
 {
     renderer->ConfigInt[CONFIG_CURRENT_FBO] = fbo_index;
-    XrFramebufferAcquire(&renderer->Framebuffer[fbo_index]);
+
+    // Render into the scaled part of the image, the compositor samples only that rect
+    for (int i = 0; i < renderer->FramebufferCount; i++)
+    {
+        struct XrFramebuffer* framebuffer = &renderer->Framebuffer[i];
+        framebuffer->ViewportWidth = (int)(framebuffer->Width * renderer->ResolutionScale);
+        framebuffer->ViewportHeight = (int)(framebuffer->Height * renderer->ResolutionScale);
+    }
+    XrFramebufferAcquire(&renderer->Framebuffer[fbo_index], !renderer->ConfigInt[CONFIG_FULL_COVERAGE]);
 }
 
 void XrRendererEndFrame(struct XrRenderer* renderer)
@@ -295,24 +415,38 @@ void XrRendererFinishFrame(struct XrEngine* engine, struct XrRenderer* renderer)
 {
     int x = 0;
     int y = 0;
-    int w = renderer->Framebuffer[0].Width;
-    int h = renderer->Framebuffer[0].Height;
+    int w = renderer->Framebuffer[0].ViewportWidth;
+    int h = renderer->Framebuffer[0].ViewportHeight;
     if (renderer->ConfigInt[CONFIG_SBS])
     {
         w /= 2;
     }
 
+    // Late latch: locate the views again for the same display time right before
+    // submission, the runtime's prediction is a frame fresher now. Projection
+    // layers keep the pose they were rendered with (the compositor reprojects
+    // from it), head-locked placement and the game's head tracking use the new one.
+    XrRendererLocateViews(engine, renderer);
+    XrPosef latched_pose = renderer->Projections[0].pose;
+    renderer->HmdOrientation = XrQuaternionfEulerAngles(latched_pose.orientation);
+
     int mode = renderer->ConfigInt[CONFIG_MODE];
     XrCompositionLayerProjectionView projection_layer_elements[2] = {};
     if ((mode == RENDER_MODE_MONO_6DOF) || (mode == RENDER_MODE_STEREO_6DOF))
     {
         renderer->ConfigFloat[CONFIG_MENU_YAW] = renderer->HmdOrientation.y;
+        bool multiview = renderer->ConfigInt[CONFIG_CURRENT_FBO] == XrMultiviewFbo;
 
         for (int eye = 0; eye < XrMaxNumEyes; eye++)
         {
             struct XrFramebuffer* framebuffer = &renderer->Framebuffer[0];
             XrPosef pose = renderer->InvertedViewPose[0];
-            if (renderer->ConfigInt[CONFIG_SBS] && (eye == 1))
+            if (multiview)
+            {
+                framebuffer = &renderer->Framebuffer[XrMultiviewFbo];
+                pose = renderer->InvertedViewPose[eye];
+            }
+            else if (renderer->ConfigInt[CONFIG_SBS] && (eye == 1))
             {
                 x += w;
             }
@@ -333,7 +467,7 @@ void XrRendererFinishFrame(struct XrEngine* engine, struct XrRenderer* renderer)
             projection_layer_elements[eye].subImage.imageRect.offset.y = y;
             projection_layer_elements[eye].subImage.imageRect.extent.width = w;
             projection_layer_elements[eye].subImage.imageRect.extent.height = h;
-            projection_layer_elements[eye].subImage.imageArrayIndex = 0;
+            projection_layer_elements[eye].subImage.imageArrayIndex = multiview ? eye : 0;
         }
 
         XrCompositionLayerProjection projection_layer = {};
@@ -346,15 +480,29 @@ void XrRendererFinishFrame(struct XrEngine* engine, struct XrRenderer* renderer)
 
         renderer->Layers[renderer->LayerCount++].projection = projection_layer;
     }
-    else if ((mode == RENDER_MODE_MONO_SCREEN) || (mode == RENDER_MODE_STEREO_SCREEN))
+    else if ((mode == RENDER_MODE_MONO_SCREEN) || (mode == RENDER_MODE_STEREO_SCREEN) ||
+             (mode == RENDER_MODE_MONO_QUAD))
     {
         // Flat screen pose
         float distance = renderer->ConfigFloat[CONFIG_CANVAS_DISTANCE];
         float menu_pitch = ToRadians(renderer->ConfigFloat[CONFIG_MENU_PITCH]);
         float menu_yaw = ToRadians(renderer->ConfigFloat[CONFIG_MENU_YAW]);
-        XrVector3f pos = {renderer->InvertedViewPose[0].position.x - sinf(menu_yaw) * cosf(menu_pitch) * distance,
-                          renderer->InvertedViewPose[0].position.y - sinf(menu_pitch) * distance,
-                          renderer->InvertedViewPose[0].position.z - cosf(menu_yaw) * cosf(menu_pitch) * distance};
+        if (mode == RENDER_MODE_MONO_QUAD)
+        {
+            // Anchored in the recentered space on the first frame, head motion
+            // is left to the compositor instead of a per-eye projection pass
+            menu_pitch = 0;
+            menu_yaw = 0;
+            if (!renderer->QuadAnchored)
+            {
+                renderer->QuadAnchor = latched_pose.position;
+                renderer->QuadAnchored = true;
+            }
+            latched_pose.position = renderer->QuadAnchor;
+        }
+        XrVector3f pos = {latched_pose.position.x - sinf(menu_yaw) * cosf(menu_pitch) * distance,
+                          latched_pose.position.y - sinf(menu_pitch) * distance,
+                          latched_pose.position.z - cosf(menu_yaw) * cosf(menu_pitch) * distance};
         XrVector3f pitch_axis = {1, 0, 0};
         XrVector3f yaw_axis = {0, 1, 0};
         XrQuaternionf pitch = XrQuaternionfCreateFromVectorAngle(pitch_axis, -menu_pitch);
@@ -387,7 +535,7 @@ void XrRendererFinishFrame(struct XrEngine* engine, struct XrRenderer* renderer)
             quad_layer.subImage.imageRect.offset.x = w;
             renderer->Layers[renderer->LayerCount++].quad = quad_layer;
         }
-        else if (mode == RENDER_MODE_MONO_SCREEN)
+        else if ((mode == RENDER_MODE_MONO_SCREEN) || (mode == RENDER_MODE_MONO_QUAD))
         {
             quad_layer.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
             renderer->Layers[renderer->LayerCount++].quad = quad_layer;
@@ -434,6 +582,7 @@ void XrRendererBindFramebuffer(struct XrRenderer* renderer)
 void XrRendererRecenter(struct XrEngine* engine, struct XrRenderer* renderer)
 {
     // Calculate recenter reference
+    renderer->QuadAnchored = false;
     XrReferenceSpaceCreateInfo space_info = {};
     space_info.type = XR_TYPE_REFERENCE_SPACE_CREATE_INFO;
     space_info.poseInReferenceSpace.orientation.w = 1.0f;
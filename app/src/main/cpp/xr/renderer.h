@@ -25,6 +25,7 @@ enum XrConfigInt
     CONFIG_VIEWPORT_HEIGHT,
     // render status
     CONFIG_CURRENT_FBO,
+    CONFIG_FULL_COVERAGE, // the desktop covers the whole image, no clear needed
 
     // end
     CONFIG_INT_MAX
@@ -35,7 +36,8 @@ enum XrRenderMode
     RENDER_MODE_MONO_SCREEN,
     RENDER_MODE_STEREO_SCREEN,
     RENDER_MODE_MONO_6DOF,
-    RENDER_MODE_STEREO_6DOF
+    RENDER_MODE_STEREO_6DOF,
+    RENDER_MODE_MONO_QUAD // world-locked quad, the compositor samples the desktop directly
 };
 
 struct XrRenderer {
@@ -46,7 +48,8 @@ struct XrRenderer {
     float ConfigFloat[CONFIG_FLOAT_MAX];
     int ConfigInt[CONFIG_INT_MAX];
 
-    struct XrFramebuffer Framebuffer[XrMaxNumEyes];
+    struct XrFramebuffer Framebuffer[XrMaxNumEyes + 1];
+    int FramebufferCount; // XrMaxNumEyes, plus XrMultiviewFbo when GL_OVR_multiview2 is available
 
     int LayerCount;
     XrCompositorLayer Layers[XrMaxLayerCount];
@@ -60,6 +63,14 @@ struct XrRenderer {
     XrView* Projections;
     XrPosef InvertedViewPose[2];
     XrVector3f HmdOrientation;
+    XrVector3f QuadAnchor;
+    bool QuadAnchored;
+
+    // Dynamic resolution, driven by the frame load measured around xrWaitFrame
+    float ResolutionScale;
+    float FrameLoad;
+    int ScaleCooldown;
+    XrFoveationProfileFB FoveationProfile;
 };
 
 void XrRendererInit(struct XrEngine* engine, struct XrRenderer* renderer);
@@ -1,17 +0,0 @@
-package com.steamdeck.mobile.core.alsaserver;
-
-import com.steamdeck.mobile.core.xconnector.Client;
-import com.steamdeck.mobile.core.xconnector.ConnectionHandler;
-
-public class ALSAClientConnectionHandler implements ConnectionHandler {
-    @Override
-    public void handleNewConnection(Client client) {
-        client.createIOStreams();
-        client.setTag(new ALSAClient());
-    }
-
-    @Override
-    public void handleConnectionShutdown(Client client) {
-        ((ALSAClient)client.getTag()).release();
-    }
-}
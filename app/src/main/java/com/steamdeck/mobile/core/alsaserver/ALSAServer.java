@@ -0,0 +1,43 @@
+package com.steamdeck.mobile.core.alsaserver;
+
+// The requests of the guest ALSA plugin are handled natively (winlator/alsa_client.c): every client gets
+// a thread in the audio role that writes its periods straight into the AAudio ring, so no period passes
+// through Java. This class only starts and stops the server.
+public class ALSAServer {
+    // Indices into the array returned by getStats()
+    public enum Stat {UNDERRUNS, XRUNS, BUFFER_FILL, BUFFER_SIZE, FRAMES_PER_BURST, EXCLUSIVE, LATENCY_MILLIS}
+    private long serverPtr = 0;
+
+    static {
+        System.loadLibrary("winlator");
+    }
+
+    public synchronized boolean start(String socketPath) {
+        if (serverPtr == 0) serverPtr = startServer(socketPath);
+        return serverPtr != 0;
+    }
+
+    // Closes every client's stream before returning
+    public synchronized void stop() {
+        if (serverPtr != 0) {
+            stopServer(serverPtr);
+            serverPtr = 0;
+        }
+    }
+
+    // Stats of the most recently connected client that is prepared
+    public synchronized int[] getStats() {
+        int[] stats = new int[Stat.values().length];
+        if (serverPtr != 0) getStats(serverPtr, stats);
+        return stats;
+    }
+
+    // Mixes every stream created afterwards into one shared output stream instead of opening one each
+    public static native void setMixerEnabled(boolean enabled);
+
+    private native long startServer(String socketPath);
+
+    private native void stopServer(long serverPtr);
+
+    private native void getStats(long serverPtr, int[] stats);
+}
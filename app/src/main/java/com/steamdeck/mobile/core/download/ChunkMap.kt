@@ -0,0 +1,78 @@
+package com.steamdeck.mobile.core.download
+
+import java.io.File
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.channels.FileChannel
+
+/**
+ * Persistent record of which chunks of a parallel download are complete.
+ *
+ * Stored next to the download as "<file>.chunks": the total size and the
+ * chunk size (to detect a map left over from another download), then one
+ * byte per chunk. A chunk is marked only after its data reached the disk,
+ * so a resumed download re-fetches at most the chunks that were in flight.
+ */
+internal class ChunkMap private constructor(
+ private val channel: FileChannel,
+ val chunkSize: Long,
+ val totalSize: Long,
+ private val done: BooleanArray
+) : AutoCloseable {
+
+ companion object {
+  private const val HEADER_SIZE = 16L
+
+  fun mapFile(destFile: File) = File(destFile.path + ".chunks")
+
+  /**
+   * Opens the map of [destFile], starting over when there is none or it
+   * does not describe this download.
+   */
+  fun open(destFile: File, totalSize: Long, chunkSize: Long): ChunkMap {
+   val count = ((totalSize + chunkSize - 1) / chunkSize).toInt()
+   val channel = RandomAccessFile(mapFile(destFile), "rw").channel
+   val done = BooleanArray(count)
+
+   val header = ByteBuffer.allocate(HEADER_SIZE.toInt())
+   val valid = channel.size() == HEADER_SIZE + count &&
+    channel.read(header, 0) == HEADER_SIZE.toInt() &&
+    header.getLong(0) == totalSize && header.getLong(8) == chunkSize
+
+   if (valid) {
+    val bytes = ByteBuffer.allocate(count)
+    channel.read(bytes, HEADER_SIZE)
+    for (i in 0 until count) done[i] = bytes.get(i) != 0.toByte()
+   } else {
+    channel.truncate(0)
+    header.clear()
+    header.putLong(totalSize).putLong(chunkSize).flip()
+    channel.write(header, 0)
+    channel.write(ByteBuffer.allocate(count), HEADER_SIZE)
+   }
+   return ChunkMap(channel, chunkSize, totalSize, done)
+  }
+ }
+
+ val count: Int get() = done.size
+
+ fun isDone(index: Int): Boolean = done[index]
+
+ fun start(index: Int): Long = index * chunkSize
+
+ fun length(index: Int): Long = minOf(chunkSize, totalSize - start(index))
+
+ fun doneBytes(): Long = (0 until count).filter { done[it] }.sumOf { length(it) }
+
+ /**
+  * Positional writes, safe to call from the download threads concurrently.
+  */
+ fun markDone(index: Int) {
+  done[index] = true
+  channel.write(ByteBuffer.wrap(byteArrayOf(1)), HEADER_SIZE + index)
+ }
+
+ override fun close() {
+  channel.close()
+ }
+}
@@ -1,6 +1,8 @@
 package com.steamdeck.mobile.core.download
 
 import android.content.Context
+import android.system.ErrnoException
+import android.system.Os
 import com.steamdeck.mobile.core.logging.AppLogger
 import androidx.work.Constraints
 import androidx.work.CoroutineWorker
@@ -18,15 +20,26 @@ import dagger.assisted.Assisted
 import dagger.assisted.AssistedInject
 import dagger.hilt.android.qualifiers.ApplicationContext
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.ensureActive
 import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.map
+import kotlinx.coroutines.joinAll
+import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
 import okhttp3.OkHttpClient
 import okhttp3.Request
 import java.io.File
 import java.io.FileOutputStream
+import java.io.IOException
 import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.channels.FileChannel
 import java.util.UUID
+import java.util.concurrent.ConcurrentLinkedQueue
+import java.util.concurrent.atomic.AtomicLong
 import javax.inject.Inject
 import javax.inject.Singleton
 import kotlin.math.min
@@ -200,7 +213,8 @@ data class DownloadProgress(
 /**
  * downloadWorker
  *
- * Support chunked download
+ * Support chunked download: parallel range requests when the server
+ * accepts them, a sequential chunk loop otherwise
  */
 class DownloadWorker @AssistedInject constructor(
  @Assisted context: Context,
@@ -218,6 +232,9 @@ class DownloadWorker @AssistedInject constructor(
   private const val TAG = "DownloadWorker"
   private const val CHUNK_SIZE = 8 * 1024 * 1024L // 8MB
   private const val SPEED_SAMPLE_INTERVAL_MS = 1000L // Calculate speed every second
+  private const val PARALLEL_CONNECTIONS = 4
+  private const val MAX_CHUNK_ATTEMPTS = 3
+  private const val WRITE_BUFFER_SIZE = 256 * 1024
  }
 
  private var lastSpeedUpdateTime = 0L
@@ -238,7 +255,8 @@ class DownloadWorker @AssistedInject constructor(
    database.downloadDao().updateDownloadStatus(downloadId, DownloadStatus.DOWNLOADING)
 
    // Get file size
-   val totalSize = getFileSize(url)
+   val remoteFile = getRemoteFile(url)
+   val totalSize = remoteFile.size
    database.downloadDao().updateDownloadTotalBytes(
     downloadId = downloadId,
     totalBytes = totalSize,
@@ -254,13 +272,33 @@ class DownloadWorker @AssistedInject constructor(
    destFile.parentFile?.mkdirs()
 
    // Download file with chunking
-   downloadFileChunked(
-    url = url,
-    destFile = destFile,
-    startByte = startByte,
-    totalSize = totalSize,
-    downloadId = downloadId
-   )
+   if (remoteFile.acceptsRanges && totalSize > 0) {
+    downloadFileParallel(
+     url = url,
+     destFile = destFile,
+     totalSize = totalSize,
+     downloadId = downloadId
+    )
+   } else {
+    // A parallel attempt counts its completed chunks, not a contiguous
+    // prefix, so its progress can't be resumed from sequentially
+    val chunkMap = ChunkMap.mapFile(destFile)
+    val resumeByte = if (chunkMap.exists()) {
+     AppLogger.w(TAG, "Ranges no longer available, restarting ${destFile.name} from 0")
+     RandomAccessFile(destFile, "rw").use { it.setLength(0) }
+     chunkMap.delete()
+     0L
+    } else {
+     startByte
+    }
+    downloadFileChunked(
+     url = url,
+     destFile = destFile,
+     startByte = resumeByte,
+     totalSize = totalSize,
+     downloadId = downloadId
+    )
+   }
 
    // Mark as completed with 100% progress
    database.downloadDao().updateDownloadProgress(
@@ -324,15 +362,163 @@ class DownloadWorker @AssistedInject constructor(
   }
  }
 
- private suspend fun getFileSize(url: String): Long {
+ private data class RemoteFile(val size: Long, val acceptsRanges: Boolean)
+
+ private suspend fun getRemoteFile(url: String): RemoteFile {
   val request = Request.Builder()
    .url(url)
    .head()
    .build()
 
   okHttpClient.newCall(request).execute().use { response ->
-   return response.header("Content-Length")?.toLongOrNull() ?: 0L
+   return RemoteFile(
+    size = response.header("Content-Length")?.toLongOrNull() ?: 0L,
+    acceptsRanges = response.header("Accept-Ranges")?.contains("bytes") == true
+   )
+  }
+ }
+
+ /**
+  * Downloads the chunks over [PARALLEL_CONNECTIONS] range requests at once,
+  * each written in place (positional writes) into the preallocated file.
+  * Completed chunks are recorded in a [ChunkMap], so a resumed download only
+  * fetches the rest. Progress is reported once per [SPEED_SAMPLE_INTERVAL_MS]
+  * rather than from the download threads.
+  */
+ private suspend fun downloadFileParallel(
+  url: String,
+  destFile: File,
+  totalSize: Long,
+  downloadId: Long
+ ) {
+  val chunkSize = DownloadManager.calculateOptimalChunkSize(totalSize)
+
+  ChunkMap.open(destFile, totalSize, chunkSize).use { chunks ->
+   RandomAccessFile(destFile, "rw").use { file ->
+    preallocate(file, totalSize)
+
+    val pending = ConcurrentLinkedQueue((0 until chunks.count).filter { !chunks.isDone(it) })
+    val downloaded = AtomicLong(chunks.doneBytes())
+    AppLogger.i(TAG, "Parallel download: ${pending.size} of ${chunks.count} chunks (${chunkSize / 1024 / 1024}MB) pending")
+
+    coroutineScope {
+     val reporter = launch {
+      lastSpeedUpdateTime = System.currentTimeMillis()
+      lastDownloadedBytes = downloaded.get()
+      while (true) {
+       delay(SPEED_SAMPLE_INTERVAL_MS)
+       reportProgress(downloadId, downloaded.get(), totalSize)
+      }
+     }
+
+     List(min(PARALLEL_CONNECTIONS, pending.size)) {
+      launch {
+       val buffer = ByteArray(WRITE_BUFFER_SIZE)
+       while (true) {
+        val index = pending.poll() ?: break
+        downloadChunk(url, file.channel, chunks, index, buffer, downloaded)
+       }
+      }
+     }.joinAll()
+     reporter.cancel()
+    }
+   }
   }
+  ChunkMap.mapFile(destFile).delete()
+ }
+
+ /**
+  * Fetches one chunk, retried [MAX_CHUNK_ATTEMPTS] times before the whole
+  * download fails.
+  */
+ private suspend fun downloadChunk(
+  url: String,
+  channel: FileChannel,
+  chunks: ChunkMap,
+  index: Int,
+  buffer: ByteArray,
+  downloaded: AtomicLong
+ ) {
+  val start = chunks.start(index)
+  val length = chunks.length(index)
+  var attempt = 0
+
+  while (true) {
+   var written = 0L
+   try {
+    val request = Request.Builder()
+     .url(url)
+     .header("Range", "bytes=$start-${start + length - 1}")
+     .build()
+
+    okHttpClient.newCall(request).execute().use { response ->
+     // 200 would be the whole file, not this chunk
+     if (response.code != 206) {
+      throw IOException("Range request failed: ${response.code}")
+     }
+     val input = response.body?.byteStream()
+      ?: throw IOException("Response body is null")
+
+     var bytesRead: Int
+     while (input.read(buffer).also { bytesRead = it } != -1) {
+      currentCoroutineContext().ensureActive()
+      if (written + bytesRead > length) {
+       throw IOException("Chunk $index overruns its range")
+      }
+      val data = ByteBuffer.wrap(buffer, 0, bytesRead)
+      while (data.hasRemaining()) {
+       channel.write(data, start + written + data.position())
+      }
+      written += bytesRead
+      downloaded.addAndGet(bytesRead.toLong())
+     }
+    }
+    if (written != length) {
+     throw IOException("Chunk $index truncated: $written of $length bytes")
+    }
+
+    // Only a chunk on disk may be marked, or a resume would skip it
+    channel.force(false)
+    chunks.markDone(index)
+    return
+   } catch (e: IOException) {
+    downloaded.addAndGet(-written)
+    if (++attempt >= MAX_CHUNK_ATTEMPTS) throw e
+    AppLogger.w(TAG, "Chunk $index failed (attempt $attempt), retrying: ${e.message}")
+   }
+  }
+ }
+
+ private fun preallocate(file: RandomAccessFile, size: Long) {
+  if (file.length() > size) file.setLength(size)
+  try {
+   Os.posix_fallocate(file.fd, 0, size)
+  } catch (e: ErrnoException) {
+   // Not supported by the filesystem: sparse file
+   file.setLength(size)
+  }
+ }
+
+ private suspend fun reportProgress(downloadId: Long, downloadedBytes: Long, totalSize: Long) {
+  val currentTime = System.currentTimeMillis()
+  val elapsedTime = currentTime - lastSpeedUpdateTime
+  val speed = if (elapsedTime > 0) (downloadedBytes - lastDownloadedBytes) * 1000 / elapsedTime else 0L
+  lastSpeedUpdateTime = currentTime
+  lastDownloadedBytes = downloadedBytes
+
+  val progressPercent = ((downloadedBytes * 100) / totalSize).toInt()
+  database.downloadDao().updateDownloadProgress(
+   downloadId = downloadId,
+   downloadedBytes = downloadedBytes,
+   progress = progressPercent,
+   updatedAt = currentTime
+  )
+  setProgress(
+   workDataOf(
+    "progress" to progressPercent,
+    "speed" to speed
+   )
+  )
  }
 
  private suspend fun downloadFileChunked(
@@ -1,5 +1,6 @@
 package com.steamdeck.mobile.core.input
 
+import android.view.InputDevice
 import android.view.KeyEvent
 import android.view.MotionEvent
 import com.steamdeck.mobile.core.logging.AppLogger
@@ -38,6 +39,9 @@ import kotlin.math.abs
  * - Target latency: <15ms (hardware → Wine)
  * - Event batching for analog axes (reduces JNI overhead)
  * - Deadzone filtering (only send on >1% change)
+ * - Game rumble plays on the controller that last sent input
+ * - evdev passthrough: when the physical pad's /dev/input node is readable, a native
+ *   thread forwards it directly and its InputDevice events are ignored here
  */
 @Singleton
 class ControllerInputRouter @Inject constructor(
@@ -63,6 +67,10 @@ class ControllerInputRouter @Inject constructor(
     // Cache previous axis values to filter noise
     private val previousAxisValues = mutableMapOf<Pair<Int, Int>, Float>()
 
+    // Android device IDs already probed for evdev passthrough, and the one being forwarded natively
+    private val probedDevices = mutableSetOf<Int>()
+    private var passthroughDeviceId: Int? = null
+
     /**
      * Start routing controller events
      * Called when game launches
@@ -117,11 +125,16 @@ class ControllerInputRouter @Inject constructor(
         routingJob = null
 
         if (usingNativeUInput) {
+            nativeUInputBridge.rumbleDeviceId = null
             nativeUInputBridge.cleanup()
             usingNativeUInput = false
         }
 
         previousAxisValues.clear()
+        synchronized(probedDevices) {
+            probedDevices.clear()
+            passthroughDeviceId = null
+        }
         isRouting = false
 
         AppLogger.i(TAG, "Controller routing stopped")
@@ -164,6 +177,9 @@ class ControllerInputRouter @Inject constructor(
      * Maps Android KeyEvent → Xbox button code → uinput
      */
     private fun handleButtonEvent(event: ButtonEvent) {
+        nativeUInputBridge.rumbleDeviceId = event.deviceId
+        if (isPassthroughDevice(event.deviceId)) return
+
         val xboxButton = mapAndroidKeyToXboxButton(event.button)
         if (xboxButton == null) {
             AppLogger.v(TAG, "Unmapped button: ${event.button}")
@@ -181,6 +197,9 @@ class ControllerInputRouter @Inject constructor(
      * Applies deadzone, filters noise, maps to evdev codes
      */
     private fun handleAxisEvent(event: AxisEvent) {
+        nativeUInputBridge.rumbleDeviceId = event.deviceId
+        if (isPassthroughDevice(event.deviceId)) return
+
         // Apply deadzone
         val adjustedValue = applyDeadzone(event.value, DEFAULT_DEADZONE)
 
@@ -205,6 +224,25 @@ class ControllerInputRouter @Inject constructor(
         }
     }
 
+    /**
+     * Whether a device is forwarded by the native evdev passthrough thread
+     * Probes each device once; only one device can drive the default virtual controller.
+     */
+    private fun isPassthroughDevice(deviceId: Int): Boolean {
+        synchronized(probedDevices) {
+            if (!probedDevices.add(deviceId)) return deviceId == passthroughDeviceId
+            if (passthroughDeviceId != null) return false
+
+            val device = InputDevice.getDevice(deviceId) ?: return false
+            if (nativeUInputBridge.startPassthrough(device.vendorId, device.productId)) {
+                AppLogger.i(TAG, "✓ evdev passthrough for ${device.name}")
+                passthroughDeviceId = deviceId
+                return true
+            }
+            return false
+        }
+    }
+
     /**
      * Map Android KeyEvent code to Xbox button code
      *
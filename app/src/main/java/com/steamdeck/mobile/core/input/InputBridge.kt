@@ -2,6 +2,10 @@ package com.steamdeck.mobile.core.input
 
 import android.content.Context
 import android.content.pm.PackageManager
+import android.os.VibrationEffect
+import android.os.Vibrator
+import android.view.InputDevice
+import androidx.annotation.Keep
 import com.steamdeck.mobile.core.logging.AppLogger
 import dagger.hilt.android.qualifiers.ApplicationContext
 import java.io.File
@@ -199,6 +203,12 @@ class NativeUInputBridge @Inject constructor(
   private const val XBOX360_VENDOR_ID = 0x045e
   private const val XBOX360_PRODUCT_ID = 0x028e
 
+  // Segment length of the looping waveform used for rumble without a set duration
+  private const val RUMBLE_LOOP_MS = 1000L
+
+  // Motion sensor sample rate, what most phone IMUs deliver without batching
+  private const val MOTION_RATE_HZ = 400
+
   init {
    try {
     System.loadLibrary("uinput_bridge")
@@ -212,6 +222,12 @@ class NativeUInputBridge @Inject constructor(
  private var isInitialized = false
  private var controllerId: Int = -1
 
+ /**
+  * Android InputDevice ID whose vibrator plays game rumble (phone vibrator if null or without one)
+  */
+ @Volatile
+ var rumbleDeviceId: Int? = null
+
  // Native methods (implemented in uinput_jni.c)
  private external fun nativeInit(): Boolean
  private external fun nativeCreateVirtualController(
@@ -219,8 +235,27 @@ class NativeUInputBridge @Inject constructor(
   vendorId: Int,
   productId: Int
  ): Int
- private external fun nativeSendButtonEvent(button: Int, pressed: Boolean): Boolean
- private external fun nativeSendAxisEvent(axis: Int, value: Float): Boolean
+ private external fun nativeSendButtonEvent(controllerId: Int, button: Int, pressed: Boolean): Boolean
+ private external fun nativeSendAxisEvent(controllerId: Int, axis: Int, value: Float): Boolean
+ private external fun nativeSendState(controllerId: Int, buttons: Int, axes: FloatArray): Boolean
+ private external fun nativeStartPassthrough(
+  controllerId: Int,
+  vendorId: Int,
+  productId: Int,
+  grab: Boolean
+ ): Boolean
+ private external fun nativeStopPassthrough(controllerId: Int)
+ private external fun nativeStartMotion(
+  controllerId: Int,
+  name: String,
+  vendorId: Int,
+  productId: Int,
+  packageName: String,
+  rateHz: Int
+ ): Boolean
+ private external fun nativeSetMotionRotation(controllerId: Int, rotation: Int)
+ private external fun nativeStopMotion(controllerId: Int)
+ private external fun nativeDestroyController(controllerId: Int)
  private external fun nativeDestroy()
 
  override fun initialize(): Result<Unit> {
@@ -283,32 +318,180 @@ class NativeUInputBridge @Inject constructor(
   }
  }
 
+ /**
+  * Create an additional virtual controller (up to 4 in total, including the default one)
+  * @param name Device name reported to the kernel
+  * @return Controller ID on success, -1 on failure
+  */
+ fun createController(
+  name: String,
+  vendorId: Int = XBOX360_VENDOR_ID,
+  productId: Int = XBOX360_PRODUCT_ID
+ ): Int {
+  if (!isInitialized) {
+   AppLogger.w(TAG, "Not initialized, cannot create controller")
+   return -1
+  }
+  return nativeCreateVirtualController(name, vendorId, productId)
+ }
+
+ /**
+  * Destroy a controller created by createController()
+  * @param id Controller ID returned by createController()
+  */
+ fun destroyController(id: Int) {
+  if (!isInitialized || id == controllerId) {
+   AppLogger.w(TAG, "Cannot destroy controller $id")
+   return
+  }
+  nativeDestroyController(id)
+ }
+
+ /**
+  * Forward a physical gamepad to a virtual controller from a native thread reading its evdev node
+  * (bypasses InputDevice callbacks and JNI per event). Needs read access to /dev/input/event*.
+  * @param vendorId Physical device vendor ID (InputDevice.vendorId)
+  * @param productId Physical device product ID (InputDevice.productId)
+  * @param grab true to take the node exclusively (Android stops receiving its events)
+  * @param id Target controller (default controller if omitted)
+  * @return true if the node was found and forwarding started, false otherwise
+  */
+ fun startPassthrough(vendorId: Int, productId: Int, grab: Boolean = false, id: Int = controllerId): Boolean {
+  if (!isInitialized) {
+   AppLogger.w(TAG, "Not initialized, cannot start passthrough")
+   return false
+  }
+  return nativeStartPassthrough(id, vendorId, productId, grab)
+ }
+
+ /**
+  * Stop evdev passthrough started by startPassthrough()
+  * @param id Target controller (default controller if omitted)
+  */
+ fun stopPassthrough(id: Int = controllerId) {
+  if (isInitialized) nativeStopPassthrough(id)
+ }
+
+ /**
+  * Add a motion sensor device (accelerometer + gyroscope, INPUT_PROP_ACCELEROMETER) next to a
+  * virtual controller, fed from the phone's sensors by a native thread (no JNI per sample)
+  * @param rateHz Sensor sample rate, limited by the sensors
+  * @param name Name of the controller, the device is called "<name> Motion Sensors"
+  * @param id Target controller (default controller if omitted)
+  * @return true if the device was created and the sensors started, false otherwise
+  */
+ fun startMotion(
+  rateHz: Int = MOTION_RATE_HZ,
+  name: String = "Steam Deck Mobile Controller",
+  vendorId: Int = XBOX360_VENDOR_ID,
+  productId: Int = XBOX360_PRODUCT_ID,
+  id: Int = controllerId
+ ): Boolean {
+  if (!isInitialized) {
+   AppLogger.w(TAG, "Not initialized, cannot start motion")
+   return false
+  }
+  return nativeStartMotion(id, name, vendorId, productId, context.packageName, rateHz)
+ }
+
+ /**
+  * Map motion axes to the display, call when it rotates
+  * @param rotation Display.rotation (Surface.ROTATION_0 ~ ROTATION_270)
+  * @param id Target controller (default controller if omitted)
+  */
+ fun setMotionRotation(rotation: Int, id: Int = controllerId) {
+  if (isInitialized) nativeSetMotionRotation(id, rotation)
+ }
+
+ /**
+  * Stop the motion sensor device started by startMotion()
+  * @param id Target controller (default controller if omitted)
+  */
+ fun stopMotion(id: Int = controllerId) {
+  if (isInitialized) nativeStopMotion(id)
+ }
+
+ /**
+  * Rumble from a game (EV_FF on a virtual controller), called from the native
+  * force-feedback threads already coalesced to one update per 16ms
+  * @param strong Strong motor 0 ~ 65535
+  * @param weak Weak motor 0 ~ 65535
+  * @param durationMs Time until the native mix changes on its own, -1 until the next call
+  */
+ @Keep
+ @Suppress("unused")
+ private fun onRumble(controllerId: Int, strong: Int, weak: Int, durationMs: Int) {
+  val deviceVibrator = rumbleDeviceId?.let { InputDevice.getDevice(it) }?.vibrator
+  val vibrator = if (deviceVibrator?.hasVibrator() == true) {
+   deviceVibrator
+  } else {
+   context.getSystemService(Vibrator::class.java)
+  }
+  if (vibrator == null || !vibrator.hasVibrator()) return
+
+  // Single-motor vibrators: play the stronger of the two motors
+  val magnitude = maxOf(strong, weak)
+  if (magnitude == 0) {
+   vibrator.cancel()
+   return
+  }
+
+  val amplitude = if (vibrator.hasAmplitudeControl()) {
+   (magnitude * 255 / 65535).coerceIn(1, 255)
+  } else {
+   VibrationEffect.DEFAULT_AMPLITUDE
+  }
+  val effect = if (durationMs > 0) {
+   VibrationEffect.createOneShot(durationMs.toLong(), amplitude)
+  } else {
+   VibrationEffect.createWaveform(longArrayOf(RUMBLE_LOOP_MS), intArrayOf(amplitude), 0)
+  }
+  vibrator.vibrate(effect)
+ }
+
  /**
   * Send button event
   * @param button Xbox button code (BTN_A=304, BTN_B=305, etc.)
   * @param pressed true for press, false for release
+  * @param id Target controller (default controller if omitted)
   * @return true on success, false on failure
   */
- fun sendButtonEvent(button: Int, pressed: Boolean): Boolean {
+ fun sendButtonEvent(button: Int, pressed: Boolean, id: Int = controllerId): Boolean {
   if (!isInitialized) {
    AppLogger.w(TAG, "Not initialized, cannot send button event")
    return false
   }
-  return nativeSendButtonEvent(button, pressed)
+  return nativeSendButtonEvent(id, button, pressed)
  }
 
  /**
   * Send axis event
   * @param axis evdev axis code (ABS_X=0, ABS_Y=1, etc.)
   * @param value -1.0 ~ 1.0 (Android value)
+  * @param id Target controller (default controller if omitted)
   * @return true on success, false on failure
   */
- fun sendAxisEvent(axis: Int, value: Float): Boolean {
+ fun sendAxisEvent(axis: Int, value: Float, id: Int = controllerId): Boolean {
   if (!isInitialized) {
    AppLogger.w(TAG, "Not initialized, cannot send axis event")
    return false
   }
-  return nativeSendAxisEvent(axis, value)
+  return nativeSendAxisEvent(id, axis, value)
+ }
+
+ /**
+  * Send complete gamepad state in one write (only changed inputs, single SYN_REPORT)
+  * @param buttons Bitmask of pressed buttons, bit N = STATE_BUTTONS[N]
+  * @param axes 8 values in STATE_AXES order: sticks -1.0 ~ 1.0, triggers 0.0 ~ 1.0, D-pad -1/0/1
+  * @param id Target controller (default controller if omitted)
+  * @return true on success, false on failure
+  */
+ fun sendState(buttons: Int, axes: FloatArray, id: Int = controllerId): Boolean {
+  if (!isInitialized) {
+   AppLogger.w(TAG, "Not initialized, cannot send state")
+   return false
+  }
+  return nativeSendState(id, buttons, axes)
  }
 
  /**
@@ -361,6 +544,12 @@ object XboxButtonCodes {
  const val BTN_MODE = 0x13c   // 316 (Xbox button)
  const val BTN_THUMBL = 0x13d // 317 (Left stick press)
  const val BTN_THUMBR = 0x13e // 318 (Right stick press)
+
+ /** Bit order of NativeUInputBridge.sendState() buttons (matches button_codes in uinput_bridge.c) */
+ val STATE_BUTTONS = intArrayOf(
+  BTN_A, BTN_B, BTN_X, BTN_Y, BTN_TL, BTN_TR,
+  BTN_SELECT, BTN_START, BTN_MODE, BTN_THUMBL, BTN_THUMBR
+ )
 }
 
 /**
@@ -375,6 +564,9 @@ object EvdevAxisCodes {
  const val ABS_RZ = 0x05    // 5 (Right trigger)
  const val ABS_HAT0X = 0x10 // 16 (D-pad X)
  const val ABS_HAT0Y = 0x11 // 17 (D-pad Y)
+
+ /** Axis order of NativeUInputBridge.sendState() (matches axis_codes in uinput_bridge.c) */
+ val STATE_AXES = intArrayOf(ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_HAT0X, ABS_HAT0Y)
 }
 
 /**
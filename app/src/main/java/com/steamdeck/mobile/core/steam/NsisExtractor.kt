@@ -2,19 +2,29 @@ package com.steamdeck.mobile.core.steam
 
 import com.steamdeck.mobile.core.logging.AppLogger
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
 import kotlinx.coroutines.withContext
+import net.sf.sevenzipjbinding.ExtractAskMode
 import net.sf.sevenzipjbinding.ExtractOperationResult
+import net.sf.sevenzipjbinding.IArchiveExtractCallback
 import net.sf.sevenzipjbinding.IInArchive
 import net.sf.sevenzipjbinding.ISequentialOutStream
+import net.sf.sevenzipjbinding.PropID
 import net.sf.sevenzipjbinding.SevenZip
 import net.sf.sevenzipjbinding.SevenZipException
 import net.sf.sevenzipjbinding.impl.RandomAccessFileInStream
-import net.sf.sevenzipjbinding.simple.ISimpleInArchiveItem
+import java.io.BufferedOutputStream
 import java.io.File
 import java.io.FileOutputStream
+import java.io.IOException
+import java.io.OutputStream
 import java.io.RandomAccessFile
+import java.util.concurrent.atomic.AtomicInteger
 import javax.inject.Inject
 import javax.inject.Singleton
+import kotlin.math.min
 
 /**
  * NSIS installer extractor using 7-Zip-JBinding-4Android
@@ -27,11 +37,15 @@ import javax.inject.Singleton
  * - Supports all NSIS compression formats (LZMA, BZIP2, ZLIB/Deflate)
  * - Extracts ~132 files including Steam.exe, steamclient.dll, libcef.dll, etc.
  * - Total extracted size: ~180MB
+ * - One extract() pass per archive instance; non-solid archives are split
+ *   across several instances extracting concurrently
  */
 @Singleton
 class NsisExtractor @Inject constructor() {
  companion object {
   private const val TAG = "NsisExtractor"
+  private const val MAX_WORKERS = 4
+  private const val OUTPUT_BUFFER_SIZE = 1024 * 1024
  }
 
  /**
@@ -62,88 +76,111 @@ class NsisExtractor @Inject constructor() {
     targetDir.mkdirs()
    }
 
-   var archive: IInArchive? = null
-   var randomAccessFile: RandomAccessFile? = null
-   var filesExtracted = 0
+   // Solid archives decode as one stream, so one pass in index order is
+   // all there is; independent items are split across archive instances
+   val (totalFiles, indices, solid) = withArchive(nsisFile) { archive ->
+    val indices = (0 until archive.numberOfItems).filter { index ->
+     val path = archive.getProperty(index, PropID.PATH) as String?
+     archive.getProperty(index, PropID.IS_FOLDER) != true && path != null && !shouldSkip(path)
+    }
+    val solid = archive.getArchiveProperty(PropID.SOLID) == true
+    Triple(archive.numberOfItems, indices, solid)
+   }
+   val workers = if (solid || indices.size < 2) 1 else min(MAX_WORKERS, Runtime.getRuntime().availableProcessors())
+   AppLogger.i(TAG, "Found $totalFiles items in NSIS archive (${if (solid) "solid" else "non-solid"}, $workers workers)")
+
+   val filesExtracted = AtomicInteger(0)
+   val reportProgress: () -> Unit = {
+    val extracted = filesExtracted.incrementAndGet()
+    // Report progress every 5 files OR on first/last file
+    if (extracted == 1 || extracted % 5 == 0 || extracted == indices.size) {
+     synchronized(filesExtracted) { progressCallback?.invoke(extracted, totalFiles) }
+    }
+   }
 
-   try {
-    // Open NSIS archive using 7-Zip
-    randomAccessFile = RandomAccessFile(nsisFile, "r")
-    val inStream = RandomAccessFileInStream(randomAccessFile)
-
-    // Auto-detect archive format (NSIS)
-    archive = SevenZip.openInArchive(null, inStream)
-
-    val totalFiles = archive.numberOfItems
-    AppLogger.i(TAG, "Found $totalFiles items in NSIS archive")
-
-    // Extract all items with frequent progress updates
-    // Update progress every 5 files (instead of 10) for smoother UI feedback
-    for (item in archive.simpleInterface.archiveItems) {
-     if (!item.isFolder) {
-      extractItem(item, targetDir)
-      filesExtracted++
-
-      // Report progress every 5 files OR on first/last file
-      if (filesExtracted == 1 || filesExtracted % 5 == 0 || filesExtracted == totalFiles) {
-       progressCallback?.invoke(filesExtracted, totalFiles)
-       AppLogger.d(TAG, "Extracted $filesExtracted/$totalFiles files (${filesExtracted * 100 / totalFiles}%)")
+   coroutineScope {
+    (0 until workers).map { worker ->
+     async {
+      val slice = indices.filterIndexed { i, _ -> i % workers == worker }.toIntArray()
+      withArchive(nsisFile) { archive ->
+       archive.extract(slice, false, ExtractCallback(archive, targetDir, reportProgress))
       }
      }
-    }
-
-    // Final progress update
-    progressCallback?.invoke(filesExtracted, totalFiles)
-    AppLogger.i(TAG, "NSIS extraction completed: $filesExtracted files extracted")
-    Result.success(filesExtracted)
-
-   } finally {
-    archive?.close()
-    randomAccessFile?.close()
+    }.awaitAll()
    }
 
+   // Final progress update
+   progressCallback?.invoke(filesExtracted.get(), totalFiles)
+   AppLogger.i(TAG, "NSIS extraction completed: ${filesExtracted.get()} files extracted")
+   Result.success(filesExtracted.get())
+
   } catch (e: Exception) {
    AppLogger.e(TAG, "NSIS extraction failed", e)
    Result.failure(e)
   }
  }
 
+ private inline fun <T> withArchive(nsisFile: File, block: (IInArchive) -> T): T =
+  RandomAccessFile(nsisFile, "r").use { randomAccessFile ->
+   // Auto-detect archive format (NSIS)
+   val archive = SevenZip.openInArchive(null, RandomAccessFileInStream(randomAccessFile))
+   try {
+    block(archive)
+   } finally {
+    archive.close()
+   }
+  }
+
  /**
-  * Extract a single item from archive
-  * Uses streaming extraction to avoid OutOfMemoryError on large files (e.g., 281MB bins_cef_win32.zip)
+  * Writes the items of one IInArchive.extract() pass to their files.
+  *
+  * A single extract() call decodes a solid block once, where extractSlow()
+  * per item restarts it for every item. Output goes through a large buffer,
+  * 7-Zip hands out small pieces.
   */
- private fun extractItem(item: ISimpleInArchiveItem, targetDir: File) {
-  val itemPath = item.path ?: return
-
-  // Skip certain directories/files we don't need
-  if (shouldSkip(itemPath)) {
-   return
+ private class ExtractCallback(
+  private val archive: IInArchive,
+  private val targetDir: File,
+  private val onItemExtracted: () -> Unit
+ ) : IArchiveExtractCallback {
+  private var output: OutputStream? = null
+  private var path: String? = null
+
+  override fun getStream(index: Int, extractAskMode: ExtractAskMode): ISequentialOutStream? {
+   if (extractAskMode != ExtractAskMode.EXTRACT) return null
+   val itemPath = archive.getProperty(index, PropID.PATH) as String? ?: return null
+
+   val targetFile = File(targetDir, itemPath)
+   targetFile.parentFile?.mkdirs()
+   val stream = BufferedOutputStream(FileOutputStream(targetFile), OUTPUT_BUFFER_SIZE)
+   output = stream
+   path = itemPath
+   return ISequentialOutStream { data ->
+    stream.write(data)
+    data.size
+   }
   }
 
-  val targetFile = File(targetDir, itemPath)
-
-  // Create parent directories
-  targetFile.parentFile?.mkdirs()
+  override fun prepareOperation(extractAskMode: ExtractAskMode) {}
 
-  // Extract file using streaming ISequentialOutStream (memory-efficient, 64KB chunks)
-  val outputStream = FileOutputStream(targetFile)
-  try {
-   val sequentialOutStream = object : ISequentialOutStream {
-    override fun write(data: ByteArray): Int {
-     outputStream.write(data)
-     return data.size
-    }
+  override fun setOperationResult(extractOperationResult: ExtractOperationResult) {
+   val stream = output ?: return
+   output = null
+   try {
+    stream.close()
+   } catch (e: IOException) {
+    throw SevenZipException("Writing $path failed", e)
    }
-
-   val result = item.extractSlow(sequentialOutStream)
-   if (result != ExtractOperationResult.OK) {
-    throw Exception("Extraction failed with result: $result")
+   if (extractOperationResult != ExtractOperationResult.OK) {
+    throw SevenZipException("Extraction of $path failed with result: $extractOperationResult")
    }
-
-   AppLogger.d(TAG, "Extracted: $itemPath (${targetFile.length()} bytes)")
-  } finally {
-   outputStream.close()
+   AppLogger.d(TAG, "Extracted: $path")
+   onItemExtracted()
   }
+
+  override fun setTotal(total: Long) {}
+
+  override fun setCompleted(complete: Long) {}
  }
 
  /**
@@ -1,7 +0,0 @@
-package com.steamdeck.mobile.core.sysvshm;
-
-public abstract class RequestCodes {
-    public static final byte SHMGET = 0;
-    public static final byte GET_FD = 1;
-    public static final byte DELETE = 2;
-}
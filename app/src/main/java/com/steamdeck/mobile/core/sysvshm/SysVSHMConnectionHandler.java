@@ -1,21 +0,0 @@
-package com.steamdeck.mobile.core.sysvshm;
-
-import com.steamdeck.mobile.core.xconnector.Client;
-import com.steamdeck.mobile.core.xconnector.ConnectionHandler;
-
-public class SysVSHMConnectionHandler implements ConnectionHandler {
-    private final SysVSharedMemory sysVSharedMemory;
-
-    public SysVSHMConnectionHandler(SysVSharedMemory sysVSharedMemory) {
-        this.sysVSharedMemory = sysVSharedMemory;
-    }
-
-    @Override
-    public void handleNewConnection(Client client) {
-        client.createIOStreams();
-        client.setTag(sysVSharedMemory);
-    }
-
-    @Override
-    public void handleConnectionShutdown(Client client) {}
-}
@@ -0,0 +1,212 @@
+package com.steamdeck.mobile.core.winlator
+
+import android.content.Context
+import android.system.ErrnoException
+import android.system.Os
+import android.system.OsConstants
+import com.steamdeck.mobile.core.logging.AppLogger
+import dagger.hilt.android.qualifiers.ApplicationContext
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.withContext
+import java.io.File
+import java.io.FileInputStream
+import java.nio.ByteBuffer
+import java.security.MessageDigest
+import javax.inject.Inject
+import javax.inject.Singleton
+
+/**
+ * Content-addressed store shared by the container prefixes.
+ *
+ * Every container gets its own copy of the Wine system DLLs, Mono and Gecko.
+ * [deduplicate] moves identical files into the store (keyed by SHA-256) and
+ * leaves hard links behind, so N containers take the disk space and page
+ * cache of one.
+ *
+ * Stored files keep their mode, Wine would report cleared write bits to
+ * Windows as FILE_ATTRIBUTE_READONLY and refuse to delete or replace them.
+ * Their inode carries [STORE_XATTR] instead, and PRoot breaks the link before
+ * a tracee writes, truncates or chmods one (copy-on-write, see
+ * proot/src/path/shared.c), so one container can never change another's files.
+ *
+ * The store lives next to the containers: hard links need one filesystem.
+ * Android's ext4/f2fs data partitions have no reflinks, so links it is.
+ */
+@Singleton
+class ContentStore @Inject constructor(
+ @ApplicationContext private val context: Context
+) {
+
+ companion object {
+  private const val TAG = "ContentStore"
+  private const val BUFFER_SIZE = 1024 * 1024
+
+  // Smaller files are not worth an inode lookup on every open
+  private const val MIN_FILE_SIZE = 16 * 1024L
+
+  // Marks stored files, same name as STORE_XATTR in proot/src/path/shared.c
+  private const val STORE_XATTR = "user.winlator.store"
+  private val STORE_XATTR_VALUE = byteArrayOf(1)
+
+  private const val PERMISSION_BITS = 0b111_111_111 // 0777
+  private const val WRITE_BITS = 0b010_010_010 // 0222
+  private const val OWNER_WRITE_BIT = 0b010_000_000 // 0200
+ }
+
+ private val storeDir = File(context.filesDir, "winlator/store")
+
+ data class Stats(val files: Int, val bytesSaved: Long)
+
+ /**
+  * Replaces the regular files under [dir] by links into the store.
+  *
+  * Files already linked are skipped, so running it again over a container
+  * only costs a stat per file.
+  */
+ suspend fun deduplicate(dir: File): Result<Stats> = withContext(Dispatchers.IO) {
+  try {
+   storeDir.mkdirs()
+   migrateReadOnlyEntries()
+   val digest = MessageDigest.getInstance("SHA-256")
+   val buffer = ByteBuffer.allocateDirect(BUFFER_SIZE)
+   var files = 0
+   var bytesSaved = 0L
+
+   dir.walkTopDown().onEnter { !isSymlink(it) }.forEach { file ->
+    val stat = try {
+     Os.lstat(file.path)
+    } catch (e: ErrnoException) {
+     return@forEach
+    }
+    if (!OsConstants.S_ISREG(stat.st_mode) || stat.st_size < MIN_FILE_SIZE) return@forEach
+    if (isShared(file, stat.st_nlink)) return@forEach
+
+    val mode = stat.st_mode and PERMISSION_BITS
+    val stored = storePath(hash(file, digest, buffer), mode)
+    if (link(file, stored)) {
+     files++
+     bytesSaved += stat.st_size
+    }
+   }
+
+   AppLogger.i(TAG, "Deduplicated ${dir.name}: $files files, ${bytesSaved / 1024 / 1024}MB shared")
+   Result.success(Stats(files, bytesSaved))
+  } catch (e: Exception) {
+   AppLogger.e(TAG, "Deduplication of ${dir.path} failed", e)
+   Result.failure(e)
+  }
+ }
+
+ /**
+  * Drops store entries no container links to anymore.
+  */
+ suspend fun prune(): Result<Long> = withContext(Dispatchers.IO) {
+  try {
+   var bytesFreed = 0L
+   storeDir.listFiles()?.forEach { bucket ->
+    bucket.listFiles()?.forEach { entry ->
+     val stat = Os.lstat(entry.path)
+     if (stat.st_nlink <= 1 && entry.delete()) bytesFreed += stat.st_size
+    }
+    bucket.delete() // only succeeds when empty
+   }
+   if (bytesFreed > 0) AppLogger.i(TAG, "Pruned ${bytesFreed / 1024 / 1024}MB from the store")
+   Result.success(bytesFreed)
+  } catch (e: Exception) {
+   AppLogger.e(TAG, "Store pruning failed", e)
+   Result.failure(e)
+  }
+ }
+
+ /**
+  * Same test as PRoot's is_shared().
+  */
+ private fun isShared(file: File, nlink: Long): Boolean =
+  nlink > 1 && hasStoreXattr(file)
+
+ private fun hasStoreXattr(file: File): Boolean = try {
+  Os.getxattr(file.path, STORE_XATTR) != null
+ } catch (e: ErrnoException) {
+  false
+ }
+
+ /**
+  * Earlier stores marked their entries by clearing the write bits, which
+  * Windows sees as read-only files. Tags those entries with [STORE_XATTR]
+  * and gives the owner write bit back (Wine creates its files 0644), the
+  * links in the containers share the inode and follow.
+  */
+ private fun migrateReadOnlyEntries() {
+  storeDir.listFiles()?.forEach { bucket ->
+   bucket.listFiles()?.forEach { entry ->
+    if (hasStoreXattr(entry)) return@forEach
+    try {
+     val mode = Os.lstat(entry.path).st_mode and PERMISSION_BITS
+     if ((mode and WRITE_BITS) != 0) return@forEach
+     val writable = mode or OWNER_WRITE_BIT
+     Os.setxattr(entry.path, STORE_XATTR, STORE_XATTR_VALUE, 0)
+     Os.chmod(entry.path, writable)
+     Os.rename(entry.path, storePath(entry.name.substringBefore('-'), writable).path)
+    } catch (e: ErrnoException) {
+     AppLogger.w(TAG, "Can not migrate ${entry.path}: ${e.message}")
+    }
+   }
+  }
+ }
+
+ private fun isSymlink(file: File): Boolean = try {
+  OsConstants.S_ISLNK(Os.lstat(file.path).st_mode)
+ } catch (e: ErrnoException) {
+  true
+ }
+
+ /**
+  * Links share the mode too, so it is part of the key.
+  */
+ private fun storePath(hash: String, mode: Int): File =
+  File(File(storeDir, hash.substring(0, 2)), "$hash-${mode.toString(8)}")
+
+ private fun hash(file: File, digest: MessageDigest, buffer: ByteBuffer): String {
+  digest.reset()
+  FileInputStream(file).channel.use { channel ->
+   while (true) {
+    buffer.clear()
+    if (channel.read(buffer) < 0) break
+    buffer.flip()
+    digest.update(buffer)
+   }
+  }
+  return digest.digest().joinToString("") { "%02x".format(it) }
+ }
+
+ /**
+  * Links [file] to [stored], adopting [file] as the stored copy when the
+  * content is new. Returns whether [file] is now shared.
+  */
+ private fun link(file: File, stored: File): Boolean {
+  try {
+   if (!stored.exists()) {
+    stored.parentFile?.mkdirs()
+    // Without the xattr PRoot could not tell the file is shared, leave it alone
+    Os.setxattr(file.path, STORE_XATTR, STORE_XATTR_VALUE, 0)
+    try {
+     Os.link(file.path, stored.path)
+    } catch (e: ErrnoException) {
+     Os.removexattr(file.path, STORE_XATTR)
+     throw e
+    }
+    return false // the first copy saves nothing yet
+   }
+
+   // Link next to the file and rename over it, the file is never missing
+   val temp = File(file.parentFile, ".${file.name}.store")
+   temp.delete()
+   Os.link(stored.path, temp.path)
+   Os.rename(temp.path, file.path)
+   return true
+  } catch (e: ErrnoException) {
+   AppLogger.w(TAG, "Can not share ${file.path}: ${e.message}")
+   return false
+  }
+ }
+}
@@ -0,0 +1,103 @@
+package com.steamdeck.mobile.core.winlator
+
+import com.steamdeck.mobile.core.logging.AppLogger
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Bindings for the native archive extractor (libarchive_extract.so, cpp/archive).
+ *
+ * tar.zst archives are decoded natively, on all cores when they consist of
+ * several frames. Plain tar streams (the output of the Java XZ decoder) are
+ * read from a pipe, so decoding and writing the tree run on separate threads.
+ * Entries are written with large buffered writes into preallocated files.
+ */
+object NativeArchive {
+ private const val TAG = "NativeArchive"
+
+ // Slots of the progress buffer, see archive_extract.h
+ const val PROGRESS_DONE = 0
+ const val PROGRESS_TOTAL = 1
+ const val PROGRESS_ENTRIES = 2
+ const val PROGRESS_CANCEL = 3
+ private const val PROGRESS_SLOTS = 4
+
+ // What an EntryFilter returns
+ const val ENTRY_SKIP = 0
+ const val ENTRY_EXTRACT = 1
+ const val ENTRY_EXECUTABLE = 2
+
+ /**
+  * Decides per entry, called on the extracting thread with the entry's
+  * relative path (no leading "./" or "/") as raw bytes.
+  */
+ fun interface EntryFilter {
+  fun accept(path: ByteArray): Int
+ }
+
+ val isAvailable: Boolean = try {
+  System.loadLibrary("archive_extract")
+  true
+ } catch (e: UnsatisfiedLinkError) {
+  AppLogger.w(TAG, "Native archive extractor not available: ${e.message}")
+  false
+ }
+
+ /**
+  * Whether tar.zst can be extracted. The decoder comes from libzstd-jni,
+  * which has to be loaded first.
+  */
+ val isZstdAvailable: Boolean by lazy {
+  isAvailable && try {
+   com.github.luben.zstd.util.Native.load()
+   nativeIsZstdAvailable()
+  } catch (e: Throwable) {
+   AppLogger.w(TAG, "zstd-jni not available: ${e.message}")
+   false
+  }
+ }
+
+ /**
+  * Progress slots shared with the native side, read with [progress].
+  */
+ fun newProgressBuffer(): ByteBuffer =
+  ByteBuffer.allocateDirect(PROGRESS_SLOTS * 8).order(ByteOrder.nativeOrder())
+
+ fun progress(buffer: ByteBuffer, slot: Int): Long = buffer.getLong(slot * 8)
+
+ /**
+  * Ask a running extraction to stop, it then fails with "Operation canceled".
+  */
+ fun cancel(buffer: ByteBuffer) {
+  buffer.putLong(PROGRESS_CANCEL * 8, 1)
+ }
+
+ /**
+  * @return null on success, otherwise the error message
+  */
+ fun extractZstd(archive: String, targetDir: String, filter: EntryFilter?, progress: ByteBuffer): String? =
+  nativeExtractZstd(archive, targetDir, filter, progress)
+
+ /**
+  * Extract the tar stream read from fd until end of file; fd stays open.
+  *
+  * @return null on success, otherwise the error message
+  */
+ fun extractTarFd(fd: Int, targetDir: String, filter: EntryFilter?, progress: ByteBuffer): String? =
+  nativeExtractTarFd(fd, targetDir, filter, progress)
+
+ // Native methods (implemented in archive_jni.c)
+ private external fun nativeIsZstdAvailable(): Boolean
+ private external fun nativeExtractZstd(
+  archivePath: String,
+  targetDir: String,
+  filter: EntryFilter?,
+  progress: ByteBuffer
+ ): String?
+ private external fun nativeExtractTarFd(
+  fd: Int,
+  targetDir: String,
+  filter: EntryFilter?,
+  progress: ByteBuffer
+ ): String?
+}
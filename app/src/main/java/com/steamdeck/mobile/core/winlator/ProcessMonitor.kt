@@ -4,6 +4,7 @@ import com.steamdeck.mobile.core.logging.AppLogger
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.FlowCollector
 import kotlinx.coroutines.flow.flow
 import kotlinx.coroutines.withContext
 import java.io.File
@@ -13,8 +14,10 @@ import javax.inject.Singleton
 /**
  * Monitors process metrics (CPU, memory) via /proc filesystem.
  *
- * This implementation reads from /proc/[pid]/stat and /proc/[pid]/status
- * to gather CPU and memory usage statistics.
+ * Metrics cover the process and all its descendants (the Wine processes
+ * under proot) through the native [ProcessSampler]. Without the native
+ * library this falls back to reading /proc/[pid]/stat and /proc/[pid]/status
+ * of the process alone.
  */
 @Singleton
 class ProcessMonitor @Inject constructor() {
@@ -34,6 +37,12 @@ class ProcessMonitor @Inject constructor() {
  fun startMonitoring(pid: Int, intervalMs: Long = UPDATE_INTERVAL_MS): Flow<ProcessMetrics> = flow {
   AppLogger.i(TAG, "Starting process monitoring for PID $pid")
 
+  if (ProcessSampler.isAvailable) {
+   monitorTree(pid, intervalMs)
+   AppLogger.i(TAG, "Stopped process monitoring for PID $pid")
+   return@flow
+  }
+
   val startTime = System.currentTimeMillis()
   var lastCpuTime = 0L
   var lastCheckTime = System.currentTimeMillis()
@@ -73,6 +82,33 @@ class ProcessMonitor @Inject constructor() {
   AppLogger.i(TAG, "Stopped process monitoring for PID $pid")
  }
 
+ private suspend fun FlowCollector<ProcessMetrics>.monitorTree(pid: Int, intervalMs: Long) {
+  val startTime = System.currentTimeMillis()
+  ProcessSampler(pid).use { sampler ->
+   while (true) {
+    val threads = withContext(Dispatchers.IO) {
+     // threads created since the last sample inherited their creator's cores
+     if (ThreadRoles.isAvailable) ThreadRoles.refresh()
+     sampler.sample()
+    }
+    if (threads == 0) {
+     AppLogger.d(TAG, "Process tree of $pid no longer exists, stopping monitoring")
+     if (ThreadRoles.isAvailable) ThreadRoles.unregisterProcessTree(pid)
+     break
+    }
+    emit(
+     ProcessMetrics(
+      pid = pid,
+      cpuPercent = sampler.treeCpuPercent.coerceIn(0f, 100f),
+      memoryMB = (sampler.treeRssBytes / 1024 / 1024).toInt(),
+      uptimeMs = System.currentTimeMillis() - startTime
+     )
+    )
+    delay(intervalMs)
+   }
+  }
+ }
+
  /**
   * Reads process metrics from /proc filesystem.
   *
@@ -0,0 +1,117 @@
+package com.steamdeck.mobile.core.winlator
+
+import com.steamdeck.mobile.core.logging.AppLogger
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Samples every thread of a process tree (process_sampler.c): proot and all
+ * the Wine processes below it.
+ *
+ * [sample] refills a direct buffer in place and the accessors read it, so a
+ * performance HUD can poll it every frame without allocating. Not thread-safe.
+ *
+ * @param rootPid Root of the tree, usually the proot process
+ * @param maxThreads Threads reported per sample, the rest is only counted
+ *  in [treeCpuPercent]
+ */
+class ProcessSampler(rootPid: Int, maxThreads: Int = DEFAULT_MAX_THREADS) : AutoCloseable {
+
+ companion object {
+  private const val TAG = "ProcessSampler"
+  private const val DEFAULT_MAX_THREADS = 512
+
+  // Buffer layout, see process_sampler.c
+  private const val HEADER_THREADS = 0
+  private const val HEADER_ELAPSED_NANOS = 1
+  private const val HEADER_TICKS_PER_SECOND = 2
+  private const val HEADER_PROCESSES = 3
+  private const val HEADER_RSS_BYTES = 4
+  private const val HEADER_CPU_DELTA_TICKS = 5
+  private const val HEADER_FIELDS = 6
+
+  private const val FIELD_PID = 0
+  private const val FIELD_TID = 1
+  private const val FIELD_CPU_TICKS = 2
+  private const val FIELD_CPU_DELTA_TICKS = 3
+  private const val FIELD_RSS_BYTES = 4
+  private const val FIELD_MAJOR_FAULTS = 5
+  private const val FIELD_VOLUNTARY_SWITCHES = 6
+  private const val FIELD_INVOLUNTARY_SWITCHES = 7
+  private const val FIELD_STATE = 8
+  private const val THREAD_FIELDS = 9
+
+  val isAvailable: Boolean = try {
+   System.loadLibrary("winlator")
+   true
+  } catch (e: UnsatisfiedLinkError) {
+   AppLogger.w(TAG, "Native process sampler not available: ${e.message}")
+   false
+  }
+
+  @JvmStatic private external fun nativeCreate(rootPid: Int): Long
+  @JvmStatic private external fun nativeSample(handle: Long, buffer: ByteBuffer): Int
+  @JvmStatic private external fun nativeDestroy(handle: Long)
+ }
+
+ private var handle = nativeCreate(rootPid)
+ private val buffer = ByteBuffer.allocateDirect((HEADER_FIELDS + maxThreads * THREAD_FIELDS) * 8)
+  .order(ByteOrder.nativeOrder())
+ private val cores = Runtime.getRuntime().availableProcessors()
+
+ /**
+  * Takes a sample. CPU figures are over the time since the previous one,
+  * zero on the first.
+  *
+  * @return number of threads reported, 0 once the tree is gone
+  */
+ fun sample(): Int {
+  check(handle != 0L) { "ProcessSampler is closed" }
+  return nativeSample(handle, buffer).coerceAtLeast(0)
+ }
+
+ val threadCount: Int get() = header(HEADER_THREADS).toInt()
+ val processCount: Int get() = header(HEADER_PROCESSES).toInt()
+ val elapsedNanos: Long get() = header(HEADER_ELAPSED_NANOS)
+ val treeRssBytes: Long get() = header(HEADER_RSS_BYTES)
+
+ /**
+  * CPU use of the whole tree, 100 meaning all cores busy.
+  */
+ val treeCpuPercent: Float get() = cpuPercent(header(HEADER_CPU_DELTA_TICKS)) / cores
+
+ fun pid(thread: Int): Int = field(thread, FIELD_PID).toInt()
+ fun tid(thread: Int): Int = field(thread, FIELD_TID).toInt()
+ fun cpuTicks(thread: Int): Long = field(thread, FIELD_CPU_TICKS)
+
+ /**
+  * CPU use of one thread, 100 meaning one core busy.
+  */
+ fun cpuPercent(thread: Int): Float = cpuPercent(field(thread, FIELD_CPU_DELTA_TICKS))
+
+ /** RSS of the thread's process */
+ fun rssBytes(thread: Int): Long = field(thread, FIELD_RSS_BYTES)
+ fun majorFaults(thread: Int): Long = field(thread, FIELD_MAJOR_FAULTS)
+ fun voluntarySwitches(thread: Int): Long = field(thread, FIELD_VOLUNTARY_SWITCHES)
+ fun involuntarySwitches(thread: Int): Long = field(thread, FIELD_INVOLUNTARY_SWITCHES)
+ fun state(thread: Int): Char = field(thread, FIELD_STATE).toInt().toChar()
+
+ override fun close() {
+  if (handle != 0L) {
+   nativeDestroy(handle)
+   handle = 0L
+  }
+ }
+
+ private fun header(index: Int): Long = buffer.getLong(index * 8)
+
+ private fun field(thread: Int, index: Int): Long =
+  buffer.getLong((HEADER_FIELDS + thread * THREAD_FIELDS + index) * 8)
+
+ private fun cpuPercent(deltaTicks: Long): Float {
+  val elapsed = elapsedNanos
+  val ticksPerSecond = header(HEADER_TICKS_PER_SECOND)
+  if (elapsed <= 0 || ticksPerSecond <= 0) return 0f
+  return deltaTicks * 1_000_000_000f / ticksPerSecond / elapsed * 100f
+ }
+}
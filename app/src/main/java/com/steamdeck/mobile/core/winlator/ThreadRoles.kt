@@ -0,0 +1,81 @@
+package com.steamdeck.mobile.core.winlator
+
+import com.steamdeck.mobile.core.logging.AppLogger
+
+/**
+ * Registry of the threads of the native components by role (thread_roles.c).
+ *
+ * The policy pins every role to a set of cores, told apart by their maximum
+ * frequency: prime, mid (the other big cores) and little. Process trees, the
+ * Wine and box64 processes below proot, are registered by their root and
+ * re-applied by [refresh], since new threads inherit the core of their creator.
+ */
+object ThreadRoles {
+ private const val TAG = "ThreadRoles"
+
+ const val ROLE_GL = 0
+ const val ROLE_DECODE = 1
+ const val ROLE_TRACER = 2
+ const val ROLE_AUDIO = 3
+ const val ROLE_INPUT = 4
+ const val ROLE_GAME = 5
+ const val ROLE_COUNT = 6
+
+ /** Inherited scheduling on every core */
+ const val POLICY_NONE = 0
+
+ /**
+  * GL, decode and game threads on the big cores, the tracer on a core of its
+  * own and audio on a mid core, real-time where the system allows it
+  */
+ const val POLICY_PINNED = 1
+
+ /** Everything off the prime cores, the background roles on the little cores */
+ const val POLICY_EFFICIENT = 2
+
+ val isAvailable: Boolean = try {
+  System.loadLibrary("winlator")
+  true
+ } catch (e: UnsatisfiedLinkError) {
+  AppLogger.w(TAG, "Native thread roles not available: ${e.message}")
+  false
+ }
+
+ private val lastTicks = LongArray(ROLE_COUNT)
+ private var lastSampleNanos = 0L
+
+ /**
+  * CPU use per role in percent of one core since the previous call, indexed
+  * by role. The first call reports the time since the threads started.
+  */
+ @Synchronized
+ fun sampleRoleCpuPercent(): FloatArray {
+  val ticks = LongArray(ROLE_COUNT)
+  getRoleCpuTicks(ticks)
+
+  val now = System.nanoTime()
+  val elapsed = now - lastSampleNanos
+  val ticksPerSecond = getTicksPerSecond()
+  val percent = FloatArray(ROLE_COUNT) { role ->
+   val delta = (ticks[role] - lastTicks[role]).coerceAtLeast(0)
+   if (lastSampleNanos == 0L || elapsed <= 0 || ticksPerSecond <= 0) 0f
+   else delta * 1_000_000_000f / ticksPerSecond / elapsed * 100f
+  }
+  ticks.copyInto(lastTicks)
+  lastSampleNanos = now
+  return percent
+ }
+
+ @JvmStatic external fun registerCurrentThread(role: Int)
+ @JvmStatic external fun registerThread(tid: Int, role: Int)
+
+ /** Every process below [root] gets [role], [root] itself is not included */
+ @JvmStatic external fun registerProcessTree(root: Int, role: Int)
+ @JvmStatic external fun unregisterProcessTree(root: Int)
+ @JvmStatic external fun setPolicy(policy: Int)
+
+ /** Re-applies the policy to the registered process trees */
+ @JvmStatic external fun refresh()
+ @JvmStatic external fun getRoleCpuTicks(ticks: LongArray)
+ @JvmStatic external fun getTicksPerSecond(): Long
+}
@@ -43,7 +43,8 @@ class WinlatorEmulator @Inject constructor(
  private val wineGeckoInstaller: com.steamdeck.mobile.core.wine.WineGeckoInstaller,
  private val gpuDetector: com.steamdeck.mobile.core.util.GpuDetector,
  private val versionManager: ComponentVersionManager,
- private val protonManager: com.steamdeck.mobile.core.proton.ProtonManager
+ private val protonManager: com.steamdeck.mobile.core.proton.ProtonManager,
+ private val contentStore: ContentStore
 ) : WindowsEmulator {
 
  override val name: String = "Winlator"
@@ -90,6 +91,9 @@ class WinlatorEmulator @Inject constructor(
   val startTime: Long
  )
 
+ // Warm wineservers (WINEPREFIX -> wineserver process), see ensureWarmWineserver()
+ private val warmWineservers = ConcurrentHashMap<String, Process>()
+
  private enum class GameEngine {
   UNITY, UNREAL, UNKNOWN
  }
@@ -119,6 +123,10 @@ class WinlatorEmulator @Inject constructor(
   private const val WINESERVER_SOCKET_POLL_ATTEMPTS = 20  // Max attempts to find wineserver socket
   private const val WINESERVER_SOCKET_POLL_DELAY_MS = 100L // Delay between socket poll attempts
 
+  // Warm mode: a container's wineserver outlives its last game by this long, so that the next
+  // launch connects to it instead of booting a wineserver and loading the registry again
+  private const val WARM_WINESERVER_IDLE_SECONDS = 300
+
   // Progress range allocation (prevents progress regression)
   // Used by initialize() method to report consistent progress (0.0 ~ 1.0)
   private object ProgressRanges {
@@ -946,6 +954,12 @@ class WinlatorEmulator @Inject constructor(
     AppLogger.w(TAG, "DirectInput configuration error (non-fatal)", e)
    }
 
+   // Share the system DLLs, Mono and Gecko with the other containers
+   val dedupResult = contentStore.deduplicate(driveC)
+   if (dedupResult.isFailure) {
+    AppLogger.w(TAG, "Content store deduplication failed (non-fatal): ${dedupResult.exceptionOrNull()?.message}")
+   }
+
    val container = EmulatorContainer(
     id = containerId,
     name = config.name,
@@ -1005,7 +1019,9 @@ class WinlatorEmulator @Inject constructor(
     )
    }
 
+   warmWineservers.remove(containerDir.absolutePath)?.destroy()
    containerDir.deleteRecursively()
+   contentStore.prune()
    AppLogger.i(TAG, "Deleted container: $containerId")
    Result.success(Unit)
   } catch (e: Exception) {
@@ -1220,6 +1236,8 @@ class WinlatorEmulator @Inject constructor(
    env["LD_LIBRARY_PATH"] = ldLibraryPath
    processBuilder.redirectErrorStream(true)
 
+   ensureWarmWineserver(box64ToUse, environmentVars, ldLibraryPath)
+
    // WORKING DIRECTORY FIX: Set to executable's parent directory
    // This allows Wine to find DLLs in the same folder as the .exe
    // Wine will use this as the current working directory when launching the application
@@ -1240,6 +1258,12 @@ class WinlatorEmulator @Inject constructor(
 
    AppLogger.i(TAG, "Process launched: PID=$pid, ProcessId=$processId")
 
+   // The launched process is proot, everything below it is Wine and box64
+   if (ThreadRoles.isAvailable && pid > 0) {
+    ThreadRoles.registerThread(pid, ThreadRoles.ROLE_TRACER)
+    ThreadRoles.registerProcessTree(pid, ThreadRoles.ROLE_GAME)
+   }
+
    // 6. CRITICAL FIX: Drain process output to prevent buffer overflow deadlock
    // Launch background coroutine to continuously read stdout
    // This prevents the process from blocking when output buffer fills up
@@ -1499,6 +1523,76 @@ class WinlatorEmulator @Inject constructor(
 
  // Helper functions
 
+ /**
+  * Starts a persistent wineserver for the prefix of [environmentVars] unless one is still running, and
+  * waits for its socket. Games launched afterwards in the same prefix connect to it, each of them
+  * only paying for its own proot and Wine process, and it exits [WARM_WINESERVER_IDLE_SECONDS] after
+  * the last of them. When it can't be started, Wine starts its own wineserver as before.
+  */
+ private suspend fun ensureWarmWineserver(box64: File, environmentVars: Map<String, String>, ldLibraryPath: String) {
+  val prefix = environmentVars["WINEPREFIX"] ?: return
+  val socket = getWineserverSocket(prefix)
+  val warmWineserver = warmWineservers[prefix]
+  if (warmWineserver != null && warmWineserver.isAlive && socket?.exists() != false) {
+   AppLogger.d(TAG, "Reusing warm wineserver for $prefix")
+   return
+  }
+
+  try {
+   // Same binds as the game, the socket lives in the shared /tmp
+   val command = listOf(
+    prootBinary.absolutePath,
+    "-b", "${rootfsDir.absolutePath}:/data/data/com.winlator/files/rootfs",
+    "-b", "${rootfsDir.absolutePath}/tmp:/tmp",
+    box64.absolutePath,
+    wineserverBinary.absolutePath,
+    "-p$WARM_WINESERVER_IDLE_SECONDS"
+   )
+   val process = ProcessBuilder(command).apply {
+    environment().clear()
+    environment().putAll(environmentVars)
+    environment()["LD_LIBRARY_PATH"] = ldLibraryPath
+    redirectErrorStream(true)
+   }.start()
+   warmWineservers[prefix] = process
+
+   CoroutineScope(Dispatchers.IO).launch {
+    try {
+     process.inputStream.bufferedReader().use { reader ->
+      while (true) {
+       val line = reader.readLine() ?: break
+       AppLogger.d(TAG, "[wineserver] $line")
+      }
+     }
+    } catch (e: Exception) {
+     AppLogger.d(TAG, "[wineserver] Output reading stopped: ${e.message}")
+    }
+   }
+
+   // A wineserver Wine started earlier for this prefix makes this one exit right away
+   for (attempt in 0 until WINESERVER_SOCKET_POLL_ATTEMPTS) {
+    if (socket?.exists() == true || !process.isAlive) break
+    delay(WINESERVER_SOCKET_POLL_DELAY_MS)
+   }
+   AppLogger.i(TAG, "Warm wineserver for $prefix: running=${process.isAlive}, socket=${socket?.exists()}")
+  } catch (e: Exception) {
+   AppLogger.w(TAG, "Failed to start warm wineserver: ${e.message}")
+  }
+ }
+
+ /**
+  * Returns the socket of the wineserver for [prefix]: Wine names its server directory after the
+  * device and inode of the prefix, in /tmp which is bound to the rootfs' tmp.
+  */
+ private fun getWineserverSocket(prefix: String): File? {
+  return try {
+   val stat = Os.stat(prefix)
+   File(rootfsDir, "tmp/.wine-${Os.getuid()}/server-${java.lang.Long.toHexString(stat.st_dev)}-${java.lang.Long.toHexString(stat.st_ino)}/socket")
+  } catch (e: Exception) {
+   null
+  }
+ }
+
  /**
   * Builds environment variables for wineboot initialization with retry-specific settings.
   *
@@ -1522,6 +1616,7 @@ class WinlatorEmulator @Inject constructor(
    // CRITICAL: PRoot requires PROOT_TMP_DIR for temporary files
    // Without this, proot fails with "can't create temporary directory"
    put("PROOT_TMP_DIR", context.cacheDir.absolutePath)
+   put("PROOT_STATIC_PATHS", buildProotStaticPaths())
 
    put("LANG", "C")
    put("LC_ALL", "C")
@@ -2926,6 +3021,7 @@ REGEDIT4
    // CRITICAL: PRoot requires PROOT_TMP_DIR for temporary files
    // Without this, proot fails with "can't create temporary directory"
    put("PROOT_TMP_DIR", context.cacheDir.absolutePath)
+   put("PROOT_STATIC_PATHS", buildProotStaticPaths())
 
    put("LANG", "C")
    put("LC_ALL", "C")
@@ -3113,6 +3209,18 @@ REGEDIT4
   }
  }
 
+ /**
+  * Build PROOT_STATIC_PATHS: rootfs directories that nothing writes to while
+  * Wine runs, so proot keeps their canonicalized paths cached for good.
+  * Both the host path and its /data/data/com.winlator/files/rootfs binding
+  * are listed, rootfs/tmp and the prefixes stay out since they change.
+  */
+ private fun buildProotStaticPaths(): String {
+  val roots = listOf(rootfsDir.absolutePath, "/data/data/com.winlator/files/rootfs")
+  val dirs = listOf("usr", "lib", "bin", "opt/wine")
+  return roots.flatMap { root -> dirs.map { "$root/$it" } }.joinToString(":")
+ }
+
  /**
   * Get the Box64 binary to use for execution.
   * Uses the extracted Box64 which has the hardcoded interpreter path.
@@ -1,7 +1,13 @@
 package com.steamdeck.mobile.core.winlator
 
+import android.os.ParcelFileDescriptor
+import com.github.luben.zstd.ZstdInputStream
 import com.steamdeck.mobile.core.logging.AppLogger
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
 import org.apache.commons.compress.archivers.tar.TarArchiveEntry
 import org.apache.commons.compress.archivers.tar.TarArchiveInputStream
@@ -10,13 +16,19 @@ import java.io.BufferedInputStream
 import java.io.File
 import java.io.FileInputStream
 import java.io.FileOutputStream
+import java.io.IOException
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 import javax.inject.Inject
 import javax.inject.Singleton
 
 /**
- * Utility for decompressing tar-based archives (.txz).
+ * Utility for decompressing tar-based archives (.tzst, .txz).
  *
- * XZ (.txz) support is provided by Apache Commons Compress.
+ * Both are extracted by the native extractor ([NativeArchive]): .tzst is decoded
+ * natively (on all cores for multi-frame archives), .txz is decoded by Apache
+ * Commons Compress on one thread and piped to the native tar writer on another.
+ * Without the native library .txz falls back to extraction in Kotlin.
  *
  * Reference:
  * - Apache Commons Compress: https://commons.apache.org/proper/commons-compress/
@@ -27,6 +39,9 @@ class ZstdDecompressor @Inject constructor() {
  companion object {
   private const val TAG = "ZstdDecompressor"
   private const val BUFFER_SIZE = 8192 // 8KB buffer
+  private const val NATIVE_BUFFER_SIZE = 1024 * 1024 // 1MB, decoder side of the native paths
+  private const val PROGRESS_INTERVAL_MS = 100L
+  private const val ZSTD_MAGIC = 0xFD2FB528.toInt()
 
   // Compression ratio estimates for progress calculation
   // These are used to estimate decompressed size from compressed file size
@@ -47,37 +62,122 @@ class ZstdDecompressor @Inject constructor() {
   outputFile: File,
   progressCallback: ((Float) -> Unit)? = null
  ): Result<File> = withContext(Dispatchers.IO) {
-  Result.failure(
-   UnsupportedOperationException(
-    "Zstandard decompression is temporarily unavailable. " +
-    "Please use XZ-compressed archives (.txz) instead. " +
-    "See extractTxz() method."
-   )
-  )
+  if (!NativeArchive.isZstdAvailable) {
+   return@withContext Result.failure(UnsupportedOperationException("Zstandard decoder is not available"))
+  }
+
+  try {
+   val inputSize = inputFile.length().coerceAtLeast(1)
+   FileInputStream(inputFile).use { input ->
+    ZstdInputStream(BufferedInputStream(input, NATIVE_BUFFER_SIZE)).use { zstdInput ->
+     FileOutputStream(outputFile).use { output ->
+      val buffer = ByteArray(NATIVE_BUFFER_SIZE)
+      var len: Int
+      while (zstdInput.read(buffer).also { len = it } > 0) {
+       output.write(buffer, 0, len)
+       progressCallback?.invoke((input.channel.position().toFloat() / inputSize).coerceIn(0f, 1f))
+      }
+     }
+    }
+   }
+   progressCallback?.invoke(1.0f)
+   Result.success(outputFile)
+  } catch (e: Exception) {
+   AppLogger.e(TAG, "Zstd decompression failed", e)
+   Result.failure(e)
+  }
  }
 
  /**
   * Decompresses and extracts a .tzst archive in one step.
   *
-  * NOTE: Zstandard (.tzst) is not supported on Android ARM64 due to library limitations.
-  * Use .tar.xz format instead (convert tzst files to tar.xz before using).
+  * Decoded natively straight into the tree without an intermediate .tar;
+  * archives made of several frames (zstd seekable format, pzstd) on all cores.
   *
   * @param tzstFile .tzst compressed archive
   * @param targetDir Directory to extract to
-  * @param progressCallback Optional progress callback (0.0 to 1.0)
-  * @return Result indicating failure (not supported)
+  * @param progressCallback Optional progress callback (0.0 to 1.0, status message)
+  * @return Result with extracted directory
   */
  suspend fun decompressAndExtract(
   tzstFile: File,
   targetDir: File,
   progressCallback: ((Float, String) -> Unit)? = null
  ): Result<File> = withContext(Dispatchers.IO) {
-  Result.failure(
-   UnsupportedOperationException(
-    "Zstandard (.tzst) decompression is not supported on Android ARM64. " +
-    "Please convert to .tar.xz format using: zstd -d file.tzst -o file.tar && xz file.tar"
+  if (!tzstFile.exists()) {
+   return@withContext Result.failure(
+    IllegalArgumentException("Input file not found: ${tzstFile.absolutePath}")
    )
-  )
+  }
+  if (!NativeArchive.isZstdAvailable) {
+   return@withContext Result.failure(UnsupportedOperationException("Zstandard decoder is not available"))
+  }
+
+  targetDir.mkdirs()
+  AppLogger.i(TAG, "Extracting tzst archive: ${tzstFile.name} (${tzstFile.length() / 1024 / 1024}MB)")
+  progressCallback?.invoke(0.0f, "Extracting ${tzstFile.name}...")
+
+  val error = runNativeExtraction(progressCallback, { progress ->
+   val total = NativeArchive.progress(progress, NativeArchive.PROGRESS_TOTAL)
+   if (total > 0) NativeArchive.progress(progress, NativeArchive.PROGRESS_DONE).toFloat() / total else 0f
+  }) { progress ->
+   NativeArchive.extractZstd(tzstFile.absolutePath, targetDir.absolutePath, entryFilter(null), progress)
+  }
+
+  if (error != null) {
+   AppLogger.e(TAG, "Tzst extraction failed: $error")
+   return@withContext Result.failure(IOException(error))
+  }
+
+  AppLogger.i(TAG, "Tzst extraction complete: ${targetDir.absolutePath}")
+  progressCallback?.invoke(1.0f, "Extraction complete")
+  Result.success(targetDir)
+ }
+
+ /**
+  * Box64 requires the dynamic linker to be executable for Proot to work,
+  * whatever mode the archive gives it.
+  */
+ private fun isDynamicLinker(name: String): Boolean =
+  name.contains("ld-linux-aarch64.so") || name.endsWith("/ld-linux-aarch64.so.1")
+
+ private fun entryFilter(pathFilter: ((String) -> Boolean)?) = NativeArchive.EntryFilter { bytes ->
+  val path = String(bytes, Charsets.UTF_8)
+  when {
+   pathFilter != null && !pathFilter(path) -> NativeArchive.ENTRY_SKIP
+   isDynamicLinker(path) -> NativeArchive.ENTRY_EXECUTABLE
+   else -> NativeArchive.ENTRY_EXTRACT
+  }
+ }
+
+ /**
+  * Runs a blocking native extraction while polling its progress buffer;
+  * cancelling the caller cancels the native side.
+  *
+  * @return null on success, otherwise the error message
+  */
+ private suspend fun runNativeExtraction(
+  progressCallback: ((Float, String) -> Unit)?,
+  fraction: (ByteBuffer) -> Float,
+  extract: (ByteBuffer) -> String?
+ ): String? = coroutineScope {
+  val progress = NativeArchive.newProgressBuffer()
+  val poller = launch {
+   try {
+    while (true) {
+     delay(PROGRESS_INTERVAL_MS)
+     progressCallback?.invoke(fraction(progress).coerceIn(0f, 1f), "Extracting...")
+    }
+   } finally {
+    // Harmless once extract() returned
+    NativeArchive.cancel(progress)
+   }
+  }
+  try {
+   extract(progress)
+  } finally {
+   poller.cancel()
+  }
  }
 
  /**
@@ -173,8 +273,8 @@ class ZstdDecompressor @Inject constructor() {
   * @return Estimated decompressed size in bytes, or null if cannot determine
   */
  fun getDecompressedSize(tzstFile: File): Long? {
-  AppLogger.w(TAG, "Zstandard decompression is temporarily unavailable")
-  return null
+  if (!isValidZstd(tzstFile)) return null
+  return (tzstFile.length() * TZST_COMPRESSION_RATIO).toLong()
  }
 
  /**
@@ -193,13 +293,84 @@ class ZstdDecompressor @Inject constructor() {
   pathFilter: ((String) -> Boolean)? = null,
   progressCallback: ((Float, String) -> Unit)? = null
  ): Result<File> = withContext(Dispatchers.IO) {
-  try {
-   if (!txzFile.exists()) {
-    return@withContext Result.failure(
-     IllegalArgumentException("Input file not found: ${txzFile.absolutePath}")
-    )
+  if (!txzFile.exists()) {
+   return@withContext Result.failure(
+    IllegalArgumentException("Input file not found: ${txzFile.absolutePath}")
+   )
+  }
+
+  if (NativeArchive.isAvailable) {
+   extractTxzNative(txzFile, targetDir, pathFilter, progressCallback)
+  } else {
+   extractTxzKotlin(txzFile, targetDir, pathFilter, progressCallback)
+  }
+ }
+
+ /**
+  * XZ is decoded on its own thread and piped to the native tar writer.
+  */
+ private suspend fun extractTxzNative(
+  txzFile: File,
+  targetDir: File,
+  pathFilter: ((String) -> Boolean)?,
+  progressCallback: ((Float, String) -> Unit)?
+ ): Result<File> = coroutineScope {
+  targetDir.mkdirs()
+
+  val txzFileSize = txzFile.length().coerceAtLeast(1)
+  val filterMsg = if (pathFilter != null) " (filtered)" else ""
+  AppLogger.i(TAG, "Extracting txz archive$filterMsg: ${txzFile.name} (${txzFileSize / 1024 / 1024}MB)")
+  progressCallback?.invoke(0.0f, "Extracting ${txzFile.name}$filterMsg...")
+
+  val input = FileInputStream(txzFile)
+  val pipe = ParcelFileDescriptor.createPipe()
+  val decoder = async(Dispatchers.IO) {
+   runCatching {
+    ParcelFileDescriptor.AutoCloseOutputStream(pipe[1]).use { output ->
+     XZCompressorInputStream(BufferedInputStream(input, NATIVE_BUFFER_SIZE)).use { xzInput ->
+      xzInput.copyTo(output, NATIVE_BUFFER_SIZE)
+     }
+    }
+   }.exceptionOrNull()
+  }
+
+  val error = try {
+   runNativeExtraction(progressCallback, {
+    runCatching { input.channel.position().toFloat() / txzFileSize }.getOrDefault(1f)
+   }) { progress ->
+    NativeArchive.extractTarFd(pipe[0].fd, targetDir.absolutePath, entryFilter(pathFilter), progress)
+   }
+  } finally {
+   // Unblocks the decoder if the extraction stopped early
+   pipe[0].close()
+  }
+  val decodeError = decoder.await()
+
+  when {
+   // A failing decoder shows up natively as a truncated tar
+   decodeError != null && (error == null || error == "Archive is truncated") -> {
+    AppLogger.e(TAG, "Txz extraction failed", decodeError)
+    Result.failure(decodeError)
+   }
+   error != null -> {
+    AppLogger.e(TAG, "Txz extraction failed: $error")
+    Result.failure(IOException(error))
    }
+   else -> {
+    AppLogger.i(TAG, "Txz extraction complete: ${targetDir.absolutePath}")
+    progressCallback?.invoke(1.0f, "Extraction complete")
+    Result.success(targetDir)
+   }
+  }
+ }
 
+ private fun extractTxzKotlin(
+  txzFile: File,
+  targetDir: File,
+  pathFilter: ((String) -> Boolean)?,
+  progressCallback: ((Float, String) -> Unit)?
+ ): Result<File> {
+  try {
    targetDir.mkdirs()
 
    val txzFileSize = txzFile.length()
@@ -256,9 +427,7 @@ class ZstdDecompressor @Inject constructor() {
         val isExecutable = (mode and 0x49) != 0 // Check execute bits
 
         // CRITICAL FIX (2025-12-27): ALWAYS set executable on dynamic linker
-        // Box64 requires the linker to be executable for Proot to work
-        val isLinker = entry.name.contains("ld-linux-aarch64.so") ||
-                       entry.name.endsWith("/ld-linux-aarch64.so.1")
+        val isLinker = isDynamicLinker(entry.name)
 
         if (isExecutable || isLinker) {
          outputFile.setExecutable(true, false)
@@ -285,10 +454,10 @@ class ZstdDecompressor @Inject constructor() {
 
    AppLogger.i(TAG, "Txz extraction complete: ${targetDir.absolutePath}")
    progressCallback?.invoke(1.0f, "Extraction complete")
-   Result.success(targetDir)
+   return Result.success(targetDir)
   } catch (e: Exception) {
    AppLogger.e(TAG, "Txz extraction failed", e)
-   Result.failure(e)
+   return Result.failure(e)
   }
  }
 
@@ -299,7 +468,14 @@ class ZstdDecompressor @Inject constructor() {
   * @return true if valid zstd file
   */
  fun isValidZstd(file: File): Boolean {
-  AppLogger.w(TAG, "Zstandard validation is temporarily unavailable")
-  return false
+  return try {
+   FileInputStream(file).use { input ->
+    val header = ByteArray(4)
+    input.read(header) == 4 &&
+     ByteBuffer.wrap(header).order(ByteOrder.LITTLE_ENDIAN).int == ZSTD_MAGIC
+   }
+  } catch (e: IOException) {
+   false
+  }
  }
 }
@@ -7,6 +7,7 @@ import java.nio.ByteBuffer;
 import java.util.ArrayDeque;
 
 public class ClientSocket {
+    private static final int READ_WOULD_BLOCK = -2;
     public final int fd;
     private final ArrayDeque<Integer> ancillaryFds = new ArrayDeque<>();
 
@@ -41,6 +42,9 @@ public class ClientSocket {
         else if (bytesRead == 0) {
             return -1;
         }
+        else if (bytesRead == READ_WOULD_BLOCK) {
+            return 0;
+        }
         else throw new IOException("Failed to read data.");
     }
 
@@ -62,6 +66,9 @@ public class ClientSocket {
         else if (bytesRead == 0) {
             return -1;
         }
+        else if (bytesRead == READ_WOULD_BLOCK) {
+            return 0;
+        }
         else throw new IOException("Failed to receive ancillary messages.");
     }
 
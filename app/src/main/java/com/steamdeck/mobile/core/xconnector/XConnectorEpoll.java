@@ -4,6 +4,8 @@ import android.util.SparseArray;
 
 import androidx.annotation.Keep;
 
+import com.steamdeck.mobile.core.winlator.ThreadRoles;
+
 import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.util.ArrayList;
@@ -18,9 +20,13 @@ public class XConnectorEpoll implements Runnable {
     private boolean running = false;
     private boolean multithreadedClients = false;
     private boolean canReceiveAncillaryMessages = false;
+    private boolean edgeTriggered = false;
+    private int maxEvents = 10;
+    private int threadRole = -1;
     private int initialInputBufferCapacity = 4096;
     private int initialOutputBufferCapacity = 4096;
     private final SparseArray<Client> connectedClients = new SparseArray<>();
+    private int[] readyFds;
 
     static {
         System.loadLibrary("winlator");
@@ -80,7 +86,13 @@ public class XConnectorEpoll implements Runnable {
 
     @Override
     public void run() {
-        while (running && doEpollIndefinitely(epollFd, serverFd, !multithreadedClients));
+        if (threadRole >= 0) ThreadRoles.registerCurrentThread(threadRole);
+        readyFds = new int[maxEvents];
+        while (running) {
+            int numReadyFds = doEpollIndefinitely(epollFd, serverFd, !multithreadedClients, edgeTriggered && !multithreadedClients, readyFds);
+            if (numReadyFds < 0) break;
+            for (int i = 0; i < numReadyFds && running; i++) handleExistingConnection(readyFds[i]);
+        }
         shutdown();
     }
 
@@ -91,6 +103,7 @@ public class XConnectorEpoll implements Runnable {
         if (multithreadedClients) {
             client.shutdownFd = createEventFd();
             client.pollThread = new Thread(() -> {
+                if (threadRole >= 0) ThreadRoles.registerCurrentThread(threadRole);
                 connectionHandler.handleNewConnection(client);
                 while (client.connected && waitForSocketRead(client.clientSocket.fd, client.shutdownFd));
             });
@@ -108,12 +121,26 @@ public class XConnectorEpoll implements Runnable {
         XInputStream inputStream = client.getInputStream();
         try {
             if (inputStream != null) {
-                if (inputStream.readMoreData(canReceiveAncillaryMessages) > 0) {
-                    int activePosition = 0;
-                    while (running && requestHandler.handleRequest(client)) activePosition = inputStream.getActivePosition();
-                    inputStream.setActivePosition(activePosition);
+                XOutputStream outputStream = client.getOutputStream();
+                if (outputStream != null) outputStream.beginBatch();
+
+                // edge triggered clients are only reported again once new data arrives, so drain the socket
+                int bytesRead;
+                try {
+                    do {
+                        bytesRead = inputStream.readMoreData(canReceiveAncillaryMessages);
+                        if (bytesRead > 0) {
+                            int activePosition = 0;
+                            while (running && requestHandler.handleRequest(client)) activePosition = inputStream.getActivePosition();
+                            inputStream.setActivePosition(activePosition);
+                        }
+                    }
+                    while (edgeTriggered && running && client.connected && bytesRead > 0);
                 }
-                else killConnection(client);
+                finally {
+                    if (outputStream != null) outputStream.endBatch(client.connected);
+                }
+                if (bytesRead < 0) killConnection(client);
             }
             else requestHandler.handleRequest(client);
         }
@@ -128,8 +155,8 @@ public class XConnectorEpoll implements Runnable {
 
     public void killConnection(Client client) {
         client.connected = false;
-        connectionHandler.handleConnectionShutdown(client);
         if (multithreadedClients) {
+            // the poll thread may still be inside a request, stop it before tearing down the client
             if (Thread.currentThread() != client.pollThread) {
                 client.requestShutdown();
 
@@ -142,9 +169,13 @@ public class XConnectorEpoll implements Runnable {
 
                 client.pollThread = null;
             }
+            connectionHandler.handleConnectionShutdown(client);
             closeFd(client.shutdownFd);
         }
-        else removeFdFromEpoll(epollFd, client.clientSocket.fd);
+        else {
+            connectionHandler.handleConnectionShutdown(client);
+            removeFdFromEpoll(epollFd, client.clientSocket.fd);
+        }
         closeFd(client.clientSocket.fd);
         connectedClients.remove(client.clientSocket.fd);
     }
@@ -178,6 +209,15 @@ public class XConnectorEpoll implements Runnable {
         this.initialOutputBufferCapacity = initialOutputBufferCapacity;
     }
 
+    public int getThreadRole() {
+        return threadRole;
+    }
+
+    // epoll and client threads register with this ThreadRoles role when they start, -1 for none
+    public void setThreadRole(int threadRole) {
+        this.threadRole = threadRole;
+    }
+
     public boolean isMultithreadedClients() {
         return multithreadedClients;
     }
@@ -186,6 +226,23 @@ public class XConnectorEpoll implements Runnable {
         this.multithreadedClients = multithreadedClients;
     }
 
+    public boolean isEdgeTriggered() {
+        return edgeTriggered;
+    }
+
+    /** Only for clients that read through their XInputStream, as the socket is drained on every wakeup. */
+    public void setEdgeTriggered(boolean edgeTriggered) {
+        this.edgeTriggered = edgeTriggered;
+    }
+
+    public int getMaxEvents() {
+        return maxEvents;
+    }
+
+    public void setMaxEvents(int maxEvents) {
+        this.maxEvents = maxEvents;
+    }
+
     public boolean isCanReceiveAncillaryMessages() {
         return canReceiveAncillaryMessages;
     }
@@ -209,7 +266,7 @@ public class XConnectorEpoll implements Runnable {
 
     private native int createEventFd();
 
-    private native boolean doEpollIndefinitely(int epollFd, int serverFd, boolean addClientToEpoll);
+    private native int doEpollIndefinitely(int epollFd, int serverFd, boolean addClientToEpoll, boolean edgeTriggered, int[] readyFds);
 
     private native boolean addFdToEpoll(int epollFd, int fd);
 
@@ -13,6 +13,7 @@ public class XOutputStream {
     public final ClientSocket clientSocket;
     private final ReentrantLock lock = new ReentrantLock();
     private int ancillaryFd = -1;
+    private volatile int batchDepth = 0;
 
     public XOutputStream(int initialCapacity) {
         this(null, initialCapacity);
@@ -91,6 +92,24 @@ public class XOutputStream {
         }
     }
 
+    // Holds back the flushes of released locks until the batch ends, so the replies and events of a
+    // whole request batch leave in one write
+    public void beginBatch() {
+        batchDepth++;
+    }
+
+    public void endBatch(boolean flush) throws IOException {
+        if (--batchDepth > 0) return;
+        lock.lock();
+        try {
+            if (flush) flush();
+            else buffer.clear();
+        }
+        finally {
+            lock.unlock();
+        }
+    }
+
     public XStreamLock lock() {
         return new OutputStreamLock();
     }
@@ -112,7 +131,8 @@ public class XOutputStream {
         @Override
         public void close() throws IOException {
             try {
-                flush();
+                // an ancillary fd may be closed by the caller right after, it can't wait for the batch
+                if (lock.getHoldCount() == 1 && (batchDepth == 0 || ancillaryFd != -1)) flush();
             }
             finally {
                 lock.unlock();
@@ -1,14 +1,15 @@
 package com.steamdeck.mobile.core.xenvironment.components;
 
-import com.steamdeck.mobile.core.alsaserver.ALSAClientConnectionHandler;
-import com.steamdeck.mobile.core.alsaserver.ALSARequestHandler;
+import android.util.Log;
+
+import com.steamdeck.mobile.core.alsaserver.ALSAServer;
 import com.steamdeck.mobile.core.xconnector.UnixSocketConfig;
-import com.steamdeck.mobile.core.xconnector.XConnectorEpoll;
 import com.steamdeck.mobile.core.xenvironment.EnvironmentComponent;
 
 public class ALSAServerComponent extends EnvironmentComponent {
-    private XConnectorEpoll connector;
+    private ALSAServer server;
     private final UnixSocketConfig socketConfig;
+    private boolean mixerEnabled = false;
 
     public ALSAServerComponent(UnixSocketConfig socketConfig) {
         this.socketConfig = socketConfig;
@@ -16,17 +17,23 @@ public class ALSAServerComponent extends EnvironmentComponent {
 
     @Override
     public void start() {
-        if (connector != null) return;
-        connector = new XConnectorEpoll(socketConfig, new ALSAClientConnectionHandler(), new ALSARequestHandler());
-        connector.setMultithreadedClients(true);
-        connector.start();
+        if (server != null) return;
+        if (mixerEnabled) ALSAServer.setMixerEnabled(true);
+        server = new ALSAServer();
+        if (!server.start(socketConfig.path)) {
+            Log.e("ALSAServer", "Failed to start the server on " + socketConfig.path);
+        }
+    }
+
+    public void setMixerEnabled(boolean mixerEnabled) {
+        this.mixerEnabled = mixerEnabled;
     }
 
     @Override
     public void stop() {
-        if (connector != null) {
-            connector.stop();
-            connector = null;
+        if (server != null) {
+            server.stop();
+            server = null;
         }
     }
 }
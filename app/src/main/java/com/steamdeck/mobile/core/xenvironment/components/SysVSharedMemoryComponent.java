@@ -1,16 +1,14 @@
 package com.steamdeck.mobile.core.xenvironment.components;
 
-import com.steamdeck.mobile.core.sysvshm.SysVSHMConnectionHandler;
-import com.steamdeck.mobile.core.sysvshm.SysVSHMRequestHandler;
+import android.util.Log;
+
 import com.steamdeck.mobile.core.sysvshm.SysVSharedMemory;
 import com.steamdeck.mobile.core.xconnector.UnixSocketConfig;
-import com.steamdeck.mobile.core.xconnector.XConnectorEpoll;
 import com.steamdeck.mobile.core.xenvironment.EnvironmentComponent;
 import com.steamdeck.mobile.core.xserver.SHMSegmentManager;
 import com.steamdeck.mobile.core.xserver.XServer;
 
 public class SysVSharedMemoryComponent extends EnvironmentComponent {
-    private XConnectorEpoll connector;
     public final UnixSocketConfig socketConfig;
     private SysVSharedMemory sysVSharedMemory;
     private final XServer xServer;
@@ -22,21 +20,20 @@ public class SysVSharedMemoryComponent extends EnvironmentComponent {
 
     @Override
     public void start() {
-        if (connector != null) return;
+        if (sysVSharedMemory != null) return;
         sysVSharedMemory = new SysVSharedMemory();
-        connector = new XConnectorEpoll(socketConfig, new SysVSHMConnectionHandler(sysVSharedMemory), new SysVSHMRequestHandler());
-        connector.start();
+        if (!sysVSharedMemory.start(socketConfig.path)) {
+            Log.e("SysVSharedMemory", "Failed to start the server on " + socketConfig.path);
+        }
 
         xServer.setSHMSegmentManager(new SHMSegmentManager(sysVSharedMemory));
     }
 
     @Override
     public void stop() {
-        if (connector != null) {
-            connector.stop();
-            connector = null;
+        if (sysVSharedMemory != null) {
+            sysVSharedMemory.stop();
+            sysVSharedMemory = null;
         }
-
-        sysVSharedMemory.deleteAll();
     }
 }
@@ -0,0 +1,87 @@
+package com.steamdeck.mobile.core.xenvironment.components;
+
+import android.content.Context;
+import android.os.Build;
+import android.os.Handler;
+import android.os.Looper;
+import android.os.PowerManager;
+
+import com.steamdeck.mobile.core.xenvironment.EnvironmentComponent;
+
+/**
+ * Lowers the virgl frame rate limit ahead of thermal throttling.
+ *
+ * The thermal headroom forecast reaches 1.0 where the device would start throttling on its
+ * own, which costs far more than capping the frame rate a bit earlier. The cap steps down as
+ * the forecast approaches it and back up once the device cooled down, never above the limit
+ * set on VirGLRendererComponent. Needs Android 11, does nothing before.
+ */
+public class ThermalGovernorComponent extends EnvironmentComponent {
+    private static final long POLL_INTERVAL_MS = 5000;
+    private static final int FORECAST_SECONDS = 10;
+    private static final float HOT_HEADROOM = 0.9f;
+    private static final float COOL_HEADROOM = 0.7f;
+    // frame rate caps per level, level 0 is no thermal cap
+    private static final int[] LEVEL_CAPS = {0, 45, 30};
+    // successive cool polls before a level is lifted
+    private static final int COOL_POLLS = 3;
+
+    private final Handler handler = new Handler(Looper.getMainLooper());
+    private PowerManager powerManager;
+    private VirGLRendererComponent virGLRendererComponent;
+    private int level = 0;
+    private int coolPolls = 0;
+
+    private final Runnable poll = new Runnable() {
+        @Override
+        public void run() {
+            update(powerManager.getThermalHeadroom(FORECAST_SECONDS));
+            handler.postDelayed(this, POLL_INTERVAL_MS);
+        }
+    };
+
+    @Override
+    public void start() {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.R) return;
+        virGLRendererComponent = environment.getComponent(VirGLRendererComponent.class);
+        if (virGLRendererComponent == null) return;
+
+        powerManager = (PowerManager)environment.getContext().getSystemService(Context.POWER_SERVICE);
+        handler.post(poll);
+    }
+
+    @Override
+    public void stop() {
+        handler.removeCallbacks(poll);
+        if (virGLRendererComponent != null) virGLRendererComponent.setThermalFrameRateLimit(0);
+        level = 0;
+        coolPolls = 0;
+    }
+
+    public int getLevel() {
+        return level;
+    }
+
+    private void update(float headroom) {
+        // NaN while the forecast is unsupported or polled too often
+        if (Float.isNaN(headroom)) return;
+
+        int newLevel = level;
+        if (headroom >= HOT_HEADROOM) {
+            coolPolls = 0;
+            if (level < LEVEL_CAPS.length - 1) newLevel++;
+        }
+        else if (headroom < COOL_HEADROOM && level > 0) {
+            if (++coolPolls >= COOL_POLLS) {
+                coolPolls = 0;
+                newLevel--;
+            }
+        }
+        else coolPolls = 0;
+
+        if (newLevel != level) {
+            level = newLevel;
+            virGLRendererComponent.setThermalFrameRateLimit(LEVEL_CAPS[level]);
+        }
+    }
+}
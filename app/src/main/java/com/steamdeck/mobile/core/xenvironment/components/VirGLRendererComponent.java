@@ -1,9 +1,13 @@
 package com.steamdeck.mobile.core.xenvironment.components;
 
+import android.opengl.GLES30;
+
 import androidx.annotation.Keep;
 
 import com.steamdeck.mobile.presentation.renderer.GLRenderer;
+import com.steamdeck.mobile.presentation.renderer.GPUImage;
 import com.steamdeck.mobile.presentation.renderer.Texture;
+import com.steamdeck.mobile.core.winlator.ThreadRoles;
 import com.steamdeck.mobile.core.xconnector.Client;
 import com.steamdeck.mobile.core.xconnector.ConnectionHandler;
 import com.steamdeck.mobile.core.xconnector.RequestHandler;
@@ -13,6 +17,7 @@ import com.steamdeck.mobile.core.xenvironment.EnvironmentComponent;
 import com.steamdeck.mobile.core.xserver.Drawable;
 import com.steamdeck.mobile.core.xserver.XServer;
 
+import java.io.File;
 import java.io.IOException;
 
 public class VirGLRendererComponent extends EnvironmentComponent implements ConnectionHandler, RequestHandler {
@@ -20,6 +25,20 @@ public class VirGLRendererComponent extends EnvironmentComponent implements Conn
     private final UnixSocketConfig socketConfig;
     private XConnectorEpoll connector;
     private long sharedEGLContextPtr;
+    private File programCacheDir;
+    private File shaderVariantLog;
+    private int shaderCompileThreads;
+    private boolean skipDrawsUntilReady;
+    private int maxRenderThreads = 4;
+    private boolean asyncReadback;
+    private boolean pipelinedDecode;
+    private boolean constantBufferUbo;
+    private boolean separablePrograms;
+    private File traceDir;
+    private boolean decodeStats;
+    private int frameRateLimit;
+    private int thermalFrameRateLimit;
+    private String[] decodeCommandNames;
 
     static {
         System.loadLibrary("virglrenderer");
@@ -30,10 +49,78 @@ public class VirGLRendererComponent extends EnvironmentComponent implements Conn
         this.socketConfig = socketConfig;
     }
 
+    public void setProgramCacheDir(File programCacheDir) {
+        this.programCacheDir = programCacheDir;
+    }
+
+    public void setShaderVariantLog(File shaderVariantLog) {
+        this.shaderVariantLog = shaderVariantLog;
+    }
+
+    public void setMaxRenderThreads(int maxRenderThreads) {
+        this.maxRenderThreads = maxRenderThreads;
+    }
+
+    public void setAsyncReadback(boolean asyncReadback) {
+        this.asyncReadback = asyncReadback;
+    }
+
+    public void setPipelinedDecode(boolean pipelinedDecode) {
+        this.pipelinedDecode = pipelinedDecode;
+    }
+
+    public void setConstantBufferUbo(boolean constantBufferUbo) {
+        this.constantBufferUbo = constantBufferUbo;
+    }
+
+    // vertex + fragment shader pairs become program pipelines of separately linked stages
+    public void setSeparablePrograms(boolean separablePrograms) {
+        this.separablePrograms = separablePrograms;
+    }
+
+    // every client records its command stream into a trace file in traceDir
+    public void setTraceDir(File traceDir) {
+        this.traceDir = traceDir;
+    }
+
+    // clients connecting afterwards count and time every decoded command
+    public void setDecodeStats(boolean decodeStats) {
+        this.decodeStats = decodeStats;
+    }
+
+    // presents are held back to at most fps per second aligned to vsync, 0 lifts the limit; applies immediately
+    public void setFrameRateLimit(int fps) {
+        this.frameRateLimit = Math.max(fps, 0);
+        applyFrameRateLimit();
+    }
+
+    public int getFrameRateLimit() {
+        return frameRateLimit;
+    }
+
+    // lower cap from ThermalGovernorComponent, the lower of both limits applies
+    public void setThermalFrameRateLimit(int fps) {
+        this.thermalFrameRateLimit = Math.max(fps, 0);
+        applyFrameRateLimit();
+    }
+
+    private void applyFrameRateLimit() {
+        int limit = frameRateLimit;
+        if (thermalFrameRateLimit > 0 && (limit == 0 || thermalFrameRateLimit < limit)) limit = thermalFrameRateLimit;
+        setFrameRateLimitNative(limit);
+    }
+
+    public void setAsyncShaderCompile(int threads, boolean skipDrawsUntilReady) {
+        this.shaderCompileThreads = threads;
+        this.skipDrawsUntilReady = skipDrawsUntilReady;
+    }
+
     @Override
     public void start() {
         if (connector != null) return;
         connector = new XConnectorEpoll(socketConfig, this, this);
+        connector.setMultithreadedClients(true);
+        connector.setThreadRole(ThreadRoles.ROLE_GL);
         connector.start();
     }
 
@@ -73,6 +160,61 @@ public class VirGLRendererComponent extends EnvironmentComponent implements Conn
         return sharedEGLContextPtr;
     }
 
+    @Keep
+    private String getProgramCacheDir() {
+        return programCacheDir != null ? programCacheDir.getAbsolutePath() : null;
+    }
+
+    @Keep
+    private String getShaderVariantLog() {
+        return shaderVariantLog != null ? shaderVariantLog.getAbsolutePath() : null;
+    }
+
+    @Keep
+    private int getShaderCompileThreads() {
+        return shaderCompileThreads;
+    }
+
+    @Keep
+    private boolean getSkipDrawsUntilReady() {
+        return skipDrawsUntilReady;
+    }
+
+    @Keep
+    private int getMaxRenderThreads() {
+        return maxRenderThreads;
+    }
+
+    @Keep
+    private boolean getAsyncReadback() {
+        return asyncReadback;
+    }
+
+    @Keep
+    private boolean getPipelinedDecode() {
+        return pipelinedDecode;
+    }
+
+    @Keep
+    private boolean getConstantBufferUbo() {
+        return constantBufferUbo;
+    }
+
+    @Keep
+    private boolean getSeparablePrograms() {
+        return separablePrograms;
+    }
+
+    @Keep
+    private String getTraceDir() {
+        return traceDir != null ? traceDir.getAbsolutePath() : null;
+    }
+
+    @Keep
+    private boolean getDecodeStatsEnabled() {
+        return decodeStats;
+    }
+
     @Override
     public void handleConnectionShutdown(Client client) {
         long clientPtr = (long)client.getTag();
@@ -104,10 +246,68 @@ public class VirGLRendererComponent extends EnvironmentComponent implements Conn
             texture.copyFromFramebuffer(framebuffer, drawable.width, drawable.height);
         }
 
+        schedulePresentation();
         Runnable onDrawListener = drawable.getOnDrawListener();
         if (onDrawListener != null) onDrawListener.run();
     }
 
+    // the vsync the frame rate limit picked for this present, see virgl_server_pacer.h
+    private void schedulePresentation() {
+        if (frameRateLimit == 0 && thermalFrameRateLimit == 0) return;
+        long presentationTime = getPresentationTime();
+        if (presentationTime != 0) xServer.getRenderer().setPresentationTime(presentationTime);
+    }
+
+    @Keep
+    private void flushFrontbufferHardwareBuffer(int drawableId, long hardwareBufferPtr, long sync) {
+        Drawable drawable = xServer.drawableManager.getDrawable(drawableId);
+        if (drawable == null) {
+            GLES30.glDeleteSync(sync);
+            return;
+        }
+
+        synchronized (drawable.renderLock) {
+            Texture texture = drawable.getTexture();
+            if (!(texture instanceof GPUImage) || ((GPUImage)texture).getHardwareBufferPtr() != hardwareBufferPtr) {
+                xServer.getRenderer().xServerView.queueEvent(texture::destroy);
+                texture = new GPUImage(hardwareBufferPtr);
+                drawable.setTexture(texture);
+            }
+            ((GPUImage)texture).setPendingSync(sync);
+        }
+
+        schedulePresentation();
+        Runnable onDrawListener = drawable.getOnDrawListener();
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
+    // clients apply it on their next request, see virgl_server_renderer_trim()
+    public void onTrimMemory(int level) {
+        trimMemory(level);
+    }
+
+    // GL bytes, shm bytes and shm bytes released by trims
+    public long[] getMemoryStats(Client client) {
+        long[] stats = new long[3];
+        Object tag = client.getTag();
+        if (tag != null) getMemoryStats((long)tag, stats);
+        return stats;
+    }
+
+    public String[] getDecodeCommandNames() {
+        if (decodeCommandNames == null) decodeCommandNames = getDecodeCommandNamesNative();
+        return decodeCommandNames;
+    }
+
+    // count and total ns of every command type, indexed like getDecodeCommandNames()
+    public long[][] getDecodeStats(Client client, boolean reset) {
+        int numCommands = getDecodeCommandNames().length;
+        long[][] stats = {new long[numCommands], new long[numCommands]};
+        Object tag = client.getTag();
+        if (tag != null) getDecodeStats((long)tag, stats[0], stats[1], reset);
+        return stats;
+    }
+
     private native long handleNewConnection(int fd);
 
     private native void handleRequest(long clientPtr);
@@ -117,4 +317,16 @@ public class VirGLRendererComponent extends EnvironmentComponent implements Conn
     private native void destroyClient(long clientPtr);
 
     private native void destroyRenderer(long clientPtr);
+
+    private native void trimMemory(int level);
+
+    private native void setFrameRateLimitNative(int fps);
+
+    private native long getPresentationTime();
+
+    private native void getMemoryStats(long clientPtr, long[] stats);
+
+    private native String[] getDecodeCommandNamesNative();
+
+    private native void getDecodeStats(long clientPtr, long[] counts, long[] nanos, boolean reset);
 }
@@ -1,5 +1,6 @@
 package com.steamdeck.mobile.core.xenvironment.components;
 
+import com.steamdeck.mobile.core.winlator.ThreadRoles;
 import com.steamdeck.mobile.core.xenvironment.EnvironmentComponent;
 import com.steamdeck.mobile.core.xconnector.XConnectorEpoll;
 import com.steamdeck.mobile.core.xconnector.UnixSocketConfig;
@@ -23,6 +24,9 @@ public class XServerComponent extends EnvironmentComponent {
         connector = new XConnectorEpoll(socketConfig, new XClientConnectionHandler(xServer), new XClientRequestHandler());
         connector.setInitialInputBufferCapacity(262144);
         connector.setCanReceiveAncillaryMessages(true);
+        connector.setEdgeTriggered(true);
+        connector.setMaxEvents(64);
+        connector.setThreadRole(ThreadRoles.ROLE_INPUT);
         connector.start();
     }
 
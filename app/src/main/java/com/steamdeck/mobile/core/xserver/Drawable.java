@@ -11,6 +11,11 @@ import java.nio.ByteBuffer;
 import java.nio.ByteOrder;
 
 public class Drawable extends XResource {
+    public static final byte COMPOSITE_OP_SRC = 1;
+    public static final byte COMPOSITE_OP_OVER = 3;
+    public static final byte COMPOSITE_OP_ADD = 12;
+    private static final int COMPOSITE_SRC_OPAQUE = 1;
+    private static final int COMPOSITE_DST_OPAQUE = 2;
     public final short width;
     public final short height;
     public final Visual visual;
@@ -19,6 +24,9 @@ public class Drawable extends XResource {
     private Runnable onDrawListener;
     private Callback<Drawable> onDestroyListener;
     public final Object renderLock = new Object();
+    private Bitmap lockedBitmap; // keeps wrapped pixels alive
+    private GPUImage backImage;
+    private boolean destroyed = false;
 
     static {
         System.loadLibrary("winlator");
@@ -32,12 +40,30 @@ public class Drawable extends XResource {
         this.data = ByteBuffer.allocateDirect(width * height * 4).order(ByteOrder.LITTLE_ENDIAN);
     }
 
+    private Drawable(int id, int width, int height, Visual visual, ByteBuffer data) {
+        super(id);
+        this.width = (short)width;
+        this.height = (short)height;
+        this.visual = visual;
+        this.data = data;
+    }
+
     public static Drawable fromBitmap(Bitmap bitmap) {
         Drawable drawable = new Drawable(0, bitmap.getWidth(), bitmap.getHeight(), null);
         fromBitmap(bitmap, drawable.data);
         return drawable;
     }
 
+    // Backs the drawable with the locked pixels of the bitmap instead of a copy
+    public static Drawable wrapBitmap(Bitmap bitmap) {
+        ByteBuffer pixels = lockBitmapPixels(bitmap);
+        if (pixels == null) return fromBitmap(bitmap);
+
+        Drawable drawable = new Drawable(0, bitmap.getWidth(), bitmap.getHeight(), null, pixels.order(ByteOrder.LITTLE_ENDIAN));
+        drawable.lockedBitmap = bitmap;
+        return drawable;
+    }
+
     public Texture getTexture() {
         return texture;
     }
@@ -47,6 +73,10 @@ public class Drawable extends XResource {
         this.texture = texture;
     }
 
+    public GPUImage getBackImage() {
+        return backImage;
+    }
+
     public ByteBuffer getData() {
         return data;
     }
@@ -59,6 +89,16 @@ public class Drawable extends XResource {
         return texture instanceof GPUImage ? ((GPUImage)texture).getStride() : width;
     }
 
+    // Set under the render lock when the drawable is removed: its texture and pixels may be released
+    // any time after, so whoever draws outside of the drawable manager lock checks it first
+    public boolean isDestroyed() {
+        return destroyed;
+    }
+
+    public void markDestroyed() {
+        destroyed = true;
+    }
+
     public Runnable getOnDrawListener() {
         return onDrawListener;
     }
@@ -91,7 +131,44 @@ public class Drawable extends XResource {
         this.data.rewind();
         data.rewind();
 
-        texture.setNeedsUpdate(true);
+        if (depth == 1) texture.setNeedsUpdate(true);
+        else texture.addDamage(dstX, dstY, width, height);
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
+    // Draws an XYBitmap with 1 bits in the foreground and 0 bits in the background colour
+    public void drawBitmap(short dstX, short dstY, short width, short height, int foreground, int background, ByteBuffer data) {
+        short srcWidth = width;
+        short srcX = 0;
+        short srcY = 0;
+        if (dstX < 0) {
+            srcX = (short)-dstX;
+            width += dstX;
+            dstX = 0;
+        }
+        if (dstY < 0) {
+            srcY = (short)-dstY;
+            height += dstY;
+            dstY = 0;
+        }
+        if ((dstX + width) > this.width) width = (short)(this.width - dstX);
+        if ((dstY + height) > this.height) height = (short)(this.height - dstY);
+        if (width <= 0 || height <= 0) return;
+
+        if (visual != null && visual.depth == 1) {
+            foreground = (foreground & 1) != 0 ? 0xffffff : 0x000000;
+            background = (background & 1) != 0 ? 0xffffff : 0x000000;
+        }
+        else {
+            foreground = 0xff000000 | foreground;
+            background = 0xff000000 | background;
+        }
+
+        drawBitmapColored(srcX, srcY, dstX, dstY, width, height, srcWidth, foreground, background, this.getStride(), data, this.data);
+        this.data.rewind();
+        data.rewind();
+
+        texture.addDamage(dstX, dstY, width, height);
         if (onDrawListener != null) onDrawListener.run();
     }
 
@@ -128,7 +205,57 @@ public class Drawable extends XResource {
         this.data.rewind();
         drawable.data.rewind();
 
-        texture.setNeedsUpdate(true);
+        texture.addDamage(dstX, dstY, width, height);
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
+    // Presents into the second buffer of a GPUImage backed drawable and swaps it in, so the copy neither
+    // holds the render lock nor overwrites pixels the GPU may still be sampling
+    public void present(short dstX, short dstY, Drawable drawable) {
+        if (!(texture instanceof GPUImage) || data == null) {
+            synchronized (renderLock) {
+                copyArea((short)0, (short)0, dstX, dstY, drawable.width, drawable.height, drawable);
+            }
+            return;
+        }
+
+        if (backImage == null) {
+            backImage = new GPUImage(width, height);
+            backImage.setTracksRelease(true);
+        }
+        ByteBuffer backData = backImage.getVirtualData();
+        if (backData == null) {
+            synchronized (renderLock) {
+                copyArea((short)0, (short)0, dstX, dstY, drawable.width, drawable.height, drawable);
+            }
+            return;
+        }
+        ((GPUImage)texture).setTracksRelease(true);
+
+        short width = drawable.width;
+        short height = drawable.height;
+        dstX = (short)Mathf.clamp(dstX, 0, this.width-1);
+        dstY = (short)Mathf.clamp(dstY, 0, this.height-1);
+        if ((dstX + width) > this.width) width = (short)(this.width - dstX);
+        if ((dstY + height) > this.height) height = (short)(this.height - dstY);
+
+        backImage.waitForRelease();
+        short backStride = backImage.getStride();
+        if (dstX != 0 || dstY != 0 || width != this.width || height != this.height) {
+            copyArea((short)0, (short)0, (short)0, (short)0, this.width, this.height, this.getStride(), backStride, this.data, backData);
+            this.data.rewind();
+            backData.rewind();
+        }
+        copyArea((short)0, (short)0, dstX, dstY, width, height, drawable.getStride(), backStride, drawable.data, backData);
+        drawable.data.rewind();
+        backData.rewind();
+
+        synchronized (renderLock) {
+            GPUImage frontImage = (GPUImage)texture;
+            setTexture(backImage);
+            backImage = frontImage;
+        }
+
         if (onDrawListener != null) onDrawListener.run();
     }
 
@@ -145,7 +272,33 @@ public class Drawable extends XResource {
         fillRect((short)x, (short)y, (short)width, (short)height, color, this.getStride(), this.data);
         this.data.rewind();
 
-        texture.setNeedsUpdate(true);
+        texture.addDamage(x, y, width, height);
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
+    public void fillRects(int color, short... rects) {
+        int numRects = 0;
+        for (int i = 0; i < rects.length; i += 4) {
+            int x = Mathf.clamp(rects[i+0], 0, this.width-1);
+            int y = Mathf.clamp(rects[i+1], 0, this.height-1);
+            int width = rects[i+2];
+            int height = rects[i+3];
+            if ((x + width) > this.width) width = this.width - x;
+            if ((y + height) > this.height) height = this.height - y;
+            if (width <= 0 || height <= 0) continue;
+
+            int j = numRects++ * 4;
+            rects[j+0] = (short)x;
+            rects[j+1] = (short)y;
+            rects[j+2] = (short)width;
+            rects[j+3] = (short)height;
+        }
+        if (numRects == 0) return;
+
+        fillRects(rects, numRects, color, this.getStride(), this.data);
+        this.data.rewind();
+
+        for (int i = 0; i < numRects * 4; i += 4) texture.addDamage(rects[i+0], rects[i+1], rects[i+2], rects[i+3]);
         if (onDrawListener != null) onDrawListener.run();
     }
 
@@ -165,7 +318,7 @@ public class Drawable extends XResource {
 
         this.data.rewind();
 
-        texture.setNeedsUpdate(true);
+        texture.addDamage(Math.min(x0, x1), Math.min(y0, y1), Math.abs(x1 - x0) + lineWidth, Math.abs(y1 - y0) + lineWidth);
         if (onDrawListener != null) onDrawListener.run();
     }
 
@@ -177,8 +330,52 @@ public class Drawable extends XResource {
         if (onDrawListener != null) onDrawListener.run();
     }
 
+    public boolean isOpaque() {
+        return visual != null && visual.depth != 32;
+    }
+
+    // Render Composite of a premultiplied source drawable (or a solid color when srcDrawable is null)
+    // through the alpha of an optional mask drawable. The rectangle is clipped to every drawable involved.
+    public void composite(byte op, Drawable srcDrawable, int srcColor, short srcX, short srcY, Drawable maskDrawable, short maskX, short maskY, short dstX, short dstY, short width, short height) {
+        if (dstX < 0) { srcX -= dstX; maskX -= dstX; width += dstX; dstX = 0; }
+        if (dstY < 0) { srcY -= dstY; maskY -= dstY; height += dstY; dstY = 0; }
+        width = (short)Math.min(width, this.width - dstX);
+        height = (short)Math.min(height, this.height - dstY);
+        if (srcDrawable != null) {
+            width = (short)Math.min(width, srcDrawable.width - srcX);
+            height = (short)Math.min(height, srcDrawable.height - srcY);
+        }
+        if (maskDrawable != null) {
+            width = (short)Math.min(width, maskDrawable.width - maskX);
+            height = (short)Math.min(height, maskDrawable.height - maskY);
+        }
+        if (width <= 0 || height <= 0 || srcX < 0 || srcY < 0 || maskX < 0 || maskY < 0) return;
+
+        int flags = (isOpaque() ? COMPOSITE_DST_OPAQUE : 0) | (srcDrawable != null && srcDrawable.isOpaque() ? COMPOSITE_SRC_OPAQUE : 0);
+        composite(op, flags, srcX, srcY, maskX, maskY, dstX, dstY, width, height,
+            srcDrawable != null ? srcDrawable.getStride() : 0, maskDrawable != null ? maskDrawable.getStride() : 0, this.getStride(),
+            srcDrawable != null ? srcDrawable.data : null, srcColor, maskDrawable != null ? maskDrawable.data : null, this.data);
+        this.data.rewind();
+
+        texture.addDamage(dstX, dstY, width, height);
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
+    // Composites numGlyphs glyphs from an a8 atlas with a solid color in one call, glyphRects holding the
+    // x, y, width and height of each glyph in this drawable followed by its x and y in the atlas
+    public void compositeGlyphs(byte op, int srcColor, ByteBuffer atlasData, short atlasStride, short[] glyphRects, int numGlyphs) {
+        if (numGlyphs <= 0) return;
+        compositeGlyphs(op, isOpaque() ? COMPOSITE_DST_OPAQUE : 0, srcColor, atlasData, atlasStride, glyphRects, numGlyphs, width, height, this.getStride(), this.data);
+        this.data.rewind();
+
+        for (int i = 0; i < numGlyphs * 6; i += 6) texture.addDamage(glyphRects[i+0], glyphRects[i+1], glyphRects[i+2], glyphRects[i+3]);
+        if (onDrawListener != null) onDrawListener.run();
+    }
+
     private static native void drawBitmap(short width, short height, ByteBuffer srcData, ByteBuffer dstData);
 
+    private static native void drawBitmapColored(short srcX, short srcY, short dstX, short dstY, short width, short height, short srcWidth, int foreground, int background, short stride, ByteBuffer srcData, ByteBuffer dstData);
+
     private static native void drawAlphaMaskedBitmap(byte foreRed, byte foreGreen, byte foreBlue, byte backRed, byte backGreen, byte backBlue, ByteBuffer srcData, ByteBuffer maskData, ByteBuffer dstData);
 
     private static native void copyArea(short srcX, short srcY, short dstX, short dstY, short width, short height, short srcStride, short dstStride, ByteBuffer srcData, ByteBuffer dstData);
@@ -187,7 +384,15 @@ public class Drawable extends XResource {
 
     private static native void fillRect(short x, short y, short width, short height, int color, short stride, ByteBuffer data);
 
+    private static native void fillRects(short[] rects, int numRects, int color, short stride, ByteBuffer data);
+
     private static native void drawLine(short x0, short y0, short x1, short y1, int color, short lineWidth, short stride, ByteBuffer data);
 
+    private static native void composite(byte op, int flags, short srcX, short srcY, short maskX, short maskY, short dstX, short dstY, short width, short height, short srcStride, short maskStride, short dstStride, ByteBuffer srcData, int srcColor, ByteBuffer maskData, ByteBuffer dstData);
+
+    private static native void compositeGlyphs(byte op, int flags, int srcColor, ByteBuffer atlasData, short atlasStride, short[] glyphRects, int numGlyphs, short dstWidth, short dstHeight, short dstStride, ByteBuffer dstData);
+
     private static native void fromBitmap(Bitmap bitmap, ByteBuffer data);
+
+    private static native ByteBuffer lockBitmapPixels(Bitmap bitmap);
 }
\ No newline at end of file
@@ -34,13 +34,19 @@ public class DrawableManager extends XResourceManager implements XResourceManage
         Drawable drawable = drawables.get(id);
         if (drawable == null) return;
 
-        final Texture texture = drawable.getTexture();
+        final Texture texture;
+        synchronized (drawable.renderLock) {
+            drawable.markDestroyed();
+            texture = drawable.getTexture();
+        }
         if (texture != null) {
             // CRITICAL: Check if renderer is still available (app may be shutting down)
             // Prevents NPE when XServerView/GLRenderer is already destroyed
             com.steamdeck.mobile.presentation.renderer.GLRenderer renderer = xServer.getRenderer();
             if (renderer != null && renderer.xServerView != null) {
                 renderer.xServerView.queueEvent(texture::destroy);
+                final Texture backImage = drawable.getBackImage();
+                if (backImage != null) renderer.xServerView.queueEvent(backImage::destroy);
             }
         }
 
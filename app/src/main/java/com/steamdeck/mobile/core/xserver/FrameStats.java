@@ -0,0 +1,35 @@
+package com.steamdeck.mobile.core.xserver;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Frame pacing of the last 256 presented frames, collected in native code (frame_stats.c).
+ * virgl reports each present with the CPU time spent decoding its commands and later the
+ * time its GPU work completed; while no virgl client presents, the compositor's presents
+ * are recorded instead.
+ */
+public abstract class FrameStats {
+    public static final int MAX_FRAMES = 256;
+
+    static {
+        System.loadLibrary("winlator");
+    }
+
+    public static native void markPresent();
+
+    /**
+     * Fills one RGBA texel per frame into a direct buffer, oldest first: R the time since the
+     * previous present, G the CPU decode time and B the GPU completion time after the present,
+     * 255 standing for scaleMicros or more.
+     * @return number of frames filled, the buffer starts with zero texels when fewer were seen
+     */
+    public static native int fillGraph(ByteBuffer texels, int frames, int scaleMicros);
+
+    /**
+     * Fills the average frame interval, CPU decode and GPU completion times and the worst frame
+     * interval in microseconds, -1 for a value that was not seen.
+     */
+    public static native void getAverages(long[] averages);
+
+    public static native void reset();
+}
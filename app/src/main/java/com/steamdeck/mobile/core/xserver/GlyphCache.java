@@ -0,0 +1,177 @@
+package com.steamdeck.mobile.core.xserver;
+
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Iterator;
+
+// Coverage masks of the glyphs clients uploaded, keyed by glyph set and glyph index. They are packed into
+// shelves of a single a8 atlas so that a whole string is composited with one native call.
+public class GlyphCache {
+    public static final short ATLAS_WIDTH = 1024;
+    private static final short MIN_ATLAS_HEIGHT = 256;
+    private static final short MAX_ATLAS_HEIGHT = 8192;
+    private final HashMap<Long, Glyph> glyphs = new HashMap<>();
+    private ByteBuffer atlas = ByteBuffer.allocateDirect(ATLAS_WIDTH * MIN_ATLAS_HEIGHT);
+    private short atlasHeight = MIN_ATLAS_HEIGHT;
+    private short shelfX = 0;
+    private short shelfY = 0;
+    private short shelfHeight = 0;
+    private int usedArea = 0;
+    private short[] glyphRects = new short[6 * 64];
+
+    public static class Glyph {
+        public final short width;
+        public final short height;
+        public final short x;
+        public final short y;
+        private short atlasX;
+        private short atlasY;
+
+        private Glyph(short width, short height, short x, short y) {
+            this.width = width;
+            this.height = height;
+            this.x = x;
+            this.y = y;
+        }
+    }
+
+    private static long key(int glyphSet, int index) {
+        return ((long)glyphSet << 32) | (index & 0xffffffffL);
+    }
+
+    public Glyph getGlyph(int glyphSet, int index) {
+        return glyphs.get(key(glyphSet, index));
+    }
+
+    // Adds an a8 image, rows padded to 4 bytes, whose origin is x, y pixels into the image.
+    // Returns false when the glyph doesn't fit in the atlas.
+    public synchronized boolean addGlyph(int glyphSet, int index, short width, short height, short x, short y, ByteBuffer data) {
+        if (width > ATLAS_WIDTH || height > MAX_ATLAS_HEIGHT) return false;
+        Glyph glyph = new Glyph(width, height, x, y);
+        if (!allocate(glyph)) return false;
+
+        int stride = (width + 3) & ~3;
+        for (int row = 0; row < height; row++) {
+            ByteBuffer line = data.duplicate();
+            line.position(data.position() + row * stride).limit(data.position() + row * stride + width);
+            atlas.position(glyph.atlasX + (glyph.atlasY + row) * ATLAS_WIDTH);
+            atlas.put(line);
+        }
+        atlas.rewind();
+
+        Glyph oldGlyph = glyphs.put(key(glyphSet, index), glyph);
+        if (oldGlyph != null) usedArea -= oldGlyph.width * oldGlyph.height;
+        usedArea += width * height;
+        return true;
+    }
+
+    public synchronized void freeGlyph(int glyphSet, int index) {
+        Glyph glyph = glyphs.remove(key(glyphSet, index));
+        if (glyph != null) usedArea -= glyph.width * glyph.height;
+    }
+
+    public synchronized void freeGlyphSet(int glyphSet) {
+        Iterator<HashMap.Entry<Long, Glyph>> iterator = glyphs.entrySet().iterator();
+        while (iterator.hasNext()) {
+            HashMap.Entry<Long, Glyph> entry = iterator.next();
+            if ((int)(entry.getKey() >> 32) != glyphSet) continue;
+            usedArea -= entry.getValue().width * entry.getValue().height;
+            iterator.remove();
+        }
+    }
+
+    // Draws numGlyphs glyphs of glyphSet, their origins at the x, y pairs of positions. Glyphs that were
+    // never added are skipped.
+    public synchronized void drawGlyphs(Drawable drawable, byte op, int color, int glyphSet, int[] indices, short[] positions, int numGlyphs) {
+        if (glyphRects.length < numGlyphs * 6) glyphRects = new short[numGlyphs * 6];
+
+        int count = 0;
+        for (int i = 0; i < numGlyphs; i++) {
+            Glyph glyph = glyphs.get(key(glyphSet, indices[i]));
+            if (glyph == null || glyph.width == 0 || glyph.height == 0) continue;
+
+            int j = count++ * 6;
+            glyphRects[j+0] = (short)(positions[i * 2 + 0] - glyph.x);
+            glyphRects[j+1] = (short)(positions[i * 2 + 1] - glyph.y);
+            glyphRects[j+2] = glyph.width;
+            glyphRects[j+3] = glyph.height;
+            glyphRects[j+4] = glyph.atlasX;
+            glyphRects[j+5] = glyph.atlasY;
+        }
+
+        drawable.compositeGlyphs(op, color, atlas, ATLAS_WIDTH, glyphRects, count);
+    }
+
+    private boolean allocate(Glyph glyph) {
+        if (glyph.width == 0 || glyph.height == 0) return true;
+        if (place(glyph)) return true;
+
+        // The atlas is full: repack it, growing it until half of it stays free for later glyphs
+        int neededArea = usedArea + glyph.width * glyph.height;
+        for (int height = atlasHeight; height <= MAX_ATLAS_HEIGHT; height *= 2) {
+            if (neededArea * 2 > ATLAS_WIDTH * height && height < MAX_ATLAS_HEIGHT) continue;
+            if (repack((short)height) && place(glyph)) return true;
+        }
+        return false;
+    }
+
+    private boolean place(Glyph glyph) {
+        if (shelfX + glyph.width > ATLAS_WIDTH || glyph.height > shelfHeight) {
+            short y = (short)(shelfY + shelfHeight);
+            if (y + glyph.height > atlasHeight) return false;
+            shelfX = 0;
+            shelfY = y;
+            shelfHeight = glyph.height;
+        }
+
+        glyph.atlasX = shelfX;
+        glyph.atlasY = shelfY;
+        shelfX += glyph.width;
+        return true;
+    }
+
+    // Moves every glyph into a new atlas, tallest first so the shelves waste little. The old atlas is
+    // kept when they don't all fit.
+    private boolean repack(short newHeight) {
+        Glyph[] liveGlyphs = glyphs.values().toArray(new Glyph[0]);
+        Arrays.sort(liveGlyphs, (a, b) -> b.height - a.height);
+        short[] oldPositions = new short[liveGlyphs.length * 2];
+        for (int i = 0; i < liveGlyphs.length; i++) {
+            oldPositions[i * 2 + 0] = liveGlyphs[i].atlasX;
+            oldPositions[i * 2 + 1] = liveGlyphs[i].atlasY;
+        }
+
+        short oldHeight = atlasHeight, oldShelfX = shelfX, oldShelfY = shelfY, oldShelfHeight = shelfHeight;
+        atlasHeight = newHeight;
+        shelfX = shelfY = shelfHeight = 0;
+        for (Glyph glyph : liveGlyphs) {
+            if (glyph.width == 0 || glyph.height == 0 || place(glyph)) continue;
+
+            for (int i = 0; i < liveGlyphs.length; i++) {
+                liveGlyphs[i].atlasX = oldPositions[i * 2 + 0];
+                liveGlyphs[i].atlasY = oldPositions[i * 2 + 1];
+            }
+            atlasHeight = oldHeight;
+            shelfX = oldShelfX;
+            shelfY = oldShelfY;
+            shelfHeight = oldShelfHeight;
+            return false;
+        }
+
+        ByteBuffer oldAtlas = atlas;
+        atlas = ByteBuffer.allocateDirect(ATLAS_WIDTH * newHeight);
+        for (int i = 0; i < liveGlyphs.length; i++) {
+            Glyph glyph = liveGlyphs[i];
+            for (int row = 0; row < glyph.height; row++) {
+                int offset = oldPositions[i * 2 + 0] + (oldPositions[i * 2 + 1] + row) * ATLAS_WIDTH;
+                ByteBuffer line = oldAtlas.duplicate();
+                line.position(offset).limit(offset + glyph.width);
+                atlas.position(glyph.atlasX + (glyph.atlasY + row) * ATLAS_WIDTH);
+                atlas.put(line);
+            }
+        }
+        atlas.rewind();
+        return true;
+    }
+}
@@ -0,0 +1,36 @@
+package com.steamdeck.mobile.core.xserver;
+
+/**
+ * Input-to-photon latency, correlated per presented frame in native code (latency_stats.c).
+ * Stages are marked from the uinput bridge, the X server input path, the virgl frontbuffer
+ * flush and the compositor; samples cover the last 256 frames that responded to input.
+ */
+public abstract class LatencyStats {
+    public static final int STAGE_INPUT = 0;
+    public static final int STAGE_DISPATCH = 1;
+    public static final int STAGE_FLUSH = 2;
+    public static final int STAGE_PRESENT = 3;
+
+    public static final int HISTOGRAM_BUCKETS = 33;
+    public static final int HISTOGRAM_BUCKET_MS = 2;
+
+    static {
+        System.loadLibrary("winlator");
+    }
+
+    public static native void mark(int stage);
+
+    /**
+     * Fills input-to-present counts in 2ms buckets, the last bucket holds everything from 64ms.
+     * @return number of samples
+     */
+    public static native int getHistogram(int[] buckets);
+
+    /**
+     * Fills the average input-to-dispatch, input-to-flush and input-to-present times in
+     * microseconds, -1 for a stage that was not seen.
+     */
+    public static native void getAverages(long[] averages);
+
+    public static native void reset();
+}
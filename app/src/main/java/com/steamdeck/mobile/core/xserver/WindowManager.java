@@ -288,6 +288,38 @@ public class WindowManager extends XResourceManager {
         return child != null ? findPointWindow(child, rootX, rootY) : window;
     }
 
+    // The window whose content is all that is visible: it covers the whole screen, is opaque and
+    // nothing is mapped above it. Null when the screen shows more than one window, the compositor
+    // then has to blend them all.
+    public Window getFullscreenWindow() {
+        return findFullscreenWindow(rootWindow, rootWindow.getX(), rootWindow.getY());
+    }
+
+    private Window findFullscreenWindow(Window window, int x, int y) {
+        List<Window> children = window.getChildren();
+        for (int i = children.size()-1; i >= 0; i--) {
+            Window child = children.get(i);
+            if (!child.attributes.isMapped() || !child.isInputOutput()) continue;
+
+            int childX = x + child.getX();
+            int childY = y + child.getY();
+            if (childX > 0 || childY > 0 || childX + child.getWidth() < rootWindow.getWidth() || childY + child.getHeight() < rootWindow.getHeight()) return null;
+            if (!child.getContent().isOpaque()) return null;
+
+            // a child covering it in turn hides it
+            Window descendant = findFullscreenWindow(child, childX, childY);
+            return descendant != null || hasMappedChildren(child) ? descendant : child;
+        }
+        return null;
+    }
+
+    private static boolean hasMappedChildren(Window window) {
+        for (Window child : window.getChildren()) {
+            if (child.attributes.isMapped() && child.isInputOutput()) return true;
+        }
+        return false;
+    }
+
     public void addOnWindowModificationListener(OnWindowModificationListener onWindowModificationListener) {
         onWindowModificationListeners.add(onWindowModificationListener);
     }
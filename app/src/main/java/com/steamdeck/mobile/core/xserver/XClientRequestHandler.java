@@ -321,14 +321,11 @@ public class XClientRequestHandler implements RequestHandler {
                     }
                     break;
                 case ClientOpcodes.COPY_AREA:
-                    try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
-                        DrawRequests.copyArea(client, inputStream, outputStream);
-                    }
+                    // locks what it looks up by itself, the drawing only holds the drawable's render lock
+                    DrawRequests.copyArea(client, inputStream, outputStream);
                     break;
                 case ClientOpcodes.POLY_LINE:
-                    try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
-                        DrawRequests.polyLine(client, inputStream, outputStream);
-                    }
+                    DrawRequests.polyLine(client, inputStream, outputStream);
                     break;
                 case ClientOpcodes.POLY_SEGMENT:
                     client.skipRequest();
@@ -337,14 +334,10 @@ public class XClientRequestHandler implements RequestHandler {
                     client.skipRequest();
                     break;
                 case ClientOpcodes.POLY_FILL_RECTANGLE:
-                    try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
-                        DrawRequests.polyFillRectangle(client, inputStream, outputStream);
-                    }
+                    DrawRequests.polyFillRectangle(client, inputStream, outputStream);
                     break;
                 case ClientOpcodes.PUT_IMAGE:
-                    try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
-                        DrawRequests.putImage(client, inputStream, outputStream);
-                    }
+                    DrawRequests.putImage(client, inputStream, outputStream);
                     break;
                 case ClientOpcodes.GET_IMAGE:
                     try (XLock lock = client.xServer.lock(XServer.Lockable.PIXMAP_MANAGER, XServer.Lockable.DRAWABLE_MANAGER)) {
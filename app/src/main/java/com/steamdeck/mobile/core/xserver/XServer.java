@@ -26,6 +26,7 @@ public class XServer {
     public final PixmapManager pixmapManager;
     public final ResourceIDs resourceIDs = new ResourceIDs(128);
     public final GraphicsContextManager graphicsContextManager = new GraphicsContextManager();
+    public final GlyphCache glyphCache = new GlyphCache();
     public final SelectionManager selectionManager;
     public final DrawableManager drawableManager;
     public final WindowManager windowManager;
@@ -142,27 +143,35 @@ public class XServer {
     }
 
     public void injectPointerMove(int x, int y) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             pointer.setPosition(x, y);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     public void injectPointerMoveDelta(int dx, int dy) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             pointer.setPosition(pointer.getX() + dx, pointer.getY() + dy);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     public void injectPointerButtonPress(Pointer.Button buttonCode) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             pointer.setButton(buttonCode, true);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     public void injectPointerButtonRelease(Pointer.Button buttonCode) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             pointer.setButton(buttonCode, false);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     public void injectKeyPress(XKeycode xKeycode) {
@@ -170,15 +179,19 @@ public class XServer {
     }
 
     public void injectKeyPress(XKeycode xKeycode, int keysym) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             keyboard.setKeyPress(xKeycode.id, keysym);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     public void injectKeyRelease(XKeycode xKeycode) {
+        LatencyStats.mark(LatencyStats.STAGE_INPUT);
         try (XLock lock = lock(Lockable.WINDOW_MANAGER, Lockable.INPUT_DEVICE)) {
             keyboard.setKeyRelease(xKeycode.id);
         }
+        LatencyStats.mark(LatencyStats.STAGE_DISPATCH);
     }
 
     private void setupExtensions() {
@@ -90,20 +90,27 @@ public class MITSHMExtension implements Extension {
         int shmseg = inputStream.readInt();
         inputStream.skip(4);
 
-        Drawable drawable = client.xServer.drawableManager.getDrawable(drawableId);
-        if (drawable == null) throw new BadDrawable(drawableId);
-
-        GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
-        if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+        Drawable drawable;
+        GraphicsContext.Function function;
+        try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+            drawable = client.xServer.drawableManager.getDrawable(drawableId);
+            if (drawable == null) throw new BadDrawable(drawableId);
+
+            GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
+            if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            function = graphicsContext.getFunction();
+        }
 
         ByteBuffer data = client.xServer.getSHMSegmentManager().getData(shmseg);
         if (data == null) throw new BadSHMSegment(shmseg);
 
-        if (graphicsContext.getFunction() != GraphicsContext.Function.COPY) {
+        if (function != GraphicsContext.Function.COPY) {
             throw new UnsupportedOperationException("GC Function other than COPY is not supported.");
         }
 
-        drawable.drawImage(srcX, srcY, dstX, dstY, srcWidth, srcHeight, depth, data, totalWidth, totalHeight);
+        synchronized (drawable.renderLock) {
+            if (!drawable.isDestroyed()) drawable.drawImage(srcX, srcY, dstX, dstY, srcWidth, srcHeight, depth, data, totalWidth, totalHeight);
+        }
     }
 
     @Override
@@ -124,7 +131,9 @@ public class MITSHMExtension implements Extension {
                 }
                 break;
             case ClientOpcodes.PUT_IMAGE :
-                try (XLock lock = client.xServer.lock(XServer.Lockable.SHMSEGMENT_MANAGER, XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+                // the segment stays attached while its pixels are copied, the drawable and GC are only
+                // locked while they are looked up
+                try (XLock lock = client.xServer.lock(XServer.Lockable.SHMSEGMENT_MANAGER)) {
                     putImage(client, inputStream, outputStream);
                 }
                 break;
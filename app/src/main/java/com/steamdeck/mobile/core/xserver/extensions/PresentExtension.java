@@ -31,13 +31,17 @@ public class PresentExtension implements Extension {
     private static final int FAKE_INTERVAL = 1000000 / 60;
     public enum Kind {PIXMAP, MSC_NOTIFY}
     public enum Mode {COPY, FLIP, SKIP}
+    // Presents complete as soon as the pixmap was copied, whatever the target msc
+    private static final int CAPABILITY_ASYNC = 1;
     private final SparseArray<Event> events = new SparseArray<>();
     private SyncExtension syncExtension;
 
     private static abstract class ClientOpcodes {
         private static final byte QUERY_VERSION = 0;
         private static final byte PRESENT_PIXMAP = 1;
+        private static final byte NOTIFY_MSC = 2;
         private static final byte SELECT_INPUT = 3;
+        private static final byte QUERY_CAPABILITIES = 4;
     }
 
     private static class Event {
@@ -128,10 +132,35 @@ public class PresentExtension implements Extension {
         long ust = System.nanoTime() / 1000;
         long msc = ust / FAKE_INTERVAL;
 
-        synchronized (content.renderLock) {
-            content.copyArea((short)0, (short)0, xOff, yOff, pixmap.drawable.width, pixmap.drawable.height, pixmap.drawable);
-            sendIdleNotify(window, pixmap, serial, idleFence);
-            sendCompleteNotify(window, serial, Kind.PIXMAP, Mode.COPY, ust, msc);
+        content.present(xOff, yOff, pixmap.drawable);
+        sendIdleNotify(window, pixmap, serial, idleFence);
+        sendCompleteNotify(window, serial, Kind.PIXMAP, Mode.COPY, ust, msc);
+    }
+
+    private void notifyMSC(XClient client, XInputStream inputStream, XOutputStream outputStream) throws IOException, XRequestError {
+        int windowId = inputStream.readInt();
+        int serial = inputStream.readInt();
+        inputStream.skip(client.getRemainingRequestLength());
+
+        Window window = client.xServer.windowManager.getWindow(windowId);
+        if (window == null) throw new BadWindow(windowId);
+
+        long ust = System.nanoTime() / 1000;
+        long msc = ust / FAKE_INTERVAL;
+        sendCompleteNotify(window, serial, Kind.MSC_NOTIFY, Mode.COPY, ust, msc);
+    }
+
+    private static void queryCapabilities(XClient client, XInputStream inputStream, XOutputStream outputStream) throws IOException, XRequestError {
+        int target = inputStream.readInt();
+        if (client.xServer.windowManager.getWindow(target) == null) throw new BadWindow(target);
+
+        try (XStreamLock lock = outputStream.lock()) {
+            outputStream.writeByte(RESPONSE_CODE_SUCCESS);
+            outputStream.writeByte((byte)0);
+            outputStream.writeShort(client.getSequenceNumber());
+            outputStream.writeInt(0);
+            outputStream.writeInt(CAPABILITY_ASYNC);
+            outputStream.writePad(20);
         }
     }
 
@@ -185,6 +214,16 @@ public class PresentExtension implements Extension {
                     presentPixmap(client, inputStream, outputStream);
                 }
                 break;
+            case ClientOpcodes.NOTIFY_MSC:
+                try (XLock lock = client.xServer.lock(XServer.Lockable.WINDOW_MANAGER)) {
+                    notifyMSC(client, inputStream, outputStream);
+                }
+                break;
+            case ClientOpcodes.QUERY_CAPABILITIES:
+                try (XLock lock = client.xServer.lock(XServer.Lockable.WINDOW_MANAGER)) {
+                    queryCapabilities(client, inputStream, outputStream);
+                }
+                break;
             case ClientOpcodes.SELECT_INPUT:
                 try (XLock lock = client.xServer.lock(XServer.Lockable.WINDOW_MANAGER)) {
                     selectInput(client, inputStream, outputStream);
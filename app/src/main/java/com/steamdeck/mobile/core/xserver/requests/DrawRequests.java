@@ -8,6 +8,8 @@ import com.steamdeck.mobile.core.xconnector.XStreamLock;
 import com.steamdeck.mobile.core.xserver.Drawable;
 import com.steamdeck.mobile.core.xserver.GraphicsContext;
 import com.steamdeck.mobile.core.xserver.XClient;
+import com.steamdeck.mobile.core.xserver.XLock;
+import com.steamdeck.mobile.core.xserver.XServer;
 import com.steamdeck.mobile.core.xserver.errors.BadDrawable;
 import com.steamdeck.mobile.core.xserver.errors.BadGraphicsContext;
 import com.steamdeck.mobile.core.xserver.errors.BadMatch;
@@ -34,21 +36,29 @@ public abstract class DrawRequests {
         int length = client.getRemainingRequestLength();
         ByteBuffer data = inputStream.readByteBuffer(length);
 
-        Drawable drawable =  client.xServer.drawableManager.getDrawable(drawableId);
-        if (drawable == null) throw new BadDrawable(drawableId);
+        Drawable drawable;
+        int foreground, background;
+        try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+            drawable = client.xServer.drawableManager.getDrawable(drawableId);
+            if (drawable == null) throw new BadDrawable(drawableId);
 
-        GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
-        if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
+            if (graphicsContext == null) throw new BadGraphicsContext(gcId);
 
-        if (!(graphicsContext.getFunction() == GraphicsContext.Function.COPY || format == Format.Z_PIXMAP)) {
-            throw new UnsupportedOperationException("GC Function other than COPY is not supported.");
+            if (!(graphicsContext.getFunction() == GraphicsContext.Function.COPY || format == Format.Z_PIXMAP)) {
+                throw new UnsupportedOperationException("GC Function other than COPY is not supported.");
+            }
+            foreground = graphicsContext.getForeground();
+            background = graphicsContext.getBackground();
         }
 
         switch (format) {
             case BITMAP:
                 if (leftPad != 0) throw new UnsupportedOperationException("PutImage.leftPad cannot be != 0.");
                 if (depth == 1) {
-                    drawable.drawImage((short)0, (short)0, dstX, dstY, width, height, (byte)1, data, width, height);
+                    synchronized (drawable.renderLock) {
+                        if (!drawable.isDestroyed()) drawable.drawBitmap(dstX, dstY, width, height, foreground, background, data);
+                    }
                 }
                 else throw new BadMatch();
                 break;
@@ -57,7 +67,9 @@ public abstract class DrawRequests {
                 break;
             case Z_PIXMAP:
                 if (leftPad == 0) {
-                    drawable.drawImage((short)0, (short)0, dstX, dstY, width, height, depth, data, width, height);
+                    synchronized (drawable.renderLock) {
+                        if (!drawable.isDestroyed()) drawable.drawImage((short)0, (short)0, dstX, dstY, width, height, depth, data, width, height);
+                    }
                 }
                 else throw new BadMatch();
                 break;
@@ -104,18 +116,31 @@ public abstract class DrawRequests {
         short width = inputStream.readShort();
         short height = inputStream.readShort();
 
-        Drawable srcDrawable =  client.xServer.drawableManager.getDrawable(srcDrawableId);
-        if (srcDrawable == null) throw new BadDrawable(srcDrawableId);
+        Drawable srcDrawable, dstDrawable;
+        GraphicsContext.Function function;
+        try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+            srcDrawable = client.xServer.drawableManager.getDrawable(srcDrawableId);
+            if (srcDrawable == null) throw new BadDrawable(srcDrawableId);
 
-        Drawable dstDrawable =  client.xServer.drawableManager.getDrawable(dstDrawableId);
-        if (dstDrawable == null) throw new BadDrawable(dstDrawableId);
+            dstDrawable = client.xServer.drawableManager.getDrawable(dstDrawableId);
+            if (dstDrawable == null) throw new BadDrawable(dstDrawableId);
 
-        GraphicsContext graphicsContext =  client.xServer.graphicsContextManager.getGraphicsContext(gcId);
-        if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
+            if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            function = graphicsContext.getFunction();
+        }
 
         if (srcDrawable.visual.depth != dstDrawable.visual.depth) throw new BadMatch();
 
-        dstDrawable.copyArea(srcX, srcY, dstX, dstY, width, height, srcDrawable, graphicsContext.getFunction());
+        // both render locks in id order, so that copies in opposite directions can't deadlock
+        Drawable first = srcDrawable.id <= dstDrawable.id ? srcDrawable : dstDrawable;
+        Drawable second = first == srcDrawable ? dstDrawable : srcDrawable;
+        synchronized (first.renderLock) {
+            synchronized (second.renderLock) {
+                if (srcDrawable.isDestroyed() || dstDrawable.isDestroyed()) return;
+                dstDrawable.copyArea(srcX, srcY, dstX, dstY, width, height, srcDrawable, function);
+            }
+        }
     }
 
     public static void polyLine(XClient client, XInputStream inputStream, XOutputStream outputStream) throws XRequestError {
@@ -123,10 +148,16 @@ public abstract class DrawRequests {
         int drawableId = inputStream.readInt();
         int gcId = inputStream.readInt();
 
-        Drawable drawable = client.xServer.drawableManager.getDrawable(drawableId);
-        if (drawable == null) throw new BadDrawable(drawableId);
-        GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
-        if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+        Drawable drawable;
+        int foreground, lineWidth;
+        try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+            drawable = client.xServer.drawableManager.getDrawable(drawableId);
+            if (drawable == null) throw new BadDrawable(drawableId);
+            GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
+            if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            foreground = graphicsContext.getForeground();
+            lineWidth = graphicsContext.getLineWidth();
+        }
         int length = client.getRemainingRequestLength();
 
         short[] points = new short[length / 2];
@@ -137,8 +168,10 @@ public abstract class DrawRequests {
             length -= 4;
         }
 
-        if (coordinateMode == CoordinateMode.ORIGIN && graphicsContext.getLineWidth() > 0) {
-            drawable.drawLines(graphicsContext.getForeground(), graphicsContext.getLineWidth(), points);
+        if (coordinateMode == CoordinateMode.ORIGIN && lineWidth > 0) {
+            synchronized (drawable.renderLock) {
+                if (!drawable.isDestroyed()) drawable.drawLines(foreground, lineWidth, points);
+            }
         }
     }
 
@@ -146,19 +179,29 @@ public abstract class DrawRequests {
         int drawableId = inputStream.readInt();
         int gcId = inputStream.readInt();
 
-        Drawable drawable = client.xServer.drawableManager.getDrawable(drawableId);
-        if (drawable == null) throw new BadDrawable(drawableId);
-        GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
-        if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+        Drawable drawable;
+        int background;
+        try (XLock lock = client.xServer.lock(XServer.Lockable.DRAWABLE_MANAGER, XServer.Lockable.GRAPHIC_CONTEXT_MANAGER)) {
+            drawable = client.xServer.drawableManager.getDrawable(drawableId);
+            if (drawable == null) throw new BadDrawable(drawableId);
+            GraphicsContext graphicsContext = client.xServer.graphicsContextManager.getGraphicsContext(gcId);
+            if (graphicsContext == null) throw new BadGraphicsContext(gcId);
+            background = graphicsContext.getBackground();
+        }
         int length = client.getRemainingRequestLength();
 
+        short[] rects = new short[length / 2];
+        int i = 0;
         while (length != 0) {
-            short x = inputStream.readShort();
-            short y = inputStream.readShort();
-            short width = inputStream.readShort();
-            short height = inputStream.readShort();
-            drawable.fillRect(x, y, width, height, graphicsContext.getBackground());
+            rects[i++] = inputStream.readShort();
+            rects[i++] = inputStream.readShort();
+            rects[i++] = inputStream.readShort();
+            rects[i++] = inputStream.readShort();
             length -= 8;
         }
+
+        synchronized (drawable.renderLock) {
+            if (!drawable.isDestroyed()) drawable.fillRects(background, rects);
+        }
     }
 }
\ No newline at end of file
@@ -3,20 +3,30 @@ package com.steamdeck.mobile.presentation.renderer;
 import android.content.Context;
 import android.graphics.Bitmap;
 import android.graphics.BitmapFactory;
+import android.opengl.EGL14;
+import android.opengl.EGLExt;
 import android.opengl.GLES20;
 import android.opengl.GLSurfaceView;
+import android.os.Build;
+import android.os.PerformanceHintManager;
+import android.os.Process;
+import android.view.Display;
 
 import com.steamdeck.mobile.R;
 import com.steamdeck.mobile.core.vr.XrActivity;
 import com.steamdeck.mobile.core.math.Mathf;
 import com.steamdeck.mobile.core.math.XForm;
 import com.steamdeck.mobile.presentation.renderer.material.CursorMaterial;
+import com.steamdeck.mobile.presentation.renderer.material.FrameStatsMaterial;
 import com.steamdeck.mobile.presentation.renderer.material.ShaderMaterial;
+import com.steamdeck.mobile.presentation.renderer.material.UpscaleMaterial;
 import com.steamdeck.mobile.presentation.renderer.material.WindowMaterial;
 import com.steamdeck.mobile.presentation.widget.XServerView;
 import com.steamdeck.mobile.core.xserver.Bitmask;
 import com.steamdeck.mobile.core.xserver.Cursor;
 import com.steamdeck.mobile.core.xserver.Drawable;
+import com.steamdeck.mobile.core.xserver.FrameStats;
+import com.steamdeck.mobile.core.xserver.LatencyStats;
 import com.steamdeck.mobile.core.xserver.Pointer;
 import com.steamdeck.mobile.core.xserver.Window;
 import com.steamdeck.mobile.core.xserver.WindowAttributes;
@@ -24,12 +34,20 @@ import com.steamdeck.mobile.core.xserver.WindowManager;
 import com.steamdeck.mobile.core.xserver.XLock;
 import com.steamdeck.mobile.core.xserver.XServer;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 
 import javax.microedition.khronos.egl.EGLConfig;
 import javax.microedition.khronos.opengles.GL10;
 
 public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindowModificationListener, Pointer.OnPointerMotionListener {
+    // Frame time graph: one bar per frame, full height at 50ms with a line at 60fps
+    private static final int FRAME_STATS_FRAMES = 128;
+    private static final int FRAME_STATS_SCALE_MICROS = 50000;
+    private static final int FRAME_STATS_TARGET_MICROS = 16667;
+    // windows cut into more visible pieces than this are drawn whole
+    private static final int MAX_VISIBLE_RECTS = 16;
     public final XServerView xServerView;
     private final XServer xServer;
     private final VertexAttribute quadVertices = new VertexAttribute("position", 2);
@@ -37,25 +55,43 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
     private final float[] tmpXForm2 = XForm.getInstance();
     private final CursorMaterial cursorMaterial = new CursorMaterial();
     private final WindowMaterial windowMaterial = new WindowMaterial();
+    private final FrameStatsMaterial frameStatsMaterial = new FrameStatsMaterial();
+    private final UpscaleMaterial upscaleMaterial = new UpscaleMaterial();
+    private final RenderScale renderScale;
+    private float upscaleSharpness = 0.0f;
+    private final ByteBuffer frameStatsTexels = ByteBuffer.allocateDirect(FRAME_STATS_FRAMES * 4).order(ByteOrder.nativeOrder());
+    private int frameStatsTextureId = 0;
+    private volatile boolean frameStatsVisible = false;
+    private volatile long presentationTime = 0;
+    // ADPF session of the GL thread, null before Android 12 or when the system refuses one
+    private PerformanceHintManager.Session hintSession;
     public final ViewTransformation viewTransformation = new ViewTransformation();
     private final Drawable rootCursorDrawable;
     private final ArrayList<RenderableWindow> renderableWindows = new ArrayList<>();
+    // a single opaque window covers the screen: it is drawn alone and without blending
+    private volatile boolean unredirected = false;
     private String forceFullscreenWMClass = null;
     private boolean fullscreen = false;
     private boolean toggleFullscreen = false;
     private boolean viewportNeedsUpdate = true;
     private boolean cursorVisible = true;
+    private volatile boolean cursorDrawn = false;
     private boolean screenOffsetYRelativeToCursor = false;
     private String[] unviewableWMClasses = null;
     private float magnifierZoom = 1.0f;
     private boolean magnifierEnabled = true;
     private int surfaceWidth;
     private int surfaceHeight;
+    private final int[] viewport = new int[4];
+    private boolean viewScissor = false;
 
     public GLRenderer(XServerView xServerView, XServer xServer) {
         this.xServerView = xServerView;
         this.xServer = xServer;
         rootCursorDrawable = createRootCursorDrawable();
+        renderScale = new RenderScale(xServerView.getContext());
+        // a reduced render resolution is sharpened by default
+        if (renderScale.getScale() < RenderScale.MAX_SCALE) upscaleSharpness = 0.5f;
 
         quadVertices.put(new float[]{
             0.0f, 0.0f,
@@ -87,6 +123,25 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
         GLES20.glEnable(GLES20.GL_BLEND);
         GLES20.glBlendFunc(GLES20.GL_SRC_ALPHA, GLES20.GL_ONE_MINUS_SRC_ALPHA);
         GLES20.glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        // a new EGL context, the old texture went with the old one
+        frameStatsTextureId = 0;
+        createHintSession();
+    }
+
+    private void createHintSession() {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.S) return;
+        // GLSurfaceView may have started a new GL thread
+        if (hintSession != null) {
+            hintSession.close();
+            hintSession = null;
+        }
+
+        PerformanceHintManager manager = xServerView.getContext().getSystemService(PerformanceHintManager.class);
+        if (manager == null) return;
+
+        Display display = xServerView.getDisplay();
+        float refreshRate = display != null ? display.getRefreshRate() : 60.0f;
+        hintSession = manager.createHintSession(new int[]{Process.myTid()}, (long)(1e9f / refreshRate));
     }
 
     @Override
@@ -97,6 +152,7 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             width = activity.getWidth();
             height = activity.getHeight();
             GLES20.glViewport(0, 0, width, height);
+            setViewport(0, 0, width, height);
             magnifierEnabled = false;
         }
 
@@ -113,7 +169,21 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             viewportNeedsUpdate = true;
         }
 
+        long frameStart = System.nanoTime();
         drawFrame();
+        if (hintSession != null) hintSession.reportActualWorkDuration(System.nanoTime() - frameStart);
+
+        long presentationTime = this.presentationTime;
+        if (presentationTime != 0) {
+            this.presentationTime = 0;
+            if (presentationTime > System.nanoTime()) {
+                EGLExt.eglPresentationTimeANDROID(EGL14.eglGetCurrentDisplay(), EGL14.eglGetCurrentSurface(EGL14.EGL_DRAW), presentationTime);
+            }
+        }
+        // GLSurfaceView swaps right after onDrawFrame returns
+        LatencyStats.mark(LatencyStats.STAGE_PRESENT);
+        FrameStats.markPresent();
+        renderScale.update(System.nanoTime());
     }
 
     private void drawFrame() {
@@ -123,9 +193,10 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
 
         if (viewportNeedsUpdate && magnifierEnabled) {
             if (fullscreen) {
-                GLES20.glViewport(0, 0, surfaceWidth, surfaceHeight);
+                setViewport(0, 0, surfaceWidth, surfaceHeight);
             }
-            else GLES20.glViewport(viewTransformation.viewOffsetX, viewTransformation.viewOffsetY, viewTransformation.viewWidth, viewTransformation.viewHeight);
+            else setViewport(viewTransformation.viewOffsetX, viewTransformation.viewOffsetY, viewTransformation.viewWidth, viewTransformation.viewHeight);
+            GLES20.glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
             viewportNeedsUpdate = false;
         }
 
@@ -163,9 +234,12 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             }
             else XForm.identity(tmpXForm2);
         }
+        viewScissor = !magnifierEnabled && !fullscreen;
 
         renderWindows();
         if (cursorVisible) renderCursor();
+        else cursorDrawn = false;
+        if (frameStatsVisible) renderFrameStats();
 
         if (!magnifierEnabled && !fullscreen) GLES20.glDisable(GLES20.GL_SCISSOR_TEST);
 
@@ -202,7 +276,8 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
 
     @Override
     public void onUpdateWindowGeometry(final Window window, boolean resized) {
-        if (resized) {
+        // a move can start or end fullscreen as well
+        if (resized || unredirected || coversScreen(window)) {
             xServerView.queueEvent(this::updateScene);
         }
         else xServerView.queueEvent(() -> updateWindowPosition(window));
@@ -216,20 +291,43 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
 
     @Override
     public void onPointerMove(short x, short y) {
+        // with the cursor hidden (as most games do) and the view not following the pointer, motion changes nothing on screen
+        boolean followsPointer = screenOffsetYRelativeToCursor || (magnifierEnabled && magnifierZoom != 1.0f);
+        if (!followsPointer && !cursorDrawn && !isCursorShown()) return;
         xServerView.requestRender();
     }
 
+    private boolean coversScreen(Window window) {
+        return window.getRootX() <= 0 && window.getRootY() <= 0 &&
+               window.getRootX() + window.getWidth() >= xServer.screenInfo.width &&
+               window.getRootY() + window.getHeight() >= xServer.screenInfo.height;
+    }
+
+    private boolean isCursorShown() {
+        if (!cursorVisible) return false;
+        Window pointWindow = xServer.inputDeviceManager.getPointWindow();
+        Cursor cursor = pointWindow != null ? pointWindow.attributes.getCursor() : null;
+        return cursor == null || cursor.isVisible();
+    }
+
     private void renderDrawable(Drawable drawable, int x, int y, ShaderMaterial material) {
         renderDrawable(drawable, x, y, material, false);
     }
 
     private void renderDrawable(Drawable drawable, int x, int y, ShaderMaterial material, boolean forceFullscreen) {
+        renderDrawable(drawable, x, y, material, forceFullscreen, null);
+    }
+
+    // Draws the parts of the drawable in visibleRects, one scissored draw each, or all of it when null
+    private void renderDrawable(Drawable drawable, int x, int y, ShaderMaterial material, boolean forceFullscreen, ArrayList<int[]> visibleRects) {
         synchronized (drawable.renderLock) {
+            // freed since the scene was collected, its texture is about to be destroyed
+            if (drawable.isDestroyed()) return;
             Texture texture = drawable.getTexture();
             texture.updateFromDrawable(drawable);
 
             if (forceFullscreen) {
-                short newHeight = (short)Math.min(xServer.screenInfo.height, ((float)xServer.screenInfo.width / drawable.width) * drawable.height);
+                short newHeight = getForcedFullscreenHeight(drawable);
                 short newWidth = (short)(((float)newHeight / drawable.height) * drawable.width);
                 XForm.set(tmpXForm1, (xServer.screenInfo.width - newWidth) * 0.5f, (xServer.screenInfo.height - newHeight) * 0.5f, newWidth, newHeight);
             }
@@ -241,28 +339,97 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, texture.getTextureId());
             GLES20.glUniform1i(material.getUniformLocation("texture"), 0);
             GLES20.glUniform1fv(material.getUniformLocation("xform"), tmpXForm1.length, tmpXForm1, 0);
-            GLES20.glDrawArrays(GLES20.GL_TRIANGLE_STRIP, 0, quadVertices.count());
+            if (material == upscaleMaterial) GLES20.glUniform2f(material.getUniformLocation("texelSize"), 1.0f / drawable.width, 1.0f / drawable.height);
+            if (visibleRects != null) {
+                for (int[] rect : visibleRects) {
+                    if (setScissor(rect)) GLES20.glDrawArrays(GLES20.GL_TRIANGLE_STRIP, 0, quadVertices.count());
+                }
+            }
+            else GLES20.glDrawArrays(GLES20.GL_TRIANGLE_STRIP, 0, quadVertices.count());
             GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, 0);
+            if (texture instanceof GPUImage) ((GPUImage)texture).markDrawn();
         }
     }
 
     private void renderWindows() {
-        windowMaterial.use();
+        // sharpened only when the X screen is stretched onto the display
+        ShaderMaterial windowMaterial = this.windowMaterial;
+        if (upscaleSharpness > 0.0f && (fullscreen || viewTransformation.aspect > 1.0f)) {
+            windowMaterial = upscaleMaterial;
+            upscaleMaterial.use();
+            GLES20.glUniform1f(upscaleMaterial.getUniformLocation("sharpness"), upscaleSharpness);
+        }
+        else windowMaterial.use();
+
         GLES20.glUniform2f(windowMaterial.getUniformLocation("viewSize"), xServer.screenInfo.width, xServer.screenInfo.height);
         quadVertices.bind(windowMaterial.programId);
 
-        try (XLock lock = xServer.lock(XServer.Lockable.DRAWABLE_MANAGER)) {
-            if (renderableWindows.size() > 0) {
-                android.util.Log.d("GLRenderer", "renderWindows: rendering " + renderableWindows.size() + " windows");
+        // nothing shows through an opaque window covering the screen
+        if (unredirected) GLES20.glDisable(GLES20.GL_BLEND);
+        // the uploads only hold each drawable's render lock, X clients keep drawing into the others
+        if (renderableWindows.size() > 0) {
+            android.util.Log.d("GLRenderer", "renderWindows: rendering " + renderableWindows.size() + " windows");
+        }
+        boolean scissored = false;
+        for (RenderableWindow window : renderableWindows) {
+            if (window.visibleRects.isEmpty()) continue;
+            if (window.fullyVisible && scissored) {
+                restoreScissor();
+                scissored = false;
             }
-            for (RenderableWindow window : renderableWindows) {
-                renderDrawable(window.content, window.rootX, window.rootY, windowMaterial, window.forceFullscreen);
+            else if (!window.fullyVisible && !scissored) {
+                if (!viewScissor) GLES20.glEnable(GLES20.GL_SCISSOR_TEST);
+                scissored = true;
             }
+            renderDrawable(window.content, window.rootX, window.rootY, windowMaterial, window.forceFullscreen, window.fullyVisible ? null : window.visibleRects);
         }
+        if (scissored) restoreScissor();
+        if (unredirected) GLES20.glEnable(GLES20.GL_BLEND);
 
         quadVertices.disable();
     }
 
+    private void restoreScissor() {
+        if (viewScissor) GLES20.glScissor(viewTransformation.viewOffsetX, viewTransformation.viewOffsetY, viewTransformation.viewWidth, viewTransformation.viewHeight);
+        else GLES20.glDisable(GLES20.GL_SCISSOR_TEST);
+    }
+
+    private void setViewport(int x, int y, int width, int height) {
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+    }
+
+    // Scissors to a screen space rectangle as the scene transform and the viewport place it on the
+    // surface, kept inside the view when it is letterboxed. False when nothing of it is on the surface.
+    private boolean setScissor(int[] rect) {
+        float[] xform = tmpXForm2;
+        float scaleX = viewport[2] / (float)xServer.screenInfo.width;
+        float scaleY = viewport[3] / (float)xServer.screenInfo.height;
+        float sceneX0 = xform[0] * rect[0] + xform[2] * rect[1] + xform[4];
+        float sceneY0 = xform[1] * rect[0] + xform[3] * rect[1] + xform[5];
+        float sceneX1 = xform[0] * rect[2] + xform[2] * rect[3] + xform[4];
+        float sceneY1 = xform[1] * rect[2] + xform[3] * rect[3] + xform[5];
+
+        // GL window coordinates start at the bottom, the scene at the top
+        int x0 = viewport[0] + (int)Math.floor(Math.min(sceneX0, sceneX1) * scaleX);
+        int x1 = viewport[0] + (int)Math.ceil(Math.max(sceneX0, sceneX1) * scaleX);
+        int y0 = viewport[1] + viewport[3] - (int)Math.ceil(Math.max(sceneY0, sceneY1) * scaleY);
+        int y1 = viewport[1] + viewport[3] - (int)Math.floor(Math.min(sceneY0, sceneY1) * scaleY);
+
+        if (viewScissor) {
+            x0 = Math.max(x0, viewTransformation.viewOffsetX);
+            y0 = Math.max(y0, viewTransformation.viewOffsetY);
+            x1 = Math.min(x1, viewTransformation.viewOffsetX + viewTransformation.viewWidth);
+            y1 = Math.min(y1, viewTransformation.viewOffsetY + viewTransformation.viewHeight);
+        }
+        if (x0 >= x1 || y0 >= y1) return false;
+
+        GLES20.glScissor(x0, y0, x1 - x0, y1 - y0);
+        return true;
+    }
+
     private void renderCursor() {
         cursorMaterial.use();
         GLES20.glUniform2f(cursorMaterial.getUniformLocation("viewSize"), xServer.screenInfo.width, xServer.screenInfo.height);
@@ -275,14 +442,53 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             short y = xServer.pointer.getClampedY();
 
             if (cursor != null) {
-                if (cursor.isVisible()) renderDrawable(cursor.cursorImage, x - cursor.hotSpotX, y - cursor.hotSpotY, cursorMaterial);
+                cursorDrawn = cursor.isVisible();
+                if (cursorDrawn) renderDrawable(cursor.cursorImage, x - cursor.hotSpotX, y - cursor.hotSpotY, cursorMaterial);
+            }
+            else {
+                cursorDrawn = true;
+                renderDrawable(rootCursorDrawable, x, y, cursorMaterial);
             }
-            else renderDrawable(rootCursorDrawable, x, y, cursorMaterial);
         }
 
         quadVertices.disable();
     }
 
+    private void renderFrameStats() {
+        if (frameStatsTextureId == 0) {
+            int[] textureIds = new int[1];
+            GLES20.glGenTextures(1, textureIds, 0);
+            frameStatsTextureId = textureIds[0];
+            GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, frameStatsTextureId);
+            GLES20.glTexImage2D(GLES20.GL_TEXTURE_2D, 0, GLES20.GL_RGBA, FRAME_STATS_FRAMES, 1, 0, GLES20.GL_RGBA, GLES20.GL_UNSIGNED_BYTE, null);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_WRAP_S, GLES20.GL_CLAMP_TO_EDGE);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_WRAP_T, GLES20.GL_CLAMP_TO_EDGE);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_MAG_FILTER, GLES20.GL_NEAREST);
+            GLES20.glTexParameteri(GLES20.GL_TEXTURE_2D, GLES20.GL_TEXTURE_MIN_FILTER, GLES20.GL_NEAREST);
+        }
+
+        FrameStats.fillGraph(frameStatsTexels, FRAME_STATS_FRAMES, FRAME_STATS_SCALE_MICROS);
+
+        frameStatsMaterial.use();
+        GLES20.glUniform2f(frameStatsMaterial.getUniformLocation("viewSize"), xServer.screenInfo.width, xServer.screenInfo.height);
+        GLES20.glUniform1f(frameStatsMaterial.getUniformLocation("targetLine"), (float)FRAME_STATS_TARGET_MICROS / FRAME_STATS_SCALE_MICROS);
+        quadVertices.bind(frameStatsMaterial.programId);
+
+        // top left corner of the screen, not moved by the magnifier
+        XForm.set(tmpXForm1, 8, 8, xServer.screenInfo.width / 3.0f, xServer.screenInfo.height / 6.0f);
+
+        GLES20.glActiveTexture(GLES20.GL_TEXTURE0);
+        GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, frameStatsTextureId);
+        GLES20.glPixelStorei(GLES20.GL_UNPACK_ALIGNMENT, 4);
+        GLES20.glTexSubImage2D(GLES20.GL_TEXTURE_2D, 0, 0, 0, FRAME_STATS_FRAMES, 1, GLES20.GL_RGBA, GLES20.GL_UNSIGNED_BYTE, frameStatsTexels);
+        GLES20.glUniform1i(frameStatsMaterial.getUniformLocation("graph"), 0);
+        GLES20.glUniform1fv(frameStatsMaterial.getUniformLocation("xform"), tmpXForm1.length, tmpXForm1, 0);
+        GLES20.glDrawArrays(GLES20.GL_TRIANGLE_STRIP, 0, quadVertices.count());
+        GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, 0);
+
+        quadVertices.disable();
+    }
+
     public void toggleFullscreen() {
         toggleFullscreen = true;
         xServerView.requestRender();
@@ -293,17 +499,93 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
         BitmapFactory.Options options = new BitmapFactory.Options();
         options.inScaled = false;
         Bitmap bitmap = BitmapFactory.decodeResource(context.getResources(), R.drawable.cursor, options);
-        return Drawable.fromBitmap(bitmap);
+        return Drawable.wrapBitmap(bitmap);
     }
 
     private void updateScene() {
         try (XLock lock = xServer.lock(XServer.Lockable.WINDOW_MANAGER, XServer.Lockable.DRAWABLE_MANAGER)) {
             renderableWindows.clear();
-            collectRenderableWindows(xServer.windowManager.rootWindow, xServer.windowManager.rootWindow.getX(), xServer.windowManager.rootWindow.getY());
+            Window fullscreenWindow = xServer.windowManager.getFullscreenWindow();
+            unredirected = fullscreenWindow != null && !isUnviewable(fullscreenWindow);
+            if (unredirected) {
+                // the windows below it are hidden, none of them has to be drawn
+                renderableWindows.add(new RenderableWindow(fullscreenWindow.getContent(), fullscreenWindow.getRootX(), fullscreenWindow.getRootY()));
+            }
+            else collectRenderableWindows(xServer.windowManager.rootWindow, xServer.windowManager.rootWindow.getX(), xServer.windowManager.rootWindow.getY());
+            cullRenderableWindows();
             android.util.Log.d("GLRenderer", "updateScene: renderableWindows.size=" + renderableWindows.size());
         }
     }
 
+    private short getForcedFullscreenHeight(Drawable drawable) {
+        return (short)Math.min(xServer.screenInfo.height, ((float)xServer.screenInfo.width / drawable.width) * drawable.height);
+    }
+
+    /**
+     * Front to back, each window keeps the parts of its rectangle on screen that no window above
+     * covers. Window contents are drawn opaque, so the covered parts would only be overdrawn.
+     */
+    private void cullRenderableWindows() {
+        int screenWidth = xServer.screenInfo.width;
+        int screenHeight = xServer.screenInfo.height;
+        ArrayList<int[]> coveredRects = new ArrayList<>();
+
+        for (int i = renderableWindows.size()-1; i >= 0; i--) {
+            RenderableWindow window = renderableWindows.get(i);
+            Drawable drawable = window.content;
+            int[] bounds;
+            if (window.forceFullscreen) {
+                short newHeight = getForcedFullscreenHeight(drawable);
+                short newWidth = (short)(((float)newHeight / drawable.height) * drawable.width);
+                int x = (int)((screenWidth - newWidth) * 0.5f);
+                int y = (int)((screenHeight - newHeight) * 0.5f);
+                bounds = new int[]{x, y, x + newWidth, y + newHeight};
+            }
+            else bounds = new int[]{window.rootX, window.rootY, window.rootX + drawable.width, window.rootY + drawable.height};
+
+            int[] onScreen = {Math.max(bounds[0], 0), Math.max(bounds[1], 0), Math.min(bounds[2], screenWidth), Math.min(bounds[3], screenHeight)};
+            window.visibleRects.clear();
+            if (onScreen[0] < onScreen[2] && onScreen[1] < onScreen[3]) window.visibleRects.add(onScreen);
+
+            for (int j = 0; j < coveredRects.size() && !window.visibleRects.isEmpty(); j++) {
+                subtractRect(window.visibleRects, coveredRects.get(j));
+            }
+
+            if (window.visibleRects.size() > MAX_VISIBLE_RECTS) {
+                window.visibleRects.clear();
+                window.visibleRects.add(onScreen);
+            }
+            window.fullyVisible = window.visibleRects.size() == 1 && window.visibleRects.get(0) == onScreen;
+            if (!window.visibleRects.isEmpty()) coveredRects.add(onScreen);
+        }
+    }
+
+    // Replaces the rectangles overlapping cut by the up to four pieces of them around it
+    private static void subtractRect(ArrayList<int[]> rects, int[] cut) {
+        for (int i = rects.size()-1; i >= 0; i--) {
+            int[] rect = rects.get(i);
+            if (cut[0] >= rect[2] || cut[2] <= rect[0] || cut[1] >= rect[3] || cut[3] <= rect[1]) continue;
+
+            rects.remove(i);
+            int y0 = Math.max(rect[1], cut[1]);
+            int y1 = Math.min(rect[3], cut[3]);
+            if (rect[1] < cut[1]) rects.add(new int[]{rect[0], rect[1], rect[2], cut[1]});
+            if (cut[3] < rect[3]) rects.add(new int[]{rect[0], cut[3], rect[2], rect[3]});
+            if (rect[0] < cut[0]) rects.add(new int[]{rect[0], y0, cut[0], y1});
+            if (cut[2] < rect[2]) rects.add(new int[]{cut[2], y0, rect[2], y1});
+        }
+    }
+
+    private boolean isUnviewable(Window window) {
+        if (unviewableWMClasses == null) return false;
+        for (Window ancestor = window; ancestor != null && ancestor != xServer.windowManager.rootWindow; ancestor = ancestor.getParent()) {
+            for (String unviewableWMClass : unviewableWMClasses) {
+                if (ancestor.getClassName().contains(unviewableWMClass)) return true;
+            }
+        }
+        return false;
+    }
+
     private void collectRenderableWindows(Window window, int x, int y) {
         if (!window.attributes.isMapped()) return;
         if (window != xServer.windowManager.rootWindow) {
@@ -406,6 +688,7 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
             if (renderableWindow.content == window.getContent()) {
                 renderableWindow.rootX = window.getRootX();
                 renderableWindow.rootY = window.getRootY();
+                cullRenderableWindows();
                 break;
             }
         }
@@ -416,6 +699,45 @@ public class GLRenderer implements GLSurfaceView.Renderer, WindowManager.OnWindo
         xServerView.requestRender();
     }
 
+    /**
+     * Queues the next composited frame for display at the given CLOCK_MONOTONIC time, the vsync
+     * a frame rate limited client aimed its present at. Later calls replace earlier ones.
+     */
+    public void setPresentationTime(long presentationTime) {
+        this.presentationTime = presentationTime;
+    }
+
+    public RenderScale getRenderScale() {
+        return renderScale;
+    }
+
+    public float getUpscaleSharpness() {
+        return upscaleSharpness;
+    }
+
+    /**
+     * Sharpens the X screen when it is upscaled to the display, 0 for plain bilinear filtering
+     * and up to 1 for the strongest sharpening.
+     */
+    public void setUpscaleSharpness(float upscaleSharpness) {
+        this.upscaleSharpness = Mathf.clamp(upscaleSharpness, 0.0f, 1.0f);
+        xServerView.requestRender();
+    }
+
+    public boolean isFrameStatsVisible() {
+        return frameStatsVisible;
+    }
+
+    /**
+     * Shows the frame time graph: the interval between presents in white, the GPU time after
+     * each present in orange and the CPU decode time in green. Collection runs regardless,
+     * hidden it costs nothing in the composition.
+     */
+    public void setFrameStatsVisible(boolean frameStatsVisible) {
+        this.frameStatsVisible = frameStatsVisible;
+        xServerView.requestRender();
+    }
+
     public boolean isCursorVisible() {
         return cursorVisible;
     }
@@ -1,7 +1,10 @@
 package com.steamdeck.mobile.presentation.renderer;
 
+import android.opengl.GLES30;
+
 import androidx.annotation.Keep;
 
+import com.steamdeck.mobile.core.xconnector.XConnectorEpoll;
 import com.steamdeck.mobile.core.xserver.Drawable;
 
 import java.nio.ByteBuffer;
@@ -13,6 +16,9 @@ public class GPUImage extends Texture {
     private short stride;
     private boolean locked = false;
     private int nativeHandle;
+    private long pendingSync;
+    private int releaseFence = -1;
+    private boolean tracksRelease = false;
     private static boolean supported = false;
 
     static {
@@ -31,6 +37,12 @@ public class GPUImage extends Texture {
         }
     }
 
+    /** Wraps a buffer allocated elsewhere, e.g. a virgl scanout resource. */
+    public GPUImage(long hardwareBufferPtr) {
+        acquireHardwareBuffer(hardwareBufferPtr);
+        this.hardwareBufferPtr = hardwareBufferPtr;
+    }
+
     @Override
     public void allocateTexture(short width, short height, ByteBuffer data) {
         if (isAllocated()) return;
@@ -41,9 +53,49 @@ public class GPUImage extends Texture {
     @Override
     public void updateFromDrawable(Drawable drawable) {
         if (!isAllocated()) allocateTexture(drawable.width, drawable.height, null);
+        if (pendingSync != 0) {
+            GLES30.glWaitSync(pendingSync, 0, GLES30.GL_TIMEOUT_IGNORED);
+            GLES30.glDeleteSync(pendingSync);
+            pendingSync = 0;
+        }
         needsUpdate = false;
     }
 
+    /**
+     * Makes the next draw wait for the producer's rendering instead of
+     * stalling the producer. Takes ownership of the sync object, which has
+     * to be shared with the renderer's context.
+     */
+    public void setPendingSync(long sync) {
+        if (pendingSync != 0) GLES30.glDeleteSync(pendingSync);
+        pendingSync = sync;
+    }
+
+    /**
+     * Called by the renderer after drawing with this image, so a producer that
+     * reuses the buffer can wait until the GPU stopped sampling it.
+     */
+    public synchronized void markDrawn() {
+        if (!tracksRelease) return;
+        int fence = createReleaseFence();
+        if (releaseFence != -1) XConnectorEpoll.closeFd(releaseFence);
+        releaseFence = fence;
+    }
+
+    public void setTracksRelease(boolean tracksRelease) {
+        this.tracksRelease = tracksRelease;
+    }
+
+    /** Blocks until the GPU finished the last draw that read this image. */
+    public void waitForRelease() {
+        int fence;
+        synchronized (this) {
+            fence = releaseFence;
+            releaseFence = -1;
+        }
+        waitFence(fence);
+    }
+
     public short getStride() {
         return stride;
     }
@@ -68,6 +120,14 @@ public class GPUImage extends Texture {
 
     @Override
     public void destroy() {
+        if (pendingSync != 0) {
+            GLES30.glDeleteSync(pendingSync);
+            pendingSync = 0;
+        }
+        synchronized (this) {
+            if (releaseFence != -1) XConnectorEpoll.closeFd(releaseFence);
+            releaseFence = -1;
+        }
         destroyImageKHR(imageKHRPtr);
         destroyHardwareBuffer(hardwareBufferPtr, locked);
         virtualData = null;
@@ -94,6 +154,8 @@ public class GPUImage extends Texture {
 
     private native long createHardwareBuffer(short width, short height, boolean cpuAccess);
 
+    private native void acquireHardwareBuffer(long hardwareBufferPtr);
+
     private native void destroyHardwareBuffer(long hardwareBufferPtr, boolean locked);
 
     private native ByteBuffer lockHardwareBuffer(long hardwareBufferPtr);
@@ -101,4 +163,8 @@ public class GPUImage extends Texture {
     private native long createImageKHR(long hardwareBufferPtr, int textureId);
 
     private native void destroyImageKHR(long imageKHRPtr);
+
+    private static native int createReleaseFence();
+
+    private static native void waitFence(int fenceFd);
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+package com.steamdeck.mobile.presentation.renderer;
+
+import android.content.Context;
+import android.content.SharedPreferences;
+import android.preference.PreferenceManager;
+
+import com.steamdeck.mobile.core.xserver.FrameStats;
+import com.steamdeck.mobile.core.xserver.ScreenInfo;
+
+/**
+ * Internal render resolution of the X screen relative to the display.
+ *
+ * Games size their swapchain from the X screen when they start, so a scale below 1 makes them
+ * render fewer pixels and the compositor upscales with UpscaleMaterial. With the dynamic mode
+ * on, the scale is adjusted from the measured GPU time of the frames (FrameStats) and the
+ * adjusted scale is used for the next X screen; a running game keeps its resolution.
+ */
+public class RenderScale {
+    public static final float MIN_SCALE = 0.5f;
+    public static final float MAX_SCALE = 1.0f;
+    private static final float STEP = 0.1f;
+    private static final String PREF_SCALE = "render_scale";
+    private static final String PREF_DYNAMIC = "dynamic_render_scale";
+    // GPU work still running this long after the present, relative to the frame interval
+    private static final float GPU_BOUND_RATIO = 0.75f;
+    private static final float GPU_IDLE_RATIO = 0.25f;
+    private static final long EVALUATE_INTERVAL_NANOS = 5_000_000_000L;
+    // successive idle evaluations before the scale goes up again, it goes down after one
+    private static final int IDLE_EVALUATIONS = 3;
+
+    private final SharedPreferences preferences;
+    private final long[] averages = new long[4];
+    private long lastEvaluation = 0;
+    private int idleEvaluations = 0;
+
+    public RenderScale(Context context) {
+        preferences = PreferenceManager.getDefaultSharedPreferences(context);
+    }
+
+    public float getScale() {
+        return clamp(preferences.getFloat(PREF_SCALE, MAX_SCALE));
+    }
+
+    public void setScale(float scale) {
+        preferences.edit().putFloat(PREF_SCALE, clamp(scale)).apply();
+    }
+
+    public boolean isDynamic() {
+        return preferences.getBoolean(PREF_DYNAMIC, false);
+    }
+
+    public void setDynamic(boolean dynamic) {
+        preferences.edit().putBoolean(PREF_DYNAMIC, dynamic).apply();
+    }
+
+    /**
+     * The X screen for a display, both dimensions rounded down to even numbers.
+     */
+    public ScreenInfo apply(ScreenInfo display) {
+        float scale = getScale();
+        if (scale >= MAX_SCALE) return display;
+        return new ScreenInfo((int)(display.width * scale) & ~1, (int)(display.height * scale) & ~1);
+    }
+
+    /**
+     * Called by the compositor once per frame, evaluates the recent frames every few seconds
+     * when the dynamic mode is on.
+     */
+    public void update(long now) {
+        if (now - lastEvaluation < EVALUATE_INTERVAL_NANOS) return;
+        lastEvaluation = now;
+        if (!isDynamic()) return;
+
+        FrameStats.getAverages(averages);
+        long interval = averages[0];
+        long gpu = averages[2];
+        if (interval <= 0 || gpu < 0) return;
+
+        float scale = getScale();
+        if (gpu > interval * GPU_BOUND_RATIO) {
+            idleEvaluations = 0;
+            if (scale > MIN_SCALE) setScale(scale - STEP);
+        }
+        else if (gpu < interval * GPU_IDLE_RATIO) {
+            if (++idleEvaluations >= IDLE_EVALUATIONS && scale < MAX_SCALE) {
+                idleEvaluations = 0;
+                setScale(scale + STEP);
+            }
+        }
+        else idleEvaluations = 0;
+    }
+
+    private static float clamp(float scale) {
+        // rounded to the step so repeated adjustments do not drift
+        float rounded = Math.round(scale / STEP) * STEP;
+        return Math.max(MIN_SCALE, Math.min(MAX_SCALE, rounded));
+    }
+}
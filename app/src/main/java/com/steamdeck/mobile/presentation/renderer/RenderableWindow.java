@@ -2,11 +2,16 @@ package com.steamdeck.mobile.presentation.renderer;
 
 import com.steamdeck.mobile.core.xserver.Drawable;
 
+import java.util.ArrayList;
+
 class RenderableWindow {
     final Drawable content;
     short rootX;
     short rootY;
     final boolean forceFullscreen;
+    // x0, y0, x1, y1 in screen space of the parts no window above covers, see GLRenderer.cullRenderableWindows
+    final ArrayList<int[]> visibleRects = new ArrayList<>();
+    boolean fullyVisible = true;
 
     public RenderableWindow(Drawable content, int rootX, int rootY) {
         this(content, rootX, rootY, false);
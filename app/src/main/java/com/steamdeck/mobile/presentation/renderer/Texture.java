@@ -2,11 +2,13 @@ package com.steamdeck.mobile.presentation.renderer;
 
 import android.opengl.GLES11Ext;
 import android.opengl.GLES20;
+import android.opengl.GLES30;
 
 import com.steamdeck.mobile.core.vr.XrActivity;
 import com.steamdeck.mobile.core.xserver.Drawable;
 
 import java.nio.ByteBuffer;
+import java.util.BitSet;
 
 public class Texture {
     protected int textureId = 0;
@@ -16,6 +18,12 @@ public class Texture {
     private int minFilter = GLES20.GL_LINEAR;
     private int format = GLES11Ext.GL_BGRA;
     protected boolean needsUpdate = true;
+    private boolean fullDamage = true;
+    // Damage is tracked per 64x64 tile, bit (tileY << TILE_ROW_SHIFT) + tileX
+    private static final int TILE_SHIFT = 6;
+    private static final int TILE_ROW_SHIFT = 9;
+    private BitSet dirtyTiles = new BitSet();
+    private BitSet uploadTiles = new BitSet();
 
     public void allocateTexture(short width, short height, ByteBuffer data) {
         int[] textureIds = new int[1];
@@ -83,23 +91,86 @@ public class Texture {
         return needsUpdate;
     }
 
-    public void setNeedsUpdate(boolean needsUpdate) {
+    public synchronized void setNeedsUpdate(boolean needsUpdate) {
         this.needsUpdate = needsUpdate;
+        fullDamage = needsUpdate;
+        dirtyTiles.clear();
+    }
+
+    // Marks a region as changed; the next update only uploads the tiles it touches
+    public synchronized void addDamage(int x, int y, int width, int height) {
+        if (width <= 0 || height <= 0) return;
+        if (needsUpdate && fullDamage) return;
+        if (!needsUpdate) {
+            needsUpdate = true;
+            fullDamage = false;
+        }
+
+        int tileX0 = Math.max(x, 0) >> TILE_SHIFT;
+        int tileY0 = Math.max(y, 0) >> TILE_SHIFT;
+        int tileX1 = (x + width - 1) >> TILE_SHIFT;
+        int tileY1 = (y + height - 1) >> TILE_SHIFT;
+        for (int tileY = tileY0; tileY <= tileY1; tileY++) {
+            int row = tileY << TILE_ROW_SHIFT;
+            dirtyTiles.set(row + tileX0, row + tileX1 + 1);
+        }
     }
 
     public void updateFromDrawable(Drawable drawable) {
         ByteBuffer data = drawable.getData();
         if (data == null) return;
 
+        boolean update, full;
+        synchronized (this) {
+            update = needsUpdate;
+            full = fullDamage;
+            BitSet tiles = dirtyTiles;
+            dirtyTiles = uploadTiles;
+            uploadTiles = tiles;
+            needsUpdate = false;
+            fullDamage = false;
+        }
+
+        int tilesX = (drawable.width + (1 << TILE_SHIFT) - 1) >> TILE_SHIFT;
+        int tilesY = (drawable.height + (1 << TILE_SHIFT) - 1) >> TILE_SHIFT;
+        if (update && !full && uploadTiles.cardinality() * 4 >= tilesX * tilesY * 3) full = true;
+
         if (!isAllocated()) {
             allocateTexture(drawable.width, drawable.height, data);
         }
-        else if (needsUpdate) {
+        else if (update && full) {
             GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, textureId);
             GLES20.glTexSubImage2D(GLES20.GL_TEXTURE_2D, 0, 0, 0, drawable.width, drawable.height, format, GLES20.GL_UNSIGNED_BYTE, data);
             GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, 0);
-            needsUpdate = false;
         }
+        else if (update) {
+            GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, textureId);
+            GLES20.glPixelStorei(GLES30.GL_UNPACK_ROW_LENGTH, drawable.width);
+
+            // one upload per run of dirty tiles in a tile row
+            for (int tileY = 0; tileY < tilesY; tileY++) {
+                int row = tileY << TILE_ROW_SHIFT;
+                int tileX = uploadTiles.nextSetBit(row);
+                while (tileX >= 0 && tileX < row + tilesX) {
+                    int endTileX = Math.min(uploadTiles.nextClearBit(tileX), row + tilesX);
+                    int x = (tileX - row) << TILE_SHIFT;
+                    int y = tileY << TILE_SHIFT;
+                    int width = Math.min((endTileX - row) << TILE_SHIFT, drawable.width) - x;
+                    int height = Math.min(y + (1 << TILE_SHIFT), drawable.height) - y;
+
+                    GLES20.glPixelStorei(GLES30.GL_UNPACK_SKIP_PIXELS, x);
+                    GLES20.glPixelStorei(GLES30.GL_UNPACK_SKIP_ROWS, y);
+                    GLES20.glTexSubImage2D(GLES20.GL_TEXTURE_2D, 0, x, y, width, height, format, GLES20.GL_UNSIGNED_BYTE, data);
+                    tileX = uploadTiles.nextSetBit(endTileX);
+                }
+            }
+
+            GLES20.glPixelStorei(GLES30.GL_UNPACK_ROW_LENGTH, 0);
+            GLES20.glPixelStorei(GLES30.GL_UNPACK_SKIP_PIXELS, 0);
+            GLES20.glPixelStorei(GLES30.GL_UNPACK_SKIP_ROWS, 0);
+            GLES20.glBindTexture(GLES20.GL_TEXTURE_2D, 0);
+        }
+        uploadTiles.clear();
     }
 
     public boolean isAllocated() {
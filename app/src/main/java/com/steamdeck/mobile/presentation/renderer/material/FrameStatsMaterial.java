@@ -0,0 +1,45 @@
+package com.steamdeck.mobile.presentation.renderer.material;
+
+public class FrameStatsMaterial extends ShaderMaterial {
+    public FrameStatsMaterial() {
+        setUniformNames("xform", "viewSize", "graph", "targetLine");
+    }
+
+    @Override
+    protected String getVertexShader() {
+        return
+            "uniform float xform[6];\n" +
+            "uniform vec2 viewSize;\n" +
+            "attribute vec2 position;\n" +
+            "varying vec2 vUV;\n" +
+
+            "void main() {\n" +
+                "vUV = position;\n" +
+                "vec2 transformedPos = applyXForm(position, xform);\n" +
+                "gl_Position = vec4(2.0 * transformedPos.x / viewSize.x - 1.0, 1.0 - 2.0 * transformedPos.y / viewSize.y, 0.0, 1.0);\n" +
+            "}"
+        ;
+    }
+
+    @Override
+    protected String getFragmentShader() {
+        // One bar per texel of the graph, see FrameStats.fillGraph()
+        return
+            "precision mediump float;\n" +
+
+            "uniform sampler2D graph;\n" +
+            "uniform float targetLine;\n" +
+            "varying vec2 vUV;\n" +
+
+            "void main() {\n" +
+                "vec4 frame = texture2D(graph, vec2(vUV.x, 0.5));\n" +
+                "float height = 1.0 - vUV.y;\n" +
+                "if (abs(height - targetLine) < 0.01) gl_FragColor = vec4(1.0, 0.2, 0.2, 0.8);\n" +
+                "else if (height < frame.g) gl_FragColor = vec4(0.3, 0.9, 0.3, 0.9);\n" +
+                "else if (height < frame.b) gl_FragColor = vec4(1.0, 0.6, 0.1, 0.9);\n" +
+                "else if (height < frame.r) gl_FragColor = vec4(0.9, 0.9, 0.9, 0.8);\n" +
+                "else gl_FragColor = vec4(0.0, 0.0, 0.0, 0.4);\n" +
+            "}"
+        ;
+    }
+}
@@ -0,0 +1,53 @@
+package com.steamdeck.mobile.presentation.renderer.material;
+
+public class UpscaleMaterial extends ShaderMaterial {
+    public UpscaleMaterial() {
+        setUniformNames("xform", "viewSize", "texture", "texelSize", "sharpness");
+    }
+
+    @Override
+    protected String getVertexShader() {
+        return
+            "uniform float xform[6];\n" +
+            "uniform vec2 viewSize;\n" +
+            "attribute vec2 position;\n" +
+            "varying vec2 vUV;\n" +
+
+            "void main() {\n" +
+                "vUV = position;\n" +
+                "vec2 transformedPos = applyXForm(position, xform);\n" +
+                "gl_Position = vec4(2.0 * transformedPos.x / viewSize.x - 1.0, 1.0 - 2.0 * transformedPos.y / viewSize.y, 0.0, 1.0);\n" +
+            "}"
+        ;
+    }
+
+    @Override
+    protected String getFragmentShader() {
+        // Bilinear upscale followed by contrast adaptive sharpening on the cross around the texel:
+        // flat areas get the full sharpening weight, edges close to the value range get less so
+        // they do not ring
+        return
+            "precision mediump float;\n" +
+
+            "uniform sampler2D texture;\n" +
+            "uniform vec2 texelSize;\n" +
+            "uniform float sharpness;\n" +
+            "varying vec2 vUV;\n" +
+
+            "void main() {\n" +
+                "vec3 b = texture2D(texture, vUV - vec2(0.0, texelSize.y)).rgb;\n" +
+                "vec3 d = texture2D(texture, vUV - vec2(texelSize.x, 0.0)).rgb;\n" +
+                "vec3 e = texture2D(texture, vUV).rgb;\n" +
+                "vec3 f = texture2D(texture, vUV + vec2(texelSize.x, 0.0)).rgb;\n" +
+                "vec3 h = texture2D(texture, vUV + vec2(0.0, texelSize.y)).rgb;\n" +
+
+                "vec3 minRGB = min(min(min(b, d), min(f, h)), e);\n" +
+                "vec3 maxRGB = max(max(max(b, d), max(f, h)), e);\n" +
+                "vec3 amp = sqrt(clamp(min(minRGB, 1.0 - maxRGB) / max(maxRGB, 1.0 / 256.0), 0.0, 1.0));\n" +
+                "vec3 w = -amp * mix(0.125, 0.2, sharpness);\n" +
+
+                "gl_FragColor = vec4(clamp((e + w * (b + d + f + h)) / (1.0 + 4.0 * w), 0.0, 1.0), 1.0);\n" +
+            "}"
+        ;
+    }
+}
@@ -24,6 +24,7 @@ import androidx.hilt.navigation.compose.hiltViewModel
 import com.steamdeck.mobile.R
 import com.steamdeck.mobile.core.xserver.ScreenInfo
 import com.steamdeck.mobile.core.xserver.XServer
+import com.steamdeck.mobile.presentation.renderer.RenderScale
 import com.steamdeck.mobile.presentation.viewmodel.SteamDisplayViewModel
 import com.steamdeck.mobile.presentation.viewmodel.SteamDisplayUiState
 import com.steamdeck.mobile.presentation.widget.XServerView
@@ -75,7 +76,8 @@ fun SteamDisplayScreen(
     // Create XServer instance (X11 protocol server) with device native resolution
     val xServer = remember {
         android.util.Log.e("SteamDisplayScreen", "Creating XServer with resolution: $nativeScreenSize")
-        XServer(ScreenInfo(nativeScreenSize))
+        // scaled down when a render scale is set, the compositor upscales to the display
+        XServer(RenderScale(context).apply(ScreenInfo(nativeScreenSize)))
     }
 
     // XServerView wraps GLSurfaceView for OpenGL rendering